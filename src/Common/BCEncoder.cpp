@@ -0,0 +1,652 @@
+//***************************************************************************************
+// BCEncoder.cpp
+//***************************************************************************************
+
+#include "BCEncoder.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BC_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	//-----------------------------------------------------------------------------
+	// DDS layout (only what is needed to write/read DXT1 and DXT5)
+	//-----------------------------------------------------------------------------
+#pragma pack(push,1)
+	struct DdsPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t RGBBitCount;
+		uint32_t RBitMask;
+		uint32_t GBitMask;
+		uint32_t BBitMask;
+		uint32_t ABitMask;
+	};
+
+	struct DdsHeader
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DdsPixelFormat ddspf;
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+#pragma pack(pop)
+
+	const uint32_t kDdsMagic = 0x20534444; // "DDS "
+	const uint32_t kFourCCDXT1 = 0x31545844;
+	const uint32_t kFourCCDXT5 = 0x35545844;
+
+	const uint32_t kDdsdCaps = 0x1;
+	const uint32_t kDdsdHeight = 0x2;
+	const uint32_t kDdsdWidth = 0x4;
+	const uint32_t kDdsdPixelFormat = 0x1000;
+	const uint32_t kDdsdMipMapCount = 0x20000;
+	const uint32_t kDdsdLinearSize = 0x80000;
+	const uint32_t kDdpfFourCC = 0x4;
+	const uint32_t kDdsCapsComplex = 0x8;
+	const uint32_t kDdsCapsTexture = 0x1000;
+	const uint32_t kDdsCapsMipMap = 0x400000;
+
+	//-----------------------------------------------------------------------------
+	// Colour helpers
+	//-----------------------------------------------------------------------------
+	inline uint16_t To565(uint32_t c)
+	{
+		const uint32_t r = c & 0xFF;
+		const uint32_t g = (c >> 8) & 0xFF;
+		const uint32_t b = (c >> 16) & 0xFF;
+		return (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+	}
+
+	inline uint32_t From565(uint16_t c)
+	{
+		const uint32_t r = (c >> 11) & 0x1F;
+		const uint32_t g = (c >> 5) & 0x3F;
+		const uint32_t b = c & 0x1F;
+		return ((r << 3) | (r >> 2))
+			| (((g << 2) | (g >> 4)) << 8)
+			| (((b << 3) | (b >> 2)) << 16)
+			| 0xFF000000u;
+	}
+
+	inline uint32_t Lerp3(uint32_t a, uint32_t b)
+	{
+		// (2a + b) / 3 per channel
+		uint32_t r = 0;
+		for (int c = 0; c < 24; c += 8)
+			r |= ((2 * ((a >> c) & 0xFF) + ((b >> c) & 0xFF)) / 3) << c;
+		return r | 0xFF000000u;
+	}
+
+	inline uint32_t Lerp2(uint32_t a, uint32_t b)
+	{
+		uint32_t r = 0;
+		for (int c = 0; c < 24; c += 8)
+			r |= ((((a >> c) & 0xFF) + ((b >> c) & 0xFF)) / 2) << c;
+		return r | 0xFF000000u;
+	}
+
+	// Gathers a 4x4 block, replicating edge texels for partial blocks.
+	inline void LoadBlock(const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch,
+		uint32_t bx, uint32_t by, uint32_t block[16])
+	{
+		for (uint32_t y = 0; y < 4; ++y)
+		{
+			const uint32_t sy = std::min(by * 4 + y, height - 1);
+			const uint8_t* row = rgba + sy * rowPitch;
+			if (bx * 4 + 3 < width)
+			{
+				std::memcpy(&block[y * 4], row + bx * 16, 16);
+				continue;
+			}
+			for (uint32_t x = 0; x < 4; ++x)
+			{
+				const uint32_t sx = std::min(bx * 4 + x, width - 1);
+				std::memcpy(&block[y * 4 + x], row + sx * 4, 4);
+			}
+		}
+	}
+
+	//-----------------------------------------------------------------------------
+	// Colour block (shared by BC1 and BC3)
+	//-----------------------------------------------------------------------------
+#if BC_USE_SSE2
+	inline uint32_t HorizontalMinU8(__m128i v)
+	{
+		v = _mm_min_epu8(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_min_epu8(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return (uint32_t)_mm_cvtsi128_si32(v);
+	}
+
+	inline uint32_t HorizontalMaxU8(__m128i v)
+	{
+		v = _mm_max_epu8(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_max_epu8(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return (uint32_t)_mm_cvtsi128_si32(v);
+	}
+
+	// Manhattan RGB distance of four pixels to one palette colour, as 4 x int32.
+	inline __m128i ColorDistance4(__m128i px, __m128i color)
+	{
+		const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+		const __m128i ones = _mm_set1_epi16(1);
+		const __m128i zero = _mm_setzero_si128();
+
+		__m128i d = _mm_or_si128(_mm_subs_epu8(px, color), _mm_subs_epu8(color, px));
+		d = _mm_and_si128(d, rgbMask);
+
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(d, zero), ones);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(d, zero), ones);
+		lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+		hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+		lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 3, 2, 0));
+		hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 3, 2, 0));
+		return _mm_unpacklo_epi64(lo, hi);
+	}
+#endif
+
+	void FindColorEndpoints(const uint32_t block[16], uint32_t& minColor, uint32_t& maxColor)
+	{
+#if BC_USE_SSE2
+		const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 0));
+		const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 4));
+		const __m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 8));
+		const __m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 12));
+		minColor = HorizontalMinU8(_mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3)));
+		maxColor = HorizontalMaxU8(_mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3)));
+#else
+		minColor = 0xFFFFFFFFu;
+		maxColor = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			uint32_t mn = 0, mx = 0;
+			for (int c = 0; c < 32; c += 8)
+			{
+				const uint32_t v = (block[i] >> c) & 0xFF;
+				mn |= std::min(v, (minColor >> c) & 0xFF) << c;
+				mx |= std::max(v, (maxColor >> c) & 0xFF) << c;
+			}
+			minColor = mn;
+			maxColor = mx;
+		}
+#endif
+
+		int mn[3], mx[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			mn[c] = (minColor >> (c * 8)) & 0xFF;
+			mx[c] = (maxColor >> (c * 8)) & 0xFF;
+		}
+
+		// The bounding box assumes channels grow together. Flip red/blue when
+		// they correlate negatively with green.
+		int center[3];
+		for (int c = 0; c < 3; ++c)
+			center[c] = (mn[c] + mx[c]) >> 1;
+
+		int covRG = 0, covBG = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			const int r = (int)(block[i] & 0xFF) - center[0];
+			const int g = (int)((block[i] >> 8) & 0xFF) - center[1];
+			const int b = (int)((block[i] >> 16) & 0xFF) - center[2];
+			covRG += r * g;
+			covBG += b * g;
+		}
+		if (covRG < 0) std::swap(mn[0], mx[0]);
+		if (covBG < 0) std::swap(mn[2], mx[2]);
+
+		// Inset by 1/16 of the range so the ends of the line land on real texels.
+		minColor = 0;
+		maxColor = 0;
+		for (int c = 0; c < 3; ++c)
+		{
+			const int inset = (mx[c] - mn[c]) / 16;
+			minColor |= (uint32_t)std::clamp(mn[c] + inset, 0, 255) << (c * 8);
+			maxColor |= (uint32_t)std::clamp(mx[c] - inset, 0, 255) << (c * 8);
+		}
+	}
+
+	void EncodeColorBlock(const uint32_t block[16], uint8_t* out)
+	{
+		uint32_t minColor, maxColor;
+		FindColorEndpoints(block, minColor, maxColor);
+
+		uint16_t c0 = To565(maxColor);
+		uint16_t c1 = To565(minColor);
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		out[0] = (uint8_t)(c0 & 0xFF);
+		out[1] = (uint8_t)(c0 >> 8);
+		out[2] = (uint8_t)(c1 & 0xFF);
+		out[3] = (uint8_t)(c1 >> 8);
+
+		if (c0 == c1)
+		{
+			std::memset(out + 4, 0, 4);
+			return;
+		}
+
+		uint32_t palette[4];
+		palette[0] = From565(c0);
+		palette[1] = From565(c1);
+		palette[2] = Lerp3(palette[0], palette[1]);
+		palette[3] = Lerp3(palette[1], palette[0]);
+
+		uint32_t indices = 0;
+#if BC_USE_SSE2
+		const __m128i pal0 = _mm_set1_epi32((int)palette[0]);
+		const __m128i pal1 = _mm_set1_epi32((int)palette[1]);
+		const __m128i pal2 = _mm_set1_epi32((int)palette[2]);
+		const __m128i pal3 = _mm_set1_epi32((int)palette[3]);
+		const __m128i one = _mm_set1_epi32(1);
+		const __m128i two = _mm_set1_epi32(2);
+		const __m128i three = _mm_set1_epi32(3);
+
+		for (int q = 0; q < 4; ++q)
+		{
+			const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + q * 4));
+
+			__m128i best = ColorDistance4(px, pal0);
+			__m128i index = _mm_setzero_si128();
+
+			__m128i d = ColorDistance4(px, pal1);
+			__m128i m = _mm_cmplt_epi32(d, best);
+			best = _mm_or_si128(_mm_and_si128(m, d), _mm_andnot_si128(m, best));
+			index = _mm_or_si128(_mm_and_si128(m, one), _mm_andnot_si128(m, index));
+
+			d = ColorDistance4(px, pal2);
+			m = _mm_cmplt_epi32(d, best);
+			best = _mm_or_si128(_mm_and_si128(m, d), _mm_andnot_si128(m, best));
+			index = _mm_or_si128(_mm_and_si128(m, two), _mm_andnot_si128(m, index));
+
+			d = ColorDistance4(px, pal3);
+			m = _mm_cmplt_epi32(d, best);
+			index = _mm_or_si128(_mm_and_si128(m, three), _mm_andnot_si128(m, index));
+
+			alignas(16) uint32_t idx[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(idx), index);
+			for (int i = 0; i < 4; ++i)
+				indices |= idx[i] << ((q * 4 + i) * 2);
+		}
+#else
+		for (int i = 0; i < 16; ++i)
+		{
+			int bestDist = 0x7FFFFFFF;
+			uint32_t bestIndex = 0;
+			for (uint32_t p = 0; p < 4; ++p)
+			{
+				int dist = 0;
+				for (int c = 0; c < 24; c += 8)
+					dist += std::abs((int)((block[i] >> c) & 0xFF) - (int)((palette[p] >> c) & 0xFF));
+				if (dist < bestDist)
+				{
+					bestDist = dist;
+					bestIndex = p;
+				}
+			}
+			indices |= bestIndex << (i * 2);
+		}
+#endif
+
+		std::memcpy(out + 4, &indices, 4);
+	}
+
+	void EncodeAlphaBlock(const uint32_t block[16], uint8_t* out)
+	{
+		uint32_t minA = 255, maxA = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			const uint32_t a = block[i] >> 24;
+			minA = std::min(minA, a);
+			maxA = std::max(maxA, a);
+		}
+
+		out[0] = (uint8_t)maxA;
+		out[1] = (uint8_t)minA;
+
+		uint64_t bits = 0;
+		if (maxA != minA)
+		{
+			// 8-value mode: step 0 is maxA (index 0), step 7 is minA (index 1),
+			// steps 1..6 map to indices 2..7.
+			const uint32_t range = maxA - minA;
+			for (int i = 0; i < 16; ++i)
+			{
+				const uint32_t a = block[i] >> 24;
+				const uint32_t step = ((maxA - a) * 14 + range) / (2 * range);
+				const uint64_t index = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+				bits |= index << (i * 3);
+			}
+		}
+
+		for (int i = 0; i < 6; ++i)
+			out[2 + i] = (uint8_t)(bits >> (i * 8));
+	}
+
+	void DecodeColorBlock(const uint8_t* in, uint32_t block[16], bool allowPunchThrough)
+	{
+		const uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8));
+		const uint16_t c1 = (uint16_t)(in[2] | (in[3] << 8));
+
+		uint32_t palette[4];
+		palette[0] = From565(c0);
+		palette[1] = From565(c1);
+		if (c0 > c1 || !allowPunchThrough)
+		{
+			palette[2] = Lerp3(palette[0], palette[1]);
+			palette[3] = Lerp3(palette[1], palette[0]);
+		}
+		else
+		{
+			palette[2] = Lerp2(palette[0], palette[1]);
+			palette[3] = 0;
+		}
+
+		uint32_t indices;
+		std::memcpy(&indices, in + 4, 4);
+		for (int i = 0; i < 16; ++i)
+			block[i] = palette[(indices >> (i * 2)) & 3];
+	}
+
+	void DecodeAlphaBlock(const uint8_t* in, uint32_t block[16])
+	{
+		const uint32_t a0 = in[0];
+		const uint32_t a1 = in[1];
+
+		uint32_t palette[8];
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1)
+		{
+			for (uint32_t i = 1; i < 7; ++i)
+				palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+		}
+		else
+		{
+			for (uint32_t i = 1; i < 5; ++i)
+				palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t bits = 0;
+		for (int i = 0; i < 6; ++i)
+			bits |= (uint64_t)in[2 + i] << (i * 8);
+
+		for (int i = 0; i < 16; ++i)
+			block[i] = (block[i] & 0x00FFFFFFu) | (palette[(bits >> (i * 3)) & 7] << 24);
+	}
+
+	void EncodeRows(BCEncoder::Format format, const uint8_t* rgba, uint32_t width, uint32_t height,
+		size_t rowPitch, uint8_t* output, uint32_t firstRow, uint32_t lastRow)
+	{
+		const uint32_t blocksX = (width + 3) / 4;
+		const size_t blockBytes = BCEncoder::BlockBytes(format);
+
+		uint32_t block[16];
+		for (uint32_t by = firstRow; by < lastRow; ++by)
+		{
+			uint8_t* out = output + (size_t)by * blocksX * blockBytes;
+			for (uint32_t bx = 0; bx < blocksX; ++bx, out += blockBytes)
+			{
+				LoadBlock(rgba, width, height, rowPitch, bx, by, block);
+				if (format == BCEncoder::Format::BC3)
+				{
+					EncodeAlphaBlock(block, out);
+					EncodeColorBlock(block, out + 8);
+				}
+				else
+				{
+					EncodeColorBlock(block, out);
+				}
+			}
+		}
+	}
+
+	void Downsample(const uint8_t* src, uint32_t width, uint32_t height, size_t rowPitch,
+		std::vector<uint8_t>& dst, uint32_t& dstWidth, uint32_t& dstHeight)
+	{
+		dstWidth = std::max(1u, width / 2);
+		dstHeight = std::max(1u, height / 2);
+		dst.resize((size_t)dstWidth * dstHeight * 4);
+
+		for (uint32_t y = 0; y < dstHeight; ++y)
+		{
+			const uint8_t* r0 = src + std::min(y * 2, height - 1) * rowPitch;
+			const uint8_t* r1 = src + std::min(y * 2 + 1, height - 1) * rowPitch;
+			for (uint32_t x = 0; x < dstWidth; ++x)
+			{
+				const uint32_t x0 = std::min(x * 2, width - 1) * 4;
+				const uint32_t x1 = std::min(x * 2 + 1, width - 1) * 4;
+				for (int c = 0; c < 4; ++c)
+					dst[((size_t)y * dstWidth + x) * 4 + c] =
+						(uint8_t)((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) / 4);
+			}
+		}
+	}
+}
+
+size_t BCEncoder::CompressedSize(Format format, uint32_t width, uint32_t height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+void BCEncoder::Encode(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch,
+	uint8_t* output, unsigned threadCount)
+{
+	const uint32_t blockRows = (height + 3) / 4;
+
+	JobSystem& jobs = JobSystem::Get();
+	if (threadCount == 0)
+		threadCount = jobs.GetThreadCount();
+	threadCount = std::min<unsigned>(threadCount, blockRows);
+
+	if (threadCount <= 1)
+	{
+		EncodeRows(format, rgba, width, height, rowPitch, output, 0, blockRows);
+		return;
+	}
+
+	// A few bands per thread, so threads that finish early steal the rest
+	const size_t grain = (std::max)(1u, blockRows / (threadCount * 4));
+	jobs.ParallelFor(blockRows, grain, [&](size_t first, size_t last)
+	{
+		EncodeRows(format, rgba, width, height, rowPitch, output, (uint32_t)first, (uint32_t)last);
+	});
+}
+
+void BCEncoder::Decode(Format format, const uint8_t* blocks, uint32_t width, uint32_t height,
+	uint8_t* rgba, size_t rowPitch)
+{
+	const uint32_t blocksX = (width + 3) / 4;
+	const uint32_t blocksY = (height + 3) / 4;
+	const size_t blockBytes = BlockBytes(format);
+
+	uint32_t block[16];
+	for (uint32_t by = 0; by < blocksY; ++by)
+	{
+		for (uint32_t bx = 0; bx < blocksX; ++bx)
+		{
+			const uint8_t* in = blocks + ((size_t)by * blocksX + bx) * blockBytes;
+			if (format == Format::BC3)
+			{
+				DecodeColorBlock(in + 8, block, false);
+				DecodeAlphaBlock(in, block);
+			}
+			else
+			{
+				DecodeColorBlock(in, block, true);
+			}
+
+			for (uint32_t y = 0; y < 4 && by * 4 + y < height; ++y)
+				for (uint32_t x = 0; x < 4 && bx * 4 + x < width; ++x)
+					std::memcpy(rgba + (by * 4 + y) * rowPitch + (bx * 4 + x) * 4, &block[y * 4 + x], 4);
+		}
+	}
+}
+
+double BCEncoder::ComputePSNR(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t height,
+	size_t rowPitch, bool includeAlpha)
+{
+	const int channels = includeAlpha ? 4 : 3;
+
+	double sum = 0.0;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const uint8_t* ra = a + y * rowPitch;
+		const uint8_t* rb = b + y * rowPitch;
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			for (int c = 0; c < channels; ++c)
+			{
+				const double d = (double)ra[x * 4 + c] - (double)rb[x * 4 + c];
+				sum += d * d;
+			}
+		}
+	}
+
+	const double mse = sum / ((double)width * height * channels);
+	if (mse <= 0.0)
+		return 99.0;
+	return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+bool BCEncoder::SaveDDS(const std::wstring& fileName, Format format, const uint8_t* rgba,
+	uint32_t width, uint32_t height, size_t rowPitch, bool generateMips, unsigned threadCount, SaveStats* stats)
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	if (stats)
+		*stats = SaveStats();
+	if (width == 0 || height == 0)
+		return false;
+
+	uint32_t mipCount = 1;
+	if (generateMips)
+	{
+		for (uint32_t s = std::max(width, height); s > 1; s >>= 1)
+			++mipCount;
+	}
+
+	DdsHeader header = {};
+	header.size = sizeof(DdsHeader);
+	header.flags = kDdsdCaps | kDdsdHeight | kDdsdWidth | kDdsdPixelFormat | kDdsdLinearSize;
+	header.height = height;
+	header.width = width;
+	header.pitchOrLinearSize = (uint32_t)CompressedSize(format, width, height);
+	header.mipMapCount = mipCount;
+	header.ddspf.size = sizeof(DdsPixelFormat);
+	header.ddspf.flags = kDdpfFourCC;
+	header.ddspf.fourCC = format == Format::BC1 ? kFourCCDXT1 : kFourCCDXT5;
+	header.caps = kDdsCapsTexture;
+	if (mipCount > 1)
+	{
+		header.flags |= kDdsdMipMapCount;
+		header.caps |= kDdsCapsComplex | kDdsCapsMipMap;
+	}
+
+	std::ofstream file(std::filesystem::path(fileName), std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	file.write(reinterpret_cast<const char*>(&kDdsMagic), sizeof(kDdsMagic));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	std::vector<uint8_t> blocks;
+	std::vector<uint8_t> mip;
+	std::vector<uint8_t> nextMip;
+	const uint8_t* src = rgba;
+	size_t srcPitch = rowPitch;
+	uint32_t w = width, h = height;
+
+	for (uint32_t level = 0; level < mipCount; ++level)
+	{
+		blocks.resize(CompressedSize(format, w, h));
+		const Clock::time_point encodeStart = Clock::now();
+		Encode(format, src, w, h, srcPitch, blocks.data(), threadCount);
+		if (stats)
+		{
+			stats->EncodeMs += std::chrono::duration<double, std::milli>(Clock::now() - encodeStart).count();
+			stats->EncodedPixels += (uint64_t)w * h;
+		}
+		file.write(reinterpret_cast<const char*>(blocks.data()), (std::streamsize)blocks.size());
+
+		if (level + 1 < mipCount)
+		{
+			uint32_t nw, nh;
+			Downsample(src, w, h, srcPitch, nextMip, nw, nh);
+			mip.swap(nextMip);
+			src = mip.data();
+			srcPitch = (size_t)nw * 4;
+			w = nw;
+			h = nh;
+		}
+	}
+
+	file.close();
+	if (stats)
+		stats->TotalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	return (bool)file;
+}
+
+bool BCEncoder::LoadDDS(const std::wstring& fileName, std::vector<uint8_t>& rgba,
+	uint32_t& width, uint32_t& height, Format* format)
+{
+	std::ifstream file(std::filesystem::path(fileName), std::ios::binary);
+	if (!file)
+		return false;
+
+	uint32_t magic = 0;
+	DdsHeader header = {};
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || magic != kDdsMagic || header.size != sizeof(DdsHeader) || !(header.ddspf.flags & kDdpfFourCC))
+		return false;
+
+	Format fmt;
+	if (header.ddspf.fourCC == kFourCCDXT1)
+		fmt = Format::BC1;
+	else if (header.ddspf.fourCC == kFourCCDXT5)
+		fmt = Format::BC3;
+	else
+		return false;
+
+	width = header.width;
+	height = header.height;
+
+	std::vector<uint8_t> blocks(CompressedSize(fmt, width, height));
+	file.read(reinterpret_cast<char*>(blocks.data()), (std::streamsize)blocks.size());
+	if (!file)
+		return false;
+
+	rgba.resize((size_t)width * height * 4);
+	Decode(fmt, blocks.data(), width, height, rgba.data(), (size_t)width * 4);
+
+	if (format)
+		*format = fmt;
+	return true;
+}
@@ -0,0 +1,60 @@
+//***************************************************************************************
+// BCEncoder.h
+//
+// Fast block compressor for RGBA8 images (BC1 / BC3). Endpoints come from the
+// inset bounding box of each block with a diagonal flip, indices are picked
+// with SSE2 when available. Rows of blocks are spread across the JobSystem.
+// Output is plain DXT1/DXT5 DDS, so DDSTextureLoader reads it back as is.
+//
+// Has no dependency on Windows or Direct3D headers.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class BCEncoder
+{
+public:
+	enum class Format
+	{
+		BC1, // RGB, 8 bytes per block; always the opaque mode, alpha decodes as 255 ("DXT1")
+		BC3, // RGB + interpolated alpha, 16 bytes     ("DXT5")
+	};
+
+	static size_t BlockBytes(Format format) { return format == Format::BC1 ? 8 : 16; }
+	static size_t CompressedSize(Format format, uint32_t width, uint32_t height);
+
+	// Compresses a width x height RGBA8 image. rowPitch is in bytes; output
+	// receives CompressedSize(...) bytes, block rows tightly packed.
+	// threadCount == 0 uses every JobSystem thread, 1 encodes on the caller.
+	static void Encode(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch,
+		uint8_t* output, unsigned threadCount = 0);
+
+	static void Decode(Format format, const uint8_t* blocks, uint32_t width, uint32_t height,
+		uint8_t* rgba, size_t rowPitch);
+
+	// PSNR over the RGB channels (and alpha when includeAlpha), in dB.
+	static double ComputePSNR(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t height,
+		size_t rowPitch, bool includeAlpha);
+
+	// Where SaveDDS spent its time: Encode calls alone, and everything
+	struct SaveStats
+	{
+		double EncodeMs = 0.0;
+		uint64_t EncodedPixels = 0;   // over all mip levels
+		double TotalMs = 0.0;         // with mip generation and file I/O
+	};
+
+	// Writes a DDS with the full mip chain (box filtered) when generateMips is set.
+	static bool SaveDDS(const std::wstring& fileName, Format format, const uint8_t* rgba,
+		uint32_t width, uint32_t height, size_t rowPitch, bool generateMips, unsigned threadCount = 0,
+		SaveStats* stats = nullptr);
+
+	// Reads the top mip of a DXT1/DXT5 DDS back into RGBA8.
+	static bool LoadDDS(const std::wstring& fileName, std::vector<uint8_t>& rgba,
+		uint32_t& width, uint32_t& height, Format* format = nullptr);
+};
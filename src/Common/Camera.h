@@ -11,7 +11,9 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
-#include "d3dUtil.h"
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+#include <cassert>
 
 class Camera
 {
@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------------------
+// File: DDSTextureData.h
+//
+// The device-free stage of DDSTextureLoader: reads or maps a DDS file, validates
+// its headers and lays out the subresources, without touching D3D. Safe on any
+// thread; CreateDDSTextureFromData12 (DDSTextureLoader.h) then creates the
+// resources on the thread that owns the command list.
+//
+// Needs only dxgiformat.h, so it builds on Linux as well (with dxgiformat.h
+// from DirectX-Headers and a sal.h on the include path).
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FileMapping.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <dxgiformat.h>
+#else
+#include <sal.h>
+#include <dxgiformat.h>
+
+// The few winerror.h definitions the parse stage returns
+typedef int32_t HRESULT;
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define S_OK ((HRESULT)0L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_POINTER ((HRESULT)0x80004003L)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_INVALID_DATA 13L
+#define ERROR_HANDLE_EOF 38L
+#define ERROR_NOT_SUPPORTED 50L
+#define HRESULT_FROM_WIN32(x) ((HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0x0000FFFF) | (7 << 16) | 0x80000000))
+#endif
+
+#ifndef _Use_decl_annotations_
+#define _Use_decl_annotations_
+#endif
+
+namespace DirectX
+{
+    enum DDS_ALPHA_MODE
+    {
+        DDS_ALPHA_MODE_UNKNOWN       = 0,
+        DDS_ALPHA_MODE_STRAIGHT      = 1,
+        DDS_ALPHA_MODE_PREMULTIPLIED = 2,
+        DDS_ALPHA_MODE_OPAQUE        = 3,
+        DDS_ALPHA_MODE_CUSTOM        = 4,
+    };
+
+    // Whole-file read buffer. Capacity is kept when it goes back to a pool.
+    struct DDSReadBuffer
+    {
+        std::unique_ptr<uint8_t[]> Data;
+        size_t Capacity = 0;
+        size_t Size = 0;
+    };
+
+    // Thread-safe free list of read buffers, so a batch of loads reuses a few
+    // large allocations instead of allocating one per file.
+    class DDSReadBufferPool
+    {
+    public:
+        DDSReadBuffer Acquire(size_t size);
+        void Release(DDSReadBuffer&& buffer);
+        void Clear();
+
+        size_t GetAllocationCount() const { return mAllocations; }
+
+    private:
+        std::mutex mMutex;
+        std::vector<DDSReadBuffer> mFree;
+        size_t mAllocations = 0;
+    };
+
+    // One mip of one array slice inside the file data. Same members as
+    // D3D12_SUBRESOURCE_DATA, which CreateDDSTextureFromData12 converts it to.
+    struct DDSSubresource
+    {
+        const void* pData = nullptr;
+        size_t RowPitch = 0;
+        size_t SlicePitch = 0;
+    };
+
+    struct DDSTextureData
+    {
+        DDSReadBuffer FileData;                         // InitData points into this...
+        MappedFile Mapping;                             // ...or into this, for mapped loads
+        uint32_t ResourceDimension = 0;                 // D3D12_RESOURCE_DIMENSION
+        size_t Width = 0;
+        size_t Height = 0;
+        size_t Depth = 0;
+        size_t MipCount = 0;
+        size_t ArraySize = 0;
+        DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+        bool IsCubeMap = false;
+        DDS_ALPHA_MODE AlphaMode = DDS_ALPHA_MODE_UNKNOWN;
+        std::vector<DDSSubresource> InitData;
+    };
+
+    HRESULT LoadDDSTextureData12(_In_z_ const wchar_t* szFileName,
+                                 _Out_ DDSTextureData& data,
+                                 _In_opt_ DDSReadBufferPool* pool = nullptr,
+                                 _In_ size_t maxsize = 0
+                                 );
+
+    // Zero-copy variant: maps the file and points InitData straight into the
+    // mapping, so no read buffer is needed. The mapping stays alive until
+    // ReleaseDDSTextureData, i.e. until the upload has been recorded.
+    HRESULT LoadDDSTextureDataMapped12(_In_z_ const wchar_t* szFileName,
+                                       _Out_ DDSTextureData& data,
+                                       _In_ size_t maxsize = 0
+                                       );
+
+    // Returns the file buffer to the pool and closes the mapping; data is empty afterwards.
+    void ReleaseDDSTextureData(_Inout_ DDSTextureData& data, _In_opt_ DDSReadBufferPool* pool);
+}
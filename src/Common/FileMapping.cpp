@@ -0,0 +1,227 @@
+//***************************************************************************************
+// FileMapping.cpp
+//***************************************************************************************
+
+#include "FileMapping.h"
+
+#include <new>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) noexcept
+{
+	Swap(rhs);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& rhs) noexcept
+{
+	if (this != &rhs)
+	{
+		Close();
+		Swap(rhs);
+	}
+	return *this;
+}
+
+void MappedFile::Swap(MappedFile& rhs) noexcept
+{
+	std::swap(mOpen, rhs.mOpen);
+	std::swap(mData, rhs.mData);
+	std::swap(mSize, rhs.mSize);
+	std::swap(mView, rhs.mView);
+	std::swap(mBuffer, rhs.mBuffer);
+#if defined(_WIN32)
+	std::swap(mFile, rhs.mFile);
+	std::swap(mMapping, rhs.mMapping);
+#else
+	std::swap(mFd, rhs.mFd);
+#endif
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::wstring& fileName, Mode mode)
+{
+	Close();
+
+	HANDLE file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || (uint64_t)fileSize.QuadPart > (uint64_t)SIZE_MAX)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	mFile = file;
+	mSize = (size_t)fileSize.QuadPart;
+	mOpen = true;
+
+	if (mSize == 0 || mode == Mode::Positional)
+		return true;
+
+	if (mode == Mode::Map)
+	{
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr)
+		{
+			void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (view != nullptr)
+			{
+				mMapping = mapping;
+				mView = view;
+				mData = static_cast<const uint8_t*>(view);
+				return true;
+			}
+			CloseHandle(mapping);
+		}
+	}
+
+	mBuffer.reset(new (std::nothrow) uint8_t[mSize]);
+	if (!mBuffer || ReadAt(0, mBuffer.get(), mSize) != mSize)
+	{
+		Close();
+		return false;
+	}
+	mData = mBuffer.get();
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mView)
+		UnmapViewOfFile(mView);
+	if (mMapping)
+		CloseHandle(static_cast<HANDLE>(mMapping));
+	if (mFile)
+		CloseHandle(static_cast<HANDLE>(mFile));
+
+	mView = nullptr;
+	mMapping = nullptr;
+	mFile = nullptr;
+	mBuffer.reset();
+	mData = nullptr;
+	mSize = 0;
+	mOpen = false;
+}
+
+size_t MappedFile::ReadAt(uint64_t offset, void* dst, size_t size) const
+{
+	if (!mFile)
+		return 0;
+
+	size_t total = 0;
+	while (total < size)
+	{
+		OVERLAPPED ov = {};
+		const uint64_t pos = offset + total;
+		ov.Offset = (DWORD)(pos & 0xFFFFFFFFu);
+		ov.OffsetHigh = (DWORD)(pos >> 32);
+
+		const DWORD chunk = (DWORD)((size - total) > 0x40000000u ? 0x40000000u : (size - total));
+		DWORD read = 0;
+		if (!ReadFile(static_cast<HANDLE>(mFile), static_cast<uint8_t*>(dst) + total, chunk, &read, &ov) || read == 0)
+			break;
+		total += read;
+	}
+	return total;
+}
+
+#else
+
+bool MappedFile::Open(const std::wstring& fileName, Mode mode)
+{
+	Close();
+
+	const std::string path = std::filesystem::path(fileName).string();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st = {};
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	mFd = fd;
+	mSize = (size_t)st.st_size;
+	mOpen = true;
+
+	if (mSize == 0 || mode == Mode::Positional)
+		return true;
+
+	if (mode == Mode::Map)
+	{
+		void* view = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED)
+		{
+			mView = view;
+			mData = static_cast<const uint8_t*>(view);
+			return true;
+		}
+	}
+
+	mBuffer.reset(new (std::nothrow) uint8_t[mSize]);
+	if (!mBuffer || ReadAt(0, mBuffer.get(), mSize) != mSize)
+	{
+		Close();
+		return false;
+	}
+	mData = mBuffer.get();
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mView)
+		munmap(mView, mSize);
+	if (mFd >= 0)
+		::close(mFd);
+
+	mView = nullptr;
+	mFd = -1;
+	mBuffer.reset();
+	mData = nullptr;
+	mSize = 0;
+	mOpen = false;
+}
+
+size_t MappedFile::ReadAt(uint64_t offset, void* dst, size_t size) const
+{
+	if (mFd < 0)
+		return 0;
+
+	size_t total = 0;
+	while (total < size)
+	{
+		const ssize_t read = pread(mFd, static_cast<uint8_t*>(dst) + total, size - total, (off_t)(offset + total));
+		if (read <= 0)
+			break;
+		total += (size_t)read;
+	}
+	return total;
+}
+
+#endif
@@ -0,0 +1,67 @@
+//***************************************************************************************
+// FileMapping.h
+//
+// Read-only view of a whole file. Mode::Map maps it into the address space
+// (MapViewOfFile / mmap) so callers can point straight into the file without
+// a copy; Mode::Read reads it into an owned buffer with positional reads
+// (ReadFile with an offset / pread); Mode::Positional only opens it, for
+// callers that ReadAt into their own buffers. ReadAt works in every mode.
+//
+// No Windows headers leak from here, so it builds on Linux as well.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+class MappedFile
+{
+public:
+	enum class Mode
+	{
+		Map,
+		Read,
+		Positional,                         // GetData() stays null
+	};
+
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& rhs) noexcept;
+	MappedFile& operator=(MappedFile&& rhs) noexcept;
+
+	// Falls back to Mode::Read when the file cannot be mapped.
+	bool Open(const std::wstring& fileName, Mode mode = Mode::Map);
+	void Close();
+
+	// Positional read straight from the file, independent of the view.
+	size_t ReadAt(uint64_t offset, void* dst, size_t size) const;
+
+	bool IsOpen() const { return mOpen; }
+	bool IsMapped() const { return mView != nullptr; }
+	const uint8_t* GetData() const { return mData; }
+	size_t GetSize() const { return mSize; }
+
+private:
+	void Swap(MappedFile& rhs) noexcept;
+
+private:
+	bool mOpen = false;
+	const uint8_t* mData = nullptr;
+	size_t mSize = 0;
+
+	void* mView = nullptr;                  // mapped view, if any
+	std::unique_ptr<uint8_t[]> mBuffer;     // Mode::Read contents
+
+#if defined(_WIN32)
+	void* mFile = nullptr;                  // HANDLE
+	void* mMapping = nullptr;               // HANDLE
+#else
+	int mFd = -1;
+#endif
+};
@@ -0,0 +1,260 @@
+//***************************************************************************************
+// FramePipeline.h
+//
+// Two-stage frame pipeline: the simulation thread (the one that calls
+// BeginPacket and Publish) fills a packet per frame, a render thread draws
+// each packet it takes. Packets go through a TripleBuffer, so the handoff
+// takes no lock; the threads only sleep on a condition variable when one
+// has to wait for the other.
+//
+// Paced (the default), BeginPacket waits until the render thread has taken
+// the packet published before, so simulation of frame N + 1 overlaps the
+// drawing of frame N and never runs further ahead: every packet is drawn,
+// in order, and at most two exist outside the producer's slot. Unpaced, the
+// simulation runs free and a packet the render thread had no time for is
+// replaced by the next one; that suits packets that carry everything by
+// value, since nothing then bounds how far ahead the simulation reuses what
+// a packet refers to.
+//
+// A render callback that throws stops the drawing; the exception is rethrown
+// on the simulation thread by its next BeginPacket, Publish or Drain.
+//
+// Has no dependency on Windows headers.
+//***************************************************************************************
+
+#pragma once
+
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct FramePipelineStats
+{
+	uint64_t Published = 0;
+	uint64_t Rendered = 0;
+	uint64_t Dropped = 0;           // replaced before the render thread took them (unpaced only)
+	double SimulationWaitMs = 0.0;  // BeginPacket and Drain waiting for the render thread
+	double RenderIdleMs = 0.0;      // the render thread waiting for a packet
+	double HandoffMs = 0.0;         // from Publish until taken, summed over rendered packets
+};
+
+template <typename Packet>
+class FramePipeline
+{
+public:
+	FramePipeline() = default;
+	~FramePipeline() { Stop(); }
+
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	// Starts the render thread. threadStart, if given, runs on it first (e.g.
+	// to name it for the profiler); render then runs for every packet taken.
+	void Start(std::function<void(const Packet&)> render, std::function<void()> threadStart = nullptr, bool paced = true);
+	// Draws what was published, then ends the render thread. A render error
+	// not yet rethrown is dropped.
+	void Stop();
+	bool IsRunning() const { return mThread.joinable(); }
+
+	// Simulation side: the packet for the next frame, to be filled completely
+	Packet& BeginPacket();
+	void Publish();
+	// Returns once every published packet is drawn and the render thread is
+	// idle, so the caller may touch whatever the render callback uses
+	void Drain();
+
+	FramePipelineStats GetStats() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Slot
+	{
+		Packet Value;
+		Clock::time_point Published;
+	};
+
+	void RenderMain(std::function<void()> threadStart);
+	void RethrowRenderError();
+	static double Ms(Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); }
+
+	TripleBuffer<Slot> mSlots;
+	std::function<void(const Packet&)> mRender;
+	std::thread mThread;
+	bool mPaced = true;
+
+	std::atomic<uint64_t> mPublished{ 0 };
+	std::atomic<uint64_t> mFinished{ 0 };           // drawn or dropped
+	std::atomic<uint64_t> mRendered{ 0 };
+	std::atomic<uint64_t> mDropped{ 0 };
+	std::atomic<bool> mFailed{ false };
+	double mSimulationWaitMs = 0.0;                 // simulation thread's
+	std::atomic<double> mRenderIdleMs{ 0.0 };       // written by the render thread only
+	std::atomic<double> mHandoffMs{ 0.0 };
+
+	std::mutex mLock;                               // guards the rest; held only to sleep and wake
+	std::condition_variable mRenderWake;
+	std::condition_variable mSimulationWake;
+	bool mQuit = false;
+	std::exception_ptr mError;
+};
+
+template <typename Packet>
+void FramePipeline<Packet>::Start(std::function<void(const Packet&)> render, std::function<void()> threadStart, bool paced)
+{
+	if (IsRunning())
+		return;
+	mRender = std::move(render);
+	mPaced = paced;
+	mQuit = false;
+	mFailed.store(false);
+	mError = nullptr;
+	mThread = std::thread(&FramePipeline::RenderMain, this, std::move(threadStart));
+}
+
+template <typename Packet>
+void FramePipeline<Packet>::Stop()
+{
+	if (!IsRunning())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mQuit = true;
+		mError = nullptr;
+	}
+	mRenderWake.notify_one();
+	mThread.join();
+}
+
+template <typename Packet>
+void FramePipeline<Packet>::RethrowRenderError()
+{
+	if (!mFailed.load())
+		return;
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		error = mError;
+		mError = nullptr;
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+template <typename Packet>
+Packet& FramePipeline<Packet>::BeginPacket()
+{
+	if (mPaced && IsRunning() && mSlots.HasFresh())
+	{
+		const Clock::time_point start = Clock::now();
+		std::unique_lock<std::mutex> lock(mLock);
+		mSimulationWake.wait(lock, [this]() { return !mSlots.HasFresh(); });
+		lock.unlock();
+		mSimulationWaitMs += Ms(start);
+	}
+	RethrowRenderError();
+	return mSlots.GetBack().Value;
+}
+
+template <typename Packet>
+void FramePipeline<Packet>::Publish()
+{
+	RethrowRenderError();
+	mSlots.GetBack().Published = Clock::now();
+	mPublished.fetch_add(1);
+	if (mSlots.Publish())
+	{
+		mDropped.fetch_add(1);
+		mFinished.fetch_add(1);
+	}
+	// Taking the lock orders this with the render thread's check before it
+	// sleeps, so the wake-up cannot be missed
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+	}
+	mRenderWake.notify_one();
+}
+
+template <typename Packet>
+void FramePipeline<Packet>::Drain()
+{
+	if (IsRunning() && mFinished.load() != mPublished.load())
+	{
+		const Clock::time_point start = Clock::now();
+		std::unique_lock<std::mutex> lock(mLock);
+		mSimulationWake.wait(lock, [this]() { return mFinished.load() == mPublished.load(); });
+		lock.unlock();
+		mSimulationWaitMs += Ms(start);
+	}
+	RethrowRenderError();
+}
+
+template <typename Packet>
+void FramePipeline<Packet>::RenderMain(std::function<void()> threadStart)
+{
+	if (threadStart)
+		threadStart();
+
+	for (;;)
+	{
+		{
+			const Clock::time_point start = Clock::now();
+			std::unique_lock<std::mutex> lock(mLock);
+			mRenderWake.wait(lock, [this]() { return mQuit || mSlots.HasFresh(); });
+			mRenderIdleMs.store(mRenderIdleMs.load(std::memory_order_relaxed) + Ms(start), std::memory_order_relaxed);
+			if (!mSlots.HasFresh())
+				break;
+		}
+
+		mSlots.Acquire();
+		const Slot& slot = mSlots.GetFront();
+		mHandoffMs.store(mHandoffMs.load(std::memory_order_relaxed) +
+			std::chrono::duration<double, std::milli>(Clock::now() - slot.Published).count(), std::memory_order_relaxed);
+		// A paced simulation thread may start its next packet now
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+		}
+		mSimulationWake.notify_all();
+
+		if (!mFailed.load())
+		{
+			try
+			{
+				mRender(slot.Value);
+				mRendered.fetch_add(1);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+				mError = std::current_exception();
+				mFailed.store(true);
+			}
+		}
+
+		mFinished.fetch_add(1);
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+		}
+		mSimulationWake.notify_all();
+	}
+}
+
+template <typename Packet>
+FramePipelineStats FramePipeline<Packet>::GetStats() const
+{
+	FramePipelineStats stats;
+	stats.Published = mPublished.load();
+	stats.Rendered = mRendered.load();
+	stats.Dropped = mDropped.load();
+	stats.SimulationWaitMs = mSimulationWaitMs;
+	stats.RenderIdleMs = mRenderIdleMs.load(std::memory_order_relaxed);
+	stats.HandoffMs = mHandoffMs.load(std::memory_order_relaxed);
+	return stats;
+}
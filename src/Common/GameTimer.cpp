@@ -2,16 +2,46 @@
 // GameTimer.cpp by Frank Luna (C) 2011 All Rights Reserved.
 //***************************************************************************************
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <chrono>
+#endif
 #include "GameTimer.h"
 
+namespace
+{
+	// QueryPerformanceCounter where there is one, a steady clock in
+	// nanoseconds elsewhere.
+	std::int64_t QueryCounter()
+	{
+#ifdef _WIN32
+		LARGE_INTEGER count;
+		QueryPerformanceCounter(&count);
+		return count.QuadPart;
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	std::int64_t CountsPerSecond()
+	{
+#ifdef _WIN32
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return frequency.QuadPart;
+#else
+		return 1000000000;
+#endif
+	}
+}
+
 GameTimer::GameTimer()
 : mSecondsPerCount(0.0), mDeltaTime(-1.0), mBaseTime(0), 
   mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
 {
-	__int64 countsPerSec;
-	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
-	mSecondsPerCount = 1.0 / (double)countsPerSec;
+	mSecondsPerCount = 1.0 / (double)CountsPerSecond();
 }
 
 // Returns the total time elapsed since Reset() was called, NOT counting any
@@ -55,8 +85,7 @@ float GameTimer::DeltaTime()const
 
 void GameTimer::Reset()
 {
-	__int64 currTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+	std::int64_t currTime = QueryCounter();
 
 	mBaseTime = currTime;
 	mPrevTime = currTime;
@@ -66,8 +95,7 @@ void GameTimer::Reset()
 
 void GameTimer::Start()
 {
-	__int64 startTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+	std::int64_t startTime = QueryCounter();
 
 
 	// Accumulate the time elapsed between stop and start pairs.
@@ -90,8 +118,7 @@ void GameTimer::Stop()
 {
 	if( !mStopped )
 	{
-		__int64 currTime;
-		QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+		std::int64_t currTime = QueryCounter();
 
 		mStopTime = currTime;
 		mStopped  = true;
@@ -106,8 +133,7 @@ void GameTimer::Tick()
 		return;
 	}
 
-	__int64 currTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+	std::int64_t currTime = QueryCounter();
 	mCurrTime = currTime;
 
 	// Time difference between this frame and the previous.
@@ -125,3 +151,10 @@ void GameTimer::Tick()
 	}
 }
 
+void GameTimer::Advance(float dt)
+{
+	mDeltaTime = dt;
+	mCurrTime = mPrevTime + (std::int64_t)(dt / mSecondsPerCount);
+	mPrevTime = mCurrTime;
+}
+
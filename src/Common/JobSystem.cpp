@@ -0,0 +1,362 @@
+//***************************************************************************************
+// JobSystem.cpp
+//***************************************************************************************
+
+#include "JobSystem.h"
+
+namespace
+{
+	struct ThreadSlot
+	{
+		const JobSystem* System = nullptr;
+		unsigned Index = 0;
+		uint32_t Random = 0x9E3779B9u;
+	};
+
+	thread_local ThreadSlot tSlot;
+	void (*gWorkerStartHook)(unsigned worker) = nullptr;
+
+	uint32_t NextRandom(uint32_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	void RunFunction(Job& job)
+	{
+		std::unique_ptr<std::function<void()>> function(static_cast<std::function<void()>*>(job.Data));
+		(*function)();
+	}
+}
+
+// Chase-Lev deque with a fixed ring (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models"). Bottom is only written by the
+// owner; thieves and the owner's last-item pop race on top with a CAS.
+// Slots are stored with release and loaded with acquire, so a job's fields
+// are visible to whoever takes it.
+struct JobSystem::WorkerQueue
+{
+	static const int64_t Capacity = 4096;
+
+	alignas(64) std::atomic<int64_t> Top{ 0 };
+	alignas(64) std::atomic<int64_t> Bottom{ 0 };
+	std::atomic<Job*> Slots[Capacity];
+
+	alignas(64) std::atomic<uint64_t> Executed{ 0 };
+	std::atomic<uint64_t> Stolen{ 0 };
+
+	WorkerQueue()
+	{
+		for (auto& slot : Slots)
+			slot.store(nullptr, std::memory_order_relaxed);
+	}
+
+	// Owner only; false when full
+	bool Push(Job* job)
+	{
+		const int64_t b = Bottom.load(std::memory_order_relaxed);
+		const int64_t t = Top.load(std::memory_order_acquire);
+		if (b - t >= Capacity)
+			return false;
+		Slots[b & (Capacity - 1)].store(job, std::memory_order_release);
+		Bottom.store(b + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Owner only; the most recently pushed job
+	Job* Pop()
+	{
+		const int64_t b = Bottom.load(std::memory_order_relaxed) - 1;
+		Bottom.store(b, std::memory_order_seq_cst);
+		int64_t t = Top.load(std::memory_order_seq_cst);
+		if (t > b)
+		{
+			Bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		Job* job = Slots[b & (Capacity - 1)].load(std::memory_order_acquire);
+		if (t == b)
+		{
+			// Last one: a thief may be taking it too
+			if (!Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = nullptr;
+			Bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	// Any thread; the oldest job, or null when empty or another thread won it
+	Job* Steal()
+	{
+		int64_t t = Top.load(std::memory_order_seq_cst);
+		const int64_t b = Bottom.load(std::memory_order_seq_cst);
+		if (t >= b)
+			return nullptr;
+		Job* job = Slots[t & (Capacity - 1)].load(std::memory_order_acquire);
+		if (!Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return job;
+	}
+};
+
+JobSystem::JobSystem(unsigned workerCount)
+{
+	if (workerCount == HardwareWorkers)
+		workerCount = (std::max)(1u, std::thread::hardware_concurrency()) - 1;
+
+	for (unsigned i = 0; i <= workerCount; ++i)
+		mQueues.push_back(std::make_unique<WorkerQueue>());
+
+	tSlot.System = this;
+	tSlot.Index = 0;
+
+	mThreads.reserve(workerCount);
+	for (unsigned i = 1; i <= workerCount; ++i)
+		mThreads.emplace_back(&JobSystem::WorkerMain, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepLock);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for (auto& thread : mThreads)
+		thread.join();
+	if (tSlot.System == this)
+		tSlot.System = nullptr;
+}
+
+JobSystem& JobSystem::Get()
+{
+	static JobSystem system;
+	return system;
+}
+
+void JobSystem::SetWorkerStartHook(void (*hook)(unsigned worker))
+{
+	gWorkerStartHook = hook;
+}
+
+void JobSystem::Run(std::function<void()> function, JobCounter* counter, JobCounter* after)
+{
+	Job* job = new Job;
+	job->Function = &RunFunction;
+	job->Data = new std::function<void()>(std::move(function));
+	job->Counter = counter;
+	job->Owned = true;
+	if (counter)
+		counter->mPending.fetch_add(1);
+	Submit(job, after);
+}
+
+void JobSystem::Submit(Job* job, JobCounter* after)
+{
+	if (after)
+	{
+		// Finish takes the held jobs under the same lock after the count
+		// reaches zero, so a job is either held and released there, or
+		// pushed here
+		std::lock_guard<std::mutex> lock(after->mLock);
+		if (after->mPending.load() > 0)
+		{
+			after->mHeld.push_back(job);
+			return;
+		}
+	}
+	Push(job);
+	Wake(1);
+}
+
+JobSystem::WorkerQueue* JobSystem::OwnQueue() const
+{
+	return tSlot.System == this ? mQueues[tSlot.Index].get() : nullptr;
+}
+
+void JobSystem::Push(Job* job)
+{
+	WorkerQueue* own = OwnQueue();
+	if (!own || !own->Push(job))
+	{
+		std::lock_guard<std::mutex> lock(mSharedLock);
+		mShared.push_back(job);
+		mSharedCount.fetch_add(1);
+	}
+	mQueued.fetch_add(1);
+}
+
+// A worker about to sleep counts itself in mSleeping under the lock, then
+// checks mQueued; Push counts the job before Wake reads mSleeping. Either
+// the worker sees the job or Wake sees the worker.
+void JobSystem::Wake(size_t jobs)
+{
+	const int sleeping = mSleeping.load();
+	if (sleeping == 0)
+		return;
+	std::lock_guard<std::mutex> lock(mSleepLock);
+	if (jobs >= (size_t)sleeping)
+		mWake.notify_all();
+	else
+		for (size_t i = 0; i < jobs; ++i)
+			mWake.notify_one();
+}
+
+Job* JobSystem::Take()
+{
+	WorkerQueue* own = OwnQueue();
+	if (own)
+	{
+		if (Job* job = own->Pop())
+		{
+			mQueued.fetch_sub(1);
+			return job;
+		}
+	}
+
+	if (mSharedCount.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(mSharedLock);
+		if (mSharedHead < mShared.size())
+		{
+			Job* job = mShared[mSharedHead++];
+			if (mSharedHead == mShared.size())
+			{
+				mShared.clear();
+				mSharedHead = 0;
+			}
+			mSharedCount.fetch_sub(1);
+			mQueued.fetch_sub(1);
+			return job;
+		}
+	}
+
+	// Steal, starting from a random victim
+	const size_t count = mQueues.size();
+	const size_t start = NextRandom(tSlot.Random) % count;
+	for (size_t i = 0; i < count; ++i)
+	{
+		WorkerQueue* victim = mQueues[(start + i) % count].get();
+		if (victim == own)
+			continue;
+		if (Job* job = victim->Steal())
+		{
+			mQueued.fetch_sub(1);
+			if (own)
+				own->Stolen.fetch_add(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+bool JobSystem::RunOne()
+{
+	Job* job = Take();
+	if (!job)
+		return false;
+	Execute(job);
+	return true;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	// The job may live on the stack of a thread waiting for its counter,
+	// so it is not touched once the counter is finished
+	JobCounter* counter = job->Counter;
+	const bool owned = job->Owned;
+	job->Function(*job);
+	if (owned)
+		delete job;
+
+	if (WorkerQueue* own = OwnQueue())
+		own->Executed.fetch_add(1, std::memory_order_relaxed);
+	else
+		mSharedExecuted.fetch_add(1, std::memory_order_relaxed);
+
+	if (counter)
+		Finish(*counter);
+}
+
+void JobSystem::Finish(JobCounter& counter)
+{
+	counter.mFinishing.fetch_add(1);
+	if (counter.mPending.fetch_sub(1) == 1)
+	{
+		std::vector<Job*> held;
+		{
+			std::lock_guard<std::mutex> lock(counter.mLock);
+			held.swap(counter.mHeld);
+		}
+		for (Job* job : held)
+			Push(job);
+		Wake(held.size());
+	}
+	counter.mFinishing.fetch_sub(1);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (!counter.IsDone())
+	{
+		if (!RunOne())
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WorkerMain(unsigned index)
+{
+	tSlot.System = this;
+	tSlot.Index = index;
+	tSlot.Random = 0x9E3779B9u * (index + 1);
+	if (gWorkerStartHook)
+		gWorkerStartHook(index);
+
+	while (!mQuit.load())
+	{
+		if (RunOne())
+			continue;
+
+		// Spin a little before sleeping: jobs often come in bursts
+		bool found = false;
+		for (int spin = 0; spin < 64 && !found; ++spin)
+		{
+			std::this_thread::yield();
+			found = RunOne();
+		}
+		if (found)
+			continue;
+
+		std::unique_lock<std::mutex> lock(mSleepLock);
+		mSleeping.fetch_add(1);
+		mSleeps.fetch_add(1, std::memory_order_relaxed);
+		mWake.wait(lock, [this]() { return mQuit.load() || mQueued.load() > 0; });
+		mSleeping.fetch_sub(1);
+	}
+}
+
+JobStats JobSystem::GetStats() const
+{
+	JobStats stats;
+	for (const auto& queue : mQueues)
+	{
+		stats.Executed.push_back(queue->Executed.load(std::memory_order_relaxed));
+		stats.Stolen += queue->Stolen.load(std::memory_order_relaxed);
+	}
+	stats.Executed.push_back(mSharedExecuted.load(std::memory_order_relaxed));
+	stats.Sleeps = mSleeps.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void JobSystem::ResetStats()
+{
+	for (auto& queue : mQueues)
+	{
+		queue->Executed.store(0, std::memory_order_relaxed);
+		queue->Stolen.store(0, std::memory_order_relaxed);
+	}
+	mSharedExecuted.store(0, std::memory_order_relaxed);
+	mSleeps.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,234 @@
+//***************************************************************************************
+// JobSystem.h
+//
+// Work-stealing job scheduler. Every worker thread, and the thread that
+// creates the system (the app's main thread), owns a Chase-Lev deque: the
+// owner pushes and pops jobs at the bottom, idle threads steal from the top.
+// Jobs are counted on a JobCounter, and Wait runs jobs - its own first, then
+// stolen ones - until the counter is done, so a waiting thread works instead
+// of blocking and jobs can wait on jobs of their own. A job can be held back
+// until another counter is done.
+//
+// Other threads can use the system too; their jobs go through a shared,
+// locked queue that every thread also takes from.
+//
+// Has no dependency on Windows headers.
+//***************************************************************************************
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class JobCounter;
+
+// One unit of work. Function gets the job back and reads what it needs from
+// Data and the Begin/End range; ParallelFor and Run fill these in.
+struct Job
+{
+	void (*Function)(Job& job) = nullptr;
+	void* Data = nullptr;
+	size_t Begin = 0;
+	size_t End = 0;
+	JobCounter* Counter = nullptr;
+	bool Owned = false;             // allocated by Run, deleted once it has run
+};
+
+// Jobs still to finish. Must outlive the jobs it counts; Wait on it (or see
+// IsDone) before destroying it.
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const
+	{
+		return mPending.load() == 0 && mFinishing.load() == 0;
+	}
+	uint32_t GetPending() const { return mPending.load(std::memory_order_relaxed); }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<uint32_t> mPending{ 0 };
+	std::atomic<uint32_t> mFinishing{ 0 }; // threads between their decrement and their last access
+	std::mutex mLock;                      // guards mHeld
+	std::vector<Job*> mHeld;               // jobs that start once this counter is done
+};
+
+struct JobStats
+{
+	std::vector<uint64_t> Executed; // per thread, the creating thread first; other threads last
+	uint64_t Stolen = 0;
+	uint64_t Sleeps = 0;            // times a worker found nothing to do and slept
+};
+
+class JobSystem
+{
+public:
+	// Chunks a ParallelFor is split into at most; its jobs live on the caller's stack
+	static const size_t MaxChunks = 256;
+
+	// One worker per hardware thread, less the caller
+	static const unsigned HardwareWorkers = ~0u;
+
+	// workerCount threads besides the calling one; with 0 every job runs on
+	// threads that wait
+	explicit JobSystem(unsigned workerCount = HardwareWorkers);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Shared instance. The first call creates it and makes the calling
+	// thread its owner, so make it from the main thread.
+	static JobSystem& Get();
+	// Called on each worker of systems created afterwards, on the worker,
+	// before it takes a job (e.g. to name it for the profiler)
+	static void SetWorkerStartHook(void (*hook)(unsigned worker));
+
+	// Queues job. counter, if given, counts it; if after is given, the job
+	// starts once after is done.
+	void Run(std::function<void()> job, JobCounter* counter = nullptr, JobCounter* after = nullptr);
+	// Runs jobs until counter is done
+	void Wait(JobCounter& counter);
+	// Runs one queued job on the calling thread; false if there was none
+	bool RunOne();
+
+	// body(begin, end) over [0, count) in chunks of at least grain items,
+	// the calling thread taking the first; returns when every chunk has run
+	template <typename Body>
+	void ParallelFor(size_t count, size_t grain, Body&& body);
+	// The same with at most maxThreads threads on it, the calling one among
+	// them (0 = no limit): they take the chunks one at a time
+	template <typename Body>
+	void ParallelFor(size_t count, size_t grain, unsigned maxThreads, Body&& body);
+
+	// Workers plus the creating thread
+	unsigned GetThreadCount() const { return (unsigned)mQueues.size(); }
+	JobStats GetStats() const;
+	void ResetStats();
+
+private:
+	struct WorkerQueue;
+
+	template <typename Callable>
+	static void CallRange(Job& job)
+	{
+		(*static_cast<Callable*>(job.Data))(job.Begin, job.End);
+	}
+
+	void Submit(Job* job, JobCounter* after);
+	// Onto the calling thread's deque, or the shared queue for other threads
+	void Push(Job* job);
+	void Wake(size_t jobs);
+	Job* Take();
+	void Execute(Job* job);
+	void Finish(JobCounter& counter);
+	void WorkerMain(unsigned index);
+	WorkerQueue* OwnQueue() const;
+
+	std::vector<std::unique_ptr<WorkerQueue>> mQueues; // 0: the creating thread
+	std::vector<std::thread> mThreads;
+
+	std::mutex mSharedLock;
+	std::vector<Job*> mShared;                   // jobs from other threads, FIFO from mSharedHead
+	size_t mSharedHead = 0;
+	std::atomic<size_t> mSharedCount{ 0 };
+	std::atomic<uint64_t> mSharedExecuted{ 0 };
+
+	std::atomic<int64_t> mQueued{ 0 };           // jobs in any queue
+	std::mutex mSleepLock;
+	std::condition_variable mWake;
+	std::atomic<int> mSleeping{ 0 };
+	std::atomic<uint64_t> mSleeps{ 0 };
+	std::atomic<bool> mQuit{ false };
+};
+
+template <typename Body>
+void JobSystem::ParallelFor(size_t count, size_t grain, Body&& body)
+{
+	using Callable = typename std::remove_reference<Body>::type;
+
+	grain = (std::max)(grain, (size_t)1);
+	if (count <= grain)
+	{
+		if (count > 0)
+			body((size_t)0, count);
+		return;
+	}
+	grain = (std::max)(grain, (count + MaxChunks - 1) / MaxChunks);
+	const size_t chunks = (count + grain - 1) / grain;
+
+	Job jobs[MaxChunks];
+	JobCounter counter;
+	counter.mPending.store((uint32_t)(chunks - 1));
+	for (size_t c = 1; c < chunks; ++c)
+	{
+		Job& job = jobs[c];
+		job.Function = &CallRange<Callable>;
+		job.Data = const_cast<void*>(static_cast<const void*>(std::addressof(body)));
+		job.Begin = c * grain;
+		job.End = (std::min)(count, job.Begin + grain);
+		job.Counter = &counter;
+		Push(&job);
+	}
+	Wake(chunks - 1);
+
+	body((size_t)0, grain);
+	Wait(counter);
+}
+
+template <typename Body>
+void JobSystem::ParallelFor(size_t count, size_t grain, unsigned maxThreads, Body&& body)
+{
+	grain = (std::max)(grain, (size_t)1);
+	const size_t chunks = (count + grain - 1) / grain;
+	const unsigned threads = maxThreads == 0 ? GetThreadCount() : (std::min)(maxThreads, GetThreadCount());
+	if (threads >= chunks)
+	{
+		ParallelFor(count, grain, body);
+		return;
+	}
+	if (threads <= 1)
+	{
+		body((size_t)0, count);
+		return;
+	}
+
+	std::atomic<size_t> next{ 0 };
+	auto drain = [&](size_t, size_t)
+	{
+		for (size_t c = next.fetch_add(1); c < chunks; c = next.fetch_add(1))
+			body(c * grain, (std::min)(count, c * grain + grain));
+	};
+	using Drain = decltype(drain);
+
+	const size_t helpers = (std::min)((size_t)threads - 1, MaxChunks);
+	Job jobs[MaxChunks];
+	JobCounter counter;
+	counter.mPending.store((uint32_t)helpers);
+	for (size_t h = 0; h < helpers; ++h)
+	{
+		Job& job = jobs[h];
+		job.Function = &CallRange<Drain>;
+		job.Data = &drain;
+		job.Counter = &counter;
+		Push(&job);
+	}
+	Wake(helpers);
+
+	drain(0, 0);
+	Wait(counter);
+}
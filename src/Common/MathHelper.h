@@ -6,9 +6,13 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 #include <DirectXMath.h>
 #include <cstdint>
+#include <cstdlib>
+#include <cmath>
 
 class MathHelper
 {
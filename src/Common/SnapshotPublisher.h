@@ -0,0 +1,282 @@
+//***************************************************************************************
+// SnapshotPublisher.h
+//
+// Immutable versions of some state, published by one writer and read by any
+// number of threads, with epoch-based reclamation (a userspace RCU).
+//
+// A reader thread claims a Reader once. Begin returns the current version
+// and End lets it go; neither waits, loops or takes a lock: Begin is two
+// loads and a store, End one store. The version returned stays valid and
+// unchanged until End, however many versions are published meanwhile.
+//
+// The writer fills the version BeginWrite hands out and publishes it; the
+// one it replaces is retired with the epoch of the replacement. A retired
+// version is reclaimed once every reader inside Begin/End entered at that
+// epoch or later, and is then reused by a later BeginWrite (so the state is
+// double-buffered while readers keep up: the current version and the one
+// being written), or freed beyond MaxSpare. Writers are serialized by a
+// lock that readers never touch.
+//
+// Has no dependency on Windows headers.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+struct SnapshotStats
+{
+	uint64_t Published = 0;
+	uint64_t Reclaimed = 0;
+	uint64_t Allocated = 0;     // versions created; the rest of BeginWrite reused one
+	uint32_t Retired = 0;       // replaced, but a reader may still hold them
+	uint32_t Spare = 0;         // reclaimed, waiting for BeginWrite
+	uint32_t Readers = 0;       // claimed reader slots
+};
+
+template <typename T>
+class SnapshotPublisher
+{
+public:
+	static const uint32_t MaxReaders = 64;
+	static const uint32_t MaxSpare = 2;
+
+	class Reader
+	{
+	public:
+		// Claims a reader slot; throws std::runtime_error when all
+		// MaxReaders are taken. One per thread, used by that thread only.
+		explicit Reader(SnapshotPublisher& publisher);
+		~Reader();
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		// The current version, null before the first Publish. Valid until End.
+		const T* Begin();
+		void End();
+
+	private:
+		SnapshotPublisher* mPublisher;
+		uint32_t mSlot;
+	};
+
+	// Begin/End for a scope
+	class ReadScope
+	{
+	public:
+		explicit ReadScope(Reader& reader) : mReader(reader), mVersion(reader.Begin()) {}
+		~ReadScope() { mReader.End(); }
+		ReadScope(const ReadScope&) = delete;
+		ReadScope& operator=(const ReadScope&) = delete;
+
+		const T* Get() const { return mVersion; }
+		const T* operator->() const { return mVersion; }
+		explicit operator bool() const { return mVersion != nullptr; }
+
+	private:
+		Reader& mReader;
+		const T* mVersion;
+	};
+
+	SnapshotPublisher() = default;
+	~SnapshotPublisher();
+	SnapshotPublisher(const SnapshotPublisher&) = delete;
+	SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+	// Writer. A version no reader can see, to fill completely: a reclaimed
+	// one still holds what it held (keeping vector capacity), a new one is
+	// default-constructed. The same one until Publish.
+	T& BeginWrite();
+	// Writer. Makes the version from BeginWrite current, then reclaims what
+	// it can.
+	void Publish();
+	// Writer. Reclaims retired versions no reader holds any more; Publish
+	// does this too.
+	void Reclaim();
+	// Writer. The current version, or null; valid until the next Publish.
+	const T* GetCurrent() const { return mCurrent.load(std::memory_order_relaxed); }
+
+	SnapshotStats GetStats() const;
+
+private:
+	static const uint64_t Idle = ~0ull;
+
+	struct alignas(64) Slot
+	{
+		std::atomic<uint64_t> Epoch{ Idle };    // epoch seen by Begin, Idle outside Begin/End
+		std::atomic<bool> Claimed{ false };
+	};
+
+	struct RetiredVersion
+	{
+		T* Version;
+		uint64_t Epoch;
+	};
+
+	void ReclaimLocked();
+
+	Slot mSlots[MaxReaders];
+	alignas(64) std::atomic<T*> mCurrent{ nullptr };
+	alignas(64) std::atomic<uint64_t> mEpoch{ 0 };
+
+	mutable std::mutex mWriteLock;              // guards the rest
+	T* mWriting = nullptr;
+	std::vector<RetiredVersion> mRetired;
+	std::vector<T*> mSpare;
+	uint64_t mPublished = 0;
+	uint64_t mReclaimed = 0;
+	uint64_t mAllocated = 0;
+};
+
+template <typename T>
+SnapshotPublisher<T>::Reader::Reader(SnapshotPublisher& publisher)
+	: mPublisher(&publisher), mSlot(MaxReaders)
+{
+	for (uint32_t i = 0; i < MaxReaders; ++i)
+	{
+		bool expected = false;
+		if (publisher.mSlots[i].Claimed.compare_exchange_strong(expected, true))
+		{
+			mSlot = i;
+			return;
+		}
+	}
+	throw std::runtime_error("SnapshotPublisher: no free reader slot");
+}
+
+template <typename T>
+SnapshotPublisher<T>::Reader::~Reader()
+{
+	assert(mPublisher->mSlots[mSlot].Epoch.load() == Idle && "End before the reader goes");
+	mPublisher->mSlots[mSlot].Claimed.store(false);
+}
+
+template <typename T>
+const T* SnapshotPublisher<T>::Reader::Begin()
+{
+	Slot& slot = mPublisher->mSlots[mSlot];
+	assert(slot.Epoch.load(std::memory_order_relaxed) == Idle && "Begin inside Begin/End");
+	// Sequentially consistent with Publish's exchange and Reclaim's scan:
+	// either the scan sees this epoch, or the load below sees the newer
+	// version (see ReclaimLocked)
+	slot.Epoch.store(mPublisher->mEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+	return mPublisher->mCurrent.load(std::memory_order_seq_cst);
+}
+
+template <typename T>
+void SnapshotPublisher<T>::Reader::End()
+{
+	// Release: reads of the version are done before it can be reclaimed
+	mPublisher->mSlots[mSlot].Epoch.store(Idle, std::memory_order_release);
+}
+
+template <typename T>
+SnapshotPublisher<T>::~SnapshotPublisher()
+{
+	for (const Slot& slot : mSlots)
+		assert(!slot.Claimed.load() && "readers go before the publisher");
+	delete mCurrent.load();
+	delete mWriting;
+	for (const RetiredVersion& retired : mRetired)
+		delete retired.Version;
+	for (T* spare : mSpare)
+		delete spare;
+}
+
+template <typename T>
+T& SnapshotPublisher<T>::BeginWrite()
+{
+	std::lock_guard<std::mutex> lock(mWriteLock);
+	if (!mWriting)
+	{
+		if (!mSpare.empty())
+		{
+			mWriting = mSpare.back();
+			mSpare.pop_back();
+		}
+		else
+		{
+			mWriting = new T();
+			++mAllocated;
+		}
+	}
+	return *mWriting;
+}
+
+template <typename T>
+void SnapshotPublisher<T>::Publish()
+{
+	std::lock_guard<std::mutex> lock(mWriteLock);
+	assert(mWriting && "BeginWrite first");
+	T* previous = mCurrent.exchange(mWriting, std::memory_order_seq_cst);
+	mWriting = nullptr;
+	// Readers that saw an epoch below this one may hold previous
+	const uint64_t epoch = mEpoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+	if (previous)
+		mRetired.push_back(RetiredVersion{ previous, epoch });
+	++mPublished;
+	ReclaimLocked();
+}
+
+template <typename T>
+void SnapshotPublisher<T>::Reclaim()
+{
+	std::lock_guard<std::mutex> lock(mWriteLock);
+	ReclaimLocked();
+}
+
+// A reader holding a retired version loaded it before the exchange that
+// replaced it, so the epoch in its slot is below the one the version was
+// retired with. A reader whose slot this scan sees Idle, or at that epoch or
+// later, loads the pointer after the exchange and gets a newer version.
+template <typename T>
+void SnapshotPublisher<T>::ReclaimLocked()
+{
+	if (mRetired.empty())
+		return;
+
+	uint64_t oldest = Idle;
+	for (const Slot& slot : mSlots)
+	{
+		const uint64_t epoch = slot.Epoch.load(std::memory_order_seq_cst);
+		if (epoch < oldest)
+			oldest = epoch;
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < mRetired.size(); ++i)
+	{
+		RetiredVersion& retired = mRetired[i];
+		if (retired.Epoch > oldest)
+		{
+			mRetired[kept++] = retired;
+			continue;
+		}
+		++mReclaimed;
+		if (mSpare.size() < MaxSpare)
+			mSpare.push_back(retired.Version);
+		else
+			delete retired.Version;
+	}
+	mRetired.resize(kept);
+}
+
+template <typename T>
+SnapshotStats SnapshotPublisher<T>::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mWriteLock);
+	SnapshotStats stats;
+	stats.Published = mPublished;
+	stats.Reclaimed = mReclaimed;
+	stats.Allocated = mAllocated;
+	stats.Retired = (uint32_t)mRetired.size();
+	stats.Spare = (uint32_t)mSpare.size();
+	for (const Slot& slot : mSlots)
+		stats.Readers += slot.Claimed.load(std::memory_order_relaxed) ? 1 : 0;
+	return stats;
+}
@@ -0,0 +1,211 @@
+//***************************************************************************************
+// TaskGraph.cpp
+//***************************************************************************************
+
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+TaskGraph::TaskId TaskGraph::Add(const char* name, std::function<void()> function, std::initializer_list<TaskId> dependencies,
+	Queue queue)
+{
+	const TaskId id = (TaskId)mTasks.size();
+	mTasks.emplace_back(name, std::move(function), queue);
+	Task& task = mTasks.back();
+	for (TaskId dependency : dependencies)
+	{
+		assert(dependency < id && "dependencies are added first");
+		if (std::find(task.Dependencies.begin(), task.Dependencies.end(), dependency) != task.Dependencies.end())
+			continue;
+		task.Dependencies.push_back(dependency);
+		mTasks[dependency].Dependents.push_back(id);
+	}
+	return id;
+}
+
+double TaskGraph::Now() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count();
+}
+
+uint32_t TaskGraph::ThreadIndex()
+{
+	const std::thread::id self = std::this_thread::get_id();
+	std::lock_guard<std::mutex> lock(mLock);
+	for (size_t i = 0; i < mThreads.size(); ++i)
+		if (mThreads[i] == self)
+			return (uint32_t)i;
+	mThreads.push_back(self);
+	return (uint32_t)mThreads.size() - 1;
+}
+
+// All of task's dependencies have run
+void TaskGraph::Release(TaskId task)
+{
+	if (mTasks[task].Where == Queue::Main)
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mMainReady.push_back(task);
+		return;
+	}
+	mJobs->Run([this, task]() { Execute(task); }, &mWorkers);
+}
+
+void TaskGraph::Execute(TaskId id)
+{
+	Task& task = mTasks[id];
+	TaskTiming& timing = task.Timing;
+	timing.Name = task.Name;
+	timing.Where = task.Where;
+	timing.Thread = ThreadIndex();
+	timing.StartMs = Now();
+
+	bool failed = task.Skip.load();
+	if (!failed)
+	{
+		try
+		{
+			task.Function();
+			timing.Ran = true;
+		}
+		catch (...)
+		{
+			failed = true;
+			std::lock_guard<std::mutex> lock(mLock);
+			if (!mError)
+				mError = std::current_exception();
+		}
+	}
+	timing.EndMs = Now();
+
+	// The decrement publishes this task's work (and the skip flag) to
+	// whichever thread releases the dependent
+	for (TaskId dependent : task.Dependents)
+	{
+		if (failed)
+			mTasks[dependent].Skip.store(true);
+		if (mTasks[dependent].Waiting.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			Release(dependent);
+	}
+	mDone.fetch_add(1, std::memory_order_release);
+}
+
+void TaskGraph::Run(JobSystem& jobs)
+{
+	mJobs = &jobs;
+	mStart = std::chrono::steady_clock::now();
+	mDone.store(0);
+	mError = nullptr;
+	mMainReady.clear();
+	mThreads.assign(1, std::this_thread::get_id());
+
+	for (Task& task : mTasks)
+	{
+		task.Waiting.store((uint32_t)task.Dependencies.size());
+		task.Skip.store(false);
+		task.Timing = TaskTiming();
+	}
+	for (TaskId id = 0; id < (TaskId)mTasks.size(); ++id)
+		if (mTasks[id].Dependencies.empty())
+			Release(id);
+
+	// Main tasks in the order they were added, among those ready
+	while (mDone.load(std::memory_order_acquire) < mTasks.size())
+	{
+		TaskId next = (TaskId)-1;
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			if (!mMainReady.empty())
+			{
+				auto first = std::min_element(mMainReady.begin(), mMainReady.end());
+				next = *first;
+				mMainReady.erase(first);
+			}
+		}
+		if (next != (TaskId)-1)
+			Execute(next);
+		else if (!jobs.RunOne())
+			std::this_thread::yield();
+	}
+	jobs.Wait(mWorkers);
+	mWallMs = Now();
+
+	if (mError)
+		std::rethrow_exception(mError);
+}
+
+double TaskGraph::GetBusyMs() const
+{
+	double busy = 0.0;
+	for (const Task& task : mTasks)
+		busy += task.Timing.EndMs - task.Timing.StartMs;
+	return busy;
+}
+
+double TaskGraph::GetCriticalPath(std::vector<TaskId>* path) const
+{
+	// Tasks are in dependency order already
+	std::vector<double> finish(mTasks.size(), 0.0);
+	std::vector<TaskId> previous(mTasks.size(), (TaskId)-1);
+	TaskId last = (TaskId)-1;
+	for (TaskId id = 0; id < (TaskId)mTasks.size(); ++id)
+	{
+		const Task& task = mTasks[id];
+		double start = 0.0;
+		for (TaskId dependency : task.Dependencies)
+		{
+			if (finish[dependency] > start)
+			{
+				start = finish[dependency];
+				previous[id] = dependency;
+			}
+		}
+		finish[id] = start + (task.Timing.EndMs - task.Timing.StartMs);
+		if (last == (TaskId)-1 || finish[id] > finish[last])
+			last = id;
+	}
+
+	if (path)
+	{
+		path->clear();
+		for (TaskId id = last; id != (TaskId)-1; id = previous[id])
+			path->push_back(id);
+		std::reverse(path->begin(), path->end());
+	}
+	return last == (TaskId)-1 ? 0.0 : finish[last];
+}
+
+std::string TaskGraph::Describe() const
+{
+	std::vector<TaskId> critical;
+	const double criticalMs = GetCriticalPath(&critical);
+
+	char line[256];
+	snprintf(line, sizeof(line), "%zu tasks in %.1f ms on %u threads: %.1f ms of work, critical path %.1f ms\n",
+		mTasks.size(), mWallMs, GetThreadsUsed(), GetBusyMs(), criticalMs);
+	std::string text = line;
+
+	text += "  critical path:";
+	for (size_t i = 0; i < critical.size(); ++i)
+		text += (i ? " > " : " ") + std::string(mTasks[critical[i]].Name);
+	text += "\n";
+
+	std::vector<TaskId> order(mTasks.size());
+	for (TaskId id = 0; id < (TaskId)order.size(); ++id)
+		order[id] = id;
+	std::stable_sort(order.begin(), order.end(), [this](TaskId a, TaskId b)
+	{
+		return mTasks[a].Timing.StartMs < mTasks[b].Timing.StartMs;
+	});
+	for (TaskId id : order)
+	{
+		const TaskTiming& t = mTasks[id].Timing;
+		snprintf(line, sizeof(line), "  %-28s %-6s %8.1f %8.1f ms  thread %u%s\n", mTasks[id].Name,
+			mTasks[id].Where == Queue::Main ? "main" : "worker", t.StartMs, t.EndMs - t.StartMs, t.Thread,
+			t.Ran ? "" : "  skipped");
+		text += line;
+	}
+	return text;
+}
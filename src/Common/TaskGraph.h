@@ -0,0 +1,110 @@
+//***************************************************************************************
+// TaskGraph.h
+//
+// One-shot dependency graph of named tasks over the JobSystem, for startup
+// work: tasks start as soon as everything they depend on has run. Worker
+// tasks run as jobs on any thread; main tasks run on the thread that calls
+// Run, one at a time, so everything that records on one command list can be
+// funnelled through it. Each task's start and end are kept, for a breakdown
+// of where the time went and the critical path through the graph.
+//
+// Has no dependency on Windows headers.
+//***************************************************************************************
+
+#pragma once
+
+#include "JobSystem.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TaskGraph
+{
+public:
+	typedef uint32_t TaskId;
+
+	enum class Queue
+	{
+		Worker,     // a job on any thread
+		Main,       // the thread that calls Run
+	};
+
+	struct TaskTiming
+	{
+		const char* Name = "";
+		Queue Where = Queue::Worker;
+		double StartMs = 0.0;       // since Run started
+		double EndMs = 0.0;
+		uint32_t Thread = 0;        // 0 is the thread that called Run; others numbered as first seen
+		bool Ran = false;           // false when skipped because a dependency threw
+	};
+
+	// Dependencies are tasks added earlier, so the graph has no cycles by
+	// construction. name must outlive the graph (a string literal).
+	TaskId Add(const char* name, std::function<void()> function, std::initializer_list<TaskId> dependencies = {},
+		Queue queue = Queue::Worker);
+
+	// Runs every task and returns when all have run, helping with jobs while
+	// there is no main task to run. A task that throws skips everything that
+	// depends on it; the first exception is rethrown here once the rest is done.
+	void Run(JobSystem& jobs);
+
+	size_t GetTaskCount() const { return mTasks.size(); }
+	const TaskTiming& GetTiming(TaskId task) const { return mTasks[task].Timing; }
+	const std::vector<TaskId>& GetDependencies(TaskId task) const { return mTasks[task].Dependencies; }
+
+	double GetWallMs() const { return mWallMs; }
+	// Sum of every task's time: the wall time on one thread
+	double GetBusyMs() const;
+	// Longest chain of dependent tasks by their measured times, first to last
+	double GetCriticalPath(std::vector<TaskId>* path = nullptr) const;
+	uint32_t GetThreadsUsed() const { return (uint32_t)mThreads.size(); }
+
+	// Totals, the critical path, then one line per task in start order
+	std::string Describe() const;
+
+private:
+	struct Task
+	{
+		const char* Name;
+		std::function<void()> Function;
+		TaskGraph::Queue Where;
+		std::vector<TaskId> Dependencies;
+		std::vector<TaskId> Dependents;
+		std::atomic<uint32_t> Waiting{ 0 };  // dependencies still to run
+		std::atomic<bool> Skip{ false };
+		TaskTiming Timing;
+
+		Task(const char* name, std::function<void()> function, TaskGraph::Queue queue)
+			: Name(name), Function(std::move(function)), Where(queue) {}
+		// Only while the graph is built, when nothing runs yet
+		Task(Task&& other) noexcept
+			: Name(other.Name), Function(std::move(other.Function)), Where(other.Where),
+			Dependencies(std::move(other.Dependencies)), Dependents(std::move(other.Dependents)) {}
+	};
+
+	void Release(TaskId task);
+	void Execute(TaskId task);
+	uint32_t ThreadIndex();
+	double Now() const;
+
+	std::vector<Task> mTasks;
+	JobSystem* mJobs = nullptr;
+	JobCounter mWorkers;
+	std::atomic<size_t> mDone{ 0 };
+	std::chrono::steady_clock::time_point mStart;
+	double mWallMs = 0.0;
+
+	std::mutex mLock;                       // guards the rest
+	std::vector<TaskId> mMainReady;
+	std::vector<std::thread::id> mThreads;
+	std::exception_ptr mError;
+};
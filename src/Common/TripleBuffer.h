@@ -0,0 +1,71 @@
+//***************************************************************************************
+// TripleBuffer.h
+//
+// Lock-free handoff of the latest value from one producer thread to one
+// consumer thread. The producer fills its back slot and publishes it; the
+// consumer takes the freshest published slot. Three slots mean neither side
+// ever waits for the other: the one in the middle is swapped with one
+// atomic exchange. A value published while the previous one was never taken
+// replaces it.
+//
+// Slots are reused: the back slot still holds whatever was in it before, so
+// the producer overwrites every field (and keeps vector capacity).
+//
+// Has no dependency on Windows headers.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() = default;
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// Producer only
+	T& GetBack() { return mSlots[mBack]; }
+
+	// Producer only. Hands the back slot over and takes the middle one as the
+	// new back; true if the value published before was never taken.
+	bool Publish()
+	{
+		// Release: the slot's contents go with it. Acquire: the consumer is
+		// done with the slot coming back.
+		const uint8_t old = mMiddle.exchange((uint8_t)(mBack | Fresh), std::memory_order_acq_rel);
+		mBack = old & IndexMask;
+		return (old & Fresh) != 0;
+	}
+
+	// Either side; whether a value is waiting to be taken
+	bool HasFresh() const { return (mMiddle.load(std::memory_order_acquire) & Fresh) != 0; }
+
+	// Consumer only. Takes the freshest published value; false, with the
+	// front slot unchanged, when nothing new was published.
+	bool Acquire()
+	{
+		if ((mMiddle.load(std::memory_order_relaxed) & Fresh) == 0)
+			return false;
+		// Only this side clears Fresh, so the exchange takes a fresh slot even
+		// if the producer published again since the check
+		const uint8_t old = mMiddle.exchange(mFront, std::memory_order_acq_rel);
+		mFront = old & IndexMask;
+		return true;
+	}
+
+	// Consumer only
+	const T& GetFront() const { return mSlots[mFront]; }
+
+private:
+	static const uint8_t IndexMask = 3;
+	static const uint8_t Fresh = 4;
+
+	T mSlots[3];
+	alignas(64) std::atomic<uint8_t> mMiddle{ 1 };  // slot index, | Fresh while not taken
+	alignas(64) uint8_t mBack = 0;                   // producer's
+	alignas(64) uint8_t mFront = 2;                  // consumer's
+};
@@ -55,6 +55,23 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Read access for command captures (FrameCapture.h); slow, the upload
+    // heap is write-combined memory.
+    const BYTE* MappedData()const
+    {
+        return mMappedData;
+    }
+
+    UINT ElementByteSize()const
+    {
+        return mElementByteSize;
+    }
+
+    UINT64 ByteSize()const
+    {
+        return mUploadBuffer->GetDesc().Width;
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
@@ -163,6 +163,9 @@ struct MeshGeometry
 	// Give it a name so we can look it up by name.
 	std::string Name;
 
+	// Id the app's command recording knows this geometry by.
+	uint32_t Id = 0;
+
 	// System memory copies.  Use Blobs because the vertex/index format can be generic.
 	// It is up to the client to cast appropriately.  
 	Microsoft::WRL::ComPtr<ID3DBlob> VertexBufferCPU = nullptr;
@@ -0,0 +1,184 @@
+#include "BrushUndo.h"
+
+BrushUndo::BrushUndo(size_t memoryBudget)
+	: mMemoryBudget(memoryBudget)
+{
+}
+
+void BrushUndo::BeginStroke(PaintLayer& layer)
+{
+	if (mInStroke)
+		EndStroke(layer);
+
+	mStroke = Step();
+	mStrokeTiles.assign(layer.GetTileCount(), 0);
+	mInStroke = true;
+}
+
+PaintRect BrushUndo::Paint(PaintLayer& layer, const BrushStamp& stamp)
+{
+	// Painting outside of a stroke is still recorded as a one-dab stroke.
+	const bool implicitStroke = !mInStroke;
+	if (implicitStroke)
+		BeginStroke(layer);
+
+	layer.GetTilesInRect(layer.GetStampRect(stamp), mScratchTiles);
+	for (int tile : mScratchTiles)
+	{
+		if (mStrokeTiles[tile])
+			continue;
+		mStrokeTiles[tile] = 1;
+
+		TileChange change;
+		change.Tile = tile;
+		change.Before = layer.Pack(tile);
+		mStroke.Changes.push_back(std::move(change));
+	}
+
+	PaintRect rect = layer.Stamp(stamp);
+	mStroke.Rect.Merge(rect);
+
+	if (implicitStroke)
+		EndStroke(layer);
+
+	return rect;
+}
+
+bool BrushUndo::EndStroke(PaintLayer& layer)
+{
+	if (!mInStroke)
+		return false;
+	mInStroke = false;
+
+	// Drop tiles the stamp's bounding rect covered but no texel changed.
+	std::vector<TileChange> changes;
+	changes.reserve(mStroke.Changes.size());
+	for (auto& c : mStroke.Changes)
+	{
+		c.After = layer.Pack(c.Tile);
+		if (c.After != c.Before)
+			changes.push_back(std::move(c));
+	}
+
+	if (changes.empty())
+	{
+		mStroke = Step();
+		return false;
+	}
+	mStroke.Changes = std::move(changes);
+
+	// A new stroke invalidates the redo branch.
+	for (auto& step : mRedo)
+		ReleaseStep(step);
+	mRedo.clear();
+
+	for (auto& c : mStroke.Changes)
+	{
+		Retain(c.Before);
+		Retain(c.After);
+	}
+	mUndo.push_back(std::move(mStroke));
+	mStroke = Step();
+
+	Trim();
+	return true;
+}
+
+bool BrushUndo::Undo(PaintLayer& layer, PaintRect& restored)
+{
+	if (mInStroke)
+		EndStroke(layer);
+	if (mUndo.empty())
+		return false;
+
+	Step step = std::move(mUndo.back());
+	mUndo.pop_back();
+
+	restored = PaintRect();
+	for (auto& c : step.Changes)
+	{
+		layer.Unpack(c.Tile, c.Before);
+		restored.Merge(layer.GetTileRect(c.Tile));
+	}
+
+	mRedo.push_back(std::move(step));
+	return true;
+}
+
+bool BrushUndo::Redo(PaintLayer& layer, PaintRect& restored)
+{
+	if (mInStroke || mRedo.empty())
+		return false;
+
+	Step step = std::move(mRedo.back());
+	mRedo.pop_back();
+
+	restored = PaintRect();
+	for (auto& c : step.Changes)
+	{
+		layer.Unpack(c.Tile, c.After);
+		restored.Merge(layer.GetTileRect(c.Tile));
+	}
+
+	mUndo.push_back(std::move(step));
+	return true;
+}
+
+void BrushUndo::Clear()
+{
+	mUndo.clear();
+	mRedo.clear();
+	mRefCounts.clear();
+	mMemoryUsage = 0;
+	mStroke = Step();
+	mInStroke = false;
+}
+
+void BrushUndo::SetMemoryBudget(size_t bytes)
+{
+	mMemoryBudget = bytes;
+	Trim();
+}
+
+void BrushUndo::Retain(const std::shared_ptr<const PackedTile>& packed)
+{
+	if (mRefCounts[packed.get()]++ == 0)
+		mMemoryUsage += packed->ByteSize();
+}
+
+void BrushUndo::Release(const std::shared_ptr<const PackedTile>& packed)
+{
+	auto it = mRefCounts.find(packed.get());
+	if (it == mRefCounts.end())
+		return;
+	if (--it->second == 0)
+	{
+		mMemoryUsage -= packed->ByteSize();
+		mRefCounts.erase(it);
+	}
+}
+
+void BrushUndo::ReleaseStep(const Step& step)
+{
+	for (auto& c : step.Changes)
+	{
+		Release(c.Before);
+		Release(c.After);
+	}
+}
+
+void BrushUndo::Trim()
+{
+	// Oldest history goes first; the most recent step is always kept so a
+	// single oversized stroke can still be undone.
+	while (mMemoryUsage > mMemoryBudget && mUndo.size() > 1)
+	{
+		ReleaseStep(mUndo.front());
+		mUndo.pop_front();
+	}
+	while (mMemoryUsage > mMemoryBudget && !mRedo.empty() && mUndo.size() + mRedo.size() > 1)
+	{
+		ReleaseStep(mRedo.front());
+		mRedo.erase(mRedo.begin());
+	}
+}
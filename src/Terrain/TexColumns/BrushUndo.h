@@ -0,0 +1,69 @@
+#pragma once
+#include "PaintLayer.h"
+
+#include <deque>
+#include <unordered_map>
+
+// Undo/redo journal for brush strokes on a PaintLayer.
+// Before a stroke first touches a tile, the tile's packed state is recorded;
+// when the stroke ends the packed result is recorded as well. Packed tiles
+// are shared between steps (the "after" of one stroke is usually the "before"
+// of the next), and memory is accounted per unique packed tile. When the
+// budget is exceeded the oldest steps are dropped.
+class BrushUndo
+{
+public:
+	explicit BrushUndo(size_t memoryBudget = 64u * 1024u * 1024u);
+
+	void BeginStroke(PaintLayer& layer);
+	// Snapshots the tiles under the stamp and applies it.
+	PaintRect Paint(PaintLayer& layer, const BrushStamp& stamp);
+	// Returns false when the stroke did not change anything.
+	bool EndStroke(PaintLayer& layer);
+
+	// On success 'restored' receives the texels that changed.
+	bool Undo(PaintLayer& layer, PaintRect& restored);
+	bool Redo(PaintLayer& layer, PaintRect& restored);
+
+	void Clear();
+
+	bool IsInStroke() const { return mInStroke; }
+	size_t GetUndoCount() const { return mUndo.size(); }
+	size_t GetRedoCount() const { return mRedo.size(); }
+	size_t GetMemoryUsage() const { return mMemoryUsage; }
+	size_t GetMemoryBudget() const { return mMemoryBudget; }
+	void SetMemoryBudget(size_t bytes);
+
+private:
+	struct TileChange
+	{
+		int Tile;
+		std::shared_ptr<const PackedTile> Before;
+		std::shared_ptr<const PackedTile> After;
+	};
+
+	struct Step
+	{
+		std::vector<TileChange> Changes;
+		PaintRect Rect;
+	};
+
+	void Retain(const std::shared_ptr<const PackedTile>& packed);
+	void Release(const std::shared_ptr<const PackedTile>& packed);
+	void ReleaseStep(const Step& step);
+	void Trim();
+
+private:
+	std::deque<Step> mUndo;
+	std::vector<Step> mRedo;
+
+	Step mStroke;
+	std::vector<uint8_t> mStrokeTiles; // tile already snapshotted this stroke
+	bool mInStroke = false;
+
+	std::unordered_map<const PackedTile*, int> mRefCounts;
+	size_t mMemoryUsage = 0;
+	size_t mMemoryBudget;
+
+	std::vector<int> mScratchTiles;
+};
@@ -0,0 +1,85 @@
+#include "CameraControls.h"
+
+#include <cmath>
+
+using namespace DirectX;
+
+void CameraControls::Fly(Camera& camera, const JournalKeys& keys, float dt, float horSpeed, float vertSpeed)
+{
+	const bool shiftPressed = keys[JournalKeyShift];
+
+	if (keys['W'])
+	{
+		if (shiftPressed) camera.MoveUp(vertSpeed * dt);
+		else camera.Walk(horSpeed * dt);
+	}
+
+	if (keys['S'])
+	{
+		if (shiftPressed) camera.MoveUp(-vertSpeed * dt);
+		else camera.Walk(-horSpeed * dt);
+	}
+
+	if (keys['A'])
+		camera.Strafe(-horSpeed * dt);
+
+	if (keys['D'])
+		camera.Strafe(horSpeed * dt);
+}
+
+void CameraControls::Look(Camera& camera, int dx, int dy)
+{
+	camera.Pitch(XMConvertToRadians(0.25f * static_cast<float>(dy)));
+	camera.RotateY(XMConvertToRadians(0.25f * static_cast<float>(dx)));
+}
+
+bool CameraControls::PickGroundPlane(FXMMATRIX invViewProj, int x, int y, int width, int height, XMFLOAT3& hit)
+{
+	// Normalized device coordinates of the pixel
+	const float nx = (2.0f * static_cast<float>(x)) / width - 1.0f;
+	const float ny = 1.0f - (2.0f * static_cast<float>(y)) / height;
+
+	// Near and far points of the ray in world space
+	const XMVECTOR rayStart = XMVector3TransformCoord(XMVectorSet(nx, ny, 0.0f, 1.0f), invViewProj);
+	const XMVECTOR rayEnd = XMVector3TransformCoord(XMVectorSet(nx, ny, 1.0f, 1.0f), invViewProj);
+	const XMVECTOR rayDir = XMVector3Normalize(XMVectorSubtract(rayEnd, rayStart));
+
+	const XMVECTOR planeNormal = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	const float numerator = -XMVectorGetX(XMVector3Dot(rayStart, planeNormal));
+	const float denominator = XMVectorGetX(XMVector3Dot(rayDir, planeNormal));
+	if (std::fabs(denominator) <= 1e-6f)
+		return false;
+
+	const float t = numerator / denominator;
+	if (t < 0.0f)
+		return false;
+
+	XMStoreFloat3(&hit, XMVectorAdd(rayStart, XMVectorScale(rayDir, t)));
+	return true;
+}
+
+namespace
+{
+	// Radical inverse of index in the given base
+	float Halton(uint32_t index, uint32_t base)
+	{
+		float result = 0.0f;
+		float fraction = 1.0f / base;
+		while (index > 0)
+		{
+			result += (index % base) * fraction;
+			index /= base;
+			fraction /= base;
+		}
+		return result;
+	}
+}
+
+void CameraControls::HaltonJitter(float width, float height, int count, XMFLOAT2* jitters)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		jitters[i].x = ((Halton(i + 1, 2) - 0.5f) / width) * 2.0f;
+		jitters[i].y = ((Halton(i + 1, 3) - 0.5f) / height) * 2.0f;
+	}
+}
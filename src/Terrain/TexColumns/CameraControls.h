@@ -0,0 +1,20 @@
+#pragma once
+#include "Camera.h"
+#include "InputJournal.h"
+
+// The app's camera and brush controls, shared with Tools/JournalReplay so a
+// replayed journal moves the camera exactly as the app did.
+class CameraControls
+{
+public:
+	// W/S walk, A/D strafe; with Shift held W/S move up and down instead.
+	static void Fly(Camera& camera, const JournalKeys& keys, float dt, float horSpeed, float vertSpeed);
+	// Right drag: each pixel is a quarter of a degree.
+	static void Look(Camera& camera, int dx, int dy);
+	// Ray through a client pixel against the y = 0 plane. invViewProj is the
+	// inverse of the unjittered view-projection.
+	static bool PickGroundPlane(DirectX::FXMMATRIX invViewProj, int x, int y, int width, int height, DirectX::XMFLOAT3& hit);
+	// TAA projection offsets: the Halton(2, 3) sequence from index 1, centred
+	// on the pixel and scaled to clip space for a width x height viewport.
+	static void HaltonJitter(float width, float height, int count, DirectX::XMFLOAT2* jitters);
+};
@@ -0,0 +1,161 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+
+// Plain-float bounding volumes shared by the spatial structures. They carry no
+// DirectXMath types so the structures can be built and tested anywhere; the
+// renderer converts BoundingBox / view-projection matrices at the boundary.
+
+struct Aabb
+{
+	float Min[3] = { 0.0f, 0.0f, 0.0f };
+	float Max[3] = { 0.0f, 0.0f, 0.0f };
+
+	static Aabb FromCenterExtents(const float center[3], const float extents[3])
+	{
+		Aabb box;
+		for (int c = 0; c < 3; ++c)
+		{
+			box.Min[c] = center[c] - extents[c];
+			box.Max[c] = center[c] + extents[c];
+		}
+		return box;
+	}
+
+	float Center(int axis) const { return 0.5f * (Min[axis] + Max[axis]); }
+	float Size(int axis) const { return Max[axis] - Min[axis]; }
+	float MaxSize() const { return std::max(Size(0), std::max(Size(1), Size(2))); }
+	// Half the surface area; enough for comparing costs.
+	float HalfArea() const
+	{
+		const float x = Size(0), y = Size(1), z = Size(2);
+		return x * y + y * z + z * x;
+	}
+
+	bool Contains(const Aabb& b) const
+	{
+		return Min[0] <= b.Min[0] && Min[1] <= b.Min[1] && Min[2] <= b.Min[2] &&
+			Max[0] >= b.Max[0] && Max[1] >= b.Max[1] && Max[2] >= b.Max[2];
+	}
+	bool Overlaps(const Aabb& b) const
+	{
+		return Min[0] <= b.Max[0] && Min[1] <= b.Max[1] && Min[2] <= b.Max[2] &&
+			Max[0] >= b.Min[0] && Max[1] >= b.Min[1] && Max[2] >= b.Min[2];
+	}
+
+	static Aabb Union(const Aabb& a, const Aabb& b)
+	{
+		Aabb box;
+		for (int c = 0; c < 3; ++c)
+		{
+			box.Min[c] = std::min(a.Min[c], b.Min[c]);
+			box.Max[c] = std::max(a.Max[c], b.Max[c]);
+		}
+		return box;
+	}
+};
+
+enum class CullResult : uint8_t
+{
+	Outside,
+	Intersects,
+	Inside,
+};
+
+// Six inward-facing planes (a, b, c, d): a point is inside when
+// a*x + b*y + c*z + d >= 0 for all of them.
+struct FrustumPlanes
+{
+	float Planes[6][4] = {};
+
+	// Row-major matrix in the row-vector convention (clip = p * M) with D3D
+	// clip depth 0..w, i.e. what XMStoreFloat4x4 of view * proj gives.
+	static FrustumPlanes FromViewProj(const float m[4][4])
+	{
+		FrustumPlanes f;
+		for (int i = 0; i < 4; ++i)
+		{
+			const float x = m[i][0], y = m[i][1], z = m[i][2], w = m[i][3];
+			f.Planes[0][i] = w + x; // left
+			f.Planes[1][i] = w - x; // right
+			f.Planes[2][i] = w + y; // bottom
+			f.Planes[3][i] = w - y; // top
+			f.Planes[4][i] = z;     // near
+			f.Planes[5][i] = w - z; // far
+		}
+		return f;
+	}
+
+	static const uint32_t AllPlanes = 0x3F;
+
+	CullResult Classify(const Aabb& box) const
+	{
+		uint32_t planes = AllPlanes;
+		return Classify(box, planes);
+	}
+
+	// Only tests the planes set in planeMask and clears the ones the box is
+	// completely inside of. Hierarchies pass the mask down, so children skip
+	// planes their parent already cleared.
+	CullResult Classify(const Aabb& box, uint32_t& planeMask) const
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			if (!(planeMask & (1u << i)))
+				continue;
+			const float* p = Planes[i];
+
+			// Farthest corner along the plane normal, then the nearest one
+			const float px = p[0] >= 0.0f ? box.Max[0] : box.Min[0];
+			const float py = p[1] >= 0.0f ? box.Max[1] : box.Min[1];
+			const float pz = p[2] >= 0.0f ? box.Max[2] : box.Min[2];
+			if (p[0] * px + p[1] * py + p[2] * pz + p[3] < 0.0f)
+				return CullResult::Outside;
+
+			const float nx = p[0] >= 0.0f ? box.Min[0] : box.Max[0];
+			const float ny = p[1] >= 0.0f ? box.Min[1] : box.Max[1];
+			const float nz = p[2] >= 0.0f ? box.Min[2] : box.Max[2];
+			if (p[0] * nx + p[1] * ny + p[2] * nz + p[3] >= 0.0f)
+				planeMask &= ~(1u << i);
+		}
+		return planeMask == 0 ? CullResult::Inside : CullResult::Intersects;
+	}
+};
+
+// Several views culled in one walk (the camera plus shadow cascades). A
+// hierarchy passes the state down: bit i of Visible says views[i] may still
+// see the node, Planes[i] are the planes of views[i] it still crosses, the
+// same way Classify's plane mask works for a single view.
+struct ViewCullState
+{
+	static constexpr uint32_t MaxViews = 8;
+
+	uint32_t Visible = 0;
+	uint8_t Planes[MaxViews] = {};
+
+	static ViewCullState All(uint32_t viewCount)
+	{
+		ViewCullState state;
+		for (uint32_t i = 0; i < viewCount && i < MaxViews; ++i)
+		{
+			state.Visible |= 1u << i;
+			state.Planes[i] = (uint8_t)FrustumPlanes::AllPlanes;
+		}
+		return state;
+	}
+
+	// Narrows the state to box; false when no view sees it.
+	bool Classify(const FrustumPlanes* views, uint32_t viewCount, const Aabb& box)
+	{
+		for (uint32_t i = 0; i < viewCount && i < MaxViews; ++i)
+		{
+			if (!(Visible & (1u << i)) || !Planes[i])
+				continue;
+			uint32_t planes = Planes[i];
+			if (views[i].Classify(box, planes) == CullResult::Outside)
+				Visible &= ~(1u << i);
+			Planes[i] = (uint8_t)planes;
+		}
+		return Visible != 0;
+	}
+};
@@ -0,0 +1,168 @@
+#include "D3D12CommandList.h"
+
+static_assert((UINT)ResourceState::RenderTarget == D3D12_RESOURCE_STATE_RENDER_TARGET, "ResourceState must match D3D12");
+static_assert((UINT)ResourceState::UnorderedAccess == D3D12_RESOURCE_STATE_UNORDERED_ACCESS, "ResourceState must match D3D12");
+static_assert((UINT)ResourceState::PixelShaderResource == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, "ResourceState must match D3D12");
+static_assert((UINT)ResourceState::CopyDest == D3D12_RESOURCE_STATE_COPY_DEST, "ResourceState must match D3D12");
+static_assert((UINT)ResourceState::CopySource == D3D12_RESOURCE_STATE_COPY_SOURCE, "ResourceState must match D3D12");
+static_assert(sizeof(RenderViewport) == sizeof(D3D12_VIEWPORT), "RenderViewport must match D3D12_VIEWPORT");
+static_assert(sizeof(RenderRect) == sizeof(D3D12_RECT), "RenderRect must match D3D12_RECT");
+
+RenderId D3D12CommandList::AddPipeline(ID3D12PipelineState* pipeline)
+{
+	mPipelines.push_back(pipeline);
+	return (RenderId)mPipelines.size() - 1;
+}
+
+RenderId D3D12CommandList::AddRootSignature(ID3D12RootSignature* rootSignature)
+{
+	mRootSignatures.push_back(rootSignature);
+	return (RenderId)mRootSignatures.size() - 1;
+}
+
+RenderId D3D12CommandList::AddDescriptorHeap()
+{
+	mHeaps.push_back({ nullptr, 0, {} });
+	return (RenderId)mHeaps.size() - 1;
+}
+
+void D3D12CommandList::UpdateDescriptorHeap(RenderId id, ID3D12DescriptorHeap* heap, UINT descriptorSize)
+{
+	mHeaps[id] = { heap, descriptorSize, heap->GetGPUDescriptorHandleForHeapStart() };
+}
+
+RenderId D3D12CommandList::AddGeometry(MeshGeometry* geometry)
+{
+	mGeometries.push_back(geometry);
+	geometry->Id = (uint32_t)mGeometries.size() - 1;
+	return geometry->Id;
+}
+
+RenderId D3D12CommandList::AddResource()
+{
+	mResources.push_back(nullptr);
+	return (RenderId)mResources.size() - 1;
+}
+
+void D3D12CommandList::SetTargetHeaps(ID3D12DescriptorHeap* rtvHeap, UINT rtvSize, ID3D12DescriptorHeap* dsvHeap, UINT dsvSize)
+{
+	mRtvStart = rtvHeap->GetCPUDescriptorHandleForHeapStart();
+	mRtvSize = rtvSize;
+	mDsvStart = dsvHeap->GetCPUDescriptorHandleForHeapStart();
+	mDsvSize = dsvSize;
+}
+
+void D3D12CommandList::SetPipelineState(RenderId pipeline)
+{
+	mCmdList->SetPipelineState(mPipelines[pipeline]);
+}
+
+void D3D12CommandList::SetGraphicsRootSignature(RenderId rootSignature)
+{
+	mCmdList->SetGraphicsRootSignature(mRootSignatures[rootSignature]);
+}
+
+void D3D12CommandList::SetComputeRootSignature(RenderId rootSignature)
+{
+	mCmdList->SetComputeRootSignature(mRootSignatures[rootSignature]);
+}
+
+void D3D12CommandList::SetDescriptorHeap(RenderId heap)
+{
+	mBoundHeap = heap;
+	ID3D12DescriptorHeap* heaps[] = { mHeaps[heap].Heap };
+	mCmdList->SetDescriptorHeaps(_countof(heaps), heaps);
+}
+
+void D3D12CommandList::SetGraphicsRootDescriptorTable(uint32_t slot, uint32_t descriptor)
+{
+	mCmdList->SetGraphicsRootDescriptorTable(slot, Descriptor(descriptor));
+}
+
+void D3D12CommandList::SetComputeRootDescriptorTable(uint32_t slot, uint32_t descriptor)
+{
+	mCmdList->SetComputeRootDescriptorTable(slot, Descriptor(descriptor));
+}
+
+void D3D12CommandList::SetGraphicsRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset)
+{
+	mCmdList->SetGraphicsRootConstantBufferView(slot, mResources[buffer]->GetGPUVirtualAddress() + offset);
+}
+
+void D3D12CommandList::SetComputeRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset)
+{
+	mCmdList->SetComputeRootConstantBufferView(slot, mResources[buffer]->GetGPUVirtualAddress() + offset);
+}
+
+void D3D12CommandList::SetVertexBuffer(RenderId geometry)
+{
+	D3D12_VERTEX_BUFFER_VIEW view = mGeometries[geometry]->VertexBufferView();
+	mCmdList->IASetVertexBuffers(0, 1, &view);
+}
+
+void D3D12CommandList::SetIndexBuffer(RenderId geometry)
+{
+	D3D12_INDEX_BUFFER_VIEW view = mGeometries[geometry]->IndexBufferView();
+	mCmdList->IASetIndexBuffer(&view);
+}
+
+void D3D12CommandList::SetPrimitiveTopology(uint32_t topology)
+{
+	mCmdList->IASetPrimitiveTopology((D3D12_PRIMITIVE_TOPOLOGY)topology);
+}
+
+void D3D12CommandList::SetViewport(const RenderViewport& viewport)
+{
+	mCmdList->RSSetViewports(1, reinterpret_cast<const D3D12_VIEWPORT*>(&viewport));
+}
+
+void D3D12CommandList::SetScissorRect(const RenderRect& rect)
+{
+	mCmdList->RSSetScissorRects(1, reinterpret_cast<const D3D12_RECT*>(&rect));
+}
+
+void D3D12CommandList::SetRenderTargets(const uint32_t* rtvs, uint32_t count, uint32_t dsv)
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE handles[MaxRenderTargets];
+	for (uint32_t i = 0; i < count; ++i)
+		handles[i] = Rtv(rtvs[i]);
+	D3D12_CPU_DESCRIPTOR_HANDLE depth = Dsv(dsv == NoDepth ? 0 : dsv);
+	mCmdList->OMSetRenderTargets(count, handles, false, dsv == NoDepth ? nullptr : &depth);
+}
+
+void D3D12CommandList::ClearRenderTarget(uint32_t rtv, const float color[4])
+{
+	mCmdList->ClearRenderTargetView(Rtv(rtv), color, 0, nullptr);
+}
+
+void D3D12CommandList::ClearDepthStencil(uint32_t dsv, float depth, uint8_t stencil)
+{
+	mCmdList->ClearDepthStencilView(Dsv(dsv), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, depth, stencil, 0, nullptr);
+}
+
+void D3D12CommandList::Barrier(RenderId resource, ResourceState before, ResourceState after)
+{
+	CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+		mResources[resource], (D3D12_RESOURCE_STATES)before, (D3D12_RESOURCE_STATES)after);
+	mCmdList->ResourceBarrier(1, &barrier);
+}
+
+void D3D12CommandList::CopyResource(RenderId destination, RenderId source)
+{
+	mCmdList->CopyResource(mResources[destination], mResources[source]);
+}
+
+void D3D12CommandList::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex)
+{
+	mCmdList->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, 0);
+}
+
+void D3D12CommandList::DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex)
+{
+	mCmdList->DrawInstanced(vertexCount, instanceCount, startVertex, 0);
+}
+
+void D3D12CommandList::Dispatch(uint32_t x, uint32_t y, uint32_t z)
+{
+	mCmdList->Dispatch(x, y, z);
+}
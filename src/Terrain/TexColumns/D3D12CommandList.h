@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+#include "d3dUtil.h"
+#include "RenderCommands.h"
+
+// RenderCommandList on a D3D12 graphics command list. Ids index tables of
+// the app's device objects; descriptor indices are turned into handles of
+// the bound SRV heap and of the RTV and DSV heaps given to SetTargetHeaps.
+class D3D12CommandList : public RenderCommandList
+{
+public:
+	// The list being recorded; reset by the caller
+	void SetCommandList(ID3D12GraphicsCommandList* cmdList) { mCmdList = cmdList; }
+	ID3D12GraphicsCommandList* Get() const { return mCmdList; }
+
+	RenderId AddPipeline(ID3D12PipelineState* pipeline);
+	RenderId AddRootSignature(ID3D12RootSignature* rootSignature);
+	// Also stores the id in geometry->Id, which the draw items are built from
+	RenderId AddGeometry(MeshGeometry* geometry);
+	// Heaps and resources are recreated on resize and resources differ per
+	// frame resource, so their ids are slots the app points at this frame's
+	RenderId AddDescriptorHeap();
+	void UpdateDescriptorHeap(RenderId id, ID3D12DescriptorHeap* heap, UINT descriptorSize);
+	RenderId AddResource();
+	void SetResource(RenderId id, ID3D12Resource* resource) { mResources[id] = resource; }
+	void SetTargetHeaps(ID3D12DescriptorHeap* rtvHeap, UINT rtvSize, ID3D12DescriptorHeap* dsvHeap, UINT dsvSize);
+
+	void SetPipelineState(RenderId pipeline) override;
+	void SetGraphicsRootSignature(RenderId rootSignature) override;
+	void SetComputeRootSignature(RenderId rootSignature) override;
+	void SetDescriptorHeap(RenderId heap) override;
+	void SetGraphicsRootDescriptorTable(uint32_t slot, uint32_t descriptor) override;
+	void SetComputeRootDescriptorTable(uint32_t slot, uint32_t descriptor) override;
+	void SetGraphicsRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset) override;
+	void SetComputeRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset) override;
+
+	void SetVertexBuffer(RenderId geometry) override;
+	void SetIndexBuffer(RenderId geometry) override;
+	void SetPrimitiveTopology(uint32_t topology) override;
+
+	void SetViewport(const RenderViewport& viewport) override;
+	void SetScissorRect(const RenderRect& rect) override;
+	void SetRenderTargets(const uint32_t* rtvs, uint32_t count, uint32_t dsv) override;
+	void ClearRenderTarget(uint32_t rtv, const float color[4]) override;
+	void ClearDepthStencil(uint32_t dsv, float depth, uint8_t stencil) override;
+
+	void Barrier(RenderId resource, ResourceState before, ResourceState after) override;
+	void CopyResource(RenderId destination, RenderId source) override;
+
+	void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex) override;
+	void DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex) override;
+	void Dispatch(uint32_t x, uint32_t y, uint32_t z) override;
+
+private:
+	struct Heap
+	{
+		ID3D12DescriptorHeap* Heap;
+		UINT DescriptorSize;
+		D3D12_GPU_DESCRIPTOR_HANDLE GpuStart;
+	};
+
+	D3D12_GPU_DESCRIPTOR_HANDLE Descriptor(uint32_t index) const
+	{
+		return CD3DX12_GPU_DESCRIPTOR_HANDLE(mHeaps[mBoundHeap].GpuStart, index, mHeaps[mBoundHeap].DescriptorSize);
+	}
+	D3D12_CPU_DESCRIPTOR_HANDLE Rtv(uint32_t index) const
+	{
+		return CD3DX12_CPU_DESCRIPTOR_HANDLE(mRtvStart, index, mRtvSize);
+	}
+	D3D12_CPU_DESCRIPTOR_HANDLE Dsv(uint32_t index) const
+	{
+		return CD3DX12_CPU_DESCRIPTOR_HANDLE(mDsvStart, index, mDsvSize);
+	}
+
+	ID3D12GraphicsCommandList* mCmdList = nullptr;
+	std::vector<ID3D12PipelineState*> mPipelines;
+	std::vector<ID3D12RootSignature*> mRootSignatures;
+	std::vector<Heap> mHeaps;
+	std::vector<MeshGeometry*> mGeometries;
+	std::vector<ID3D12Resource*> mResources;
+	RenderId mBoundHeap = 0;
+
+	D3D12_CPU_DESCRIPTOR_HANDLE mRtvStart = {};
+	D3D12_CPU_DESCRIPTOR_HANDLE mDsvStart = {};
+	UINT mRtvSize = 0;
+	UINT mDsvSize = 0;
+};
@@ -0,0 +1,592 @@
+#include "DynamicAabbTree.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	Aabb Expand(const Aabb& box, float margin)
+	{
+		Aabb result = box;
+		for (int c = 0; c < 3; ++c)
+		{
+			result.Min[c] -= margin;
+			result.Max[c] += margin;
+		}
+		return result;
+	}
+
+	// Entry distance of the ray into box, or -1 when it misses within maxDistance
+	float RayEnter(const Aabb& box, const float origin[3], const float invDir[3], float maxDistance)
+	{
+		float tMin = 0.0f, tMax = maxDistance;
+		for (int c = 0; c < 3; ++c)
+		{
+			float t0 = (box.Min[c] - origin[c]) * invDir[c];
+			float t1 = (box.Max[c] - origin[c]) * invDir[c];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			// NaN (0 * inf for a ray in the slab plane) must not reject the box
+			if (t0 > tMin) tMin = t0;
+			if (t1 < tMax) tMax = t1;
+			if (tMin > tMax)
+				return -1.0f;
+		}
+		return tMin;
+	}
+}
+
+void DynamicAabbTree::Clear()
+{
+	mNodes.clear();
+	mRoot = -1;
+	mFreeList = -1;
+	mLeafCount = 0;
+}
+
+int32_t DynamicAabbTree::AllocateNode()
+{
+	int32_t index;
+	if (mFreeList >= 0)
+	{
+		index = mFreeList;
+		mFreeList = mNodes[index].Parent;
+	}
+	else
+	{
+		index = (int32_t)mNodes.size();
+		mNodes.emplace_back();
+	}
+	mNodes[index] = Node();
+	return index;
+}
+
+void DynamicAabbTree::FreeNode(int32_t node)
+{
+	mNodes[node].Parent = mFreeList;
+	mNodes[node].Height = -1;
+	mFreeList = node;
+}
+
+int32_t DynamicAabbTree::Insert(const Aabb& box, uint32_t userData)
+{
+	const int32_t leaf = AllocateNode();
+	mNodes[leaf].Box = Expand(box, mMargin);
+	mNodes[leaf].UserData = userData;
+	InsertLeaf(leaf);
+	++mLeafCount;
+	return leaf;
+}
+
+void DynamicAabbTree::Remove(int32_t proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	--mLeafCount;
+}
+
+bool DynamicAabbTree::Move(int32_t proxy, const Aabb& box)
+{
+	Node& leaf = mNodes[proxy];
+	if (leaf.Box.Contains(box))
+		return false;
+
+	const Aabb fat = Expand(box, mMargin);
+
+	// Refit in place while the leaf still belongs next to its sibling; once
+	// it has drifted off (the pair's box would grow a lot) the old
+	// neighbourhood means nothing and the leaf is inserted again.
+	bool refit = leaf.Parent >= 0;
+	if (refit)
+	{
+		const Node& parent = mNodes[leaf.Parent];
+		const int32_t sibling = parent.Child1 == proxy ? parent.Child2 : parent.Child1;
+		refit = Aabb::Union(fat, mNodes[sibling].Box).HalfArea() <= MaxRefitGrowth * (fat.HalfArea() + mNodes[sibling].Box.HalfArea());
+	}
+
+	if (refit)
+	{
+		leaf.Box = fat;
+		RefitAncestors(leaf.Parent);
+	}
+	else
+	{
+		RemoveLeaf(proxy);
+		mNodes[proxy].Box = fat;
+		InsertLeaf(proxy);
+	}
+	return true;
+}
+
+int32_t DynamicAabbTree::FindBestSibling(const Aabb& box) const
+{
+	// Branch and bound over the cost of placing the leaf next to each node:
+	// the new parent's area plus the growth of every ancestor.
+	const float boxArea = box.HalfArea();
+	int32_t best = mRoot;
+	float bestCost = Aabb::Union(mNodes[mRoot].Box, box).HalfArea();
+
+	struct Candidate { int32_t Node; float Inherited; };
+	Candidate stack[256];
+	int top = 0;
+	stack[top++] = { mRoot, 0.0f };
+
+	while (top > 0)
+	{
+		const Candidate c = stack[--top];
+		const Node& node = mNodes[c.Node];
+		const float direct = Aabb::Union(node.Box, box).HalfArea();
+		const float cost = direct + c.Inherited;
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			best = c.Node;
+		}
+
+		const float inherited = c.Inherited + direct - node.Box.HalfArea();
+		if (!node.IsLeaf() && boxArea + inherited < bestCost && top + 2 <= 256)
+		{
+			stack[top++] = { node.Child1, inherited };
+			stack[top++] = { node.Child2, inherited };
+		}
+	}
+	return best;
+}
+
+void DynamicAabbTree::InsertLeaf(int32_t leaf)
+{
+	if (mRoot < 0)
+	{
+		mRoot = leaf;
+		mNodes[leaf].Parent = -1;
+		return;
+	}
+
+	const int32_t sibling = FindBestSibling(mNodes[leaf].Box);
+	const int32_t oldParent = mNodes[sibling].Parent;
+	const int32_t newParent = AllocateNode();
+
+	Node& parent = mNodes[newParent];
+	parent.Parent = oldParent;
+	parent.Child1 = sibling;
+	parent.Child2 = leaf;
+	parent.Box = Aabb::Union(mNodes[sibling].Box, mNodes[leaf].Box);
+	parent.Height = mNodes[sibling].Height + 1;
+
+	if (oldParent >= 0)
+	{
+		if (mNodes[oldParent].Child1 == sibling)
+			mNodes[oldParent].Child1 = newParent;
+		else
+			mNodes[oldParent].Child2 = newParent;
+	}
+	else
+	{
+		mRoot = newParent;
+	}
+	mNodes[sibling].Parent = newParent;
+	mNodes[leaf].Parent = newParent;
+
+	RefitAncestors(newParent);
+}
+
+void DynamicAabbTree::RemoveLeaf(int32_t leaf)
+{
+	if (leaf == mRoot)
+	{
+		mRoot = -1;
+		return;
+	}
+
+	const int32_t parent = mNodes[leaf].Parent;
+	const int32_t grandParent = mNodes[parent].Parent;
+	const int32_t sibling = mNodes[parent].Child1 == leaf ? mNodes[parent].Child2 : mNodes[parent].Child1;
+
+	if (grandParent >= 0)
+	{
+		if (mNodes[grandParent].Child1 == parent)
+			mNodes[grandParent].Child1 = sibling;
+		else
+			mNodes[grandParent].Child2 = sibling;
+		mNodes[sibling].Parent = grandParent;
+		FreeNode(parent);
+		RefitAncestors(grandParent);
+	}
+	else
+	{
+		mRoot = sibling;
+		mNodes[sibling].Parent = -1;
+		FreeNode(parent);
+	}
+	mNodes[leaf].Parent = -1;
+}
+
+void DynamicAabbTree::RefitAncestors(int32_t index)
+{
+	while (index >= 0)
+	{
+		Node& node = mNodes[index];
+		const Node& a = mNodes[node.Child1];
+		const Node& b = mNodes[node.Child2];
+		node.Box = Aabb::Union(a.Box, b.Box);
+		node.Height = 1 + std::max(a.Height, b.Height);
+
+		Rotate(index);
+		index = mNodes[index].Parent;
+	}
+}
+
+void DynamicAabbTree::Rotate(int32_t index)
+{
+	// Swapping a child with a grandchild on the other side keeps the node's
+	// own box and only changes the box of the child that gets the new member.
+	// Take the swap that shrinks that box the most, if any does.
+	Node& a = mNodes[index];
+	const int32_t b = a.Child1, c = a.Child2;
+	const Node& nb = mNodes[b];
+	const Node& nc = mNodes[c];
+	if (nb.IsLeaf() && nc.IsLeaf())
+		return;
+
+	enum { None, BF, BG, CD, CE } best = None;
+	float bestGain = 0.0f;
+
+	if (!nc.IsLeaf())
+	{
+		const float area = nc.Box.HalfArea();
+		const float bf = area - Aabb::Union(nb.Box, mNodes[nc.Child2].Box).HalfArea(); // b <-> f
+		const float bg = area - Aabb::Union(nb.Box, mNodes[nc.Child1].Box).HalfArea(); // b <-> g
+		if (bf > bestGain) { bestGain = bf; best = BF; }
+		if (bg > bestGain) { bestGain = bg; best = BG; }
+	}
+	if (!nb.IsLeaf())
+	{
+		const float area = nb.Box.HalfArea();
+		const float cd = area - Aabb::Union(nc.Box, mNodes[nb.Child2].Box).HalfArea(); // c <-> d
+		const float ce = area - Aabb::Union(nc.Box, mNodes[nb.Child1].Box).HalfArea(); // c <-> e
+		if (cd > bestGain) { bestGain = cd; best = CD; }
+		if (ce > bestGain) { bestGain = ce; best = CE; }
+	}
+	if (best == None)
+		return;
+
+	// child: a's child that moves down; other: a's other child, whose
+	// grandchild moves up in exchange.
+	const int32_t child = (best == BF || best == BG) ? b : c;
+	const int32_t other = child == b ? c : b;
+	Node& no = mNodes[other];
+	const bool firstGrandchild = best == BF || best == CD;
+	const int32_t grandchild = firstGrandchild ? no.Child1 : no.Child2;
+	const int32_t kept = firstGrandchild ? no.Child2 : no.Child1;
+
+	if (a.Child1 == child)
+		a.Child1 = grandchild;
+	else
+		a.Child2 = grandchild;
+	if (firstGrandchild)
+		no.Child1 = child;
+	else
+		no.Child2 = child;
+	mNodes[grandchild].Parent = index;
+	mNodes[child].Parent = other;
+
+	no.Box = Aabb::Union(mNodes[child].Box, mNodes[kept].Box);
+	no.Height = 1 + std::max(mNodes[child].Height, mNodes[kept].Height);
+	a.Height = 1 + std::max(mNodes[a.Child1].Height, mNodes[a.Child2].Height);
+}
+
+void DynamicAabbTree::Rebuild()
+{
+	std::vector<int32_t> leaves;
+	leaves.reserve(mLeafCount);
+	for (int32_t i = 0; i < (int32_t)mNodes.size(); ++i)
+	{
+		if (mNodes[i].Height < 0)
+			continue;
+		if (mNodes[i].IsLeaf())
+			leaves.push_back(i);
+		else
+			FreeNode(i);
+	}
+	mRoot = leaves.empty() ? -1 : BuildRange(leaves.data(), (int32_t)leaves.size());
+	if (mRoot >= 0)
+		mNodes[mRoot].Parent = -1;
+}
+
+int32_t DynamicAabbTree::BuildRange(int32_t* leaves, int32_t count)
+{
+	if (count == 1)
+		return leaves[0];
+
+	Aabb bounds = mNodes[leaves[0]].Box;
+	Aabb centroids;
+	for (int c = 0; c < 3; ++c)
+		centroids.Min[c] = centroids.Max[c] = bounds.Center(c);
+	for (int32_t i = 1; i < count; ++i)
+	{
+		const Aabb& box = mNodes[leaves[i]].Box;
+		bounds = Aabb::Union(bounds, box);
+		for (int c = 0; c < 3; ++c)
+		{
+			centroids.Min[c] = std::min(centroids.Min[c], box.Center(c));
+			centroids.Max[c] = std::max(centroids.Max[c], box.Center(c));
+		}
+	}
+
+	// Binned SAH over the centroid extents of every axis
+	const int Bins = 12;
+	int bestAxis = -1, bestSplit = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float extent = centroids.Size(axis);
+		if (extent <= 0.0f)
+			continue;
+
+		Aabb binBox[Bins];
+		int binCount[Bins] = {};
+		for (int32_t i = 0; i < count; ++i)
+		{
+			const Aabb& box = mNodes[leaves[i]].Box;
+			const int bin = std::min(Bins - 1, (int)((box.Center(axis) - centroids.Min[axis]) / extent * Bins));
+			binBox[bin] = binCount[bin]++ ? Aabb::Union(binBox[bin], box) : box;
+		}
+
+		float rightArea[Bins];
+		int rightCount[Bins];
+		Aabb acc;
+		int n = 0;
+		for (int i = Bins - 1; i > 0; --i)
+		{
+			if (binCount[i])
+				acc = n ? Aabb::Union(acc, binBox[i]) : binBox[i];
+			n += binCount[i];
+			rightArea[i] = n ? acc.HalfArea() : 0.0f;
+			rightCount[i] = n;
+		}
+		n = 0;
+		for (int i = 0; i < Bins - 1; ++i)
+		{
+			if (binCount[i])
+				acc = n ? Aabb::Union(acc, binBox[i]) : binBox[i];
+			n += binCount[i];
+			if (n == 0 || rightCount[i + 1] == 0)
+				continue;
+			const float cost = n * acc.HalfArea() + rightCount[i + 1] * rightArea[i + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	int32_t mid;
+	if (bestAxis < 0)
+	{
+		mid = count / 2; // all centroids coincide
+	}
+	else
+	{
+		const float extent = centroids.Size(bestAxis);
+		int32_t* split = std::partition(leaves, leaves + count, [&](int32_t leaf)
+		{
+			const int bin = std::min(Bins - 1, (int)((mNodes[leaf].Box.Center(bestAxis) - centroids.Min[bestAxis]) / extent * Bins));
+			return bin <= bestSplit;
+		});
+		mid = (int32_t)(split - leaves);
+		if (mid == 0 || mid == count)
+			mid = count / 2;
+	}
+
+	const int32_t left = BuildRange(leaves, mid);
+	const int32_t right = BuildRange(leaves + mid, count - mid);
+	const int32_t index = AllocateNode();
+	Node& node = mNodes[index];
+	node.Child1 = left;
+	node.Child2 = right;
+	node.Box = bounds;
+	node.Height = 1 + std::max(mNodes[left].Height, mNodes[right].Height);
+	mNodes[left].Parent = index;
+	mNodes[right].Parent = index;
+	return index;
+}
+
+void DynamicAabbTree::Query(const FrustumPlanes& frustum, std::vector<uint32_t>& result, BvhQueryStats* stats) const
+{
+	BvhQueryStats local;
+	if (mRoot >= 0)
+	{
+		struct Entry { int32_t Node; uint32_t Planes; };
+		std::vector<Entry> stack;
+		stack.push_back({ mRoot, FrustumPlanes::AllPlanes });
+		while (!stack.empty())
+		{
+			Entry e = stack.back();
+			stack.pop_back();
+			const Node& node = mNodes[e.Node];
+			++local.NodesVisited;
+
+			if (e.Planes != 0)
+			{
+				if (node.IsLeaf())
+					++local.LeavesTested;
+				if (frustum.Classify(node.Box, e.Planes) == CullResult::Outside)
+					continue;
+			}
+
+			if (node.IsLeaf())
+			{
+				result.push_back(node.UserData);
+				continue;
+			}
+			// A cleared mask means fully inside: the subtree is taken untested
+			stack.push_back({ node.Child1, e.Planes });
+			stack.push_back({ node.Child2, e.Planes });
+		}
+	}
+	if (stats)
+		*stats = local;
+}
+
+void DynamicAabbTree::Query(const FrustumPlanes* views, uint32_t viewCount, std::vector<uint32_t>* results, BvhQueryStats* stats) const
+{
+	BvhQueryStats local;
+	viewCount = std::min(viewCount, ViewCullState::MaxViews);
+	if (mRoot >= 0 && viewCount > 0)
+	{
+		struct Entry { int32_t Node; ViewCullState State; };
+		std::vector<Entry> stack;
+		stack.push_back({ mRoot, ViewCullState::All(viewCount) });
+		while (!stack.empty())
+		{
+			Entry e = stack.back();
+			stack.pop_back();
+			const Node& node = mNodes[e.Node];
+			++local.NodesVisited;
+
+			if (node.IsLeaf())
+				++local.LeavesTested;
+			if (!e.State.Classify(views, viewCount, node.Box))
+				continue;
+
+			if (node.IsLeaf())
+			{
+				for (uint32_t i = 0; i < viewCount; ++i)
+				{
+					if (e.State.Visible & (1u << i))
+						results[i].push_back(node.UserData);
+				}
+				continue;
+			}
+			stack.push_back({ node.Child1, e.State });
+			stack.push_back({ node.Child2, e.State });
+		}
+	}
+	if (stats)
+		*stats = local;
+}
+
+void DynamicAabbTree::Query(const Aabb& box, std::vector<uint32_t>& result) const
+{
+	if (mRoot < 0)
+		return;
+
+	std::vector<int32_t> stack;
+	stack.push_back(mRoot);
+	while (!stack.empty())
+	{
+		const Node& node = mNodes[stack.back()];
+		stack.pop_back();
+		if (!node.Box.Overlaps(box))
+			continue;
+		if (node.IsLeaf())
+		{
+			result.push_back(node.UserData);
+			continue;
+		}
+		stack.push_back(node.Child1);
+		stack.push_back(node.Child2);
+	}
+}
+
+void DynamicAabbTree::RayCast(const float origin[3], const float direction[3], float maxDistance, std::vector<RayHit>& hits) const
+{
+	if (mRoot < 0)
+		return;
+
+	const float invDir[3] = { 1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2] };
+	const size_t first = hits.size();
+
+	std::vector<int32_t> stack;
+	stack.push_back(mRoot);
+	while (!stack.empty())
+	{
+		const Node& node = mNodes[stack.back()];
+		stack.pop_back();
+		const float t = RayEnter(node.Box, origin, invDir, maxDistance);
+		if (t < 0.0f)
+			continue;
+		if (node.IsLeaf())
+		{
+			hits.push_back({ node.UserData, t });
+			continue;
+		}
+		stack.push_back(node.Child1);
+		stack.push_back(node.Child2);
+	}
+
+	std::sort(hits.begin() + first, hits.end(), [](const RayHit& a, const RayHit& b) { return a.Distance < b.Distance; });
+}
+
+float DynamicAabbTree::ComputeCost() const
+{
+	if (mRoot < 0 || mNodes[mRoot].IsLeaf())
+		return 0.0f;
+
+	float area = 0.0f;
+	for (const Node& node : mNodes)
+	{
+		if (node.Height > 0)
+			area += node.Box.HalfArea();
+	}
+	const float rootArea = mNodes[mRoot].Box.HalfArea();
+	return rootArea > 0.0f ? area / rootArea : 0.0f;
+}
+
+bool DynamicAabbTree::Validate() const
+{
+	if (mRoot < 0)
+		return mLeafCount == 0;
+	if (mNodes[mRoot].Parent != -1)
+		return false;
+
+	size_t leaves = 0;
+	std::vector<int32_t> stack;
+	stack.push_back(mRoot);
+	while (!stack.empty())
+	{
+		const int32_t index = stack.back();
+		stack.pop_back();
+		const Node& node = mNodes[index];
+		if (node.IsLeaf())
+		{
+			++leaves;
+			if (node.Height != 0)
+				return false;
+			continue;
+		}
+
+		const Node& a = mNodes[node.Child1];
+		const Node& b = mNodes[node.Child2];
+		if (a.Parent != index || b.Parent != index ||
+			node.Height != 1 + std::max(a.Height, b.Height) ||
+			!node.Box.Contains(a.Box) || !node.Box.Contains(b.Box))
+			return false;
+		stack.push_back(node.Child1);
+		stack.push_back(node.Child2);
+	}
+	return leaves == mLeafCount;
+}
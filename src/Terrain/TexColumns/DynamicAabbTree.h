@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "CullingShapes.h"
+
+// Dynamic bounding volume hierarchy for objects that move every frame.
+//
+// Leaves store a "fat" box (the object box grown by a margin). Moving an
+// object inside its fat box costs nothing; once it leaves, the leaf is
+// refitted in place and the ancestors are refitted on the way up, with a
+// tree rotation (Kensler 2008) tried at every level so the hierarchy does not
+// decay. Only a leaf that drifted away from its sibling is reinserted. New
+// leaves are placed by a branch-and-bound search for the sibling with the
+// lowest surface area cost (SAH).
+//
+// Rebuild() does a full top-down binned SAH build over the current leaves;
+// proxies stay valid across it.
+
+struct RayHit
+{
+	uint32_t UserData = 0;
+	float Distance = 0.0f;       // where the ray enters the leaf's box
+};
+
+struct BvhQueryStats
+{
+	uint32_t NodesVisited = 0;
+	uint32_t LeavesTested = 0;
+};
+
+class DynamicAabbTree
+{
+public:
+	explicit DynamicAabbTree(float margin = 0.1f) : mMargin(margin) {}
+
+	void Clear();
+
+	int32_t Insert(const Aabb& box, uint32_t userData);
+	void Remove(int32_t proxy);
+	// Returns true when the box left the leaf's fat box and the tree changed.
+	bool Move(int32_t proxy, const Aabb& box);
+
+	void Rebuild();
+
+	void Query(const FrustumPlanes& frustum, std::vector<uint32_t>& result, BvhQueryStats* stats = nullptr) const;
+	void Query(const Aabb& box, std::vector<uint32_t>& result) const;
+	// One walk for up to ViewCullState::MaxViews views: results[i] gets what
+	// views[i] sees.
+	void Query(const FrustumPlanes* views, uint32_t viewCount, std::vector<uint32_t>* results, BvhQueryStats* stats = nullptr) const;
+	// All leaves the ray passes through within maxDistance, nearest first.
+	// direction does not need to be normalized; distances are in its units.
+	void RayCast(const float origin[3], const float direction[3], float maxDistance, std::vector<RayHit>& hits) const;
+
+	uint32_t GetUserData(int32_t proxy) const { return mNodes[proxy].UserData; }
+	const Aabb& GetFatBox(int32_t proxy) const { return mNodes[proxy].Box; }
+	size_t GetLeafCount() const { return mLeafCount; }
+	int32_t GetHeight() const { return mRoot < 0 ? 0 : mNodes[mRoot].Height; }
+	// Sum of internal node areas over the root area: what a query is
+	// expected to pay. Lower is better.
+	float ComputeCost() const;
+	// Checks parent links, heights and containment. For debugging.
+	bool Validate() const;
+
+private:
+	struct Node
+	{
+		Aabb Box;
+		int32_t Parent = -1;
+		int32_t Child1 = -1;
+		int32_t Child2 = -1;
+		int32_t Height = 0;          // 0 for leaves, -1 when free
+		uint32_t UserData = 0;
+
+		bool IsLeaf() const { return Child1 < 0; }
+	};
+
+	int32_t AllocateNode();
+	void FreeNode(int32_t node);
+	void InsertLeaf(int32_t leaf);
+	void RemoveLeaf(int32_t leaf);
+	int32_t FindBestSibling(const Aabb& box) const;
+	// Refits from node to the root, rotating on the way.
+	void RefitAncestors(int32_t node);
+	void Rotate(int32_t node);
+	int32_t BuildRange(int32_t* leaves, int32_t count);
+
+	static constexpr float MaxRefitGrowth = 4.0f;
+
+private:
+	std::vector<Node> mNodes;
+	int32_t mRoot = -1;
+	int32_t mFreeList = -1;      // chained through Parent
+	size_t mLeafCount = 0;
+	float mMargin;
+};
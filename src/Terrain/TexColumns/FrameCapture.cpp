@@ -0,0 +1,540 @@
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	const char Magic[4] = { 'T', 'C', 'A', 'P' };
+	const uint32_t Version = 1;
+	const uint32_t MaxRootParameters = 64;
+	const uint64_t Unbound = ~0ull;
+
+	void PutU32(std::vector<uint8_t>& out, uint32_t value)
+	{
+		for (int i = 0; i < 4; ++i)
+			out.push_back((uint8_t)(value >> (8 * i)));
+	}
+
+	struct Reader
+	{
+		const std::vector<uint8_t>& Data;
+		size_t Cursor = 0;
+
+		bool GetU32(uint32_t& value)
+		{
+			if (Cursor + 4 > Data.size())
+				return false;
+			value = 0;
+			for (int i = 0; i < 4; ++i)
+				value |= (uint32_t)Data[Cursor++] << (8 * i);
+			return true;
+		}
+	};
+
+	uint64_t Pack(uint32_t hi, uint32_t lo)
+	{
+		return (uint64_t)hi << 32 | lo;
+	}
+
+	// Root arguments of one pipeline type (graphics or compute)
+	struct RootState
+	{
+		uint64_t RootSignature = Unbound;
+		uint64_t Tables[MaxRootParameters];
+		uint64_t Cbvs[MaxRootParameters];
+
+		RootState() { ClearArguments(); }
+
+		void ClearArguments()
+		{
+			std::fill(std::begin(Tables), std::end(Tables), Unbound);
+			std::fill(std::begin(Cbvs), std::end(Cbvs), Unbound);
+		}
+		void ClearTables()
+		{
+			std::fill(std::begin(Tables), std::end(Tables), Unbound);
+		}
+	};
+
+	// Sets state to value; true if it already was
+	bool Bind(uint64_t& state, uint64_t value)
+	{
+		if (state == value)
+			return true;
+		state = value;
+		return false;
+	}
+}
+
+bool FrameCapture::Save(const std::string& path, std::string& error) const
+{
+	std::vector<uint8_t> bytes;
+	bytes.reserve(32 + Commands.size() * sizeof(RenderCommand) + Payload.size() * 4
+		+ Constants.size() * sizeof(CapturedConstants) + ConstantData.size());
+	bytes.insert(bytes.end(), std::begin(Magic), std::end(Magic));
+	PutU32(bytes, Version);
+	PutU32(bytes, Frame);
+	PutU32(bytes, (uint32_t)Commands.size());
+	PutU32(bytes, (uint32_t)Payload.size());
+	PutU32(bytes, (uint32_t)Constants.size());
+	PutU32(bytes, (uint32_t)ConstantData.size());
+	for (const RenderCommand& c : Commands)
+	{
+		PutU32(bytes, (uint32_t)c.Op | (uint32_t)c.Slot << 8 | (uint32_t)c.Count << 16);
+		PutU32(bytes, c.A);
+		PutU32(bytes, c.B);
+		PutU32(bytes, c.C);
+	}
+	for (uint32_t word : Payload)
+		PutU32(bytes, word);
+	for (const CapturedConstants& c : Constants)
+	{
+		PutU32(bytes, c.Buffer);
+		PutU32(bytes, c.Offset);
+		PutU32(bytes, c.Size);
+		PutU32(bytes, c.Data);
+	}
+	bytes.insert(bytes.end(), ConstantData.begin(), ConstantData.end());
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+	if (!out)
+	{
+		error = "Cannot write " + path;
+		return false;
+	}
+	return true;
+}
+
+bool FrameCapture::Load(const std::string& path, std::string& error)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		error = "Cannot read " + path;
+		return false;
+	}
+	const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	Reader r{ data };
+
+	uint32_t version = 0;
+	if (data.size() < sizeof(Magic) || memcmp(data.data(), Magic, sizeof(Magic)) != 0)
+	{
+		error = path + " is not a capture";
+		return false;
+	}
+	r.Cursor = sizeof(Magic);
+	uint32_t counts[5];
+	if (!r.GetU32(version) || version != Version)
+	{
+		error = path + ": unsupported capture version " + std::to_string(version);
+		return false;
+	}
+	for (uint32_t& count : counts)
+	{
+		if (!r.GetU32(count))
+		{
+			error = path + ": truncated header";
+			return false;
+		}
+	}
+	const uint64_t expected = (uint64_t)counts[1] * 16 + (uint64_t)counts[2] * 4 + (uint64_t)counts[3] * 16 + counts[4];
+	if (data.size() - r.Cursor != expected)
+	{
+		error = path + ": size does not match the header";
+		return false;
+	}
+
+	Frame = counts[0];
+	Commands.resize(counts[1]);
+	Payload.resize(counts[2]);
+	Constants.resize(counts[3]);
+	for (RenderCommand& c : Commands)
+	{
+		uint32_t head = 0;
+		r.GetU32(head);
+		r.GetU32(c.A);
+		r.GetU32(c.B);
+		r.GetU32(c.C);
+		c.Op = (RenderOp)(head & 0xFF);
+		c.Slot = (uint8_t)(head >> 8);
+		c.Count = (uint16_t)(head >> 16);
+	}
+	for (uint32_t& word : Payload)
+		r.GetU32(word);
+	for (CapturedConstants& c : Constants)
+	{
+		r.GetU32(c.Buffer);
+		r.GetU32(c.Offset);
+		r.GetU32(c.Size);
+		r.GetU32(c.Data);
+	}
+	ConstantData.assign(data.begin() + r.Cursor, data.end());
+
+	// Replay trusts the payload offsets and target counts, so check them here
+	for (size_t i = 0; i < Commands.size(); ++i)
+	{
+		const RenderCommand& c = Commands[i];
+		const uint32_t words = RenderPayloadWords(c.Op);
+		const bool ok = c.Op < RenderOp::Count
+			&& (words == 0 || (uint64_t)c.B + words <= Payload.size())
+			&& (c.Op != RenderOp::SetRenderTargets || c.Count <= RenderCommandList::MaxRenderTargets);
+		if (!ok)
+		{
+			error = path + ": bad command " + std::to_string(i);
+			return false;
+		}
+	}
+	for (const CapturedConstants& c : Constants)
+	{
+		if ((uint64_t)c.Data + c.Size > ConstantData.size())
+		{
+			error = path + ": bad constant block";
+			return false;
+		}
+	}
+	return true;
+}
+
+void FrameCapture::Replay(RenderCommandList& cmd) const
+{
+	for (const RenderCommand& c : Commands)
+	{
+		switch (c.Op)
+		{
+		case RenderOp::SetPipelineState: cmd.SetPipelineState(c.A); break;
+		case RenderOp::SetGraphicsRootSignature: cmd.SetGraphicsRootSignature(c.A); break;
+		case RenderOp::SetComputeRootSignature: cmd.SetComputeRootSignature(c.A); break;
+		case RenderOp::SetDescriptorHeap: cmd.SetDescriptorHeap(c.A); break;
+		case RenderOp::SetGraphicsTable: cmd.SetGraphicsRootDescriptorTable(c.Slot, c.A); break;
+		case RenderOp::SetComputeTable: cmd.SetComputeRootDescriptorTable(c.Slot, c.A); break;
+		case RenderOp::SetGraphicsCbv: cmd.SetGraphicsRootConstantBufferView(c.Slot, c.A, c.B); break;
+		case RenderOp::SetComputeCbv: cmd.SetComputeRootConstantBufferView(c.Slot, c.A, c.B); break;
+		case RenderOp::SetVertexBuffer: cmd.SetVertexBuffer(c.A); break;
+		case RenderOp::SetIndexBuffer: cmd.SetIndexBuffer(c.A); break;
+		case RenderOp::SetTopology: cmd.SetPrimitiveTopology(c.A); break;
+		case RenderOp::SetViewport:
+		{
+			RenderViewport viewport;
+			memcpy((void*)&viewport, Payload.data() + c.B, sizeof(viewport));
+			cmd.SetViewport(viewport);
+			break;
+		}
+		case RenderOp::SetScissor:
+		{
+			RenderRect rect;
+			memcpy((void*)&rect, Payload.data() + c.B, sizeof(rect));
+			cmd.SetScissorRect(rect);
+			break;
+		}
+		case RenderOp::SetRenderTargets:
+		{
+			const uint32_t rtvs[RenderCommandList::MaxRenderTargets] = { c.A, c.B };
+			cmd.SetRenderTargets(rtvs, c.Count, c.C);
+			break;
+		}
+		case RenderOp::ClearRenderTarget:
+		{
+			float color[4];
+			memcpy(color, Payload.data() + c.B, sizeof(color));
+			cmd.ClearRenderTarget(c.A, color);
+			break;
+		}
+		case RenderOp::ClearDepthStencil:
+		{
+			float depth;
+			memcpy(&depth, &c.B, sizeof(depth));
+			cmd.ClearDepthStencil(c.A, depth, (uint8_t)c.C);
+			break;
+		}
+		case RenderOp::Barrier: cmd.Barrier(c.A, (ResourceState)c.B, (ResourceState)c.C); break;
+		case RenderOp::CopyResource: cmd.CopyResource(c.A, c.B); break;
+		case RenderOp::DrawIndexed: cmd.DrawIndexedInstanced(c.A, c.Count, c.B, (int32_t)c.C); break;
+		case RenderOp::Draw: cmd.DrawInstanced(c.A, c.Count, c.B); break;
+		case RenderOp::Dispatch: cmd.Dispatch(c.A, c.B, c.C); break;
+		default: break;
+		}
+	}
+}
+
+CaptureAnalysis AnalyzeCapture(const FrameCapture& capture)
+{
+	CaptureAnalysis a;
+	a.Totals = CountCommands(capture.Commands.data(), capture.Commands.size());
+	a.ConstantBlocks = (uint32_t)capture.Constants.size();
+	a.UploadBytes = capture.ConstantData.size();
+
+	RootState graphics, compute;
+	uint64_t pipeline = Unbound, heap = Unbound;
+	uint64_t vertexBuffer = Unbound, indexBuffer = Unbound, topology = Unbound;
+	uint64_t targets[2] = { Unbound, Unbound };
+	const uint32_t* viewport = nullptr;
+	const uint32_t* scissor = nullptr;
+	RenderStats& r = a.Redundant;
+
+	// Viewports and scissors are compared by value, the payload has a copy per bind
+	auto samePayload = [&](const uint32_t*& bound, const RenderCommand& c)
+	{
+		const uint32_t* words = capture.Payload.data() + c.B;
+		const bool same = bound && memcmp(bound, words, RenderPayloadWords(c.Op) * 4) == 0;
+		bound = words;
+		return same;
+	};
+
+	for (const RenderCommand& c : capture.Commands)
+	{
+		if (c.Op < RenderOp::Count)
+			a.Ops[(size_t)c.Op]++;
+		RootState& root = c.Op == RenderOp::SetComputeRootSignature || c.Op == RenderOp::SetComputeTable
+			|| c.Op == RenderOp::SetComputeCbv ? compute : graphics;
+		const uint32_t slot = (std::min)((uint32_t)c.Slot, MaxRootParameters - 1);
+
+		switch (c.Op)
+		{
+		case RenderOp::SetPipelineState:
+			r.PipelineBinds += Bind(pipeline, c.A);
+			break;
+		case RenderOp::SetGraphicsRootSignature:
+		case RenderOp::SetComputeRootSignature:
+			if (Bind(root.RootSignature, c.A))
+				r.RootSignatureBinds++;
+			else
+				root.ClearArguments();
+			break;
+		case RenderOp::SetDescriptorHeap:
+			if (Bind(heap, c.A))
+				r.TargetBinds++;
+			else
+			{
+				graphics.ClearTables();
+				compute.ClearTables();
+			}
+			break;
+		case RenderOp::SetGraphicsTable:
+		case RenderOp::SetComputeTable:
+			r.TableBinds += Bind(root.Tables[slot], c.A);
+			break;
+		case RenderOp::SetGraphicsCbv:
+		case RenderOp::SetComputeCbv:
+			r.CbvBinds += Bind(root.Cbvs[slot], Pack(c.A, c.B));
+			break;
+		case RenderOp::SetVertexBuffer:
+			r.InputBinds += Bind(vertexBuffer, c.A);
+			break;
+		case RenderOp::SetIndexBuffer:
+			r.InputBinds += Bind(indexBuffer, c.A);
+			break;
+		case RenderOp::SetTopology:
+			r.InputBinds += Bind(topology, c.A);
+			break;
+		case RenderOp::SetViewport:
+			r.TargetBinds += samePayload(viewport, c);
+			break;
+		case RenderOp::SetScissor:
+			r.TargetBinds += samePayload(scissor, c);
+			break;
+		case RenderOp::SetRenderTargets:
+		{
+			// Count and first target, then second target and depth
+			const bool sameFirst = Bind(targets[0], Pack(c.Count, c.A));
+			const bool sameRest = Bind(targets[1], Pack(c.Count > 1 ? c.B : 0, c.C));
+			r.TargetBinds += sameFirst && sameRest;
+			break;
+		}
+		case RenderOp::DrawIndexed:
+		case RenderOp::Draw:
+		{
+			const uint64_t primitives = (uint64_t)c.A * c.Count;
+			int bucket = 0;
+			while (bucket + 1 < CaptureAnalysis::DrawSizeBuckets && (primitives >> (bucket + 1)) != 0)
+				++bucket;
+			a.DrawSizes[bucket]++;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	return a;
+}
+
+void CaptureCommandList::Begin(RenderCommandList& target, uint32_t frame)
+{
+	mTarget = &target;
+	mFrame = frame;
+	mRecord.Reset();
+	mSources.clear();
+	mConstants.clear();
+	mConstantData.clear();
+	mCaptured.clear();
+}
+
+void CaptureCommandList::SetConstantSource(RenderId buffer, const void* data, size_t bytes, uint32_t blockSize)
+{
+	mSources.push_back({ buffer, (const uint8_t*)data, bytes, blockSize });
+}
+
+void CaptureCommandList::End(FrameCapture& capture)
+{
+	capture.Frame = mFrame;
+	capture.Commands = mRecord.GetCommands();
+	capture.Payload = mRecord.GetPayload();
+	capture.Constants.swap(mConstants);
+	capture.ConstantData.swap(mConstantData);
+	mConstants.clear();
+	mConstantData.clear();
+	mTarget = nullptr;
+}
+
+void CaptureCommandList::CaptureConstants(RenderId buffer, uint32_t offset)
+{
+	if (!mCaptured.insert(Pack(buffer, offset)).second)
+		return;
+	for (const ConstantSource& source : mSources)
+	{
+		if (source.Buffer != buffer)
+			continue;
+		if ((uint64_t)offset + source.BlockSize > source.Bytes)
+			break;
+		CapturedConstants c;
+		c.Buffer = buffer;
+		c.Offset = offset;
+		c.Size = source.BlockSize;
+		c.Data = (uint32_t)mConstantData.size();
+		mConstantData.insert(mConstantData.end(), source.Data + offset, source.Data + offset + source.BlockSize);
+		mConstants.push_back(c);
+		return;
+	}
+	// No source: the bind is in the commands, the contents are not
+}
+
+void CaptureCommandList::SetPipelineState(RenderId pipeline)
+{
+	mTarget->SetPipelineState(pipeline);
+	mRecord.SetPipelineState(pipeline);
+}
+
+void CaptureCommandList::SetGraphicsRootSignature(RenderId rootSignature)
+{
+	mTarget->SetGraphicsRootSignature(rootSignature);
+	mRecord.SetGraphicsRootSignature(rootSignature);
+}
+
+void CaptureCommandList::SetComputeRootSignature(RenderId rootSignature)
+{
+	mTarget->SetComputeRootSignature(rootSignature);
+	mRecord.SetComputeRootSignature(rootSignature);
+}
+
+void CaptureCommandList::SetDescriptorHeap(RenderId heap)
+{
+	mTarget->SetDescriptorHeap(heap);
+	mRecord.SetDescriptorHeap(heap);
+}
+
+void CaptureCommandList::SetGraphicsRootDescriptorTable(uint32_t slot, uint32_t descriptor)
+{
+	mTarget->SetGraphicsRootDescriptorTable(slot, descriptor);
+	mRecord.SetGraphicsRootDescriptorTable(slot, descriptor);
+}
+
+void CaptureCommandList::SetComputeRootDescriptorTable(uint32_t slot, uint32_t descriptor)
+{
+	mTarget->SetComputeRootDescriptorTable(slot, descriptor);
+	mRecord.SetComputeRootDescriptorTable(slot, descriptor);
+}
+
+void CaptureCommandList::SetGraphicsRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset)
+{
+	mTarget->SetGraphicsRootConstantBufferView(slot, buffer, offset);
+	mRecord.SetGraphicsRootConstantBufferView(slot, buffer, offset);
+	CaptureConstants(buffer, offset);
+}
+
+void CaptureCommandList::SetComputeRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset)
+{
+	mTarget->SetComputeRootConstantBufferView(slot, buffer, offset);
+	mRecord.SetComputeRootConstantBufferView(slot, buffer, offset);
+	CaptureConstants(buffer, offset);
+}
+
+void CaptureCommandList::SetVertexBuffer(RenderId geometry)
+{
+	mTarget->SetVertexBuffer(geometry);
+	mRecord.SetVertexBuffer(geometry);
+}
+
+void CaptureCommandList::SetIndexBuffer(RenderId geometry)
+{
+	mTarget->SetIndexBuffer(geometry);
+	mRecord.SetIndexBuffer(geometry);
+}
+
+void CaptureCommandList::SetPrimitiveTopology(uint32_t topology)
+{
+	mTarget->SetPrimitiveTopology(topology);
+	mRecord.SetPrimitiveTopology(topology);
+}
+
+void CaptureCommandList::SetViewport(const RenderViewport& viewport)
+{
+	mTarget->SetViewport(viewport);
+	mRecord.SetViewport(viewport);
+}
+
+void CaptureCommandList::SetScissorRect(const RenderRect& rect)
+{
+	mTarget->SetScissorRect(rect);
+	mRecord.SetScissorRect(rect);
+}
+
+void CaptureCommandList::SetRenderTargets(const uint32_t* rtvs, uint32_t count, uint32_t dsv)
+{
+	mTarget->SetRenderTargets(rtvs, count, dsv);
+	mRecord.SetRenderTargets(rtvs, count, dsv);
+}
+
+void CaptureCommandList::ClearRenderTarget(uint32_t rtv, const float color[4])
+{
+	mTarget->ClearRenderTarget(rtv, color);
+	mRecord.ClearRenderTarget(rtv, color);
+}
+
+void CaptureCommandList::ClearDepthStencil(uint32_t dsv, float depth, uint8_t stencil)
+{
+	mTarget->ClearDepthStencil(dsv, depth, stencil);
+	mRecord.ClearDepthStencil(dsv, depth, stencil);
+}
+
+void CaptureCommandList::Barrier(RenderId resource, ResourceState before, ResourceState after)
+{
+	mTarget->Barrier(resource, before, after);
+	mRecord.Barrier(resource, before, after);
+}
+
+void CaptureCommandList::CopyResource(RenderId destination, RenderId source)
+{
+	mTarget->CopyResource(destination, source);
+	mRecord.CopyResource(destination, source);
+}
+
+void CaptureCommandList::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex)
+{
+	mTarget->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex);
+	mRecord.DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex);
+}
+
+void CaptureCommandList::DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex)
+{
+	mTarget->DrawInstanced(vertexCount, instanceCount, startVertex);
+	mRecord.DrawInstanced(vertexCount, instanceCount, startVertex);
+}
+
+void CaptureCommandList::Dispatch(uint32_t x, uint32_t y, uint32_t z)
+{
+	mTarget->Dispatch(x, y, z);
+	mRecord.Dispatch(x, y, z);
+}
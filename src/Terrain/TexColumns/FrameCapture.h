@@ -0,0 +1,123 @@
+#pragma once
+#include "RenderCommands.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Command-stream capture: one frame of what FrameRecorder records - binds,
+// barriers, draws, dispatches, their payload - plus the bytes of every
+// constant buffer element the frame binds, saved to a file. The app
+// captures at the Draw boundary (TexColumnsApp::Draw); Tools/CaptureReplay
+// loads captures anywhere, replays them on a NullCommandList, reports
+// where the binds and bytes go and diffs two captures.
+//
+// Not captured: UploadBrushRegion and ImGui, which record on the D3D12
+// list directly.
+//
+// A file is "TCAP", a version and the four array sizes, then the arrays,
+// little-endian. Commands keep their RenderCommand words.
+
+// One constant buffer element a CBV bind pointed at
+struct CapturedConstants
+{
+	RenderId Buffer = 0;
+	uint32_t Offset = 0;            // bind offset, bytes
+	uint32_t Size = 0;              // bytes captured
+	uint32_t Data = 0;              // offset in FrameCapture::ConstantData
+};
+
+struct FrameCapture
+{
+	uint32_t Frame = 0;
+	std::vector<RenderCommand> Commands;
+	std::vector<uint32_t> Payload;
+	std::vector<CapturedConstants> Constants; // in order of first bind
+	std::vector<uint8_t> ConstantData;
+
+	bool Save(const std::string& path, std::string& error) const;
+	bool Load(const std::string& path, std::string& error);
+
+	// Makes the recorded calls again, in order, on another list
+	void Replay(RenderCommandList& cmd) const;
+};
+
+// What a capture spends its commands and bytes on
+struct CaptureAnalysis
+{
+	static const int DrawSizeBuckets = 32;
+
+	RenderStats Totals;
+	// Bind counters only: binds that set what was already bound. Changing
+	// a root signature drops its root arguments and changing the heap drops
+	// the tables, as D3D12 does, so rebinding after those is not redundant.
+	RenderStats Redundant;
+	uint32_t Ops[(size_t)RenderOp::Count] = {};
+	// Draws by primitives (indices or vertices times instances): bucket i
+	// counts 2^i to 2^(i+1) - 1, bucket 0 also counts empty draws
+	uint32_t DrawSizes[DrawSizeBuckets] = {};
+	uint32_t ConstantBlocks = 0;
+	uint64_t UploadBytes = 0;       // constant bytes the frame reads from upload heaps
+};
+
+CaptureAnalysis AnalyzeCapture(const FrameCapture& capture);
+
+// Passes every call on to another list while recording it. Only the frames
+// being captured go through here; the app records on its D3D12 list
+// directly otherwise.
+class CaptureCommandList : public RenderCommandList
+{
+public:
+	void Begin(RenderCommandList& target, uint32_t frame);
+	// CBV binds of buffer copy blockSize bytes at the bind offset from data,
+	// which holds bytes bytes - the mapped upload buffer in the app. Binds
+	// of buffers without a source are recorded without their contents.
+	void SetConstantSource(RenderId buffer, const void* data, size_t bytes, uint32_t blockSize);
+	// Hands the recording over and stops forwarding
+	void End(FrameCapture& capture);
+	bool IsCapturing() const { return mTarget != nullptr; }
+
+	void SetPipelineState(RenderId pipeline) override;
+	void SetGraphicsRootSignature(RenderId rootSignature) override;
+	void SetComputeRootSignature(RenderId rootSignature) override;
+	void SetDescriptorHeap(RenderId heap) override;
+	void SetGraphicsRootDescriptorTable(uint32_t slot, uint32_t descriptor) override;
+	void SetComputeRootDescriptorTable(uint32_t slot, uint32_t descriptor) override;
+	void SetGraphicsRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset) override;
+	void SetComputeRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset) override;
+
+	void SetVertexBuffer(RenderId geometry) override;
+	void SetIndexBuffer(RenderId geometry) override;
+	void SetPrimitiveTopology(uint32_t topology) override;
+
+	void SetViewport(const RenderViewport& viewport) override;
+	void SetScissorRect(const RenderRect& rect) override;
+	void SetRenderTargets(const uint32_t* rtvs, uint32_t count, uint32_t dsv) override;
+	void ClearRenderTarget(uint32_t rtv, const float color[4]) override;
+	void ClearDepthStencil(uint32_t dsv, float depth, uint8_t stencil) override;
+
+	void Barrier(RenderId resource, ResourceState before, ResourceState after) override;
+	void CopyResource(RenderId destination, RenderId source) override;
+
+	void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex) override;
+	void DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex) override;
+	void Dispatch(uint32_t x, uint32_t y, uint32_t z) override;
+
+private:
+	struct ConstantSource
+	{
+		RenderId Buffer;
+		const uint8_t* Data;
+		size_t Bytes;
+		uint32_t BlockSize;
+	};
+
+	void CaptureConstants(RenderId buffer, uint32_t offset);
+
+	RenderCommandList* mTarget = nullptr;
+	uint32_t mFrame = 0;
+	NullCommandList mRecord;
+	std::vector<ConstantSource> mSources;
+	std::vector<CapturedConstants> mConstants;
+	std::vector<uint8_t> mConstantData;
+	std::unordered_set<uint64_t> mCaptured; // buffer << 32 | offset
+};
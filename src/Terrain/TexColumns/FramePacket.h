@@ -0,0 +1,31 @@
+#pragma once
+#include "FrameRecorder.h"
+#include "PaintLayer.h"
+#include <cstdint>
+#include <vector>
+
+// One frame as the simulation side hands it to the render thread
+// (FramePipeline): what Draw records, gathered by Update and never changed
+// after it is published. The camera matrices and the other per-frame
+// constants are already written into the constant buffers of the frame
+// resource named here; the render side binds those and records.
+struct FramePacket
+{
+	uint64_t Frame = 0;
+	uint32_t FrameResource = 0;     // index into the fence ring the constants went to
+
+	// The back buffer RTV is left to the render side, which presents
+	FrameBindings Bindings;
+	std::vector<DrawItem> Opaque;
+	std::vector<DrawItem> CustomMeshes;
+	std::vector<DrawItem> Tiles;
+
+	bool Painting = false;          // dispatch the brush this frame
+	bool Capture = false;           // record into a FrameCapture as well
+
+	// Texels of the paint layer to copy into the brush texture: the rect's
+	// rows, BrushUploadPitch bytes apart. Empty when nothing changed.
+	PaintRect BrushUpload;
+	uint32_t BrushUploadPitch = 0;
+	std::vector<uint8_t> BrushUploadPixels;
+};
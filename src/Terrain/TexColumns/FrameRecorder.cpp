@@ -0,0 +1,198 @@
+#include "FrameRecorder.h"
+
+namespace
+{
+	const uint32_t TriangleList = 4; // D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST
+
+	void BindGeometry(RenderCommandList& cmd, const DrawItem& item)
+	{
+		cmd.SetVertexBuffer(item.Geometry);
+		cmd.SetIndexBuffer(item.Geometry);
+		cmd.SetPrimitiveTopology(item.Topology);
+	}
+
+	void DrawIndexed(RenderCommandList& cmd, const DrawItem& item)
+	{
+		cmd.DrawIndexedInstanced(item.IndexCount, 1, item.StartIndex, item.BaseVertex);
+	}
+}
+
+void FrameRecorder::BeginScene(RenderCommandList& cmd, const FrameBindings& b)
+{
+	cmd.SetPipelineState(b.OpaquePipeline);
+	cmd.SetViewport(b.Viewport);
+	cmd.SetScissorRect(b.Scissor);
+
+	cmd.Barrier(b.ColorBuffer, ResourceState::Common, ResourceState::RenderTarget);
+	cmd.Barrier(b.VelocityBuffer, ResourceState::Common, ResourceState::RenderTarget);
+
+	const uint32_t rtvs[2] = { b.ColorRtv, b.VelocityRtv };
+	cmd.SetRenderTargets(rtvs, 2, b.Dsv);
+	cmd.ClearRenderTarget(b.ColorRtv, b.SceneClearColor);
+	const float clearVel[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	cmd.ClearRenderTarget(b.VelocityRtv, clearVel);
+	cmd.ClearDepthStencil(b.Dsv, 1.0f, 0);
+
+	cmd.SetDescriptorHeap(b.SrvHeap);
+}
+
+void FrameRecorder::RecordScene(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& opaque,
+	const std::vector<DrawItem>& customMeshes, const std::vector<DrawItem>& tiles)
+{
+	// Opaque items
+	cmd.SetGraphicsRootSignature(b.OpaqueRootSignature);
+	cmd.SetGraphicsRootConstantBufferView(4, b.PassCB, 0);
+	RecordOpaqueItems(cmd, b, opaque);
+
+	// Custom meshes (MeshStandard.hlsl writes real velocity)
+	cmd.SetGraphicsRootSignature(b.StandardMeshRootSignature);
+	cmd.SetGraphicsRootConstantBufferView(3, b.PassCB, 0);
+	cmd.SetPipelineState(b.StandardMeshPipeline);
+	if (!customMeshes.empty())
+		RecordCustomMeshes(cmd, b, customMeshes);
+
+	// Terrain
+	if (!tiles.empty())
+	{
+		cmd.SetPipelineState(b.TerrainPipeline);
+		cmd.SetGraphicsRootSignature(b.TerrainRootSignature);
+		cmd.SetGraphicsRootConstantBufferView(5, b.PassCB, 0);
+		RecordTerrainTiles(cmd, b, tiles);
+	}
+
+	if (b.FirstFrame)
+		SeedHistory(cmd, b);
+}
+
+// After this, Prev and Current are back in COMMON and the colour buffer is a render target again
+void FrameRecorder::SeedHistory(RenderCommandList& cmd, const FrameBindings& b)
+{
+	cmd.Barrier(b.ColorBuffer, ResourceState::RenderTarget, ResourceState::CopySource);
+	cmd.Barrier(b.PrevHistory, ResourceState::Common, ResourceState::CopyDest);
+	cmd.Barrier(b.CurrentHistory, ResourceState::Common, ResourceState::CopyDest);
+
+	cmd.CopyResource(b.PrevHistory, b.ColorBuffer);
+	cmd.CopyResource(b.CurrentHistory, b.ColorBuffer);
+
+	cmd.Barrier(b.PrevHistory, ResourceState::CopyDest, ResourceState::Common);
+	cmd.Barrier(b.CurrentHistory, ResourceState::CopyDest, ResourceState::Common);
+	cmd.Barrier(b.ColorBuffer, ResourceState::CopySource, ResourceState::RenderTarget);
+}
+
+void FrameRecorder::RecordTaa(RenderCommandList& cmd, const FrameBindings& b)
+{
+	cmd.Barrier(b.ColorBuffer, ResourceState::RenderTarget, ResourceState::PixelShaderResource);
+	cmd.Barrier(b.VelocityBuffer, ResourceState::RenderTarget, ResourceState::PixelShaderResource);
+	cmd.Barrier(b.BackBuffer, ResourceState::Present, ResourceState::RenderTarget);
+
+	cmd.SetPipelineState(b.TaaPipeline);
+	cmd.SetGraphicsRootSignature(b.TaaRootSignature);
+
+	// Ping-pong; both history buffers start the frame in COMMON
+	const bool even = b.FrameIndex % 2 == 0;
+	const RenderId read = even ? b.PrevHistory : b.CurrentHistory;
+	const RenderId write = even ? b.CurrentHistory : b.PrevHistory;
+	const uint32_t historySrv = even ? b.PrevHistorySrv : b.CurrentHistorySrv;
+	const uint32_t historyRtv = even ? b.CurrentHistoryRtv : b.PrevHistoryRtv;
+	cmd.Barrier(read, ResourceState::Common, ResourceState::PixelShaderResource);
+	cmd.Barrier(write, ResourceState::Common, ResourceState::RenderTarget);
+
+	cmd.SetGraphicsRootDescriptorTable(0, b.ColorSrv);
+	cmd.SetGraphicsRootDescriptorTable(1, historySrv);
+	cmd.SetGraphicsRootDescriptorTable(2, b.VelocitySrv);
+	cmd.SetGraphicsRootConstantBufferView(3, b.TaaCB, 0);
+
+	// Back buffer (Target0) + history write (Target1)
+	const uint32_t rtvs[2] = { b.BackBufferRtv, historyRtv };
+	cmd.SetRenderTargets(rtvs, 2, RenderCommandList::NoDepth);
+	cmd.ClearRenderTarget(b.BackBufferRtv, b.BackBufferClearColor);
+
+	// Fullscreen triangle - no vertex buffer, TAA VS uses SV_VertexID
+	cmd.SetPrimitiveTopology(TriangleList);
+	cmd.DrawInstanced(3, 1, 0);
+}
+
+void FrameRecorder::RecordBrush(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& tiles)
+{
+	cmd.SetPipelineState(b.BrushPipeline);
+	cmd.SetComputeRootSignature(b.BrushRootSignature);
+
+	cmd.Barrier(b.BrushTexture, ResourceState::PixelShaderResource, ResourceState::UnorderedAccess);
+
+	cmd.SetComputeRootConstantBufferView(0, b.BrushCB, 0);
+	if (!tiles.empty())
+		cmd.SetComputeRootConstantBufferView(1, b.TerrainCB, tiles[0].TileIndex * b.TerrainCBStride);
+	cmd.SetComputeRootDescriptorTable(2, b.TerrainDisplacementSrv);
+	cmd.SetComputeRootDescriptorTable(3, b.BrushUav);
+
+	cmd.Dispatch(b.BrushGroupsX, b.BrushGroupsY, 1);
+
+	cmd.Barrier(b.BrushTexture, ResourceState::UnorderedAccess, ResourceState::PixelShaderResource);
+}
+
+void FrameRecorder::EndFrame(RenderCommandList& cmd, const FrameBindings& b)
+{
+	cmd.Barrier(b.ColorBuffer, ResourceState::PixelShaderResource, ResourceState::Common);
+	cmd.Barrier(b.VelocityBuffer, ResourceState::PixelShaderResource, ResourceState::Common);
+
+	// Same parity as RecordTaa: the history read was an SRV, the one written an RTV
+	const bool even = b.FrameIndex % 2 == 0;
+	cmd.Barrier(even ? b.PrevHistory : b.CurrentHistory, ResourceState::PixelShaderResource, ResourceState::Common);
+	cmd.Barrier(even ? b.CurrentHistory : b.PrevHistory, ResourceState::RenderTarget, ResourceState::Common);
+
+	cmd.Barrier(b.BackBuffer, ResourceState::RenderTarget, ResourceState::Present);
+}
+
+void FrameRecorder::RecordOpaqueItems(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& items)
+{
+	for (const DrawItem& item : items)
+	{
+		BindGeometry(cmd, item);
+
+		cmd.SetGraphicsRootDescriptorTable(0, item.DiffuseSrv);      // t0 - diffuse
+		cmd.SetGraphicsRootDescriptorTable(1, item.NormalSrv);       // t1 - normal
+		cmd.SetGraphicsRootDescriptorTable(2, item.DisplacementSrv); // t2 - displacement
+
+		cmd.SetGraphicsRootConstantBufferView(3, b.ObjectCB, item.ObjCBIndex * b.ObjectCBStride);   // b0 - per object
+		cmd.SetGraphicsRootConstantBufferView(5, b.MaterialCB, item.MatCBIndex * b.MaterialCBStride); // b1 - per material
+
+		DrawIndexed(cmd, item);
+	}
+}
+
+void FrameRecorder::RecordCustomMeshes(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& items)
+{
+	for (const DrawItem& item : items)
+	{
+		BindGeometry(cmd, item);
+
+		cmd.SetGraphicsRootDescriptorTable(0, item.DiffuseSrv);      // t0 - diffuse
+		cmd.SetGraphicsRootDescriptorTable(1, item.NormalSrv);       // t1 - normal
+
+		cmd.SetGraphicsRootConstantBufferView(2, b.ObjectCB, item.ObjCBIndex * b.ObjectCBStride);   // b0 - per object
+		cmd.SetGraphicsRootConstantBufferView(4, b.MaterialCB, item.MatCBIndex * b.MaterialCBStride); // b1 - per material
+
+		DrawIndexed(cmd, item);
+	}
+}
+
+void FrameRecorder::RecordTerrainTiles(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& tiles)
+{
+	for (const DrawItem& tile : tiles)
+	{
+		BindGeometry(cmd, tile);
+
+		cmd.SetGraphicsRootDescriptorTable(0, b.TerrainDiffuseSrv);
+		cmd.SetGraphicsRootDescriptorTable(1, b.TerrainNormalSrv);
+		cmd.SetGraphicsRootDescriptorTable(2, b.TerrainDisplacementSrv);
+		cmd.SetGraphicsRootDescriptorTable(3, b.BrushSrv);
+
+		// b0 cbPerObject; b1 cbPass (root 5) is bound once in RecordScene
+		cmd.SetGraphicsRootConstantBufferView(4, b.ObjectCB, tile.ObjCBIndex * b.ObjectCBStride);
+		cmd.SetGraphicsRootConstantBufferView(6, b.MaterialCB, tile.MatCBIndex * b.MaterialCBStride); // b2 - cbMaterial
+		cmd.SetGraphicsRootConstantBufferView(7, b.TerrainCB, tile.TileIndex * b.TerrainCBStride);   // b3 - cbTerrainTile
+		cmd.SetGraphicsRootConstantBufferView(8, b.BrushCB, 0);                                      // b4 - cbBrush
+
+		DrawIndexed(cmd, tile);
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "RenderCommands.h"
+#include <vector>
+
+// TexColumnsApp::Draw as a sequence of RenderCommandList calls. The app
+// fills FrameBindings and the DrawItem lists from its device objects and
+// render items and records into its D3D12 command list; the headless
+// tools (Tools/NullDraw.cpp) fill them with made-up ids and record into a
+// NullCommandList. Both get the same binds, draws and barriers.
+
+// What one item's draw reads: the geometry, the per-object and
+// per-material constants and the material's textures.
+struct DrawItem
+{
+	RenderId Geometry = 0;
+	uint32_t Topology = 0;          // D3D_PRIMITIVE_TOPOLOGY
+	uint32_t IndexCount = 0;
+	uint32_t StartIndex = 0;
+	int32_t BaseVertex = 0;
+	uint32_t ObjCBIndex = 0;
+	uint32_t MatCBIndex = 0;
+	uint32_t DiffuseSrv = 0;
+	uint32_t NormalSrv = 0;
+	uint32_t DisplacementSrv = 0;
+	uint32_t TileIndex = 0;         // terrain tiles: element of the tile constants
+};
+
+// Everything Draw binds besides the items, for the current frame
+struct FrameBindings
+{
+	// Solid or wireframe already picked
+	RenderId OpaquePipeline = 0;
+	RenderId StandardMeshPipeline = 0;
+	RenderId TerrainPipeline = 0;
+	RenderId TaaPipeline = 0;
+	RenderId BrushPipeline = 0;
+
+	RenderId OpaqueRootSignature = 0;
+	RenderId StandardMeshRootSignature = 0;
+	RenderId TerrainRootSignature = 0;
+	RenderId TaaRootSignature = 0;
+	RenderId BrushRootSignature = 0;
+
+	// Constant buffers of the current frame resource; strides are the
+	// 256-byte aligned element sizes
+	RenderId ObjectCB = 0;
+	RenderId MaterialCB = 0;
+	RenderId PassCB = 0;
+	RenderId TerrainCB = 0;
+	RenderId BrushCB = 0;
+	RenderId TaaCB = 0;
+	uint32_t ObjectCBStride = 0;
+	uint32_t MaterialCBStride = 0;
+	uint32_t TerrainCBStride = 0;
+
+	RenderId SrvHeap = 0;
+	RenderId ColorBuffer = 0;
+	RenderId VelocityBuffer = 0;
+	RenderId PrevHistory = 0;
+	RenderId CurrentHistory = 0;
+	RenderId BackBuffer = 0;
+	RenderId BrushTexture = 0;
+
+	uint32_t ColorRtv = 0;
+	uint32_t VelocityRtv = 0;
+	uint32_t PrevHistoryRtv = 0;
+	uint32_t CurrentHistoryRtv = 0;
+	uint32_t BackBufferRtv = 0;
+	uint32_t Dsv = 0;
+
+	uint32_t ColorSrv = 0;
+	uint32_t VelocitySrv = 0;
+	uint32_t PrevHistorySrv = 0;
+	uint32_t CurrentHistorySrv = 0;
+	uint32_t TerrainDiffuseSrv = 0;
+	uint32_t TerrainNormalSrv = 0;
+	uint32_t TerrainDisplacementSrv = 0;
+	uint32_t BrushSrv = 0;
+	uint32_t BrushUav = 0;
+
+	RenderViewport Viewport;
+	RenderRect Scissor;
+	float SceneClearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	float BackBufferClearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	bool FirstFrame = false;        // seed both history buffers from this frame
+	uint32_t FrameIndex = 0;        // even: read Prev, write Current; odd: the other way
+	uint32_t BrushGroupsX = 0;
+	uint32_t BrushGroupsY = 0;
+};
+
+class FrameRecorder
+{
+public:
+	// Scene pass: colour and velocity targets bound and cleared, the SRV heap set
+	static void BeginScene(RenderCommandList& cmd, const FrameBindings& b);
+	// Opaque items, custom meshes and terrain tiles, each under its own root
+	// signature; on the first frame also seeds the TAA history
+	static void RecordScene(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& opaque,
+		const std::vector<DrawItem>& customMeshes, const std::vector<DrawItem>& tiles);
+	// TAA resolve into the back buffer and the history buffer being written
+	static void RecordTaa(RenderCommandList& cmd, const FrameBindings& b);
+	// Brush.hlsl over the brush texture; the tile constants are the first visible tile's
+	static void RecordBrush(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& tiles);
+	// Everything back to COMMON, the back buffer to PRESENT
+	static void EndFrame(RenderCommandList& cmd, const FrameBindings& b);
+
+	// Per-item loops of the scene pass
+	static void RecordOpaqueItems(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& items);
+	static void RecordCustomMeshes(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& items);
+	static void RecordTerrainTiles(RenderCommandList& cmd, const FrameBindings& b, const std::vector<DrawItem>& tiles);
+
+private:
+	static void SeedHistory(RenderCommandList& cmd, const FrameBindings& b);
+};
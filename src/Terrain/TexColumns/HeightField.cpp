@@ -0,0 +1,155 @@
+#include "HeightField.h"
+
+#include <algorithm>
+#include <cmath>
+
+void HeightField::Init(const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch, int channel)
+{
+	mWidth = width;
+	mHeight = height;
+	mSamples.resize((size_t)width * height);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const uint8_t* row = rgba + y * rowPitch;
+		for (uint32_t x = 0; x < width; ++x)
+			mSamples[(size_t)y * width + x] = row[x * 4 + channel] * (1.0f / 255.0f);
+	}
+}
+
+void HeightField::Init(const float* samples, uint32_t width, uint32_t height)
+{
+	mWidth = width;
+	mHeight = height;
+	mSamples.assign(samples, samples + (size_t)width * height);
+}
+
+void HeightField::SetPlacement(float originX, float originZ, float size, float baseY, float heightScale)
+{
+	mOriginX = originX;
+	mOriginZ = originZ;
+	mSize = size;
+	mBaseY = baseY;
+	mHeightScale = heightScale;
+}
+
+float HeightField::Texel(int x, int y) const
+{
+	x = std::min(std::max(x, 0), (int)mWidth - 1);
+	y = std::min(std::max(y, 0), (int)mHeight - 1);
+	return mSamples[(size_t)y * mWidth + x];
+}
+
+float HeightField::Sample(float x, float z) const
+{
+	if (mSamples.empty())
+		return mBaseY;
+
+	// Texel centres sit at (i + 0.5) / width
+	const float s = (x - mOriginX) / mSize * mWidth - 0.5f;
+	const float t = (z - mOriginZ) / mSize * mHeight - 0.5f;
+	const float fs = std::floor(s), ft = std::floor(t);
+	const int i = (int)fs, j = (int)ft;
+	const float a = s - fs, b = t - ft;
+
+	const float top = Texel(i, j) + (Texel(i + 1, j) - Texel(i, j)) * a;
+	const float bottom = Texel(i, j + 1) + (Texel(i + 1, j + 1) - Texel(i, j + 1)) * a;
+	return mBaseY + (top + (bottom - top) * b) * mHeightScale;
+}
+
+void HeightField::TexelSpan(float a, float b, uint32_t count, int& first, int& last) const
+{
+	first = (int)std::floor(a / mSize * count - 0.5f);
+	last = (int)std::floor(b / mSize * count - 0.5f) + 1;
+	first = std::min(std::max(first, 0), (int)count - 1);
+	last = std::min(std::max(last, 0), (int)count - 1);
+}
+
+void HeightField::GetRange(float x0, float z0, float x1, float z1, float& minY, float& maxY) const
+{
+	if (mSamples.empty())
+	{
+		minY = maxY = mBaseY;
+		return;
+	}
+
+	// A filtered sample is a blend of its four texels, so the texels under
+	// the footprint bound the surface.
+	int i0, i1, j0, j1;
+	TexelSpan(x0 - mOriginX, x1 - mOriginX, mWidth, i0, i1);
+	TexelSpan(z0 - mOriginZ, z1 - mOriginZ, mHeight, j0, j1);
+
+	float lo = mSamples[(size_t)j0 * mWidth + i0];
+	float hi = lo;
+	for (int j = j0; j <= j1; ++j)
+	{
+		const float* row = &mSamples[(size_t)j * mWidth];
+		for (int i = i0; i <= i1; ++i)
+		{
+			lo = std::min(lo, row[i]);
+			hi = std::max(hi, row[i]);
+		}
+	}
+	minY = mBaseY + lo * mHeightScale;
+	maxY = mBaseY + hi * mHeightScale;
+}
+
+void HeightField::BuildOccluder(float x0, float z0, float size, int resolution, float margin, std::vector<float>& positions) const
+{
+	const int cells = resolution - 1;
+	const float step = size / cells;
+
+	std::vector<float> cellMin((size_t)cells * cells);
+	for (int j = 0; j < cells; ++j)
+	{
+		for (int i = 0; i < cells; ++i)
+		{
+			float lo, hi;
+			GetRange(x0 + i * step - margin, z0 + j * step - margin,
+				x0 + (i + 1) * step + margin, z0 + (j + 1) * step + margin, lo, hi);
+			cellMin[(size_t)j * cells + i] = lo;
+		}
+	}
+
+	// A vertex below every cell it touches keeps each cell's triangles below
+	// that cell's lowest point. Only cells inside the square count; there are
+	// no triangles outside it to cover.
+	positions.resize((size_t)resolution * resolution * 3);
+	for (int j = 0; j < resolution; ++j)
+	{
+		for (int i = 0; i < resolution; ++i)
+		{
+			float y = 0.0f;
+			bool first = true;
+			for (int cj = std::max(j - 1, 0); cj <= std::min(j, cells - 1); ++cj)
+			{
+				for (int ci = std::max(i - 1, 0); ci <= std::min(i, cells - 1); ++ci)
+				{
+					const float h = cellMin[(size_t)cj * cells + ci];
+					y = first ? h : std::min(y, h);
+					first = false;
+				}
+			}
+
+			float* p = &positions[((size_t)j * resolution + i) * 3];
+			p[0] = x0 + i * step;
+			p[1] = y;
+			p[2] = z0 + j * step;
+		}
+	}
+}
+
+void HeightField::BuildGridIndices(int resolution, std::vector<uint32_t>& indices)
+{
+	indices.clear();
+	for (int j = 0; j + 1 < resolution; ++j)
+	{
+		for (int i = 0; i + 1 < resolution; ++i)
+		{
+			const uint32_t a = j * resolution + i;
+			const uint32_t b = a + 1;
+			const uint32_t c = a + resolution;
+			const uint32_t d = c + 1;
+			indices.insert(indices.end(), { a, c, b, b, c, d });
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// CPU copy of the terrain displacement map, laid out the way Terrain.hlsl
+// samples it: u = (x - OriginX) / Size, v = (z - OriginZ) / Size, linear
+// filtering with clamping, world height = BaseY + sample * HeightScale.
+//
+// Culling uses it for real per-node height ranges and for coarse occluder
+// meshes that never poke out of the rendered surface.
+
+class HeightField
+{
+public:
+	HeightField() = default;
+
+	// One channel of an RGBA8 image (what BCEncoder::LoadDDS gives), mapped to 0..1.
+	void Init(const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch, int channel = 0);
+	void Init(const float* samples, uint32_t width, uint32_t height);
+
+	void SetPlacement(float originX, float originZ, float size, float baseY, float heightScale);
+
+	bool IsEmpty() const { return mSamples.empty(); }
+	uint32_t GetWidth() const { return mWidth; }
+	uint32_t GetHeight() const { return mHeight; }
+	float GetSize() const { return mSize; }
+
+	// World height at (x, z), bilinear like the shader.
+	float Sample(float x, float z) const;
+	// World height range over the square [x0, x1] x [z0, z1], conservative
+	// for the filtered surface.
+	void GetRange(float x0, float z0, float x1, float z1, float& minY, float& maxY) const;
+
+	// A resolution x resolution vertex grid over the square at (x0, z0) whose
+	// surface lies on or under the terrain inside the square: each vertex
+	// takes the minimum of the cells around it. Cells are grown by margin
+	// when taking their minimum, which covers a mesh that samples the map
+	// every margin units and interpolates in between. xyz per vertex.
+	void BuildOccluder(float x0, float z0, float size, int resolution, float margin, std::vector<float>& positions) const;
+	// Two triangles per cell of such a grid.
+	static void BuildGridIndices(int resolution, std::vector<uint32_t>& indices);
+
+private:
+	float Texel(int x, int y) const;
+	// Texel range whose filtered footprint covers [a, b] along one axis
+	void TexelSpan(float a, float b, uint32_t count, int& first, int& last) const;
+
+private:
+	std::vector<float> mSamples;
+	uint32_t mWidth = 0;
+	uint32_t mHeight = 0;
+	float mOriginX = 0.0f;
+	float mOriginZ = 0.0f;
+	float mSize = 1.0f;
+	float mBaseY = 0.0f;
+	float mHeightScale = 1.0f;
+};
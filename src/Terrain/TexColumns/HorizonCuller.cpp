@@ -0,0 +1,104 @@
+#include "HorizonCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const float TwoPi = 6.28318530718f;
+	const float Pi = 3.14159265359f;
+}
+
+HorizonCuller::HorizonCuller(uint32_t bucketCount)
+	: mHorizon(std::max(bucketCount, 4u), -INFINITY)
+{
+	mBucketsPerRadian = mHorizon.size() / TwoPi;
+}
+
+void HorizonCuller::Begin(float eyeX, float eyeY, float eyeZ)
+{
+	mEye[0] = eyeX;
+	mEye[1] = eyeY;
+	mEye[2] = eyeZ;
+	std::fill(mHorizon.begin(), mHorizon.end(), -INFINITY);
+}
+
+bool HorizonCuller::Measure(float x0, float z0, float x1, float z1, Footprint& fp) const
+{
+	const float ex = mEye[0], ez = mEye[2];
+	const float dx = std::max(std::max(x0 - ex, ex - x1), 0.0f);
+	const float dz = std::max(std::max(z0 - ez, ez - z1), 0.0f);
+	fp.Near = std::sqrt(dx * dx + dz * dz);
+	if (fp.Near <= 0.0f)
+		return false;
+
+	// Corners relative to the direction of the centre: a rectangle that does
+	// not contain the eye spans less than pi, so there is no wrap to handle.
+	const float center = std::atan2(0.5f * (z0 + z1) - ez, 0.5f * (x0 + x1) - ex);
+	const float xs[2] = { x0, x1 }, zs[2] = { z0, z1 };
+	float lo = 0.0f, hi = 0.0f, far2 = 0.0f;
+	for (int i = 0; i < 4; ++i)
+	{
+		const float cx = xs[i & 1] - ex, cz = zs[i >> 1] - ez;
+		float delta = std::atan2(cz, cx) - center;
+		if (delta > Pi) delta -= TwoPi;
+		if (delta < -Pi) delta += TwoPi;
+		lo = std::min(lo, delta);
+		hi = std::max(hi, delta);
+		far2 = std::max(far2, cx * cx + cz * cz);
+	}
+
+	fp.AngleMin = center + lo;
+	while (fp.AngleMin < 0.0f)
+		fp.AngleMin += TwoPi;
+	while (fp.AngleMin >= TwoPi)
+		fp.AngleMin -= TwoPi;
+	fp.AngleMax = fp.AngleMin + (hi - lo);
+	fp.Far = std::sqrt(far2);
+	return true;
+}
+
+bool HorizonCuller::IsHidden(float x0, float z0, float x1, float z1, float maxY) const
+{
+	Footprint fp;
+	if (!Measure(x0, z0, x1, z1, fp))
+		return false;
+
+	// Steepest ray to any point of the column
+	const float rise = maxY - mEye[1];
+	const float elevation = rise > 0.0f ? rise / fp.Near : rise / fp.Far;
+
+	// Every bucket the footprint touches must be blocked above that
+	const int count = (int)mHorizon.size();
+	const int first = (int)std::floor(fp.AngleMin * mBucketsPerRadian);
+	const int last = (int)std::floor(fp.AngleMax * mBucketsPerRadian);
+	for (int b = first; b <= last; ++b)
+	{
+		if (!(mHorizon[b % count] > elevation))
+			return false;
+	}
+	return true;
+}
+
+void HorizonCuller::AddOccluder(float x0, float z0, float x1, float z1, float minY)
+{
+	Footprint fp;
+	if (!Measure(x0, z0, x1, z1, fp))
+		return;
+
+	// A ray through the footprint meets ground at minY somewhere between
+	// Near and Far; it is blocked for sure below the flattest of those
+	// elevations.
+	const float rise = minY - mEye[1];
+	const float elevation = rise >= 0.0f ? rise / fp.Far : rise / fp.Near;
+
+	// Only buckets the footprint covers completely: every ray in them crosses it
+	const int count = (int)mHorizon.size();
+	const int first = (int)std::ceil(fp.AngleMin * mBucketsPerRadian);
+	const int last = (int)std::floor(fp.AngleMax * mBucketsPerRadian) - 1;
+	for (int b = first; b <= last; ++b)
+	{
+		float& horizon = mHorizon[b % count];
+		horizon = std::max(horizon, elevation);
+	}
+}
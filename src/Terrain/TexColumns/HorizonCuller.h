@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Horizon culling for a heightfield. Around the camera the xz plane is split
+// into angular buckets, each remembering the steepest elevation (as a
+// tangent) under which terrain already drawn blocks every ray of the bucket.
+// Terrain columns are fed front to back: a column whose top stays under the
+// horizon of every bucket it spans is hidden, a column that is drawn raises
+// the horizon by its guaranteed ground height.
+//
+// Front to back means no later column is in front of an earlier one along
+// any ray, which is what visiting quadtree children nearest-first gives.
+
+class HorizonCuller
+{
+public:
+	explicit HorizonCuller(uint32_t bucketCount = 512);
+
+	void Begin(float eyeX, float eyeY, float eyeZ);
+
+	// Column over [x0, x1] x [z0, z1] reaching up to maxY.
+	bool IsHidden(float x0, float z0, float x1, float z1, float maxY) const;
+	// Column whose ground is at least minY everywhere over the footprint.
+	void AddOccluder(float x0, float z0, float x1, float z1, float minY);
+
+	uint32_t GetBucketCount() const { return (uint32_t)mHorizon.size(); }
+
+private:
+	struct Footprint
+	{
+		float AngleMin, AngleMax;    // radians, AngleMin in [0, 2pi), AngleMax may pass 2pi
+		float Near, Far;             // xz distances from the eye
+	};
+	// False when the eye is over the footprint
+	bool Measure(float x0, float z0, float x1, float z1, Footprint& fp) const;
+
+private:
+	std::vector<float> mHorizon;
+	float mEye[3] = {};
+	float mBucketsPerRadian = 0.0f;
+};
@@ -0,0 +1,494 @@
+#include "InputJournal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+	const char Magic[4] = { 'T', 'J', 'N', 'L' };
+	const uint32_t Version = 1;
+
+	uint32_t FloatBits(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	float BitsFloat(uint32_t bits)
+	{
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	uint32_t ZigZag(int32_t value)
+	{
+		return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+	}
+
+	int32_t UnZigZag(uint32_t value)
+	{
+		return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+	}
+
+	bool IsMouse(JournalEventType type)
+	{
+		return type == JournalEventType::MouseDown || type == JournalEventType::MouseUp || type == JournalEventType::MouseMove;
+	}
+}
+
+void InputJournal::WatchSetting(const char* name, float* value)
+{
+	Watch(name, value, SettingKind::Float);
+}
+
+void InputJournal::WatchSetting(const char* name, int* value)
+{
+	Watch(name, value, SettingKind::Int);
+}
+
+void InputJournal::WatchSetting(const char* name, bool* value)
+{
+	Watch(name, value, SettingKind::Bool);
+}
+
+void InputJournal::Watch(const char* name, void* value, SettingKind kind)
+{
+	for (auto& setting : mSettings)
+	{
+		if (setting.Name == name)
+		{
+			setting.Value = value;
+			setting.Kind = kind;
+			return;
+		}
+	}
+	mSettings.push_back({ name, value, kind, 0 });
+}
+
+uint32_t InputJournal::ReadValue(const Setting& setting)
+{
+	switch (setting.Kind)
+	{
+	case SettingKind::Float: return FloatBits(*(const float*)setting.Value);
+	case SettingKind::Int: return (uint32_t)*(const int*)setting.Value;
+	default: return *(const bool*)setting.Value ? 1u : 0u;
+	}
+}
+
+void InputJournal::WriteValue(const Setting& setting, uint32_t bits)
+{
+	switch (setting.Kind)
+	{
+	case SettingKind::Float: *(float*)setting.Value = BitsFloat(bits); break;
+	case SettingKind::Int: *(int*)setting.Value = (int)bits; break;
+	default: *(bool*)setting.Value = bits != 0; break;
+	}
+}
+
+bool InputJournal::StartRecording(const std::string& path, const JournalHeader& header)
+{
+	Stop();
+	mError.clear();
+	mOut.open(path, std::ios::binary | std::ios::trunc);
+	if (!mOut)
+		return Fail("Cannot write " + path);
+
+	mHeader = header;
+	mKeys.reset();
+	mMouse.clear();
+	mMouseX = header.MouseX;
+	mMouseY = header.MouseY;
+	mFrame = 0;
+	mBytes = 0;
+
+	mPending.insert(mPending.end(), std::begin(Magic), std::end(Magic));
+	PutU32(Version);
+	PutU32(header.ClientWidth);
+	PutU32(header.ClientHeight);
+	for (float v : header.Position) PutU32(FloatBits(v));
+	for (float v : header.Look) PutU32(FloatBits(v));
+	for (float v : header.Up) PutU32(FloatBits(v));
+	PutU32(FloatBits(header.FovY));
+	PutU32((uint32_t)header.MouseX);
+	PutU32((uint32_t)header.MouseY);
+	PutU32((uint32_t)mSettings.size());
+	for (const auto& setting : mSettings)
+	{
+		const size_t length = (std::min)(setting.Name.size(), (size_t)255);
+		Put((uint8_t)length);
+		mPending.insert(mPending.end(), setting.Name.begin(), setting.Name.begin() + length);
+	}
+
+	// Starting values
+	for (uint32_t i = 0; i < mSettings.size(); ++i)
+	{
+		JournalEvent e;
+		e.Type = JournalEventType::Setting;
+		e.Setting = i;
+		e.Value = mSettings[i].Recorded = ReadValue(mSettings[i]);
+		PutEvent(e);
+	}
+
+	mMode = Mode::Recording;
+	Flush();
+	return mMode == Mode::Recording;
+}
+
+void InputJournal::BeginFrame(float dt, const JournalKeys& keys)
+{
+	if (mMode != Mode::Recording)
+		return;
+
+	JournalEvent e;
+	e.Type = JournalEventType::Frame;
+	e.Dt = dt;
+	PutEvent(e);
+
+	const JournalKeys changed = keys ^ mKeys;
+	if (changed.any())
+	{
+		for (uint32_t key = 0; key < changed.size(); ++key)
+		{
+			if (!changed[key])
+				continue;
+			JournalEvent k;
+			k.Type = keys[key] ? JournalEventType::KeyDown : JournalEventType::KeyUp;
+			k.Key = (uint8_t)key;
+			PutEvent(k);
+		}
+		mKeys = keys;
+	}
+
+	for (const auto& m : mMouse)
+		PutEvent(m);
+	mMouse.clear();
+	++mFrame;
+}
+
+void InputJournal::RecordMouse(JournalEventType type, uint8_t buttons, bool captured, int32_t x, int32_t y)
+{
+	if (mMode != Mode::Recording || !IsMouse(type))
+		return;
+
+	JournalEvent e;
+	e.Type = type;
+	e.Buttons = buttons;
+	e.Captured = captured;
+	e.X = x;
+	e.Y = y;
+	mMouse.push_back(e);
+}
+
+void InputJournal::EndFrame()
+{
+	if (mMode != Mode::Recording)
+		return;
+
+	for (uint32_t i = 0; i < mSettings.size(); ++i)
+	{
+		const uint32_t value = ReadValue(mSettings[i]);
+		if (value == mSettings[i].Recorded)
+			continue;
+		JournalEvent e;
+		e.Type = JournalEventType::Setting;
+		e.Setting = i;
+		e.Value = mSettings[i].Recorded = value;
+		PutEvent(e);
+	}
+	Flush();
+}
+
+bool InputJournal::StartReplay(const std::string& path)
+{
+	Stop();
+	mError.clear();
+
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+		return Fail("Cannot read " + path);
+	mData.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	mCursor = 0;
+
+	char magic[4];
+	for (char& c : magic)
+	{
+		uint8_t byte;
+		if (!Get(byte))
+			return Fail(path + " is not a journal");
+		c = (char)byte;
+	}
+	uint32_t version = 0;
+	if (memcmp(magic, Magic, sizeof(Magic)) != 0 || !GetU32(version))
+		return Fail(path + " is not a journal");
+	if (version != Version)
+		return Fail(path + ": unsupported journal version " + std::to_string(version));
+
+	JournalHeader header;
+	uint32_t bits[15];
+	for (uint32_t& b : bits)
+		if (!GetU32(b))
+			return Fail(path + ": truncated header");
+	header.ClientWidth = bits[0];
+	header.ClientHeight = bits[1];
+	for (int i = 0; i < 3; ++i)
+	{
+		header.Position[i] = BitsFloat(bits[2 + i]);
+		header.Look[i] = BitsFloat(bits[5 + i]);
+		header.Up[i] = BitsFloat(bits[8 + i]);
+	}
+	header.FovY = BitsFloat(bits[11]);
+	header.MouseX = (int32_t)bits[12];
+	header.MouseY = (int32_t)bits[13];
+	mHeader = header;
+
+	mSettingMap.clear();
+	for (uint32_t i = 0; i < bits[14]; ++i)
+	{
+		uint8_t length;
+		if (!Get(length) || mCursor + length > mData.size())
+			return Fail(path + ": truncated header");
+		const std::string name((const char*)mData.data() + mCursor, length);
+		mCursor += length;
+
+		int index = -1;
+		for (size_t s = 0; s < mSettings.size(); ++s)
+			if (mSettings[s].Name == name)
+				index = (int)s;
+		mSettingMap.push_back(index);
+	}
+
+	// Count the frames. A journal cut short (the app closed while
+	// recording) has no End event and replays up to the last whole event.
+	const size_t start = mCursor;
+	mMouseX = header.MouseX;
+	mMouseY = header.MouseY;
+	mFrameCount = 0;
+	JournalEvent e;
+	while (GetEvent(e) && e.Type != JournalEventType::End)
+		if (e.Type == JournalEventType::Frame)
+			++mFrameCount;
+	mCursor = start;
+	mMouseX = header.MouseX;
+	mMouseY = header.MouseY;
+
+	// Settings before the first frame are the starting values
+	JournalFrame initial;
+	while (mCursor < mData.size() && mData[mCursor] == (uint8_t)JournalEventType::Setting && GetEvent(e))
+		initial.Events.push_back(e);
+	ApplySettings(initial);
+
+	mKeys.reset();
+	mFrame = 0;
+	mBytes = mData.size();
+	mMode = Mode::Replaying;
+	return true;
+}
+
+bool InputJournal::ReadFrame(JournalFrame& frame)
+{
+	frame.Dt = 0.0f;
+	frame.Events.clear();
+	if (mMode != Mode::Replaying)
+		return false;
+
+	JournalEvent e;
+	if (!GetEvent(e) || e.Type != JournalEventType::Frame)
+		return false;
+	frame.Dt = e.Dt;
+
+	while (mCursor < mData.size())
+	{
+		const uint8_t next = mData[mCursor];
+		if (next == (uint8_t)JournalEventType::Frame || next == (uint8_t)JournalEventType::End)
+			break;
+		if (!GetEvent(e))
+			break;
+		if (e.Type == JournalEventType::KeyDown || e.Type == JournalEventType::KeyUp)
+			mKeys[e.Key] = e.Type == JournalEventType::KeyDown;
+		frame.Events.push_back(e);
+	}
+	++mFrame;
+	return true;
+}
+
+void InputJournal::ApplySettings(const JournalFrame& frame)
+{
+	for (const auto& e : frame.Events)
+	{
+		if (e.Type != JournalEventType::Setting || e.Setting >= mSettingMap.size())
+			continue;
+		const int index = mSettingMap[e.Setting];
+		if (index >= 0)
+			WriteValue(mSettings[index], e.Value);
+	}
+}
+
+void InputJournal::Stop()
+{
+	if (mMode == Mode::Recording)
+	{
+		for (const auto& m : mMouse)
+			PutEvent(m);
+		mMouse.clear();
+		Put((uint8_t)JournalEventType::End);
+		Flush();
+		mOut.close();
+	}
+	mData.clear();
+	mData.shrink_to_fit();
+	mCursor = 0;
+	mMode = Mode::Idle;
+}
+
+void InputJournal::PutU32(uint32_t value)
+{
+	for (int i = 0; i < 4; ++i)
+		Put((uint8_t)(value >> (8 * i)));
+}
+
+void InputJournal::PutVarint(uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		Put((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	Put((uint8_t)value);
+}
+
+void InputJournal::PutEvent(const JournalEvent& e)
+{
+	Put((uint8_t)e.Type);
+	switch (e.Type)
+	{
+	case JournalEventType::Frame:
+		PutU32(FloatBits(e.Dt));
+		break;
+	case JournalEventType::KeyDown:
+	case JournalEventType::KeyUp:
+		Put(e.Key);
+		break;
+	case JournalEventType::MouseDown:
+	case JournalEventType::MouseUp:
+	case JournalEventType::MouseMove:
+		Put((uint8_t)((e.Buttons & 0x7F) | (e.Captured ? 0x80 : 0)));
+		PutVarint(ZigZag(e.X - mMouseX));
+		PutVarint(ZigZag(e.Y - mMouseY));
+		mMouseX = e.X;
+		mMouseY = e.Y;
+		break;
+	case JournalEventType::Setting:
+		PutVarint(e.Setting);
+		PutU32(e.Value);
+		break;
+	default:
+		break;
+	}
+}
+
+void InputJournal::Flush()
+{
+	if (mPending.empty())
+		return;
+	mOut.write((const char*)mPending.data(), (std::streamsize)mPending.size());
+	mBytes += mPending.size();
+	mPending.clear();
+	if (!mOut && mMode == Mode::Recording)
+	{
+		mOut.close();
+		mMode = Mode::Idle;
+		mError = "Journal write failed";
+	}
+}
+
+bool InputJournal::Get(uint8_t& byte)
+{
+	if (mCursor >= mData.size())
+		return false;
+	byte = mData[mCursor++];
+	return true;
+}
+
+bool InputJournal::GetU32(uint32_t& value)
+{
+	value = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		uint8_t byte;
+		if (!Get(byte))
+			return false;
+		value |= (uint32_t)byte << (8 * i);
+	}
+	return true;
+}
+
+bool InputJournal::GetVarint(uint32_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7)
+	{
+		uint8_t byte;
+		if (!Get(byte))
+			return false;
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool InputJournal::GetEvent(JournalEvent& e)
+{
+	uint8_t type;
+	if (!Get(type) || type > (uint8_t)JournalEventType::End)
+		return false;
+
+	e = JournalEvent();
+	e.Type = (JournalEventType)type;
+	switch (e.Type)
+	{
+	case JournalEventType::Frame:
+	{
+		uint32_t bits;
+		if (!GetU32(bits))
+			return false;
+		e.Dt = BitsFloat(bits);
+		return true;
+	}
+	case JournalEventType::KeyDown:
+	case JournalEventType::KeyUp:
+		return Get(e.Key);
+	case JournalEventType::MouseDown:
+	case JournalEventType::MouseUp:
+	case JournalEventType::MouseMove:
+	{
+		uint8_t flags;
+		uint32_t dx, dy;
+		if (!Get(flags) || !GetVarint(dx) || !GetVarint(dy))
+			return false;
+		e.Buttons = flags & 0x7F;
+		e.Captured = (flags & 0x80) != 0;
+		mMouseX += UnZigZag(dx);
+		mMouseY += UnZigZag(dy);
+		e.X = mMouseX;
+		e.Y = mMouseY;
+		return true;
+	}
+	case JournalEventType::Setting:
+		return GetVarint(e.Setting) && GetU32(e.Value);
+	default:
+		return true;
+	}
+}
+
+bool InputJournal::Fail(const std::string& error)
+{
+	mError = error;
+	mOut.close();
+	mData.clear();
+	mMode = Mode::Idle;
+	return false;
+}
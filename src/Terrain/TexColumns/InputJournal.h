@@ -0,0 +1,183 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Input journal: records everything that drives a frame - the timer delta,
+// key state, mouse messages and watched settings - into a compact binary
+// file, and plays it back so a session can be repeated exactly, in the app
+// or headless (Tools/JournalReplay).
+//
+// A file is a header (camera pose, client size, setting names) followed by a
+// byte stream of events. A Frame event starts each frame and carries its
+// delta; the events after it belong to that frame, in the order the app
+// consumes them: key changes, the mouse messages that arrived before the
+// frame, then settings changed while it ran. Mouse positions are stored as
+// varint offsets from the previous one, so a frame usually costs 5-10 bytes.
+
+// Key codes and mouse button bits are the Win32 ones (VK_*, MK_*), so the
+// app stores what it gets; the names below are for code without windows.h.
+enum JournalKey : uint8_t
+{
+	JournalKeyShift = 0x10,   // VK_SHIFT
+	JournalKeyControl = 0x11, // VK_CONTROL
+};
+
+enum JournalButton : uint8_t
+{
+	JournalButtonLeft = 0x01,   // MK_LBUTTON
+	JournalButtonRight = 0x02,  // MK_RBUTTON
+	JournalButtonMiddle = 0x10, // MK_MBUTTON
+};
+
+using JournalKeys = std::bitset<256>;
+
+enum class JournalEventType : uint8_t
+{
+	Frame,
+	KeyDown,
+	KeyUp,
+	MouseDown,
+	MouseUp,
+	MouseMove,
+	Setting,
+	End,
+};
+
+struct JournalEvent
+{
+	JournalEventType Type = JournalEventType::Frame;
+	float Dt = 0.0f;       // Frame: seconds
+	uint8_t Key = 0;       // KeyDown, KeyUp
+	uint8_t Buttons = 0;   // Mouse*: JournalButton bits
+	bool Captured = false; // Mouse*: ImGui wanted the mouse
+	int32_t X = 0;         // Mouse*: client coordinates
+	int32_t Y = 0;
+	uint32_t Setting = 0;  // Setting: index into the file's setting names
+	uint32_t Value = 0;    // Setting: raw bits of the float, int or bool
+};
+
+struct JournalFrame
+{
+	float Dt = 0.0f;
+	std::vector<JournalEvent> Events; // everything but the Frame event
+};
+
+// State the recording started from
+struct JournalHeader
+{
+	uint32_t ClientWidth = 0;
+	uint32_t ClientHeight = 0;
+	float Position[3] = {};
+	float Look[3] = { 0.0f, 0.0f, 1.0f };
+	float Up[3] = { 0.0f, 1.0f, 0.0f };
+	float FovY = 0.785f;
+	int32_t MouseX = 0;
+	int32_t MouseY = 0;
+};
+
+class InputJournal
+{
+public:
+	enum class Mode
+	{
+		Idle,
+		Recording,
+		Replaying,
+	};
+
+	// Settings are recorded by value whenever they change and written back
+	// on replay. Names are stored in the file and matched on replay, so the
+	// app and the headless tool only need to agree on the ones both watch.
+	void WatchSetting(const char* name, float* value);
+	void WatchSetting(const char* name, int* value);
+	void WatchSetting(const char* name, bool* value);
+
+	Mode GetMode() const { return mMode; }
+	bool IsRecording() const { return mMode == Mode::Recording; }
+	bool IsReplaying() const { return mMode == Mode::Replaying; }
+
+	// Recording. The current value of every watched setting is stored first.
+	bool StartRecording(const std::string& path, const JournalHeader& header);
+	// Starts a frame: key changes since the last frame and the mouse
+	// messages recorded since are written after the Frame event.
+	void BeginFrame(float dt, const JournalKeys& keys);
+	void RecordMouse(JournalEventType type, uint8_t buttons, bool captured, int32_t x, int32_t y);
+	// Writes the settings that changed since BeginFrame.
+	void EndFrame();
+
+	// Replay. StartReplay applies the settings stored at the start of the
+	// recording; the settings of each frame are applied by ApplySettings,
+	// at the point where the recording saw them change.
+	bool StartReplay(const std::string& path);
+	const JournalHeader& GetHeader() const { return mHeader; }
+	// False at the end of the journal
+	bool ReadFrame(JournalFrame& frame);
+	const JournalKeys& GetKeys() const { return mKeys; }
+	void ApplySettings(const JournalFrame& frame);
+
+	// Ends recording or replay; a recording is flushed and closed.
+	void Stop();
+
+	uint32_t GetFrame() const { return mFrame; }
+	uint32_t GetFrameCount() const { return mFrameCount; } // replay only
+	uint64_t GetBytes() const { return mBytes; }
+	const std::string& GetError() const { return mError; }
+
+private:
+	enum class SettingKind : uint8_t
+	{
+		Float,
+		Int,
+		Bool,
+	};
+
+	struct Setting
+	{
+		std::string Name;
+		void* Value;
+		SettingKind Kind;
+		uint32_t Recorded; // last value written
+	};
+
+	void Watch(const char* name, void* value, SettingKind kind);
+	static uint32_t ReadValue(const Setting& setting);
+	static void WriteValue(const Setting& setting, uint32_t bits);
+
+	void Put(uint8_t byte) { mPending.push_back(byte); }
+	void PutU32(uint32_t value);
+	void PutVarint(uint32_t value);
+	void PutEvent(const JournalEvent& e);
+	void Flush();
+
+	bool Get(uint8_t& byte);
+	bool GetU32(uint32_t& value);
+	bool GetVarint(uint32_t& value);
+	bool GetEvent(JournalEvent& e);
+	bool Fail(const std::string& error);
+
+private:
+	Mode mMode = Mode::Idle;
+	std::vector<Setting> mSettings;
+
+	JournalHeader mHeader;
+	JournalKeys mKeys;
+	int32_t mMouseX = 0;
+	int32_t mMouseY = 0;
+	uint32_t mFrame = 0;
+	uint32_t mFrameCount = 0;
+	uint64_t mBytes = 0;
+	std::string mError;
+
+	// Recording
+	std::ofstream mOut;
+	std::vector<uint8_t> mPending;
+	std::vector<JournalEvent> mMouse; // recorded since BeginFrame
+
+	// Replay: the whole file, journals are small
+	std::vector<uint8_t> mData;
+	size_t mCursor = 0;
+	std::vector<int> mSettingMap; // file setting index to mSettings, -1 if not watched
+};
@@ -0,0 +1,85 @@
+#include "LodSelector.h"
+
+#include <algorithm>
+#include <cmath>
+
+int LodSelector::Add(float centerX, float centerY, float centerZ, float radius,
+	const float* levelErrors, uint32_t levelCount)
+{
+	mCenterX.push_back(centerX);
+	mCenterY.push_back(centerY);
+	mCenterZ.push_back(centerZ);
+	mRadius.push_back(radius);
+	mScreenRadius.push_back(0.0f);
+	mFirstError.push_back((uint32_t)mErrors.size());
+	mLevelCount.push_back(std::max(levelCount, 1u));
+	mLevel.push_back(0);
+
+	if (levelCount == 0)
+		mErrors.push_back(0.0f);
+	else
+		mErrors.insert(mErrors.end(), levelErrors, levelErrors + levelCount);
+	return (int)mRadius.size() - 1;
+}
+
+void LodSelector::Clear()
+{
+	mCenterX.clear();
+	mCenterY.clear();
+	mCenterZ.clear();
+	mRadius.clear();
+	mScreenRadius.clear();
+	mFirstError.clear();
+	mLevelCount.clear();
+	mLevel.clear();
+	mErrors.clear();
+}
+
+void LodSelector::Reset()
+{
+	std::fill(mLevel.begin(), mLevel.end(), 0u);
+}
+
+uint32_t LodSelector::Select(const LodSelectParams& params)
+{
+	const float tolerance = params.PixelError * std::exp2(params.Bias);
+	const float coarserTolerance = tolerance * (1.0f - std::min(std::max(params.Hysteresis, 0.0f), 1.0f));
+	const size_t count = mRadius.size();
+	uint32_t changed = 0;
+
+	const float* cx = mCenterX.data();
+	const float* cy = mCenterY.data();
+	const float* cz = mCenterZ.data();
+	const float* radius = mRadius.data();
+	float* screenRadius = mScreenRadius.data();
+
+	// Projected size first, in one pass the compiler can vectorize
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float dx = cx[i] - params.EyeX;
+		const float dy = cy[i] - params.EyeY;
+		const float dz = cz[i] - params.EyeZ;
+		const float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+		screenRadius[i] = radius[i] * params.PixelsPerUnit / std::max(std::max(dist, radius[i]), 1e-6f);
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float* errors = &mErrors[mFirstError[i]];
+		const uint32_t levels = mLevelCount[i];
+		// Pixels per world unit at the object's distance
+		const float scale = radius[i] > 0.0f ? screenRadius[i] / radius[i] : 0.0f;
+
+		uint32_t level = std::min(mLevel[i], levels - 1);
+		// Finer as soon as the current level's error shows...
+		while (level > 0 && errors[level] * scale > tolerance)
+			--level;
+		// ...coarser only once the next level is clearly below the tolerance
+		while (level + 1 < levels && errors[level + 1] * scale <= coarserTolerance)
+			++level;
+
+		changed += level != mLevel[i];
+		mLevel[i] = level;
+	}
+	return changed;
+}
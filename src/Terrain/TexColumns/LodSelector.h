@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Picks a detail level for many objects at once from how large they are on
+// screen. Objects are stored as structure-of-arrays so Select is one tight
+// loop over plain float arrays; the renderer only reads the chosen levels.
+//
+// A level is good enough while its geometric error, projected at the
+// object's distance (clamped to the bounding sphere so nearby objects don't
+// blow up), stays under the pixel tolerance. Going to a coarser level needs
+// the error to drop below tolerance * (1 - hysteresis), so objects sitting on
+// a boundary don't flicker between two levels.
+
+struct LodSelectParams
+{
+	float EyeX = 0.0f, EyeY = 0.0f, EyeZ = 0.0f;
+	float PixelsPerUnit = 1.0f;    // pixels covered by one world unit at distance 1
+	float PixelError = 1.0f;       // tolerated projected error
+	float Bias = 0.0f;             // each +1 doubles the tolerance (coarser levels)
+	float Hysteresis = 0.15f;      // 0..1
+};
+
+class LodSelector
+{
+public:
+	// levelErrors: world-space error of each level, finest (0) first and
+	// non-decreasing. Returns the object's index.
+	int Add(float centerX, float centerY, float centerZ, float radius,
+		const float* levelErrors, uint32_t levelCount);
+	void Clear();
+	size_t GetCount() const { return mRadius.size(); }
+
+	void SetSphere(int item, float centerX, float centerY, float centerZ, float radius)
+	{
+		mCenterX[item] = centerX;
+		mCenterY[item] = centerY;
+		mCenterZ[item] = centerZ;
+		mRadius[item] = radius;
+	}
+
+	// Updates the level of every object; returns how many changed.
+	uint32_t Select(const LodSelectParams& params);
+	void Reset();                  // everything back to level 0
+
+	uint32_t GetLevel(int item) const { return mLevel[item]; }
+	uint32_t GetLevelCount(int item) const { return mLevelCount[item]; }
+	float GetScreenRadius(int item) const { return mScreenRadius[item]; }
+
+private:
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mRadius;
+	std::vector<float> mScreenRadius; // projected sphere radius in pixels, last Select
+	std::vector<uint32_t> mFirstError;
+	std::vector<uint32_t> mLevelCount;
+	std::vector<uint32_t> mLevel;
+	std::vector<float> mErrors;       // all objects' level errors back to back
+};
@@ -0,0 +1,278 @@
+#include "LooseOctree.h"
+
+#include <algorithm>
+#include <cmath>
+
+void LooseOctree::Reset(const Aabb& world, uint32_t maxDepth)
+{
+	mNodes.clear();
+	mFreeNodes.clear();
+	mItems.clear();
+	mCount = 0;
+	mMaxDepth = maxDepth;
+
+	Node root;
+	for (int c = 0; c < 3; ++c)
+		root.Center[c] = world.Center(c);
+	root.HalfSize = 0.5f * world.MaxSize();
+	root.Parent = -1;
+	for (auto& child : root.Children)
+		child = -1;
+	root.ChildCount = 0;
+	root.Depth = 0;
+	mNodes.push_back(std::move(root));
+}
+
+int32_t LooseOctree::AllocateNode(int32_t parent, int child)
+{
+	int32_t index;
+	if (!mFreeNodes.empty())
+	{
+		index = mFreeNodes.back();
+		mFreeNodes.pop_back();
+	}
+	else
+	{
+		index = (int32_t)mNodes.size();
+		mNodes.emplace_back();
+	}
+
+	// mNodes may have grown: index the parent again rather than keep a reference
+	const float half = 0.5f * mNodes[parent].HalfSize;
+	Node& node = mNodes[index];
+	for (int c = 0; c < 3; ++c)
+		node.Center[c] = mNodes[parent].Center[c] + ((child >> c) & 1 ? half : -half);
+	node.HalfSize = half;
+	node.Parent = parent;
+	for (auto& c : node.Children)
+		c = -1;
+	node.ChildCount = 0;
+	node.Depth = mNodes[parent].Depth + 1;
+	node.Items.clear();
+
+	mNodes[parent].Children[child] = index;
+	mNodes[parent].ChildCount++;
+	return index;
+}
+
+int32_t LooseOctree::FindNode(const Aabb& box, bool create)
+{
+	const float size = box.MaxSize();
+	const float center[3] = { box.Center(0), box.Center(1), box.Center(2) };
+
+	const Node& root = mNodes[0];
+	for (int c = 0; c < 3; ++c)
+	{
+		if (!(std::fabs(center[c] - root.Center[c]) <= root.HalfSize))
+			return 0;
+	}
+
+	// An item fits a loose node when it is no larger than the node's cell and
+	// its centre lies in the cell, so descend while the child cell is big enough.
+	int32_t node = 0;
+	while (mNodes[node].Depth < mMaxDepth && size <= mNodes[node].HalfSize)
+	{
+		const Node& n = mNodes[node];
+		const int child =
+			(center[0] >= n.Center[0] ? 1 : 0) |
+			(center[1] >= n.Center[1] ? 2 : 0) |
+			(center[2] >= n.Center[2] ? 4 : 0);
+		int32_t next = n.Children[child];
+		if (next < 0)
+		{
+			if (!create)
+				break;
+			next = AllocateNode(node, child);
+		}
+		node = next;
+	}
+	return node;
+}
+
+void LooseOctree::Insert(uint32_t id, const Aabb& box)
+{
+	if (id >= mItems.size())
+		mItems.resize(id + 1);
+	if (mItems[id].Node >= 0)
+		Unlink(id);
+
+	const int32_t node = FindNode(box, true);
+	Item& item = mItems[id];
+	item.Box = box;
+	item.Node = node;
+	item.Slot = (uint32_t)mNodes[node].Items.size();
+	mNodes[node].Items.push_back(id);
+	++mCount;
+}
+
+void LooseOctree::Remove(uint32_t id)
+{
+	if (!Contains(id))
+		return;
+	const int32_t node = mItems[id].Node;
+	Unlink(id);
+	Prune(node);
+}
+
+void LooseOctree::Move(uint32_t id, const Aabb& box)
+{
+	if (!Contains(id))
+	{
+		Insert(id, box);
+		return;
+	}
+
+	const int32_t oldNode = mItems[id].Node;
+	const int32_t newNode = FindNode(box, true);
+	mItems[id].Box = box;
+	if (newNode == oldNode)
+		return;
+
+	Unlink(id);
+	Item& item = mItems[id];
+	item.Box = box;
+	item.Node = newNode;
+	item.Slot = (uint32_t)mNodes[newNode].Items.size();
+	mNodes[newNode].Items.push_back(id);
+	++mCount;
+	Prune(oldNode);
+}
+
+void LooseOctree::Unlink(uint32_t id)
+{
+	Item& item = mItems[id];
+	auto& items = mNodes[item.Node].Items;
+
+	// Swap-remove keeps it O(1); the moved item learns its new slot
+	const uint32_t last = items.back();
+	items[item.Slot] = last;
+	mItems[last].Slot = item.Slot;
+	items.pop_back();
+
+	item.Node = -1;
+	--mCount;
+}
+
+void LooseOctree::Prune(int32_t node)
+{
+	while (node > 0 && mNodes[node].Items.empty() && mNodes[node].ChildCount == 0)
+	{
+		const int32_t parent = mNodes[node].Parent;
+		for (auto& child : mNodes[parent].Children)
+		{
+			if (child == node)
+			{
+				child = -1;
+				break;
+			}
+		}
+		mNodes[parent].ChildCount--;
+		mFreeNodes.push_back(node);
+		node = parent;
+	}
+}
+
+Aabb LooseOctree::LooseBounds(const Node& node) const
+{
+	const float loose = 2.0f * node.HalfSize;
+	Aabb box;
+	for (int c = 0; c < 3; ++c)
+	{
+		box.Min[c] = node.Center[c] - loose;
+		box.Max[c] = node.Center[c] + loose;
+	}
+	return box;
+}
+
+void LooseOctree::Query(const FrustumPlanes& frustum, std::vector<uint32_t>& result, OctreeQueryStats* stats) const
+{
+	OctreeQueryStats local;
+	if (!mNodes.empty())
+		QueryNode(0, frustum, FrustumPlanes::AllPlanes, result, local);
+	if (stats)
+		*stats = local;
+}
+
+void LooseOctree::QueryNode(int32_t index, const FrustumPlanes& frustum, uint32_t planes, std::vector<uint32_t>& result, OctreeQueryStats& stats) const
+{
+	const Node& node = mNodes[index];
+	++stats.NodesVisited;
+
+	// The root also holds whatever does not fit the world, so it is never
+	// culled as a whole.
+	if (index != 0)
+	{
+		const CullResult cull = frustum.Classify(LooseBounds(node), planes);
+		if (cull == CullResult::Outside)
+			return;
+		if (cull == CullResult::Inside)
+		{
+			AddSubtree(index, result, stats);
+			return;
+		}
+	}
+
+	for (uint32_t id : node.Items)
+	{
+		++stats.ItemsTested;
+		uint32_t itemPlanes = planes;
+		if (frustum.Classify(mItems[id].Box, itemPlanes) != CullResult::Outside)
+			result.push_back(id);
+	}
+	for (int32_t child : node.Children)
+	{
+		if (child >= 0)
+			QueryNode(child, frustum, planes, result, stats);
+	}
+}
+
+void LooseOctree::AddSubtree(int32_t index, std::vector<uint32_t>& result, OctreeQueryStats& stats) const
+{
+	const Node& node = mNodes[index];
+	++stats.NodesVisited;
+	stats.ItemsAccepted += (uint32_t)node.Items.size();
+	result.insert(result.end(), node.Items.begin(), node.Items.end());
+	for (int32_t child : node.Children)
+	{
+		if (child >= 0)
+			AddSubtree(child, result, stats);
+	}
+}
+
+void LooseOctree::Query(const FrustumPlanes* views, uint32_t viewCount, std::vector<uint32_t>* results, OctreeQueryStats* stats) const
+{
+	OctreeQueryStats local;
+	viewCount = std::min(viewCount, ViewCullState::MaxViews);
+	for (uint32_t i = 0; i < viewCount && !mNodes.empty(); ++i)
+		QueryNode(0, views[i], FrustumPlanes::AllPlanes, results[i], local);
+	if (stats)
+		*stats = local;
+}
+
+void LooseOctree::Query(const Aabb& box, std::vector<uint32_t>& result) const
+{
+	if (mNodes.empty())
+		return;
+
+	std::vector<int32_t> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const int32_t index = stack.back();
+		stack.pop_back();
+		const Node& node = mNodes[index];
+		if (index != 0 && !LooseBounds(node).Overlaps(box))
+			continue;
+
+		for (uint32_t id : node.Items)
+		{
+			if (mItems[id].Box.Overlaps(box))
+				result.push_back(id);
+		}
+		for (int32_t child : node.Children)
+		{
+			if (child >= 0)
+				stack.push_back(child);
+		}
+	}
+}
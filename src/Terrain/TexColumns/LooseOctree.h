@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "CullingShapes.h"
+
+// Loose octree (Ulrich, "Loose Octrees", Game Programming Gems 1): every
+// node's bounds are twice its cell, so an item only depends on its size and
+// its centre. That makes the node an item belongs to computable directly,
+// and Insert/Remove/Move touch one root-to-node path - O(depth) - instead of
+// re-sorting items into children.
+//
+// Items are identified by small integers chosen by the caller (e.g. a render
+// item's ObjCBIndex). Items larger than the root or outside it live in the
+// root, which is always visited.
+
+struct OctreeQueryStats
+{
+	uint32_t NodesVisited = 0;
+	uint32_t ItemsTested = 0;
+	uint32_t ItemsAccepted = 0; // inside a fully visible node, not tested
+};
+
+class LooseOctree
+{
+public:
+	LooseOctree() = default;
+	LooseOctree(const Aabb& world, uint32_t maxDepth = 8) { Reset(world, maxDepth); }
+
+	// Drops all items and nodes. world is the region cells subdivide; it is
+	// made cubic around its centre.
+	void Reset(const Aabb& world, uint32_t maxDepth = 8);
+
+	void Insert(uint32_t id, const Aabb& box);
+	void Remove(uint32_t id);
+	// Same as Remove + Insert, but cheap when the item stays in its node.
+	void Move(uint32_t id, const Aabb& box);
+
+	bool Contains(uint32_t id) const { return id < mItems.size() && mItems[id].Node >= 0; }
+	const Aabb& GetBox(uint32_t id) const { return mItems[id].Box; }
+	size_t GetCount() const { return mCount; }
+	size_t GetNodeCount() const { return mNodes.size() - mFreeNodes.size(); }
+
+	// Appends the ids of all items that are not outside the frustum.
+	void Query(const FrustumPlanes& frustum, std::vector<uint32_t>& result, OctreeQueryStats* stats = nullptr) const;
+	// Appends the ids of all items whose box overlaps box.
+	void Query(const Aabb& box, std::vector<uint32_t>& result) const;
+	// Up to ViewCullState::MaxViews views: results[i] gets what views[i]
+	// sees; stats add up over the views. One walk per view: a node costs
+	// about a plane test per view either way, and a shared walk only saves
+	// the node fetches, less than tracking which views still see the node
+	// costs (Tools/ShadowBench.cpp).
+	void Query(const FrustumPlanes* views, uint32_t viewCount, std::vector<uint32_t>* results, OctreeQueryStats* stats = nullptr) const;
+
+private:
+	struct Node
+	{
+		float Center[3];
+		float HalfSize;              // of the cell; loose bounds are twice that
+		int32_t Parent;
+		int32_t Children[8];
+		uint32_t ChildCount;
+		uint32_t Depth;
+		std::vector<uint32_t> Items;
+	};
+
+	struct Item
+	{
+		Aabb Box;
+		int32_t Node = -1;
+		uint32_t Slot = 0;           // position in Node::Items
+	};
+
+	int32_t FindNode(const Aabb& box, bool create);
+	int32_t AllocateNode(int32_t parent, int child);
+	void Unlink(uint32_t id);
+	void Prune(int32_t node);
+	Aabb LooseBounds(const Node& node) const;
+	void QueryNode(int32_t node, const FrustumPlanes& frustum, uint32_t planes, std::vector<uint32_t>& result, OctreeQueryStats& stats) const;
+	void AddSubtree(int32_t node, std::vector<uint32_t>& result, OctreeQueryStats& stats) const;
+
+private:
+	std::vector<Node> mNodes;        // [0] is the root
+	std::vector<int32_t> mFreeNodes;
+	std::vector<Item> mItems;        // indexed by id
+	size_t mCount = 0;
+	uint32_t mMaxDepth = 8;
+};
@@ -0,0 +1,262 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+	inline size_t Align4(size_t v) { return (v + 3) & ~size_t(3); }
+}
+
+void CookedMesh::ComputeBounds()
+{
+	for (auto& sm : Submeshes)
+	{
+		float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (uint32_t v = 0; v < sm.VertexCount; ++v)
+		{
+			const float* p = Vertices[sm.BaseVertex + v].Pos;
+			for (int c = 0; c < 3; ++c)
+			{
+				lo[c] = std::min(lo[c], p[c]);
+				hi[c] = std::max(hi[c], p[c]);
+			}
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			if (sm.VertexCount == 0)
+				lo[c] = hi[c] = 0.0f;
+			sm.BoundsCenter[c] = 0.5f * (lo[c] + hi[c]);
+			sm.BoundsExtents[c] = 0.5f * (hi[c] - lo[c]);
+		}
+	}
+}
+
+bool MeshCache::HashFile(const std::wstring& fileName, uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+		return false;
+
+	const uint8_t* data = file.GetData();
+	for (size_t i = 0; i < file.GetSize(); ++i)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001b3ull;
+	}
+	return true;
+}
+
+bool MeshCache::Write(const std::wstring& fileName, const CookedMesh& mesh)
+{
+	std::string strings;
+	std::vector<MeshFileMaterial> materials(mesh.Materials.size());
+	auto addString = [&strings](const std::string& s, uint32_t& offset, uint32_t& length)
+	{
+		offset = (uint32_t)strings.size();
+		length = (uint32_t)s.size();
+		strings += s;
+	};
+	for (size_t i = 0; i < mesh.Materials.size(); ++i)
+	{
+		addString(mesh.Materials[i].Name, materials[i].NameOffset, materials[i].NameLength);
+		addString(mesh.Materials[i].DiffuseMap, materials[i].DiffuseOffset, materials[i].DiffuseLength);
+		addString(mesh.Materials[i].NormalMap, materials[i].NormalOffset, materials[i].NormalLength);
+	}
+
+	std::vector<MeshFileSubmesh> submeshes(mesh.Submeshes.size());
+	for (size_t i = 0; i < mesh.Submeshes.size(); ++i)
+	{
+		const CookedSubmesh& src = mesh.Submeshes[i];
+		MeshFileSubmesh& dst = submeshes[i];
+		dst.IndexCount = src.IndexCount;
+		dst.StartIndex = src.StartIndex;
+		dst.BaseVertex = src.BaseVertex;
+		dst.VertexCount = src.VertexCount;
+		dst.MaterialIndex = src.MaterialIndex;
+		std::memcpy(dst.BoundsCenter, src.BoundsCenter, sizeof(dst.BoundsCenter));
+		std::memcpy(dst.BoundsExtents, src.BoundsExtents, sizeof(dst.BoundsExtents));
+	}
+
+	std::vector<MeshFileLod> lods(mesh.Lods.size());
+	for (size_t i = 0; i < mesh.Lods.size(); ++i)
+	{
+		const CookedLod& src = mesh.Lods[i];
+		lods[i] = { src.Submesh, src.Level, src.StartIndex, src.IndexCount, src.Error };
+	}
+
+	MeshFileHeader header = {};
+	header.Magic = Magic;
+	header.Version = Version;
+	header.SourceHash = mesh.SourceHash;
+	header.VertexStride = sizeof(CookedVertex);
+	header.VertexCount = (uint32_t)mesh.Vertices.size();
+	header.IndexCount = (uint32_t)mesh.Indices.size();
+	header.SubmeshCount = (uint32_t)submeshes.size();
+	header.MaterialCount = (uint32_t)materials.size();
+	header.StringBytes = (uint32_t)strings.size();
+	header.LodCount = (uint32_t)lods.size();
+	header.VertexOffset = sizeof(MeshFileHeader);
+	header.IndexOffset = header.VertexOffset + mesh.Vertices.size() * sizeof(CookedVertex);
+	header.SubmeshOffset = header.IndexOffset + Align4(mesh.Indices.size() * sizeof(uint16_t));
+	header.MaterialOffset = header.SubmeshOffset + submeshes.size() * sizeof(MeshFileSubmesh);
+	header.LodOffset = header.MaterialOffset + materials.size() * sizeof(MeshFileMaterial);
+	header.StringOffset = header.LodOffset + lods.size() * sizeof(MeshFileLod);
+
+	// Write to a temporary and rename, so a crash never leaves a torn file behind.
+	const std::filesystem::path path(fileName);
+	std::filesystem::path temp = path;
+	temp += ".tmp";
+	{
+		std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+
+		const uint32_t pad = 0;
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(mesh.Vertices.data()), mesh.Vertices.size() * sizeof(CookedVertex));
+		out.write(reinterpret_cast<const char*>(mesh.Indices.data()), mesh.Indices.size() * sizeof(uint16_t));
+		out.write(reinterpret_cast<const char*>(&pad), Align4(mesh.Indices.size() * sizeof(uint16_t)) - mesh.Indices.size() * sizeof(uint16_t));
+		out.write(reinterpret_cast<const char*>(submeshes.data()), submeshes.size() * sizeof(MeshFileSubmesh));
+		out.write(reinterpret_cast<const char*>(materials.data()), materials.size() * sizeof(MeshFileMaterial));
+		out.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(MeshFileLod));
+		out.write(strings.data(), strings.size());
+		if (!out)
+			return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(temp, path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(temp, ec);
+		return false;
+	}
+	return true;
+}
+
+bool MeshFileView::Open(const std::wstring& fileName)
+{
+	Close();
+
+	if (!mFile.Open(fileName) || mFile.GetSize() < sizeof(MeshFileHeader))
+	{
+		Close();
+		return false;
+	}
+
+	const uint8_t* base = mFile.GetData();
+	const size_t size = mFile.GetSize();
+	const MeshFileHeader* header = reinterpret_cast<const MeshFileHeader*>(base);
+
+	auto fits = [size](uint64_t offset, uint64_t bytes) { return offset <= size && bytes <= size - offset; };
+	if (header->Magic != MeshCache::Magic ||
+		header->Version != MeshCache::Version ||
+		header->VertexStride != sizeof(CookedVertex) ||
+		!fits(header->VertexOffset, (uint64_t)header->VertexCount * sizeof(CookedVertex)) ||
+		!fits(header->IndexOffset, (uint64_t)header->IndexCount * sizeof(uint16_t)) ||
+		!fits(header->SubmeshOffset, (uint64_t)header->SubmeshCount * sizeof(MeshFileSubmesh)) ||
+		!fits(header->MaterialOffset, (uint64_t)header->MaterialCount * sizeof(MeshFileMaterial)) ||
+		!fits(header->LodOffset, (uint64_t)header->LodCount * sizeof(MeshFileLod)) ||
+		!fits(header->StringOffset, header->StringBytes))
+	{
+		Close();
+		return false;
+	}
+
+	mHeader = header;
+	mVertices = reinterpret_cast<const CookedVertex*>(base + header->VertexOffset);
+	mIndices = reinterpret_cast<const uint16_t*>(base + header->IndexOffset);
+	mSubmeshes = reinterpret_cast<const MeshFileSubmesh*>(base + header->SubmeshOffset);
+	mMaterials = reinterpret_cast<const MeshFileMaterial*>(base + header->MaterialOffset);
+	mLods = reinterpret_cast<const MeshFileLod*>(base + header->LodOffset);
+	mStrings = reinterpret_cast<const char*>(base + header->StringOffset);
+
+	// Ranges inside the tables must not point outside the streams either.
+	for (uint32_t i = 0; i < header->SubmeshCount; ++i)
+	{
+		const MeshFileSubmesh& sm = mSubmeshes[i];
+		if ((uint64_t)sm.StartIndex + sm.IndexCount > header->IndexCount ||
+			(uint64_t)sm.BaseVertex + sm.VertexCount > header->VertexCount ||
+			sm.MaterialIndex >= std::max(header->MaterialCount, 1u))
+		{
+			Close();
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header->MaterialCount; ++i)
+	{
+		const MeshFileMaterial& m = mMaterials[i];
+		if ((uint64_t)m.NameOffset + m.NameLength > header->StringBytes ||
+			(uint64_t)m.DiffuseOffset + m.DiffuseLength > header->StringBytes ||
+			(uint64_t)m.NormalOffset + m.NormalLength > header->StringBytes)
+		{
+			Close();
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header->LodCount; ++i)
+	{
+		const MeshFileLod& lod = mLods[i];
+		if (lod.Submesh >= header->SubmeshCount ||
+			(uint64_t)lod.StartIndex + lod.IndexCount > header->IndexCount)
+		{
+			Close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void MeshFileView::Close()
+{
+	mFile.Close();
+	mHeader = nullptr;
+	mVertices = nullptr;
+	mIndices = nullptr;
+	mSubmeshes = nullptr;
+	mMaterials = nullptr;
+	mLods = nullptr;
+	mStrings = nullptr;
+}
+
+void MeshFileView::ToCookedMesh(CookedMesh& mesh) const
+{
+	mesh = CookedMesh();
+	mesh.SourceHash = mHeader->SourceHash;
+	mesh.Vertices.assign(mVertices, mVertices + mHeader->VertexCount);
+	mesh.Indices.assign(mIndices, mIndices + mHeader->IndexCount);
+
+	mesh.Submeshes.resize(mHeader->SubmeshCount);
+	for (uint32_t i = 0; i < mHeader->SubmeshCount; ++i)
+	{
+		const MeshFileSubmesh& src = mSubmeshes[i];
+		CookedSubmesh& dst = mesh.Submeshes[i];
+		dst.IndexCount = src.IndexCount;
+		dst.StartIndex = src.StartIndex;
+		dst.BaseVertex = src.BaseVertex;
+		dst.VertexCount = src.VertexCount;
+		dst.MaterialIndex = src.MaterialIndex;
+		std::memcpy(dst.BoundsCenter, src.BoundsCenter, sizeof(dst.BoundsCenter));
+		std::memcpy(dst.BoundsExtents, src.BoundsExtents, sizeof(dst.BoundsExtents));
+	}
+
+	mesh.Materials.resize(mHeader->MaterialCount);
+	for (uint32_t i = 0; i < mHeader->MaterialCount; ++i)
+	{
+		mesh.Materials[i].Name = GetMaterialName(i);
+		mesh.Materials[i].DiffuseMap = GetDiffuseMap(i);
+		mesh.Materials[i].NormalMap = GetNormalMap(i);
+	}
+
+	mesh.Lods.resize(mHeader->LodCount);
+	for (uint32_t i = 0; i < mHeader->LodCount; ++i)
+	{
+		const MeshFileLod& src = mLods[i];
+		mesh.Lods[i] = { src.Submesh, src.Level, src.StartIndex, src.IndexCount, src.Error };
+	}
+}
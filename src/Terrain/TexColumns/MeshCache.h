@@ -0,0 +1,180 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "../../Common/FileMapping.h"
+
+// Cooked mesh files (.mesh): a versioned binary image of an imported model,
+// laid out so the loader only has to map the file and point into it.
+//
+//   MeshFileHeader
+//   CookedVertex[VertexCount]         (same layout as the app's Vertex)
+//   uint16_t[IndexCount]              (submesh-local, padded to 4 bytes)
+//   MeshFileSubmesh[SubmeshCount]
+//   MeshFileMaterial[MaterialCount]
+//   MeshFileLod[LodCount]             (simplified index ranges per submesh)
+//   char[StringBytes]                 (material and texture names)
+//
+// SourceHash is taken over the source model and its material library; a
+// mismatch means the cooked file is stale and has to be cooked again.
+
+struct CookedVertex
+{
+	float Pos[3];
+	float Normal[3];
+	float TexC[2];
+	float Tangent[3];
+};
+
+struct CookedSubmesh
+{
+	uint32_t IndexCount = 0;
+	uint32_t StartIndex = 0;      // into CookedMesh::Indices
+	uint32_t BaseVertex = 0;      // into CookedMesh::Vertices
+	uint32_t VertexCount = 0;
+	uint32_t MaterialIndex = 0;
+	float BoundsCenter[3] = {};
+	float BoundsExtents[3] = {};
+};
+
+// A simplified version of a submesh. It reuses the submesh's vertices, only
+// the index range is its own.
+struct CookedLod
+{
+	uint32_t Submesh = 0;
+	uint32_t Level = 0;           // 1.. (0 is the submesh itself)
+	uint32_t StartIndex = 0;      // into CookedMesh::Indices
+	uint32_t IndexCount = 0;
+	float Error = 0.0f;           // geometric error relative to the submesh extents
+};
+
+struct CookedMaterial
+{
+	std::string Name;
+	std::string DiffuseMap;       // texture name without extension, may be empty
+	std::string NormalMap;
+};
+
+// In-memory form the cook step works on.
+struct CookedMesh
+{
+	uint64_t SourceHash = 0;
+	std::vector<CookedVertex> Vertices;
+	std::vector<uint16_t> Indices;
+	std::vector<CookedSubmesh> Submeshes;
+	std::vector<CookedMaterial> Materials;
+	std::vector<CookedLod> Lods;  // sorted by submesh, then level
+
+	void ComputeBounds();
+};
+
+#pragma pack(push, 4)
+struct MeshFileHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t SourceHash;
+	uint32_t VertexStride;
+	uint32_t VertexCount;
+	uint32_t IndexCount;
+	uint32_t SubmeshCount;
+	uint32_t MaterialCount;
+	uint32_t StringBytes;
+	uint32_t LodCount;
+	uint32_t Reserved;
+	uint64_t VertexOffset;
+	uint64_t IndexOffset;
+	uint64_t SubmeshOffset;
+	uint64_t MaterialOffset;
+	uint64_t StringOffset;
+	uint64_t LodOffset;
+};
+
+struct MeshFileSubmesh
+{
+	uint32_t IndexCount;
+	uint32_t StartIndex;
+	uint32_t BaseVertex;
+	uint32_t VertexCount;
+	uint32_t MaterialIndex;
+	float BoundsCenter[3];
+	float BoundsExtents[3];
+};
+
+struct MeshFileMaterial
+{
+	uint32_t NameOffset;
+	uint32_t NameLength;
+	uint32_t DiffuseOffset;
+	uint32_t DiffuseLength;
+	uint32_t NormalOffset;
+	uint32_t NormalLength;
+};
+
+struct MeshFileLod
+{
+	uint32_t Submesh;
+	uint32_t Level;
+	uint32_t StartIndex;
+	uint32_t IndexCount;
+	float Error;
+};
+#pragma pack(pop)
+
+namespace MeshCache
+{
+	constexpr uint32_t Magic = 0x4853454D; // "MESH"
+	constexpr uint32_t Version = 4; // 2: streams are cache/overdraw/fetch optimized, 3: LODs, 4: welded first
+
+	// FNV-1a over the file contents; combine several files by passing the
+	// previous result as seed. Returns false if the file cannot be read.
+	bool HashFile(const std::wstring& fileName, uint64_t& hash);
+	constexpr uint64_t HashSeed = 0xcbf29ce484222325ull;
+
+	bool Write(const std::wstring& fileName, const CookedMesh& mesh);
+}
+
+// Read-only mapped view of a .mesh file. All pointers stay valid while the
+// view is open.
+class MeshFileView
+{
+public:
+	bool Open(const std::wstring& fileName);
+	void Close();
+
+	bool IsOpen() const { return mHeader != nullptr; }
+	uint64_t GetSourceHash() const { return mHeader->SourceHash; }
+
+	uint32_t GetVertexCount() const { return mHeader->VertexCount; }
+	uint32_t GetIndexCount() const { return mHeader->IndexCount; }
+	uint32_t GetSubmeshCount() const { return mHeader->SubmeshCount; }
+	uint32_t GetMaterialCount() const { return mHeader->MaterialCount; }
+	uint32_t GetLodCount() const { return mHeader->LodCount; }
+
+	const CookedVertex* GetVertices() const { return mVertices; }
+	const uint16_t* GetIndices() const { return mIndices; }
+	const MeshFileSubmesh& GetSubmesh(uint32_t i) const { return mSubmeshes[i]; }
+	const MeshFileLod& GetLod(uint32_t i) const { return mLods[i]; }
+
+	std::string GetMaterialName(uint32_t i) const { return GetString(mMaterials[i].NameOffset, mMaterials[i].NameLength); }
+	std::string GetDiffuseMap(uint32_t i) const { return GetString(mMaterials[i].DiffuseOffset, mMaterials[i].DiffuseLength); }
+	std::string GetNormalMap(uint32_t i) const { return GetString(mMaterials[i].NormalOffset, mMaterials[i].NormalLength); }
+
+	// Copies everything back into the in-memory form (cook-time tools).
+	void ToCookedMesh(CookedMesh& mesh) const;
+
+private:
+	std::string GetString(uint32_t offset, uint32_t length) const { return std::string(mStrings + offset, length); }
+
+private:
+	MappedFile mFile;
+	const MeshFileHeader* mHeader = nullptr;
+	const CookedVertex* mVertices = nullptr;
+	const uint16_t* mIndices = nullptr;
+	const MeshFileSubmesh* mSubmeshes = nullptr;
+	const MeshFileMaterial* mMaterials = nullptr;
+	const MeshFileLod* mLods = nullptr;
+	const char* mStrings = nullptr;
+};
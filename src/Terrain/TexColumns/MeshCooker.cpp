@@ -0,0 +1,187 @@
+#include "MeshCooker.h"
+#include "MeshSimplifier.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <filesystem>
+
+namespace
+{
+	// Strips the file extension the same way materials always have been named.
+	std::string TextureName(const aiString& path)
+	{
+		std::string name = path.C_Str();
+		return name.length() >= 4 ? name.substr(0, name.length() - 4) : name;
+	}
+}
+
+bool MeshCooker::HashSource(const std::wstring& sourceFile, uint64_t& hash)
+{
+	hash = MeshCache::HashSeed;
+	hash ^= MeshCache::Version;
+
+	MappedFile source;
+	if (!source.Open(sourceFile))
+		return false;
+
+	const std::filesystem::path dir = std::filesystem::path(sourceFile).parent_path();
+	const char* text = reinterpret_cast<const char*>(source.GetData());
+	const size_t size = source.GetSize();
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= (uint8_t)text[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	// OBJ materials live in separate files ("mtllib name.mtl"); a change there
+	// has to re-cook as well.
+	for (size_t line = 0; line < size;)
+	{
+		size_t end = line;
+		while (end < size && text[end] != '\n')
+			++end;
+
+		if (end - line > 7 && std::string(text + line, 7) == "mtllib ")
+		{
+			std::string lib(text + line + 7, end - line - 7);
+			while (!lib.empty() && (lib.back() == '\r' || lib.back() == ' '))
+				lib.pop_back();
+			MeshCache::HashFile((dir / lib).wstring(), hash);
+		}
+		line = end + 1;
+	}
+	return true;
+}
+
+bool MeshCooker::Import(const std::string& sourceFile, CookedMesh& mesh, std::string& error)
+{
+	mesh = CookedMesh();
+
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(sourceFile,
+		aiProcess_Triangulate |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_ConvertToLeftHanded |
+		aiProcess_FlipUVs |
+		aiProcess_GenNormals |
+		aiProcess_CalcTangentSpace);
+	if (!scene || !scene->mRootNode)
+	{
+		error = importer.GetErrorString();
+		return false;
+	}
+
+	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+	{
+		const aiMesh* src = scene->mMeshes[m];
+		if (src->mNumVertices > 0xFFFF)
+		{
+			error = "submesh has more vertices than 16-bit indices can address: " + std::string(src->mName.C_Str());
+			return false;
+		}
+
+		CookedSubmesh sm;
+		sm.BaseVertex = (uint32_t)mesh.Vertices.size();
+		sm.StartIndex = (uint32_t)mesh.Indices.size();
+		sm.VertexCount = src->mNumVertices;
+		sm.MaterialIndex = src->mMaterialIndex;
+
+		for (unsigned int i = 0; i < src->mNumVertices; ++i)
+		{
+			CookedVertex v = {};
+			v.Pos[0] = src->mVertices[i].x;
+			v.Pos[1] = src->mVertices[i].y;
+			v.Pos[2] = src->mVertices[i].z;
+			if (src->HasNormals())
+			{
+				v.Normal[0] = src->mNormals[i].x;
+				v.Normal[1] = src->mNormals[i].y;
+				v.Normal[2] = src->mNormals[i].z;
+			}
+			if (src->HasTextureCoords(0))
+			{
+				v.TexC[0] = src->mTextureCoords[0][i].x;
+				v.TexC[1] = src->mTextureCoords[0][i].y;
+			}
+			if (src->HasTangentsAndBitangents())
+			{
+				v.Tangent[0] = src->mTangents[i].x;
+				v.Tangent[1] = src->mTangents[i].y;
+				v.Tangent[2] = src->mTangents[i].z;
+			}
+			mesh.Vertices.push_back(v);
+		}
+
+		for (unsigned int i = 0; i < src->mNumFaces; ++i)
+		{
+			const aiFace& face = src->mFaces[i];
+			if (face.mNumIndices != 3)
+				continue;
+			mesh.Indices.push_back((uint16_t)face.mIndices[0]);
+			mesh.Indices.push_back((uint16_t)face.mIndices[1]);
+			mesh.Indices.push_back((uint16_t)face.mIndices[2]);
+		}
+		sm.IndexCount = (uint32_t)mesh.Indices.size() - sm.StartIndex;
+		mesh.Submeshes.push_back(sm);
+	}
+
+	for (unsigned int k = 0; k < scene->mNumMaterials; ++k)
+	{
+		const aiMaterial* src = scene->mMaterials[k];
+		CookedMaterial mat;
+		mat.Name = src->GetName().C_Str();
+
+		aiString texPath;
+		if (src->GetTexture(aiTextureType_DIFFUSE, 0, &texPath) == AI_SUCCESS)
+			mat.DiffuseMap = TextureName(texPath);
+		if (src->GetTexture(aiTextureType_NORMALS, 0, &texPath) == AI_SUCCESS ||
+			src->GetTexture(aiTextureType_HEIGHT, 0, &texPath) == AI_SUCCESS)
+			mat.NormalMap = TextureName(texPath);
+
+		mesh.Materials.push_back(std::move(mat));
+	}
+
+	mesh.ComputeBounds();
+	return true;
+}
+
+bool MeshCooker::CookIfStale(const std::string& sourceFile, const std::wstring& cookedFile, bool* recooked, std::string& error,
+	MeshOptimizeStats* stats)
+{
+	if (recooked)
+		*recooked = false;
+
+	uint64_t hash = 0;
+	const bool haveSource = HashSource(std::filesystem::path(sourceFile).wstring(), hash);
+
+	{
+		MeshFileView cooked;
+		if (cooked.Open(cookedFile) && (!haveSource || cooked.GetSourceHash() == hash))
+			return true; // up to date, or shipped without its source
+	}
+
+	if (!haveSource)
+	{
+		error = "no source model and no valid cooked file: " + sourceFile;
+		return false;
+	}
+
+	CookedMesh mesh;
+	if (!Import(sourceFile, mesh, error))
+		return false;
+	mesh.SourceHash = hash;
+	MeshOptimizer::Optimize(mesh, stats);
+	MeshSimplifier::GenerateLods(mesh, { 0.5f, 0.25f, 0.125f });
+
+	if (!MeshCache::Write(cookedFile, mesh))
+	{
+		error = "cannot write cooked mesh for " + sourceFile;
+		return false;
+	}
+
+	if (recooked)
+		*recooked = true;
+	return true;
+}
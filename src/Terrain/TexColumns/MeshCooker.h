@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+
+// Offline side of the .mesh format: imports a source model with Assimp
+// (triangulate, identical vertices joined, left-handed, flipped UVs, normals,
+// tangents - the app's old startup post-processing plus the join), optimizes
+// the streams for the vertex cache, overdraw and fetch, builds simplified
+// LODs and writes the cooked file.
+class MeshCooker
+{
+public:
+	// Hash of the model plus the material libraries it references.
+	static bool HashSource(const std::wstring& sourceFile, uint64_t& hash);
+
+	static bool Import(const std::string& sourceFile, CookedMesh& mesh, std::string& error);
+
+	// Cooks sourceFile into cookedFile unless cookedFile is already built from
+	// the same source. recooked tells which of the two happened; stats are
+	// only filled in when a cook ran.
+	static bool CookIfStale(const std::string& sourceFile, const std::wstring& cookedFile, bool* recooked, std::string& error,
+		MeshOptimizeStats* stats = nullptr);
+};
@@ -0,0 +1,449 @@
+#include "MeshOptimizer.h"
+#include "../../Common/JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// FIFO post-transform cache. Entries carry the miss count at insertion, so
+	// hits do not refresh them and Reset is O(1).
+	struct FifoCache
+	{
+		std::vector<uint32_t> Stamp;
+		uint32_t Misses = 0;
+		uint32_t Base = 0;
+		uint32_t Size;
+
+		FifoCache(size_t vertexCount, uint32_t size) : Stamp(vertexCount, 0), Size(size) {}
+
+		void Reset() { Base = Misses; }
+
+		// Returns true on a miss
+		bool Access(uint16_t v)
+		{
+			const uint32_t s = Stamp[v];
+			if (s > Base && Misses - s < Size)
+				return false;
+			Stamp[v] = ++Misses;
+			return true;
+		}
+
+		uint32_t Triangle(const uint16_t* tri)
+		{
+			return (uint32_t)Access(tri[0]) + (uint32_t)Access(tri[1]) + (uint32_t)Access(tri[2]);
+		}
+	};
+
+	struct Float3
+	{
+		float x = 0.0f, y = 0.0f, z = 0.0f;
+	};
+
+	inline Float3 Sub(const float* a, const float* b) { return { a[0] - b[0], a[1] - b[1], a[2] - b[2] }; }
+	inline Float3 Cross(const Float3& a, const Float3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	struct SubmeshResult
+	{
+		std::vector<CookedVertex> Vertices;
+		std::vector<uint16_t> Indices;
+		VertexCacheStats Before;
+		VertexCacheStats After;
+		uint32_t Clusters = 0;
+		uint32_t Welded = 0;
+		uint32_t Unused = 0;
+	};
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const uint16_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStats stats;
+	stats.Triangles = (uint32_t)(indexCount / 3);
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<char> used(vertexCount, 0);
+	for (size_t i = 0; i < stats.Triangles * 3; ++i)
+	{
+		stats.Transforms += cache.Access(indices[i]) ? 1 : 0;
+		if (!used[indices[i]])
+		{
+			used[indices[i]] = 1;
+			++stats.Vertices;
+		}
+	}
+
+	stats.ACMR = stats.Triangles ? (float)stats.Transforms / stats.Triangles : 0.0f;
+	stats.ATVR = stats.Vertices ? (float)stats.Transforms / stats.Vertices : 0.0f;
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint16_t* indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize, std::vector<uint32_t>* clusters)
+{
+	if (clusters)
+		clusters->clear();
+
+	const size_t triCount = indexCount / 3;
+	if (triCount == 0 || vertexCount == 0)
+		return;
+
+	// Vertex -> triangle adjacency (CSR) and live triangle counts
+	std::vector<uint32_t> live(vertexCount, 0);
+	for (size_t i = 0; i < triCount * 3; ++i)
+		++live[indices[i]];
+
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + live[v];
+
+	std::vector<uint32_t> adjacency(triCount * 3);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t t = 0; t < triCount; ++t)
+			for (int c = 0; c < 3; ++c)
+				adjacency[fill[indices[t * 3 + c]]++] = (uint32_t)t;
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<char> emitted(triCount, 0);
+	std::vector<uint16_t> deadEnd;
+	std::vector<uint16_t> candidates;
+	std::vector<uint16_t> result;
+	deadEnd.reserve(triCount * 3);
+	result.reserve(triCount * 3);
+
+	uint32_t time = cacheSize + 1;
+	size_t cursor = 0;
+	int fanning = indices[0];
+	bool jumped = true;
+
+	while (fanning >= 0)
+	{
+		if (jumped && clusters)
+			clusters->push_back((uint32_t)(result.size() / 3));
+
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t k = offsets[fanning]; k < offsets[fanning + 1]; ++k)
+		{
+			const uint32_t t = adjacency[k];
+			if (emitted[t])
+				continue;
+			emitted[t] = 1;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				const uint16_t v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (time - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = time;
+					++time;
+				}
+			}
+		}
+
+		// Next fanning vertex: the oldest candidate that will still be in the
+		// cache after its remaining triangles are emitted.
+		int best = -1;
+		int bestPriority = -1;
+		for (uint16_t v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = (int)(time - cacheTime[v]);
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+
+		jumped = best < 0;
+		if (jumped)
+		{
+			// Dead end: most recently used vertex with work left, else scan forward
+			while (!deadEnd.empty() && best < 0)
+			{
+				const uint16_t d = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[d] > 0)
+					best = d;
+			}
+			while (best < 0 && cursor < vertexCount)
+			{
+				if (live[cursor] > 0)
+					best = (int)cursor;
+				else
+					++cursor;
+			}
+		}
+		fanning = best;
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint16_t* indices, size_t indexCount, const CookedVertex* vertices, size_t vertexCount,
+	const std::vector<uint32_t>& clusters, uint32_t cacheSize, float threshold, uint32_t* clusterCount)
+{
+	const uint32_t triCount = (uint32_t)(indexCount / 3);
+	if (triCount == 0)
+		return;
+
+	// Split the hard clusters further where the local cache efficiency already
+	// is within threshold of the whole cluster's.
+	std::vector<uint32_t> starts;
+	FifoCache cache(vertexCount, cacheSize);
+	for (size_t h = 0; h < clusters.size(); ++h)
+	{
+		const uint32_t begin = clusters[h];
+		const uint32_t end = h + 1 < clusters.size() ? clusters[h + 1] : triCount;
+		if (begin >= end)
+			continue;
+
+		cache.Reset();
+		uint32_t misses = 0;
+		for (uint32_t t = begin; t < end; ++t)
+			misses += cache.Triangle(indices + t * 3);
+		const float clusterACMR = (float)misses / (end - begin);
+
+		cache.Reset();
+		misses = 0;
+		uint32_t pieceStart = begin;
+		starts.push_back(begin);
+		for (uint32_t t = begin; t < end; ++t)
+		{
+			misses += cache.Triangle(indices + t * 3);
+			if (t + 1 < end && (float)misses / (t + 1 - pieceStart) <= threshold * clusterACMR)
+			{
+				pieceStart = t + 1;
+				starts.push_back(pieceStart);
+				cache.Reset();
+				misses = 0;
+			}
+		}
+	}
+	if (starts.empty() || starts[0] != 0)
+		starts.insert(starts.begin(), 0);
+
+	// Area-weighted centroids and normals
+	Float3 meshCentroid;
+	float meshArea = 0.0f;
+	const size_t count = starts.size();
+	std::vector<Float3> centroids(count), normals(count);
+	for (size_t c = 0; c < count; ++c)
+	{
+		const uint32_t end = c + 1 < count ? starts[c + 1] : triCount;
+		float area = 0.0f;
+		for (uint32_t t = starts[c]; t < end; ++t)
+		{
+			const float* p0 = vertices[indices[t * 3 + 0]].Pos;
+			const float* p1 = vertices[indices[t * 3 + 1]].Pos;
+			const float* p2 = vertices[indices[t * 3 + 2]].Pos;
+			const Float3 n = Cross(Sub(p1, p0), Sub(p2, p0));
+			const float a = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+
+			centroids[c].x += (p0[0] + p1[0] + p2[0]) * a / 3.0f;
+			centroids[c].y += (p0[1] + p1[1] + p2[1]) * a / 3.0f;
+			centroids[c].z += (p0[2] + p1[2] + p2[2]) * a / 3.0f;
+			normals[c].x += n.x;
+			normals[c].y += n.y;
+			normals[c].z += n.z;
+			area += a;
+		}
+
+		meshCentroid.x += centroids[c].x;
+		meshCentroid.y += centroids[c].y;
+		meshCentroid.z += centroids[c].z;
+		meshArea += area;
+
+		const float inv = area > 0.0f ? 1.0f / area : 0.0f;
+		centroids[c].x *= inv;
+		centroids[c].y *= inv;
+		centroids[c].z *= inv;
+	}
+	if (meshArea > 0.0f)
+	{
+		meshCentroid.x /= meshArea;
+		meshCentroid.y /= meshArea;
+		meshCentroid.z /= meshArea;
+	}
+
+	// Clusters facing away from the centre are likely to occlude the rest
+	std::vector<float> keys(count);
+	for (size_t c = 0; c < count; ++c)
+	{
+		const Float3& n = normals[c];
+		const float len = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+		const float dx = centroids[c].x - meshCentroid.x;
+		const float dy = centroids[c].y - meshCentroid.y;
+		const float dz = centroids[c].z - meshCentroid.z;
+		keys[c] = len > 0.0f ? (dx * n.x + dy * n.y + dz * n.z) / len : 0.0f;
+	}
+
+	std::vector<uint32_t> order(count);
+	for (size_t c = 0; c < count; ++c)
+		order[c] = (uint32_t)c;
+	std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint16_t> result;
+	result.reserve(triCount * 3);
+	for (uint32_t c : order)
+	{
+		const uint32_t end = c + 1 < count ? starts[c + 1] : triCount;
+		result.insert(result.end(), indices + starts[c] * 3, indices + end * 3);
+	}
+	std::copy(result.begin(), result.end(), indices);
+
+	if (clusterCount)
+		*clusterCount = (uint32_t)count;
+}
+
+size_t MeshOptimizer::WeldVertices(std::vector<CookedVertex>& vertices, uint16_t* indices, size_t indexCount)
+{
+	// Equal vertices end up next to each other, the first in input order leading
+	std::vector<uint32_t> order(vertices.size());
+	for (size_t v = 0; v < order.size(); ++v)
+		order[v] = (uint32_t)v;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		const int c = memcmp(&vertices[a], &vertices[b], sizeof(CookedVertex));
+		return c < 0 || (c == 0 && a < b);
+	});
+
+	std::vector<uint32_t> leader(vertices.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		const bool same = i > 0 && memcmp(&vertices[order[i]], &vertices[order[i - 1]], sizeof(CookedVertex)) == 0;
+		leader[order[i]] = same ? leader[order[i - 1]] : order[i];
+	}
+
+	std::vector<uint32_t> remap(vertices.size());
+	size_t kept = 0;
+	for (size_t v = 0; v < vertices.size(); ++v)
+	{
+		if (leader[v] == v)
+		{
+			vertices[kept] = vertices[v];
+			remap[v] = (uint32_t)kept++;
+		}
+		else
+		{
+			remap[v] = remap[leader[v]];
+		}
+	}
+	vertices.resize(kept);
+
+	for (size_t i = 0; i < indexCount; ++i)
+		indices[i] = (uint16_t)remap[indices[i]];
+	return kept;
+}
+
+size_t MeshOptimizer::OptimizeVertexFetch(std::vector<CookedVertex>& vertices, uint16_t* indices, size_t indexCount)
+{
+	std::vector<int> remap(vertices.size(), -1);
+	std::vector<CookedVertex> ordered;
+	ordered.reserve(vertices.size());
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		int& r = remap[indices[i]];
+		if (r < 0)
+		{
+			r = (int)ordered.size();
+			ordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = (uint16_t)r;
+	}
+
+	vertices.swap(ordered);
+	return vertices.size();
+}
+
+void MeshOptimizer::Optimize(CookedMesh& mesh, MeshOptimizeStats* stats, unsigned threadCount,
+	uint32_t cacheSize, float overdrawThreshold)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const size_t count = mesh.Submeshes.size();
+	std::vector<SubmeshResult> results(count);
+	auto work = [&](size_t first, size_t last)
+	{
+		for (size_t s = first; s < last; ++s)
+		{
+			const CookedSubmesh& sm = mesh.Submeshes[s];
+			SubmeshResult& r = results[s];
+			r.Vertices.assign(mesh.Vertices.begin() + sm.BaseVertex, mesh.Vertices.begin() + sm.BaseVertex + sm.VertexCount);
+			r.Indices.assign(mesh.Indices.begin() + sm.StartIndex, mesh.Indices.begin() + sm.StartIndex + sm.IndexCount);
+
+			r.Welded = (uint32_t)(r.Vertices.size() - WeldVertices(r.Vertices, r.Indices.data(), r.Indices.size()));
+			const size_t welded = r.Vertices.size();
+			r.Before = AnalyzeVertexCache(r.Indices.data(), r.Indices.size(), r.Vertices.size(), cacheSize);
+
+			std::vector<uint32_t> clusters;
+			OptimizeVertexCache(r.Indices.data(), r.Indices.size(), r.Vertices.size(), cacheSize, &clusters);
+			OptimizeOverdraw(r.Indices.data(), r.Indices.size(), r.Vertices.data(), r.Vertices.size(),
+				clusters, cacheSize, overdrawThreshold, &r.Clusters);
+			r.Unused = (uint32_t)(welded - OptimizeVertexFetch(r.Vertices, r.Indices.data(), r.Indices.size()));
+
+			r.After = AnalyzeVertexCache(r.Indices.data(), r.Indices.size(), r.Vertices.size(), cacheSize);
+		}
+	};
+
+	// One submesh at a time: they differ a lot in size, so idle threads take
+	// the next one
+	if (threadCount == 1)
+		work(0, count);
+	else
+		JobSystem::Get().ParallelFor(count, 1, threadCount, work);
+
+	// Stitch the submeshes back together in their original order
+	MeshOptimizeStats total;
+	mesh.Vertices.clear();
+	mesh.Indices.clear();
+	for (size_t s = 0; s < count; ++s)
+	{
+		CookedSubmesh& sm = mesh.Submeshes[s];
+		SubmeshResult& r = results[s];
+		total.WeldedVertices += r.Welded;
+		total.RemovedVertices += r.Unused;
+		sm.BaseVertex = (uint32_t)mesh.Vertices.size();
+		sm.StartIndex = (uint32_t)mesh.Indices.size();
+		sm.VertexCount = (uint32_t)r.Vertices.size();
+		sm.IndexCount = (uint32_t)r.Indices.size();
+		mesh.Vertices.insert(mesh.Vertices.end(), r.Vertices.begin(), r.Vertices.end());
+		mesh.Indices.insert(mesh.Indices.end(), r.Indices.begin(), r.Indices.end());
+
+		for (VertexCacheStats* dst : { &total.Before, &total.After })
+		{
+			const VertexCacheStats& src = dst == &total.Before ? r.Before : r.After;
+			dst->Triangles += src.Triangles;
+			dst->Vertices += src.Vertices;
+			dst->Transforms += src.Transforms;
+		}
+		total.Clusters += r.Clusters;
+	}
+	mesh.ComputeBounds();
+
+	if (stats)
+	{
+		for (VertexCacheStats* s : { &total.Before, &total.After })
+		{
+			s->ACMR = s->Triangles ? (float)s->Transforms / s->Triangles : 0.0f;
+			s->ATVR = s->Vertices ? (float)s->Transforms / s->Vertices : 0.0f;
+		}
+		total.Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		*stats = total;
+	}
+}
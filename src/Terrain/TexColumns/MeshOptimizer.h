@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "MeshCache.h"
+
+// Cook-time reordering of submesh index/vertex streams:
+//   0. bit-identical vertices are welded (an OBJ import gives every face
+//      corner its own vertex, which leaves the cache nothing to reuse),
+//   1. triangles for post-transform cache locality (Tipsify, Sander et al. 2007),
+//   2. clusters of that order for overdraw (outward-facing clusters first),
+//   3. vertices in first-use order for fetch locality; unused ones are dropped.
+// Works on 16-bit submesh-local indices, no D3D involved.
+
+struct VertexCacheStats
+{
+	uint32_t Triangles = 0;
+	uint32_t Vertices = 0;        // referenced vertices
+	uint32_t Transforms = 0;      // cache misses in a FIFO cache simulation
+	float ACMR = 0.0f;            // transforms per triangle (0.5 is the ideal for big grids, 3 the worst)
+	float ATVR = 0.0f;            // transforms per vertex (1 is ideal)
+};
+
+struct MeshOptimizeStats
+{
+	VertexCacheStats Before;
+	VertexCacheStats After;
+	uint32_t Clusters = 0;
+	uint32_t WeldedVertices = 0;  // duplicates merged before Before was measured
+	uint32_t RemovedVertices = 0; // unused after welding
+	double Milliseconds = 0.0;
+};
+
+class MeshOptimizer
+{
+public:
+	static const uint32_t DefaultCacheSize = 16;
+
+	static VertexCacheStats AnalyzeVertexCache(const uint16_t* indices, size_t indexCount, size_t vertexCount,
+		uint32_t cacheSize = DefaultCacheSize);
+
+	// Reorders triangles in place. clusters receives the first triangle of every
+	// run that starts on a cache "dead end", i.e. where the order may be
+	// rearranged without hurting cache efficiency much.
+	static void OptimizeVertexCache(uint16_t* indices, size_t indexCount, size_t vertexCount,
+		uint32_t cacheSize, std::vector<uint32_t>* clusters);
+
+	// Reorders the clusters found by OptimizeVertexCache so that clusters
+	// facing away from the mesh centre are drawn first. threshold bounds how
+	// much the cache efficiency of a cluster may suffer when it is split further.
+	static void OptimizeOverdraw(uint16_t* indices, size_t indexCount, const CookedVertex* vertices, size_t vertexCount,
+		const std::vector<uint32_t>& clusters, uint32_t cacheSize, float threshold, uint32_t* clusterCount = nullptr);
+
+	// Merges vertices whose attributes are bit-identical, keeping the first of
+	// each in input order, and rewrites indices. Returns the new vertex count.
+	static size_t WeldVertices(std::vector<CookedVertex>& vertices, uint16_t* indices, size_t indexCount);
+
+	// Renumbers vertices in first-use order. Returns the new vertex count;
+	// vertices no triangle refers to are removed.
+	static size_t OptimizeVertexFetch(std::vector<CookedVertex>& vertices, uint16_t* indices, size_t indexCount);
+
+	// Weld and all three passes over every submesh, on at most threadCount JobSystem
+	// threads, the caller among them (0 = all of them, 1 = only the caller). Rebuilds
+	// the mesh streams and offsets.
+	static void Optimize(CookedMesh& mesh, MeshOptimizeStats* stats = nullptr, unsigned threadCount = 0,
+		uint32_t cacheSize = DefaultCacheSize, float overdrawThreshold = 1.05f);
+};
@@ -0,0 +1,422 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "../../Common/JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+	enum VertexKind : uint8_t
+	{
+		Manifold,   // free to collapse anywhere
+		Border,     // on an open edge; collapses along it only
+		Locked,     // seam, corner or non-manifold; never moves
+	};
+
+	struct Quadric
+	{
+		// Symmetric 4x4: a2 ab ac ad / b2 bc bd / c2 cd / d2
+		double a2 = 0, ab = 0, ac = 0, ad = 0;
+		double b2 = 0, bc = 0, bd = 0;
+		double c2 = 0, cd = 0;
+		double d2 = 0;
+		double w = 0;
+
+		void AddPlane(double a, double b, double c, double d, double weight)
+		{
+			a2 += a * a * weight; ab += a * b * weight; ac += a * c * weight; ad += a * d * weight;
+			b2 += b * b * weight; bc += b * c * weight; bd += b * d * weight;
+			c2 += c * c * weight; cd += c * d * weight;
+			d2 += d * d * weight;
+			w += weight;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+			w += q.w;
+		}
+
+		// Weighted squared distance of p to the accumulated planes
+		double Error(const float* p) const
+		{
+			const double x = p[0], y = p[1], z = p[2];
+			const double e =
+				x * x * a2 + y * y * b2 + z * z * c2 +
+				2.0 * (x * y * ab + x * z * ac + y * z * bc) +
+				2.0 * (x * ad + y * bd + z * cd) + d2;
+			return std::fabs(e);
+		}
+	};
+
+	struct Collapse
+	{
+		uint16_t From;
+		uint16_t To;
+		float Cost;
+	};
+
+	inline uint64_t EdgeKey(uint32_t a, uint32_t b) { return ((uint64_t)a << 32) | b; }
+
+	inline void TriangleNormal(const float* p0, const float* p1, const float* p2, double* n)
+	{
+		const double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+		const double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+}
+
+float MeshSimplifier::Simplify(const CookedVertex* vertices, size_t vertexCount,
+	const uint16_t* indices, size_t indexCount,
+	size_t targetIndexCount, float maxError, std::vector<uint16_t>& result)
+{
+	result.assign(indices, indices + indexCount - indexCount % 3);
+	if (result.size() <= targetIndexCount || vertexCount == 0)
+		return 0.0f;
+
+	// Scale errors to the mesh extents
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint16_t i : result)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			lo[c] = std::min(lo[c], vertices[i].Pos[c]);
+			hi[c] = std::max(hi[c], vertices[i].Pos[c]);
+		}
+	}
+	const double extent = std::sqrt((double)(hi[0] - lo[0]) * (hi[0] - lo[0]) +
+		(double)(hi[1] - lo[1]) * (hi[1] - lo[1]) + (double)(hi[2] - lo[2]) * (hi[2] - lo[2]));
+	if (extent <= 0.0)
+		return 0.0f;
+	const double maxCost = (double)maxError * maxError * extent * extent;
+
+	// Copies of one vertex (an unwelded import) become one, so they collapse
+	// together; the result indexes the first of them
+	{
+		std::unordered_map<std::string, uint16_t> firstCopy;
+		firstCopy.reserve(vertexCount);
+		std::vector<uint16_t> canonical(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			const std::string key(reinterpret_cast<const char*>(&vertices[v]), sizeof(CookedVertex));
+			canonical[v] = firstCopy.emplace(key, (uint16_t)v).first->second;
+		}
+		for (uint16_t& i : result)
+			i = canonical[i];
+	}
+
+	// Weld by position: the vertices left sharing one differ in normal, UV or
+	// tangent, i.e. they are a seam, and stay where they are
+	std::vector<uint32_t> position(vertexCount);
+	std::vector<uint8_t> kind(vertexCount, Manifold);
+	{
+		std::vector<uint8_t> used(vertexCount, 0);
+		for (uint16_t i : result)
+			used[i] = 1;
+
+		std::unordered_map<std::string, uint32_t> firstWithPosition;
+		firstWithPosition.reserve(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			position[v] = (uint32_t)v;
+			if (!used[v])
+				continue;
+			const std::string key(reinterpret_cast<const char*>(vertices[v].Pos), sizeof(vertices[v].Pos));
+			auto it = firstWithPosition.emplace(key, (uint32_t)v).first;
+			position[v] = it->second;
+			if (it->second != v)
+			{
+				kind[v] = Locked;
+				kind[it->second] = Locked;
+			}
+		}
+	}
+
+	// Half-edges in position space: open ones are borders, repeated ones non-manifold
+	std::unordered_map<uint64_t, uint32_t> halfEdges;
+	halfEdges.reserve(result.size());
+	for (size_t t = 0; t < result.size(); t += 3)
+		for (int e = 0; e < 3; ++e)
+			++halfEdges[EdgeKey(position[result[t + e]], position[result[t + (e + 1) % 3]])];
+
+	auto isBorderEdge = [&](uint32_t a, uint32_t b)
+	{
+		return halfEdges.count(EdgeKey(position[a], position[b])) != halfEdges.count(EdgeKey(position[b], position[a]));
+	};
+
+	std::vector<uint8_t> borderEdges(vertexCount, 0);
+	for (const auto& he : halfEdges)
+	{
+		const uint32_t a = (uint32_t)(he.first >> 32), b = (uint32_t)he.first;
+		if (he.second > 1 || halfEdges.count(EdgeKey(b, a)) == 0)
+		{
+			// Count open edges per end; repeated half-edges lock both ends
+			if (he.second > 1)
+			{
+				borderEdges[a] = borderEdges[b] = 0xFF;
+				continue;
+			}
+			if (borderEdges[a] != 0xFF) ++borderEdges[a];
+			if (borderEdges[b] != 0xFF) ++borderEdges[b];
+		}
+	}
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const uint8_t edges = borderEdges[position[v]];
+		if (kind[v] == Locked || edges == 0)
+			continue;
+		// A simple border vertex has exactly one open edge in and one out
+		kind[v] = edges == 2 ? Border : Locked;
+	}
+
+	// Plane quadrics from the faces, plus perpendicular planes along borders
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t t = 0; t < result.size(); t += 3)
+	{
+		const uint16_t i[3] = { result[t], result[t + 1], result[t + 2] };
+		const float* p[3] = { vertices[i[0]].Pos, vertices[i[1]].Pos, vertices[i[2]].Pos };
+
+		double n[3];
+		TriangleNormal(p[0], p[1], p[2], n);
+		const double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len <= 0.0)
+			continue;
+		n[0] /= len; n[1] /= len; n[2] /= len;
+		const double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+		for (int c = 0; c < 3; ++c)
+			quadrics[i[c]].AddPlane(n[0], n[1], n[2], d, len * 0.5);
+
+		for (int e = 0; e < 3; ++e)
+		{
+			const uint16_t a = i[e], b = i[(e + 1) % 3];
+			if (!isBorderEdge(a, b))
+				continue;
+
+			const double edge[3] = { (double)p[(e + 1) % 3][0] - p[e][0], (double)p[(e + 1) % 3][1] - p[e][1], (double)p[(e + 1) % 3][2] - p[e][2] };
+			double bn[3] = { edge[1] * n[2] - edge[2] * n[1], edge[2] * n[0] - edge[0] * n[2], edge[0] * n[1] - edge[1] * n[0] };
+			const double blen = std::sqrt(bn[0] * bn[0] + bn[1] * bn[1] + bn[2] * bn[2]);
+			if (blen <= 0.0)
+				continue;
+			bn[0] /= blen; bn[1] /= blen; bn[2] /= blen;
+			const double bd = -(bn[0] * p[e][0] + bn[1] * p[e][1] + bn[2] * p[e][2]);
+			const double weight = (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]) * 10.0;
+			quadrics[a].AddPlane(bn[0], bn[1], bn[2], bd, weight);
+			quadrics[b].AddPlane(bn[0], bn[1], bn[2], bd, weight);
+		}
+	}
+
+	auto collapseCost = [&](uint16_t from, uint16_t to)
+	{
+		Quadric q = quadrics[from];
+		q.Add(quadrics[to]);
+		return q.w > 0.0 ? q.Error(vertices[to].Pos) / q.w : 0.0;
+	};
+
+	auto canCollapse = [&](uint16_t from, uint16_t to)
+	{
+		if (kind[from] == Manifold)
+			return true;
+		if (kind[from] == Border)
+			return isBorderEdge(from, to);
+		return false;
+	};
+
+	std::vector<uint32_t> adjOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<uint8_t> touched(vertexCount);
+	std::vector<Collapse> collapses;
+	double errorReached = 0.0;
+
+	size_t liveIndices = result.size();
+	while (liveIndices > targetIndexCount)
+	{
+		// Vertex -> triangle adjacency for this pass
+		std::fill(adjOffsets.begin(), adjOffsets.end(), 0);
+		for (uint16_t i : result)
+			++adjOffsets[i + 1];
+		for (size_t v = 0; v < vertexCount; ++v)
+			adjOffsets[v + 1] += adjOffsets[v];
+		adjacency.resize(result.size());
+		{
+			std::vector<uint32_t> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+			for (size_t t = 0; t < result.size(); t += 3)
+				for (int c = 0; c < 3; ++c)
+					adjacency[fill[result[t + c]]++] = (uint32_t)(t / 3);
+		}
+
+		// Cheapest valid direction of every edge
+		collapses.clear();
+		for (size_t t = 0; t < result.size(); t += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				const uint16_t a = result[t + e], b = result[t + (e + 1) % 3];
+				const bool ab = canCollapse(a, b), ba = canCollapse(b, a);
+				if (!ab && !ba)
+					continue;
+				const double costAB = ab ? collapseCost(a, b) : DBL_MAX;
+				const double costBA = ba ? collapseCost(b, a) : DBL_MAX;
+				if (costAB <= costBA)
+					collapses.push_back({ a, b, (float)costAB });
+				else
+					collapses.push_back({ b, a, (float)costBA });
+			}
+		}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y)
+		{
+			return x.Cost < y.Cost || (x.Cost == y.Cost && (x.From < y.From || (x.From == y.From && x.To < y.To)));
+		});
+
+		std::fill(touched.begin(), touched.end(), 0);
+		size_t applied = 0;
+		for (const Collapse& c : collapses)
+		{
+			if (liveIndices <= targetIndexCount || c.Cost > maxCost)
+				break;
+			if (touched[c.From] || touched[c.To])
+				continue;
+
+			// Reject collapses that flip or fold a remaining triangle
+			bool flips = false;
+			size_t removed = 0;
+			for (uint32_t k = adjOffsets[c.From]; k < adjOffsets[c.From + 1] && !flips; ++k)
+			{
+				const uint16_t* tri = &result[adjacency[k] * 3];
+				if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+					continue;
+				if (tri[0] == c.To || tri[1] == c.To || tri[2] == c.To)
+				{
+					++removed;
+					continue;
+				}
+
+				const float* before[3] = { vertices[tri[0]].Pos, vertices[tri[1]].Pos, vertices[tri[2]].Pos };
+				const float* after[3] = { before[0], before[1], before[2] };
+				for (int v = 0; v < 3; ++v)
+					if (tri[v] == c.From)
+						after[v] = vertices[c.To].Pos;
+
+				double n0[3], n1[3];
+				TriangleNormal(before[0], before[1], before[2], n0);
+				TriangleNormal(after[0], after[1], after[2], n1);
+				const double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+				const double l0 = std::sqrt(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+				const double l1 = std::sqrt(n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]);
+				flips = dot < 0.25 * l0 * l1;
+			}
+			if (flips || removed == 0)
+				continue;
+
+			// Move every triangle of From onto To; keep the neighbourhood
+			// still for the rest of the pass so the sorted costs stay valid.
+			for (uint32_t k = adjOffsets[c.From]; k < adjOffsets[c.From + 1]; ++k)
+			{
+				uint16_t* tri = &result[adjacency[k] * 3];
+				for (int v = 0; v < 3; ++v)
+				{
+					touched[tri[v]] = 1;
+					if (tri[v] == c.From)
+						tri[v] = c.To;
+				}
+			}
+			quadrics[c.To].Add(quadrics[c.From]);
+			touched[c.To] = 1;
+			liveIndices -= removed * 3;
+			errorReached = std::max(errorReached, (double)c.Cost);
+			++applied;
+		}
+
+		// Drop triangles that collapsed to a line
+		size_t write = 0;
+		for (size_t t = 0; t < result.size(); t += 3)
+		{
+			if (result[t] == result[t + 1] || result[t + 1] == result[t + 2] || result[t] == result[t + 2])
+				continue;
+			std::memmove(&result[write], &result[t], 3 * sizeof(uint16_t));
+			write += 3;
+		}
+		result.resize(write);
+		liveIndices = write;
+
+		if (applied == 0)
+			break;
+	}
+
+	return (float)(std::sqrt(errorReached) / extent);
+}
+
+void MeshSimplifier::GenerateLods(CookedMesh& mesh, const std::vector<float>& ratios, float maxError, unsigned threadCount)
+{
+	struct SubmeshLods
+	{
+		std::vector<std::vector<uint16_t>> Indices;
+		std::vector<float> Errors;
+	};
+
+	const size_t count = mesh.Submeshes.size();
+	std::vector<SubmeshLods> results(count);
+	auto work = [&](size_t first, size_t last)
+	{
+		for (size_t s = first; s < last; ++s)
+		{
+			const CookedSubmesh& sm = mesh.Submeshes[s];
+			const CookedVertex* vertices = mesh.Vertices.data() + sm.BaseVertex;
+			std::vector<uint16_t> previous(mesh.Indices.begin() + sm.StartIndex, mesh.Indices.begin() + sm.StartIndex + sm.IndexCount);
+			float error = 0.0f;
+
+			for (float ratio : ratios)
+			{
+				const size_t target = std::max<size_t>(3, (size_t)(sm.IndexCount / 3 * ratio) * 3);
+				std::vector<uint16_t> lod;
+				// Errors of the cascade add up at worst
+				error += Simplify(vertices, sm.VertexCount, previous.data(), previous.size(), target, maxError - error, lod);
+
+				// Not worth a level of its own
+				if (lod.empty() || lod.size() > previous.size() * 9 / 10)
+					break;
+
+				MeshOptimizer::OptimizeVertexCache(lod.data(), lod.size(), sm.VertexCount, MeshOptimizer::DefaultCacheSize, nullptr);
+				results[s].Indices.push_back(lod);
+				results[s].Errors.push_back(error);
+				previous.swap(lod);
+				if (error >= maxError)
+					break;
+			}
+		}
+	};
+
+	// One submesh at a time: they differ a lot in size, so idle threads take
+	// the next one
+	if (threadCount == 1)
+		work(0, count);
+	else
+		JobSystem::Get().ParallelFor(count, 1, threadCount, work);
+
+	mesh.Lods.clear();
+	for (size_t s = 0; s < count; ++s)
+	{
+		for (size_t l = 0; l < results[s].Indices.size(); ++l)
+		{
+			CookedLod lod;
+			lod.Submesh = (uint32_t)s;
+			lod.Level = (uint32_t)l + 1;
+			lod.StartIndex = (uint32_t)mesh.Indices.size();
+			lod.IndexCount = (uint32_t)results[s].Indices[l].size();
+			lod.Error = results[s].Errors[l];
+			mesh.Indices.insert(mesh.Indices.end(), results[s].Indices[l].begin(), results[s].Indices[l].end());
+			mesh.Lods.push_back(lod);
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "MeshCache.h"
+
+// Quadric error metric simplification (Garland & Heckbert) restricted to the
+// existing vertices, so every LOD indexes the same vertex range as LOD 0 and
+// only needs its own index list in the shared buffer.
+//
+// Exact copies of a vertex count as one. Vertices that share a position but
+// differ in normal/UV/tangent (seams) and non-manifold vertices are never
+// moved; open borders only collapse along themselves. That keeps UV and
+// normal seams and silhouettes intact.
+class MeshSimplifier
+{
+public:
+	// Simplifies a 16-bit triangle list towards targetIndexCount, stopping early
+	// once the next collapse would exceed maxError (relative to the mesh
+	// extents). Returns the error reached, in the same relative units.
+	static float Simplify(const CookedVertex* vertices, size_t vertexCount,
+		const uint16_t* indices, size_t indexCount,
+		size_t targetIndexCount, float maxError, std::vector<uint16_t>& result);
+
+	// Appends LODs for every submesh at the given triangle ratios (e.g. 0.5,
+	// 0.25, ...), each simplified from the previous one. LOD index lists go
+	// after the existing indices; levels that would not save enough are
+	// skipped. Submeshes run on at most threadCount JobSystem threads, the
+	// caller among them (0 = all of them, 1 = only the caller).
+	static void GenerateLods(CookedMesh& mesh, const std::vector<float>& ratios,
+		float maxError = 0.05f, unsigned threadCount = 0);
+};
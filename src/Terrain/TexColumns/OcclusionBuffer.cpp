@@ -0,0 +1,316 @@
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCC_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define OCC_USE_SSE2 0
+#endif
+
+namespace
+{
+	enum : uint32_t
+	{
+		ClipLeft = 1,
+		ClipRight = 2,
+		ClipBottom = 4,
+		ClipTop = 8,
+		ClipNear = 16,
+		ClipFar = 32,
+	};
+
+	uint32_t OutCode(const float* v)
+	{
+		uint32_t code = 0;
+		if (v[0] < -v[3]) code |= ClipLeft;
+		if (v[0] > v[3]) code |= ClipRight;
+		if (v[1] < -v[3]) code |= ClipBottom;
+		if (v[1] > v[3]) code |= ClipTop;
+		if (v[2] < 0.0f) code |= ClipNear;
+		if (v[2] > v[3]) code |= ClipFar;
+		return code;
+	}
+
+	void Transform(const float m[4][4], const float* p, float* out)
+	{
+		for (int c = 0; c < 4; ++c)
+			out[c] = p[0] * m[0][c] + p[1] * m[1][c] + p[2] * m[2][c] + m[3][c];
+	}
+}
+
+void OcclusionBuffer::Resize(uint32_t width, uint32_t height)
+{
+	mWidth = (std::max(width, 4u) + 3) & ~3u;
+	mHeight = std::max(height, 1u);
+
+	mHiZ.clear();
+	uint32_t w = mWidth, h = mHeight;
+	for (;;)
+	{
+		mHiZ.push_back({ w, h, std::vector<float>((size_t)w * h, 1.0f) });
+		if (w == 1 && h == 1)
+			break;
+		w = std::max(1u, (w + 1) / 2);
+		h = std::max(1u, (h + 1) / 2);
+	}
+}
+
+void OcclusionBuffer::Begin(const float viewProj[4][4])
+{
+	for (int r = 0; r < 4; ++r)
+		for (int c = 0; c < 4; ++c)
+			mViewProj[r][c] = viewProj[r][c];
+	std::fill(mHiZ[0].Depth.begin(), mHiZ[0].Depth.end(), 1.0f);
+	mStats = OcclusionStats();
+}
+
+OcclusionBuffer::ScreenVertex OcclusionBuffer::ToScreen(const float* clip) const
+{
+	const float invW = 1.0f / clip[3];
+	ScreenVertex v;
+	v.X = (clip[0] * invW * 0.5f + 0.5f) * mWidth;
+	v.Y = (0.5f - clip[1] * invW * 0.5f) * mHeight;
+	v.Z = clip[2] * invW;
+	return v;
+}
+
+void OcclusionBuffer::RenderOccluder(const float* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount)
+{
+	mClip.resize((size_t)vertexCount * 4);
+	for (uint32_t i = 0; i < vertexCount; ++i)
+		Transform(mViewProj, positions + i * 3, &mClip[i * 4]);
+
+	++mStats.Occluders;
+	for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		++mStats.Triangles;
+		DrawTriangle(&mClip[indices[i] * 4], &mClip[indices[i + 1] * 4], &mClip[indices[i + 2] * 4]);
+	}
+}
+
+void OcclusionBuffer::DrawTriangle(const float* a, const float* b, const float* c)
+{
+	const uint32_t ca = OutCode(a), cb = OutCode(b), cc = OutCode(c);
+	if (ca & cb & cc)
+		return;
+	++mStats.TrianglesDrawn;
+
+	if (!((ca | cb | cc) & ClipNear))
+	{
+		RasterizeTriangle(ToScreen(a), ToScreen(b), ToScreen(c));
+		return;
+	}
+
+	// Clip against z >= 0; a triangle becomes at most a quad. The other
+	// planes are left to the screen bounds of the rasterizer.
+	float poly[4][4];
+	int count = 0;
+	const float* in[3] = { a, b, c };
+	for (int i = 0; i < 3; ++i)
+	{
+		const float* p = in[i];
+		const float* q = in[(i + 1) % 3];
+		if (p[2] >= 0.0f)
+		{
+			for (int k = 0; k < 4; ++k)
+				poly[count][k] = p[k];
+			++count;
+		}
+		if ((p[2] >= 0.0f) != (q[2] >= 0.0f))
+		{
+			const float t = p[2] / (p[2] - q[2]);
+			for (int k = 0; k < 4; ++k)
+				poly[count][k] = p[k] + (q[k] - p[k]) * t;
+			++count;
+		}
+	}
+	if (count < 3)
+		return;
+
+	const ScreenVertex v0 = ToScreen(poly[0]);
+	ScreenVertex prev = ToScreen(poly[1]);
+	for (int i = 2; i < count; ++i)
+	{
+		const ScreenVertex next = ToScreen(poly[i]);
+		RasterizeTriangle(v0, prev, next);
+		prev = next;
+	}
+}
+
+void OcclusionBuffer::RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1In, const ScreenVertex& v2In)
+{
+	ScreenVertex v1 = v1In, v2 = v2In;
+	float area = (v1.X - v0.X) * (v2.Y - v0.Y) - (v2.X - v0.X) * (v1.Y - v0.Y);
+	if (!(std::fabs(area) > 1e-8f))
+		return;
+	// Both windings occlude; make it counter-clockwise in screen space
+	if (area < 0.0f)
+	{
+		std::swap(v1, v2);
+		area = -area;
+	}
+
+	// Pixels whose centre lies inside the bounds
+	const float minX = std::min(v0.X, std::min(v1.X, v2.X));
+	const float maxX = std::max(v0.X, std::max(v1.X, v2.X));
+	const float minY = std::min(v0.Y, std::min(v1.Y, v2.Y));
+	const float maxY = std::max(v0.Y, std::max(v1.Y, v2.Y));
+	const int x0 = std::max(0, (int)std::ceil(std::max(minX, -1.0f) - 0.5f));
+	const int x1 = std::min((int)mWidth - 1, (int)std::floor(std::min(maxX, (float)mWidth + 1.0f) - 0.5f));
+	const int y0 = std::max(0, (int)std::ceil(std::max(minY, -1.0f) - 0.5f));
+	const int y1 = std::min((int)mHeight - 1, (int)std::floor(std::min(maxY, (float)mHeight + 1.0f) - 0.5f));
+	if (x0 > x1 || y0 > y1)
+		return;
+
+	// Edge functions E(x, y) = A x + B y + C, non-negative inside; E12, E20
+	// and E01 over the area are the barycentrics of v0, v1 and v2.
+	const float A0 = v1.Y - v2.Y, B0 = v2.X - v1.X, C0 = -(A0 * v1.X + B0 * v1.Y);
+	const float A1 = v2.Y - v0.Y, B1 = v0.X - v2.X, C1 = -(A1 * v2.X + B1 * v2.Y);
+	const float A2 = v0.Y - v1.Y, B2 = v1.X - v0.X, C2 = -(A2 * v0.X + B2 * v0.Y);
+
+	const float invArea = 1.0f / area;
+	const float zA = (A0 * v0.Z + A1 * v1.Z + A2 * v2.Z) * invArea;
+	const float zB = (B0 * v0.Z + B1 * v1.Z + B2 * v2.Z) * invArea;
+	const float zC = (C0 * v0.Z + C1 * v1.Z + C2 * v2.Z) * invArea;
+
+	float* depth = mHiZ[0].Depth.data();
+
+#if OCC_USE_SSE2
+	if (mUseSimd)
+	{
+		// Columns start on a multiple of 4 so rows load and store aligned
+		// groups; the width is a multiple of 4, so the last group is in range.
+		// The edge functions and depth are evaluated per group in the same
+		// order as the scalar loop below rather than stepped by 4 A, so both
+		// paths cover the same pixels with the same depth; stepping lets the
+		// rounding drift and flips pixel centres lying on an edge.
+		const int xStart = x0 & ~3;
+		const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 four = _mm_set1_ps(4.0f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 a0 = _mm_set1_ps(A0), a1 = _mm_set1_ps(A1), a2 = _mm_set1_ps(A2), az = _mm_set1_ps(zA);
+		const __m128 c0 = _mm_set1_ps(C0), c1 = _mm_set1_ps(C1), c2 = _mm_set1_ps(C2), cz = _mm_set1_ps(zC);
+
+		for (int y = y0; y <= y1; ++y)
+		{
+			const float py = y + 0.5f;
+			const __m128 b0 = _mm_set1_ps(B0 * py), b1 = _mm_set1_ps(B1 * py), b2 = _mm_set1_ps(B2 * py), bz = _mm_set1_ps(zB * py);
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)xStart), lane);
+
+			float* row = depth + (size_t)y * mWidth;
+			for (int x = xStart; x <= x1; x += 4)
+			{
+				const __m128 e0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, px), b0), c0);
+				const __m128 e1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a1, px), b1), c1);
+				const __m128 e2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a2, px), b2), c2);
+				const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+				if (_mm_movemask_ps(inside))
+				{
+					const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(az, px), bz), cz);
+					const __m128 old = _mm_loadu_ps(row + x);
+					const __m128 nearer = _mm_min_ps(old, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+				}
+				px = _mm_add_ps(px, four);
+			}
+		}
+		return;
+	}
+#endif
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		const float py = y + 0.5f;
+		float* row = depth + (size_t)y * mWidth;
+		for (int x = x0; x <= x1; ++x)
+		{
+			const float px = x + 0.5f;
+			if (A0 * px + B0 * py + C0 >= 0.0f && A1 * px + B1 * py + C1 >= 0.0f && A2 * px + B2 * py + C2 >= 0.0f)
+				row[x] = std::min(row[x], zA * px + zB * py + zC);
+		}
+	}
+}
+
+void OcclusionBuffer::Finish()
+{
+	for (size_t l = 1; l < mHiZ.size(); ++l)
+	{
+		const Level& src = mHiZ[l - 1];
+		Level& dst = mHiZ[l];
+		for (uint32_t y = 0; y < dst.Height; ++y)
+		{
+			const uint32_t sy0 = std::min(2 * y, src.Height - 1), sy1 = std::min(2 * y + 1, src.Height - 1);
+			for (uint32_t x = 0; x < dst.Width; ++x)
+			{
+				const uint32_t sx0 = std::min(2 * x, src.Width - 1), sx1 = std::min(2 * x + 1, src.Width - 1);
+				const float* r0 = &src.Depth[(size_t)sy0 * src.Width];
+				const float* r1 = &src.Depth[(size_t)sy1 * src.Width];
+				dst.Depth[(size_t)y * dst.Width + x] = std::max(std::max(r0[sx0], r0[sx1]), std::max(r1[sx0], r1[sx1]));
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::IsOccluded(const Aabb& box) const
+{
+	float minX = 0.0f, maxX = 0.0f, minY = 0.0f, maxY = 0.0f, minZ = 0.0f;
+	for (int i = 0; i < 8; ++i)
+	{
+		const float p[3] = {
+			(i & 1) ? box.Max[0] : box.Min[0],
+			(i & 2) ? box.Max[1] : box.Min[1],
+			(i & 4) ? box.Max[2] : box.Min[2],
+		};
+		float clip[4];
+		Transform(mViewProj, p, clip);
+		if (clip[2] < 0.0f || clip[3] <= 0.0f)
+			return false;
+
+		const ScreenVertex v = ToScreen(clip);
+		if (i == 0)
+		{
+			minX = maxX = v.X;
+			minY = maxY = v.Y;
+			minZ = v.Z;
+		}
+		else
+		{
+			minX = std::min(minX, v.X);
+			maxX = std::max(maxX, v.X);
+			minY = std::min(minY, v.Y);
+			maxY = std::max(maxY, v.Y);
+			minZ = std::min(minZ, v.Z);
+		}
+	}
+
+	if (maxX < 0.0f || maxY < 0.0f || minX >= (float)mWidth || minY >= (float)mHeight || minZ > 1.0f)
+		return false;
+
+	// Every pixel the rectangle touches
+	int x0 = std::max(0, (int)minX), x1 = std::min((int)mWidth - 1, (int)maxX);
+	int y0 = std::max(0, (int)minY), y1 = std::min((int)mHeight - 1, (int)maxY);
+
+	// Coarsest level where that is at most 4x4 texels
+	size_t level = 0;
+	while (level + 1 < mHiZ.size() && ((x1 - x0) > 3 || (y1 - y0) > 3))
+	{
+		++level;
+		x0 >>= 1; x1 >>= 1;
+		y0 >>= 1; y1 >>= 1;
+	}
+
+	const Level& hiz = mHiZ[level];
+	for (int y = y0; y <= y1; ++y)
+	{
+		const float* row = &hiz.Depth[(size_t)y * hiz.Width];
+		for (int x = x0; x <= x1; ++x)
+		{
+			if (row[x] >= minZ)
+				return false;
+		}
+	}
+	return true;
+}
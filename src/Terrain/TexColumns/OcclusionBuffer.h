@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "CullingShapes.h"
+
+// Software occlusion culling. Occluders (coarse, conservative meshes) are
+// rasterized on the CPU into a small depth buffer, four pixels at a time with
+// SSE2 when available; a max-depth pyramid (Hi-Z) is built from it, and
+// bounding boxes are tested against the pyramid level at which their screen
+// rectangle covers a few texels.
+//
+// Depth follows D3D: 0 at the near plane, 1 at the far plane, the buffer
+// keeps the nearest occluder per pixel. Pixels are covered when their centre
+// is inside a triangle.
+
+struct OcclusionStats
+{
+	uint32_t Occluders = 0;
+	uint32_t Triangles = 0;          // submitted
+	uint32_t TrianglesDrawn = 0;     // survived clipping and culling
+};
+
+class OcclusionBuffer
+{
+public:
+	explicit OcclusionBuffer(uint32_t width = 256, uint32_t height = 144) { Resize(width, height); }
+
+	// width is rounded up to a multiple of 4.
+	void Resize(uint32_t width, uint32_t height);
+
+	// Clears the depth buffer. Same matrix convention as
+	// FrustumPlanes::FromViewProj.
+	void Begin(const float viewProj[4][4]);
+	// World-space triangles, xyz per vertex.
+	void RenderOccluder(const float* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+	// Builds the Hi-Z pyramid; call before testing.
+	void Finish();
+
+	// True only when the box is certainly hidden behind the occluders.
+	// Boxes crossing the near plane or off screen are never occluded.
+	bool IsOccluded(const Aabb& box) const;
+
+	void SetUseSimd(bool enable) { mUseSimd = enable; }
+	uint32_t GetWidth() const { return mWidth; }
+	uint32_t GetHeight() const { return mHeight; }
+	float GetDepth(uint32_t x, uint32_t y) const { return mHiZ[0].Depth[(size_t)y * mWidth + x]; }
+	const OcclusionStats& GetStats() const { return mStats; }
+
+private:
+	struct ScreenVertex
+	{
+		float X, Y, Z;
+	};
+
+	void DrawTriangle(const float* a, const float* b, const float* c);
+	void RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2);
+	ScreenVertex ToScreen(const float* clip) const;
+
+private:
+	uint32_t mWidth = 0;
+	uint32_t mHeight = 0;
+	float mViewProj[4][4] = {};
+	bool mUseSimd = true;
+
+	// Level 0 is the depth buffer, each next level keeps the farthest of 2x2
+	struct Level
+	{
+		uint32_t Width, Height;
+		std::vector<float> Depth;
+	};
+	std::vector<Level> mHiZ;
+
+	std::vector<float> mClip;        // scratch: clip-space xyzw per vertex
+	OcclusionStats mStats;
+};
@@ -0,0 +1,284 @@
+#include "PaintLayer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	inline float Saturate(float v) { return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v); }
+
+	inline float SmoothStep01(float t)
+	{
+		t = Saturate(t);
+		return t * t * (3.0f - 2.0f * t);
+	}
+
+	inline float UnpackChannel(uint32_t texel, int channel)
+	{
+		return (float)((texel >> (channel * 8)) & 0xFF) * (1.0f / 255.0f);
+	}
+
+	inline uint32_t PackChannel(float v, int channel)
+	{
+		return (uint32_t)(Saturate(v) * 255.0f + 0.5f) << (channel * 8);
+	}
+}
+
+void PaintRect::Merge(const PaintRect& rhs)
+{
+	if (rhs.Empty())
+		return;
+	if (Empty())
+	{
+		*this = rhs;
+		return;
+	}
+	X0 = std::min(X0, rhs.X0);
+	Y0 = std::min(Y0, rhs.Y0);
+	X1 = std::max(X1, rhs.X1);
+	Y1 = std::max(Y1, rhs.Y1);
+}
+
+PaintLayer::PaintLayer(int width, int height, int tileSize)
+	: mWidth(width), mHeight(height), mTileSize(tileSize)
+{
+	mTilesX = (width + tileSize - 1) / tileSize;
+	mTilesY = (height + tileSize - 1) / tileSize;
+
+	// Every tile starts out pointing at the same blank block.
+	mBlankTile = std::make_shared<TileTexels>();
+	mBlankTile->Texels.assign((size_t)tileSize * tileSize, 0u);
+	mBlankPacked = Compress(mBlankTile->Texels.data(), mBlankTile->Texels.size());
+
+	mTiles.assign((size_t)mTilesX * mTilesY, mBlankTile);
+	mPacked.assign((size_t)mTilesX * mTilesY, mBlankPacked);
+}
+
+PaintRect PaintLayer::GetStampRect(const BrushStamp& stamp) const
+{
+	const float reach = stamp.RadiusUV + stamp.FalloffUV;
+
+	PaintRect r;
+	r.X0 = std::max(0, (int)std::floor((stamp.U - reach) * mWidth));
+	r.Y0 = std::max(0, (int)std::floor((stamp.V - reach) * mHeight));
+	r.X1 = std::min(mWidth, (int)std::ceil((stamp.U + reach) * mWidth) + 1);
+	r.Y1 = std::min(mHeight, (int)std::ceil((stamp.V + reach) * mHeight) + 1);
+	if (r.Empty())
+		r = PaintRect();
+	return r;
+}
+
+PaintRect PaintLayer::Stamp(const BrushStamp& stamp)
+{
+	PaintRect rect = GetStampRect(stamp);
+	if (rect.Empty())
+		return rect;
+
+	const float reach = stamp.RadiusUV + stamp.FalloffUV;
+
+	for (int ty = rect.Y0 / mTileSize; ty <= (rect.Y1 - 1) / mTileSize; ++ty)
+	{
+		for (int tx = rect.X0 / mTileSize; tx <= (rect.X1 - 1) / mTileSize; ++tx)
+		{
+			const int tile = ty * mTilesX + tx;
+			const int x0 = std::max(rect.X0, tx * mTileSize);
+			const int y0 = std::max(rect.Y0, ty * mTileSize);
+			const int x1 = std::min(rect.X1, (tx + 1) * mTileSize);
+			const int y1 = std::min(rect.Y1, (ty + 1) * mTileSize);
+
+			const uint32_t* current = mTiles[tile]->Texels.data();
+			uint32_t* texels = nullptr;
+
+			for (int y = y0; y < y1; ++y)
+			{
+				const float dv = (float)y / (float)mHeight - stamp.V;
+				for (int x = x0; x < x1; ++x)
+				{
+					const float du = (float)x / (float)mWidth - stamp.U;
+					const float dist = std::sqrt(du * du + dv * dv);
+					if (dist > reach)
+						continue;
+
+					float intensity = 1.0f;
+					if (dist > stamp.RadiusUV)
+						intensity = 1.0f - SmoothStep01((dist - stamp.RadiusUV) / stamp.FalloffUV);
+					if (intensity <= 0.0f)
+						continue;
+
+					const int index = (y - ty * mTileSize) * mTileSize + (x - tx * mTileSize);
+					const uint32_t t = current[index];
+					const float a = intensity * stamp.Color[3];
+
+					uint32_t result = 0;
+					for (int c = 0; c < 3; ++c)
+					{
+						const float cur = UnpackChannel(t, c);
+						result |= PackChannel(cur + (stamp.Color[c] - cur) * a, c);
+					}
+					result |= PackChannel(std::min(UnpackChannel(t, 3) + a * 0.5f, 1.0f), 3);
+					if (result == t)
+						continue;
+
+					// Only break sharing once a texel really changes, so a dab
+					// that blends to the same values keeps the packed tile and
+					// the undo journal sees no change.
+					if (texels == nullptr)
+					{
+						texels = GetWritableTile(tile);
+						current = texels;
+					}
+					texels[index] = result;
+				}
+			}
+		}
+	}
+
+	return rect;
+}
+
+void PaintLayer::GetTilesInRect(const PaintRect& rect, std::vector<int>& tiles) const
+{
+	tiles.clear();
+	if (rect.Empty())
+		return;
+
+	for (int ty = rect.Y0 / mTileSize; ty <= (rect.Y1 - 1) / mTileSize; ++ty)
+		for (int tx = rect.X0 / mTileSize; tx <= (rect.X1 - 1) / mTileSize; ++tx)
+			tiles.push_back(ty * mTilesX + tx);
+}
+
+PaintRect PaintLayer::GetTileRect(int tile) const
+{
+	PaintRect r;
+	r.X0 = (tile % mTilesX) * mTileSize;
+	r.Y0 = (tile / mTilesX) * mTileSize;
+	r.X1 = std::min(mWidth, r.X0 + mTileSize);
+	r.Y1 = std::min(mHeight, r.Y0 + mTileSize);
+	return r;
+}
+
+std::shared_ptr<const PackedTile> PaintLayer::Pack(int tile)
+{
+	if (!mPacked[tile])
+		mPacked[tile] = Compress(mTiles[tile]->Texels.data(), mTiles[tile]->Texels.size());
+	return mPacked[tile];
+}
+
+void PaintLayer::Unpack(int tile, const std::shared_ptr<const PackedTile>& packed)
+{
+	if (packed == mBlankPacked)
+	{
+		mTiles[tile] = mBlankTile;
+	}
+	else
+	{
+		auto texels = std::make_shared<TileTexels>();
+		texels->Texels.resize((size_t)mTileSize * mTileSize);
+		Decompress(*packed, texels->Texels.data(), texels->Texels.size());
+		mTiles[tile] = std::move(texels);
+	}
+	mPacked[tile] = packed;
+}
+
+void PaintLayer::ReadRect(const PaintRect& rect, void* dst, size_t dstRowPitch) const
+{
+	uint8_t* out = static_cast<uint8_t*>(dst);
+	for (int y = rect.Y0; y < rect.Y1; ++y)
+	{
+		uint32_t* row = reinterpret_cast<uint32_t*>(out + (size_t)(y - rect.Y0) * dstRowPitch);
+		const int ty = y / mTileSize;
+		for (int x = rect.X0; x < rect.X1;)
+		{
+			const int tx = x / mTileSize;
+			const int spanEnd = std::min(rect.X1, (tx + 1) * mTileSize);
+			const uint32_t* src = mTiles[ty * mTilesX + tx]->Texels.data()
+				+ (y - ty * mTileSize) * mTileSize + (x - tx * mTileSize);
+			std::memcpy(row + (x - rect.X0), src, (spanEnd - x) * sizeof(uint32_t));
+			x = spanEnd;
+		}
+	}
+}
+
+void PaintLayer::WriteRect(const PaintRect& rect, const void* src, size_t srcRowPitch)
+{
+	const uint8_t* in = static_cast<const uint8_t*>(src);
+	for (int ty = rect.Y0 / mTileSize; ty <= (rect.Y1 - 1) / mTileSize; ++ty)
+	{
+		for (int tx = rect.X0 / mTileSize; tx <= (rect.X1 - 1) / mTileSize; ++tx)
+		{
+			uint32_t* texels = GetWritableTile(ty * mTilesX + tx);
+			const int x0 = std::max(rect.X0, tx * mTileSize);
+			const int x1 = std::min(rect.X1, (tx + 1) * mTileSize);
+			const int y0 = std::max(rect.Y0, ty * mTileSize);
+			const int y1 = std::min(rect.Y1, (ty + 1) * mTileSize);
+			for (int y = y0; y < y1; ++y)
+			{
+				std::memcpy(texels + (y - ty * mTileSize) * mTileSize + (x0 - tx * mTileSize),
+					in + (size_t)(y - rect.Y0) * srcRowPitch + (size_t)(x0 - rect.X0) * 4,
+					(x1 - x0) * sizeof(uint32_t));
+			}
+		}
+	}
+}
+
+uint32_t PaintLayer::GetTexel(int x, int y) const
+{
+	const int tx = x / mTileSize;
+	const int ty = y / mTileSize;
+	return mTiles[ty * mTilesX + tx]->Texels[(y - ty * mTileSize) * mTileSize + (x - tx * mTileSize)];
+}
+
+uint32_t* PaintLayer::GetWritableTile(int tile)
+{
+	auto& t = mTiles[tile];
+	// Copy-on-write: the block may be the blank tile or owned by nobody else.
+	if (t.use_count() > 1)
+		t = std::make_shared<TileTexels>(*t);
+	mPacked[tile].reset();
+	return t->Texels.data();
+}
+
+std::shared_ptr<const PackedTile> PaintLayer::Compress(const uint32_t* texels, size_t count)
+{
+	auto packed = std::make_shared<PackedTile>();
+
+	size_t i = 0;
+	while (i < count)
+	{
+		size_t run = 1;
+		while (i + run < count && texels[i + run] == texels[i])
+			++run;
+		packed->Data.push_back((uint32_t)run);
+		packed->Data.push_back(texels[i]);
+		i += run;
+
+		// Noisy tiles: RLE would only grow the data.
+		if (packed->Data.size() >= count)
+		{
+			packed->Raw = true;
+			packed->Data.assign(texels, texels + count);
+			break;
+		}
+	}
+
+	packed->Data.shrink_to_fit();
+	return packed;
+}
+
+void PaintLayer::Decompress(const PackedTile& packed, uint32_t* texels, size_t count)
+{
+	if (packed.Raw)
+	{
+		std::memcpy(texels, packed.Data.data(), count * sizeof(uint32_t));
+		return;
+	}
+
+	size_t o = 0;
+	for (size_t i = 0; i + 1 < packed.Data.size() && o < count; i += 2)
+	{
+		const size_t run = std::min<size_t>(packed.Data[i], count - o);
+		std::fill(texels + o, texels + o + run, packed.Data[i + 1]);
+		o += run;
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// CPU mirror of the brush canvas (R8G8B8A8, same layout as mBrushTexture).
+// The canvas is split into square tiles that are shared copy-on-write, so
+// untouched regions cost nothing and the undo journal can reference them.
+
+// Texel rectangle, [X0, X1) x [Y0, Y1).
+struct PaintRect
+{
+	int X0 = 0;
+	int Y0 = 0;
+	int X1 = 0;
+	int Y1 = 0;
+
+	bool Empty() const { return X1 <= X0 || Y1 <= Y0; }
+	void Merge(const PaintRect& rhs);
+};
+
+// One brush dab, in the same units Brush.hlsl works with (terrain UV).
+struct BrushStamp
+{
+	float U = 0.0f;
+	float V = 0.0f;
+	float RadiusUV = 0.0f;
+	float FalloffUV = 0.0f;
+	float Color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+};
+
+// Run-length packed copy of a tile. Falls back to raw texels when RLE
+// would not pay off.
+struct PackedTile
+{
+	bool Raw = false;
+	std::vector<uint32_t> Data; // Raw: texels, otherwise (count, texel) pairs
+
+	size_t ByteSize() const { return sizeof(PackedTile) + Data.size() * sizeof(uint32_t); }
+};
+
+class PaintLayer
+{
+public:
+	PaintLayer(int width, int height, int tileSize = 64);
+
+	PaintLayer(const PaintLayer&) = delete;
+	PaintLayer& operator=(const PaintLayer&) = delete;
+
+	int GetWidth() const { return mWidth; }
+	int GetHeight() const { return mHeight; }
+	int GetTileSize() const { return mTileSize; }
+	int GetTileCount() const { return mTilesX * mTilesY; }
+
+	// Texels a stamp may touch, clipped to the canvas.
+	PaintRect GetStampRect(const BrushStamp& stamp) const;
+	// Same blend as Brush.hlsl. Returns the rect that was written.
+	PaintRect Stamp(const BrushStamp& stamp);
+
+	void GetTilesInRect(const PaintRect& rect, std::vector<int>& tiles) const;
+	PaintRect GetTileRect(int tile) const;
+
+	// Packed tiles are cached until the tile changes, so repeated snapshots
+	// of an unchanged tile return the same shared object.
+	std::shared_ptr<const PackedTile> Pack(int tile);
+	void Unpack(int tile, const std::shared_ptr<const PackedTile>& packed);
+
+	// Copies a rect into a row-pitched destination (e.g. an upload buffer).
+	void ReadRect(const PaintRect& rect, void* dst, size_t dstRowPitch) const;
+	// Overwrites a rect from row-pitched RGBA8 data (e.g. a decoded DDS).
+	void WriteRect(const PaintRect& rect, const void* src, size_t srcRowPitch);
+	uint32_t GetTexel(int x, int y) const;
+
+private:
+	struct TileTexels
+	{
+		std::vector<uint32_t> Texels;
+	};
+
+	uint32_t* GetWritableTile(int tile);
+
+	static std::shared_ptr<const PackedTile> Compress(const uint32_t* texels, size_t count);
+	static void Decompress(const PackedTile& packed, uint32_t* texels, size_t count);
+
+private:
+	int mWidth;
+	int mHeight;
+	int mTileSize;
+	int mTilesX;
+	int mTilesY;
+
+	std::shared_ptr<TileTexels> mBlankTile;
+	std::shared_ptr<const PackedTile> mBlankPacked;
+	std::vector<std::shared_ptr<TileTexels>> mTiles;
+	std::vector<std::shared_ptr<const PackedTile>> mPacked;
+};
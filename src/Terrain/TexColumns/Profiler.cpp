@@ -0,0 +1,203 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+Profiler::Profiler()
+{
+	Calibrate();
+}
+
+void Profiler::Calibrate()
+{
+#if PROFILER_USE_RDTSC
+	// Ticks per nanosecond over a short busy wait; the TSC of every x86 CPU
+	// this runs on is invariant, so one measurement holds.
+	using Clock = std::chrono::steady_clock;
+	const auto clockStart = Clock::now();
+	const uint64_t tickStart = Now();
+	Clock::time_point clockEnd;
+	do
+	{
+		clockEnd = Clock::now();
+	} while (clockEnd - clockStart < std::chrono::milliseconds(5));
+	const uint64_t tickEnd = Now();
+
+	const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(clockEnd - clockStart).count();
+	mNsPerTick = ns / (double)(std::max)(tickEnd - tickStart, (uint64_t)1);
+	mBaseTicks = tickStart;
+#else
+	mNsPerTick = 1.0;
+	mBaseTicks = Now();
+#endif
+	mFrameStart = 0;
+}
+
+uint64_t Profiler::ToNanoseconds(uint64_t ticks) const
+{
+	if (ticks <= mBaseTicks)
+		return 0;
+	return (uint64_t)((double)(ticks - mBaseTicks) * mNsPerTick);
+}
+
+// Hands the thread's ring back when the thread exits
+struct Profiler::ThreadExit
+{
+	ThreadRing* Ring = nullptr;
+	ThreadRing** Slot = nullptr;
+
+	~ThreadExit()
+	{
+		if (!Ring)
+			return;
+		*Slot = nullptr;
+		Profiler::Get().ReleaseThread(Ring);
+	}
+};
+
+Profiler::ThreadRing* Profiler::RegisterThread(ThreadRing** slot)
+{
+	thread_local ThreadExit threadExit;
+
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	ThreadRing* ring = nullptr;
+	if (!mFreeRings.empty())
+	{
+		ring = mFreeRings.back();
+		mFreeRings.pop_back();
+	}
+	else
+	{
+		mThreads.push_back(std::make_unique<ThreadRing>());
+		ring = mThreads.back().get();
+		ring->Index = (uint32_t)mThreads.size() - 1;
+	}
+	ring->Name = "Thread " + std::to_string(ring->Index);
+	threadExit.Ring = ring;
+	threadExit.Slot = slot;
+	return ring;
+}
+
+void Profiler::ReleaseThread(ThreadRing* ring)
+{
+	// Zones may still be waiting in it: BeginFrame frees it after draining
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	ring->Retired = true;
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	ThreadRing* ring = GetThreadRing();
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	ring->Name = name;
+}
+
+std::vector<std::string> Profiler::GetThreadNames() const
+{
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	std::vector<std::string> names;
+	names.reserve(mThreads.size());
+	for (const auto& ring : mThreads)
+		names.push_back(ring->Name);
+	return names;
+}
+
+void Profiler::BeginFrame()
+{
+	const uint64_t now = ToNanoseconds(Now());
+	mLastFrame.Start = mFrameStart;
+	mLastFrame.End = now;
+	mLastFrame.Zones.clear();
+	mFrameStart = now;
+
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		for (const auto& ring : mThreads)
+		{
+			const uint32_t head = ring->Head.load(std::memory_order_acquire);
+			uint32_t tail = ring->Tail.load(std::memory_order_relaxed);
+			for (; tail != head; ++tail)
+			{
+				const ThreadRing::Entry& entry = ring->Entries[tail & (ThreadRing::Capacity - 1)];
+				ProfileZone zone;
+				zone.Name = entry.Name;
+				zone.Start = ToNanoseconds(entry.Start);
+				zone.End = ToNanoseconds(entry.End);
+				zone.Thread = ring->Index;
+				zone.Depth = entry.Depth;
+				mLastFrame.Zones.push_back(zone);
+			}
+			ring->Tail.store(tail, std::memory_order_release);
+			mDropped += ring->Dropped.exchange(0, std::memory_order_relaxed);
+			// Its owner is gone, so the drain above took its last zones
+			if (ring->Retired)
+			{
+				ring->Retired = false;
+				mFreeRings.push_back(ring.get());
+			}
+		}
+	}
+
+	// Zones land in a ring when they end, so parents follow their children
+	std::sort(mLastFrame.Zones.begin(), mLastFrame.Zones.end(), [](const ProfileZone& a, const ProfileZone& b)
+	{
+		return a.Thread != b.Thread ? a.Thread < b.Thread : a.Start < b.Start;
+	});
+
+	if (mHistory.size() + mLastFrame.Zones.size() > MaxHistory)
+	{
+		const size_t excess = mHistory.size() + mLastFrame.Zones.size() - MaxHistory;
+		mHistory.erase(mHistory.begin(), mHistory.begin() + (std::min)(excess + MaxHistory / 4, mHistory.size()));
+	}
+	mHistory.insert(mHistory.end(), mLastFrame.Zones.begin(), mLastFrame.Zones.end());
+}
+
+namespace
+{
+	void WriteJsonString(std::ostream& out, const char* text)
+	{
+		out << '"';
+		for (const char* c = text ? text : ""; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+				out << '\\' << *c;
+			else if ((unsigned char)*c < 0x20)
+				out << ' ';
+			else
+				out << *c;
+		}
+		out << '"';
+	}
+}
+
+bool Profiler::WriteChromeTrace(const std::string& path) const
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	// Complete ("X") events; ts and dur are microseconds
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	const std::vector<std::string> names = GetThreadNames();
+	const char* separator = "\n";
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		out << separator << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":";
+		WriteJsonString(out, names[i].c_str());
+		out << "}}";
+		separator = ",\n";
+	}
+	for (const ProfileZone& zone : mHistory)
+	{
+		out << separator << "{\"ph\":\"X\",\"name\":";
+		WriteJsonString(out, zone.Name);
+		out << ",\"pid\":1,\"tid\":" << zone.Thread << ",\"ts\":" << zone.Start / 1000.0
+			<< ",\"dur\":" << (zone.End - zone.Start) / 1000.0 << "}";
+		separator = ",\n";
+	}
+	out << "\n]}\n";
+	return (bool)out;
+}
@@ -0,0 +1,225 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define PROFILER_USE_RDTSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#define PROFILER_USE_RDTSC 0
+#include <chrono>
+#endif
+
+// Scoped CPU profiler. PROFILE_SCOPE("name") times the rest of the enclosing
+// block; a named ProfileScope can also be split into phases with Next. Zones
+// are written to a ring owned by the calling thread, so recording takes no
+// lock. Once a frame the main thread calls BeginFrame, which drains every
+// ring into the history the timeline and the Chrome trace export read.
+//
+// When a thread exits its ring goes back to a free list (after BeginFrame
+// has drained it) and the next new thread takes it over, index included.
+// The ring count follows the most threads alive between two BeginFrame
+// calls, not the threads ever started. Threads that shared a ring share a
+// row in the timeline and the trace, under the name of the latest one.
+//
+// Zone names must be string literals (or otherwise outlive the profiler):
+// only the pointer is stored. Timestamps are CPU ticks while recording and
+// nanoseconds since Profiler start everywhere else.
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#if PROFILER_ENABLED
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#endif
+
+struct ProfileZone
+{
+	const char* Name = nullptr;
+	uint64_t Start = 0;          // ns
+	uint64_t End = 0;            // ns
+	uint32_t Thread = 0;         // index into GetThreadNames
+	uint32_t Depth = 0;          // nesting level on its thread
+};
+
+struct ProfileFrame
+{
+	uint64_t Start = 0;          // ns
+	uint64_t End = 0;
+	std::vector<ProfileZone> Zones; // zones that ended inside the frame, by thread then start
+};
+
+class Profiler
+{
+public:
+	static Profiler& Get();
+
+	// Recording can be switched off at run time; scopes then cost one load.
+	void SetEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+	bool IsEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+	// Names the calling thread in the timeline and the trace.
+	void SetThreadName(const char* name);
+
+	// Ends the current frame and starts the next one. Main thread only.
+	void BeginFrame();
+	const ProfileFrame& GetLastFrame() const { return mLastFrame; }
+	// One per ring, by index
+	std::vector<std::string> GetThreadNames() const;
+	// Zones lost because a thread's ring was full between two BeginFrame calls
+	uint64_t GetDroppedZones() const { return mDropped; }
+
+	// Everything still in the history, as Chrome trace event JSON
+	// (chrome://tracing, Perfetto). Main thread only.
+	bool WriteChromeTrace(const std::string& path) const;
+	void ClearHistory() { mHistory.clear(); }
+	size_t GetHistorySize() const { return mHistory.size(); }
+
+	// Raw timestamp used while recording: the TSC on x86 (calibrated against
+	// steady_clock at start), steady_clock nanoseconds elsewhere.
+	static uint64_t Now()
+	{
+#if PROFILER_USE_RDTSC
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+	uint64_t ToNanoseconds(uint64_t ticks) const;
+
+	// Per-thread single producer, single consumer ring
+	struct ThreadRing
+	{
+		static constexpr uint32_t Capacity = 1u << 14;
+
+		struct Entry
+		{
+			const char* Name;
+			uint64_t Start;
+			uint64_t End;
+			uint32_t Depth;
+		};
+
+		Entry Entries[Capacity];
+		std::atomic<uint32_t> Head{ 0 };    // written by the owner
+		std::atomic<uint32_t> Tail{ 0 };    // written by BeginFrame
+		std::atomic<uint32_t> Dropped{ 0 }; // written by the owner
+		uint32_t Index = 0;
+		std::string Name;
+		bool Retired = false;               // the owner exited; under mThreadsMutex
+	};
+
+	static ThreadRing* GetThreadRing();
+	static uint32_t& ThreadDepth();
+
+private:
+	struct ThreadExit;
+
+	Profiler();
+	// slot is the calling thread's GetThreadRing pointer, cleared when it exits
+	ThreadRing* RegisterThread(ThreadRing** slot);
+	void ReleaseThread(ThreadRing* ring);
+	void Calibrate();
+
+private:
+	std::atomic<bool> mEnabled{ true };
+
+	mutable std::mutex mThreadsMutex;    // guards mThreads, mFreeRings, ring names; never taken while recording
+	std::vector<std::unique_ptr<ThreadRing>> mThreads;
+	std::vector<ThreadRing*> mFreeRings; // drained rings of exited threads
+
+	uint64_t mBaseTicks = 0;
+	double mNsPerTick = 1.0;
+
+	uint64_t mFrameStart = 0;
+	ProfileFrame mLastFrame;
+	std::vector<ProfileZone> mHistory;
+	uint64_t mDropped = 0;
+	static constexpr size_t MaxHistory = 1u << 18;
+};
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name) { Open(name); }
+	~ProfileScope() { Close(); }
+
+	// Ends this zone and starts a sibling, for functions made of phases.
+	void Next(const char* name)
+	{
+		Close();
+		Open(name);
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	void Open(const char* name)
+	{
+		mName = nullptr;
+		if (!Profiler::Get().IsEnabled())
+			return;
+		mName = name;
+		mDepth = Profiler::ThreadDepth()++;
+		mStart = Profiler::Now();
+	}
+
+	void Close()
+	{
+		if (!mName)
+			return;
+		const uint64_t end = Profiler::Now();
+		--Profiler::ThreadDepth();
+
+		Profiler::ThreadRing* ring = Profiler::GetThreadRing();
+		const uint32_t head = ring->Head.load(std::memory_order_relaxed);
+		if (head - ring->Tail.load(std::memory_order_acquire) >= Profiler::ThreadRing::Capacity)
+		{
+			ring->Dropped.store(ring->Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return;
+		}
+		ring->Entries[head & (Profiler::ThreadRing::Capacity - 1)] = { mName, mStart, end, mDepth };
+		ring->Head.store(head + 1, std::memory_order_release);
+	}
+
+private:
+	const char* mName = nullptr;
+	uint64_t mStart = 0;
+	uint32_t mDepth = 0;
+};
+
+inline Profiler& Profiler::Get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+inline Profiler::ThreadRing* Profiler::GetThreadRing()
+{
+	thread_local ThreadRing* ring = nullptr;
+	if (!ring)
+		ring = Get().RegisterThread(&ring);
+	return ring;
+}
+
+inline uint32_t& Profiler::ThreadDepth()
+{
+	thread_local uint32_t depth = 0;
+	return depth;
+}
@@ -0,0 +1,210 @@
+#include "RenderCommands.h"
+#include <cassert>
+#include <cstring>
+
+RenderStats CountCommands(const RenderCommand* commands, size_t count)
+{
+	RenderStats stats;
+	stats.Commands = (uint32_t)count;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const RenderCommand& c = commands[i];
+		switch (c.Op)
+		{
+		case RenderOp::SetPipelineState:
+			stats.PipelineBinds++;
+			break;
+		case RenderOp::SetGraphicsRootSignature:
+		case RenderOp::SetComputeRootSignature:
+			stats.RootSignatureBinds++;
+			break;
+		case RenderOp::SetGraphicsTable:
+		case RenderOp::SetComputeTable:
+			stats.TableBinds++;
+			break;
+		case RenderOp::SetGraphicsCbv:
+		case RenderOp::SetComputeCbv:
+			stats.CbvBinds++;
+			break;
+		case RenderOp::SetVertexBuffer:
+		case RenderOp::SetIndexBuffer:
+		case RenderOp::SetTopology:
+			stats.InputBinds++;
+			break;
+		case RenderOp::SetDescriptorHeap:
+		case RenderOp::SetViewport:
+		case RenderOp::SetScissor:
+		case RenderOp::SetRenderTargets:
+			stats.TargetBinds++;
+			break;
+		case RenderOp::ClearRenderTarget:
+		case RenderOp::ClearDepthStencil:
+			stats.Clears++;
+			break;
+		case RenderOp::Barrier:
+			stats.Barriers++;
+			break;
+		case RenderOp::CopyResource:
+			stats.Copies++;
+			break;
+		case RenderOp::DrawIndexed:
+		case RenderOp::Draw:
+			stats.Draws++;
+			stats.Primitives += (uint64_t)c.A * c.Count;
+			break;
+		case RenderOp::Dispatch:
+			stats.Dispatches++;
+			break;
+		default:
+			break;
+		}
+	}
+	return stats;
+}
+
+const char* RenderOpName(RenderOp op)
+{
+	static const char* const names[] =
+	{
+		"SetPipelineState", "SetGraphicsRootSignature", "SetComputeRootSignature", "SetDescriptorHeap",
+		"SetGraphicsTable", "SetComputeTable", "SetGraphicsCbv", "SetComputeCbv",
+		"SetVertexBuffer", "SetIndexBuffer", "SetTopology",
+		"SetViewport", "SetScissor", "SetRenderTargets", "ClearRenderTarget", "ClearDepthStencil",
+		"Barrier", "CopyResource", "DrawIndexed", "Draw", "Dispatch",
+	};
+	static_assert(sizeof(names) / sizeof(names[0]) == (size_t)RenderOp::Count, "One name per RenderOp");
+	return op < RenderOp::Count ? names[(size_t)op] : "Unknown";
+}
+
+uint32_t RenderPayloadWords(RenderOp op)
+{
+	switch (op)
+	{
+	case RenderOp::SetViewport: return sizeof(RenderViewport) / 4;
+	case RenderOp::SetScissor: return sizeof(RenderRect) / 4;
+	case RenderOp::ClearRenderTarget: return 4;
+	default: return 0;
+	}
+}
+
+void NullCommandList::Reset()
+{
+	mCommands.clear();
+	mPayload.clear();
+}
+
+uint32_t NullCommandList::PushPayload(const void* data, size_t bytes)
+{
+	const uint32_t offset = (uint32_t)mPayload.size();
+	mPayload.resize(offset + (bytes + 3) / 4);
+	memcpy(mPayload.data() + offset, data, bytes);
+	return offset;
+}
+
+void NullCommandList::SetPipelineState(RenderId pipeline)
+{
+	Push(RenderOp::SetPipelineState, pipeline);
+}
+
+void NullCommandList::SetGraphicsRootSignature(RenderId rootSignature)
+{
+	Push(RenderOp::SetGraphicsRootSignature, rootSignature);
+}
+
+void NullCommandList::SetComputeRootSignature(RenderId rootSignature)
+{
+	Push(RenderOp::SetComputeRootSignature, rootSignature);
+}
+
+void NullCommandList::SetDescriptorHeap(RenderId heap)
+{
+	Push(RenderOp::SetDescriptorHeap, heap);
+}
+
+void NullCommandList::SetGraphicsRootDescriptorTable(uint32_t slot, uint32_t descriptor)
+{
+	Push(RenderOp::SetGraphicsTable, descriptor, 0, 0, slot);
+}
+
+void NullCommandList::SetComputeRootDescriptorTable(uint32_t slot, uint32_t descriptor)
+{
+	Push(RenderOp::SetComputeTable, descriptor, 0, 0, slot);
+}
+
+void NullCommandList::SetGraphicsRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset)
+{
+	Push(RenderOp::SetGraphicsCbv, buffer, offset, 0, slot);
+}
+
+void NullCommandList::SetComputeRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset)
+{
+	Push(RenderOp::SetComputeCbv, buffer, offset, 0, slot);
+}
+
+void NullCommandList::SetVertexBuffer(RenderId geometry)
+{
+	Push(RenderOp::SetVertexBuffer, geometry);
+}
+
+void NullCommandList::SetIndexBuffer(RenderId geometry)
+{
+	Push(RenderOp::SetIndexBuffer, geometry);
+}
+
+void NullCommandList::SetPrimitiveTopology(uint32_t topology)
+{
+	Push(RenderOp::SetTopology, topology);
+}
+
+void NullCommandList::SetViewport(const RenderViewport& viewport)
+{
+	Push(RenderOp::SetViewport, 0, PushPayload(&viewport, sizeof(viewport)));
+}
+
+void NullCommandList::SetScissorRect(const RenderRect& rect)
+{
+	Push(RenderOp::SetScissor, 0, PushPayload(&rect, sizeof(rect)));
+}
+
+void NullCommandList::SetRenderTargets(const uint32_t* rtvs, uint32_t count, uint32_t dsv)
+{
+	assert(count <= MaxRenderTargets);
+	Push(RenderOp::SetRenderTargets, count > 0 ? rtvs[0] : 0, count > 1 ? rtvs[1] : 0, dsv, 0, count);
+}
+
+void NullCommandList::ClearRenderTarget(uint32_t rtv, const float color[4])
+{
+	Push(RenderOp::ClearRenderTarget, rtv, PushPayload(color, 4 * sizeof(float)));
+}
+
+void NullCommandList::ClearDepthStencil(uint32_t dsv, float depth, uint8_t stencil)
+{
+	uint32_t depthBits;
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+	Push(RenderOp::ClearDepthStencil, dsv, depthBits, stencil);
+}
+
+void NullCommandList::Barrier(RenderId resource, ResourceState before, ResourceState after)
+{
+	Push(RenderOp::Barrier, resource, (uint32_t)before, (uint32_t)after);
+}
+
+void NullCommandList::CopyResource(RenderId destination, RenderId source)
+{
+	Push(RenderOp::CopyResource, destination, source);
+}
+
+void NullCommandList::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex)
+{
+	Push(RenderOp::DrawIndexed, indexCount, startIndex, (uint32_t)baseVertex, 0, instanceCount);
+}
+
+void NullCommandList::DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex)
+{
+	Push(RenderOp::Draw, vertexCount, startVertex, 0, 0, instanceCount);
+}
+
+void NullCommandList::Dispatch(uint32_t x, uint32_t y, uint32_t z)
+{
+	Push(RenderOp::Dispatch, x, y, z);
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Backend-neutral command recording. A frame is described with small ids
+// (pipelines, root signatures, resources, geometry, descriptor heaps) and
+// descriptor heap indices instead of device pointers and handles, so the
+// same recording code (FrameRecorder) drives the app's D3D12 command list
+// and NullCommandList, which needs no GPU.
+
+typedef uint32_t RenderId;
+
+// Values are D3D12_RESOURCE_STATES, so the D3D12 backend passes them through
+enum class ResourceState : uint32_t
+{
+	Common = 0,
+	Present = 0,
+	RenderTarget = 0x4,
+	UnorderedAccess = 0x8,
+	PixelShaderResource = 0x80,
+	CopyDest = 0x400,
+	CopySource = 0x800,
+};
+
+// Same layouts as D3D12_VIEWPORT and D3D12_RECT
+struct RenderViewport
+{
+	float TopLeftX = 0.0f;
+	float TopLeftY = 0.0f;
+	float Width = 0.0f;
+	float Height = 0.0f;
+	float MinDepth = 0.0f;
+	float MaxDepth = 1.0f;
+};
+
+struct RenderRect
+{
+	int32_t Left = 0;
+	int32_t Top = 0;
+	int32_t Right = 0;
+	int32_t Bottom = 0;
+};
+
+enum class RenderOp : uint8_t
+{
+	SetPipelineState,
+	SetGraphicsRootSignature,
+	SetComputeRootSignature,
+	SetDescriptorHeap,
+	SetGraphicsTable,
+	SetComputeTable,
+	SetGraphicsCbv,
+	SetComputeCbv,
+	SetVertexBuffer,
+	SetIndexBuffer,
+	SetTopology,
+	SetViewport,
+	SetScissor,
+	SetRenderTargets,
+	ClearRenderTarget,
+	ClearDepthStencil,
+	Barrier,
+	CopyResource,
+	DrawIndexed,
+	Draw,
+	Dispatch,
+	Count
+};
+
+// One recorded command. Arguments by op:
+//   SetPipelineState, Set*RootSignature, SetDescriptorHeap: A = id
+//   Set*Table: Slot = root parameter, A = descriptor index in the bound heap
+//   Set*Cbv: Slot = root parameter, A = buffer id, B = byte offset
+//   SetVertexBuffer, SetIndexBuffer: A = geometry id
+//   SetTopology: A = D3D_PRIMITIVE_TOPOLOGY value
+//   SetViewport, SetScissor: B = payload offset of the RenderViewport / RenderRect
+//   SetRenderTargets: Count = targets, A, B = RTV indices, C = DSV index or NoDepth
+//   ClearRenderTarget: A = RTV index, B = payload offset of the colour
+//   ClearDepthStencil: A = DSV index, B = depth as float bits, C = stencil
+//   Barrier: A = resource, B = before, C = after (ResourceState)
+//   CopyResource: A = destination, B = source
+//   DrawIndexed: A = index count, B = start index, C = base vertex, Count = instances
+//   Draw: A = vertex count, B = start vertex, Count = instances
+//   Dispatch: A, B, C = thread groups
+struct RenderCommand
+{
+	RenderOp Op;
+	uint8_t Slot;
+	uint16_t Count;
+	uint32_t A;
+	uint32_t B;
+	uint32_t C;
+};
+static_assert(sizeof(RenderCommand) == 16, "RenderCommand is meant to stay compact");
+
+struct RenderStats
+{
+	uint32_t Commands = 0;
+	uint32_t PipelineBinds = 0;
+	uint32_t RootSignatureBinds = 0;
+	uint32_t TableBinds = 0;        // descriptor tables, graphics and compute
+	uint32_t CbvBinds = 0;          // root CBVs, graphics and compute
+	uint32_t InputBinds = 0;        // vertex and index buffers, topology
+	uint32_t TargetBinds = 0;       // render targets, viewports, scissors, heaps
+	uint32_t Clears = 0;
+	uint32_t Barriers = 0;
+	uint32_t Copies = 0;
+	uint32_t Draws = 0;
+	uint32_t Dispatches = 0;
+	uint64_t Primitives = 0;        // indices or vertices drawn, times instances
+
+	uint32_t Binds() const
+	{
+		return PipelineBinds + RootSignatureBinds + TableBinds + CbvBinds + InputBinds + TargetBinds;
+	}
+};
+
+RenderStats CountCommands(const RenderCommand* commands, size_t count);
+// "SetPipelineState", "DrawIndexed", ... for reports
+const char* RenderOpName(RenderOp op);
+// Payload words an op keeps at B: viewports, scissors and clear colours
+uint32_t RenderPayloadWords(RenderOp op);
+
+class RenderCommandList
+{
+public:
+	static const uint32_t MaxRenderTargets = 2;
+	static const uint32_t NoDepth = 0xFFFFFFFF;
+
+	virtual ~RenderCommandList() = default;
+
+	virtual void SetPipelineState(RenderId pipeline) = 0;
+	virtual void SetGraphicsRootSignature(RenderId rootSignature) = 0;
+	virtual void SetComputeRootSignature(RenderId rootSignature) = 0;
+	virtual void SetDescriptorHeap(RenderId heap) = 0;
+	// descriptor: index in the heap of the last SetDescriptorHeap
+	virtual void SetGraphicsRootDescriptorTable(uint32_t slot, uint32_t descriptor) = 0;
+	virtual void SetComputeRootDescriptorTable(uint32_t slot, uint32_t descriptor) = 0;
+	virtual void SetGraphicsRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset) = 0;
+	virtual void SetComputeRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset) = 0;
+
+	virtual void SetVertexBuffer(RenderId geometry) = 0;
+	virtual void SetIndexBuffer(RenderId geometry) = 0;
+	virtual void SetPrimitiveTopology(uint32_t topology) = 0;
+
+	virtual void SetViewport(const RenderViewport& viewport) = 0;
+	virtual void SetScissorRect(const RenderRect& rect) = 0;
+	// RTV and DSV indices are offsets in the app's RTV and DSV heaps
+	virtual void SetRenderTargets(const uint32_t* rtvs, uint32_t count, uint32_t dsv) = 0;
+	virtual void ClearRenderTarget(uint32_t rtv, const float color[4]) = 0;
+	virtual void ClearDepthStencil(uint32_t dsv, float depth, uint8_t stencil) = 0;
+
+	virtual void Barrier(RenderId resource, ResourceState before, ResourceState after) = 0;
+	virtual void CopyResource(RenderId destination, RenderId source) = 0;
+
+	virtual void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex) = 0;
+	virtual void DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex) = 0;
+	virtual void Dispatch(uint32_t x, uint32_t y, uint32_t z) = 0;
+};
+
+// Records into a flat array of RenderCommand plus a payload for the few
+// commands that carry more than three words. Touches no device, so the
+// whole frame recording runs in the headless tools; Reset keeps the
+// capacity, so a warmed-up list records a frame without allocating.
+class NullCommandList : public RenderCommandList
+{
+public:
+	void Reset();
+
+	const std::vector<RenderCommand>& GetCommands() const { return mCommands; }
+	const std::vector<uint32_t>& GetPayload() const { return mPayload; }
+	RenderStats GetStats() const { return CountCommands(mCommands.data(), mCommands.size()); }
+
+	void SetPipelineState(RenderId pipeline) override;
+	void SetGraphicsRootSignature(RenderId rootSignature) override;
+	void SetComputeRootSignature(RenderId rootSignature) override;
+	void SetDescriptorHeap(RenderId heap) override;
+	void SetGraphicsRootDescriptorTable(uint32_t slot, uint32_t descriptor) override;
+	void SetComputeRootDescriptorTable(uint32_t slot, uint32_t descriptor) override;
+	void SetGraphicsRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset) override;
+	void SetComputeRootConstantBufferView(uint32_t slot, RenderId buffer, uint32_t offset) override;
+
+	void SetVertexBuffer(RenderId geometry) override;
+	void SetIndexBuffer(RenderId geometry) override;
+	void SetPrimitiveTopology(uint32_t topology) override;
+
+	void SetViewport(const RenderViewport& viewport) override;
+	void SetScissorRect(const RenderRect& rect) override;
+	void SetRenderTargets(const uint32_t* rtvs, uint32_t count, uint32_t dsv) override;
+	void ClearRenderTarget(uint32_t rtv, const float color[4]) override;
+	void ClearDepthStencil(uint32_t dsv, float depth, uint8_t stencil) override;
+
+	void Barrier(RenderId resource, ResourceState before, ResourceState after) override;
+	void CopyResource(RenderId destination, RenderId source) override;
+
+	void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex) override;
+	void DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex) override;
+	void Dispatch(uint32_t x, uint32_t y, uint32_t z) override;
+
+private:
+	void Push(RenderOp op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t slot = 0, uint32_t count = 0)
+	{
+		mCommands.push_back({ op, (uint8_t)slot, (uint16_t)count, a, b, c });
+	}
+	// Word offset of the copy
+	uint32_t PushPayload(const void* data, size_t bytes);
+
+	std::vector<RenderCommand> mCommands;
+	std::vector<uint32_t> mPayload;
+};
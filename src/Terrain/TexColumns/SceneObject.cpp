@@ -0,0 +1,51 @@
+#include "SceneObject.h"
+#include <cmath>
+
+using namespace DirectX;
+
+bool SceneObject::UpdateConstants(float totalTime, int numFrameResources, ObjectConstants& constants)
+{
+	if (NumFramesDirty <= 0)
+		return false;
+
+	PrevWorld = World;
+
+	if (Bobbing)
+	{
+		// Извлекаем компоненты (поворот/масштаб/позиция)
+		XMVECTOR scale, rotation, translation;
+		XMMatrixDecompose(&scale, &rotation, &translation, XMLoadFloat4x4(&World));
+
+		// Сохраняем начальную позицию при первом запуске
+		if (!mHasBobOrigin)
+		{
+			XMStoreFloat3(&mBobOrigin, translation);
+			mHasBobOrigin = true;
+		}
+
+		// Синусоидальное движение относительно начальной позиции
+		const float verticalOffset = std::sin(totalTime * 1.0f) * 20.0f;
+
+		// Создаем новую матрицу с сохранением масштаба и поворота
+		XMMATRIX newWorld = XMMatrixAffineTransformation(
+			scale,
+			XMVectorZero(),
+			rotation,
+			XMVectorSet(mBobOrigin.x, mBobOrigin.y + verticalOffset, mBobOrigin.z, 1.0f));
+		XMStoreFloat4x4(&World, newWorld);
+		NumFramesDirty = numFrameResources;
+	}
+
+	XMMATRIX world = XMLoadFloat4x4(&World);
+	XMMATRIX prevWorld = XMLoadFloat4x4(&PrevWorld);
+	XMMATRIX texTransform = XMLoadFloat4x4(&TexTransform);
+	Bounds.Transform(WorldBounds, world);
+
+	XMStoreFloat4x4(&constants.World, XMMatrixTranspose(world));
+	XMStoreFloat4x4(&constants.PrevWorld, XMMatrixTranspose(prevWorld));
+	XMStoreFloat4x4(&constants.TexTransform, XMMatrixTranspose(texTransform));
+
+	// Next FrameResource need to be updated too.
+	NumFramesDirty--;
+	return true;
+}
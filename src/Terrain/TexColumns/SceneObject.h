@@ -0,0 +1,55 @@
+#pragma once
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <string>
+#include "MathHelper.h"
+
+// Per-object constants, as the shaders read them (cbPerObject)
+struct ObjectConstants
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 PrevWorld = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+};
+
+// CPU side of a render item: transforms, bounds and the dirty count. No
+// device types, so the scene update runs in headless tools; the app's
+// RenderItem adds the geometry and material to draw it with.
+struct SceneObject
+{
+	// World matrix of the shape that describes the object's local space
+	// relative to the world space, which defines the position, orientation,
+	// and scale of the object in the world.
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 PrevWorld = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 BaseWorld = MathHelper::Identity4x4(); // исходная матрица
+	DirectX::BoundingBox Bounds;
+	// Bounds transformed by World; refreshed whenever the object constants are.
+	DirectX::BoundingBox WorldBounds;
+	// Moves every frame: culled through the dynamic BVH instead of the octree.
+	bool Dynamic = false;
+	// Bobs up and down around where it started, keeping scale and rotation.
+	bool Bobbing = false;
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
+	// Because we have an object cbuffer for each FrameResource, we have to apply the
+	// update to each FrameResource.  Thus, when we modify obect data we should set 
+	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
+	int NumFramesDirty = 0;
+
+	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	uint32_t ObjCBIndex = (uint32_t)-1;
+
+	std::string Name;
+
+	// One frame resource's worth of UpdateObjectCBs: moves a bobbing object,
+	// refreshes PrevWorld and WorldBounds and fills the constants. False if
+	// the object is clean and nothing needs uploading.
+	bool UpdateConstants(float totalTime, int numFrameResources, ObjectConstants& constants);
+
+private:
+	DirectX::XMFLOAT3 mBobOrigin = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+	bool mHasBobOrigin = false;
+};
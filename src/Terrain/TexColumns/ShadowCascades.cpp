@@ -0,0 +1,114 @@
+#include "ShadowCascades.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	float Dot(const float a[3], const float b[3])
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	void Cross(const float a[3], const float b[3], float out[3])
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	void Normalize(float v[3])
+	{
+		const float length = std::sqrt(Dot(v, v));
+		if (length > 0.0f)
+		{
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+	}
+}
+
+float ShadowCascades::SplitDistance(const CascadeParams& params, uint32_t i)
+{
+	const uint32_t count = std::max(params.Count, 1u);
+	if (i == 0)
+		return params.NearZ;
+	if (i >= count)
+		return params.FarZ;
+
+	const float t = (float)i / count;
+	const float uniform = params.NearZ + (params.FarZ - params.NearZ) * t;
+	const float logarithmic = params.NearZ * std::pow(params.FarZ / params.NearZ, t);
+	return uniform + (logarithmic - uniform) * params.Lambda;
+}
+
+void ShadowCascades::Fit(const CascadeParams& params, std::vector<ShadowCascade>& cascades)
+{
+	cascades.resize(params.Count);
+
+	// Light space basis, built like XMMatrixLookToLH
+	float light[3] = { params.LightDir[0], params.LightDir[1], params.LightDir[2] };
+	Normalize(light);
+	const float worldUp[3] = { 0.0f, 1.0f, 0.0f };
+	const float worldForward[3] = { 0.0f, 0.0f, 1.0f };
+	float right[3], up[3];
+	Cross(std::fabs(light[1]) > 0.99f ? worldForward : worldUp, light, right);
+	Normalize(right);
+	Cross(light, right, up);
+
+	// A slice's corners sit at sqrt(k) * d from the view axis at depth d
+	const float tanHalf = std::tan(0.5f * params.FovY);
+	const float k = tanHalf * tanHalf * (1.0f + params.Aspect * params.Aspect);
+
+	for (uint32_t i = 0; i < params.Count; ++i)
+	{
+		ShadowCascade& cascade = cascades[i];
+		const float dn = SplitDistance(params, i);
+		const float df = SplitDistance(params, i + 1);
+		cascade.SplitNear = dn;
+		cascade.SplitFar = df;
+
+		// Bounding sphere centred on the view axis, equidistant from the near
+		// and far corners (or at the far plane when the slice is wide)
+		const float c = std::min(0.5f * (dn + df) * (1.0f + k), df);
+		float radius = std::max(std::sqrt((dn - c) * (dn - c) + k * dn * dn), std::sqrt((df - c) * (df - c) + k * df * df));
+		// Coarse steps so the texel size does not creep with float noise
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		float center[3];
+		for (int a = 0; a < 3; ++a)
+			center[a] = params.Eye[a] + params.Look[a] * c;
+
+		// Snap across the light to whole texels. The snap moves the centre by
+		// up to a texel on each axis, so the volume is a texel wider than the
+		// sphere; the texel is the padded volume's, which is the map's.
+		const float texel = 2.0f * radius / (std::max(params.Resolution, 3u) - 2);
+		const float lx = std::floor(Dot(center, right) / texel) * texel;
+		const float ly = std::floor(Dot(center, up) / texel) * texel;
+		const float lz = Dot(center, light);
+		for (int a = 0; a < 3; ++a)
+			cascade.Center[a] = right[a] * lx + up[a] * ly + light[a] * lz;
+		radius += texel;
+		cascade.Radius = radius;
+
+		// Orthographic volume: [-r, r] across the light, and from the caster
+		// distance in front of the sphere to its back along it
+		const float zNear = lz - radius - params.CasterDistance;
+		const float depth = 2.0f * radius + params.CasterDistance;
+		float (&m)[4][4] = cascade.ViewProj;
+		for (int r = 0; r < 3; ++r)
+		{
+			m[r][0] = right[r] / radius;
+			m[r][1] = up[r] / radius;
+			m[r][2] = light[r] / depth;
+			m[r][3] = 0.0f;
+		}
+		m[3][0] = -lx / radius;
+		m[3][1] = -ly / radius;
+		m[3][2] = -zNear / depth;
+		m[3][3] = 1.0f;
+
+		cascade.Planes = FrustumPlanes::FromViewProj(m);
+	}
+}
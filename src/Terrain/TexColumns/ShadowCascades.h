@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "CullingShapes.h"
+
+// Cascaded shadow map volumes for a directional light. The camera range is
+// split with the practical scheme (a blend of uniform and logarithmic
+// splits); each slice of the view frustum gets an orthographic volume around
+// its bounding sphere, so the volume keeps its size while the camera turns,
+// with the centre snapped to shadow map texels so it does not shimmer while
+// the camera moves.
+//
+// Matrices use the same row-vector, D3D depth convention as
+// FrustumPlanes::FromViewProj.
+
+struct CascadeParams
+{
+	float Eye[3] = {};
+	float Right[3] = { 1.0f, 0.0f, 0.0f };
+	float Up[3] = { 0.0f, 1.0f, 0.0f };
+	float Look[3] = { 0.0f, 0.0f, 1.0f };
+	float FovY = 0.785f;
+	float Aspect = 1.0f;
+	float NearZ = 1.0f;
+	float FarZ = 1000.0f;            // where shadows end, not necessarily the camera's far plane
+
+	float LightDir[3] = { 0.0f, -1.0f, 0.0f }; // direction the light travels
+	uint32_t Count = 4;
+	float Lambda = 0.75f;            // 0 uniform splits, 1 logarithmic
+	uint32_t Resolution = 2048;      // shadow map size, for texel snapping
+	float CasterDistance = 500.0f;   // how far towards the light casters are kept
+};
+
+struct ShadowCascade
+{
+	float SplitNear = 0.0f;
+	float SplitFar = 0.0f;
+	float Center[3] = {};
+	float Radius = 0.0f;             // half-width across the light: the slice's sphere plus a texel
+	float ViewProj[4][4] = {};
+	FrustumPlanes Planes;
+};
+
+class ShadowCascades
+{
+public:
+	static void Fit(const CascadeParams& params, std::vector<ShadowCascade>& cascades);
+	// Distance along the view direction where cascade i ends
+	static float SplitDistance(const CascadeParams& params, uint32_t i);
+};
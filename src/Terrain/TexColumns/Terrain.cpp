@@ -1,6 +1,8 @@
 #include "Terrain.h"
 
-void Terrain::Initialize(ID3D12Device* device, float worldSize, int maxLOD, XMFLOAT3 terrainOffset)
+#include <algorithm>
+
+void Terrain::Initialize(float worldSize, int maxLOD, XMFLOAT3 terrainOffset)
 {
     mWorldSize = worldSize;
     mMaxLOD = maxLOD;
@@ -12,10 +14,30 @@ void Terrain::Initialize(ID3D12Device* device, float worldSize, int maxLOD, XMFL
 }
 
 
-void Terrain::Update(const XMFLOAT3& cameraPos, BoundingFrustum& frustum)
+void Terrain::Update(const XMFLOAT3& cameraPos, BoundingFrustum& frustum, const FrustumPlanes* shadowViews, uint32_t shadowViewCount)
 {
     mVisibleTiles.clear();
-    mRoot->UpdateVisibility(frustum, cameraPos, mVisibleTiles, mHeightScale, (int)mWorldSize);
+    mShadowViewCount = (std::min)(shadowViewCount, ViewCullState::MaxViews);
+    for (uint32_t i = 0; i < mShadowViewCount; ++i)
+        mShadowTiles[i].clear();
+
+    TerrainCullContext context;
+    context.Frustum = &frustum;
+    context.CameraPos = cameraPos;
+    context.HeightScale = mHeightScale;
+    context.MapSize = (int)mWorldSize;
+    context.VisibleTiles = &mVisibleTiles;
+    context.ShadowViews = shadowViews;
+    context.ShadowViewCount = mShadowViewCount;
+    context.ShadowTiles = mShadowTiles;
+    if (mUseHorizonCulling && mHeights && !mHeights->IsEmpty())
+    {
+        mHorizon.Begin(cameraPos.x, cameraPos.y, cameraPos.z);
+        context.Horizon = &mHorizon;
+    }
+    mRoot->UpdateVisibility(context, true, ViewCullState::All(mShadowViewCount));
+    mHorizonCulledNodes = context.HorizonCulled;
+    mNodesVisited = context.NodesVisited;
 }
 
 bool QuadTreeNode::ShouldSplit(const XMFLOAT3& cameraPos, float heightscale, int mapsize) const
@@ -35,30 +57,63 @@ bool QuadTreeNode::ShouldSplit(const XMFLOAT3& cameraPos, float heightscale, int
 }
 
 // 4.    
-void QuadTreeNode::UpdateVisibility(BoundingFrustum& frustum, const XMFLOAT3& cameraPos, std::vector<Tile*>& visibleTiles, float heightscale, int mapsize)
+void QuadTreeNode::UpdateVisibility(TerrainCullContext& context, bool camera, ViewCullState shadows)
 {
-    if (frustum.Contains(boundingBox) == DISJOINT)
+    const XMFLOAT3& c = boundingBox.Center;
+    const XMFLOAT3& e = boundingBox.Extents;
+    ++context.NodesVisited;
+
+    if (camera && context.Frustum->Contains(boundingBox) == DISJOINT)
+        camera = false;
+
+    // Hidden behind the tiles already selected in front of it. The horizon is
+    // the camera's; the light still sees the node.
+    if (camera && context.Horizon && context.Horizon->IsHidden(c.x - e.x, c.z - e.z, c.x + e.x, c.z + e.z, c.y + e.y))
+    {
+        ++context.HorizonCulled;
+        camera = false;
+    }
+
+    if (shadows.Visible)
+        shadows.Classify(context.ShadowViews, context.ShadowViewCount, Aabb::FromCenterExtents(&c.x, &e.x));
+
+    if (!camera && !shadows.Visible)
     {
         return; //    
     }
 
     //    "" (  )     
-    if (!children[0] || !ShouldSplit(cameraPos, heightscale, mapsize))
+    if (!children[0] || !ShouldSplit(context.CameraPos, context.HeightScale, context.MapSize))
     {
         //    ()
         if (tile)
         {
-            visibleTiles.push_back(tile);
+            if (camera)
+            {
+                context.VisibleTiles->push_back(tile);
+                if (context.Horizon)
+                    context.Horizon->AddOccluder(c.x - e.x, c.z - e.z, c.x + e.x, c.z + e.z, c.y - e.y);
+            }
+            for (uint32_t i = 0; i < context.ShadowViewCount; ++i)
+            {
+                if (shadows.Visible & (1u << i))
+                    context.ShadowTiles[i].push_back(tile);
+            }
         }
     }
     else //   
     {
-        //     
-        for (int i = 0; i < 4; i++)
+        //     .
+        // Nearest first: the horizon needs everything in front of a node
+        // visited before it. Child i lies at +x when i & 1, at +z when i & 2.
+        const XMFLOAT3& cameraPos = context.CameraPos;
+        const int nearest = (cameraPos.x >= c.x ? 1 : 0) | (cameraPos.z >= c.z ? 2 : 0);
+        for (int k = 0; k < 4; k++)
         {
+            const int i = nearest ^ k;
             if (children[i])
             {
-                children[i]->UpdateVisibility(frustum, cameraPos, visibleTiles, heightscale, mapsize);
+                children[i]->UpdateVisibility(context, camera, shadows);
             }
         }
     }
@@ -181,8 +236,33 @@ void Terrain::RecurseUpdatingBB(QuadTreeNode* node, XMFLOAT3 parentPos)
         }
     }
 }
+void Terrain::SetHeights(const HeightField* heights)
+{
+    mHeights = heights;
+    if (mRoot)
+        FitBounds(mRoot.get());
+}
+
+void Terrain::FitBounds(QuadTreeNode* node)
+{
+    const XMFLOAT3 center = node->boundingBox.Center;
+    const XMFLOAT3 pos = XMFLOAT3(center.x - node->size * 0.5f, mTerrainOffset.y, center.z - node->size * 0.5f);
+    node->boundingBox = CalculateAABB(pos, node->size, minHeight, maxHeight);
+    if (node->tile)
+        node->tile->boundingBox = node->boundingBox;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (node->children[i])
+            FitBounds(node->children[i].get());
+    }
+}
+
 BoundingBox Terrain::CalculateAABB(const XMFLOAT3& pos, float size, float minHeight, float maxHeight)
 {
+    if (mHeights && !mHeights->IsEmpty())
+        mHeights->GetRange(pos.x, pos.z, pos.x + size, pos.z + size, minHeight, maxHeight);
+
     BoundingBox aabb;
     auto minPoint = XMFLOAT3(pos.x, minHeight, pos.z);
     auto maxPoint = XMFLOAT3(pos.x + size, maxHeight, pos.z + size);
@@ -1,8 +1,15 @@
 #pragma once
-#include "../../Common/d3dApp.h"
-using Microsoft::WRL::ComPtr;
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <memory>
+#include <vector>
+#include "HeightField.h"
+#include "HorizonCuller.h"
+#include "CullingShapes.h"
 using namespace DirectX;
-using namespace DirectX::PackedVector;
+
+// Quadtree selection and culling only: no device or Windows dependency, so it
+// also builds in headless tools (Tools/TerrainBench.cpp).
 struct Tile
 {
 	XMFLOAT3 worldPos;
@@ -15,6 +22,23 @@ struct Tile
 	int NumFramesDirty;
 };
 
+// Everything one quadtree walk reads and fills. Shadow views share the
+// camera's LOD cut, so a tile drawn into a cascade matches the one on screen.
+struct TerrainCullContext
+{
+	BoundingFrustum* Frustum = nullptr;
+	XMFLOAT3 CameraPos;
+	float HeightScale = 0.0f;
+	int MapSize = 0;
+	std::vector<Tile*>* VisibleTiles = nullptr;
+	HorizonCuller* Horizon = nullptr;        // may be null; only hides from the camera
+	int HorizonCulled = 0;
+	int NodesVisited = 0;
+	const FrustumPlanes* ShadowViews = nullptr;
+	uint32_t ShadowViewCount = 0;
+	std::vector<Tile*>* ShadowTiles = nullptr; // one list per shadow view
+};
+
 struct QuadTreeNode
 {
 	BoundingBox boundingBox;
@@ -25,7 +49,9 @@ struct QuadTreeNode
 	Tile* tile;  //  
 
 	bool ShouldSplit(const XMFLOAT3& cameraPos, float heightscale, int mapsize) const;
-	void UpdateVisibility(BoundingFrustum& frustum, const XMFLOAT3& cameraPos, std::vector<Tile*>& visibleTiles, float heightscale, int mapsize);
+	// camera says the main frustum may still see the node, shadows carries
+	// the shadow views that may.
+	void UpdateVisibility(TerrainCullContext& context, bool camera, ViewCullState shadows);
 };
 
 class Terrain
@@ -33,12 +59,23 @@ class Terrain
 public:
 	Terrain() {};
 
-	void Initialize(ID3D12Device* device, float worldSize, int maxLOD, XMFLOAT3 terrainOffset);
-	void Update(const XMFLOAT3& cameraPos, BoundingFrustum& frustum);
+	void Initialize(float worldSize, int maxLOD, XMFLOAT3 terrainOffset);
+	// Shadow views are culled in the same walk; up to ViewCullState::MaxViews.
+	void Update(const XMFLOAT3& cameraPos, BoundingFrustum& frustum, const FrustumPlanes* shadowViews = nullptr, uint32_t shadowViewCount = 0);
 	std::vector<std::shared_ptr<Tile>>& GetAllTiles();
 	std::vector<Tile*>& GetVisibleTiles();
+	const std::vector<Tile*>& GetShadowTiles(uint32_t view) const { return mShadowTiles[view]; }
+	// For walking subtrees separately (Tools/JobBench.cpp); UpdateVisibility
+	// only reads the tree, so walks can run side by side
+	QuadTreeNode* GetRoot() { return mRoot.get(); }
+	uint32_t GetShadowViewCount() const { return mShadowViewCount; }
 	void BuildTree();
 	void UpdateBoundainBoxes(XMFLOAT3 offset);
+	// Node and tile bounds take their height range from the map instead of
+	// the fixed minHeight..maxHeight. The map must outlive the terrain.
+	void SetHeights(const HeightField* heights);
+	// Bounds of the square at pos; the height range is the map's when set.
+	BoundingBox CalculateAABB(const XMFLOAT3& pos, float size, float minHeight, float maxHeight);
 	//void UpdateLOD(const XMFLOAT3& cameraPos, float lodTransitionDistance);
 
 private:
@@ -47,8 +84,8 @@ private:
 	void CollectVisibleTiles(QuadTreeNode* node, const DirectX::BoundingFrustum& frustum, std::vector<Tile*>& visibleTiles);
 	//void UpdateNodeLOD(QuadTreeNode* node, const XMFLOAT3& cameraPos, float lodTransitionDistance);
 	void HideChildrenTiles(QuadTreeNode* node);
-	BoundingBox CalculateAABB(const XMFLOAT3& pos, float size, float minHeight, float maxHeight);
 	void RecurseUpdatingBB(QuadTreeNode* node, XMFLOAT3 actualPos);
+	void FitBounds(QuadTreeNode* node);
 
 public:
 	float mWorldSize;
@@ -56,15 +93,22 @@ public:
 	int renderlodlevel = 0;
 	int tileRenderIndex = 0;
 	XMFLOAT3 mTerrainOffset;
+	// Needs SetHeights: with the fixed height range nothing is ever hidden.
+	bool mUseHorizonCulling = true;
+	int mHorizonCulledNodes = 0;
+	int mNodesVisited = 0;                  // last Update
 
 private:
 	std::unique_ptr<QuadTreeNode> mRoot;
-	ComPtr<ID3D12Resource> mHeightmapTexture;
 	std::vector<std::shared_ptr<Tile>> mAllTiles;
 	std::vector<Tile*> mVisibleTiles;
+	std::vector<Tile*> mShadowTiles[ViewCullState::MaxViews];
+	uint32_t mShadowViewCount = 0;
 	int mMaxLOD;
 	int tileIndex = 0;
 	float minHeight = -5;// +mTerrainOffset.y;
 	float maxHeight = 400;// +mTerrainOffset.y;
+	const HeightField* mHeights = nullptr;
+	HorizonCuller mHorizon;
 };
 
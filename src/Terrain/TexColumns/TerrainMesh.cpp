@@ -0,0 +1,128 @@
+#include "TerrainMesh.h"
+#include "Terrain.h"
+
+using namespace DirectX;
+
+void TerrainMesh::GenerateTile(const XMFLOAT3& worldPos, float tileSize, std::vector<TerrainVertex>& vertices, std::vector<uint32_t>& indices)
+{
+	const int resolution = TileResolution;
+	const uint32_t base = (uint32_t)vertices.size();
+	const float stepSize = tileSize / (resolution - 1);
+	const float curtainY = worldPos.y - CurtainDepth;
+
+	vertices.reserve(vertices.size() + TileVertices);
+	indices.reserve(indices.size() + TileIndices);
+
+	//main vertices
+	for (int z = 0; z < resolution; z++)
+	{
+		for (int x = 0; x < resolution; x++)
+		{
+			TerrainVertex vertex;
+			vertex.Pos = XMFLOAT3(worldPos.x + x * stepSize, worldPos.y, worldPos.z + z * stepSize);
+			vertex.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			vertex.TexC = XMFLOAT2((float)x / (resolution - 1), (float)z / (resolution - 1));
+			vertex.Tangent = XMFLOAT3(1.0f, 0.0f, 0.0f);
+			vertices.push_back(vertex);
+		}
+	}
+
+	//curtain vertices: copies of the left, right, bottom and top edges, lowered
+	auto pushCurtain = [&](uint32_t gridIndex)
+	{
+		TerrainVertex vertex = vertices[base + gridIndex];
+		vertex.Pos.y = curtainY;
+		vertices.push_back(vertex);
+	};
+	for (int z = 0; z < resolution; z++)
+		pushCurtain(z * resolution);
+	for (int z = 0; z < resolution; z++)
+		pushCurtain(z * resolution + (resolution - 1));
+	for (int x = 0; x < resolution; x++)
+		pushCurtain(x);
+	for (int x = 0; x < resolution; x++)
+		pushCurtain((resolution - 1) * resolution + x);
+
+	auto triangle = [&](uint32_t a, uint32_t b, uint32_t c)
+	{
+		indices.push_back(base + a);
+		indices.push_back(base + b);
+		indices.push_back(base + c);
+	};
+
+	//Indices
+	for (int z = 0; z < resolution - 1; z++)
+	{
+		for (int x = 0; x < resolution - 1; x++)
+		{
+			uint32_t topLeft = z * resolution + x;
+			uint32_t topRight = topLeft + 1;
+			uint32_t bottomLeft = (z + 1) * resolution + x;
+			uint32_t bottomRight = bottomLeft + 1;
+
+			triangle(topLeft, bottomLeft, topRight);
+			triangle(topRight, bottomLeft, bottomRight);
+		}
+	}
+
+	// curtain indices
+	const uint32_t leftCurtainStart = resolution * resolution;
+	const uint32_t rightCurtainStart = leftCurtainStart + resolution;
+	const uint32_t bottomCurtainStart = rightCurtainStart + resolution;
+	const uint32_t topCurtainStart = bottomCurtainStart + resolution;
+
+	//left
+	for (int z = 0; z < resolution - 1; z++)
+	{
+		uint32_t edge1 = z * resolution;
+		uint32_t edge2 = (z + 1) * resolution;
+		triangle(edge1, leftCurtainStart + z, edge2);
+		triangle(edge2, leftCurtainStart + z, leftCurtainStart + z + 1);
+	}
+
+	// right
+	for (int z = 0; z < resolution - 1; z++)
+	{
+		uint32_t edge1 = z * resolution + (resolution - 1);
+		uint32_t edge2 = (z + 1) * resolution + (resolution - 1);
+		triangle(edge1, edge2, rightCurtainStart + z);
+		triangle(edge2, rightCurtainStart + z + 1, rightCurtainStart + z);
+	}
+
+	// bottom
+	for (int x = 0; x < resolution - 1; x++)
+	{
+		uint32_t edge1 = x;
+		uint32_t edge2 = x + 1;
+		triangle(edge1, edge2, bottomCurtainStart + x);
+		triangle(edge2, bottomCurtainStart + x + 1, bottomCurtainStart + x);
+	}
+
+	// top
+	for (int x = 0; x < resolution - 1; x++)
+	{
+		uint32_t edge1 = (resolution - 1) * resolution + x;
+		uint32_t edge2 = edge1 + 1;
+		triangle(edge1, topCurtainStart + x, edge2);
+		triangle(edge2, topCurtainStart + x, topCurtainStart + x + 1);
+	}
+}
+
+void TerrainMesh::BuildTiles(const std::vector<std::shared_ptr<Tile>>& tiles, std::vector<TerrainVertex>& vertices, std::vector<uint32_t>& indices, std::vector<TerrainTileRange>& ranges)
+{
+	vertices.clear();
+	indices.clear();
+	ranges.clear();
+	vertices.reserve(tiles.size() * TileVertices);
+	indices.reserve(tiles.size() * TileIndices);
+	ranges.reserve(tiles.size());
+
+	for (const auto& tile : tiles)
+	{
+		TerrainTileRange range;
+		range.StartIndex = (uint32_t)indices.size();
+		GenerateTile(tile->worldPos, tile->tileSize, vertices, indices);
+		range.IndexCount = (uint32_t)indices.size() - range.StartIndex;
+		ranges.push_back(range);
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct Tile;
+
+// Terrain tile meshes, built on the CPU with no device, so the headless tools
+// (Tools/MicroBench.cpp) time the same code the app uploads.
+
+// Same layout as the app's Vertex
+struct TerrainVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexC;
+	DirectX::XMFLOAT3 Tangent;
+};
+
+struct TerrainTileRange
+{
+	uint32_t IndexCount;
+	uint32_t StartIndex;
+};
+
+class TerrainMesh
+{
+public:
+	// Tiles are an 8x8 vertex grid, whatever the LOD; the shaders tessellate.
+	static const int TileResolution = 8;
+	static const int TileVertices = TileResolution * TileResolution + 4 * TileResolution;
+	static const int TileIndices = 6 * (TileResolution - 1) * (TileResolution - 1) + 24 * (TileResolution - 1);
+	// Skirt depth below the tile, hides cracks between LODs
+	static constexpr float CurtainDepth = 50.0f;
+
+	// A flat grid at worldPos.y with a skirt on each edge. Appends to the
+	// vectors; indices count from the vertices already there.
+	static void GenerateTile(const DirectX::XMFLOAT3& worldPos, float tileSize,
+		std::vector<TerrainVertex>& vertices, std::vector<uint32_t>& indices);
+
+	// Every tile into one vertex and index buffer, indices offset to the
+	// shared vertex buffer; ranges[i] is tiles[i]'s draw.
+	static void BuildTiles(const std::vector<std::shared_ptr<Tile>>& tiles,
+		std::vector<TerrainVertex>& vertices, std::vector<uint32_t>& indices, std::vector<TerrainTileRange>& ranges);
+};
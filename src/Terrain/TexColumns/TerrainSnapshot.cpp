@@ -0,0 +1,113 @@
+#include "TerrainSnapshot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	const uint32_t MaxGridSize = 256;
+
+	void CopyTiles(const std::vector<Tile*>& tiles, std::vector<TileSnapshot>& out)
+	{
+		out.clear();
+		for (const Tile* tile : tiles)
+		{
+			TileSnapshot s;
+			s.TileIndex = tile->tileIndex;
+			s.Lod = tile->lodLevel;
+			s.Size = tile->tileSize;
+			s.WorldPos = tile->worldPos;
+			s.Bounds = tile->boundingBox;
+			out.push_back(s);
+		}
+	}
+
+	// Cells whose centres lie in [a, b] along one axis
+	void CellSpan(float a, float b, float origin, float cell, uint32_t count, int& first, int& last)
+	{
+		first = (std::max)((int)std::ceil((a - origin) / cell - 0.5f), 0);
+		last = (std::min)((int)std::floor((b - origin) / cell - 0.5f), (int)count - 1);
+	}
+}
+
+const TileSnapshot* TerrainSnapshot::FindTile(float x, float z) const
+{
+	if (GridSize == 0)
+		return nullptr;
+	const int cx = (int)std::floor((x - GridOriginX) / CellSize);
+	const int cz = (int)std::floor((z - GridOriginZ) / CellSize);
+	if (cx < 0 || cz < 0 || cx >= (int)GridSize || cz >= (int)GridSize)
+		return nullptr;
+	const int32_t index = Cells[(size_t)cz * GridSize + cx];
+	return index < 0 ? nullptr : &Tiles[index];
+}
+
+void TerrainSnapshot::Capture(Terrain& terrain)
+{
+	WorldSize = terrain.mWorldSize;
+	HeightScale = terrain.mHeightScale;
+	Offset = terrain.mTerrainOffset;
+
+	CopyTiles(terrain.GetVisibleTiles(), Tiles);
+	ShadowTiles.resize(terrain.GetShadowViewCount());
+	for (uint32_t i = 0; i < terrain.GetShadowViewCount(); ++i)
+		CopyTiles(terrain.GetShadowTiles(i), ShadowTiles[i]);
+
+	GridSize = 0;
+	Cells.clear();
+	const QuadTreeNode* root = terrain.GetRoot();
+	if (!root || Tiles.empty())
+		return;
+
+	float finest = Tiles.front().Size;
+	for (const TileSnapshot& tile : Tiles)
+		finest = (std::min)(finest, tile.Size);
+	const BoundingBox& rootBounds = root->boundingBox;
+	const float size = rootBounds.Extents.x * 2.0f;
+	GridSize = (uint32_t)(std::min)((std::max)(std::lround(size / finest), 1l), (long)MaxGridSize);
+	GridOriginX = rootBounds.Center.x - rootBounds.Extents.x;
+	GridOriginZ = rootBounds.Center.z - rootBounds.Extents.z;
+	CellSize = size / GridSize;
+	Cells.assign((size_t)GridSize * GridSize, -1);
+
+	for (size_t i = 0; i < Tiles.size(); ++i)
+	{
+		const BoundingBox& b = Tiles[i].Bounds;
+		int x0, x1, z0, z1;
+		CellSpan(b.Center.x - b.Extents.x, b.Center.x + b.Extents.x, GridOriginX, CellSize, GridSize, x0, x1);
+		CellSpan(b.Center.z - b.Extents.z, b.Center.z + b.Extents.z, GridOriginZ, CellSize, GridSize, z0, z1);
+		for (int z = z0; z <= z1; ++z)
+			for (int x = x0; x <= x1; ++x)
+				Cells[(size_t)z * GridSize + x] = (int32_t)i;
+	}
+}
+
+float TerrainSnapshot::HeightAt(float x, float z) const
+{
+	if (!Heights || Heights->IsEmpty())
+		return Offset.y;
+	return Heights->Sample(x, z);
+}
+
+void TerrainSnapshots::SetHeights(const HeightField& heights)
+{
+	mHeights = std::make_shared<const HeightField>(heights);
+	++mHeightsVersion;
+}
+
+void TerrainSnapshots::Publish(Terrain& terrain, uint64_t frame, const XMFLOAT3& cameraPos)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	// A reclaimed version: every field is written again
+	TerrainSnapshot& s = mPublisher.BeginWrite();
+	s.Version = ++mVersion;
+	s.Frame = frame;
+	s.CameraPos = cameraPos;
+	s.Heights = mHeights;
+	s.HeightsVersion = mHeightsVersion;
+	s.Capture(terrain);
+	mPublisher.Publish();
+	mLastPublishMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "Terrain.h"
+#include "HeightField.h"
+#include "../../Common/SnapshotPublisher.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Read-only versions of the terrain for threads other than the one running
+// Terrain::Update (AI, physics, tools): the quadtree's selection after an
+// Update and the height data it was culled against. Versions are immutable
+// once published; readers take one through a TerrainSnapshots::Reader and
+// query it while the terrain moves on.
+
+// A selected tile as the snapshot keeps it; Tile itself is the terrain's
+// and changes under the reader.
+struct TileSnapshot
+{
+	int TileIndex = 0;
+	int Lod = 0;
+	float Size = 0.0f;
+	XMFLOAT3 WorldPos = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	BoundingBox Bounds;
+};
+
+struct TerrainSnapshot
+{
+	uint64_t Version = 0;               // counts publishes, from 1
+	uint64_t Frame = 0;                 // caller's frame number at Publish
+	XMFLOAT3 CameraPos = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	float WorldSize = 0.0f;
+	float HeightScale = 0.0f;
+	XMFLOAT3 Offset = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+	// The camera's LOD cut as Update left it, and each shadow view's
+	std::vector<TileSnapshot> Tiles;
+	std::vector<std::vector<TileSnapshot>> ShadowTiles;
+
+	// Tiles as a GridSize x GridSize grid over the root square, cells the
+	// size of the finest selected tile: index into Tiles, -1 where none
+	uint32_t GridSize = 0;
+	float GridOriginX = 0.0f;
+	float GridOriginZ = 0.0f;
+	float CellSize = 0.0f;
+	std::vector<int32_t> Cells;
+
+	// Shared by every version until the heights change; null without a map
+	std::shared_ptr<const HeightField> Heights;
+	uint64_t HeightsVersion = 0;
+
+	// The selection fields from terrain's last Update: everything but
+	// Version, Frame, CameraPos and the heights
+	void Capture(Terrain& terrain);
+
+	// The selected tile over (x, z), or null when none is
+	const TileSnapshot* FindTile(float x, float z) const;
+	// World height at (x, z) as Terrain.hlsl displaces it; Offset.y without heights
+	float HeightAt(float x, float z) const;
+};
+
+// The writer side: the thread that runs Terrain::Update publishes after it.
+class TerrainSnapshots
+{
+public:
+	typedef SnapshotPublisher<TerrainSnapshot> Publisher;
+	typedef Publisher::Reader Reader;
+	typedef Publisher::ReadScope ReadScope;
+
+	// Copies heights; versions published from now on share the copy. Old
+	// copies go with the last version that holds them.
+	void SetHeights(const HeightField& heights);
+	// A new version from terrain's last Update
+	void Publish(Terrain& terrain, uint64_t frame, const XMFLOAT3& cameraPos);
+
+	Publisher& GetPublisher() { return mPublisher; }
+	SnapshotStats GetStats() const { return mPublisher.GetStats(); }
+	double GetLastPublishMs() const { return mLastPublishMs; }
+
+private:
+	Publisher mPublisher;
+	std::shared_ptr<const HeightField> mHeights;
+	uint64_t mHeightsVersion = 0;
+	uint64_t mVersion = 0;
+	double mLastPublishMs = 0.0;
+};
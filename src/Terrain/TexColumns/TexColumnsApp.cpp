@@ -12,16 +12,39 @@
 #include "../../Common/imgui_impl_win32.h"
 
 #include "../../Common/Camera.h"
+#include "../../Common/BCEncoder.h"
+#include "../../Common/JobSystem.h"
+#include "../../Common/TaskGraph.h"
+#include "../../Common/FramePipeline.h"
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <chrono>
+#include <psapi.h>
 
 #include "FrameResource.h"
 #include "Terrain.h"
 #include "TAATexture.h"
+#include "PaintLayer.h"
+#include "BrushUndo.h"
+#include "TextureResidency.h"
+#include "MeshCooker.h"
+#include "LodSelector.h"
+#include "LooseOctree.h"
+#include "DynamicAabbTree.h"
+#include "HeightField.h"
+#include "OcclusionBuffer.h"
+#include "ShadowCascades.h"
+#include "Profiler.h"
+#include "InputJournal.h"
+#include "CameraControls.h"
+#include "TerrainMesh.h"
+#include "FrameRecorder.h"
+#include "FrameCapture.h"
+#include "FramePacket.h"
+#include "TerrainSnapshot.h"
+#include "D3D12CommandList.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -45,38 +68,62 @@ struct LodLevel
 	float SwitchDistance = 0.0f; // Расстояние, после которого используется этот LOD (или следующий, более низкий)
 	DirectX::BoundingBox Bounds; // Локальный BoundingBox для этого LOD-уровня
 	Material* LodMaterial = nullptr;
+	float Error = 0.0f; // Геометрическая ошибка упрощения в мировых единицах
 };
 float mSwitchDist = 10;
 
-struct RenderItem
+// Result of bringing one model's cooked file up to date
+struct MeshCook
+{
+	bool Ok = false;
+	bool Recooked = false;
+	std::string Error;
+	MeshOptimizeStats Stats;
+};
+
+// Copies that fill one streamed texture's replacement, recorded ahead of the
+// frame's passes: the mips it keeps from the old resource, and the missing
+// finer ones from an upload buffer. The resources are owned by the pending
+// entry in TexColumnsApp until the frame that records this has completed.
+struct ResidencyCopy
+{
+	ID3D12Resource* Source = nullptr;
+	ID3D12Resource* Dest = nullptr;
+	ID3D12Resource* Upload = nullptr;
+	std::vector<std::pair<UINT, UINT>> GpuCopies;                                 // dest, source subresource
+	std::vector<std::pair<UINT, D3D12_PLACED_SUBRESOURCE_FOOTPRINT>> UploadCopies; // dest subresource, upload layout
+};
+
+// FramePacket plus the frame's UI: ImGui's draw data with its own copies of
+// the draw lists, since the next NewFrame rebuilds ImGui's
+struct AppFramePacket : FramePacket
+{
+	ImDrawData Ui;
+	std::vector<ResidencyCopy> Residency;
+
+	AppFramePacket() = default;
+	AppFramePacket(const AppFramePacket&) = delete;
+	AppFramePacket& operator=(const AppFramePacket&) = delete;
+	~AppFramePacket() { ClearUi(); }
+
+	void ClearUi()
+	{
+		for (ImDrawList* list : Ui.CmdLists)
+			IM_DELETE(list);
+		Ui.Clear();
+	}
+};
+
+struct RenderItem : SceneObject
 {
 	bool isHaveLods = true;
 	std::vector<LodLevel> LodLevels; // Массив уровней детализации
 	int CurrentLodIndex = 0;         // Индекс текущего активного LOD
 	std::unordered_map<int, DirectX::XMFLOAT4X4> LodSavedTransforms;
 
-	RenderItem() = default;
+	RenderItem() { NumFramesDirty = gNumFrameResources; }
 	RenderItem(const RenderItem& rhs) = delete;
 
-	// World matrix of the shape that describes the object's local space
-	// relative to the world space, which defines the position, orientation,
-	// and scale of the object in the world.
-	XMFLOAT4X4 World = MathHelper::Identity4x4();
-	XMFLOAT4X4 PrevWorld = MathHelper::Identity4x4();
-	DirectX::XMFLOAT4X4 BaseWorld = MathHelper::Identity4x4(); // исходная матрица
-	DirectX::BoundingBox Bounds;
-	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
-
-
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
-
 	Material* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
 	//MeshGeometry* mDebugGeo = nullptr;
@@ -88,83 +135,23 @@ struct RenderItem
 	UINT IndexCount = 0;
 	UINT StartIndexLocation = 0;
 	int BaseVertexLocation = 0;
-	std::string Name;
 };
 
-//struct OctreeNode
-//{
-//	BoundingBox Bounds; // Границы этой ячейки
-//	std::vector<RenderItem*> Objects; // Объекты внутри этой ячейки
-//	std::unique_ptr<OctreeNode> Children[8]; // Дети (8 штук)
-//	bool IsLeaf = true; // Лист или нет
-//
-//	OctreeNode(const BoundingBox& bounds) : Bounds(bounds) {}
-//};
-
-//std::unique_ptr<OctreeNode> BuildOctree(
-//	const BoundingBox& bounds,
-//	const std::vector<RenderItem*>& objects,
-//	int currentDepth,
-//	int maxDepth)
-//{
-//	auto node = std::make_unique<OctreeNode>(bounds);
-//
-//	if (currentDepth >= maxDepth) {
-//		node->Objects = objects;
-//		return node;
-//	}
-//
-//	// Вычисляем центр бокса
-//	XMFLOAT3 min = bounds.Center;
-//	min.x -= bounds.Extents.x;
-//	min.y -= bounds.Extents.y;
-//	min.z -= bounds.Extents.z;
-//
-//	XMFLOAT3 max = bounds.Center;
-//	max.x += bounds.Extents.x;
-//	max.y += bounds.Extents.y;
-//	max.z += bounds.Extents.z;
-//
-//	XMFLOAT3 center = bounds.Center;
-//	XMFLOAT3 e = bounds.Extents;
-//
-//	// 8 новых AABB — каждый в четверти пространства
-//	BoundingBox childBoxes[8];
-//	int i = 0;
-//	for (int dx = 0; dx <= 1; dx++) {
-//		for (int dy = 0; dy <= 1; dy++) {
-//			for (int dz = 0; dz <= 1; dz++) {
-//				XMFLOAT3 childCenter = {
-//					min.x + e.x * (0.5f + dx),
-//					min.y + e.y * (0.5f + dy),
-//					min.z + e.z * (0.5f + dz)
-//				};
-//				BoundingBox child;
-//				child.Center = childCenter;
-//				child.Extents = { e.x * 0.5f, e.y * 0.5f, e.z * 0.5f };
-//				childBoxes[i++] = child;
-//			}
-//		}
-//	}
-//
-//	// Разбрасываем объекты по детям
-//	for (int i = 0; i < 8; i++) {
-//		std::vector<RenderItem*> childObjects;
-//		for (auto* obj : objects) {
-//			BoundingBox transformedBounds;
-//			obj->Bounds.Transform(transformedBounds, XMLoadFloat4x4(&obj->World));
-//			if (childBoxes[i].Intersects(transformedBounds)) {
-//				childObjects.push_back(obj);
-//			}
-//		}
-//
-//		if (!childObjects.empty()) {
-//			node->Children[i] = BuildOctree(childBoxes[i], childObjects, currentDepth + 1, maxDepth);
-//			node->IsLeaf = false;
-//		}
-//	}
-//	return node;
-//}
+static DrawItem MakeDrawItem(const RenderItem* ri)
+{
+	DrawItem item;
+	item.Geometry = ri->Geo->Id;
+	item.Topology = ri->PrimitiveType;
+	item.IndexCount = ri->IndexCount;
+	item.StartIndex = ri->StartIndexLocation;
+	item.BaseVertex = ri->BaseVertexLocation;
+	item.ObjCBIndex = ri->ObjCBIndex;
+	item.MatCBIndex = ri->Mat->MatCBIndex;
+	item.DiffuseSrv = ri->Mat->DiffuseSrvHeapIndex;
+	item.NormalSrv = ri->Mat->NormalSrvHeapIndex;
+	item.DisplacementSrv = ri->Mat->DisplacementSrvHeapIndex;
+	return item;
+}
 
 class TexColumnsApp : public D3DApp
 {
@@ -186,18 +173,40 @@ private:
 	virtual void OnMouseMove(WPARAM btnState, int x, int y)override;
 
 	void OnKeyboardInput(const GameTimer& gt);
+	void PollKeys();
+	void WatchJournalSettings();
+	void StartJournalRecording();
+	void StartJournalReplay();
+	bool ReplayJournalFrame(JournalFrame& frame);
+	bool JournalMouse(JournalEventType type, WPARAM btnState, int x, int y, bool& captured);
 	//void UpdateCamera(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateBrushCB(const GameTimer& gt);
+	void UpdatePaintLayer(const GameTimer& gt);
+	void UndoBrushStroke();
+	void RedoBrushStroke();
+	void CollectBrushRegion(FramePacket& packet);
+	void UploadBrushRegion(ID3D12GraphicsCommandList* cmdList, const FramePacket& packet);
+	void SavePaintLayer();
+	void LoadPaintLayer();
 	void UpdateTAA(const GameTimer& gt);
+	void RegisterResidentTextures();
+	void UpdateTextureResidency(const GameTimer& gt);
+	void UpdateMeshLods(const GameTimer& gt);
+	void ApplyResidencyChanges(const std::vector<ResidencyChange>& changes);
+	void CompleteResidencyUploads();
+	void RemapResidentSrvs(AppFramePacket& packet) const;
+	void RecordResidencyCopies(const AppFramePacket& packet);
 
-	//void BuildOctreeTree();
+	void BuildOctree();
 
 	void LoadDDSTexture(std::string name, std::wstring filename);
+	void QueueDDSTexture(std::string name, std::wstring filename);
 	void LoadDDSTexturesFromFolder(const std::wstring& folderPath);
+	void LoadQueuedTextures();
 	void LoadTextures();
 	void CreateBrushTexture(CD3DX12_CPU_DESCRIPTOR_HANDLE baseDescriptorHandle, int baseOffset);
 	void BuildRootSignature();
@@ -210,15 +219,16 @@ private:
 
 	void BuildDescriptorHeaps();
 	void BuildShadersAndInputLayout();
-	void BuildShapeGeometry();
+	std::unique_ptr<MeshGeometry> BuildShapeGeometry();
 	//void BuildDebugGeometry();
 
 	//void CreateBoundingBoxMesh(const BoundingBox& bbox, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices);
 	//void BuildDebugGeometry();
 	//void RenderBoundingBoxes();
 
-	void GenerateTileGeometry(const XMFLOAT3& worldPos, float tileSize, int lodLevel, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices);
-	void BuildTerrainGeometry();
+	std::unique_ptr<MeshGeometry> BuildTerrainGeometry();
+	// Creates the GPU buffers from the CPU copies and adds geo to mGeometries
+	void UploadGeometry(std::unique_ptr<MeshGeometry> geo);
 	void UpdateTerrain(const GameTimer& gt);
 	void InitTerrain();
 	void UpdateTerrainCBs(const GameTimer& gt);
@@ -230,19 +240,33 @@ private:
 
 	void RenderCustomMesh(std::string unique_name, std::string meshname, std::string materialName, XMMATRIX Scale, XMMATRIX Rotation, XMMATRIX Translation);
 	//void BuildMultiLODGeometry(std::string name, int nLODs, UINT& meshVertexOffset, UINT& meshIndexOffset, UINT& prevVertSize, UINT& prevIndSize, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo);
+	void CookCustomMesh(const std::string& name, MeshCook& cook);
 	void BuildCustomMeshGeometry(std::string name, UINT& meshVertexOffset, UINT& meshIndexOffset, UINT& prevVertSize, UINT& prevIndSize, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo);
 	void BuildAllCustomMeshes(UINT& meshVertexOffset, UINT& meshIndexOffset, UINT& prevVertSize, UINT& prevIndSize, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo);
 
 	void BuildRenderItems();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
-	void DrawCustomMeshes(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& customMeshes);
-	void DrawTilesRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<Tile*>& tiles);
-
-	//void UpdateVisibleItems(); // Метод для обновления видимости
+	void BuildRenderIds();
+	void UpdateFrameBindings();
+	void BindFrameResources(const FramePacket& packet);
+	void BeginCapture(const FramePacket& packet);
+	void EndCapture();
+	void GatherRenderItems(const std::vector<RenderItem*>& ritems, std::vector<DrawItem>& draws);
+	void GatherCustomMeshes(const std::vector<RenderItem*>& customMeshes, std::vector<DrawItem>& draws);
+	void GatherTiles(const std::vector<Tile*>& tiles, std::vector<DrawItem>& draws);
+	void CopyImGuiDrawData(AppFramePacket& packet);
+	void BuildFramePacket(AppFramePacket& packet);
+	void RenderFrame(const AppFramePacket& packet);
+	void UpdateRenderThread();
+
+	void UpdateVisibleItems(const GameTimer& gt);
+	void BuildTerrainOccluders();
+	void UpdateOcclusion(const GameTimer& gt);
+	void UpdateShadowCascades(const GameTimer& gt);
 	//void UpdateLODs(RenderItem* ri);
 
 	void InitImGui();
 	void SetupImGui();
+	void DrawProfilerWindow(const ImVec2& pos);
 
 	bool ScreenToWorld(int screenX, int screenY, XMFLOAT3& worldPos);
 
@@ -256,7 +280,6 @@ private:
 	void CreateTAADescriptors();
 	void BuildTAARootSignature();
 	void BuildFullscreenQuadGeometry();
-	void GenerateTransformedHaltonSequence(float viewSizeX, float viewSizeY, XMFLOAT2* outJitters);
 	//void UpdateHistoryTexture(ID3D12GraphicsCommandList* cmdList);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
@@ -265,12 +288,20 @@ private:
 	XMMATRIX mInvViewProj;
 
 	std::unordered_map<std::string, unsigned int>ObjectsMeshCount;
+	// Filled by the startup cook tasks, read by BuildCustomMeshGeometry
+	std::unordered_map<std::string, MeshCook> mMeshCooks;
+	// Simplified levels (1..) of every submesh, in object space, from the cooked file
+	std::unordered_map<std::string, std::vector<std::vector<LodLevel>>> mMeshLods;
 
 	std::vector<std::unique_ptr<FrameResource>> mFrameResources;
 	FrameResource* mCurrFrameResource = nullptr;
 	int mCurrFrameResourceIndex = 0;
 	//
 	std::unordered_map<std::string, int>TexOffsets;
+	// name -> file, loaded together by LoadQueuedTextures
+	std::vector<std::pair<std::string, std::wstring>> mQueuedTextures;
+	// Map DDS files and upload straight from the mapping instead of reading them into buffers
+	bool mUseMappedTextureLoads = true;
 	//
 	UINT mCbvSrvDescriptorSize = 0;
 
@@ -316,9 +347,70 @@ private:
 	UINT mBrushTextureWidth = 1024;
 	UINT mBrushTextureHeight = 1024;
 
-	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
+	// CPU copy of the brush canvas for undo/redo; kept in step with Brush.hlsl
+	std::unique_ptr<PaintLayer> mPaintLayer;
+	BrushUndo mBrushUndo;
+	BYTE* mBrushUploadData = nullptr;
+	PaintRect mBrushUploadRect;
+	UINT64 mBrushUploadFence = 0;
+	float mBrushUndoBudgetMB = 64.f;
+	double mLastStrokeCommitMs = 0.0;
+	double mLastUndoMs = 0.0;
+
+	std::wstring mPaintLayerFile = L"../../Textures/terrain_paint.dds";
+	double mLastPaintSaveMs = 0.0;                 // SaveDDS as a whole
+	double mLastPaintEncodeMs = 0.0;               // its BCEncoder::Encode calls alone
+	double mLastPaintEncodeMPixPerSec = 0.0;
+	double mLastPaintSavePSNR = 0.0;
+
+	// Mip streaming: finest mips are dropped/reloaded by on-screen size under a budget
+	TextureResidency mTextureResidency;
+	std::vector<std::string> mResidencyTextures;    // residency id -> mTextures key
+	std::unordered_map<int, int> mResidencyBySrv;   // SRV heap offset -> residency id
+	bool mUseTextureResidency = true;
+	float mResidencyBudgetMB = 256.f;
+	float mResidencyMipBias = 0.f;
+	int mResidencyInterval = 10;                    // frames between residency updates
+	int mResidencyFrame = 0;
+	double mLastResidencyApplyMs = 0.0;
+
+	// A change is uploaded in the next frame's command list and takes effect
+	// once that frame's fence has passed. Each streamed texture has two SRV
+	// slots, its TexOffsets one and mResidencySrvBase + id: the new view goes
+	// into whichever slot no frame in flight reads, and packets are pointed
+	// at it from then on. The old resource lives until its last frame is done.
+	struct ResidentSlot
+	{
+		int Srv = 0;                        // slot packets are built with
+		bool Pending = false;               // an upload is in flight
+		ComPtr<ID3D12Resource> Retired;     // previous resource, until RetireFrame completes
+		uint64_t RetireFrame = 0;
+	};
+	struct PendingResidency
+	{
+		int Texture = 0;
+		uint32_t OldMip = 0;
+		uint64_t Frame = 0;                 // packet that records the copies
+		ComPtr<ID3D12Resource> Resource;
+		ComPtr<ID3D12Resource> UploadHeap;
+	};
+	std::vector<ResidentSlot> mResidentSlots;         // per residency id
+	std::vector<PendingResidency> mResidencyPending;
+	std::vector<ResidencyCopy> mResidencyCopies;      // for the next packet
+	int mResidencySrvBase = 0;
+
+	// Custom mesh LODs: one entry per mStandCustomMeshes item, picked every frame
+	LodSelector mLodSelector;
+	bool mUseMeshLods = true;
+	float mLodPixelError = 1.0f;
+	float mLodBias = 0.f;
+	float mLodHysteresis = 0.15f;
+	UINT mLodSwitches = 0;                          // last frame
+	std::vector<UINT> mLodDraws;                    // per level, last frame
+	std::vector<UINT> mLodTriangles;
+	double mLastLodSelectMs = 0.0;
 
-	//std::unique_ptr<OctreeNode> mOctreeRoot;
+	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
 	ComPtr<ID3D12DescriptorHeap> mImGuiSrvDescriptorHeap;
 
@@ -338,12 +430,104 @@ private:
 
 
 
-	//std::vector<RenderItem*> mVisibleRitems;
-
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mStandCustomMeshes;
 	std::vector<RenderItem*> mOpaqueRitems;
 
+	// Draw records through FrameRecorder (FrameRecorder.h): ids of the device
+	// objects and the bindings each frame packet gets a copy of.
+	D3D12CommandList mRenderCommands;
+	FrameBindings mFrameBindings;
+	std::unordered_map<std::string, RenderId> mPipelineIds;
+
+	// Command capture (FrameCapture.h): the UI asks for one, the next Draw
+	// records through mCapture and saves frame_<n>.capture
+	CaptureCommandList mCapture;
+	bool mCaptureNextFrame = false;
+	std::string mCaptureStatus;
+
+	std::string mStartupStatus;
+
+	// Pipelined frames (FramePipeline.h): this thread runs Update and fills a
+	// packet, the render thread records and presents it while the next Update
+	// runs. mPacket is the one this frame fills: the pipeline's, or
+	// mSerialPacket when Draw records here. While the render thread runs it
+	// alone uses mCommandList, mCurrBackBuffer, mCurrentFence and the frame
+	// resources' Fence values; anything else that needs them drains it first.
+	FramePipeline<AppFramePacket> mRenderThread;
+	AppFramePacket mSerialPacket;
+	AppFramePacket* mPacket = &mSerialPacket;
+	bool mUseRenderThread = true;
+	uint64_t mSimulationFrame = 0;
+
+	// Read-only terrain for other threads (TerrainSnapshot.h): published after
+	// every Terrain::Update, with the heights the selection was culled against.
+	TerrainSnapshots mTerrainSnapshots;
+
+	// Frustum culling of custom meshes: static ones in a loose octree keyed by
+	// ObjCBIndex, animated ones in a dynamic BVH that is refitted as they move.
+	// Terrain tiles are culled by the terrain quadtree; the tessellated grid
+	// has no static bounds and is always drawn.
+	LooseOctree mOctree;
+	DynamicAabbTree mDynamicTree{ 0.5f };
+	std::vector<int32_t> mDynamicProxies;           // by ObjCBIndex, -1 for static items
+	BvhQueryStats mBvhStats;
+	UINT mBvhMoves = 0;
+	bool mUseOctreeCulling = true;
+	std::vector<uint32_t> mOctreeVisible;
+	std::vector<uint8_t> mItemVisible;              // by ObjCBIndex, bit v set when view v sees it
+	std::vector<RenderItem*> mVisibleCustomMeshes;
+	OctreeQueryStats mOctreeStats;
+	UINT mOctreeMoves = 0;
+	double mLastCullMs = 0.0;
+
+	// Software occlusion: conservative coarse meshes of the nearest visible
+	// tiles are rasterized on the CPU; tiles and meshes behind them are dropped.
+	HeightField mHeightField;                       // CPU copy of terrainDisp
+	OcclusionBuffer mOcclusion;
+	std::vector<std::vector<float>> mTileOccluders; // by tileIndex
+	std::vector<uint32_t> mOccluderIndices;
+	std::vector<Tile*> mOccluderOrder;
+	bool mUseOcclusionCulling = true;
+	bool mOcclusionReady = false;                   // mOcclusion holds this frame's occluders
+	int mOccluderCount = 64;
+	UINT mOccludedTiles = 0;
+	UINT mOccludedMeshes = 0;
+	double mLastOcclusionMs = 0.0;
+
+	// Shadow cascades of the key light, culled in the same queries as the
+	// camera: view 0 is the camera, view 1 + i cascade i. There is no shadow
+	// pass yet; the tile and caster lists are what it would draw.
+	XMFLOAT3 mLightDirection = { 0.57735f, -0.57735f, 0.57735f };
+	int mCascadeCount = 4;
+	float mShadowDistance = 1000.0f;
+	std::vector<ShadowCascade> mCascades;
+	std::vector<FrustumPlanes> mCullViews;
+	std::vector<std::vector<uint32_t>> mViewItems;          // ObjCBIndex by view
+	std::vector<std::vector<RenderItem*>> mShadowCasters;   // by cascade
+
+	// CPU profiler timeline (Profiler.h): shows the previous frame, Update
+	// through Present, unless paused.
+	ProfileFrame mProfilerFrame;
+	bool mProfilerPaused = false;
+	float mProfilerZoom = 1.0f;
+	std::string mProfilerStatus;
+
+	// Camera path for Tools/TerrainBench: one "pos look fovY" line per frame
+	std::ofstream mPathRecord;
+	UINT mPathFrames = 0;
+
+	// Input journal (InputJournal.h). While replaying, the frame delta, keys,
+	// mouse messages and watched settings come from the file and live mouse
+	// input is ignored. The brush canvas is not part of the journal: a
+	// replay paints over whatever is on it.
+	InputJournal mJournal;
+	JournalKeys mKeys;                // this frame, live or replayed
+	GameTimer mReplayTimer;
+	bool mJournalDispatch = false;    // OnMouse* called by the replay
+	bool mJournalCaptured = false;    // WantCaptureMouse of that message
+	std::string mJournalStatus;
+
 	PassConstants mMainPassCB;
 	BrushConstants mBrushCB;
 	TAAConstants mTAACB;
@@ -416,56 +600,25 @@ TexColumnsApp::TexColumnsApp(HINSTANCE hInstance)
 
 TexColumnsApp::~TexColumnsApp()
 {
+	// It submits to the queue flushed below
+	mRenderThread.Stop();
 	if (md3dDevice != nullptr)
 		FlushCommandQueue();
 }
 
-//void CollectVisibleRenderItems(
-//	const OctreeNode* node,
-//	const BoundingFrustum& frustum,
-//	std::vector<RenderItem*>& visibleItems)
-//{
-//	if (!node) return;
-//
-//	if (frustum.Contains(node->Bounds) == DISJOINT) {
-//		// Узел полностью вне фруструма — пропускаем
-//		return;
-//	}
-//
-//	if (node->IsLeaf) {
-//		// Лист — просто добавляем все объекты
-//		for (RenderItem* ri : node->Objects) {
-//			visibleItems.push_back(ri);
-//		}
-//	}
-//	else {
-//		// Рекурсивно обходим всех детей
-//		for (const auto& child : node->Children) {
-//			if (child) {
-//				CollectVisibleRenderItems(child.get(), frustum, visibleItems);
-//			}
-//		}
-//	}
-//}
-//
-//void TexColumnsApp::BuildOctreeTree() {
-//	BoundingBox sceneBounds;
-//	// Задать руками или вычислить AABB всей сцены
-//	sceneBounds.Center = XMFLOAT3(600, 10, 600); // примерно по сцене
-//	sceneBounds.Extents = XMFLOAT3(600, 100, 600);
-//
-//	std::vector<RenderItem*> allItems;
-//	for (auto& ri : mAllRitems) {
-//		allItems.push_back(ri.get());
-//	}
-//
-//	mOctreeRoot = BuildOctree(sceneBounds, allItems, 0, 5);
-//}
-
-
-
 bool TexColumnsApp::Initialize()
 {
+	Profiler::Get().SetThreadName("Main");
+	// Workers name themselves as they start; creating the system here makes
+	// this thread its owner
+	JobSystem::SetWorkerStartHook([](unsigned worker)
+	{
+		char name[32];
+		sprintf_s(name, "Job %u", worker);
+		Profiler::Get().SetThreadName(name);
+	});
+	JobSystem::Get();
+	PROFILE_SCOPE("Initialize");
 
 	if (!D3DApp::Initialize())
 		return false;
@@ -482,41 +635,54 @@ bool TexColumnsApp::Initialize()
 	
 	//BuildDebugGeometry();
 
-	LoadTextures();
-	//CreateBrushTexture();
-
-	BuildRootSignature();
-
-	BuildStandMeshRootSignature();
-	BuildTerrainRootSignature();
-	BuildCsRootSignature();
-
-
-
-	BuildDescriptorHeaps();
-	BuildMaterials();
-
-	//BuildDebugRootSignature();
-
-
-
-	BuildShadersAndInputLayout();
-	InitTAAResources();
-	InitTerrain();
-
-	BuildShapeGeometry();
-	BuildTerrainGeometry();
-
-
-
-	BuildRenderItems();
-	BuildFrameResources();
-	BuildPSOs();
-
-
-	//BuildOctreeTree();
-
-	InitImGui();
+	// Startup as a task graph. Anything that records on mCommandList or
+	// writes mGeometries is a main task, run one at a time on this thread, so
+	// every upload lands on the one list submitted below; device calls are
+	// free-threaded and run as worker tasks. mMaterials and TexOffsets are
+	// written along one chain (heaps, materials, residency, shapes).
+	const auto initStart = std::chrono::high_resolution_clock::now();
+	std::unique_ptr<MeshGeometry> shapeGeo, terrainGeo;
+	MeshCook& guardCook = mMeshCooks["Guard"];
+	MeshCook& maxwellCook = mMeshCooks["maxwell"];
+
+	TaskGraph startup;
+	using Queue = TaskGraph::Queue;
+	auto textures = startup.Add("LoadTextures", [this]() { LoadTextures(); }, {}, Queue::Main);
+	auto imgui = startup.Add("InitImGui", [this]() { InitImGui(); }, {}, Queue::Main);
+	auto rootSignature = startup.Add("BuildRootSignature", [this]() { BuildRootSignature(); });
+	auto standMeshRootSignature = startup.Add("BuildStandMeshRootSignature", [this]() { BuildStandMeshRootSignature(); });
+	auto terrainRootSignature = startup.Add("BuildTerrainRootSignature", [this]() { BuildTerrainRootSignature(); });
+	auto csRootSignature = startup.Add("BuildCsRootSignature", [this]() { BuildCsRootSignature(); });
+	auto shaders = startup.Add("BuildShadersAndInputLayout", [this]() { BuildShadersAndInputLayout(); });
+	auto terrain = startup.Add("InitTerrain", [this]() { InitTerrain(); });
+	auto cookGuard = startup.Add("CookMesh Guard", [this, &guardCook]() { CookCustomMesh("Guard", guardCook); });
+	auto cookMaxwell = startup.Add("CookMesh maxwell", [this, &maxwellCook]() { CookCustomMesh("maxwell", maxwellCook); });
+
+	auto heaps = startup.Add("BuildDescriptorHeaps", [this]() { BuildDescriptorHeaps(); }, { textures }, Queue::Main);
+	auto materials = startup.Add("BuildMaterials", [this]() { BuildMaterials(); }, { heaps });
+	auto residency = startup.Add("RegisterResidentTextures", [this]() { RegisterResidentTextures(); }, { materials });
+	auto taa = startup.Add("InitTAAResources", [this]() { InitTAAResources(); }, { heaps }, Queue::Main);
+
+	auto shapes = startup.Add("BuildShapeGeometry", [this, &shapeGeo]() { shapeGeo = BuildShapeGeometry(); },
+		{ cookGuard, cookMaxwell, residency });
+	auto terrainGeometry = startup.Add("BuildTerrainGeometry", [this, &terrainGeo]() { terrainGeo = BuildTerrainGeometry(); },
+		{ terrain });
+	auto uploadShapes = startup.Add("UploadShapeGeometry", [this, &shapeGeo]() { UploadGeometry(std::move(shapeGeo)); },
+		{ shapes }, Queue::Main);
+	auto uploadTerrain = startup.Add("UploadTerrainGeometry", [this, &terrainGeo]() { UploadGeometry(std::move(terrainGeo)); },
+		{ terrainGeometry }, Queue::Main);
+
+	auto renderItems = startup.Add("BuildRenderItems", [this]() { BuildRenderItems(); },
+		{ uploadShapes, uploadTerrain, materials });
+	auto frameResources = startup.Add("BuildFrameResources", [this]() { BuildFrameResources(); }, { renderItems });
+	// InitTAAResources builds the TAA root signature
+	auto psos = startup.Add("BuildPSOs", [this]() { BuildPSOs(); },
+		{ shaders, rootSignature, standMeshRootSignature, terrainRootSignature, csRootSignature, taa });
+	startup.Add("BuildOctree", [this]() { BuildOctree(); }, { renderItems });
+	startup.Add("BuildRenderIds", [this]() { BuildRenderIds(); },
+		{ psos, uploadShapes, uploadTerrain, frameResources, taa, imgui }, Queue::Main);
+
+	startup.Run(JobSystem::Get());
 
 	// Execute the initialization commands.
 	ThrowIfFailed(mCommandList->Close());
@@ -527,8 +693,20 @@ bool TexColumnsApp::Initialize()
 	FlushCommandQueue();
 	mTAACB.blendFactor = 0.01f;
 
+	std::vector<TaskGraph::TaskId> criticalPath;
+	const double criticalMs = startup.GetCriticalPath(&criticalPath);
+	const double initMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - initStart).count();
+	char startupMsg[256];
+	sprintf_s(startupMsg, "%.0f ms to first frame: graph %.0f ms on %u threads, %.0f ms of work, critical path %.0f ms",
+		initMs, startup.GetWallMs(), startup.GetThreadsUsed(), startup.GetBusyMs(), criticalMs);
+	mStartupStatus = startupMsg;
+	if (!criticalPath.empty())
+		mStartupStatus += std::string(" (ends with ") + startup.GetTiming(criticalPath.back()).Name + ")";
+	OutputDebugStringA(("Startup " + startup.Describe()).c_str());
 
-	GenerateTransformedHaltonSequence(mClientWidth, mClientHeight, jitters);
+
+	CameraControls::HaltonJitter((float)mClientWidth, (float)mClientHeight, _countof(jitters), jitters);
+	WatchJournalSettings();
 
 	return true;
 }
@@ -549,8 +727,22 @@ void TexColumnsApp::InitTAAResources()
 
 void TexColumnsApp::InitTerrain()
 {
+	PROFILE_SCOPE("InitTerrain");
 	mTerrain = std::make_unique<Terrain>();
-	mTerrain->Initialize(md3dDevice.Get(), mTerrainSize, mMaxLOD, terrainPos);
+	mTerrain->Initialize(mTerrainSize, mMaxLOD, terrainPos);
+
+	// Heights for culling. Terrain.hlsl maps u = x / mapSize from world x and
+	// offsets heights by the tile's y.
+	std::vector<uint8_t> rgba;
+	UINT width = 0, height = 0;
+	if (BCEncoder::LoadDDS(L"../../Textures/terrain_disp.dds", rgba, width, height))
+	{
+		mHeightField.Init(rgba.data(), width, height, (size_t)width * 4);
+		mHeightField.SetPlacement(0.0f, 0.0f, mTerrainSize, terrainPos.y, mTerrain->mHeightScale);
+		mTerrain->SetHeights(&mHeightField);
+		mTerrainSnapshots.SetHeights(mHeightField);
+		BuildTerrainOccluders();
+	}
 }
 
 void TexColumnsApp::InitImGui()
@@ -585,6 +777,8 @@ void TexColumnsApp::InitImGui()
 
 void TexColumnsApp::OnResize()
 {
+	// The back buffers, the SRV heap and the TAA targets are replaced
+	mRenderThread.Drain();
 	D3DApp::OnResize();
 	if (mTextures.size() > 0) {
 		BuildDescriptorHeaps();
@@ -611,13 +805,34 @@ void TexColumnsApp::OnResize()
 
 }
 
-void TexColumnsApp::Update(const GameTimer& gt)
+void TexColumnsApp::Update(const GameTimer& timer)
 {
 
 	/*for (auto rItem : mVisibleRitems) {
 		UpdateLODs(rItem);
 		//rItem->Mat = rItem->LodLevels[rItem->CurrentLodIndex].LodMaterial;
 	}*/
+	Profiler::Get().BeginFrame();
+	PROFILE_SCOPE("Update");
+
+	// Paced: returns once the render thread has taken the last packet, so
+	// this Update overlaps that frame's Draw
+	UpdateRenderThread();
+	{
+		PROFILE_SCOPE("WaitForRenderThread");
+		mPacket = mRenderThread.IsRunning() ? &mRenderThread.BeginPacket() : &mSerialPacket;
+	}
+
+	// A replayed frame runs on the recorded delta and input
+	JournalFrame journalFrame;
+	if (mJournal.IsReplaying() && !ReplayJournalFrame(journalFrame))
+		mJournal.Stop();
+	const GameTimer& gt = mJournal.IsReplaying() ? mReplayTimer : timer;
+
+	PollKeys();
+	if (mJournal.IsRecording())
+		mJournal.BeginFrame(gt.DeltaTime(), mKeys);
+
 	OnKeyboardInput(gt);
 
 	// Cycle through the circular frame resource array.
@@ -629,6 +844,7 @@ void TexColumnsApp::Update(const GameTimer& gt)
 	// If not, wait until the GPU has completed commands up to this fence point.
 	if (mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
 	{
+		PROFILE_SCOPE("WaitForGpu");
 		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
 		ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
 		WaitForSingleObject(eventHandle, INFINITE);
@@ -639,20 +855,31 @@ void TexColumnsApp::Update(const GameTimer& gt)
 
 	AnimateMaterials(gt);
 
+	UpdateShadowCascades(gt);
 	UpdateTerrain(gt);
+	UpdateOcclusion(gt);
+	UpdateMeshLods(gt);
+	UpdateTextureResidency(gt);
 
 	UpdateObjectCBs(gt);
+	UpdateVisibleItems(gt);
 	UpdateTerrainCBs(gt);
 
 	UpdateMainPassCB(gt);
 	UpdateBrushCB(gt);
+	UpdatePaintLayer(gt);
 	UpdateMaterialCBs(gt);
 
 	// TODO: Update TAA
 	UpdateTAA(gt);
 	//UpdateCamera(gt);
-	//UpdateVisibleItems();
 	SetupImGui();
+
+	// Settings changed by this frame's UI
+	if (mJournal.IsRecording())
+		mJournal.EndFrame();
+	else if (mJournal.IsReplaying())
+		mJournal.ApplySettings(journalFrame);
 }
 
 void TexColumnsApp::SetupImGui()
@@ -712,27 +939,266 @@ void TexColumnsApp::SetupImGui()
 	ImGui::SliderFloat("Falloff radius", &BrushFalloffRadius, 0.f, 500.f, "%.1f");
 	//ImGui::DragFloat("Radius", &BrushRadius, 1.f, 1.f, 500.f, "%.1f");
 	//ImGui::DragFloat("Falloff radius", &BrushFalloffRadius, 1.f, 0.f, 500.f, "%.1f");
-	static float col[4] = { 1.f, 1.f, 1.f, 1.f };
-	ImGui::ColorEdit4("Color", col);
-	BrushColor = {col[0], col[1], col[2], col[3]};
+	ImGui::ColorEdit4("Color", &BrushColor.x);
+
+	if (ImGui::Button("Undo (Ctrl+Z)")) UndoBrushStroke();
+	ImGui::SameLine();
+	if (ImGui::Button("Redo (Ctrl+Y)")) RedoBrushStroke();
+	ImGui::Text("History: %d undo / %d redo", (int)mBrushUndo.GetUndoCount(), (int)mBrushUndo.GetRedoCount());
+	ImGui::Text("History memory: %.2f MB", mBrushUndo.GetMemoryUsage() / (1024.0 * 1024.0));
+	if (ImGui::SliderFloat("History budget, MB", &mBrushUndoBudgetMB, 1.f, 512.f, "%.0f"))
+		mBrushUndo.SetMemoryBudget((size_t)(mBrushUndoBudgetMB * 1024.f * 1024.f));
+	ImGui::Text("Stroke commit: %.3f ms, undo: %.3f ms", mLastStrokeCommitMs, mLastUndoMs);
+
+	if (ImGui::Button("Save layer (BC3)")) SavePaintLayer();
+	ImGui::SameLine();
+	if (ImGui::Button("Load layer")) LoadPaintLayer();
+	if (mLastPaintSaveMs > 0.0)
+		ImGui::Text("Saved in %.2f ms, encode %.2f ms (%.0f MPix/s), PSNR %.2f dB", mLastPaintSaveMs,
+			mLastPaintEncodeMs, mLastPaintEncodeMPixPerSec, mLastPaintSavePSNR);
+
+	ImGui::Separator();
+
+	const ResidencyStats& residency = mTextureResidency.GetStats();
+	ImGui::Text("Texture residency:");
+	ImGui::Checkbox("Stream mips", &mUseTextureResidency);
+	if (ImGui::SliderFloat("Texture budget, MB", &mResidencyBudgetMB, 16.f, 2048.f, "%.0f"))
+		mTextureResidency.SetBudget((uint64_t)(mResidencyBudgetMB * 1024.f * 1024.f));
+	if (ImGui::SliderFloat("Mip bias", &mResidencyMipBias, -2.f, 4.f, "%.1f"))
+		mTextureResidency.SetMipBias(mResidencyMipBias);
+	ImGui::Text("Resident %.1f MB, wanted %.1f MB", residency.ResidentBytes / (1024.0 * 1024.0),
+		residency.WantedBytes / (1024.0 * 1024.0));
+	ImGui::Text("Last: %d in / %d out, %d starved, %.2f ms", residency.StreamIns, residency.Evictions,
+		residency.StarvedTextures, mLastResidencyApplyMs);
+
+	ImGui::Separator();
+
+	ImGui::Text("Culling:");
+	ImGui::Checkbox("Octree culling", &mUseOctreeCulling);
+	ImGui::Text("Visible %u / %u meshes, %.3f ms", (UINT)mVisibleCustomMeshes.size(), (UINT)mStandCustomMeshes.size(), mLastCullMs);
+	ImGui::Text("Nodes %u / %u, tested %u, accepted %u, moved %u", mOctreeStats.NodesVisited, (UINT)mOctree.GetNodeCount(),
+		mOctreeStats.ItemsTested, mOctreeStats.ItemsAccepted, mOctreeMoves);
+	ImGui::Text("BVH: %u dynamic, height %d, cost %.1f, visited %u, refit %u", (UINT)mDynamicTree.GetLeafCount(),
+		mDynamicTree.GetHeight(), mDynamicTree.ComputeCost(), mBvhStats.NodesVisited, mBvhMoves);
+	if (ImGui::Button("Rebuild BVH"))
+		mDynamicTree.Rebuild();
+
+	ImGui::Separator();
+
+	ImGui::Text("Occlusion:");
+	ImGui::Checkbox("Horizon culling", &mTerrain->mUseHorizonCulling);
+	ImGui::Text("Horizon hid %d quadtree nodes", mTerrain->mHorizonCulledNodes);
+	ImGui::Text("Visited %d quadtree nodes", mTerrain->mNodesVisited);
+	if (ImGui::Button(mPathRecord.is_open() ? "Stop recording" : "Record camera path"))
+	{
+		if (mPathRecord.is_open())
+			mPathRecord.close();
+		else
+		{
+			mPathRecord.open("camera_path.txt", std::ios::trunc);
+			mPathRecord.precision(9);
+			mPathRecord << "# posX posY posZ lookX lookY lookZ fovYDegrees, replay with TerrainBench --path camera_path.txt\n";
+			mPathFrames = 0;
+		}
+	}
+	if (mPathRecord.is_open() || mPathFrames > 0)
+	{
+		ImGui::SameLine();
+		ImGui::Text("%u frames", mPathFrames);
+	}
+	ImGui::Checkbox("Occlusion culling", &mUseOcclusionCulling);
+	ImGui::SliderInt("Occluder tiles", &mOccluderCount, 0, 256);
+	ImGui::Text("Hidden %u tiles, %u meshes, %.3f ms", mOccludedTiles, mOccludedMeshes, mLastOcclusionMs);
+	ImGui::Text("Triangles %u / %u", mOcclusion.GetStats().TrianglesDrawn, mOcclusion.GetStats().Triangles);
+
+	ImGui::Separator();
+
+	ImGui::Text("Shadow cascades:");
+	ImGui::SliderInt("Cascades", &mCascadeCount, 0, ViewCullState::MaxViews - 1);
+	ImGui::SliderFloat("Shadow distance", &mShadowDistance, 100.f, 5000.f, "%.0f");
+	for (size_t i = 0; i < mCascades.size(); ++i)
+	{
+		ImGui::Text("%d: %.0f..%.0f, %u tiles, %u meshes", (int)i, mCascades[i].SplitNear, mCascades[i].SplitFar,
+			i < mTerrain->GetShadowViewCount() ? (UINT)mTerrain->GetShadowTiles((uint32_t)i).size() : 0u,
+			i < mShadowCasters.size() ? (UINT)mShadowCasters[i].size() : 0u);
+	}
+
+	ImGui::Separator();
+
+	ImGui::Text("Mesh LODs:");
+	ImGui::Checkbox("Select LODs", &mUseMeshLods);
+	ImGui::SliderFloat("LOD bias", &mLodBias, -2.f, 4.f, "%.1f");
+	ImGui::SliderFloat("Pixel error", &mLodPixelError, 0.25f, 8.f, "%.2f");
+	ImGui::SliderFloat("Hysteresis", &mLodHysteresis, 0.f, 0.5f, "%.2f");
+	ImGui::Text("%u items, %u switches, %.3f ms", (UINT)mLodSelector.GetCount(), mLodSwitches, mLastLodSelectMs);
+	for (size_t l = 0; l < mLodDraws.size(); ++l)
+		ImGui::Text("LOD %d: %u draws, %u triangles", (int)l, mLodDraws[l], mLodTriangles[l]);
+
+	ImGui::Separator();
+
+	ImGui::Text("Input journal:");
+	if (mJournal.IsRecording())
+	{
+		if (ImGui::Button("Stop recording##journal"))
+		{
+			mJournal.Stop();
+			mJournalStatus = "Saved " + std::to_string(mJournal.GetFrame()) + " frames to input.journal";
+		}
+		ImGui::Text("Recording: %u frames, %.1f KB", mJournal.GetFrame(), mJournal.GetBytes() / 1024.0);
+	}
+	else if (mJournal.IsReplaying())
+	{
+		if (ImGui::Button("Stop replay"))
+			mJournal.Stop();
+		ImGui::Text("Replaying: frame %u / %u", mJournal.GetFrame(), mJournal.GetFrameCount());
+	}
+	else
+	{
+		if (ImGui::Button("Record##journal")) StartJournalRecording();
+		ImGui::SameLine();
+		if (ImGui::Button("Replay##journal")) StartJournalReplay();
+	}
+	if (!mJournalStatus.empty())
+		ImGui::TextWrapped("%s", mJournalStatus.c_str());
+
+	ImGui::Text("Command capture:");
+	if (ImGui::Button("Capture frame"))
+		mCaptureNextFrame = true;
+	if (!mCaptureStatus.empty())
+		ImGui::TextWrapped("%s", mCaptureStatus.c_str());
+
+	ImGui::Text("Startup:");
+	ImGui::TextWrapped("%s", mStartupStatus.c_str());
+
+	ImGui::Text("Render thread:");
+	ImGui::Checkbox("Record and present on a render thread", &mUseRenderThread);
+	if (mRenderThread.IsRunning())
+	{
+		const FramePipelineStats s = mRenderThread.GetStats();
+		const double frames = (std::max)(1.0, (double)s.Rendered);
+		ImGui::Text("%llu frames, per frame: Update waited %.2f ms, render thread idle %.2f ms, handoff %.2f ms",
+			(unsigned long long)s.Rendered, s.SimulationWaitMs / frames, s.RenderIdleMs / frames, s.HandoffMs / frames);
+	}
+
+	{
+		const SnapshotStats s = mTerrainSnapshots.GetStats();
+		ImGui::Text("Terrain snapshots: %llu published in %.3f ms, %u held by readers, %llu reclaimed, %llu allocated, %u readers",
+			(unsigned long long)s.Published, mTerrainSnapshots.GetLastPublishMs(), s.Retired,
+			(unsigned long long)s.Reclaimed, (unsigned long long)s.Allocated, s.Readers);
+	}
 
 	ImGui::Separator();
 	ImGui::Checkbox("Use TAA: ", &useTaa);
 	ImGui::DragFloat("Blendfactor", &mTAACB.blendFactor, 0.01f, 0.0f, 1.0f);
 
+	const ImVec2 settingsPos = ImGui::GetWindowPos();
+	const ImVec2 settingsSize = ImGui::GetWindowSize();
 	ImGui::End();
 
+	DrawProfilerWindow(ImVec2(settingsPos.x + settingsSize.x + 8.0f, settingsPos.y));
+
+
+}
+
+static ImU32 ProfileZoneColor(const char* name)
+{
+	// Same name, same colour, whichever string literal it came from
+	uint32_t hash = 2166136261u;
+	for (const char* c = name; c && *c; ++c)
+		hash = (hash ^ (uint8_t)*c) * 16777619u;
+	return ImColor::HSV((hash % 360) / 360.0f, 0.5f, 0.75f);
+}
+
+void TexColumnsApp::DrawProfilerWindow(const ImVec2& pos)
+{
+	Profiler& profiler = Profiler::Get();
+	if (!mProfilerPaused)
+		mProfilerFrame = profiler.GetLastFrame();
+
+	ImGui::SetNextWindowPos(pos, ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(640.0f, 320.0f), ImGuiCond_FirstUseEver);
+	ImGui::Begin("Profiler");
+
+	bool recording = profiler.IsEnabled();
+	if (ImGui::Checkbox("Record", &recording))
+		profiler.SetEnabled(recording);
+	ImGui::SameLine();
+	ImGui::Checkbox("Pause", &mProfilerPaused);
+	ImGui::SameLine();
+	if (ImGui::Button("Export trace"))
+	{
+		const char* path = "profile_trace.json";
+		mProfilerStatus = profiler.WriteChromeTrace(path)
+			? std::string("Wrote ") + path + " (" + std::to_string(profiler.GetHistorySize()) + " zones)"
+			: std::string("Failed to write ") + path;
+	}
+	ImGui::SameLine();
+	ImGui::Text("%s", mProfilerStatus.c_str());
+
+	const ProfileFrame& frame = mProfilerFrame;
+	const uint64_t span = (std::max)(frame.End - frame.Start, (uint64_t)1);
+	ImGui::Text("Frame %.3f ms, %u zones, %u dropped", span / 1e6, (UINT)frame.Zones.size(), (UINT)profiler.GetDroppedZones());
+	ImGui::SliderFloat("Zoom", &mProfilerZoom, 1.0f, 32.0f, "%.1fx");
+
+	// One lane per thread, one row per nesting level; zones come sorted by
+	// thread, then start
+	const std::vector<std::string> threads = profiler.GetThreadNames();
+	ImGui::BeginChild("Timeline", ImVec2(0.0f, 0.0f), ImGuiChildFlags_Borders, ImGuiWindowFlags_HorizontalScrollbar);
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	const ImVec2 origin = ImGui::GetCursorScreenPos();
+	const ImVec2 mouse = ImGui::GetIO().MousePos;
+	const float width = ImGui::GetContentRegionAvail().x * mProfilerZoom;
+	const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+	const ProfileZone* hovered = nullptr;
+	float y = origin.y;
+
+	for (size_t i = 0; i < frame.Zones.size();)
+	{
+		const uint32_t thread = frame.Zones[i].Thread;
+		drawList->AddText(ImVec2(origin.x, y), ImGui::GetColorU32(ImGuiCol_Text),
+			thread < threads.size() ? threads[thread].c_str() : "?");
+		y += rowHeight;
+
+		uint32_t maxDepth = 0;
+		for (; i < frame.Zones.size() && frame.Zones[i].Thread == thread; ++i)
+		{
+			const ProfileZone& zone = frame.Zones[i];
+			const uint64_t start = (std::max)(zone.Start, frame.Start);
+			const uint64_t end = (std::max)(zone.End, start);
+			const float x0 = origin.x + (float)((start - frame.Start) / (double)span) * width;
+			const float x1 = (std::max)(origin.x + (float)((end - frame.Start) / (double)span) * width, x0 + 1.0f);
+			const float top = y + zone.Depth * rowHeight;
+			const ImVec2 zoneMin(x0, top), zoneMax(x1, top + rowHeight - 1.0f);
+			drawList->AddRectFilled(zoneMin, zoneMax, ProfileZoneColor(zone.Name));
+			if (ImGui::CalcTextSize(zone.Name).x + 4.0f <= x1 - x0)
+				drawList->AddText(ImVec2(x0 + 2.0f, top + 2.0f), IM_COL32(0, 0, 0, 255), zone.Name);
+			if (mouse.x >= zoneMin.x && mouse.x < zoneMax.x && mouse.y >= zoneMin.y && mouse.y < zoneMax.y)
+				hovered = &zone;
+			maxDepth = (std::max)(maxDepth, zone.Depth);
+		}
+		y += (maxDepth + 1) * rowHeight + 4.0f;
+	}
+	ImGui::Dummy(ImVec2(width, y - origin.y));
+	if (hovered && ImGui::IsWindowHovered())
+		ImGui::SetTooltip("%s\n%.3f ms", hovered->Name, (hovered->End - hovered->Start) / 1e6);
+	ImGui::EndChild();
 
+	ImGui::End();
 }
 
 void TexColumnsApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
+	bool captured;
+	if (!JournalMouse(JournalEventType::MouseDown, btnState, x, y, captured))
+		return;
+
 	mLastMousePos.x = x;
 	mLastMousePos.y = y;
 
 	if ((btnState & MK_LBUTTON) != 0)
 	{
-		//do left click
+		if (controlMode == 1 && mPaintLayer && !captured)
+			mBrushUndo.BeginStroke(*mPaintLayer);
 	}
 
 	SetCapture(mhMainWnd);
@@ -740,22 +1206,32 @@ void TexColumnsApp::OnMouseDown(WPARAM btnState, int x, int y)
 
 void TexColumnsApp::OnMouseUp(WPARAM btnState, int x, int y)
 {
+	bool captured;
+	if (!JournalMouse(JournalEventType::MouseUp, btnState, x, y, captured))
+		return;
+
+	if (mBrushUndo.IsInStroke())
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		mBrushUndo.EndStroke(*mPaintLayer);
+		mLastStrokeCommitMs = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count();
+	}
+	mIsPainting = 0;
+
 	ReleaseCapture();
 }
 
 void TexColumnsApp::OnMouseMove(WPARAM btnState, int x, int y)
 {
-	if (!ImGui::GetIO().WantCaptureMouse)
+	bool captured;
+	if (!JournalMouse(JournalEventType::MouseMove, btnState, x, y, captured))
+		return;
+
+	if (!captured)
 	{
 		if ((btnState & MK_RBUTTON) != 0)
-		{
-			// Make each pixel correspond to a quarter of a degree.
-			float dx = XMConvertToRadians(0.25f * static_cast<float>(x - mLastMousePos.x));
-			float dy = XMConvertToRadians(0.25f * static_cast<float>(y - mLastMousePos.y));
-
-			mCamera.Pitch(dy);
-			mCamera.RotateY(dx);
-		}
+			CameraControls::Look(mCamera, x - mLastMousePos.x, y - mLastMousePos.y);
 		//Control mode HERE
 		switch (controlMode)
 		{
@@ -801,307 +1277,1163 @@ void TexColumnsApp::OnKeyboardInput(const GameTimer& gt)
 {
 	const float dt = gt.DeltaTime();
 
-	bool shiftPressed = (GetAsyncKeyState(VK_SHIFT) & 0x8000) != 0;
+	CameraControls::Fly(mCamera, mKeys, dt, mCameraHorSpeed, mCameraVertSpeed);
+
+	// Ctrl+Z / Ctrl+Y, triggered once per key press
+	static bool undoHeld = false;
+	static bool redoHeld = false;
+	bool ctrlPressed = mKeys[VK_CONTROL];
+	bool undoDown = ctrlPressed && mKeys['Z'];
+	bool redoDown = ctrlPressed && mKeys['Y'];
+	if (undoDown && !undoHeld) UndoBrushStroke();
+	if (redoDown && !redoHeld) RedoBrushStroke();
+	undoHeld = undoDown;
+	redoHeld = redoDown;
 
-	if (GetAsyncKeyState('W') & 0x8000)
+	mCamera.UpdateViewMatrix();
+}
+
+void TexColumnsApp::PollKeys()
+{
+	if (mJournal.IsReplaying())
+	{
+		mKeys = mJournal.GetKeys();
+		return;
+	}
+
+	// Every key OnKeyboardInput reads
+	static const int keys[] = { 'W', 'A', 'S', 'D', 'Z', 'Y', VK_SHIFT, VK_CONTROL };
+	mKeys.reset();
+	for (int key : keys)
+		mKeys[key] = (GetAsyncKeyState(key) & 0x8000) != 0;
+}
+
+void TexColumnsApp::WatchJournalSettings()
+{
+	mJournal.WatchSetting("fill_solid", &isFillModeSolid);
+	mJournal.WatchSetting("camera.speed_h", &mCameraHorSpeed);
+	mJournal.WatchSetting("camera.speed_v", &mCameraVertSpeed);
+	mJournal.WatchSetting("tess.scale", &mScale);
+	mJournal.WatchSetting("tess.factor", &mTessellationFactor);
+	mJournal.WatchSetting("bounds.show", &showTilesBoundingBox);
+	mJournal.WatchSetting("control_mode", &controlMode);
+	mJournal.WatchSetting("brush.radius", &BrushRadius);
+	mJournal.WatchSetting("brush.falloff", &BrushFalloffRadius);
+	mJournal.WatchSetting("brush.r", &BrushColor.x);
+	mJournal.WatchSetting("brush.g", &BrushColor.y);
+	mJournal.WatchSetting("brush.b", &BrushColor.z);
+	mJournal.WatchSetting("brush.a", &BrushColor.w);
+	mJournal.WatchSetting("terrain.horizon", &mTerrain->mUseHorizonCulling);
+	mJournal.WatchSetting("occlusion.enabled", &mUseOcclusionCulling);
+	mJournal.WatchSetting("occlusion.tiles", &mOccluderCount);
+	mJournal.WatchSetting("shadows.cascades", &mCascadeCount);
+	mJournal.WatchSetting("shadows.distance", &mShadowDistance);
+	mJournal.WatchSetting("lods.enabled", &mUseMeshLods);
+	mJournal.WatchSetting("lods.bias", &mLodBias);
+	mJournal.WatchSetting("lods.pixel_error", &mLodPixelError);
+	mJournal.WatchSetting("lods.hysteresis", &mLodHysteresis);
+	mJournal.WatchSetting("taa.enabled", &useTaa);
+	mJournal.WatchSetting("taa.blend", &mTAACB.blendFactor);
+}
+
+void TexColumnsApp::StartJournalRecording()
+{
+	JournalHeader header;
+	header.ClientWidth = (uint32_t)mClientWidth;
+	header.ClientHeight = (uint32_t)mClientHeight;
+	const XMFLOAT3 eye = mCamera.GetPosition3f();
+	const XMFLOAT3 look = mCamera.GetLook3f();
+	const XMFLOAT3 up = mCamera.GetUp3f();
+	memcpy(header.Position, &eye, sizeof(header.Position));
+	memcpy(header.Look, &look, sizeof(header.Look));
+	memcpy(header.Up, &up, sizeof(header.Up));
+	header.FovY = mCamera.GetFovY();
+	header.MouseX = mLastMousePos.x;
+	header.MouseY = mLastMousePos.y;
+
+	mJournalStatus.clear();
+	if (!mJournal.StartRecording("input.journal", header))
+		mJournalStatus = mJournal.GetError();
+}
+
+void TexColumnsApp::StartJournalReplay()
+{
+	if (!mJournal.StartReplay("input.journal"))
+	{
+		mJournalStatus = mJournal.GetError();
+		return;
+	}
+
+	const JournalHeader& header = mJournal.GetHeader();
+	const XMFLOAT3 eye(header.Position[0], header.Position[1], header.Position[2]);
+	const XMFLOAT3 target(eye.x + header.Look[0], eye.y + header.Look[1], eye.z + header.Look[2]);
+	const XMFLOAT3 up(header.Up[0], header.Up[1], header.Up[2]);
+	mCamera.LookAt(eye, target, up);
+	mCamera.UpdateViewMatrix();
+	mLastMousePos.x = header.MouseX;
+	mLastMousePos.y = header.MouseY;
+	mReplayTimer.Reset();
+
+	mJournalStatus.clear();
+	if (header.ClientWidth != (uint32_t)mClientWidth || header.ClientHeight != (uint32_t)mClientHeight)
+		mJournalStatus = "Recorded at " + std::to_string(header.ClientWidth) + "x" + std::to_string(header.ClientHeight)
+			+ ", brush positions will differ";
+}
+
+bool TexColumnsApp::ReplayJournalFrame(JournalFrame& frame)
+{
+	if (!mJournal.ReadFrame(frame))
+	{
+		mJournalStatus = "Replayed " + std::to_string(mJournal.GetFrame()) + " frames";
+		return false;
+	}
+
+	mReplayTimer.Advance(frame.Dt);
+
+	// Mouse messages that arrived before this frame
+	mJournalDispatch = true;
+	for (const auto& e : frame.Events)
+	{
+		mJournalCaptured = e.Captured;
+		if (e.Type == JournalEventType::MouseDown) OnMouseDown(e.Buttons, e.X, e.Y);
+		else if (e.Type == JournalEventType::MouseUp) OnMouseUp(e.Buttons, e.X, e.Y);
+		else if (e.Type == JournalEventType::MouseMove) OnMouseMove(e.Buttons, e.X, e.Y);
+	}
+	mJournalDispatch = false;
+	return true;
+}
+
+bool TexColumnsApp::JournalMouse(JournalEventType type, WPARAM btnState, int x, int y, bool& captured)
+{
+	// Live mouse input would fight the replay
+	if (mJournal.IsReplaying() && !mJournalDispatch)
+		return false;
+
+	captured = mJournalDispatch ? mJournalCaptured : ImGui::GetIO().WantCaptureMouse;
+	mJournal.RecordMouse(type, (uint8_t)btnState, captured, x, y);
+	return true;
+}
+
+bool TexColumnsApp::ScreenToWorld(int screenX, int screenY, XMFLOAT3& worldPos)
+{
+	// Луч через пиксель против плоскости y = 0 (mInvViewProj без джиттера)
+	XMFLOAT3 intersectPos;
+	if (CameraControls::PickGroundPlane(mInvViewProj, screenX, screenY, mClientWidth, mClientHeight, intersectPos))
+	{
+		// Проверяем границы террейна в плоскости XZ
+		if (intersectPos.x >= terrainPos.x && intersectPos.x <= terrainPos.x + mTerrainSize &&
+			intersectPos.z >= terrainPos.z && intersectPos.z <= terrainPos.z + mTerrainSize)
+		{
+			worldPos = intersectPos;
+			std::string debugMsg = "HIT: Projected to terrain plane at Y=" + std::to_string(intersectPos.y) + "\n";
+			OutputDebugStringA(debugMsg.c_str());
+			return true;
+		}
+	}
+
+	OutputDebugStringA("MISS: No intersection with terrain bounds\n");
+	return false;
+}
+
+//void TexColumnsApp::UpdateCamera(const GameTimer& gt)
+//{
+//	// Convert Spherical to Cartesian coordinates.
+//	float x = mRadius * sinf(mPhi) * cosf(mTheta);
+//	float z = mRadius * sinf(mPhi) * sinf(mTheta);
+//	float y = mRadius * cosf(mPhi);
+//
+//	// Build the view matrix.
+//	XMVECTOR pos = XMVectorSet(x, y, z, 1.0f);
+//	XMVECTOR target = XMVectorZero();
+//	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+//
+//	XMVECTOR campos =mCamera.GetPosition();
+//	pos = XMVectorSet(campos.m128_f32[0], campos.m128_f32[1], campos.m128_f32[2], 0.0f);
+//	target = mCamera.GetLook();
+//	up = mCamera.GetUp();
+//
+//	XMMATRIX view = XMMatrixLookToLH(pos, target, up);
+//	XMStoreFloat4x4(&mCamera.GetView4x4f(), view);
+//	mCamera.UpdateViewMatrix();
+//}
+
+
+void TexColumnsApp::AnimateMaterials(const GameTimer& gt)
+{
+
+}
+
+void TexColumnsApp::UpdateObjectCBs(const GameTimer& gt)
+{
+	PROFILE_SCOPE("UpdateObjectCBs");
+	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
+	const float totalTime = gt.TotalTime();
+	// Every item writes its own element, so ranges of items can run as jobs
+	JobSystem::Get().ParallelFor(mAllRitems.size(), 64, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			// Only update the cbuffer data if the constants have changed.  
+			// This needs to be tracked per frame resource.
+			RenderItem* e = mAllRitems[i].get();
+			ObjectConstants objConstants;
+			if (e->UpdateConstants(totalTime, gNumFrameResources, objConstants))
+				currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+		}
+	});
+}
+
+void TexColumnsApp::UpdateMaterialCBs(const GameTimer& gt)
+{
+	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
+	for (auto& e : mMaterials)
+	{
+		// Only update the cbuffer data if the constants have changed.  If the cbuffer
+		// data changes, it needs to be updated for each FrameResource.
+		Material* mat = e.second.get();
+		if (mat->NumFramesDirty > 0)
+		{
+			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
+
+			MaterialConstants matConstants;
+			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
+			matConstants.FresnelR0 = mat->FresnelR0;
+			matConstants.Roughness = mat->Roughness;
+			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+
+			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+
+			// Next FrameResource need to be updated too.
+			mat->NumFramesDirty--;
+		}
+	}
+}
+
+void TexColumnsApp::UpdateMainPassCB(const GameTimer& gt)
+{
+	PROFILE_SCOPE("UpdateMainPassCB");
+
+	XMMATRIX view = mCamera.GetView();
+	XMMATRIX proj = mCamera.GetProj();
+	//static XMMATRIX lastViewProj = XMMatrixIdentity();
+
+	//XMStoreFloat4x4(&mMainPassCB.PrevViewProj , XMMatrixTranspose(lastViewProj));
+
+	//TODO:
+	XMMATRIX proj_jittered = proj;
+	if (useTaa)
+	{
+		proj_jittered.r[2].m128_f32[0] += jitters[frameIndex].x;
+		proj_jittered.r[2].m128_f32[1] += jitters[frameIndex].y;
+	}
+
+	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
+    mInvViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+
+	XMMATRIX viewProj_jittered = XMMatrixMultiply(view, proj_jittered);
+	//lastViewProj = viewProj_jittered;
+
+	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
+	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
+	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
+	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
+
+	mMainPassCB.PrevViewProj =mMainPassCB.ViewProj;
+
+	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
+	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(mInvViewProj));
+
+	XMStoreFloat4x4(&mMainPassCB.JitteredViewProj, XMMatrixTranspose(viewProj_jittered));
+
+	mMainPassCB.EyePosW = mCamera.GetPosition3f();
+	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
+	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
+	mMainPassCB.NearZ = 1.0f;
+	mMainPassCB.FarZ = mCamera.cameraFarZ;
+	mMainPassCB.TotalTime = gt.TotalTime();
+	mMainPassCB.DeltaTime = gt.DeltaTime();
+
+	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
+
+	mMainPassCB.Lights[0].Direction = mLightDirection;
+	mMainPassCB.Lights[0].Strength = { 0.8f, 0.8f, 0.8f };
+
+	mMainPassCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
+	mMainPassCB.Lights[1].Strength = { 0.4f, 0.4f, 0.4f };
+
+	mMainPassCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
+	mMainPassCB.Lights[2].Strength = { 0.2f, 0.2f, 0.2f };
+
+	mMainPassCB.gScale = mScale;
+	mMainPassCB.gTessellationFactor = mTessellationFactor;
+
+	auto currPassCB = mCurrFrameResource->PassCB.get();
+	currPassCB->CopyData(0, mMainPassCB);
+}
+
+void TexColumnsApp::UpdateTAA(const GameTimer& gt)
+{
+	auto TaaCB = mCurrFrameResource->TAACB.get();
+	TaaCB->CopyData(0, mTAACB);
+}
+
+void TexColumnsApp::UpdateBrushCB(const GameTimer& gt)
+{
+	mBrushCB.BrushRadius = BrushRadius;
+	mBrushCB.BrushFalofRadius = BrushFalloffRadius;
+	mBrushCB.BrushColors = BrushColor;
+	mBrushCB.isBrushMode = controlMode == 1 ? 1 : 0;
+	mBrushCB.isPainting = mIsPainting == 1 ? 1 : 0;
+
+	auto currBrushCB = mCurrFrameResource->BrushCB.get();
+	currBrushCB->CopyData(0, mBrushCB);
+}
+
+void TexColumnsApp::UpdatePaintLayer(const GameTimer& gt)
+{
+	// Repeat on the CPU exactly what BrushCS is about to do this frame,
+	// so the undo journal sees the same texels as the GPU canvas.
+	if (!mPaintLayer || !mIsPainting)
+		return;
+
+	auto& visibleTiles = mTerrain->GetVisibleTiles();
+	if (visibleTiles.empty())
+		return;
+
+	const Tile* tile = visibleTiles[0];
+	const float mapSize = mTerrain->mWorldSize;
+
+	BrushStamp stamp;
+	stamp.U = (mBrushCB.BrushWPos.x - tile->worldPos.x) / mapSize;
+	stamp.V = (mBrushCB.BrushWPos.z - tile->worldPos.z) / mapSize;
+	stamp.RadiusUV = BrushRadius / mapSize;
+	stamp.FalloffUV = BrushFalloffRadius / mapSize;
+	stamp.Color[0] = BrushColor.x;
+	stamp.Color[1] = BrushColor.y;
+	stamp.Color[2] = BrushColor.z;
+	stamp.Color[3] = BrushColor.w;
+
+	mBrushUndo.Paint(*mPaintLayer, stamp);
+}
+
+void TexColumnsApp::UndoBrushStroke()
+{
+	if (!mPaintLayer)
+		return;
+
+	PaintRect restored;
+	auto start = std::chrono::high_resolution_clock::now();
+	if (mBrushUndo.Undo(*mPaintLayer, restored))
+	{
+		mLastUndoMs = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count();
+		mBrushUploadRect.Merge(restored);
+		mIsPainting = 0;
+	}
+}
+
+void TexColumnsApp::RedoBrushStroke()
+{
+	if (!mPaintLayer)
+		return;
+
+	PaintRect restored;
+	if (mBrushUndo.Redo(*mPaintLayer, restored))
+	{
+		mBrushUploadRect.Merge(restored);
+		mIsPainting = 0;
+	}
+}
+
+// Texels undo/redo restored, copied out of the paint layer into this frame's
+// packet, so the render side never reads mPaintLayer
+void TexColumnsApp::CollectBrushRegion(FramePacket& packet)
+{
+	packet.BrushUpload = mBrushUploadRect;
+	mBrushUploadRect = PaintRect();
+	if (packet.BrushUpload.Empty())
+		return;
+
+	const PaintRect& r = packet.BrushUpload;
+	packet.BrushUploadPitch = ((r.X1 - r.X0) * 4 + D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1)
+		& ~(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+	packet.BrushUploadPixels.resize((size_t)packet.BrushUploadPitch * (r.Y1 - r.Y0));
+	mPaintLayer->ReadRect(r, packet.BrushUploadPixels.data(), packet.BrushUploadPitch);
+}
+
+void TexColumnsApp::UploadBrushRegion(ID3D12GraphicsCommandList* cmdList, const FramePacket& packet)
+{
+	const PaintRect& r = packet.BrushUpload;
+	if (r.Empty())
+		return;
+
+	// The upload heap is shared by all frames - wait until the last copy is done.
+	if (mBrushUploadFence != 0 && mFence->GetCompletedValue() < mBrushUploadFence)
+	{
+		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+		ThrowIfFailed(mFence->SetEventOnCompletion(mBrushUploadFence, eventHandle));
+		WaitForSingleObject(eventHandle, INFINITE);
+		CloseHandle(eventHandle);
+	}
+
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+	footprint.Offset = 0;
+	footprint.Footprint.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	footprint.Footprint.Width = r.X1 - r.X0;
+	footprint.Footprint.Height = r.Y1 - r.Y0;
+	footprint.Footprint.Depth = 1;
+	footprint.Footprint.RowPitch = packet.BrushUploadPitch;
+
+	memcpy(mBrushUploadData, packet.BrushUploadPixels.data(), packet.BrushUploadPixels.size());
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
+		mBrushTexture.Get(),
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_COPY_DEST));
+
+	CD3DX12_TEXTURE_COPY_LOCATION dst(mBrushTexture.Get(), 0);
+	CD3DX12_TEXTURE_COPY_LOCATION src(mBrushTextureUpload.Get(), footprint);
+	cmdList->CopyTextureRegion(&dst, r.X0, r.Y0, 0, &src, nullptr);
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
+		mBrushTexture.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	// Fence value this frame is going to signal
+	mBrushUploadFence = mCurrentFence + 1;
+}
+
+void TexColumnsApp::SavePaintLayer()
+{
+	if (!mPaintLayer)
+		return;
+
+	const UINT width = mBrushTextureWidth;
+	const UINT height = mBrushTextureHeight;
+	std::vector<uint8_t> rgba((size_t)width * height * 4);
+	PaintRect full = { 0, 0, (int)width, (int)height };
+	mPaintLayer->ReadRect(full, rgba.data(), width * 4);
+
+	// BC3 only: alpha is the blend weight Terrain.hlsl lerps the paint in
+	// with, and BC1 would store it as opaque everywhere
+	const BCEncoder::Format format = BCEncoder::Format::BC3;
+
+	BCEncoder::SaveStats stats;
+	if (!BCEncoder::SaveDDS(mPaintLayerFile, format, rgba.data(), width, height, width * 4, true, 0, &stats))
+	{
+		OutputDebugStringW((L"Failed to save paint layer: " + mPaintLayerFile + L"\n").c_str());
+		return;
+	}
+	mLastPaintSaveMs = stats.TotalMs;
+	mLastPaintEncodeMs = stats.EncodeMs;
+	mLastPaintEncodeMPixPerSec = stats.EncodeMs > 0.0 ? stats.EncodedPixels / (stats.EncodeMs * 1000.0) : 0.0;
+
+	// Read the file back through the decoder to report what was actually stored
+	std::vector<uint8_t> decoded;
+	UINT w = 0, h = 0;
+	if (BCEncoder::LoadDDS(mPaintLayerFile, decoded, w, h) && w == width && h == height)
+		mLastPaintSavePSNR = BCEncoder::ComputePSNR(rgba.data(), decoded.data(), width, height, width * 4, true);
+
+	char msg[256];
+	sprintf_s(msg, "Paint layer saved: %.2f ms (encode %.2f ms, %.0f MPix/s), PSNR %.2f dB\n", mLastPaintSaveMs,
+		mLastPaintEncodeMs, mLastPaintEncodeMPixPerSec, mLastPaintSavePSNR);
+	OutputDebugStringA(msg);
+}
+
+void TexColumnsApp::LoadPaintLayer()
+{
+	if (!mPaintLayer)
+		return;
+
+	std::vector<uint8_t> rgba;
+	UINT width = 0, height = 0;
+	BCEncoder::Format format = BCEncoder::Format::BC3;
+	// A BC1 layer has lost its alpha and would cover the whole terrain
+	if (!BCEncoder::LoadDDS(mPaintLayerFile, rgba, width, height, &format) || format != BCEncoder::Format::BC3 ||
+		width != mBrushTextureWidth || height != mBrushTextureHeight)
+	{
+		OutputDebugStringW((L"Failed to load paint layer: " + mPaintLayerFile + L"\n").c_str());
+		return;
+	}
+
+	PaintRect full = { 0, 0, (int)width, (int)height };
+	mPaintLayer->WriteRect(full, rgba.data(), width * 4);
+
+	// Loaded layer starts a new history
+	mBrushUndo.Clear();
+	mBrushUploadRect.Merge(full);
+	mIsPainting = 0;
+}
+
+void TexColumnsApp::RegisterResidentTextures()
+{
+	// Displacement is sampled for geometry, so those maps always stay complete.
+	std::vector<int> pinned = { TexOffsets["terrainDisp"] };
+	for (auto& m : mMaterials)
+		pinned.push_back(m.second->DisplacementSrvHeapIndex);
+
+	for (auto& tex : mTextures)
+	{
+		if (!tex.second || !tex.second->Resource || tex.second->Filename.empty())
+			continue;
+
+		const int srv = TexOffsets[tex.first];
+		if (std::find(pinned.begin(), pinned.end(), srv) != pinned.end())
+			continue;
+
+		const D3D12_RESOURCE_DESC desc = tex.second->Resource->GetDesc();
+		if (desc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || desc.MipLevels <= 1)
+			continue;
+
+		const bool blockCompressed =
+			(desc.Format >= DXGI_FORMAT_BC1_TYPELESS && desc.Format <= DXGI_FORMAT_BC5_SNORM) ||
+			(desc.Format >= DXGI_FORMAT_BC6H_TYPELESS && desc.Format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+
+		ResidencyTextureDesc rd;
+		rd.Width = (uint32_t)desc.Width;
+		rd.Height = desc.Height;
+		for (UINT mip = 0; mip < desc.MipLevels; ++mip)
+		{
+			UINT64 bytes = 0;
+			for (UINT slice = 0; slice < desc.DepthOrArraySize; ++slice)
+			{
+				UINT64 sliceBytes = 0;
+				md3dDevice->GetCopyableFootprints(&desc, slice * desc.MipLevels + mip, 1, 0,
+					nullptr, nullptr, nullptr, &sliceBytes);
+				bytes += sliceBytes;
+			}
+			rd.MipBytes.push_back(bytes);
+
+			// Keep a small tail resident, and BC top levels block-aligned
+			const UINT w = (std::max)(1u, rd.Width >> mip);
+			const UINT h = (std::max)(1u, rd.Height >> mip);
+			if ((std::max)(w, h) >= 64 && (!blockCompressed || (w % 4 == 0 && h % 4 == 0)))
+				rd.CoarsestMip = mip;
+		}
+
+		const int id = mTextureResidency.AddTexture(rd, 0);
+		mResidencyTextures.push_back(tex.first);
+		mResidencyBySrv[srv] = id;
+		ResidentSlot slot;
+		slot.Srv = srv;
+		mResidentSlots.push_back(slot);
+	}
+
+	mTextureResidency.SetBudget((uint64_t)(mResidencyBudgetMB * 1024.f * 1024.f));
+	mTextureResidency.SetMaxStreamInBytes(32ull * 1024 * 1024);
+	mTextureResidency.SetEvictDelay(6);
+	mTextureResidency.SetMipBias(mResidencyMipBias);
+
+	char msg[128];
+	sprintf_s(msg, "Texture residency: %d of %d textures streamed\n",
+		mTextureResidency.GetTextureCount(), (int)mTextures.size());
+	OutputDebugStringA(msg);
+}
+
+void TexColumnsApp::UpdateTextureResidency(const GameTimer& gt)
+{
+	PROFILE_SCOPE("UpdateTextureResidency");
+	CompleteResidencyUploads();
+	if (!mUseTextureResidency || mTextureResidency.GetTextureCount() == 0)
+		return;
+	if (++mResidencyFrame < mResidencyInterval)
+		return;
+	mResidencyFrame = 0;
+
+	mTextureResidency.BeginFrame();
+
+	const XMVECTOR eye = mCamera.GetPosition();
+	// Pixels covered by one world unit at distance 1
+	const float pixelsPerUnit = mClientHeight / (2.0f * tanf(0.5f * mCamera.GetFovY()));
+
+	auto screenSize = [&](const BoundingBox& worldBox)
+	{
+		const float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBox.Extents)));
+		const float dist = XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBox.Center) - eye));
+		return 2.0f * radius * pixelsPerUnit / (std::max)(dist, radius);
+	};
+
+	auto request = [&](int srv, float pixels)
+	{
+		auto it = mResidencyBySrv.find(srv);
+		if (it != mResidencyBySrv.end())
+			mTextureResidency.RequestScreenSize(it->second, pixels);
+	};
+
+	BoundingFrustum frustum = mCamera.GetFrustum();
+	for (auto ri : mStandCustomMeshes)
+	{
+		if (!ri->Mat)
+			continue;
+		if (frustum.Contains(ri->WorldBounds) == DISJOINT)
+			continue;
+
+		// Assume the UV range is laid out once across the mesh
+		const float pixels = screenSize(ri->WorldBounds);
+		request(ri->Mat->DiffuseSrvHeapIndex, pixels);
+		request(ri->Mat->NormalSrvHeapIndex, pixels);
+	}
+
+	// Terrain maps span the whole terrain, each visible tile shows a part of it
+	for (auto tile : mTerrain->GetVisibleTiles())
+	{
+		const float pixels = screenSize(tile->boundingBox) * mTerrain->mWorldSize / tile->tileSize;
+		request(TexOffsets["terrainDiff"], pixels);
+		request(TexOffsets["terrainNorm"], pixels);
+	}
+
+	const auto& changes = mTextureResidency.Update();
+	if (!changes.empty())
+		ApplyResidencyChanges(changes);
+}
+
+static Aabb ToAabb(const BoundingBox& box)
+{
+	Aabb result;
+	result.Min[0] = box.Center.x - box.Extents.x;
+	result.Min[1] = box.Center.y - box.Extents.y;
+	result.Min[2] = box.Center.z - box.Extents.z;
+	result.Max[0] = box.Center.x + box.Extents.x;
+	result.Max[1] = box.Center.y + box.Extents.y;
+	result.Max[2] = box.Center.z + box.Extents.z;
+	return result;
+}
+
+void TexColumnsApp::BuildOctree()
+{
+	PROFILE_SCOPE("BuildOctree");
+	// Cubic world over the terrain; anything outside ends up in the root
+	Aabb world;
+	world.Min[0] = terrainPos.x;
+	world.Min[1] = terrainPos.y;
+	world.Min[2] = terrainPos.z;
+	world.Max[0] = terrainPos.x + mTerrainSize;
+	world.Max[1] = terrainPos.y + mTerrainSize;
+	world.Max[2] = terrainPos.z + mTerrainSize;
+
+	// Leaf cells of about 32 units; finer cells only add nodes to walk
+	uint32_t depth = 0;
+	while (depth < 8 && mTerrainSize / float(1u << (depth + 1)) >= 32.0f)
+		++depth;
+	mOctree.Reset(world, depth);
+	mDynamicTree.Clear();
+	mDynamicProxies.assign(mAllRitems.size(), -1);
+
+	for (auto ri : mStandCustomMeshes)
+	{
+		if (ri->Dynamic)
+			mDynamicProxies[ri->ObjCBIndex] = mDynamicTree.Insert(ToAabb(ri->WorldBounds), ri->ObjCBIndex);
+		else
+			mOctree.Insert(ri->ObjCBIndex, ToAabb(ri->WorldBounds));
+	}
+	mDynamicTree.Rebuild();
+	mItemVisible.assign(mAllRitems.size(), 0xFF);
+	mVisibleCustomMeshes = mStandCustomMeshes;
+}
+
+void TexColumnsApp::UpdateVisibleItems(const GameTimer& gt)
+{
+	PROFILE_SCOPE("UpdateVisibleItems");
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (mItemVisible.size() < mAllRitems.size())
+		mItemVisible.resize(mAllRitems.size(), 0xFF);
+
+	// Only items whose world box actually changed are moved in the octree;
+	// the BVH ignores moves that stay inside a leaf's fat box by itself.
+	mOctreeMoves = 0;
+	mBvhMoves = 0;
+	for (auto ri : mStandCustomMeshes)
+	{
+		const Aabb box = ToAabb(ri->WorldBounds);
+		if (ri->ObjCBIndex < mDynamicProxies.size() && mDynamicProxies[ri->ObjCBIndex] >= 0)
+		{
+			if (mDynamicTree.Move(mDynamicProxies[ri->ObjCBIndex], box))
+				++mBvhMoves;
+			continue;
+		}
+		if (!mOctree.Contains(ri->ObjCBIndex) || memcmp(&box, &mOctree.GetBox(ri->ObjCBIndex), sizeof(Aabb)) != 0)
+		{
+			mOctree.Move(ri->ObjCBIndex, box);
+			++mOctreeMoves;
+		}
+	}
+
+	mVisibleCustomMeshes.clear();
+	const uint32_t cascadeCount = (uint32_t)mCascades.size();
+	mShadowCasters.resize(cascadeCount);
+	for (auto& casters : mShadowCasters)
+		casters.clear();
+	if (!mUseOctreeCulling)
+	{
+		mVisibleCustomMeshes = mStandCustomMeshes;
+		for (auto& casters : mShadowCasters)
+			casters = mStandCustomMeshes;
+		mOctreeStats = OctreeQueryStats();
+		mBvhStats = BvhQueryStats();
+	}
+	else
 	{
-		if (shiftPressed) mCamera.MoveUp(mCameraVertSpeed * dt);
-		else mCamera.Walk(mCameraHorSpeed * dt);
+		// The camera and every cascade: one walk of the tree, one walk per
+		// view of the octree (LooseOctree.h says why)
+		const uint32_t viewCount = (uint32_t)mCullViews.size();
+		mViewItems.resize(viewCount);
+		for (auto& items : mViewItems)
+			items.clear();
+		mOctree.Query(mCullViews.data(), viewCount, mViewItems.data(), &mOctreeStats);
+		mDynamicTree.Query(mCullViews.data(), viewCount, mViewItems.data(), &mBvhStats);
+
+		std::fill(mItemVisible.begin(), mItemVisible.end(), 0);
+		for (uint32_t v = 0; v < viewCount; ++v)
+		{
+			for (uint32_t id : mViewItems[v])
+				mItemVisible[id] |= (uint8_t)(1u << v);
+		}
+		// Keep the submission order of mStandCustomMeshes
+		for (auto ri : mStandCustomMeshes)
+		{
+			const uint8_t views = mItemVisible[ri->ObjCBIndex];
+			if (views & 1)
+				mVisibleCustomMeshes.push_back(ri);
+			for (uint32_t i = 0; i < cascadeCount; ++i)
+			{
+				if (views & (2u << i))
+					mShadowCasters[i].push_back(ri);
+			}
+		}
 	}
 
-	if (GetAsyncKeyState('S') & 0x8000)
+	mOccludedMeshes = 0;
+	if (mOcclusionReady)
 	{
-		if (shiftPressed) mCamera.MoveUp(-mCameraVertSpeed * dt);
-		else mCamera.Walk(-mCameraHorSpeed * dt);
+		auto hidden = std::remove_if(mVisibleCustomMeshes.begin(), mVisibleCustomMeshes.end(),
+			[this](const RenderItem* ri) { return mOcclusion.IsOccluded(ToAabb(ri->WorldBounds)); });
+		mOccludedMeshes = (UINT)(mVisibleCustomMeshes.end() - hidden);
+		mVisibleCustomMeshes.erase(hidden, mVisibleCustomMeshes.end());
 	}
 
-	if (GetAsyncKeyState('A') & 0x8000)
-		mCamera.Strafe(-mCameraHorSpeed * dt);
-
-	if (GetAsyncKeyState('D') & 0x8000)
-		mCamera.Strafe(mCameraHorSpeed * dt);
-
-	mCamera.UpdateViewMatrix();
+	mLastCullMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 }
 
+void TexColumnsApp::UpdateShadowCascades(const GameTimer& gt)
+{
+	PROFILE_SCOPE("UpdateShadowCascades");
+	CascadeParams params;
+	const XMFLOAT3 eye = mCamera.GetPosition3f();
+	const XMFLOAT3 right = mCamera.GetRight3f();
+	const XMFLOAT3 up = mCamera.GetUp3f();
+	const XMFLOAT3 look = mCamera.GetLook3f();
+	memcpy(params.Eye, &eye, sizeof(params.Eye));
+	memcpy(params.Right, &right, sizeof(params.Right));
+	memcpy(params.Up, &up, sizeof(params.Up));
+	memcpy(params.Look, &look, sizeof(params.Look));
+	memcpy(params.LightDir, &mLightDirection, sizeof(params.LightDir));
+	params.FovY = mCamera.GetFovY();
+	params.Aspect = mCamera.GetAspect();
+	params.NearZ = mCamera.GetNearZ();
+	params.FarZ = (std::min)(mShadowDistance, mCamera.GetFarZ());
+	params.Count = (uint32_t)(std::min)((std::max)(mCascadeCount, 0), (int)ViewCullState::MaxViews - 1);
+	// Anything between the terrain's top and the far cascade can cast
+	params.CasterDistance = mTerrainSize;
+	ShadowCascades::Fit(params, mCascades);
+
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, mCamera.GetView() * mCamera.GetProj());
+	mCullViews.clear();
+	mCullViews.push_back(FrustumPlanes::FromViewProj(viewProj.m));
+	for (const auto& cascade : mCascades)
+		mCullViews.push_back(cascade.Planes);
+}
 
-bool TexColumnsApp::ScreenToWorld(int screenX, int screenY, XMFLOAT3& worldPos)
+void TexColumnsApp::BuildTerrainOccluders()
 {
-	// 1. Нормализованные координаты экрана [-1, 1]
-	float nx = (2.0f * static_cast<float>(screenX)) / mClientWidth - 1.0f;
-	float ny = 1.0f - (2.0f * static_cast<float>(screenY)) / mClientHeight;
+	PROFILE_SCOPE("BuildTerrainOccluders");
+	// Tiles are drawn as an 8x8 vertex grid (TerrainMesh::GenerateTile); a 5x5
+	// occluder a step below it is plenty at the buffer's resolution.
+	const int resolution = 5;
+	HeightField::BuildGridIndices(resolution, mOccluderIndices);
 
-	// 2. Создаем луч в clip space
-	XMVECTOR rayStart = XMVectorSet(nx, ny, 0.0f, 1.0f);
-	XMVECTOR rayEnd = XMVectorSet(nx, ny, 1.0f, 1.0f);
+	auto& allTiles = mTerrain->GetAllTiles();
+	mTileOccluders.assign(allTiles.size(), {});
+	for (auto& tile : allTiles)
+	{
+		if (tile->tileIndex >= (int)mTileOccluders.size())
+			mTileOccluders.resize(tile->tileIndex + 1);
+		mHeightField.BuildOccluder(tile->worldPos.x, tile->worldPos.z, tile->tileSize, resolution,
+			tile->tileSize / 7.0f, mTileOccluders[tile->tileIndex]);
+	}
+}
 
-	// 3. Получаем обратную матрицу ViewProj
-	//XMMATRIX viewProj = XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj());
-	XMMATRIX invViewProj = mInvViewProj;//XMMatrixInverse(nullptr, viewProj);
+void TexColumnsApp::UpdateOcclusion(const GameTimer& gt)
+{
+	PROFILE_SCOPE("UpdateOcclusion");
+	mOcclusionReady = false;
+	mOccludedTiles = 0;
+	if (!mUseOcclusionCulling || mTileOccluders.empty())
+		return;
 
-	// 4. Преобразуем в мировые координаты
-	rayStart = XMVector3TransformCoord(rayStart, invViewProj);
-	rayEnd = XMVector3TransformCoord(rayEnd, invViewProj);
+	auto start = std::chrono::high_resolution_clock::now();
 
-	XMFLOAT3 startPos, endPos;
-	XMStoreFloat3(&startPos, rayStart);
-	XMStoreFloat3(&endPos, rayEnd);
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, mCamera.GetView() * mCamera.GetProj());
+	mOcclusion.Begin(viewProj.m);
 
-	// 5. Направление луча
-	XMVECTOR rayDir = XMVectorSubtract(rayEnd, rayStart);
-	rayDir = XMVector3Normalize(rayDir);
-	
-	// Проверяем пересечение луча с AABB террейна
-	float distance;
+	// The nearest tiles hide the most
+	auto& visibleTiles = mTerrain->GetVisibleTiles();
+	const XMFLOAT3 eye = mCamera.GetPosition3f();
+	auto distance = [&eye](const Tile* tile)
+	{
+		const BoundingBox& box = tile->boundingBox;
+		const float dx = (std::max)(fabsf(eye.x - box.Center.x) - box.Extents.x, 0.0f);
+		const float dz = (std::max)(fabsf(eye.z - box.Center.z) - box.Extents.z, 0.0f);
+		return dx * dx + dz * dz;
+	};
+	mOccluderOrder = visibleTiles;
+	const size_t count = (std::min)(mOccluderOrder.size(), (size_t)(std::max)(mOccluderCount, 0));
+	std::partial_sort(mOccluderOrder.begin(), mOccluderOrder.begin() + count, mOccluderOrder.end(),
+		[&distance](const Tile* a, const Tile* b) { return distance(a) < distance(b); });
 
-	std::string debugMsg;;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto& occluder = mTileOccluders[mOccluderOrder[i]->tileIndex];
+		mOcclusion.RenderOccluder(occluder.data(), (uint32_t)(occluder.size() / 3),
+			mOccluderIndices.data(), (uint32_t)mOccluderIndices.size());
+	}
+	mOcclusion.Finish();
+	mOcclusionReady = true;
 
-	XMVECTOR planeNormal = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	XMVECTOR planePoint = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	// A tile's own occluder lies inside its box, so it never hides itself
+	auto hidden = std::remove_if(visibleTiles.begin(), visibleTiles.end(),
+		[this](const Tile* tile) { return mOcclusion.IsOccluded(ToAabb(tile->boundingBox)); });
+	mOccludedTiles = (UINT)(visibleTiles.end() - hidden);
+	visibleTiles.erase(hidden, visibleTiles.end());
 
-	XMVECTOR diff = XMVectorSubtract(planePoint, rayStart);
-	float numerator = XMVectorGetX(XMVector3Dot(diff, planeNormal));
-	float denominator = XMVectorGetX(XMVector3Dot(rayDir, planeNormal));
+	mLastOcclusionMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
 
-	debugMsg = "Plane intersection calc: numerator=" + std::to_string(numerator) +
-		", denominator=" + std::to_string(denominator) + "\n";
-	OutputDebugStringA(debugMsg.c_str());
+void TexColumnsApp::UpdateMeshLods(const GameTimer& gt)
+{
+	PROFILE_SCOPE("UpdateMeshLods");
+	auto start = std::chrono::high_resolution_clock::now();
 
-	if (fabs(denominator) > 1e-6f)
+	// Only animated items (maxwell, see SceneObject::UpdateConstants) need their spheres refreshed
+	for (size_t i = 0; i < mStandCustomMeshes.size(); ++i)
 	{
-		float t = numerator / denominator;
-
-		if (t >= 0.0f)
-		{
-			XMVECTOR intersection = XMVectorAdd(rayStart, XMVectorScale(rayDir, t));
-			XMFLOAT3 intersectPos;
-			XMStoreFloat3(&intersectPos, intersection);
-
-			// Проверяем границы террейна в плоскости XZ
-			if (intersectPos.x >= terrainPos.x && intersectPos.x <= terrainPos.x + mTerrainSize &&
-				intersectPos.z >= terrainPos.z && intersectPos.z <= terrainPos.z + mTerrainSize)
-			{
-				worldPos = intersectPos;
-				debugMsg = "HIT: Projected to terrain plane at Y=" + std::to_string(intersectPos.y) + "\n";
-				OutputDebugStringA(debugMsg.c_str());
-				return true;
-			}
-		}
+		const BoundingBox& worldBox = mStandCustomMeshes[i]->WorldBounds;
+		if (!mStandCustomMeshes[i]->Dynamic)
+			continue;
+		const float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBox.Extents)));
+		mLodSelector.SetSphere((int)i, worldBox.Center.x, worldBox.Center.y, worldBox.Center.z, radius);
 	}
 
-	OutputDebugStringA("MISS: No intersection with terrain bounds\n");
-	return false;
-}
+	if (mUseMeshLods)
+	{
+		LodSelectParams params;
+		XMFLOAT3 eye;
+		XMStoreFloat3(&eye, mCamera.GetPosition());
+		params.EyeX = eye.x;
+		params.EyeY = eye.y;
+		params.EyeZ = eye.z;
+		params.PixelsPerUnit = mClientHeight / (2.0f * tanf(0.5f * mCamera.GetFovY()));
+		params.PixelError = mLodPixelError;
+		params.Bias = mLodBias;
+		params.Hysteresis = mLodHysteresis;
+		mLodSwitches = mLodSelector.Select(params);
+	}
+	else
+	{
+		mLodSelector.Reset();
+		mLodSwitches = 0;
+	}
 
-//void TexColumnsApp::UpdateCamera(const GameTimer& gt)
-//{
-//	// Convert Spherical to Cartesian coordinates.
-//	float x = mRadius * sinf(mPhi) * cosf(mTheta);
-//	float z = mRadius * sinf(mPhi) * sinf(mTheta);
-//	float y = mRadius * cosf(mPhi);
-//
-//	// Build the view matrix.
-//	XMVECTOR pos = XMVectorSet(x, y, z, 1.0f);
-//	XMVECTOR target = XMVectorZero();
-//	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-//
-//	XMVECTOR campos =mCamera.GetPosition();
-//	pos = XMVectorSet(campos.m128_f32[0], campos.m128_f32[1], campos.m128_f32[2], 0.0f);
-//	target = mCamera.GetLook();
-//	up = mCamera.GetUp();
-//
-//	XMMATRIX view = XMMatrixLookToLH(pos, target, up);
-//	XMStoreFloat4x4(&mCamera.GetView4x4f(), view);
-//	mCamera.UpdateViewMatrix();
-//}
+	for (size_t i = 0; i < mStandCustomMeshes.size(); ++i)
+		mStandCustomMeshes[i]->CurrentLodIndex = (int)mLodSelector.GetLevel((int)i);
 
+	mLastLodSelectMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
 
-void TexColumnsApp::AnimateMaterials(const GameTimer& gt)
+void TexColumnsApp::ApplyResidencyChanges(const std::vector<ResidencyChange>& changes)
 {
+	auto start = std::chrono::high_resolution_clock::now();
 
-}
+	// Nothing waits for the GPU here: each replacement is created now, filled
+	// by copies in the next frame's command list (RecordResidencyCopies) and
+	// swapped in by CompleteResidencyUploads once that frame has completed.
+	const uint64_t frame = mSimulationFrame + 1;
+	char msg[256];
+	int deferred = 0;
 
-void TexColumnsApp::UpdateObjectCBs(const GameTimer& gt)
-{
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for (auto& e : mAllRitems)
+	for (const auto& change : changes)
 	{
-
-		
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if (e->NumFramesDirty > 0)
+		ResidentSlot& slot = mResidentSlots[change.Texture];
+		if (slot.Pending || slot.Retired)
 		{
-			e->PrevWorld = e->World;
+			// The last change of this texture is not through yet; asked again later
+			mTextureResidency.SetResidentMip(change.Texture, change.OldMip);
+			++deferred;
+			continue;
+		}
+
+		const std::string& name = mResidencyTextures[change.Texture];
+		Texture* tex = mTextures[name].get();
+		const D3D12_RESOURCE_DESC oldDesc = tex->Resource->GetDesc();
 
-			if (e->Name == "maxwell")
+		PendingResidency pending;
+		pending.Texture = change.Texture;
+		pending.OldMip = change.OldMip;
+		pending.Frame = frame;
+		ResidencyCopy copy;
+
+		if (change.NewMip > change.OldMip)
+		{
+			// Eviction: the remaining mips are copied on the GPU, no disk access
+			const UINT drop = change.NewMip - change.OldMip;
+			if (drop >= oldDesc.MipLevels)
 			{
-				// Загружаем текущую матрицу
-				XMMATRIX currentWorld = XMLoadFloat4x4(&e->World);
+				mTextureResidency.SetResidentMip(change.Texture, change.OldMip);
+				continue;
+			}
 
-				// Извлекаем компоненты (поворот/масштаб/позиция)
-				XMVECTOR scale, rotation, translation;
-				XMMatrixDecompose(&scale, &rotation, &translation, currentWorld);
+			D3D12_RESOURCE_DESC desc = oldDesc;
+			desc.Width = (std::max)(1ull, oldDesc.Width >> drop);
+			desc.Height = (std::max)(1u, oldDesc.Height >> drop);
+			desc.MipLevels = oldDesc.MipLevels - drop;
+
+			ThrowIfFailed(md3dDevice->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&desc,
+				D3D12_RESOURCE_STATE_COPY_DEST,
+				nullptr,
+				IID_PPV_ARGS(&pending.Resource)));
+
+			for (UINT slice = 0; slice < desc.DepthOrArraySize; ++slice)
+				for (UINT mip = 0; mip < desc.MipLevels; ++mip)
+					copy.GpuCopies.push_back({ slice * desc.MipLevels + mip, slice * oldDesc.MipLevels + mip + drop });
+		}
+		else
+		{
+			// Stream-in: only the missing finer mips come from the file, the
+			// resident ones are copied over on the GPU. The file is mapped, so
+			// the pages of the mips that are not read never leave the disk.
+			const UINT missing = change.OldMip - change.NewMip;
+			const ResidencyTextureDesc& full = mTextureResidency.GetDesc(change.Texture);
+
+			D3D12_RESOURCE_DESC desc = oldDesc;
+			desc.Width = (std::max)(1u, full.Width >> change.NewMip);
+			desc.Height = (std::max)(1u, full.Height >> change.NewMip);
+			desc.MipLevels = oldDesc.MipLevels + missing;
+
+			const size_t maxsize = change.NewMip ? ((std::max)(full.Width, full.Height) >> change.NewMip) : 0;
+			DirectX::DDSTextureData data;
+			HRESULT hr = DirectX::LoadDDSTextureDataMapped12(tex->Filename.c_str(), data, maxsize);
+			if (SUCCEEDED(hr) && (data.Width != desc.Width || data.Height != desc.Height ||
+				data.Format != desc.Format || data.ArraySize != desc.DepthOrArraySize || data.MipCount != desc.MipLevels))
+				hr = E_FAIL;
+
+			if (FAILED(hr))
+			{
+				DirectX::ReleaseDDSTextureData(data, nullptr);
+				sprintf_s(msg, "Residency: failed to stream %s (hr=0x%08X)\n", name.c_str(), (unsigned)hr);
+				OutputDebugStringA(msg);
+				mTextureResidency.SetResidentMip(change.Texture, change.OldMip);
+				continue;
+			}
 
-				// Сохраняем начальную позицию при первом запуске
-				static XMFLOAT3 initialPosition;
-				static bool firstTime = true;
+			// Upload layouts of mips 0..missing-1 of every slice, packed one slice after another
+			std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(desc.DepthOrArraySize * missing);
+			std::vector<UINT> numRows(layouts.size());
+			std::vector<UINT64> rowSizes(layouts.size());
+			UINT64 uploadBytes = 0;
+			for (UINT slice = 0; slice < desc.DepthOrArraySize; ++slice)
+			{
+				UINT64 sliceBytes = 0;
+				md3dDevice->GetCopyableFootprints(&desc, slice * desc.MipLevels, missing, uploadBytes,
+					&layouts[slice * missing], &numRows[slice * missing], &rowSizes[slice * missing], &sliceBytes);
+				uploadBytes = (uploadBytes + sliceBytes + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1)
+					& ~(UINT64)(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+			}
 
-				if (firstTime)
+			ThrowIfFailed(md3dDevice->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&desc,
+				D3D12_RESOURCE_STATE_COPY_DEST,
+				nullptr,
+				IID_PPV_ARGS(&pending.Resource)));
+			ThrowIfFailed(md3dDevice->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+				D3D12_HEAP_FLAG_NONE,
+				&CD3DX12_RESOURCE_DESC::Buffer(uploadBytes),
+				D3D12_RESOURCE_STATE_GENERIC_READ,
+				nullptr,
+				IID_PPV_ARGS(&pending.UploadHeap)));
+
+			BYTE* mapped = nullptr;
+			ThrowIfFailed(pending.UploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&mapped)));
+			for (UINT slice = 0; slice < desc.DepthOrArraySize; ++slice)
+			{
+				for (UINT mip = 0; mip < missing; ++mip)
 				{
-					XMStoreFloat3(&initialPosition, translation);
-					firstTime = false;
+					const UINT i = slice * missing + mip;
+					const DirectX::DDSSubresource& src = data.InitData[slice * data.MipCount + mip];
+					const D3D12_SUBRESOURCE_DATA srcData = { src.pData, (LONG_PTR)src.RowPitch, (LONG_PTR)src.SlicePitch };
+					const D3D12_MEMCPY_DEST dstData = { mapped + layouts[i].Offset, layouts[i].Footprint.RowPitch,
+						(SIZE_T)layouts[i].Footprint.RowPitch * numRows[i] };
+					MemcpySubresource(&dstData, &srcData, (SIZE_T)rowSizes[i], numRows[i], layouts[i].Footprint.Depth);
+					copy.UploadCopies.push_back({ slice * desc.MipLevels + mip, layouts[i] });
 				}
-
-				// Синусоидальное движение относительно начальной позиции
-				float verticalOffset = sin(gt.TotalTime() * 1.0f) * 20.0f;
-
-				// Новая позиция:
-				float newX = initialPosition.x;
-				float newY = initialPosition.y + verticalOffset;
-				float newZ = initialPosition.z;
-
-				e->PrevWorld = e->World;
-
-				// Создаем новую матрицу с сохранением масштаба и поворота
-				XMMATRIX newWorld = XMMatrixAffineTransformation(
-					scale,                          // масштаб
-					XMVectorZero(),                 // центр вращения
-					rotation,                        // поворот
-					XMVectorSet(newX, newY, newZ, 1.0f) // новая позиция
-				);
-				XMStoreFloat4x4(&e->World, newWorld);
-				e->NumFramesDirty = gNumFrameResources;
+				for (UINT mip = 0; mip < oldDesc.MipLevels; ++mip)
+					copy.GpuCopies.push_back({ slice * desc.MipLevels + missing + mip, slice * oldDesc.MipLevels + mip });
 			}
+			pending.UploadHeap->Unmap(0, nullptr);
+			DirectX::ReleaseDDSTextureData(data, nullptr);
+		}
 
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX prevworld = XMLoadFloat4x4(&e->PrevWorld);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
-
-
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.PrevWorld, XMMatrixTranspose(prevworld));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+		copy.Source = copy.GpuCopies.empty() ? nullptr : tex->Resource.Get();
+		copy.Dest = pending.Resource.Get();
+		copy.Upload = pending.UploadHeap.Get();
+		mResidencyCopies.push_back(std::move(copy));
+		slot.Pending = true;
+		mResidencyPending.push_back(std::move(pending));
+	}
 
+	mLastResidencyApplyMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	const ResidencyStats& stats = mTextureResidency.GetStats();
+	sprintf_s(msg, "Residency: %d in (%.1f MB), %d out (%.1f MB), %d deferred, resident %.1f MB, %.2f ms\n",
+		stats.StreamIns, stats.StreamedInBytes / (1024.0 * 1024.0),
+		stats.Evictions, stats.EvictedBytes / (1024.0 * 1024.0), deferred,
+		stats.ResidentBytes / (1024.0 * 1024.0), mLastResidencyApplyMs);
+	OutputDebugStringA(msg);
+}
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+// Runs in Update after the wait on the current frame resource: that frame
+// resource's previous packet has completed, and with it every older one.
+void TexColumnsApp::CompleteResidencyUploads()
+{
+	const uint64_t completed = mSimulationFrame + 1 > (uint64_t)gNumFrameResources
+		? mSimulationFrame + 1 - gNumFrameResources : 0;
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+	for (auto& slot : mResidentSlots)
+	{
+		if (slot.Retired && slot.RetireFrame <= completed)
+			slot.Retired = nullptr;
 	}
-}
 
-void TexColumnsApp::UpdateMaterialCBs(const GameTimer& gt)
-{
-	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
-	for (auto& e : mMaterials)
+	CD3DX12_CPU_DESCRIPTOR_HANDLE heapStart(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	size_t kept = 0;
+	for (auto& pending : mResidencyPending)
 	{
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
-		// data changes, it needs to be updated for each FrameResource.
-		Material* mat = e.second.get();
-		if (mat->NumFramesDirty > 0)
+		if (pending.Frame > completed)
 		{
-			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
-
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
-
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
-
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
+			mResidencyPending[kept++] = std::move(pending);
+			continue;
 		}
+
+		// The other slot: its last reader retired before this upload was queued
+		ResidentSlot& slot = mResidentSlots[pending.Texture];
+		Texture* tex = mTextures[mResidencyTextures[pending.Texture]].get();
+		const int baseSrv = TexOffsets[mResidencyTextures[pending.Texture]];
+		const int srv = slot.Srv == baseSrv ? mResidencySrvBase + pending.Texture : baseSrv;
+		const D3D12_RESOURCE_DESC desc = pending.Resource->GetDesc();
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Format = desc.Format;
+		srvDesc.Texture2D.MipLevels = desc.MipLevels;
+		md3dDevice->CreateShaderResourceView(pending.Resource.Get(), &srvDesc,
+			CD3DX12_CPU_DESCRIPTOR_HANDLE(heapStart, srv, mCbvSrvDescriptorSize));
+
+		// Packets up to mSimulationFrame still read the old slot and resource
+		slot.Srv = srv;
+		slot.Pending = false;
+		slot.Retired = tex->Resource;
+		slot.RetireFrame = mSimulationFrame;
+		tex->Resource = pending.Resource;
+		tex->UploadHeap = nullptr;
 	}
+	mResidencyPending.resize(kept);
 }
 
-void TexColumnsApp::UpdateMainPassCB(const GameTimer& gt)
+// Materials and TexOffsets keep a streamed texture's first slot; the packet
+// gets the slot its current view is in
+void TexColumnsApp::RemapResidentSrvs(AppFramePacket& packet) const
 {
+	if (mResidentSlots.empty())
+		return;
 
-	XMMATRIX view = mCamera.GetView();
-	XMMATRIX proj = mCamera.GetProj();
-	//static XMMATRIX lastViewProj = XMMatrixIdentity();
-
-	//XMStoreFloat4x4(&mMainPassCB.PrevViewProj , XMMatrixTranspose(lastViewProj));
+	auto remap = [this](uint32_t& srv)
+	{
+		auto it = mResidencyBySrv.find((int)srv);
+		if (it != mResidencyBySrv.end())
+			srv = (uint32_t)mResidentSlots[it->second].Srv;
+	};
 
-	//TODO:
-	XMMATRIX proj_jittered = proj;
-	if (useTaa)
+	for (auto* items : { &packet.Opaque, &packet.CustomMeshes, &packet.Tiles })
 	{
-		proj_jittered.r[2].m128_f32[0] += jitters[frameIndex].x;
-		proj_jittered.r[2].m128_f32[1] += jitters[frameIndex].y;
+		for (DrawItem& item : *items)
+		{
+			remap(item.DiffuseSrv);
+			remap(item.NormalSrv);
+		}
 	}
-
-	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-    mInvViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
-
-	XMMATRIX viewProj_jittered = XMMatrixMultiply(view, proj_jittered);
-	//lastViewProj = viewProj_jittered;
-
-	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
-	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
-
-	mMainPassCB.PrevViewProj =mMainPassCB.ViewProj;
-
-	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
-	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(mInvViewProj));
-
-	XMStoreFloat4x4(&mMainPassCB.JitteredViewProj, XMMatrixTranspose(viewProj_jittered));
-
-	mMainPassCB.EyePosW = mCamera.GetPosition3f();
-	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
-	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
-	mMainPassCB.NearZ = 1.0f;
-	mMainPassCB.FarZ = mCamera.cameraFarZ;
-	mMainPassCB.TotalTime = gt.TotalTime();
-	mMainPassCB.DeltaTime = gt.DeltaTime();
-
-	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
-
-	mMainPassCB.Lights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[0].Strength = { 0.8f, 0.8f, 0.8f };
-
-	mMainPassCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[1].Strength = { 0.4f, 0.4f, 0.4f };
-
-	mMainPassCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
-	mMainPassCB.Lights[2].Strength = { 0.2f, 0.2f, 0.2f };
-
-	mMainPassCB.gScale = mScale;
-	mMainPassCB.gTessellationFactor = mTessellationFactor;
-
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+	remap(packet.Bindings.TerrainDiffuseSrv);
+	remap(packet.Bindings.TerrainNormalSrv);
 }
 
-void TexColumnsApp::UpdateTAA(const GameTimer& gt)
+// Fills the replacements queued by ApplyResidencyChanges, ahead of the
+// frame's passes. The old resources are also sampled this frame, so they go
+// back to PIXEL_SHADER_RESOURCE right after the copies.
+void TexColumnsApp::RecordResidencyCopies(const AppFramePacket& packet)
 {
-	auto TaaCB = mCurrFrameResource->TAACB.get();
-	TaaCB->CopyData(0, mTAACB);
-}
+	if (packet.Residency.empty())
+		return;
 
-void TexColumnsApp::UpdateBrushCB(const GameTimer& gt)
-{
-	mBrushCB.BrushRadius = BrushRadius;
-	mBrushCB.BrushFalofRadius = BrushFalloffRadius;
-	mBrushCB.BrushColors = BrushColor;
-	mBrushCB.isBrushMode = controlMode == 1 ? 1 : 0;
-	mBrushCB.isPainting = mIsPainting == 1 ? 1 : 0;
+	std::vector<D3D12_RESOURCE_BARRIER> barriers;
+	for (const ResidencyCopy& copy : packet.Residency)
+	{
+		if (copy.Source)
+			barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(copy.Source,
+				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE));
+	}
+	if (!barriers.empty())
+		mCommandList->ResourceBarrier((UINT)barriers.size(), barriers.data());
 
-	auto currBrushCB = mCurrFrameResource->BrushCB.get();
-	currBrushCB->CopyData(0, mBrushCB);
+	for (const ResidencyCopy& copy : packet.Residency)
+	{
+		for (const auto& c : copy.GpuCopies)
+		{
+			CD3DX12_TEXTURE_COPY_LOCATION dst(copy.Dest, c.first);
+			CD3DX12_TEXTURE_COPY_LOCATION src(copy.Source, c.second);
+			mCommandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		}
+		for (const auto& c : copy.UploadCopies)
+		{
+			CD3DX12_TEXTURE_COPY_LOCATION dst(copy.Dest, c.first);
+			CD3DX12_TEXTURE_COPY_LOCATION src(copy.Upload, c.second);
+			mCommandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		}
+	}
+
+	barriers.clear();
+	for (const ResidencyCopy& copy : packet.Residency)
+	{
+		if (copy.Source)
+			barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(copy.Source,
+				D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+		barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(copy.Dest,
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	}
+	mCommandList->ResourceBarrier((UINT)barriers.size(), barriers.data());
 }
 
 void TexColumnsApp::UpdateTerrainCBs(const GameTimer& gt)
 {
+	PROFILE_SCOPE("UpdateTerrainCBs");
 	auto currTileCB = mCurrFrameResource->TerrainCB.get();
 	for (auto& tile : mTerrain->GetAllTiles())
 	{
@@ -1123,11 +2455,24 @@ void TexColumnsApp::UpdateTerrainCBs(const GameTimer& gt)
 
 void TexColumnsApp::UpdateTerrain(const GameTimer& gt)
 {
+	PROFILE_SCOPE("UpdateTerrain");
 	if (!mTerrain)
 		return;
 
 
-	mTerrain->Update(mCamera.GetPosition3f(), mCamera.GetFrustum());
+	BoundingFrustum frustum = mCamera.GetFrustum();
+	mTerrain->Update(mCamera.GetPosition3f(), frustum, mCullViews.data() + 1, (uint32_t)mCullViews.size() - 1);
+	mTerrainSnapshots.Publish(*mTerrain, mSimulationFrame + 1, mCamera.GetPosition3f());
+
+	if (mPathRecord.is_open())
+	{
+		const XMFLOAT3 eye = mCamera.GetPosition3f();
+		const XMFLOAT3 look = mCamera.GetLook3f();
+		mPathRecord << eye.x << ' ' << eye.y << ' ' << eye.z << ' '
+			<< look.x << ' ' << look.y << ' ' << look.z << ' '
+			<< XMConvertToDegrees(mCamera.GetFovY()) << '\n';
+		++mPathFrames;
+	}
 	//mTerrain->UpdateBoundainBoxes(terrainOffset);
 	//auto& visibleTiles = mTerrain->GetVisibleTiles();
 	//for (auto& tile : visibleTiles)
@@ -1147,6 +2492,98 @@ void TexColumnsApp::LoadDDSTexture(std::string name, std::wstring filename)
 	mTextures[name] = std::move(tex);
 }
 
+void TexColumnsApp::QueueDDSTexture(std::string name, std::wstring filename)
+{
+	for (auto& queued : mQueuedTextures)
+	{
+		if (queued.first == name)
+			return;
+	}
+	mQueuedTextures.emplace_back(std::move(name), std::move(filename));
+}
+
+void TexColumnsApp::LoadQueuedTextures()
+{
+	PROFILE_SCOPE("LoadQueuedTextures");
+	// Jobs read and parse the files (no device access); this thread creates
+	// the resources and records the uploads in queue order as soon as each
+	// file is ready, so disk I/O overlaps with UpdateSubresources. Waiting for
+	// a file that is not read yet runs read jobs here too.
+	const size_t count = mQueuedTextures.size();
+	if (count == 0)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	const bool mapped = mUseMappedTextureLoads;
+
+	DirectX::DDSReadBufferPool pool;
+	std::vector<DirectX::DDSTextureData> parsed(count);
+	std::vector<HRESULT> results(count, E_PENDING);
+	std::vector<JobCounter> ready(count);
+
+	JobSystem& jobs = JobSystem::Get();
+	for (size_t i = 0; i < count; ++i)
+	{
+		jobs.Run([&, i]()
+		{
+			PROFILE_SCOPE("ReadDDS");
+			const wchar_t* file = mQueuedTextures[i].second.c_str();
+			results[i] = mapped
+				? DirectX::LoadDDSTextureDataMapped12(file, parsed[i])
+				: DirectX::LoadDDSTextureData12(file, parsed[i], &pool);
+		}, &ready[i]);
+	}
+
+	char msg[512];
+	for (size_t i = 0; i < count; ++i)
+	{
+		jobs.Wait(ready[i]);
+
+		const std::string& name = mQueuedTextures[i].first;
+		if (FAILED(results[i]))
+		{
+			sprintf_s(msg, "Failed to load: %s (hr=0x%08X)\n", name.c_str(), (unsigned)results[i]);
+			OutputDebugStringA(msg);
+			continue;
+		}
+
+		auto tex = std::make_unique<Texture>();
+		tex->Name = name;
+		tex->Filename = mQueuedTextures[i].second;
+		HRESULT hr = DirectX::CreateDDSTextureFromData12(md3dDevice.Get(), mCommandList.Get(),
+			parsed[i], tex->Resource, tex->UploadHeap);
+		DirectX::ReleaseDDSTextureData(parsed[i], &pool);
+		if (FAILED(hr))
+		{
+			sprintf_s(msg, "Failed to create: %s (hr=0x%08X)\n", name.c_str(), (unsigned)hr);
+			OutputDebugStringA(msg);
+			continue;
+		}
+
+		mTextures[name] = std::move(tex);
+		sprintf_s(msg, "Loaded: %s\n", name.c_str());
+		OutputDebugStringA(msg);
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	sprintf_s(msg, "Loaded %d DDS textures in %.1f ms (%s, %d threads, %d read buffers allocated)\n",
+		(int)count, ms, mapped ? "mapped" : "read", (int)jobs.GetThreadCount(), (int)pool.GetAllocationCount());
+	OutputDebugStringA(msg);
+
+	// Peak private commit is what the read buffers cost; mapped pages only show
+	// up in the working set and can be dropped by the OS at any time.
+	PROCESS_MEMORY_COUNTERS memCounters = {};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &memCounters, sizeof(memCounters)))
+	{
+		sprintf_s(msg, "  peak working set %.1f MB, peak private %.1f MB\n",
+			memCounters.PeakWorkingSetSize / (1024.0 * 1024.0),
+			memCounters.PeakPagefileUsage / (1024.0 * 1024.0));
+		OutputDebugStringA(msg);
+	}
+
+	mQueuedTextures.clear();
+}
+
 void TexColumnsApp::LoadDDSTexturesFromFolder(const std::wstring& folderPath)
 {
 	namespace fs = std::filesystem;
@@ -1203,32 +2640,14 @@ void TexColumnsApp::LoadDDSTexturesFromFolder(const std::wstring& folderPath)
 						continue;
 					}
 
-					try
-					{
-						// Загружаем текстуру
-						LoadDDSTexture(textureName, filePath);
-						// Сохраняем в TexOffsets (если используется)
-						if (TexOffsets.find(textureName) == TexOffsets.end())
-						{
-							static int textureCounter = 0;
-							TexOffsets[textureName] = textureCounter++;
-						}
-						loadedCount++;
-						// Логируем
-						char debugMsg[256];
-						sprintf_s(debugMsg, "Loaded: %s\n", textureName.c_str());
-						OutputDebugStringA(debugMsg);
-					}
-					catch (...)
-					{
-						std::wstring errorMsg = L"Failed to load: " + fileName + L"\n";
-						OutputDebugStringW(errorMsg.c_str());
-					}
+					// Actual loading happens in LoadQueuedTextures
+					QueueDDSTexture(textureName, filePath);
+					loadedCount++;
 				}
 			}
 		}
 		char summary[256];
-		sprintf_s(summary, "Loaded %d DDS textures\n", loadedCount);
+		sprintf_s(summary, "Queued %d DDS textures\n", loadedCount);
 		OutputDebugStringA(summary);
 	}
 	catch (const fs::filesystem_error& e)
@@ -1241,21 +2660,24 @@ void TexColumnsApp::LoadDDSTexturesFromFolder(const std::wstring& folderPath)
 
 void TexColumnsApp::LoadTextures()
 {
+	PROFILE_SCOPE("LoadTextures");
 	char msg[256];
 	sprintf_s(msg, "Loading textures...\n");
 	OutputDebugStringA(msg);
 	//LoadDDSTexture("disp_placeholder", L"../../Textures/terrain_disp.dds");
 
-	LoadDDSTexture("stoneTex", L"../../Textures/stone.dds");
-	LoadDDSTexture("stoneNorm", L"../../Textures/stone_nmap.dds");
-	LoadDDSTexture("stonetDisp", L"../../Textures/stone_disp.dds");
+	QueueDDSTexture("stoneTex", L"../../Textures/stone.dds");
+	QueueDDSTexture("stoneNorm", L"../../Textures/stone_nmap.dds");
+	QueueDDSTexture("stonetDisp", L"../../Textures/stone_disp.dds");
 
-	LoadDDSTexture("terrainDiff", L"../../Textures/terrain_diff.dds");
-	LoadDDSTexture("terrainNorm", L"../../Textures/terrain_norm.dds");
-	LoadDDSTexture("terrainDisp", L"../../Textures/terrain_disp.dds");
+	QueueDDSTexture("terrainDiff", L"../../Textures/terrain_diff.dds");
+	QueueDDSTexture("terrainNorm", L"../../Textures/terrain_norm.dds");
+	QueueDDSTexture("terrainDisp", L"../../Textures/terrain_disp.dds");
 
 	LoadDDSTexturesFromFolder(L"../../Textures/Guard/");
 	LoadDDSTexturesFromFolder(L"../../Textures/Maxwell/");
+
+	LoadQueuedTextures();
 }
 
 
@@ -1536,7 +2958,9 @@ void TexColumnsApp::BuildDescriptorHeaps()
 	//
 	UINT numTAASRVs = 4;
 	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = mTextures.size() + 2 + numTAASRVs; // Все текстуры + SRV кисти + UAV кисти
+	// Все текстуры + SRV кисти + UAV кисти, then a second slot per texture for mip streaming
+	mResidencySrvBase = (int)mTextures.size() + 2 + numTAASRVs;
+	srvHeapDesc.NumDescriptors = mResidencySrvBase + mTextures.size();
 	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
 	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 
@@ -1672,6 +3096,10 @@ void TexColumnsApp::BuildDescriptorHeaps()
 	sprintf_s(msg, "Total descriptors created: %d\n", offset + 2); // +2 для SRV и UAV кисти
 	OutputDebugStringA(msg);
 
+	// The new heap has each texture's current resource in its TexOffsets slot
+	for (size_t id = 0; id < mResidentSlots.size(); ++id)
+		mResidentSlots[id].Srv = TexOffsets[mResidencyTextures[id]];
+
 	OutputDebugStringA("=== END DESCRIPTOR HEAP SUMMARY ===\n\n");
 }
 
@@ -1906,7 +3334,23 @@ void TexColumnsApp::CreateBrushTexture(CD3DX12_CPU_DESCRIPTOR_HANDLE baseDescrip
 	mBrushTextureSRVIndex = baseOffset;
 	mBrushTextureUAVIndex = baseOffset + 1;
 
-	mTextures["brushCanvas"] = std::move(brushTex);
+	mTextures["brushCanvas"] = std::move(brushTex);
+
+	// Upload heap for restoring undone regions; stays mapped for the app lifetime
+	const UINT64 uploadSize = GetRequiredIntermediateSize(mBrushTexture.Get(), 0, 1);
+	CD3DX12_HEAP_PROPERTIES uploadHeapProperties(D3D12_HEAP_TYPE_UPLOAD);
+	CD3DX12_RESOURCE_DESC uploadDesc = CD3DX12_RESOURCE_DESC::Buffer(uploadSize);
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&uploadHeapProperties,
+		D3D12_HEAP_FLAG_NONE,
+		&uploadDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mBrushTextureUpload)));
+	ThrowIfFailed(mBrushTextureUpload->Map(0, nullptr, reinterpret_cast<void**>(&mBrushUploadData)));
+
+	mPaintLayer = std::make_unique<PaintLayer>((int)mBrushTextureWidth, (int)mBrushTextureHeight);
+	mBrushUndo.SetMemoryBudget((size_t)(mBrushUndoBudgetMB * 1024.f * 1024.f));
 
 	// 6. Инициализируем текстуру черным цветом
 	//InitializeBrushTexture();
@@ -1972,6 +3416,7 @@ void TexColumnsApp::CreateVelocityBuffer()
 
 void TexColumnsApp::BuildShadersAndInputLayout()
 {
+	PROFILE_SCOPE("BuildShadersAndInputLayout");
 	const D3D_SHADER_MACRO alphaTestDefines[] =
 	{
 		"ALPHA_TEST", "1",
@@ -2012,6 +3457,7 @@ void TexColumnsApp::BuildShadersAndInputLayout()
 
 void TexColumnsApp::BuildPSOs()
 {
+	PROFILE_SCOPE("BuildPSOs");
 	OutputDebugStringA("=== Building PSOs ===\n");
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc; //HeightMaps!!!!
 
@@ -2218,9 +3664,10 @@ void TexColumnsApp::BuildPSOs()
 	
 }
 
+// Sized by the final item, material and tile counts, so it runs once at
+// startup after every render item exists and before anything is submitted
 void TexColumnsApp::BuildFrameResources()
 {
-	FlushCommandQueue();
 	mFrameResources.clear();
 	for (int i = 0; i < gNumFrameResources; ++i)
 	{
@@ -2244,137 +3691,62 @@ void TexColumnsApp::BuildFrameResources()
 	}
 }
 
+// The OBJ is only parsed (by Assimp) when the cooked file is missing or stale.
+// Touches nothing but cook, so the models cook in parallel.
+void TexColumnsApp::CookCustomMesh(const std::string& name, MeshCook& cook)
+{
+	const std::string sourceFile = "../../Models/" + name + ".obj";
+	const std::wstring cookedFile = L"../../Models/" + std::wstring(name.begin(), name.end()) + L".mesh";
+	cook.Ok = MeshCooker::CookIfStale(sourceFile, cookedFile, &cook.Recooked, cook.Error, &cook.Stats);
+}
+
 void TexColumnsApp::BuildCustomMeshGeometry(std::string name, UINT& meshVertexOffset, UINT& meshIndexOffset, UINT& prevVertSize, UINT& prevIndSize, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo)
 {
-	std::vector<GeometryGenerator::MeshData> meshDatas; //структура для хранения вершин и индексов
+	static_assert(sizeof(Vertex) == sizeof(CookedVertex), "cooked vertex layout must match Vertex");
 
-	// Создаем инстанс импортера.
-	Assimp::Importer importer;
-	// Читаем файл с постпроцессингом: триангуляция, флип UV (если нужно) и генерация нормалей.
-	const aiScene* scene = importer.ReadFile("../../Models/" + name + ".obj",
-		aiProcess_Triangulate |
-		aiProcess_ConvertToLeftHanded |
-		aiProcess_FlipUVs |
-		aiProcess_GenNormals |
-		aiProcess_CalcTangentSpace);
-	if (!scene || !scene->mRootNode)
-	{
-		std::cerr << "Assimp error: " << importer.GetErrorString() << std::endl;
-	}
-	unsigned int nMeshes = scene->mNumMeshes;
-	ObjectsMeshCount[name] = nMeshes;
+	auto start = std::chrono::high_resolution_clock::now();
 
-	for (int i = 0; i < scene->mNumMeshes; i++)
+	// Startup cooks every model in its own task first; cook here otherwise
+	const std::wstring cookedFile = L"../../Models/" + std::wstring(name.begin(), name.end()) + L".mesh";
+	auto cooked = mMeshCooks.find(name);
+	if (cooked == mMeshCooks.end())
 	{
-		GeometryGenerator::MeshData meshData;
-		aiMesh* mesh = scene->mMeshes[i];
-
-		// Подготовка контейнеров для вершин и индексов.
-		std::vector<GeometryGenerator::Vertex> vertices;
-		std::vector<std::uint16_t> indices;
-
-		// Проходим по всем вершинам и копируем данные.
-		for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
-		{
-			GeometryGenerator::Vertex v;
-
-			v.Position.x = mesh->mVertices[i].x;
-			v.Position.y = mesh->mVertices[i].y;
-			v.Position.z = mesh->mVertices[i].z;
-
-			if (mesh->HasNormals())
-			{
-				v.Normal.x = mesh->mNormals[i].x;
-				v.Normal.y = mesh->mNormals[i].y;
-				v.Normal.z = mesh->mNormals[i].z;
-			}
-
-			if (mesh->HasTextureCoords(0))
-			{
-				v.TexC.x = mesh->mTextureCoords[0][i].x;
-				v.TexC.y = mesh->mTextureCoords[0][i].y;
-			}
-			else
-			{
-				v.TexC = XMFLOAT2(0.0f, 0.0f);
-			}
-			if (mesh->HasTangentsAndBitangents())
-			{
-				v.TangentU.x = mesh->mTangents[i].x;
-				v.TangentU.y = mesh->mTangents[i].y;
-				v.TangentU.z = mesh->mTangents[i].z;
-
-			}
-
-			// Если необходимо, можно обработать тангенты и другие атрибуты.
-			vertices.push_back(v);
-		}
-		// Проходим по всем граням для формирования индексов.
-		for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
-		{
-			aiFace face = mesh->mFaces[i];
-			// Убедимся, что грань треугольная.
-			if (face.mNumIndices != 3) continue;
-			indices.push_back(static_cast<std::uint16_t>(face.mIndices[0]));
-			indices.push_back(static_cast<std::uint16_t>(face.mIndices[1]));
-			indices.push_back(static_cast<std::uint16_t>(face.mIndices[2]));
-		}
-
-		// Заполняем meshData. Здесь тебе нужно адаптировать под свою структуру:
-		meshData.Vertices = vertices;
-		meshData.Indices32.resize(indices.size());
-		for (size_t j = 0; j < indices.size(); ++j)
-			meshData.Indices32[j] = indices[j];
-
-		aiMaterial* mat = scene->mMaterials[mesh->mMaterialIndex];
-		aiString texturePath;
-
-		aiString texPath;
-
-		meshData.matName = scene->mMaterials[mesh->mMaterialIndex]->GetName().C_Str();
-		// Если требуется, можно выполнить дополнительные операции, например, нормализацию, вычисление тангенсов и т.д.
-		meshDatas.push_back(meshData);
+		cooked = mMeshCooks.emplace(name, MeshCook()).first;
+		CookCustomMesh(name, cooked->second);
 	}
-	for (int k = 0; k < scene->mNumMaterials; k++)
+	const MeshCook& cook = cooked->second;
+	if (!cook.Ok)
 	{
-		aiString texPath;
+		std::cerr << "Mesh cook error: " << cook.Error << std::endl;
+		ObjectsMeshCount[name] = 0;
+		return;
+	}
+	const bool recooked = cook.Recooked;
+	const MeshOptimizeStats& optimizeStats = cook.Stats;
 
-		//Diffuse
-		std::string diffuseName = "";
-		if (scene->mMaterials[k]->GetTexture(aiTextureType_DIFFUSE, 0, &texPath) == AI_SUCCESS)
-		{
-			diffuseName = std::string(texPath.C_Str());
-			diffuseName = diffuseName.substr(0, diffuseName.length() - 4); //file extension
-			std::cout << "DIFFUSE: " << diffuseName << "\n";
-		}
+	MeshFileView mesh;
+	if (!mesh.Open(cookedFile))
+	{
+		std::cerr << "Cannot open cooked mesh: " << name << std::endl;
+		ObjectsMeshCount[name] = 0;
+		return;
+	}
 
-		//Normal
-		std::string normalName = "";
-		if (scene->mMaterials[k]->GetTexture(aiTextureType_NORMALS, 0, &texPath) == AI_SUCCESS ||
-			scene->mMaterials[k]->GetTexture(aiTextureType_HEIGHT, 0, &texPath) == AI_SUCCESS)
-		{
-			normalName = std::string(texPath.C_Str());
-			normalName = normalName.substr(0, normalName.length() - 4);
-			std::cout << "NORMAL: " << normalName << "\n";
-		}
+	ObjectsMeshCount[name] = mesh.GetSubmeshCount();
 
-		// Displacement
-		//std::string displacementName = "";
-		//if (scene->mMaterials[k]->GetTexture(aiTextureType_DISPLACEMENT, 0, &texPath) == AI_SUCCESS)
-		//{
-		//	displacementName = std::string(texPath.C_Str());
-		//	displacementName = displacementName.substr(0, displacementName.length() - 4);
-		//	std::cout << "DISPLACEMENT: " << displacementName << "\n";
-		//}
+	for (UINT k = 0; k < mesh.GetMaterialCount(); k++)
+	{
+		const std::string diffuseName = mesh.GetDiffuseMap(k);
+		const std::string normalName = mesh.GetNormalMap(k);
 
 		// Проверяем наличие смещений в TexOffsets
 		int diffuseIndex = TexOffsets.find(diffuseName) != TexOffsets.end() ? TexOffsets[diffuseName] : 0;
 		int normalIndex = TexOffsets.find(normalName) != TexOffsets.end() ? TexOffsets[normalName] : 0;
-		int displacementIndex = -1;//TexOffsets.find(displacementName) != TexOffsets.end() ? TexOffsets[displacementName] : 0;
+		int displacementIndex = -1;
 
 		// Создаем материал со всеми текстурами
 		CreateMaterial(
-			scene->mMaterials[k]->GetName().C_Str(),
+			mesh.GetMaterialName(k),
 			k,
 			diffuseIndex,
 			normalIndex,
@@ -2385,48 +3757,72 @@ void TexColumnsApp::BuildCustomMeshGeometry(std::string name, UINT& meshVertexOf
 		);
 	}
 
-	UINT totalMeshSize = 0;
-	UINT k = vertices.size();
-	std::vector<std::pair<GeometryGenerator::MeshData, SubmeshGeometry>>meshSubmeshes;
-	for (auto mesh : meshDatas)
+	// Vertex and index streams go into the shared buffers straight from the mapping
+	const size_t firstVertex = vertices.size();
+	const size_t firstIndex = indices.size();
+	vertices.resize(firstVertex + mesh.GetVertexCount());
+	memcpy(vertices.data() + firstVertex, mesh.GetVertices(), mesh.GetVertexCount() * sizeof(Vertex));
+	indices.insert(indices.end(), mesh.GetIndices(), mesh.GetIndices() + mesh.GetIndexCount());
+
+	std::vector<std::pair<GeometryGenerator::MeshData, SubmeshGeometry>> meshSubmeshes;
+	meshSubmeshes.reserve(mesh.GetSubmeshCount());
+	for (UINT i = 0; i < mesh.GetSubmeshCount(); i++)
 	{
-		meshVertexOffset = meshVertexOffset + prevVertSize;
-		prevVertSize = mesh.Vertices.size();
-		totalMeshSize += mesh.Vertices.size();
+		const MeshFileSubmesh& sm = mesh.GetSubmesh(i);
 
-		meshIndexOffset = meshIndexOffset + prevIndSize;
-		prevIndSize = mesh.Indices32.size();
+		// LOD index lists follow the submeshes, so the offsets come from the file
 		SubmeshGeometry meshSubmesh;
-		meshSubmesh.IndexCount = (UINT)mesh.Indices32.size();
-		meshSubmesh.StartIndexLocation = meshIndexOffset;
-		meshSubmesh.BaseVertexLocation = meshVertexOffset;
-
-		BoundingBox::CreateFromPoints(meshSubmesh.Bounds,
-			mesh.Vertices.size(),
-			&mesh.Vertices[0].Position,
-			sizeof(Vertex)
-		);
-		GeometryGenerator::MeshData m = mesh;
-		meshSubmeshes.push_back(std::make_pair(m, meshSubmesh));
+		meshSubmesh.IndexCount = sm.IndexCount;
+		meshSubmesh.StartIndexLocation = (UINT)firstIndex + sm.StartIndex;
+		meshSubmesh.BaseVertexLocation = (INT)firstVertex + sm.BaseVertex;
+		meshSubmesh.Bounds = BoundingBox(
+			XMFLOAT3(sm.BoundsCenter[0], sm.BoundsCenter[1], sm.BoundsCenter[2]),
+			XMFLOAT3(sm.BoundsExtents[0], sm.BoundsExtents[1], sm.BoundsExtents[2]));
+
+		GeometryGenerator::MeshData meshData;
+		meshData.matName = sm.MaterialIndex < mesh.GetMaterialCount() ? mesh.GetMaterialName(sm.MaterialIndex) : "";
+		meshSubmeshes.push_back(std::make_pair(std::move(meshData), meshSubmesh));
 	}
-	/////////
-	/////
-	for (auto mesh : meshDatas)
+	Geo->MultiDrawArgs[name] = std::move(meshSubmeshes);
+
+	meshVertexOffset = (UINT)vertices.size();
+	prevVertSize = 0;
+	meshIndexOffset = (UINT)indices.size();
+	prevIndSize = 0;
+
+	// Simplified levels share the submesh vertices; the error is relative to the
+	// submesh diagonal and becomes world units once the item's scale is known.
+	auto& lods = mMeshLods[name];
+	lods.assign(mesh.GetSubmeshCount(), {});
+	for (UINT i = 0; i < mesh.GetLodCount(); i++)
 	{
-		for (size_t i = 0; i < mesh.Vertices.size(); ++i, ++k)
-		{
-			vertices.push_back(Vertex(mesh.Vertices[i].Position, mesh.Vertices[i].Normal, mesh.Vertices[i].TexC, mesh.Vertices[i].TangentU));
-		}
+		const MeshFileLod& src = mesh.GetLod(i);
+		const MeshFileSubmesh& sm = mesh.GetSubmesh(src.Submesh);
+		const float diagonal = 2.0f * sqrtf(sm.BoundsExtents[0] * sm.BoundsExtents[0] +
+			sm.BoundsExtents[1] * sm.BoundsExtents[1] + sm.BoundsExtents[2] * sm.BoundsExtents[2]);
+
+		LodLevel lod;
+		lod.IndexCount = src.IndexCount;
+		lod.StartIndexLocation = (UINT)firstIndex + src.StartIndex;
+		lod.BaseVertexLocation = (INT)firstVertex + sm.BaseVertex;
+		lod.Error = src.Error * diagonal;
+		lods[src.Submesh].push_back(lod);
 	}
-	////////
 
-	///////
-	for (auto mesh : meshDatas)
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	char msg[256];
+	sprintf_s(msg, "Mesh %s: %u submeshes, %u LODs, %u vertices, %u indices in %.2f ms (%s)\n",
+		name.c_str(), mesh.GetSubmeshCount(), mesh.GetLodCount(), mesh.GetVertexCount(), mesh.GetIndexCount(), ms,
+		recooked ? "cooked from OBJ" : "cached");
+	OutputDebugStringA(msg);
+
+	if (recooked)
 	{
-		indices.insert(indices.end(), std::begin(mesh.GetIndices16()), std::end(mesh.GetIndices16()));
+		sprintf_s(msg, "  optimized in %.2f ms: %u vertices welded, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u clusters, %u unused vertices removed\n",
+			optimizeStats.Milliseconds, optimizeStats.WeldedVertices, optimizeStats.Before.ACMR, optimizeStats.After.ACMR,
+			optimizeStats.Before.ATVR, optimizeStats.After.ATVR, optimizeStats.Clusters, optimizeStats.RemovedVertices);
+		OutputDebugStringA(msg);
 	}
-	///////
-	Geo->MultiDrawArgs[name] = meshSubmeshes;
 }
 //void TexColumnsApp::BuildMultiLODGeometry(std::string name, int nLODs, UINT& meshVertexOffset, UINT& meshIndexOffset, UINT& prevVertSize, UINT& prevIndSize, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo)
 //{
@@ -2449,8 +3845,10 @@ void TexColumnsApp::BuildAllCustomMeshes(UINT& meshVertexOffset, UINT& meshIndex
 	BuildCustomMeshGeometry("maxwell", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, Geo);
 }
 
-void TexColumnsApp::BuildShapeGeometry()
+// CPU only; UploadGeometry creates the buffers on the main thread
+std::unique_ptr<MeshGeometry> TexColumnsApp::BuildShapeGeometry()
 {
+	PROFILE_SCOPE("BuildShapeGeometry");
 	GeometryGenerator geoGen;
 	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 3);
 	GeometryGenerator::MeshData grid = geoGen.CreateGrid(10.0f, 10.0f, 2, 2);
@@ -2561,12 +3959,6 @@ void TexColumnsApp::BuildShapeGeometry()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -2577,205 +3969,33 @@ void TexColumnsApp::BuildShapeGeometry()
 	geo->DrawArgs["sphere"] = sphereSubmesh;
 	geo->DrawArgs["cylinder"] = cylinderSubmesh;
 
-	mGeometries[geo->Name] = std::move(geo);
+	return geo;
 }
 
-void TexColumnsApp::GenerateTileGeometry(const XMFLOAT3& worldPos, float tileSize, int lodLevel, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices)
-{
-	int minResolution = 8;    
-
-	int resolution = (minResolution << lodLevel);
-	resolution = std::min(resolution, minResolution);
-	vertices.clear();
-	indices.clear();
-
-	//float scale = 1;
-
-	float stepSize = (tileSize) / (resolution - 1);
-	float curtainDepth = 50;
-
-	//main vertices
-	for (int z = 0; z < resolution; z++)
-	{
-		for (int x = 0; x < resolution; x++)
-		{
-			Vertex vertex;
-			vertex.Pos = XMFLOAT3(worldPos.x + x * stepSize, worldPos.y, worldPos.z + z * stepSize);
-			vertex.TexC = XMFLOAT2((float)x / (resolution - 1), (float)z / (resolution - 1));
-			vertex.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			vertex.Tangent = XMFLOAT3(1.0f, 0.0f, 0.0f);
-			vertices.push_back(vertex);
-		}
-	}
-
-	int mainVertexCount = static_cast<int>(vertices.size());
-
-	//curtain vertices
-	// Left (x = 0)
-	for (int z = 0; z < resolution; z++)
-	{
-		Vertex vertex = vertices[z * resolution];
-		vertex.Pos.y = worldPos.y -curtainDepth;
-		vertices.push_back(vertex);
-	}
-
-	// right (x = resolution-1)  
-	for (int z = 0; z < resolution; z++)
-	{
-		Vertex vertex = vertices[z * resolution + (resolution - 1)];
-		vertex.Pos.y = worldPos.y -curtainDepth;
-		vertices.push_back(vertex);
-	}
-
-	// bottom (z = 0)
-	for (int x = 0; x < resolution ; x++)
-	{
-		Vertex vertex = vertices[0 * resolution + x];
-		vertex.Pos.y = worldPos.y -curtainDepth;
-		vertices.push_back(vertex);
-	}
-
-	// top(z = resolution-1)
-	for (int x = 0; x < resolution ; x++)
-	{
-		Vertex vertex = vertices[(resolution - 1) * resolution + x];
-		vertex.Pos.y = worldPos.y -curtainDepth;
-		vertices.push_back(vertex);
-	}
-
-	//Indices
-	for (int z = 0; z < resolution - 1; z++)
-	{
-		for (int x = 0; x < resolution - 1; x++)
-		{
-			UINT topLeft = z * resolution + x;
-			UINT topRight = topLeft + 1;
-			UINT bottomLeft = (z + 1) * resolution + x;
-			UINT bottomRight = bottomLeft + 1;
-
-			indices.push_back(topLeft);
-			indices.push_back(bottomLeft);
-			indices.push_back(topRight);
-
-			indices.push_back(topRight);
-			indices.push_back(bottomLeft);
-			indices.push_back(bottomRight);
-		}
-	}
-
-	// curtain indices
-	int leftCurtainStart = mainVertexCount;
-	int rightCurtainStart = leftCurtainStart + resolution;
-	int bottomCurtainStart = rightCurtainStart + resolution;
-	int topCurtainStart = bottomCurtainStart + resolution;
-
-	//left
-	for (int z = 0; z < resolution - 1; z++)
-	{
-		UINT edge1 = z * resolution;
-		UINT edge2 = (z + 1) * resolution;
-		UINT curtain1 = leftCurtainStart + z;
-		UINT curtain2 = leftCurtainStart + z + 1;
-
-		indices.push_back(edge1);
-		indices.push_back(curtain1);
-		indices.push_back(edge2);
-
-		indices.push_back(edge2);
-		indices.push_back(curtain1);
-		indices.push_back(curtain2);
-	}
-
-	// right 
-	for (int z = 0; z < resolution - 1; z++)
-	{
-		UINT edge1 = z * resolution + (resolution - 1);
-		UINT edge2 = (z + 1) * resolution + (resolution - 1);
-		UINT curtain1 = rightCurtainStart + z;
-		UINT curtain2 = rightCurtainStart + z + 1;
-
-		indices.push_back(edge1);
-		indices.push_back(edge2);
-		indices.push_back(curtain1);
-
-		indices.push_back(edge2);
-		indices.push_back(curtain2);
-		indices.push_back(curtain1);
-	}
-
-	// bottom
-	for (int x = 0; x < resolution - 1; x++)
-	{
-		UINT edge1 = x;
-		UINT edge2 = x + 1;
-		UINT curtain1 = bottomCurtainStart + x;
-		UINT curtain2 = bottomCurtainStart + x+1;
-
-		indices.push_back(edge1);
-		indices.push_back(edge2);
-		indices.push_back(curtain1);
-
-		indices.push_back(edge2);
-		indices.push_back(curtain2);
-		indices.push_back(curtain1);
-	}
-
-	// top
-	for (int x = 0; x < resolution - 1; x++)
-	{
-		UINT edge1 = (resolution - 1) * resolution + x;
-		UINT edge2 = (resolution - 1) * resolution + x + 1;
-		UINT curtain1 = topCurtainStart + x;
-		UINT curtain2 = topCurtainStart + x+1;
-
-		indices.push_back(edge1);
-		indices.push_back(curtain1);
-		indices.push_back(edge2);
-
-		indices.push_back(edge2);
-		indices.push_back(curtain1);
-		indices.push_back(curtain2);
-	}
-}
-void TexColumnsApp::BuildTerrainGeometry()
+// CPU only, like BuildShapeGeometry
+std::unique_ptr<MeshGeometry> TexColumnsApp::BuildTerrainGeometry()
 {
+	PROFILE_SCOPE("BuildTerrainGeometry");
 	auto terrainGeo = std::make_unique<MeshGeometry>();
 	terrainGeo->Name = "terrainGeo";
 
+	static_assert(sizeof(Vertex) == sizeof(TerrainVertex), "terrain vertex layout must match Vertex");
 	auto& allTiles = mTerrain->GetAllTiles();
 
-	std::vector<Vertex> allVertices;
+	std::vector<TerrainVertex> allVertices;
 	std::vector<std::uint32_t> allIndices;
+	std::vector<TerrainTileRange> ranges;
+	TerrainMesh::BuildTiles(allTiles, allVertices, allIndices, ranges);
 
 	for (int tileIdx = 0; tileIdx < allTiles.size(); tileIdx++)
 	{
-		auto& tile = allTiles[tileIdx];
-
-		std::vector<Vertex> tileVertices;
-		std::vector<std::uint32_t> tileIndices;
-
-		GenerateTileGeometry(tile->worldPos, tile->tileSize, tile->lodLevel, tileVertices, tileIndices);
-
-		// ������� ������� �� ���������� ��� ����������� ������
-		UINT baseVertex = static_cast<int>(allVertices.size());
-		for (auto& index : tileIndices)
-		{
-			index += baseVertex;
-		}
-
-		// ��������� submesh
 		SubmeshGeometry submesh;
-		submesh.IndexCount = (UINT)tileIndices.size();
-		submesh.StartIndexLocation = (UINT)allIndices.size();
+		submesh.IndexCount = ranges[tileIdx].IndexCount;
+		submesh.StartIndexLocation = ranges[tileIdx].StartIndex;
 		submesh.BaseVertexLocation = 0;
 
-		std::string submeshName = "tile_" + std::to_string(tileIdx) + "_LOD_" + std::to_string(tile->lodLevel);
+		std::string submeshName = "tile_" + std::to_string(tileIdx) + "_LOD_" + std::to_string(allTiles[tileIdx]->lodLevel);
 		terrainGeo->DrawArgs[submeshName] = submesh;
-
-		// ��������� � ����� �������
-		allVertices.insert(allVertices.end(), tileVertices.begin(), tileVertices.end());
-		allIndices.insert(allIndices.end(), tileIndices.begin(), tileIndices.end());
-
 	}
 
 	const UINT vbByteSize = (UINT)allVertices.size() * sizeof(Vertex);
@@ -2787,20 +4007,25 @@ void TexColumnsApp::BuildTerrainGeometry()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &terrainGeo->IndexBufferCPU));
 	CopyMemory(terrainGeo->IndexBufferCPU->GetBufferPointer(), allIndices.data(), ibByteSize);
 
-	terrainGeo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
-		allVertices.data(), vbByteSize,
-		terrainGeo->VertexBufferUploader);
-
-	terrainGeo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
-		allIndices.data(), ibByteSize,
-		terrainGeo->IndexBufferUploader);
-
 	terrainGeo->VertexByteStride = sizeof(Vertex);
 	terrainGeo->VertexBufferByteSize = vbByteSize;
 	terrainGeo->IndexFormat = DXGI_FORMAT_R32_UINT;
 	terrainGeo->IndexBufferByteSize = ibByteSize;
 
-	mGeometries[terrainGeo->Name] = std::move(terrainGeo);
+	return terrainGeo;
+}
+
+// Records the copies on mCommandList, so startup runs it on the main thread
+void TexColumnsApp::UploadGeometry(std::unique_ptr<MeshGeometry> geo)
+{
+	PROFILE_SCOPE("UploadGeometry");
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		geo->VertexBufferCPU->GetBufferPointer(), geo->VertexBufferByteSize, geo->VertexBufferUploader);
+
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		geo->IndexBufferCPU->GetBufferPointer(), geo->IndexBufferByteSize, geo->IndexBufferUploader);
+
+	mGeometries[geo->Name] = std::move(geo);
 }
 
 void TexColumnsApp::BuildFullscreenQuadGeometry()
@@ -3005,6 +4230,7 @@ void TexColumnsApp::BuildMaterials()
 
 void TexColumnsApp::BuildRenderItems()
 {
+	PROFILE_SCOPE("BuildRenderItems");
 	auto gridRitem = std::make_unique<RenderItem>();
 	gridRitem->World = MathHelper::Identity4x4();
 	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
@@ -3065,485 +4291,428 @@ void TexColumnsApp::RenderCustomMesh(std::string unique_name, std::string meshna
 		std::cout << unique_name << " " << matname << "\n";
 		if (materialName != "") matname = materialName;
 		rItem->Mat = mMaterials[matname].get();
+		rItem->Bounds = rItem->Geo->MultiDrawArgs[meshname][i].second.Bounds;
 		rItem->IndexCount = rItem->Geo->MultiDrawArgs[meshname][i].second.IndexCount;
 		rItem->StartIndexLocation = rItem->Geo->MultiDrawArgs[meshname][i].second.StartIndexLocation;
 		rItem->BaseVertexLocation = rItem->Geo->MultiDrawArgs[meshname][i].second.BaseVertexLocation;
+
+		// LOD 0 is the submesh itself. Each level is kept while the next one's
+		// error projects to less than a pixel.
+		XMVECTOR scale, rotation, translation;
+		XMMatrixDecompose(&scale, &rotation, &translation, Scale * Rotation * Translation);
+		const float worldScale = (std::max)(XMVectorGetX(scale), (std::max)(XMVectorGetY(scale), XMVectorGetZ(scale)));
+		const float pixelsPerUnit = 0.5f * mClientHeight / tanf(0.5f * mCamera.GetFovY());
+
+		LodLevel base;
+		base.IndexCount = rItem->IndexCount;
+		base.StartIndexLocation = rItem->StartIndexLocation;
+		base.BaseVertexLocation = rItem->BaseVertexLocation;
+		rItem->LodLevels.push_back(base);
+		if (i < (int)mMeshLods[meshname].size())
+			rItem->LodLevels.insert(rItem->LodLevels.end(), mMeshLods[meshname][i].begin(), mMeshLods[meshname][i].end());
+		for (size_t l = 0; l < rItem->LodLevels.size(); ++l)
+		{
+			LodLevel& lod = rItem->LodLevels[l];
+			lod.Geo = rItem->Geo;
+			lod.Bounds = rItem->Bounds;
+			lod.LodMaterial = rItem->Mat;
+			lod.Error *= worldScale;
+		}
+		for (size_t l = 0; l < rItem->LodLevels.size(); ++l)
+		{
+			rItem->LodLevels[l].SwitchDistance = l + 1 < rItem->LodLevels.size()
+				? rItem->LodLevels[l + 1].Error * pixelsPerUnit
+				: MathHelper::Infinity;
+		}
+		rItem->isHaveLods = rItem->LodLevels.size() > 1;
+		rItem->CurrentLodIndex = 0;
+
+		std::vector<float> lodErrors;
+		for (const auto& lod : rItem->LodLevels)
+			lodErrors.push_back(lod.Error);
+		rItem->Bounds.Transform(rItem->WorldBounds, Scale * Rotation * Translation);
+		rItem->Dynamic = rItem->Bobbing = unique_name == "maxwell";
+		const BoundingBox& worldBox = rItem->WorldBounds;
+		mLodSelector.Add(worldBox.Center.x, worldBox.Center.y, worldBox.Center.z,
+			XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBox.Extents))),
+			lodErrors.data(), (uint32_t)lodErrors.size());
+		if (mLodDraws.size() < rItem->LodLevels.size())
+		{
+			mLodDraws.resize(rItem->LodLevels.size());
+			mLodTriangles.resize(rItem->LodLevels.size());
+		}
+
 		mAllRitems.push_back(std::move(rItem));
 		mStandCustomMeshes.push_back(mAllRitems[mAllRitems.size() - 1].get());
 		//mOpaqueRitems.push_back(mAllRitems[mAllRitems.size() - 1].get());
 	}
-	BuildFrameResources();
 }
 
 
-void TexColumnsApp::DrawCustomMeshes(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& customMeshes)
+void TexColumnsApp::BuildRenderIds()
 {
-	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
-
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
-
-	// For each render item...
-	for (size_t i = 0; i < customMeshes.size(); ++i)
-	{
-		auto ri = customMeshes[i];
-
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
-
-		// �������� ������� ���������� ����
-		CD3DX12_GPU_DESCRIPTOR_HANDLE baseHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-
-		// ������������� ������������� ������� ��� �������
-		CD3DX12_GPU_DESCRIPTOR_HANDLE diffuseHandle = baseHandle;
-		diffuseHandle.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(0, diffuseHandle);  // t0 - diffuse
-
-		CD3DX12_GPU_DESCRIPTOR_HANDLE normalHandle = baseHandle;
-		normalHandle.Offset(ri->Mat->NormalSrvHeapIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(1, normalHandle);   // t1 - normal
-
-		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
-
-		cmdList->SetGraphicsRootConstantBufferView(2, objCBAddress);  // b0 - per object
-		cmdList->SetGraphicsRootConstantBufferView(4, matCBAddress);  // b1 - per material
-
-		cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-	}
+	FrameBindings& b = mFrameBindings;
+
+	for (auto& pso : mPSOs)
+		mPipelineIds[pso.first] = mRenderCommands.AddPipeline(pso.second.Get());
+	b.TaaPipeline = mPipelineIds["TAA"];
+	b.BrushPipeline = mPipelineIds["brushCompute"];
+
+	b.OpaqueRootSignature = mRenderCommands.AddRootSignature(mRootSignature.Get());
+	b.StandardMeshRootSignature = mRenderCommands.AddRootSignature(mStandMeshRootSignature.Get());
+	b.TerrainRootSignature = mRenderCommands.AddRootSignature(mTerrainRootSignature.Get());
+	b.TaaRootSignature = mRenderCommands.AddRootSignature(mTAARootSignature.Get());
+	b.BrushRootSignature = mRenderCommands.AddRootSignature(mBrushComputeRootSignature.Get());
+
+	for (auto& geo : mGeometries)
+		mRenderCommands.AddGeometry(geo.second.get());
+
+	// Pointed at this frame's objects by UpdateFrameBindings
+	b.SrvHeap = mRenderCommands.AddDescriptorHeap();
+	b.ObjectCB = mRenderCommands.AddResource();
+	b.MaterialCB = mRenderCommands.AddResource();
+	b.PassCB = mRenderCommands.AddResource();
+	b.TerrainCB = mRenderCommands.AddResource();
+	b.BrushCB = mRenderCommands.AddResource();
+	b.TaaCB = mRenderCommands.AddResource();
+	b.ColorBuffer = mRenderCommands.AddResource();
+	b.VelocityBuffer = mRenderCommands.AddResource();
+	b.PrevHistory = mRenderCommands.AddResource();
+	b.CurrentHistory = mRenderCommands.AddResource();
+	b.BackBuffer = mRenderCommands.AddResource();
+	b.BrushTexture = mRenderCommands.AddResource();
+
+	b.ObjectCBStride = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	b.MaterialCBStride = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	b.TerrainCBStride = d3dUtil::CalcConstantBufferByteSize(sizeof(TileConstants));
+
+	mRenderCommands.SetTargetHeaps(mRtvHeap.Get(), mRtvDescriptorSize, mDsvHeap.Get(), mDsvDescriptorSize);
+	b.Dsv = 0;
+
+	XMFLOAT4 sceneClear, backBufferClear;
+	XMStoreFloat4(&sceneClear, Colors::DarkBlue);
+	XMStoreFloat4(&backBufferClear, Colors::DarkGoldenrod);
+	memcpy(b.SceneClearColor, &sceneClear, sizeof(b.SceneClearColor));
+	memcpy(b.BackBufferClearColor, &backBufferClear, sizeof(b.BackBufferClearColor));
 }
 
-void TexColumnsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void TexColumnsApp::UpdateFrameBindings()
 {
-	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	FrameBindings& b = mFrameBindings;
+
+	b.OpaquePipeline = mPipelineIds[isFillModeSolid ? "opaque" : "wireframe"];
+	b.StandardMeshPipeline = mPipelineIds[isFillModeSolid ? "standardMesh" : "wireStandardMesh"];
+	b.TerrainPipeline = mPipelineIds[isFillModeSolid ? "terrain" : "wireTerrain"];
+
+	// BackBufferRtv is the render side's: it presents
+	b.ColorRtv = mTaaColorBufferRTVIndex;
+	b.VelocityRtv = mVelocityBufferRTVIndex;
+	b.PrevHistoryRtv = mPrevTextureRTVIndex;
+	b.CurrentHistoryRtv = mCurrentTextureRTVIndex;
+	b.ColorSrv = mTaaColorBufferSRVIndex;
+	b.VelocitySrv = mVelocityBufferSRVIndex;
+	b.PrevHistorySrv = mPrevTextureSRVIndex;
+	b.CurrentHistorySrv = mCurrentTextureSRVIndex;
+	b.TerrainDiffuseSrv = TexOffsets["terrainDiff"];
+	b.TerrainNormalSrv = TexOffsets["terrainNorm"];
+	b.TerrainDisplacementSrv = TexOffsets["terrainDisp"];
+	b.BrushSrv = mBrushTextureSRVIndex;
+	b.BrushUav = mBrushTextureUAVIndex;
+
+	b.Viewport.TopLeftX = mScreenViewport.TopLeftX;
+	b.Viewport.TopLeftY = mScreenViewport.TopLeftY;
+	b.Viewport.Width = mScreenViewport.Width;
+	b.Viewport.Height = mScreenViewport.Height;
+	b.Viewport.MinDepth = mScreenViewport.MinDepth;
+	b.Viewport.MaxDepth = mScreenViewport.MaxDepth;
+	b.Scissor.Left = mScissorRect.left;
+	b.Scissor.Top = mScissorRect.top;
+	b.Scissor.Right = mScissorRect.right;
+	b.Scissor.Bottom = mScissorRect.bottom;
+
+	// Ping-pong parity; frameIndex is incremented once the packet has it
+	b.FrameIndex = frameIndex;
+	b.BrushGroupsX = (UINT)ceil(mBrushTextureWidth / 16.0f);
+	b.BrushGroupsY = (UINT)ceil(mBrushTextureHeight / 16.0f);
+}
 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+// The device objects behind the packet's ids: its frame resource's constant
+// buffers and the back buffer presented next. Recorded commands look them
+// up, so this runs on the side that records.
+void TexColumnsApp::BindFrameResources(const FramePacket& packet)
+{
+	const FrameBindings& b = packet.Bindings;
+	FrameResource* frame = mFrameResources[packet.FrameResource].get();
+
+	// The heap and TAA targets are recreated on resize, after a drain
+	mRenderCommands.UpdateDescriptorHeap(b.SrvHeap, mSrvDescriptorHeap.Get(), mCbvSrvDescriptorSize);
+	mRenderCommands.SetResource(b.ObjectCB, frame->ObjectCB->Resource());
+	mRenderCommands.SetResource(b.MaterialCB, frame->MaterialCB->Resource());
+	mRenderCommands.SetResource(b.PassCB, frame->PassCB->Resource());
+	mRenderCommands.SetResource(b.TerrainCB, frame->TerrainCB->Resource());
+	mRenderCommands.SetResource(b.BrushCB, frame->BrushCB->Resource());
+	mRenderCommands.SetResource(b.TaaCB, frame->TAACB->Resource());
+	mRenderCommands.SetResource(b.ColorBuffer, mTAAColorBuffer->GetResource());
+	mRenderCommands.SetResource(b.VelocityBuffer, mTAVelocityBuffer->GetResource());
+	mRenderCommands.SetResource(b.PrevHistory, mTAAPrevTexture->GetResource());
+	mRenderCommands.SetResource(b.CurrentHistory, mTAACurrentTexture->GetResource());
+	mRenderCommands.SetResource(b.BackBuffer, CurrentBackBuffer());
+	mRenderCommands.SetResource(b.BrushTexture, mBrushTexture.Get());
+}
 
-	// For each render item...
-	for (size_t i = 0; i < ritems.size(); ++i)
+// Constant contents are read back from the packet's frame resource's
+// mapped upload buffers, which Update has filled for this frame
+void TexColumnsApp::BeginCapture(const FramePacket& packet)
+{
+	const FrameBindings& b = packet.Bindings;
+	FrameResource* frame = mFrameResources[packet.FrameResource].get();
+	mCapture.Begin(mRenderCommands, (uint32_t)packet.Frame);
+	auto source = [this](RenderId id, const auto& buffer)
 	{
-		auto ri = ritems[i];
-
-		// Пропускаем невидимые объекты
-		/*if (ri->CurrentLodIndex < 0) continue;
-
-		if (ri->IndexCount == 0) {
-			OutputDebugStringA("WARNING: IndexCount is zero!\n");
-			continue;
-		}*/
-
-		//// Определяем геометрию для отрисовки
-		//const MeshGeometry* geoToDraw = nullptr;
-		//UINT indexCount = 0;
-		//UINT startIndexLocation = 0;
-		//int baseVertexLocation = 0;
-
-		//if (ri->LodLevels.empty())
-		//{
-		//	// Объект без LOD - используем основные параметры
-		//	geoToDraw = ri->Geo;
-		//	indexCount = ri->IndexCount;
-		//	startIndexLocation = ri->StartIndexLocation;
-		//	baseVertexLocation = ri->BaseVertexLocation;
-		//}
-		//else
-		//{
-		//	// Объект с LOD - используем активный уровень детализации
-		//	const LodLevel& activeLod = ri->LodLevels[ri->CurrentLodIndex];
-		//	geoToDraw = activeLod.Geo;
-		//	indexCount = activeLod.IndexCount;
-		//	startIndexLocation = activeLod.StartIndexLocation;
-		//	baseVertexLocation = activeLod.BaseVertexLocation;
-		//}
-
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
-
-		// �������� ������� ���������� ����
-		CD3DX12_GPU_DESCRIPTOR_HANDLE baseHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-
-		// ������������� ������������� ������� ��� �������
-		CD3DX12_GPU_DESCRIPTOR_HANDLE diffuseHandle = baseHandle;
-		diffuseHandle.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(0, diffuseHandle);  // t0 - diffuse
-
-		CD3DX12_GPU_DESCRIPTOR_HANDLE normalHandle = baseHandle;
-		normalHandle.Offset(ri->Mat->NormalSrvHeapIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(1, normalHandle);   // t1 - normal
-
-		CD3DX12_GPU_DESCRIPTOR_HANDLE dispHandle = baseHandle;
-		dispHandle.Offset(ri->Mat->DisplacementSrvHeapIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(2, dispHandle);     // t2 - displacement
-
-		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
-
-		cmdList->SetGraphicsRootConstantBufferView(3, objCBAddress);  // b0 - per object
-		cmdList->SetGraphicsRootConstantBufferView(5, matCBAddress);  // b1 - per material
-
-		cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-	}
+		mCapture.SetConstantSource(id, buffer->MappedData(), (size_t)buffer->ByteSize(), buffer->ElementByteSize());
+	};
+	source(b.ObjectCB, frame->ObjectCB);
+	source(b.MaterialCB, frame->MaterialCB);
+	source(b.PassCB, frame->PassCB);
+	source(b.TerrainCB, frame->TerrainCB);
+	source(b.BrushCB, frame->BrushCB);
+	source(b.TaaCB, frame->TAACB);
 }
 
-void TexColumnsApp::DrawTilesRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<Tile*>& tiles)
+void TexColumnsApp::EndCapture()
 {
+	FrameCapture capture;
+	mCapture.End(capture);
 
-	char debugMsg[256];
-
-	sprintf_s(debugMsg, "TexOffsets: diff=%d, norm=%d, disp=%d\n",
-		TexOffsets["terrainDiff"],
-		TexOffsets["terrainNorm"],
-		TexOffsets["terrainDisp"]);
-	OutputDebugStringA(debugMsg);
-
-	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
-	UINT terrCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(TileConstants));
-
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
-
-
-	for (auto& tile : tiles)
+	const std::string path = "frame_" + std::to_string(capture.Frame) + ".capture";
+	std::string error;
+	if (!capture.Save(path, error))
 	{
-		auto ri = mAllRitems[tile->renderItemIndex].get();
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
-
-		CD3DX12_GPU_DESCRIPTOR_HANDLE baseHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-
-		// t0 - Terrain diffuse
-		CD3DX12_GPU_DESCRIPTOR_HANDLE terrainDiffHandle = baseHandle;
-		terrainDiffHandle.Offset(TexOffsets["terrainDiff"], mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(0, terrainDiffHandle);
-
-		// t1 - Terrain normal
-		CD3DX12_GPU_DESCRIPTOR_HANDLE terrainNormHandle = baseHandle;
-		terrainNormHandle.Offset(TexOffsets["terrainNorm"], mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(1, terrainNormHandle);
-
-		// t2 - Terrain displacement
-		CD3DX12_GPU_DESCRIPTOR_HANDLE terrainDispHandle = baseHandle;
-		terrainDispHandle.Offset(TexOffsets["terrainDisp"], mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(2, terrainDispHandle);
-
-		// === t3 - Brush texture (НОВОЕ) ===
-		CD3DX12_GPU_DESCRIPTOR_HANDLE brushTextureHandle = baseHandle;
-		brushTextureHandle.Offset(mBrushTextureSRVIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(3, brushTextureHandle);
-
-		// CBV b0 (корневой индекс 4) - cbPerObject
-		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
-		cmdList->SetGraphicsRootConstantBufferView(4, objCBAddress);
-
-		// CBV b1 (корневой индекс 5) - cbPass - устанавливается в Draw()
-		// CBV b2 (корневой индекс 6) - cbMaterial
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
-		cmdList->SetGraphicsRootConstantBufferView(6, matCBAddress);
-
-		// CBV b3 (корневой индекс 7) - cbTerrainTile
-		auto terrCB = mCurrFrameResource->TerrainCB->Resource();
-		cmdList->SetGraphicsRootConstantBufferView(7, terrCB->GetGPUVirtualAddress() + tile->tileIndex * terrCBByteSize);
-
-		// CBV b4 (корневой индекс 8) - cbBrush
-		auto brushCB = mCurrFrameResource->BrushCB->Resource();
-		cmdList->SetGraphicsRootConstantBufferView(8, brushCB->GetGPUVirtualAddress());
-
-		cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		mCaptureStatus = error;
+		return;
 	}
+
+	const CaptureAnalysis a = AnalyzeCapture(capture);
+	char text[256];
+	sprintf_s(text, "Saved %s: %u commands, %u binds (%u redundant), %u draws, %u barriers, %.1f KB constants",
+		path.c_str(), a.Totals.Commands, a.Totals.Binds(), a.Redundant.Binds(), a.Totals.Draws, a.Totals.Barriers, a.UploadBytes / 1024.0);
+	mCaptureStatus = text;
 }
-//TODO
-//frameIndex changing
-void TexColumnsApp::Draw(const GameTimer& gt)
+
+void TexColumnsApp::GatherRenderItems(const std::vector<RenderItem*>& ritems, std::vector<DrawItem>& draws)
 {
-	static int frameCount = 0;
-	frameCount++;
+	draws.clear();
+	for (auto ri : ritems)
+		draws.push_back(MakeDrawItem(ri));
+}
 
-	char debugMsg[256];
+void TexColumnsApp::GatherCustomMeshes(const std::vector<RenderItem*>& customMeshes, std::vector<DrawItem>& draws)
+{
+	std::fill(mLodDraws.begin(), mLodDraws.end(), 0);
+	std::fill(mLodTriangles.begin(), mLodTriangles.end(), 0);
 
-	try
+	draws.clear();
+	for (auto ri : customMeshes)
 	{
-		auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
-		HRESULT hr = cmdListAlloc->Reset();
-		if (FAILED(hr)) ThrowIfFailed(hr);
-
-		if (isFillModeSolid)
-			hr = mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get());
-		else
-			hr = mCommandList->Reset(cmdListAlloc.Get(), mPSOs["wireframe"].Get());
-		if (FAILED(hr)) ThrowIfFailed(hr);
-
-		mCommandList->RSSetViewports(1, &mScreenViewport);
-		mCommandList->RSSetScissorRects(1, &mScissorRect);
-
-		// ============ STEP 1: SCENE -> COLOR + VELOCITY ============
-		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-			mTAAColorBuffer->GetResource(),
-			D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_RENDER_TARGET));
-
-		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-			mTAVelocityBuffer->GetResource(),
-			D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_RENDER_TARGET));
-
-		CD3DX12_CPU_DESCRIPTOR_HANDLE colorRTV(
-			mRtvHeap->GetCPUDescriptorHandleForHeapStart(),
-			mTaaColorBufferRTVIndex, mRtvDescriptorSize);
-		CD3DX12_CPU_DESCRIPTOR_HANDLE velocityRTV(
-			mRtvHeap->GetCPUDescriptorHandleForHeapStart(),
-			mVelocityBufferRTVIndex, mRtvDescriptorSize);
-		CD3DX12_CPU_DESCRIPTOR_HANDLE dsv(DepthStencilView());
-
-		D3D12_CPU_DESCRIPTOR_HANDLE rtvs[2] = { colorRTV, velocityRTV };
-		mCommandList->OMSetRenderTargets(2, rtvs, false, &dsv);
-		mCommandList->ClearRenderTargetView(colorRTV, Colors::DarkBlue, 0, nullptr);
-		float clearVel[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-		mCommandList->ClearRenderTargetView(velocityRTV, clearVel, 0, nullptr);
-		mCommandList->ClearDepthStencilView(dsv,
-			D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-
-		ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-		mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-
-		// Opaque items
-		mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-		auto passCB = mCurrFrameResource->PassCB->Resource();
-		mCommandList->SetGraphicsRootConstantBufferView(4, passCB->GetGPUVirtualAddress());
-		DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
-
-		// Custom meshes (MeshStandard.hlsl writes real velocity)
-		mCommandList->SetGraphicsRootSignature(mStandMeshRootSignature.Get());
-		mCommandList->SetGraphicsRootConstantBufferView(3, passCB->GetGPUVirtualAddress());
-		if (isFillModeSolid)
-			mCommandList->SetPipelineState(mPSOs["standardMesh"].Get());
-		else
-			mCommandList->SetPipelineState(mPSOs["wireStandardMesh"].Get());
-		if (!mStandCustomMeshes.empty())
-			DrawCustomMeshes(mCommandList.Get(), mStandCustomMeshes);
-
-		// Terrain
-		mVisibleTiles.clear();
-		mVisibleTiles = mTerrain->GetVisibleTiles();
-		if (!mVisibleTiles.empty())
-		{
-			if (isFillModeSolid)
-				mCommandList->SetPipelineState(mPSOs["terrain"].Get());
-			else
-				mCommandList->SetPipelineState(mPSOs["wireTerrain"].Get());
-			mCommandList->SetGraphicsRootSignature(mTerrainRootSignature.Get());
-			mCommandList->SetGraphicsRootConstantBufferView(5, passCB->GetGPUVirtualAddress());
-			DrawTilesRenderItems(mCommandList.Get(), mVisibleTiles);
-		}
-
-		// ---- Frame 1 bootstrap: seed both history buffers with first frame ----
-		// After this block, Prev and Current are back in COMMON.
-		if (frameCount == 1)
-		{
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAAColorBuffer->GetResource(),
-				D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE));
-
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAAPrevTexture->GetResource(),
-				D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAACurrentTexture->GetResource(),
-				D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
-
-			mCommandList->CopyResource(mTAAPrevTexture->GetResource(), mTAAColorBuffer->GetResource());
-			mCommandList->CopyResource(mTAACurrentTexture->GetResource(), mTAAColorBuffer->GetResource());
-
-			// Return EVERYTHING to COMMON so the TAA pass below can start fresh
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAAPrevTexture->GetResource(),
-				D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON));
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAACurrentTexture->GetResource(),
-				D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON));
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAAColorBuffer->GetResource(),
-				D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
-		}
-
-		// ============ STEP 2: TAA RESOLVE PASS ============
-		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-			mTAAColorBuffer->GetResource(),
-			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
-
-		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-			mTAVelocityBuffer->GetResource(),
-			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
-
-		CD3DX12_RESOURCE_BARRIER backBufferBarrier = CD3DX12_RESOURCE_BARRIER::Transition(
-			CurrentBackBuffer(),
-			D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
-		mCommandList->ResourceBarrier(1, &backBufferBarrier);
-
-		mCommandList->SetPipelineState(mPSOs["TAA"].Get());
-		mCommandList->SetGraphicsRootSignature(mTAARootSignature.Get());
-
-		// Ping-pong. frameIndex has NOT been incremented yet.
-		// Both textures are guaranteed to be in COMMON here (seeded above on frame 1,
-		// returned to COMMON at end-of-frame on every subsequent frame).
-		UINT historySRVIndex;
-		UINT historyRTVIndex;
-
-		if (frameIndex % 2 == 0)
+		DrawItem item = MakeDrawItem(ri);
+		if (!ri->LodLevels.empty())
 		{
-			// Read Prev (SRV), write Current (RTV)
-			historySRVIndex = mPrevTextureSRVIndex;
-			historyRTVIndex = mCurrentTextureRTVIndex;
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAAPrevTexture->GetResource(),
-				D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAACurrentTexture->GetResource(),
-				D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_RENDER_TARGET));
+			const LodLevel& activeLod = ri->LodLevels[ri->CurrentLodIndex];
+			item.IndexCount = activeLod.IndexCount;
+			item.StartIndex = activeLod.StartIndexLocation;
+			item.BaseVertex = activeLod.BaseVertexLocation;
 		}
-		else
+		if ((size_t)ri->CurrentLodIndex < mLodDraws.size())
 		{
-			// Read Current (SRV), write Prev (RTV)
-			historySRVIndex = mCurrentTextureSRVIndex;
-			historyRTVIndex = mPrevTextureRTVIndex;
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAACurrentTexture->GetResource(),
-				D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAAPrevTexture->GetResource(),
-				D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_RENDER_TARGET));
+			mLodDraws[ri->CurrentLodIndex]++;
+			mLodTriangles[ri->CurrentLodIndex] += item.IndexCount / 3;
 		}
+		draws.push_back(item);
+	}
+}
 
-		// Bind TAA inputs
-		mCommandList->SetGraphicsRootDescriptorTable(0, CD3DX12_GPU_DESCRIPTOR_HANDLE(
-			mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
-			mTaaColorBufferSRVIndex, mCbvSrvDescriptorSize));
-		mCommandList->SetGraphicsRootDescriptorTable(1, CD3DX12_GPU_DESCRIPTOR_HANDLE(
-			mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
-			historySRVIndex, mCbvSrvDescriptorSize));
-		mCommandList->SetGraphicsRootDescriptorTable(2, CD3DX12_GPU_DESCRIPTOR_HANDLE(
-			mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
-			mVelocityBufferSRVIndex, mCbvSrvDescriptorSize));
-		mCommandList->SetGraphicsRootConstantBufferView(3,
-			mCurrFrameResource->TAACB->Resource()->GetGPUVirtualAddress());
-
-		// Bind RTVs: backbuffer (Target0) + history write (Target1)
-		rtvs[0] = CurrentBackBufferView();
-		rtvs[1] = CD3DX12_CPU_DESCRIPTOR_HANDLE(
-			mRtvHeap->GetCPUDescriptorHandleForHeapStart(),
-			historyRTVIndex, mRtvDescriptorSize);
-		mCommandList->OMSetRenderTargets(2, rtvs, false, nullptr);
-		mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::DarkGoldenrod, 0, nullptr);
-
-		// Fullscreen triangle - no vertex buffer, TAA VS uses SV_VertexID
-		mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		mCommandList->DrawInstanced(3, 1, 0, 0);
-
-		// ============ COMPUTE SHADER (brush painting) ============
-		if (mIsPainting)
-		{
-			mCommandList->SetPipelineState(mPSOs["brushCompute"].Get());
-			mCommandList->SetComputeRootSignature(mBrushComputeRootSignature.Get());
-
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mBrushTexture.Get(),
-				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-				D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
-
-			mCommandList->SetComputeRootConstantBufferView(0,
-				mCurrFrameResource->BrushCB->Resource()->GetGPUVirtualAddress());
+void TexColumnsApp::GatherTiles(const std::vector<Tile*>& tiles, std::vector<DrawItem>& draws)
+{
+	draws.clear();
+	for (auto tile : tiles)
+	{
+		DrawItem item = MakeDrawItem(mAllRitems[tile->renderItemIndex].get());
+		item.TileIndex = tile->tileIndex;
+		draws.push_back(item);
+	}
+}
+// Starts or stops the render thread as the UI asks, between frames
+void TexColumnsApp::UpdateRenderThread()
+{
+	if (mUseRenderThread == mRenderThread.IsRunning())
+		return;
+	if (mUseRenderThread)
+	{
+		mRenderThread.Start([this](const AppFramePacket& packet) { RenderFrame(packet); },
+			[]() { Profiler::Get().SetThreadName("Render"); });
+	}
+	else
+	{
+		mRenderThread.Drain();
+		mRenderThread.Stop();
+	}
+}
 
-			if (!mVisibleTiles.empty())
-			{
-				auto tile = mVisibleTiles[0];
-				UINT sz = d3dUtil::CalcConstantBufferByteSize(sizeof(TileConstants));
-				mCommandList->SetComputeRootConstantBufferView(1,
-					mCurrFrameResource->TerrainCB->Resource()->GetGPUVirtualAddress()
-					+ tile->tileIndex * sz);
-			}
-			mCommandList->SetComputeRootDescriptorTable(2, CD3DX12_GPU_DESCRIPTOR_HANDLE(
-				mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
-				TexOffsets["terrainDisp"], mCbvSrvDescriptorSize));
-			mCommandList->SetComputeRootDescriptorTable(3, CD3DX12_GPU_DESCRIPTOR_HANDLE(
-				mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
-				mBrushTextureUAVIndex, mCbvSrvDescriptorSize));
-
-			mCommandList->Dispatch(
-				(UINT)ceil(mBrushTextureWidth / 16.0f),
-				(UINT)ceil(mBrushTextureHeight / 16.0f), 1);
-
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mBrushTexture.Get(),
-				D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
-		}
+// The frame's UI as draw data the render side can use after the next
+// NewFrame. Texture uploads stay here, where ImGui changes its textures;
+// the copied commands name them by id only.
+void TexColumnsApp::CopyImGuiDrawData(AppFramePacket& packet)
+{
+	ImGui::Render();
+	ImDrawData* drawData = ImGui::GetDrawData();
+	if (drawData->Textures != nullptr)
+		for (ImTextureData* tex : *drawData->Textures)
+			if (tex->Status != ImTextureStatus_OK)
+				ImGui_ImplDX12_UpdateTexture(tex);
+
+	packet.ClearUi();
+	ImDrawData& ui = packet.Ui;
+	ui.Valid = drawData->Valid;
+	ui.TotalIdxCount = drawData->TotalIdxCount;
+	ui.TotalVtxCount = drawData->TotalVtxCount;
+	ui.DisplayPos = drawData->DisplayPos;
+	ui.DisplaySize = drawData->DisplaySize;
+	ui.FramebufferScale = drawData->FramebufferScale;
+	for (ImDrawList* list : drawData->CmdLists)
+	{
+		ImDrawList* copy = list->CloneOutput();
+		for (ImDrawCmd& cmd : copy->CmdBuffer)
+			cmd.TexRef = ImTextureRef(cmd.GetTexID());
+		ui.CmdLists.push_back(copy);
+	}
+	ui.CmdListsCount = ui.CmdLists.Size;
+}
 
-		// ============ IMGUI ============
-		ID3D12DescriptorHeap* imguiHeaps[] = { mImGuiSrvDescriptorHeap.Get() };
-		mCommandList->SetDescriptorHeaps(_countof(imguiHeaps), imguiHeaps);
-		ImGui::Render();
-		ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), mCommandList.Get());
-
-		// ============ END-OF-FRAME: return all TAA resources to COMMON ============
-		// Use the SAME frameIndex value as the ping-pong above (not yet incremented).
-		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-			mTAAColorBuffer->GetResource(),
-			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COMMON));
-		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-			mTAVelocityBuffer->GetResource(),
-			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COMMON));
-
-		if (frameIndex % 2 == 0)
-		{
-			// Prev was SRV, Current was RTV
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAAPrevTexture->GetResource(),
-				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COMMON));
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAACurrentTexture->GetResource(),
-				D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COMMON));
-		}
-		else
-		{
-			// Current was SRV, Prev was RTV
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAACurrentTexture->GetResource(),
-				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COMMON));
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-				mTAAPrevTexture->GetResource(),
-				D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COMMON));
-		}
+// Everything this frame records, gathered after Update; the packet is not
+// changed again until the render side is done with it
+void TexColumnsApp::BuildFramePacket(AppFramePacket& packet)
+{
+	PROFILE_SCOPE("BuildFramePacket");
+	packet.Frame = ++mSimulationFrame;
+	packet.FrameResource = (uint32_t)mCurrFrameResourceIndex;
+
+	mVisibleTiles = mTerrain->GetVisibleTiles();
+	mFrameBindings.FirstFrame = packet.Frame == 1;
+	UpdateFrameBindings();
+	packet.Bindings = mFrameBindings;
+	// The next frame's jitter and history parity
+	frameIndex = (frameIndex + 1) % 16;
+
+	GatherRenderItems(mOpaqueRitems, packet.Opaque);
+	GatherCustomMeshes(mVisibleCustomMeshes, packet.CustomMeshes);
+	GatherTiles(mVisibleTiles, packet.Tiles);
+	RemapResidentSrvs(packet);
+	packet.Residency = std::move(mResidencyCopies);
+	mResidencyCopies.clear();
+
+	packet.Painting = mIsPainting;
+	packet.Capture = mCaptureNextFrame;
+	mCaptureNextFrame = false;
+	CollectBrushRegion(packet);
+	CopyImGuiDrawData(packet);
+}
 
-		// Increment AFTER all barriers that branch on it
-		frameIndex = (frameIndex + 1) % 16;
+void TexColumnsApp::Draw(const GameTimer& gt)
+{
+	PROFILE_SCOPE("Draw");
+	AppFramePacket& packet = *mPacket;
+	BuildFramePacket(packet);
 
-		backBufferBarrier = CD3DX12_RESOURCE_BARRIER::Transition(
-			CurrentBackBuffer(),
-			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-		mCommandList->ResourceBarrier(1, &backBufferBarrier);
+	if (!mRenderThread.IsRunning())
+	{
+		RenderFrame(packet);
+	}
+	else if (!packet.Capture)
+	{
+		mRenderThread.Publish();
+	}
+	else
+	{
+		// The capture reads this frame's constants back and sets
+		// mCaptureStatus for the UI: recorded here, with the render thread
+		// idle. Not published, the slot is simply filled again next frame.
+		mRenderThread.Drain();
+		RenderFrame(packet);
+	}
+}
 
-		hr = mCommandList->Close();
-		if (FAILED(hr)) ThrowIfFailed(hr);
+// Records, submits and presents one packet: on the render thread when it
+// runs, otherwise in Draw
+void TexColumnsApp::RenderFrame(const AppFramePacket& packet)
+{
+	PROFILE_SCOPE("RenderFrame");
+	ProfileScope phase("Draw.Scene");
+	FrameResource* frame = mFrameResources[packet.FrameResource].get();
+
+	auto cmdListAlloc = frame->CmdListAlloc;
+	HRESULT hr = cmdListAlloc->Reset();
+	if (FAILED(hr)) ThrowIfFailed(hr);
+
+	// FrameRecorder::BeginScene sets the pipeline
+	hr = mCommandList->Reset(cmdListAlloc.Get(), nullptr);
+	if (FAILED(hr)) ThrowIfFailed(hr);
+
+	BindFrameResources(packet);
+	RecordResidencyCopies(packet);
+	FrameBindings b = packet.Bindings;
+	b.BackBufferRtv = mCurrBackBuffer;  // back buffers come first in the RTV heap
+	mRenderCommands.SetCommandList(mCommandList.Get());
+
+	if (packet.Capture)
+		BeginCapture(packet);
+	RenderCommandList& cmd = packet.Capture ? static_cast<RenderCommandList&>(mCapture) : mRenderCommands;
+
+	// ============ STEP 1: SCENE -> COLOR + VELOCITY ============
+	// On frame 1 this also seeds both history buffers with the frame
+	FrameRecorder::BeginScene(cmd, b);
+	FrameRecorder::RecordScene(cmd, b, packet.Opaque, packet.CustomMeshes, packet.Tiles);
+
+	// ============ STEP 2: TAA RESOLVE PASS ============
+	phase.Next("Draw.TAA");
+	FrameRecorder::RecordTaa(cmd, b);
+
+	// Restore regions touched by undo/redo before painting on top of them
+	phase.Next("Draw.Brush");
+	UploadBrushRegion(mCommandList.Get(), packet);
+
+	// ============ COMPUTE SHADER (brush painting) ============
+	if (packet.Painting)
+		FrameRecorder::RecordBrush(cmd, b, packet.Tiles);
+
+	// ============ IMGUI ============
+	phase.Next("Draw.ImGui");
+	ID3D12DescriptorHeap* imguiHeaps[] = { mImGuiSrvDescriptorHeap.Get() };
+	mCommandList->SetDescriptorHeaps(_countof(imguiHeaps), imguiHeaps);
+	// Only read, and with Textures null it leaves ImGui's textures alone
+	ImGui_ImplDX12_RenderDrawData(const_cast<ImDrawData*>(&packet.Ui), mCommandList.Get());
+
+	// ============ END-OF-FRAME: return all TAA resources to COMMON ============
+	phase.Next("Draw.Submit");
+	FrameRecorder::EndFrame(cmd, b);
+	if (packet.Capture)
+		EndCapture();
+
+	hr = mCommandList->Close();
+	if (FAILED(hr)) ThrowIfFailed(hr);
 
-		ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-		mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
 
-		hr = mSwapChain->Present(0, 0);
-		if (FAILED(hr)) ThrowIfFailed(hr);
+	phase.Next("Draw.Present");
+	hr = mSwapChain->Present(0, 0);
+	if (FAILED(hr)) ThrowIfFailed(hr);
 
-		mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
-		mCurrFrameResource->Fence = ++mCurrentFence;
-		hr = mCommandQueue->Signal(mFence.Get(), mCurrentFence);
-		if (FAILED(hr)) ThrowIfFailed(hr);
-	}
-	catch (...)
-	{
-		throw;
-	}
+	// Update reads the Fence value back frames later, after the render
+	// thread has taken a later packet: the handoff orders it after this write
+	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+	frame->Fence = ++mCurrentFence;
+	hr = mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+	if (FAILED(hr)) ThrowIfFailed(hr);
 }
 
 //void TexColumnsApp::Draw(const GameTimer& gt)
@@ -3735,28 +4904,6 @@ void TexColumnsApp::Draw(const GameTimer& gt)
 	cmdList->ResourceBarrier(1, &historyBarrier);
 }*/
 
-//void TexColumnsApp::UpdateVisibleItems() {
-//	mVisibleRitems.clear();
-//
-//	BoundingFrustum camFrustum = mCamera.GetFrustum();
-//
-//	//for (auto& ri : mAllRitems) {
-//	//	const LodLevel& activeLod = ri->LodLevels[ri->CurrentLodIndex];
-//	//	// Трансформируем BoundingBox в мировое пространство
-//	//	BoundingBox transformedBox;
-//	//	activeLod.Bounds.Transform(transformedBox, XMLoadFloat4x4(&ri->World));
-//
-//	//	if (camFrustum.Contains(transformedBox) != DISJOINT) {
-//	//		mVisibleRitems.push_back(ri.get());
-//	//	}
-//	//}
-//
-//	CollectVisibleRenderItems(mOctreeRoot.get(), camFrustum, mVisibleRitems);
-//
-//
-//	std::cout << "objects visible: " << mVisibleRitems.size() << "\n";
-//}
-
 //void TexColumnsApp::UpdateLODs(RenderItem* ri)
 //{
 //	BoundingBox worldSpaceObjectBounds;
@@ -3789,35 +4936,6 @@ void TexColumnsApp::Draw(const GameTimer& gt)
 //	ri->NumFramesDirty = gNumFrameResources;
 //}
 
-void TexColumnsApp::GenerateTransformedHaltonSequence(float viewSizeX, float viewSizeY, XMFLOAT2* outJitters)
-{
-	const XMFLOAT2 HaltonPoints[16] =
-	{
-		XMFLOAT2(0.500000f, 0.333333f),
-		XMFLOAT2(0.250000f, 0.666667f),
-		XMFLOAT2(0.750000f, 0.111111f),
-		XMFLOAT2(0.125000f, 0.444444f),
-		XMFLOAT2(0.625000f, 0.777778f),
-		XMFLOAT2(0.375000f, 0.222222f),
-		XMFLOAT2(0.875000f, 0.555556f),
-		XMFLOAT2(0.062500f, 0.888889f),
-		XMFLOAT2(0.562500f, 0.037037f),
-		XMFLOAT2(0.312500f, 0.370370f),
-		XMFLOAT2(0.812500f, 0.703704f),
-		XMFLOAT2(0.187500f, 0.148148f),
-		XMFLOAT2(0.687500f, 0.481481f),
-		XMFLOAT2(0.437500f, 0.814815f),
-		XMFLOAT2(0.937500f, 0.259259f),
-		XMFLOAT2(0.031250f, 0.592593f)
-	};
-
-	for (int i = 0; i < 16; ++i)
-	{
-		outJitters[i].x = ((HaltonPoints[i].x - 0.5f) / viewSizeX) * 2.0f;
-		outJitters[i].y = ((HaltonPoints[i].y - 0.5f) / viewSizeY) * 2.0f;
-	}
-}
-
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> TexColumnsApp::GetStaticSamplers()
 {
 	// Applications usually only need a handful of samplers.  So just define them all up front
@@ -0,0 +1,214 @@
+#include "TextureResidency.h"
+
+#include <algorithm>
+#include <cmath>
+
+int TextureResidency::AddTexture(const ResidencyTextureDesc& desc, uint32_t residentMip)
+{
+	Entry e;
+	e.Desc = desc;
+	if (e.Desc.MipBytes.empty())
+		e.Desc.MipBytes.push_back(0);
+
+	const uint32_t mipCount = (uint32_t)e.Desc.MipBytes.size();
+	e.Desc.CoarsestMip = std::min(e.Desc.CoarsestMip, mipCount - 1);
+
+	e.BytesFromMip.assign(mipCount + 1, 0);
+	for (int i = (int)mipCount - 1; i >= 0; --i)
+		e.BytesFromMip[i] = e.BytesFromMip[i + 1] + e.Desc.MipBytes[i];
+
+	e.Resident = std::min(residentMip, e.Desc.CoarsestMip);
+	e.Target = e.Resident;
+	e.Requested = e.Desc.CoarsestMip;
+	e.Wanted = e.Desc.CoarsestMip;
+
+	mTextures.push_back(std::move(e));
+	return (int)mTextures.size() - 1;
+}
+
+void TextureResidency::BeginFrame()
+{
+	++mFrame;
+	for (auto& e : mTextures)
+	{
+		e.Requested = e.Desc.CoarsestMip;
+		e.RequestedPriority = 0.0f;
+		e.RequestedThisFrame = false;
+	}
+}
+
+uint32_t TextureResidency::MipForScreenSize(uint32_t textureSize, float screenPixels) const
+{
+	if (screenPixels <= 0.0f || textureSize == 0)
+		return UINT32_MAX;
+
+	// One texel per pixel: every halving of the on-screen size drops a mip.
+	const float lod = std::log2((float)textureSize / screenPixels) + mMipBias;
+	if (lod <= 0.0f)
+		return 0;
+	return (uint32_t)std::min(lod, 31.0f);
+}
+
+void TextureResidency::RequestScreenSize(int texture, float screenPixels)
+{
+	const auto& desc = mTextures[texture].Desc;
+	RequestMip(texture, MipForScreenSize(std::max(desc.Width, desc.Height), screenPixels), screenPixels);
+}
+
+void TextureResidency::RequestMip(int texture, uint32_t mip, float priority)
+{
+	Entry& e = mTextures[texture];
+	e.Requested = std::min(e.Requested, std::min(mip, e.Desc.CoarsestMip));
+	e.RequestedPriority = std::max(e.RequestedPriority, priority);
+	e.RequestedThisFrame = true;
+}
+
+void TextureResidency::SetResidentMip(int texture, uint32_t mip)
+{
+	Entry& e = mTextures[texture];
+	e.Resident = std::min(mip, e.Desc.CoarsestMip);
+	e.Target = e.Resident;
+}
+
+bool TextureResidency::Free(uint64_t& total, uint64_t needed, float belowPriority, int except, bool allOrNothing)
+{
+	// mOrder is sorted by descending priority, so walk it backwards.
+	if (allOrNothing)
+	{
+		uint64_t available = 0;
+		for (auto it = mOrder.rbegin(); it != mOrder.rend() && available < needed; ++it)
+		{
+			const Entry& e = mTextures[*it];
+			if (*it == except || e.Priority >= belowPriority)
+				continue;
+			available += BytesFrom(e, e.Target) - BytesFrom(e, e.Desc.CoarsestMip);
+		}
+		if (available < needed)
+			return false;
+	}
+
+	uint64_t freed = 0;
+	for (auto it = mOrder.rbegin(); it != mOrder.rend() && freed < needed; ++it)
+	{
+		Entry& e = mTextures[*it];
+		if (*it == except || e.Priority >= belowPriority)
+			continue;
+
+		// One mip at a time, so a texture only loses what is needed.
+		while (e.Target < e.Desc.CoarsestMip && freed < needed)
+		{
+			const uint64_t step = BytesFrom(e, e.Target) - BytesFrom(e, e.Target + 1);
+			++e.Target;
+			freed += step;
+			total -= step;
+		}
+	}
+	return freed >= needed;
+}
+
+const std::vector<ResidencyChange>& TextureResidency::Update()
+{
+	mChanges.clear();
+	mStats = ResidencyStats();
+
+	uint64_t total = 0;
+	for (auto& e : mTextures)
+	{
+		// Finer requests apply at once; coarser ones only once every finer
+		// request of the last mEvictDelay frames has expired, so a mip needed
+		// a frame ago is not dropped just because an older one expired.
+		if (e.RequestedThisFrame)
+		{
+			while (!e.Held.empty() && e.Held.back().Mip >= e.Requested)
+				e.Held.pop_back();
+			e.Held.push_back({ mFrame, e.Requested });
+			e.Priority = e.RequestedPriority;
+		}
+		size_t expired = 0;
+		while (expired < e.Held.size() && mFrame - e.Held[expired].Frame > mEvictDelay)
+			++expired;
+		e.Held.erase(e.Held.begin(), e.Held.begin() + expired);
+
+		if (e.Held.empty())
+		{
+			e.Wanted = e.Desc.CoarsestMip;
+			e.Priority = 0.0f;
+		}
+		else
+		{
+			e.Wanted = e.Held.front().Mip;
+		}
+
+		// Surplus mips go first, they cost nothing to drop.
+		e.Target = std::max(e.Resident, e.Wanted);
+		total += BytesFrom(e, e.Target);
+		mStats.WantedBytes += BytesFrom(e, e.Wanted);
+	}
+
+	mOrder.resize(mTextures.size());
+	for (int i = 0; i < (int)mOrder.size(); ++i)
+		mOrder[i] = i;
+	std::stable_sort(mOrder.begin(), mOrder.end(), [this](int a, int b)
+	{
+		return mTextures[a].Priority > mTextures[b].Priority;
+	});
+
+	// A lowered budget: give up detail from the least important textures.
+	if (total > mBudget)
+		Free(total, total - mBudget, INFINITY, -1, false);
+
+	// Stream in by priority. Lower-priority textures give up mips when needed.
+	uint64_t streamed = 0;
+	bool capped = false;
+	for (size_t o = 0; o < mOrder.size() && !capped; ++o)
+	{
+		const int i = mOrder[o];
+		Entry& e = mTextures[i];
+		while (e.Target > e.Wanted)
+		{
+			const uint64_t step = BytesFrom(e, e.Target - 1) - BytesFrom(e, e.Target);
+			if (mMaxStreamInBytes && streamed > 0 && streamed + step > mMaxStreamInBytes)
+			{
+				capped = true;
+				break;
+			}
+			if (total + step > mBudget && !Free(total, total + step - mBudget, e.Priority, i, true))
+				break;
+
+			--e.Target;
+			total += step;
+			streamed += step;
+		}
+	}
+
+	for (int i = 0; i < (int)mTextures.size(); ++i)
+	{
+		Entry& e = mTextures[i];
+		if (e.Target != e.Resident)
+		{
+			ResidencyChange c;
+			c.Texture = i;
+			c.OldMip = e.Resident;
+			c.NewMip = e.Target;
+			mChanges.push_back(c);
+
+			if (e.Target < e.Resident)
+			{
+				mStats.StreamedInBytes += BytesFrom(e, e.Target) - BytesFrom(e, e.Resident);
+				++mStats.StreamIns;
+			}
+			else
+			{
+				mStats.EvictedBytes += BytesFrom(e, e.Resident) - BytesFrom(e, e.Target);
+				++mStats.Evictions;
+			}
+			e.Resident = e.Target;
+		}
+
+		mStats.ResidentBytes += BytesFrom(e, e.Resident);
+		if (e.Resident > e.Wanted)
+			++mStats.StarvedTextures;
+	}
+
+	return mChanges;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Decides which mips of each texture should be resident under a memory budget.
+// Knows nothing about D3D: the renderer reports how large each texture is on
+// screen, calls Update and applies the returned changes (e.g. by recreating
+// the resource without its finest mips). Given the same inputs it always makes
+// the same decisions.
+
+struct ResidencyTextureDesc
+{
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	std::vector<uint64_t> MipBytes; // bytes of each mip, finest first (all array slices)
+	uint32_t CoarsestMip = 0;       // coarsest mip allowed as the most detailed one
+};
+
+// "Most detailed resident mip" of a texture goes from OldMip to NewMip.
+// NewMip < OldMip streams finer mips in, NewMip > OldMip evicts them.
+struct ResidencyChange
+{
+	int Texture = -1;
+	uint32_t OldMip = 0;
+	uint32_t NewMip = 0;
+};
+
+struct ResidencyStats
+{
+	uint64_t ResidentBytes = 0;
+	uint64_t WantedBytes = 0;      // what full residency of the wanted mips would cost
+	uint64_t StreamedInBytes = 0;  // last Update
+	uint64_t EvictedBytes = 0;     // last Update
+	int StreamIns = 0;
+	int Evictions = 0;
+	int StarvedTextures = 0;       // resident mip coarser than wanted after Update
+};
+
+class TextureResidency
+{
+public:
+	int AddTexture(const ResidencyTextureDesc& desc, uint32_t residentMip = 0);
+	int GetTextureCount() const { return (int)mTextures.size(); }
+
+	void SetBudget(uint64_t bytes) { mBudget = bytes; }
+	uint64_t GetBudget() const { return mBudget; }
+	// Caps how much is streamed in per Update, so one call never stalls for long.
+	// At least one change is always allowed. 0 = unlimited.
+	void SetMaxStreamInBytes(uint64_t bytes) { mMaxStreamInBytes = bytes; }
+	// A mip stays wanted for this many frames after it was last needed.
+	void SetEvictDelay(uint32_t frames) { mEvictDelay = frames; }
+	// Positive values prefer coarser mips.
+	void SetMipBias(float bias) { mMipBias = bias; }
+
+	void BeginFrame();
+	// screenPixels: on-screen size of the texture's full UV range along its
+	// longest side. Called once per user; the largest request wins.
+	void RequestScreenSize(int texture, float screenPixels);
+	// Explicit mip request; priority orders textures competing for the budget.
+	void RequestMip(int texture, uint32_t mip, float priority);
+
+	// Returns the changes to apply this frame; the manager assumes they succeed.
+	const std::vector<ResidencyChange>& Update();
+	// For when a change could not be applied.
+	void SetResidentMip(int texture, uint32_t mip);
+
+	const ResidencyTextureDesc& GetDesc(int texture) const { return mTextures[texture].Desc; }
+	uint32_t GetResidentMip(int texture) const { return mTextures[texture].Resident; }
+	uint32_t GetWantedMip(int texture) const { return mTextures[texture].Wanted; }
+	float GetPriority(int texture) const { return mTextures[texture].Priority; }
+	uint64_t GetResidentBytes(int texture) const { return BytesFrom(mTextures[texture], mTextures[texture].Resident); }
+	const ResidencyStats& GetStats() const { return mStats; }
+
+	uint32_t MipForScreenSize(uint32_t textureSize, float screenPixels) const;
+
+private:
+	struct HeldRequest
+	{
+		uint64_t Frame;
+		uint32_t Mip;
+	};
+
+	struct Entry
+	{
+		ResidencyTextureDesc Desc;
+		std::vector<uint64_t> BytesFromMip; // bytes resident when mip i is the finest one
+		uint32_t Resident = 0;
+		uint32_t Target = 0;
+
+		// Per-frame request
+		uint32_t Requested = 0;
+		float RequestedPriority = 0.0f;
+		bool RequestedThisFrame = false;
+
+		// Requests of the last mEvictDelay frames that are finer than every
+		// later one, oldest (and finest) first; the first is the wanted mip
+		std::vector<HeldRequest> Held;
+		uint32_t Wanted = 0;
+		float Priority = 0.0f;
+	};
+
+	static uint64_t BytesFrom(const Entry& e, uint32_t mip) { return e.BytesFromMip[mip]; }
+	bool Free(uint64_t& total, uint64_t needed, float belowPriority, int except, bool allOrNothing);
+
+private:
+	std::vector<Entry> mTextures;
+	std::vector<int> mOrder;
+	std::vector<ResidencyChange> mChanges;
+	ResidencyStats mStats;
+
+	uint64_t mFrame = 0;
+	uint64_t mBudget = 256ull * 1024 * 1024;
+	uint64_t mMaxStreamInBytes = 0;
+	uint32_t mEvictDelay = 60;
+	float mMipBias = 0.0f;
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// JSON helpers shared by the headless tools, so their reports read the same.
+
+inline double Percentile(std::vector<double> values, double p)
+{
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	const double rank = p * (values.size() - 1);
+	const size_t lo = (size_t)rank;
+	const size_t hi = (std::min)(lo + 1, values.size() - 1);
+	return values[lo] + (values[hi] - values[lo]) * (rank - lo);
+}
+
+// "name": { "mean", "min", "p50", "p95", "p99", "max" } of one field over
+// all samples, as a member of an object indented by six spaces
+template <typename Sample, typename Field>
+void WriteSummary(std::ostream& out, const char* name, const std::vector<Sample>& samples, Field field, bool last = false)
+{
+	std::vector<double> values;
+	values.reserve(samples.size());
+	double sum = 0.0;
+	for (const auto& s : samples)
+	{
+		values.push_back((double)field(s));
+		sum += values.back();
+	}
+	const double mean = values.empty() ? 0.0 : sum / values.size();
+	const double lo = values.empty() ? 0.0 : *std::min_element(values.begin(), values.end());
+	const double hi = values.empty() ? 0.0 : *std::max_element(values.begin(), values.end());
+	out << "      \"" << name << "\": { \"mean\": " << mean << ", \"min\": " << lo
+		<< ", \"p50\": " << Percentile(values, 0.50) << ", \"p95\": " << Percentile(values, 0.95)
+		<< ", \"p99\": " << Percentile(values, 0.99) << ", \"max\": " << hi << " }" << (last ? "\n" : ",\n");
+}
+
+inline std::string JsonString(const std::string& text)
+{
+	std::string result = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			result += '\\';
+		result += (unsigned char)c < 0x20 ? ' ' : c;
+	}
+	return result + "\"";
+}
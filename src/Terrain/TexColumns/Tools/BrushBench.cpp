@@ -0,0 +1,429 @@
+//***************************************************************************************
+// BrushBench.cpp
+//
+// Checks the brush undo journal (BrushUndo over a PaintLayer) and times what
+// a stroke costs: the dabs, committing it and undoing or redoing it.
+//
+// The stress part paints random strokes on the app's canvas and mixes in
+// undo, redo, empty strokes, strokes off the canvas, transparent strokes and
+// budget changes. The canvas after every step is hashed; an undo or redo must
+// bring back exactly the canvas recorded for the state it returns to, the
+// rect it reports must cover every texel that changed, a new stroke must drop
+// the redo branch, a stroke that changes no texel must leave the history and
+// the journal memory alone, and the journal must stay within its budget
+// whenever more than one step is left. Any violation is a failure and the
+// exit code is 3.
+//
+// The bench part paints --strokes strokes of --dabs dabs at a few brush
+// sizes (the app's 30/40 units on a 1024-unit map among them) and reports
+// per-dab cost, stroke commit (EndStroke) and undo/redo latency, and the
+// journal memory per stroke.
+//
+// Needs no GPU or window. Windows: BrushBench.vcxproj. Elsewhere:
+//   g++ -std=c++17 -O2 -pthread -I.. -I../../../Common BrushBench.cpp
+//       -L<dir> -lTerrainCore -o BrushBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: BrushBench [options]
+//   --size <texels>     canvas width and height (1024, mBrushTextureWidth)
+//   --strokes <n>       bench: strokes per brush size (200)
+//   --dabs <n>          bench: dabs per stroke (60)
+//   --ops <n>           stress: operations per round (400)
+//   --rounds <n>        stress rounds (4); 0 skips the stress part
+//   --no-bench          stress only
+//   --label <text>      stored in the output, e.g. the commit
+//   --out <file.json>   (stdout)
+//***************************************************************************************
+
+#include "PaintLayer.h"
+#include "BrushUndo.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const float MapSize = 1024.0f;         // the brush radii are in world units on this map
+
+	struct BenchConfig
+	{
+		int Size = 1024;
+		int Strokes = 200;
+		int Dabs = 60;
+		int Ops = 400;
+		int Rounds = 4;
+		bool Bench = true;
+		std::string Label;
+		std::string Out;
+	};
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void ReadCanvas(const PaintLayer& layer, std::vector<uint32_t>& texels)
+	{
+		texels.resize((size_t)layer.GetWidth() * layer.GetHeight());
+		PaintRect all;
+		all.X1 = layer.GetWidth();
+		all.Y1 = layer.GetHeight();
+		layer.ReadRect(all, texels.data(), (size_t)layer.GetWidth() * 4);
+	}
+
+	uint64_t Hash(const std::vector<uint32_t>& texels)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (uint32_t texel : texels)
+			hash = (hash ^ texel) * 1099511628211ull;
+		return hash;
+	}
+
+	// A stroke as the mouse makes one: dabs a quarter radius apart along a
+	// wobbly line
+	void PaintStroke(BrushUndo& undo, PaintLayer& layer, std::mt19937& rng, int dabs, float radius, float falloff,
+		std::vector<double>* dabMs = nullptr)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		BrushStamp stamp;
+		stamp.U = unit(rng);
+		stamp.V = unit(rng);
+		stamp.RadiusUV = radius / MapSize;
+		stamp.FalloffUV = falloff / MapSize;
+		for (float& c : stamp.Color)
+			c = unit(rng);
+		float angle = unit(rng) * 6.2831853f;
+		const float step = (std::max)(stamp.RadiusUV * 0.25f, 1.0f / layer.GetWidth());
+
+		undo.BeginStroke(layer);
+		for (int d = 0; d < dabs; ++d)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			undo.Paint(layer, stamp);
+			if (dabMs)
+				dabMs->push_back(MsSince(start));
+			angle += (unit(rng) - 0.5f) * 0.6f;
+			stamp.U += std::cos(angle) * step;
+			stamp.V += std::sin(angle) * step;
+			// Bounce off the edges so long strokes stay on the canvas
+			if (stamp.U < 0.0f || stamp.U > 1.0f)
+			{
+				stamp.U = (std::min)((std::max)(stamp.U, 0.0f), 1.0f);
+				angle = 3.1415927f - angle;
+			}
+			if (stamp.V < 0.0f || stamp.V > 1.0f)
+			{
+				stamp.V = (std::min)((std::max)(stamp.V, 0.0f), 1.0f);
+				angle = -angle;
+			}
+		}
+	}
+
+	// Texels that differ between two canvases must lie inside rect
+	bool Covers(const PaintRect& rect, const std::vector<uint32_t>& a, const std::vector<uint32_t>& b, int width)
+	{
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (a[i] == b[i])
+				continue;
+			const int x = (int)(i % width), y = (int)(i / width);
+			if (x < rect.X0 || x >= rect.X1 || y < rect.Y0 || y >= rect.Y1)
+				return false;
+		}
+		return true;
+	}
+
+	//
+	// Stress
+	//
+
+	void StressRound(const BenchConfig& config, uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		PaintLayer layer(config.Size, config.Size);
+		BrushUndo undo(16u << 20);
+
+		// Hashes of the states the journal can move between; position is the
+		// current one
+		std::vector<uint64_t> states;
+		std::vector<uint32_t> before, after;
+		ReadCanvas(layer, before);
+		states.push_back(Hash(before));
+		size_t position = 0;
+
+		for (int op = 0; op < config.Ops; ++op)
+		{
+			const uint32_t r = rng() % 100;
+			const std::string where = "op " + std::to_string(op) + " of round " + std::to_string(seed);
+			PaintRect restored;
+			if (r < 45)
+			{
+				const size_t redo = undo.GetRedoCount();
+				PaintStroke(undo, layer, rng, 1 + (int)(rng() % 40), 5.0f + (float)(rng() % 60), 10.0f + (float)(rng() % 60));
+				const bool changed = undo.EndStroke(layer);
+				ReadCanvas(layer, after);
+				const uint64_t hash = Hash(after);
+				if (changed)
+				{
+					states.resize(++position);
+					states.push_back(hash);
+					Check(undo.GetRedoCount() == 0, "redo branch", where + ": redo left after a new stroke");
+				}
+				else
+				{
+					Check(hash == states[position], "stroke", where + ": canvas changed by a stroke that reported none");
+					Check(undo.GetRedoCount() == redo, "stroke", where + ": redo dropped by a stroke that changed nothing");
+				}
+			}
+			else if (r < 70)
+			{
+				ReadCanvas(layer, before);
+				const bool had = undo.GetUndoCount() > 0;
+				Check(undo.Undo(layer, restored) == had, "undo", where + ": result does not match the undo count");
+				if (!had)
+					continue;
+				--position;
+				ReadCanvas(layer, after);
+				Check(Hash(after) == states[position], "undo", where + ": canvas differs from the state before the stroke");
+				Check(Covers(restored, before, after, config.Size), "undo", where + ": changed texels outside the reported rect");
+			}
+			else if (r < 90)
+			{
+				ReadCanvas(layer, before);
+				const bool had = undo.GetRedoCount() > 0;
+				Check(undo.Redo(layer, restored) == had, "redo", where + ": result does not match the redo count");
+				if (!had)
+					continue;
+				++position;
+				ReadCanvas(layer, after);
+				Check(Hash(after) == states[position], "redo", where + ": canvas differs from the state after the stroke");
+				Check(Covers(restored, before, after, config.Size), "redo", where + ": changed texels outside the reported rect");
+			}
+			else if (r < 94)
+			{
+				// Nothing painted, painted only off the canvas, or painted
+				// with a transparent colour, which blends every texel it
+				// covers back to itself
+				const size_t count = undo.GetUndoCount(), redo = undo.GetRedoCount(), memory = undo.GetMemoryUsage();
+				undo.BeginStroke(layer);
+				if (r != 90)
+				{
+					BrushStamp stamp;
+					stamp.U = -2.0f;
+					stamp.V = 3.0f;
+					stamp.RadiusUV = 0.05f;
+					stamp.FalloffUV = 0.06f;
+					if (r != 91)
+					{
+						std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+						stamp.U = unit(rng);
+						stamp.V = unit(rng);
+						stamp.Color[3] = 0.0f;
+					}
+					for (int d = 0; d < 8; ++d, stamp.U += 0.02f)
+						undo.Paint(layer, stamp);
+				}
+				Check(!undo.EndStroke(layer), "empty stroke", where + ": recorded a step");
+				Check(undo.GetUndoCount() == count && undo.GetRedoCount() == redo, "empty stroke", where + ": history changed");
+				Check(undo.GetMemoryUsage() == memory, "empty stroke", where + ": journal memory changed");
+				ReadCanvas(layer, after);
+				Check(Hash(after) == states[position], "empty stroke", where + ": canvas changed");
+			}
+			else
+			{
+				undo.SetMemoryBudget(rng() % 3 ? (size_t)(rng() % (4u << 20)) : (16u << 20));
+			}
+
+			Check(undo.GetUndoCount() <= position, "history", where + ": more undo steps than states behind");
+			Check(undo.GetMemoryUsage() <= undo.GetMemoryBudget() || undo.GetUndoCount() + undo.GetRedoCount() <= 1, "budget",
+				where + ": " + std::to_string(undo.GetMemoryUsage()) + " bytes over a budget of " + std::to_string(undo.GetMemoryBudget()));
+		}
+
+		// Back to the oldest state kept, then forwards again
+		while (undo.GetUndoCount() > 0)
+		{
+			PaintRect restored;
+			undo.Undo(layer, restored);
+			--position;
+		}
+		ReadCanvas(layer, after);
+		Check(Hash(after) == states[position], "unwind", "round " + std::to_string(seed) + ": oldest kept state differs");
+		undo.Clear();
+		Check(undo.GetMemoryUsage() == 0, "clear", std::to_string(undo.GetMemoryUsage()) + " bytes left after Clear");
+	}
+
+	void RunStress(const BenchConfig& config)
+	{
+		for (int round = 0; round < config.Rounds; ++round)
+			StressRound(config, 1000u + (uint32_t)round);
+		fprintf(stderr, "stress: %d rounds of %d operations, %d failures\n", config.Rounds, config.Ops, gFailures);
+	}
+
+	//
+	// Bench
+	//
+
+	struct Brush
+	{
+		const char* Name;
+		float Radius;                      // world units, as the UI sets them
+		float Falloff;
+	};
+
+	struct Sample
+	{
+		Brush Size;
+		std::vector<double> DabMs;
+		std::vector<double> CommitMs;
+		std::vector<double> UndoMs;
+		std::vector<double> RedoMs;
+		std::vector<double> StepBytes;
+	};
+
+	Sample Measure(const BenchConfig& config, const Brush& brush)
+	{
+		Sample sample;
+		sample.Size = brush;
+		PaintLayer layer(config.Size, config.Size);
+		BrushUndo undo(1024u << 20);
+		std::mt19937 rng(7);
+		for (int s = 0; s < config.Strokes; ++s)
+		{
+			const size_t memory = undo.GetMemoryUsage();
+			PaintStroke(undo, layer, rng, config.Dabs, brush.Radius, brush.Falloff, &sample.DabMs);
+			auto start = std::chrono::steady_clock::now();
+			undo.EndStroke(layer);
+			sample.CommitMs.push_back(MsSince(start));
+			sample.StepBytes.push_back((double)(undo.GetMemoryUsage() - memory));
+
+			PaintRect restored;
+			start = std::chrono::steady_clock::now();
+			undo.Undo(layer, restored);
+			sample.UndoMs.push_back(MsSince(start));
+			start = std::chrono::steady_clock::now();
+			undo.Redo(layer, restored);
+			sample.RedoMs.push_back(MsSince(start));
+		}
+		return sample;
+	}
+
+	void WriteLatency(std::ostream& out, const char* name, const std::vector<double>& ms, bool last = false)
+	{
+		out << "      \"" << name << "\": { \"p50\": " << Percentile(ms, 0.50) << ", \"p95\": " << Percentile(ms, 0.95)
+			<< ", \"p99\": " << Percentile(ms, 0.99) << ", \"max\": " << Percentile(ms, 1.0) << " }" << (last ? "\n" : ",\n");
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<Sample>& samples)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"BrushBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"size\": " << config.Size << ", \"strokes\": " << config.Strokes << ", \"dabs\": " << config.Dabs
+			<< ", \"stress_rounds\": " << config.Rounds << ", \"stress_ops\": " << config.Ops
+			<< ", \"stress_failures\": " << gFailures << " },\n";
+		out << "  \"brushes\": [\n";
+		for (size_t s = 0; s < samples.size(); ++s)
+		{
+			const Sample& sample = samples[s];
+			out << "    {\n";
+			out << "      \"brush\": " << JsonString(sample.Size.Name) << ", \"radius\": " << sample.Size.Radius
+				<< ", \"falloff\": " << sample.Size.Falloff << ",\n";
+			WriteLatency(out, "dab_ms", sample.DabMs);
+			WriteLatency(out, "commit_ms", sample.CommitMs);
+			WriteLatency(out, "undo_ms", sample.UndoMs);
+			WriteLatency(out, "redo_ms", sample.RedoMs);
+			out << "      \"step_kb\": " << Percentile(sample.StepBytes, 0.50) / 1024.0 << "\n";
+			out << "    }" << (s + 1 < samples.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--size" && hasValue) config.Size = (std::max)(atoi(argv[++i]), 64);
+			else if (arg == "--strokes" && hasValue) config.Strokes = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--dabs" && hasValue) config.Dabs = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--ops" && hasValue) config.Ops = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--rounds" && hasValue) config.Rounds = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--no-bench") config.Bench = false;
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	if (config.Rounds > 0)
+		RunStress(config);
+
+	std::vector<Sample> samples;
+	if (config.Bench)
+	{
+		const Brush brushes[] = { { "small", 10.0f, 14.0f }, { "app", 30.0f, 40.0f }, { "large", 120.0f, 160.0f } };
+		for (const Brush& brush : brushes)
+		{
+			samples.push_back(Measure(config, brush));
+			const Sample& s = samples.back();
+			fprintf(stderr, "%-6s dab p50 %7.4f ms, commit p50 %7.3f ms p95 %7.3f, undo p50 %7.3f ms p95 %7.3f, redo p50 %7.3f ms, %7.1f KB/stroke\n",
+				brush.Name, Percentile(s.DabMs, 0.5), Percentile(s.CommitMs, 0.5), Percentile(s.CommitMs, 0.95),
+				Percentile(s.UndoMs, 0.5), Percentile(s.UndoMs, 0.95), Percentile(s.RedoMs, 0.5), Percentile(s.StepBytes, 0.5) / 1024.0);
+		}
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, samples);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
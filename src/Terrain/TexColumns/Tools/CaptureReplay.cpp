@@ -0,0 +1,310 @@
+//***************************************************************************************
+// CaptureReplay.cpp
+//
+// Offline analysis of command captures (FrameCapture.h), saved by the app's
+// "Capture frame" button or by NullDraw --capture. Loads a capture, replays
+// it on a NullCommandList - checking the replay records the same stream -
+// and reports as JSON where the frame goes: commands by op, binds and how
+// many of them rebind what is already bound, draws by size, barriers, and
+// the constant bytes the frame reads from upload heaps. Given two captures,
+// also reports what changed between them: counts, the first command that
+// differs and the constant blocks whose contents changed.
+//
+// Replay failures (a stream that does not survive the round trip) exit
+// with code 3.
+//
+// Needs no GPU or window. Windows: CaptureReplay.vcxproj. Elsewhere:
+//   g++ -std=c++17 -O2 -I.. CaptureReplay.cpp -L<dir> -lTerrainCore -o CaptureReplay
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: CaptureReplay <a.capture> [<b.capture>] [options]
+//   --repeat <n>             timed replays of each capture (100)
+//   --label <text>           stored in the output, e.g. the commit
+//   --out <file.json>        (stdout)
+//***************************************************************************************
+
+#include "FrameCapture.h"
+#include "BenchReport.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct ReplayConfig
+	{
+		std::vector<std::string> Captures;
+		int Repeat = 100;
+		std::string Label;
+		std::string Out;
+	};
+
+	struct ReplaySample
+	{
+		double ReplayUs;
+	};
+
+	struct LoadedCapture
+	{
+		std::string File;
+		FrameCapture Capture;
+		CaptureAnalysis Analysis;
+		bool ReplayOk = false;
+		std::vector<ReplaySample> Samples;
+	};
+
+	bool ParseArgs(int argc, char** argv, ReplayConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--repeat" && hasValue) config.Repeat = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else if (arg.compare(0, 2, "--") != 0 && config.Captures.size() < 2) config.Captures.push_back(arg);
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		if (config.Captures.empty())
+		{
+			std::cerr << "Usage: CaptureReplay <a.capture> [<b.capture>] [options]\n";
+			return false;
+		}
+		return true;
+	}
+
+	// Payload arguments are compared by value, their offsets may differ
+	bool SameCommand(const FrameCapture& a, size_t i, const FrameCapture& b, size_t j)
+	{
+		const RenderCommand& x = a.Commands[i];
+		const RenderCommand& y = b.Commands[j];
+		if (x.Op != y.Op || x.Slot != y.Slot || x.Count != y.Count || x.A != y.A || x.C != y.C)
+			return false;
+		const size_t words = RenderPayloadWords(x.Op);
+		if (words == 0)
+			return x.B == y.B;
+		return memcmp(a.Payload.data() + x.B, b.Payload.data() + y.B, words * 4) == 0;
+	}
+
+	// Replays into a NullCommandList, which must record the captured stream again
+	bool ReplayCapture(LoadedCapture& loaded, int repeat)
+	{
+		NullCommandList commands;
+		loaded.Samples.resize(repeat);
+		for (int i = 0; i < repeat; ++i)
+		{
+			commands.Reset();
+			const auto start = std::chrono::steady_clock::now();
+			loaded.Capture.Replay(commands);
+			const auto end = std::chrono::steady_clock::now();
+			loaded.Samples[i].ReplayUs = std::chrono::duration<double, std::micro>(end - start).count();
+		}
+
+		FrameCapture replayed;
+		replayed.Commands = commands.GetCommands();
+		replayed.Payload = commands.GetPayload();
+		if (replayed.Commands.size() != loaded.Capture.Commands.size())
+			return false;
+		for (size_t i = 0; i < replayed.Commands.size(); ++i)
+			if (!SameCommand(loaded.Capture, i, replayed, i))
+				return false;
+		return true;
+	}
+
+	void WriteBind(std::ostream& out, const char* name, uint32_t total, uint32_t redundant, bool last = false)
+	{
+		out << "        \"" << name << "\": { \"total\": " << total << ", \"redundant\": " << redundant << " }" << (last ? "\n" : ",\n");
+	}
+
+	void WriteCapture(std::ostream& out, const LoadedCapture& loaded, bool last)
+	{
+		const CaptureAnalysis& a = loaded.Analysis;
+		const RenderStats& t = a.Totals;
+		const RenderStats& r = a.Redundant;
+
+		out << "    {\n";
+		out << "      \"file\": " << JsonString(loaded.File) << ",\n";
+		out << "      \"frame\": " << loaded.Capture.Frame << ",\n";
+		out << "      \"replay_ok\": " << (loaded.ReplayOk ? "true" : "false") << ",\n";
+		out << "      \"commands\": " << t.Commands << ",\n";
+		out << "      \"bytes\": " << loaded.Capture.Commands.size() * sizeof(RenderCommand) + loaded.Capture.Payload.size() * 4 << ",\n";
+		out << "      \"draws\": " << t.Draws << ",\n";
+		out << "      \"dispatches\": " << t.Dispatches << ",\n";
+		out << "      \"primitives\": " << t.Primitives << ",\n";
+		out << "      \"barriers\": " << t.Barriers << ",\n";
+		out << "      \"copies\": " << t.Copies << ",\n";
+		out << "      \"clears\": " << t.Clears << ",\n";
+		out << "      \"constant_blocks\": " << a.ConstantBlocks << ",\n";
+		out << "      \"upload_bytes\": " << a.UploadBytes << ",\n";
+
+		out << "      \"binds\": {\n";
+		WriteBind(out, "pipeline", t.PipelineBinds, r.PipelineBinds);
+		WriteBind(out, "root_signature", t.RootSignatureBinds, r.RootSignatureBinds);
+		WriteBind(out, "table", t.TableBinds, r.TableBinds);
+		WriteBind(out, "cbv", t.CbvBinds, r.CbvBinds);
+		WriteBind(out, "input", t.InputBinds, r.InputBinds);
+		WriteBind(out, "target", t.TargetBinds, r.TargetBinds);
+		WriteBind(out, "all", t.Binds(), r.Binds(), true);
+		out << "      },\n";
+
+		out << "      \"ops\": {";
+		bool first = true;
+		for (size_t op = 0; op < (size_t)RenderOp::Count; ++op)
+		{
+			if (a.Ops[op] == 0)
+				continue;
+			out << (first ? " " : ", ") << "\"" << RenderOpName((RenderOp)op) << "\": " << a.Ops[op];
+			first = false;
+		}
+		out << " },\n";
+
+		// Non-empty buckets only; "min" is the smallest size the bucket counts
+		out << "      \"draw_sizes\": [";
+		first = true;
+		for (int bucket = 0; bucket < CaptureAnalysis::DrawSizeBuckets; ++bucket)
+		{
+			if (a.DrawSizes[bucket] == 0)
+				continue;
+			out << (first ? " " : ", ") << "{ \"min\": " << (bucket == 0 ? 0ull : 1ull << bucket) << ", \"draws\": " << a.DrawSizes[bucket] << " }";
+			first = false;
+		}
+		out << " ],\n";
+
+		WriteSummary(out, "replay_us", loaded.Samples, [](const ReplaySample& s) { return s.ReplayUs; }, true);
+		out << "    }" << (last ? "\n" : ",\n");
+	}
+
+	void WriteDelta(std::ostream& out, const char* name, double a, double b, bool last = false)
+	{
+		out << "    \"" << name << "\": { \"a\": " << a << ", \"b\": " << b << ", \"delta\": " << b - a << " }" << (last ? "\n" : ",\n");
+	}
+
+	std::vector<double> ReplayTimes(const LoadedCapture& loaded)
+	{
+		std::vector<double> times;
+		for (const ReplaySample& s : loaded.Samples)
+			times.push_back(s.ReplayUs);
+		return times;
+	}
+
+	void WriteDiff(std::ostream& out, const LoadedCapture& la, const LoadedCapture& lb)
+	{
+		const FrameCapture& a = la.Capture;
+		const FrameCapture& b = lb.Capture;
+
+		// First command that differs, or the length of the shorter stream
+		// when one is a prefix of the other; -1 if the streams are the same
+		long long firstDifference = -1;
+		const size_t common = (std::min)(a.Commands.size(), b.Commands.size());
+		for (size_t i = 0; i < common && firstDifference < 0; ++i)
+			if (!SameCommand(a, i, b, i))
+				firstDifference = (long long)i;
+		if (firstDifference < 0 && a.Commands.size() != b.Commands.size())
+			firstDifference = (long long)common;
+
+		// Constant blocks matched by buffer and bind offset
+		std::map<std::pair<RenderId, uint32_t>, const CapturedConstants*> blocksA;
+		for (const CapturedConstants& c : a.Constants)
+			blocksA[{ c.Buffer, c.Offset }] = &c;
+		uint32_t changed = 0, added = 0, same = 0;
+		for (const CapturedConstants& c : b.Constants)
+		{
+			auto it = blocksA.find({ c.Buffer, c.Offset });
+			if (it == blocksA.end())
+			{
+				++added;
+				continue;
+			}
+			const CapturedConstants& old = *it->second;
+			if (old.Size == c.Size && memcmp(a.ConstantData.data() + old.Data, b.ConstantData.data() + c.Data, c.Size) == 0)
+				++same;
+			else
+				++changed;
+			blocksA.erase(it);
+		}
+
+		const CaptureAnalysis& x = la.Analysis;
+		const CaptureAnalysis& y = lb.Analysis;
+		out << "  \"diff\": {\n";
+		out << "    \"first_difference\": " << firstDifference << ",\n";
+		out << "    \"constant_blocks\": { \"same\": " << same << ", \"changed\": " << changed
+			<< ", \"added\": " << added << ", \"removed\": " << blocksA.size() << " },\n";
+		WriteDelta(out, "commands", x.Totals.Commands, y.Totals.Commands);
+		WriteDelta(out, "binds", x.Totals.Binds(), y.Totals.Binds());
+		WriteDelta(out, "redundant_binds", x.Redundant.Binds(), y.Redundant.Binds());
+		WriteDelta(out, "draws", x.Totals.Draws, y.Totals.Draws);
+		WriteDelta(out, "primitives", (double)x.Totals.Primitives, (double)y.Totals.Primitives);
+		WriteDelta(out, "barriers", x.Totals.Barriers, y.Totals.Barriers);
+		WriteDelta(out, "dispatches", x.Totals.Dispatches, y.Totals.Dispatches);
+		WriteDelta(out, "upload_bytes", (double)x.UploadBytes, (double)y.UploadBytes);
+		WriteDelta(out, "replay_us_p50", Percentile(ReplayTimes(la), 0.5), Percentile(ReplayTimes(lb), 0.5), true);
+		out << "  }\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	ReplayConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	std::vector<LoadedCapture> captures(config.Captures.size());
+	bool replayOk = true;
+	for (size_t i = 0; i < captures.size(); ++i)
+	{
+		LoadedCapture& loaded = captures[i];
+		loaded.File = config.Captures[i];
+		std::string error;
+		if (!loaded.Capture.Load(loaded.File, error))
+		{
+			std::cerr << error << "\n";
+			return 1;
+		}
+		loaded.Analysis = AnalyzeCapture(loaded.Capture);
+		loaded.ReplayOk = ReplayCapture(loaded, config.Repeat);
+		if (!loaded.ReplayOk)
+			std::cerr << loaded.File << ": the replay did not record the captured stream\n";
+		replayOk &= loaded.ReplayOk;
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	out << "{\n";
+	out << "  \"benchmark\": \"CaptureReplay\",\n";
+	out << "  \"label\": " << JsonString(config.Label) << ",\n";
+	out << "  \"config\": { \"repeat\": " << config.Repeat << " },\n";
+	out << "  \"captures\": [\n";
+	for (size_t i = 0; i < captures.size(); ++i)
+		WriteCapture(out, captures[i], i + 1 == captures.size());
+	out << "  ]" << (captures.size() == 2 ? ",\n" : "\n");
+	if (captures.size() == 2)
+		WriteDiff(out, captures[0], captures[1]);
+	out << "}\n";
+
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+	return replayOk ? 0 : 3;
+}
@@ -0,0 +1,594 @@
+//***************************************************************************************
+// DdsBench.cpp
+//
+// Checks and times the device-free stage of DDS loading (DDSTextureData:
+// read the file, validate the headers, lay out the subresources) over a
+// corpus of DDS files, the way LoadQueuedTextures runs it: one job per file
+// on a JobSystem, results taken in queue order on the calling thread.
+//
+// The check part loads every file of the corpus with every mode and
+// compares the layouts and a hash of every subresource; subresources must
+// lie inside the file, in order. Broken files (missing, empty, bad magic,
+// truncated header, truncated data) must fail with an error and not crash.
+// Any violation is a failure and the exit code is 3.
+//
+// The bench part loads the whole corpus --reps times for each mode and
+// thread count. A load is the parse stage (timed on its own), then the copy
+// out of every subresource that UpdateSubresources does on the main thread,
+// then the release. Modes:
+//   read   a fresh buffer per file, as CreateDDSTextureFromFile12 does
+//   pool   read buffers from one DDSReadBufferPool kept across loads
+//   map    LoadDDSTextureDataMapped12: InitData points into a mapping of the
+//          file, closed on release
+//
+// The memory part loads the corpus once per mode the way LoadQueuedTextures
+// does: the calling thread waits for each file in queue order, copies it into
+// an upload buffer that lives until the whole load is done, and releases it.
+// It reports that load's time and how far resident and private memory
+// (VmRSS/RssAnon, WorkingSetSize/PrivateUsage) rose above where they were
+// before it, sampled after every upload copy.
+//
+// Needs no GPU or window. Windows: DdsBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) and DirectX-Headers' dxgiformat.h on the
+// include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I<DirectX-Headers>/include/directx
+//       -I.. -I../../../Common DdsBench.cpp -L<dir> -lTerrainCore -o DdsBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: DdsBench [options]
+//   --corpus <dir>       DDS files, searched recursively (../../Textures)
+//   --threads <a,b,..>   thread counts, the calling one included (1, 2, 4 ... hardware)
+//   --reps <n>           corpus loads per mode and thread count (10)
+//   --no-memory          skip the memory part
+//   --label <text>       stored in the output, e.g. the commit
+//   --out <file.json>    (stdout)
+//***************************************************************************************
+
+#include "DDSTextureData.h"
+#include "JobSystem.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <psapi.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	enum class LoadMode
+	{
+		Read,
+		Pool,
+		Map,
+	};
+
+	const LoadMode Modes[] = { LoadMode::Read, LoadMode::Pool, LoadMode::Map };
+
+	const char* ModeName(LoadMode mode)
+	{
+		switch (mode)
+		{
+		case LoadMode::Read: return "read";
+		case LoadMode::Pool: return "pool";
+		default: return "map";
+		}
+	}
+
+	struct BenchConfig
+	{
+		std::string Corpus = "../../Textures";
+		std::vector<unsigned> Threads;
+		int Reps = 10;
+		bool Memory = true;
+		std::string Label;
+		std::string Out;
+	};
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	std::string HexResult(HRESULT hr)
+	{
+		char text[16];
+		snprintf(text, sizeof(text), "0x%08X", (unsigned)hr);
+		return text;
+	}
+
+	struct Corpus
+	{
+		std::vector<std::filesystem::path> Files;
+		uint64_t Bytes = 0;
+	};
+
+	Corpus FindCorpus(const std::string& dir)
+	{
+		Corpus corpus;
+		std::error_code error;
+		for (std::filesystem::recursive_directory_iterator it(dir, error), end; !error && it != end; it.increment(error))
+		{
+			if (!it->is_regular_file())
+				continue;
+			std::string ext = it->path().extension().string();
+			std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+			if (ext != ".dds")
+				continue;
+			corpus.Files.push_back(it->path());
+			corpus.Bytes += it->file_size();
+		}
+		std::sort(corpus.Files.begin(), corpus.Files.end());
+		return corpus;
+	}
+
+	HRESULT Load(LoadMode mode, const std::filesystem::path& file, DDSTextureData& data, DDSReadBufferPool& pool)
+	{
+		if (mode == LoadMode::Map)
+			return LoadDDSTextureDataMapped12(file.wstring().c_str(), data);
+		return LoadDDSTextureData12(file.wstring().c_str(), data, mode == LoadMode::Pool ? &pool : nullptr);
+	}
+
+	struct MemoryUse
+	{
+		double ResidentMb = 0.0;
+		double PrivateMb = 0.0;
+	};
+
+	// This process, now. Private is what the heap holds: anonymous pages on
+	// Linux, commit charge on Windows; mapped file pages only count as resident.
+	MemoryUse CurrentMemory()
+	{
+		MemoryUse use;
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS_EX counters = {};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters)))
+		{
+			use.ResidentMb = counters.WorkingSetSize / (1024.0 * 1024.0);
+			use.PrivateMb = counters.PrivateUsage / (1024.0 * 1024.0);
+		}
+#else
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line))
+		{
+			if (line.compare(0, 6, "VmRSS:") == 0)
+				use.ResidentMb = atof(line.c_str() + 6) / 1024.0;
+			else if (line.compare(0, 8, "RssAnon:") == 0)
+				use.PrivateMb = atof(line.c_str() + 8) / 1024.0;
+		}
+#endif
+		return use;
+	}
+
+	// Hands freed heap memory back, so an earlier load does not hide the next one's
+	void TrimHeap()
+	{
+#if defined(__GLIBC__)
+		malloc_trim(0);
+#endif
+	}
+
+	// Bytes of subresource index: one SlicePitch per depth slice of its mip
+	size_t SubresourceBytes(const DDSTextureData& data, size_t index)
+	{
+		const size_t mip = index % data.MipCount;
+		const size_t depth = (std::max)(data.Depth >> mip, (size_t)1);
+		return data.InitData[index].SlicePitch * depth;
+	}
+
+	uint64_t Hash(uint64_t hash, const void* bytes, size_t size)
+	{
+		const uint8_t* p = static_cast<const uint8_t*>(bytes);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ p[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	// Layout and contents, equal for every mode and thread count
+	uint64_t HashTexture(const DDSTextureData& data)
+	{
+		const size_t layout[] = { data.ResourceDimension, data.Width, data.Height, data.Depth, data.MipCount,
+			data.ArraySize, (size_t)data.Format, (size_t)data.IsCubeMap, (size_t)data.AlphaMode };
+		uint64_t hash = Hash(14695981039346656037ull, layout, sizeof(layout));
+		for (size_t i = 0; i < data.InitData.size(); ++i)
+		{
+			const size_t pitches[] = { data.InitData[i].RowPitch, data.InitData[i].SlicePitch };
+			hash = Hash(hash, pitches, sizeof(pitches));
+			hash = Hash(hash, data.InitData[i].pData, SubresourceBytes(data, i));
+		}
+		return hash;
+	}
+
+	//
+	// Checks
+	//
+
+	void CheckLayout(const DDSTextureData& data, const std::string& name)
+	{
+		Check(data.MipCount > 0 && data.ArraySize > 0 && data.InitData.size() == data.MipCount * data.ArraySize,
+			"layout", name + ": subresource count does not match mips x array size");
+		const bool mapped = data.Mapping.IsOpen();
+		const uint8_t* begin = mapped ? data.Mapping.GetData() : data.FileData.Data.get();
+		const uint8_t* end = begin + (mapped ? data.Mapping.GetSize() : data.FileData.Size);
+		const uint8_t* last = begin;
+		for (size_t i = 0; i < data.InitData.size(); ++i)
+		{
+			const uint8_t* p = static_cast<const uint8_t*>(data.InitData[i].pData);
+			const size_t bytes = SubresourceBytes(data, i);
+			if (p < last || p + bytes > end || data.InitData[i].RowPitch == 0 || data.InitData[i].RowPitch > data.InitData[i].SlicePitch)
+			{
+				Check(false, "layout", name + ": subresource " + std::to_string(i) + " out of order or outside the file");
+				return;
+			}
+			last = p + bytes;
+		}
+	}
+
+	// Every file loads with every mode, to the same layout and contents
+	std::vector<uint64_t> CheckCorpus(const Corpus& corpus)
+	{
+		std::vector<uint64_t> hashes(corpus.Files.size(), 0);
+		DDSReadBufferPool pool;
+		for (LoadMode mode : Modes)
+		{
+			for (size_t i = 0; i < corpus.Files.size(); ++i)
+			{
+				const std::string name = corpus.Files[i].filename().string() + " (" + ModeName(mode) + ")";
+				DDSTextureData data;
+				const HRESULT hr = Load(mode, corpus.Files[i], data, pool);
+				Check(SUCCEEDED(hr), "corpus", name + " failed with " + HexResult(hr));
+				if (FAILED(hr))
+					continue;
+				CheckLayout(data, name);
+				Check(mode != LoadMode::Map || data.Mapping.IsMapped(), "map", name + " was read instead of mapped");
+				const uint64_t hash = HashTexture(data);
+				Check(hashes[i] == 0 || hashes[i] == hash, "corpus", name + " differs from the read mode");
+				hashes[i] = hash;
+				ReleaseDDSTextureData(data, &pool);
+				Check(data.InitData.empty() && !data.FileData.Data && !data.Mapping.IsOpen(), "release", name + " left data behind");
+			}
+		}
+
+		// One pass of the pool over the corpus allocates at most one buffer per
+		// file; a second pass reuses them
+		const size_t allocations = pool.GetAllocationCount();
+		for (size_t i = 0; i < corpus.Files.size(); ++i)
+		{
+			DDSTextureData data;
+			if (SUCCEEDED(Load(LoadMode::Pool, corpus.Files[i], data, pool)))
+				ReleaseDDSTextureData(data, &pool);
+		}
+		Check(allocations <= corpus.Files.size(), "pool", std::to_string(allocations) + " allocations for " +
+			std::to_string(corpus.Files.size()) + " files");
+		Check(pool.GetAllocationCount() == allocations, "pool", "a second pass over the corpus allocated again");
+		return hashes;
+	}
+
+	void CheckBrokenFiles(const Corpus& corpus)
+	{
+		DDSReadBufferPool pool;
+		const std::filesystem::path dir = std::filesystem::temp_directory_path();
+		for (LoadMode mode : Modes)
+		{
+			DDSTextureData data;
+			const HRESULT missing = Load(mode, dir / "DdsBench-missing.dds", data, pool);
+			Check(missing == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND), "broken", std::string("missing file gave ") +
+				HexResult(missing) + " (" + ModeName(mode) + ")");
+		}
+		if (corpus.Files.empty())
+			return;
+
+		std::ifstream in(corpus.Files.front(), std::ios::binary);
+		const std::vector<char> source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		std::vector<char> badMagic = source;
+		badMagic[0] = 'X';
+
+		const struct { const char* Name; std::vector<char> Bytes; } cases[] = {
+			{ "empty", {} },
+			{ "bad magic", badMagic },
+			{ "header only", std::vector<char>(source.begin(), source.begin() + (std::min)(source.size(), (size_t)64)) },
+			{ "truncated data", std::vector<char>(source.begin(), source.begin() + source.size() / 2) },
+		};
+		const std::filesystem::path file = dir / "DdsBench-broken.dds";
+		for (const auto& c : cases)
+		{
+			{
+				std::ofstream out(file, std::ios::binary | std::ios::trunc);
+				out.write(c.Bytes.data(), (std::streamsize)c.Bytes.size());
+			}
+			for (LoadMode mode : Modes)
+			{
+				DDSTextureData data;
+				const HRESULT hr = Load(mode, file, data, pool);
+				Check(FAILED(hr), "broken", std::string(c.Name) + " file loaded (" + ModeName(mode) + ")");
+				Check(data.InitData.empty() && !data.FileData.Data && !data.Mapping.IsOpen(), "broken", std::string(c.Name) +
+					" file left data behind");
+			}
+		}
+		std::error_code ignored;
+		std::filesystem::remove(file, ignored);
+	}
+
+	//
+	// Bench
+	//
+
+	struct Sample
+	{
+		LoadMode Mode;
+		unsigned Threads;
+		std::vector<double> ParseMs;     // every file read and parsed
+		std::vector<double> CopyMs;      // every subresource copied out, buffers released
+		size_t Allocations = 0;          // pool buffers allocated over all reps
+	};
+
+	Sample Measure(const BenchConfig& config, const Corpus& corpus, const std::vector<uint64_t>& hashes, LoadMode mode, unsigned threads)
+	{
+		Sample sample;
+		sample.Mode = mode;
+		sample.Threads = threads;
+
+		JobSystem jobs(threads - 1);
+		DDSReadBufferPool pool;
+		std::vector<uint8_t> staging;
+		const size_t count = corpus.Files.size();
+		for (int rep = 0; rep < config.Reps; ++rep)
+		{
+			std::vector<DDSTextureData> parsed(count);
+			std::vector<HRESULT> results(count, E_FAIL);
+			std::vector<JobCounter> ready(count);
+
+			const auto start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < count; ++i)
+				jobs.Run([&, i]() { results[i] = Load(mode, corpus.Files[i], parsed[i], pool); }, &ready[i]);
+			for (size_t i = 0; i < count; ++i)
+				jobs.Wait(ready[i]);
+			const auto parsedAt = std::chrono::steady_clock::now();
+
+			// What UpdateSubresources does with InitData before the buffers go back
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (FAILED(results[i]))
+					continue;
+				for (size_t s = 0; s < parsed[i].InitData.size(); ++s)
+				{
+					const size_t bytes = SubresourceBytes(parsed[i], s);
+					if (staging.size() < bytes)
+						staging.resize(bytes);
+					memcpy(staging.data(), parsed[i].InitData[s].pData, bytes);
+				}
+				if (rep == 0)
+					Check(HashTexture(parsed[i]) == hashes[i], "bench", corpus.Files[i].filename().string() + " differs on " +
+						std::to_string(threads) + " threads (" + ModeName(mode) + ")");
+				ReleaseDDSTextureData(parsed[i], &pool);
+			}
+			const auto copiedAt = std::chrono::steady_clock::now();
+
+			sample.ParseMs.push_back(std::chrono::duration<double, std::milli>(parsedAt - start).count());
+			sample.CopyMs.push_back(std::chrono::duration<double, std::milli>(copiedAt - parsedAt).count());
+		}
+		sample.Allocations = pool.GetAllocationCount();
+		return sample;
+	}
+
+	struct MemorySample
+	{
+		LoadMode Mode;
+		unsigned Threads;
+		double LoadMs = 0.0;
+		MemoryUse Peak;                  // above the use before the load
+	};
+
+	MemorySample MeasureMemory(const Corpus& corpus, LoadMode mode, unsigned threads)
+	{
+		MemorySample sample;
+		sample.Mode = mode;
+		sample.Threads = threads;
+
+		TrimHeap();
+		JobSystem jobs(threads - 1);
+		DDSReadBufferPool pool;
+		const size_t count = corpus.Files.size();
+		std::vector<DDSTextureData> parsed(count);
+		std::vector<HRESULT> results(count, E_FAIL);
+		std::vector<JobCounter> ready(count);
+		std::vector<std::vector<uint8_t>> uploads(count);
+
+		const MemoryUse before = CurrentMemory();
+		auto sampleMemory = [&]()
+		{
+			const MemoryUse now = CurrentMemory();
+			sample.Peak.ResidentMb = (std::max)(sample.Peak.ResidentMb, now.ResidentMb - before.ResidentMb);
+			sample.Peak.PrivateMb = (std::max)(sample.Peak.PrivateMb, now.PrivateMb - before.PrivateMb);
+		};
+
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; ++i)
+			jobs.Run([&, i]() { results[i] = Load(mode, corpus.Files[i], parsed[i], pool); }, &ready[i]);
+		for (size_t i = 0; i < count; ++i)
+		{
+			jobs.Wait(ready[i]);
+			if (FAILED(results[i]))
+				continue;
+
+			size_t bytes = 0;
+			for (size_t s = 0; s < parsed[i].InitData.size(); ++s)
+				bytes += SubresourceBytes(parsed[i], s);
+			uploads[i].resize(bytes);
+			uint8_t* dst = uploads[i].data();
+			for (size_t s = 0; s < parsed[i].InitData.size(); ++s)
+			{
+				memcpy(dst, parsed[i].InitData[s].pData, SubresourceBytes(parsed[i], s));
+				dst += SubresourceBytes(parsed[i], s);
+			}
+			sampleMemory();
+			ReleaseDDSTextureData(parsed[i], &pool);
+		}
+		sample.LoadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		sampleMemory();
+		return sample;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const Corpus& corpus, const std::vector<Sample>& samples,
+		const std::vector<MemorySample>& memory)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"DdsBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"corpus\": " << JsonString(config.Corpus) << ", \"files\": " << corpus.Files.size()
+			<< ", \"bytes\": " << corpus.Bytes << ", \"reps\": " << config.Reps
+			<< ", \"hardware_threads\": " << std::thread::hardware_concurrency() << ", \"failures\": " << gFailures << " },\n";
+		out << "  \"results\": [\n";
+		for (size_t s = 0; s < samples.size(); ++s)
+		{
+			const Sample& sample = samples[s];
+			const double parseMs = Percentile(sample.ParseMs, 0.50);
+			out << "    { \"mode\": \"" << ModeName(sample.Mode) << "\", \"threads\": " << sample.Threads
+				<< ", \"parse_p50_ms\": " << parseMs << ", \"parse_min_ms\": " << Percentile(sample.ParseMs, 0.0)
+				<< ", \"parse_mb_per_sec\": " << (parseMs > 0.0 ? corpus.Bytes / (parseMs * 1000.0) : 0.0)
+				<< ", \"copy_p50_ms\": " << Percentile(sample.CopyMs, 0.50)
+				<< ", \"buffer_allocations\": " << sample.Allocations << " }"
+				<< (s + 1 < samples.size() ? ",\n" : "\n");
+		}
+		out << "  ],\n";
+		out << "  \"memory\": [\n";
+		for (size_t m = 0; m < memory.size(); ++m)
+		{
+			out << "    { \"mode\": \"" << ModeName(memory[m].Mode) << "\", \"threads\": " << memory[m].Threads
+				<< ", \"load_ms\": " << memory[m].LoadMs << ", \"resident_mb\": " << memory[m].Peak.ResidentMb
+				<< ", \"private_mb\": " << memory[m].Peak.PrivateMb << " }" << (m + 1 < memory.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseThreads(const std::string& text, BenchConfig& config)
+	{
+		std::stringstream list(text);
+		std::string item;
+		while (std::getline(list, item, ','))
+		{
+			const int threads = atoi(item.c_str());
+			if (threads < 1)
+				return false;
+			config.Threads.push_back((unsigned)threads);
+		}
+		return !config.Threads.empty();
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--corpus" && hasValue) config.Corpus = argv[++i];
+			else if (arg == "--threads" && hasValue && ParseThreads(argv[++i], config)) {}
+			else if (arg == "--reps" && hasValue) config.Reps = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--no-memory") config.Memory = false;
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+	if (config.Threads.empty())
+	{
+		const unsigned hardware = (std::max)(1u, std::thread::hardware_concurrency());
+		for (unsigned threads = 1; threads < hardware; threads *= 2)
+			config.Threads.push_back(threads);
+		config.Threads.push_back(hardware);
+	}
+	std::sort(config.Threads.begin(), config.Threads.end());
+	config.Threads.erase(std::unique(config.Threads.begin(), config.Threads.end()), config.Threads.end());
+
+	const Corpus corpus = FindCorpus(config.Corpus);
+	if (corpus.Files.empty())
+	{
+		std::cerr << "No .dds files under " << config.Corpus << "\n";
+		return 2;
+	}
+	fprintf(stderr, "corpus: %d files, %.1f MB\n", (int)corpus.Files.size(), corpus.Bytes / (1024.0 * 1024.0));
+
+	const std::vector<uint64_t> hashes = CheckCorpus(corpus);
+	CheckBrokenFiles(corpus);
+
+	// Before the bench, while the heap holds as little as it will
+	std::vector<MemorySample> memory;
+	for (LoadMode mode : Modes)
+	{
+		if (!config.Memory)
+			break;
+		memory.push_back(MeasureMemory(corpus, mode, config.Threads.back()));
+		const MemorySample& m = memory.back();
+		fprintf(stderr, "%-5s %3u threads: load %8.2f ms, resident +%.1f MB, private +%.1f MB\n",
+			ModeName(mode), m.Threads, m.LoadMs, m.Peak.ResidentMb, m.Peak.PrivateMb);
+	}
+
+	std::vector<Sample> samples;
+	for (LoadMode mode : Modes)
+	{
+		for (unsigned threads : config.Threads)
+		{
+			samples.push_back(Measure(config, corpus, hashes, mode, threads));
+			const Sample& s = samples.back();
+			const double parseMs = Percentile(s.ParseMs, 0.50);
+			fprintf(stderr, "%-5s %3u threads: parse %8.2f ms (%7.1f MB/s), copy %7.2f ms, %d buffers allocated\n",
+				ModeName(mode), threads, parseMs, parseMs > 0.0 ? corpus.Bytes / (parseMs * 1000.0) : 0.0,
+				Percentile(s.CopyMs, 0.50), (int)s.Allocations);
+		}
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, corpus, samples, memory);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
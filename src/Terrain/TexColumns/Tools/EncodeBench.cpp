@@ -0,0 +1,408 @@
+//***************************************************************************************
+// EncodeBench.cpp
+//
+// Checks and times BCEncoder::Encode alone: no mip generation, no file I/O,
+// which is what the paint layer's "Save layer" spends its encode time on.
+//
+// Images are generated, so two builds encode the same pixels:
+//   paint     a canvas painted by PaintLayer strokes on transparent black,
+//             as the app saves it
+//   gradient  smooth colour and alpha ramps
+//   noise     random texels, the worst case for block compression
+// Every format, image and thread count is encoded --reps times; the report
+// gives ms per encode, MPix/s, and the PSNR of the decoded result over RGB
+// and over RGBA.
+//
+// The checks: the output must not depend on the thread count, solid blocks
+// of 565-exact colours and alpha must decode exactly, BC1 must decode alpha
+// as 255 (it has no alpha), odd sizes must not write past CompressedSize,
+// the smooth images must reach --min-psnr, and SaveDDS + LoadDDS must give
+// what Decode gives. Any violation is a failure and the exit code is 3.
+//
+// Needs no GPU or window. Windows: EncodeBench.vcxproj. Elsewhere:
+//   g++ -std=c++17 -O2 -pthread -I.. -I../../../Common EncodeBench.cpp
+//       -L<dir> -lTerrainCore -o EncodeBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: EncodeBench [options]
+//   --size <texels>     image width and height (2048)
+//   --threads <a,b,..>  thread counts to time (1, 2, 4, ... up to the hardware)
+//   --reps <n>          encodes per sample (10)
+//   --min-psnr <dB>     floor for the paint and gradient images in BC3 (35)
+//   --label <text>      stored in the output, e.g. the commit
+//   --out <file.json>   (stdout)
+//***************************************************************************************
+
+#include "BCEncoder.h"
+#include "JobSystem.h"
+#include "PaintLayer.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// The request's throughput target, on 8 threads
+	const double TargetMPixPerSec = 100.0;
+
+	struct BenchConfig
+	{
+		uint32_t Size = 2048;
+		std::vector<unsigned> Threads;
+		int Reps = 10;
+		double MinPsnr = 35.0;
+		std::string Label;
+		std::string Out;
+	};
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	const char* FormatName(BCEncoder::Format format)
+	{
+		return format == BCEncoder::Format::BC1 ? "BC1" : "BC3";
+	}
+
+	struct Image
+	{
+		std::string Name;
+		bool Smooth = false;               // held to --min-psnr
+		std::vector<uint8_t> Rgba;
+	};
+
+	Image MakePaint(uint32_t size)
+	{
+		PaintLayer layer((int)size, (int)size);
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (int stroke = 0; stroke < 40; ++stroke)
+		{
+			BrushStamp stamp;
+			stamp.U = unit(rng);
+			stamp.V = unit(rng);
+			stamp.RadiusUV = 0.01f + 0.03f * unit(rng);
+			stamp.FalloffUV = stamp.RadiusUV * 1.4f;
+			for (float& c : stamp.Color)
+				c = unit(rng);
+			const float angle = unit(rng) * 6.2831853f;
+			for (int dab = 0; dab < 60; ++dab)
+			{
+				layer.Stamp(stamp);
+				stamp.U += std::cos(angle) * stamp.RadiusUV * 0.25f;
+				stamp.V += std::sin(angle) * stamp.RadiusUV * 0.25f;
+			}
+		}
+		Image image;
+		image.Name = "paint";
+		image.Smooth = true;
+		image.Rgba.resize((size_t)size * size * 4);
+		PaintRect all;
+		all.X1 = all.Y1 = (int)size;
+		layer.ReadRect(all, image.Rgba.data(), (size_t)size * 4);
+		return image;
+	}
+
+	Image MakeGradient(uint32_t size)
+	{
+		Image image;
+		image.Name = "gradient";
+		image.Smooth = true;
+		image.Rgba.resize((size_t)size * size * 4);
+		for (uint32_t y = 0; y < size; ++y)
+		{
+			for (uint32_t x = 0; x < size; ++x)
+			{
+				uint8_t* p = &image.Rgba[((size_t)y * size + x) * 4];
+				p[0] = (uint8_t)(128.0 + 127.0 * std::sin(x * 0.01));
+				p[1] = (uint8_t)(y * 255 / size);
+				p[2] = (uint8_t)(255 - x * 255 / size);
+				p[3] = (uint8_t)((x + y) * 255 / (2 * size));
+			}
+		}
+		return image;
+	}
+
+	Image MakeNoise(uint32_t size)
+	{
+		Image image;
+		image.Name = "noise";
+		image.Rgba.resize((size_t)size * size * 4);
+		std::mt19937 rng(11);
+		for (uint8_t& c : image.Rgba)
+			c = (uint8_t)rng();
+		return image;
+	}
+
+	std::vector<uint8_t> EncodeImage(BCEncoder::Format format, const Image& image, uint32_t size, unsigned threads)
+	{
+		std::vector<uint8_t> blocks(BCEncoder::CompressedSize(format, size, size));
+		BCEncoder::Encode(format, image.Rgba.data(), size, size, (size_t)size * 4, blocks.data(), threads);
+		return blocks;
+	}
+
+	//
+	// Checks
+	//
+
+	// Solid blocks of colours 565 holds exactly, with alpha BC3 holds exactly
+	void CheckSolidBlocks()
+	{
+		const uint8_t colours[][4] = { { 0, 0, 0, 0 }, { 255, 255, 255, 255 }, { 255, 0, 0, 128 }, { 0, 255, 0, 17 }, { 132, 130, 66, 200 } };
+		for (BCEncoder::Format format : { BCEncoder::Format::BC1, BCEncoder::Format::BC3 })
+		{
+			for (const uint8_t* c : colours)
+			{
+				std::vector<uint8_t> rgba(8 * 8 * 4), decoded(rgba.size());
+				for (size_t i = 0; i < rgba.size(); i += 4)
+					memcpy(&rgba[i], c, 4);
+				std::vector<uint8_t> blocks(BCEncoder::CompressedSize(format, 8, 8));
+				BCEncoder::Encode(format, rgba.data(), 8, 8, 8 * 4, blocks.data(), 1);
+				BCEncoder::Decode(format, blocks.data(), 8, 8, decoded.data(), 8 * 4);
+				bool exact = true;
+				for (size_t i = 0; i < rgba.size(); i += 4)
+				{
+					exact = exact && memcmp(&rgba[i], &decoded[i], 3) == 0;
+					const uint8_t alpha = format == BCEncoder::Format::BC1 ? 255 : c[3];
+					exact = exact && decoded[i + 3] == alpha;
+				}
+				Check(exact, "solid block", std::string(FormatName(format)) + " colour " + std::to_string(c[0]) + "," +
+					std::to_string(c[1]) + "," + std::to_string(c[2]) + "," + std::to_string(c[3]));
+			}
+		}
+	}
+
+	// Sizes that are not multiples of 4 read only the image and write only
+	// CompressedSize bytes
+	void CheckOddSizes(const Image& source, uint32_t sourceSize)
+	{
+		const uint32_t sizes[][2] = { { 1, 1 }, { 3, 5 }, { 4, 4 }, { 37, 19 }, { 130, 7 } };
+		const uint8_t guard = 0xA5;
+		for (BCEncoder::Format format : { BCEncoder::Format::BC1, BCEncoder::Format::BC3 })
+		{
+			for (const uint32_t* s : sizes)
+			{
+				const size_t bytes = BCEncoder::CompressedSize(format, s[0], s[1]);
+				std::vector<uint8_t> blocks(bytes + 64, guard);
+				BCEncoder::Encode(format, source.Rgba.data(), s[0], s[1], (size_t)sourceSize * 4, blocks.data(), 0);
+				bool intact = true;
+				for (size_t i = bytes; i < blocks.size(); ++i)
+					intact = intact && blocks[i] == guard;
+				Check(intact, "odd size", std::string(FormatName(format)) + " " + std::to_string(s[0]) + "x" +
+					std::to_string(s[1]) + " wrote past CompressedSize");
+			}
+		}
+	}
+
+	void CheckFileRoundTrip(const Image& image, uint32_t size)
+	{
+		const std::filesystem::path file = std::filesystem::temp_directory_path() / "EncodeBench.dds";
+		const std::vector<uint8_t> blocks = EncodeImage(BCEncoder::Format::BC3, image, size, 0);
+		std::vector<uint8_t> decoded((size_t)size * size * 4), loaded;
+		BCEncoder::Decode(BCEncoder::Format::BC3, blocks.data(), size, size, decoded.data(), (size_t)size * 4);
+
+		BCEncoder::SaveStats stats;
+		const bool saved = BCEncoder::SaveDDS(file.wstring(), BCEncoder::Format::BC3, image.Rgba.data(), size, size, (size_t)size * 4,
+			true, 0, &stats);
+		uint32_t width = 0, height = 0;
+		BCEncoder::Format format = BCEncoder::Format::BC1;
+		const bool read = saved && BCEncoder::LoadDDS(file.wstring(), loaded, width, height, &format);
+		std::error_code ignored;
+		std::filesystem::remove(file, ignored);
+		Check(saved && read, "dds file", "SaveDDS or LoadDDS failed on " + file.string());
+		if (!read)
+			return;
+		Check(width == size && height == size && format == BCEncoder::Format::BC3, "dds file", "header does not match what was saved");
+		Check(loaded == decoded, "dds file", "top mip differs from Decode of Encode");
+		Check(stats.EncodeMs > 0.0 && stats.EncodeMs <= stats.TotalMs, "save stats", "encode time not within the save time");
+		Check(stats.EncodedPixels >= (uint64_t)size * size, "save stats", "mip levels missing from the encoded pixel count");
+	}
+
+	//
+	// Bench
+	//
+
+	struct Sample
+	{
+		std::string Image;
+		BCEncoder::Format Format;
+		unsigned Threads;
+		std::vector<double> Ms;
+		double PsnrRgb = 0.0;
+		double PsnrRgba = 0.0;
+	};
+
+	Sample Measure(const BenchConfig& config, const Image& image, BCEncoder::Format format, unsigned threads,
+		const std::vector<uint8_t>& reference)
+	{
+		Sample sample;
+		sample.Image = image.Name;
+		sample.Format = format;
+		sample.Threads = threads;
+
+		std::vector<uint8_t> blocks(reference.size());
+		for (int rep = 0; rep < config.Reps; ++rep)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			BCEncoder::Encode(format, image.Rgba.data(), config.Size, config.Size, (size_t)config.Size * 4, blocks.data(), threads);
+			sample.Ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		Check(blocks == reference, "threads", image.Name + " " + FormatName(format) + " on " + std::to_string(threads) +
+			" threads differs from one thread");
+
+		std::vector<uint8_t> decoded(image.Rgba.size());
+		BCEncoder::Decode(format, blocks.data(), config.Size, config.Size, decoded.data(), (size_t)config.Size * 4);
+		sample.PsnrRgb = BCEncoder::ComputePSNR(image.Rgba.data(), decoded.data(), config.Size, config.Size, (size_t)config.Size * 4, false);
+		sample.PsnrRgba = BCEncoder::ComputePSNR(image.Rgba.data(), decoded.data(), config.Size, config.Size, (size_t)config.Size * 4, true);
+		if (image.Smooth && format == BCEncoder::Format::BC3)
+			Check(sample.PsnrRgba >= config.MinPsnr, "psnr", image.Name + " BC3 at " + std::to_string(sample.PsnrRgba) + " dB");
+		return sample;
+	}
+
+	double MPixPerSec(const BenchConfig& config, const Sample& sample)
+	{
+		const double ms = Percentile(sample.Ms, 0.50);
+		return ms > 0.0 ? (double)config.Size * config.Size / (ms * 1000.0) : 0.0;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<Sample>& samples)
+	{
+#ifdef BC_NO_SSE2
+		const bool sse2 = false;
+#elif defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		const bool sse2 = true;
+#else
+		const bool sse2 = false;
+#endif
+		out << "{\n";
+		out << "  \"benchmark\": \"EncodeBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"size\": " << config.Size << ", \"reps\": " << config.Reps << ", \"sse2\": " << (sse2 ? "true" : "false")
+			<< ", \"hardware_threads\": " << std::thread::hardware_concurrency() << ", \"target_mpix_per_sec_8_threads\": " << TargetMPixPerSec
+			<< ", \"failures\": " << gFailures << " },\n";
+		out << "  \"results\": [\n";
+		for (size_t s = 0; s < samples.size(); ++s)
+		{
+			const Sample& sample = samples[s];
+			out << "    { \"image\": " << JsonString(sample.Image) << ", \"format\": \"" << FormatName(sample.Format)
+				<< "\", \"threads\": " << sample.Threads << ", \"p50_ms\": " << Percentile(sample.Ms, 0.50)
+				<< ", \"min_ms\": " << Percentile(sample.Ms, 0.0) << ", \"mpix_per_sec\": " << MPixPerSec(config, sample)
+				<< ", \"psnr_rgb\": " << sample.PsnrRgb << ", \"psnr_rgba\": " << sample.PsnrRgba << " }"
+				<< (s + 1 < samples.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseThreads(const std::string& text, BenchConfig& config)
+	{
+		std::stringstream list(text);
+		std::string item;
+		while (std::getline(list, item, ','))
+		{
+			const int threads = atoi(item.c_str());
+			if (threads < 1)
+				return false;
+			config.Threads.push_back((unsigned)threads);
+		}
+		return !config.Threads.empty();
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--size" && hasValue) config.Size = (uint32_t)(std::max)(atoi(argv[++i]), 16);
+			else if (arg == "--threads" && hasValue && ParseThreads(argv[++i], config)) {}
+			else if (arg == "--reps" && hasValue) config.Reps = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--min-psnr" && hasValue) config.MinPsnr = atof(argv[++i]);
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+	if (config.Threads.empty())
+	{
+		const unsigned hardware = (std::max)(1u, std::thread::hardware_concurrency());
+		for (unsigned threads = 1; threads < hardware; threads *= 2)
+			config.Threads.push_back(threads);
+		config.Threads.push_back(hardware);
+	}
+	std::sort(config.Threads.begin(), config.Threads.end());
+	config.Threads.erase(std::unique(config.Threads.begin(), config.Threads.end()), config.Threads.end());
+
+	const std::vector<Image> images = { MakePaint(config.Size), MakeGradient(config.Size), MakeNoise(config.Size) };
+	CheckSolidBlocks();
+	CheckOddSizes(images[1], config.Size);
+	CheckFileRoundTrip(images[0], config.Size);
+
+	std::vector<Sample> samples;
+	for (const Image& image : images)
+	{
+		for (BCEncoder::Format format : { BCEncoder::Format::BC1, BCEncoder::Format::BC3 })
+		{
+			const std::vector<uint8_t> reference = EncodeImage(format, image, config.Size, 1);
+			for (unsigned threads : config.Threads)
+			{
+				samples.push_back(Measure(config, image, format, threads, reference));
+				const Sample& s = samples.back();
+				fprintf(stderr, "%-9s %s %3u threads %8.2f ms %8.1f MPix/s, PSNR rgb %6.2f dB rgba %6.2f dB\n", s.Image.c_str(),
+					FormatName(format), threads, Percentile(s.Ms, 0.50), MPixPerSec(config, s), s.PsnrRgb, s.PsnrRgba);
+			}
+		}
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, samples);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
@@ -0,0 +1,733 @@
+//***************************************************************************************
+// FrameHandoff.cpp
+//
+// Checks the FramePipeline that hands TexColumnsApp's frames from Update to
+// the render thread, and times a frame loop with and without it.
+//
+// The stress part runs the app's frame loop with stand-ins for the device:
+// FramePackets filled from the frame number, a ring of six frame resources
+// whose constants Update writes after waiting on their fence, and a GPU
+// thread that completes submissions in order and checks that the constants
+// it reads are still the ones of the frame that submitted them. The render
+// callback checks every packet it gets is whole and in order (paced: no
+// gaps) and that its frame resource still holds its frame's constants.
+// Rounds also drain and record frames on the simulation thread as a capture
+// does, stop and restart the render thread as the UI toggle does, run
+// unpaced with packets dropped, and throw from the render callback, which
+// must surface on the simulation thread. The raw TripleBuffer gets a
+// producer/consumer round of its own. Any violation is a failure and the
+// exit code is 3. Built with -fsanitize=thread it is the handoff's race test:
+// the Fence values are plain fields, as in the app, so a missing
+// happens-before shows up as a race.
+//
+// The bench part spins --update-ms and --draw-ms per frame, with --gpu-ms
+// per submission on the fake GPU, serially, pipelined and unpaced, and
+// reports frame times, the speedup over serial and where each side waited.
+//
+// Needs no GPU or window. Windows: FrameHandoff.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common FrameHandoff.cpp
+//       -L<dir> -lTerrainCore -o FrameHandoff
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: FrameHandoff [options]
+//   --frames <n>        frames per stress round (1000)
+//   --rounds <n>        stress rounds (20); 0 skips the stress part
+//   --update-ms <ms>    bench: Update's cost per frame (4)
+//   --draw-ms <ms>      bench: recording and submitting per frame (3)
+//   --gpu-ms <ms>       bench: fake GPU time per frame (2)
+//   --bench-frames <n>  bench: frames per mode (300)
+//   --no-bench          stress only
+//   --label <text>      stored in the output, e.g. the commit
+//   --out <file.json>   (stdout)
+//***************************************************************************************
+
+#include "FramePacket.h"
+#include "FramePipeline.h"
+#include "TripleBuffer.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const int FrameResources = 6;          // gNumFrameResources
+	const size_t ConstantWords = 64;
+
+	struct BenchConfig
+	{
+		int Frames = 1000;
+		int Rounds = 20;
+		double UpdateMs = 4.0;
+		double DrawMs = 3.0;
+		double GpuMs = 2.0;
+		int BenchFrames = 300;
+		bool Bench = true;
+		std::string Label;
+		std::string Out;
+	};
+
+	std::atomic<int> gFailures{ 0 };
+
+	// Called from the simulation, render and GPU threads
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	std::atomic<uint64_t> gSink{ 0 };
+
+	void Spin(double ms)
+	{
+		if (ms <= 0.0)
+			return;
+		const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(ms);
+		uint64_t x = 1;
+		while (std::chrono::steady_clock::now() < end)
+			for (int i = 0; i < 64; ++i)
+				x = x * 6364136223846793005ull + 1442695040888963407ull;
+		gSink.fetch_add(x, std::memory_order_relaxed);
+	}
+
+	// Now and then gives the other threads a turn, to shake out interleavings
+	void Jitter(std::mt19937& rng)
+	{
+		const uint32_t r = rng() % 16;
+		if (r == 0)
+			std::this_thread::yield();
+		else if (r == 1)
+			Spin(0.02);
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	//
+	// Stand-ins for the device
+	//
+
+	// The command queue and its fence: submissions run in order on a thread
+	// of their own, then their fence value completes
+	class FakeGpu
+	{
+	public:
+		explicit FakeGpu(double ms) : mMs(ms), mThread(&FakeGpu::Main, this) {}
+		~FakeGpu()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+				mQuit = true;
+			}
+			mWake.notify_all();
+			mThread.join();
+		}
+
+		void Submit(uint64_t fence, std::function<void()> work)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+				mQueue.push_back(Submission{ fence, std::move(work) });
+			}
+			mWake.notify_all();
+		}
+
+		uint64_t GetCompletedValue() const { return mCompleted.load(std::memory_order_acquire); }
+
+		void WaitFor(uint64_t fence)
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			mDone.wait(lock, [&]() { return mCompleted.load(std::memory_order_acquire) >= fence; });
+		}
+
+	private:
+		struct Submission
+		{
+			uint64_t Fence;
+			std::function<void()> Work;
+		};
+
+		void Main()
+		{
+			for (;;)
+			{
+				Submission next;
+				{
+					std::unique_lock<std::mutex> lock(mLock);
+					mWake.wait(lock, [&]() { return mQuit || !mQueue.empty(); });
+					if (mQueue.empty())
+						return;
+					next = std::move(mQueue.front());
+					mQueue.pop_front();
+				}
+				next.Work();
+				if (mMs > 0.0)
+					std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(mMs));
+				{
+					std::lock_guard<std::mutex> lock(mLock);
+					mCompleted.store(next.Fence, std::memory_order_release);
+				}
+				mDone.notify_all();
+			}
+		}
+
+		double mMs;
+		std::mutex mLock;
+		std::condition_variable mWake;
+		std::condition_variable mDone;
+		std::deque<Submission> mQueue;
+		std::atomic<uint64_t> mCompleted{ 0 };
+		bool mQuit = false;
+		std::thread mThread;
+	};
+
+	// One element of the fence ring: Update writes Constants, the GPU reads
+	// them until Fence completes
+	struct FakeFrameResource
+	{
+		std::vector<uint64_t> Constants = std::vector<uint64_t>(ConstantWords, 0);
+		uint64_t Fence = 0;                // the render side's, read by Update
+	};
+
+	uint64_t ConstantFor(uint64_t frame, size_t word)
+	{
+		return frame * 0x9E3779B97F4A7C15ull + word;
+	}
+
+	//
+	// Packets
+	//
+
+	uint32_t CountFor(uint64_t frame, uint32_t salt, uint32_t range)
+	{
+		return (uint32_t)((frame * 2654435761u + salt) % range);
+	}
+
+	// Sizes vary frame to frame, so a slot that kept items of an earlier,
+	// bigger packet is caught
+	void FillPacket(FramePacket& p, uint64_t frame, uint32_t resource)
+	{
+		p.Frame = frame;
+		p.FrameResource = resource;
+		p.Bindings.FirstFrame = frame == 1;
+		p.Bindings.FrameIndex = (uint32_t)(frame % 16);
+		p.Bindings.ObjectCB = (RenderId)(frame & 0xffff);
+		p.Bindings.BackBufferRtv = 0;
+
+		p.Opaque.clear();
+		for (uint32_t i = 0, n = CountFor(frame, 1, 8); i < n; ++i)
+		{
+			DrawItem item;
+			item.ObjCBIndex = (uint32_t)(frame * 31 + i);
+			item.IndexCount = i + 3;
+			p.Opaque.push_back(item);
+		}
+		p.CustomMeshes.clear();
+		for (uint32_t i = 0, n = CountFor(frame, 2, 24); i < n; ++i)
+		{
+			DrawItem item;
+			item.MatCBIndex = (uint32_t)(frame + i);
+			p.CustomMeshes.push_back(item);
+		}
+		p.Tiles.clear();
+		for (uint32_t i = 0, n = CountFor(frame, 3, 42); i < n; ++i)
+		{
+			DrawItem item;
+			item.TileIndex = (uint32_t)(frame ^ i);
+			p.Tiles.push_back(item);
+		}
+
+		p.Painting = frame % 3 == 0;
+		p.Capture = false;
+		p.BrushUpload = PaintRect();
+		if (frame % 5 == 0)
+		{
+			PaintRect& r = p.BrushUpload;
+			r.X0 = (int)(frame % 7);
+			r.Y0 = (int)(frame % 3);
+			r.X1 = r.X0 + 1 + (int)(frame % 17);
+			r.Y1 = r.Y0 + 1 + (int)(frame % 5);
+			p.BrushUploadPitch = ((r.X1 - r.X0) * 4 + 255) & ~255u;
+			p.BrushUploadPixels.resize((size_t)p.BrushUploadPitch * (r.Y1 - r.Y0));
+			for (size_t i = 0; i < p.BrushUploadPixels.size(); ++i)
+				p.BrushUploadPixels[i] = (uint8_t)(frame + i);
+		}
+	}
+
+	// Empty when p is what FillPacket wrote for its frame
+	std::string VerifyPacket(const FramePacket& p)
+	{
+		const uint64_t frame = p.Frame;
+		if (p.Bindings.FrameIndex != frame % 16 || p.Bindings.ObjectCB != (RenderId)(frame & 0xffff) ||
+			p.Bindings.FirstFrame != (frame == 1))
+			return "bindings";
+		if (p.Opaque.size() != CountFor(frame, 1, 8) || p.CustomMeshes.size() != CountFor(frame, 2, 24) ||
+			p.Tiles.size() != CountFor(frame, 3, 42))
+			return "item counts";
+		for (size_t i = 0; i < p.Opaque.size(); ++i)
+			if (p.Opaque[i].ObjCBIndex != (uint32_t)(frame * 31 + i) || p.Opaque[i].IndexCount != i + 3)
+				return "opaque item " + std::to_string(i);
+		for (size_t i = 0; i < p.CustomMeshes.size(); ++i)
+			if (p.CustomMeshes[i].MatCBIndex != (uint32_t)(frame + i))
+				return "custom mesh " + std::to_string(i);
+		for (size_t i = 0; i < p.Tiles.size(); ++i)
+			if (p.Tiles[i].TileIndex != (uint32_t)(frame ^ i))
+				return "tile " + std::to_string(i);
+		if (p.Painting != (frame % 3 == 0))
+			return "painting";
+		if (p.BrushUpload.Empty() != (frame % 5 != 0))
+			return "brush rect";
+		if (!p.BrushUpload.Empty())
+		{
+			const size_t size = (size_t)p.BrushUploadPitch * (p.BrushUpload.Y1 - p.BrushUpload.Y0);
+			if (p.BrushUploadPixels.size() != size)
+				return "brush pixel count";
+			for (size_t i = 0; i < size; ++i)
+				if (p.BrushUploadPixels[i] != (uint8_t)(frame + i))
+					return "brush pixel " + std::to_string(i);
+		}
+		return std::string();
+	}
+
+	//
+	// The app's frame loop
+	//
+
+	struct LoopConfig
+	{
+		int Frames = 1000;
+		bool Threaded = true;
+		bool Paced = true;             // unpaced packets carry no frame-resource state
+		double UpdateMs = 0.0;
+		double DrawMs = 0.0;
+		double GpuMs = 0.0;
+		bool Jitter = false;
+		int InlineEvery = 0;           // drain and record on this thread, as a capture does
+		int ToggleEvery = 0;           // stop or restart the render thread, as the UI does
+		uint64_t ThrowAt = 0;          // the render callback throws on this frame
+		uint32_t Seed = 1;
+	};
+
+	struct LoopResult
+	{
+		std::vector<double> FrameMs;
+		double WallMs = 0.0;
+		uint64_t Rendered = 0;         // by either thread
+		uint64_t InlineFrames = 0;
+		uint64_t Toggles = 0;
+		uint64_t ThrownOn = 0;         // frame whose BeginPacket, Publish or Drain rethrew
+		FramePipelineStats Stats;
+	};
+
+	class FrameLoop
+	{
+	public:
+		explicit FrameLoop(const LoopConfig& config)
+			: mConfig(config), mGpu(config.GpuMs), mSimRng(config.Seed), mRenderRng(config.Seed * 7919u + 1u) {}
+
+		LoopResult Run()
+		{
+			LoopResult result;
+			const auto start = std::chrono::steady_clock::now();
+			if (mConfig.Threaded)
+				StartRenderThread();
+
+			try
+			{
+				for (uint64_t frame = 1; frame <= (uint64_t)mConfig.Frames; ++frame)
+				{
+					const auto frameStart = std::chrono::steady_clock::now();
+					if (mConfig.ToggleEvery > 0 && frame % mConfig.ToggleEvery == 0)
+					{
+						if (mPipeline.IsRunning())
+						{
+							mPipeline.Drain();
+							mPipeline.Stop();
+						}
+						else
+						{
+							StartRenderThread();
+						}
+						++result.Toggles;
+					}
+
+					// Update
+					FramePacket& packet = mPipeline.IsRunning() ? mPipeline.BeginPacket() : mSerialPacket;
+					const uint32_t resource = (uint32_t)(frame % FrameResources);
+					if (mConfig.Paced)
+					{
+						FakeFrameResource& res = mResources[resource];
+						if (res.Fence != 0 && mGpu.GetCompletedValue() < res.Fence)
+							mGpu.WaitFor(res.Fence);
+						for (size_t i = 0; i < ConstantWords; ++i)
+							res.Constants[i] = ConstantFor(frame, i);
+					}
+					Spin(mConfig.UpdateMs);
+					if (mConfig.Jitter)
+						Jitter(mSimRng);
+
+					// Draw
+					FillPacket(packet, frame, resource);
+					if (!mPipeline.IsRunning())
+					{
+						Render(packet);
+					}
+					else if (mConfig.InlineEvery > 0 && frame % mConfig.InlineEvery == 0)
+					{
+						mPipeline.Drain();
+						Check(!mInRender.load(), "drain", "render callback still running after Drain");
+						Check(mLastRendered == frame - 1, "drain",
+							"frame " + std::to_string(mLastRendered) + " rendered last, " + std::to_string(frame - 1) + " published");
+						// What ApplyResidencyChanges does next: flush the queue
+						mGpu.WaitFor(mCurrentFence);
+						Render(packet);
+						++result.InlineFrames;
+					}
+					else
+					{
+						mPipeline.Publish();
+					}
+					result.FrameMs.push_back(MsSince(frameStart));
+				}
+				mPipeline.Drain();
+			}
+			catch (const std::runtime_error&)
+			{
+				result.ThrownOn = mConfig.ThrowAt ? mLastBegun : 0;
+			}
+
+			mPipeline.Stop();
+			mGpu.WaitFor(mCurrentFence);
+			result.WallMs = MsSince(start);
+			result.Rendered = mRendered;
+			result.Stats = mPipeline.GetStats();
+			return result;
+		}
+
+		uint64_t GetLastRendered() const { return mLastRendered; }
+
+	private:
+		void StartRenderThread()
+		{
+			mPipeline.Start([this](const FramePacket& packet) { Render(packet); }, nullptr, mConfig.Paced);
+		}
+
+		// RenderFrame: records from the packet, submits, sets the fence
+		void Render(const FramePacket& packet)
+		{
+			mLastBegun = packet.Frame;
+			mInRender.store(true);
+			if (packet.Frame == mConfig.ThrowAt)
+			{
+				mInRender.store(false);
+				throw std::runtime_error("render failed on frame " + std::to_string(packet.Frame));
+			}
+
+			const std::string error = VerifyPacket(packet);
+			Check(error.empty(), "packet", "frame " + std::to_string(packet.Frame) + ": " + error);
+			if (mConfig.Paced)
+				Check(packet.Frame == mLastRendered + 1, "order",
+					"frame " + std::to_string(packet.Frame) + " after " + std::to_string(mLastRendered));
+			else
+				Check(packet.Frame > mLastRendered, "order",
+					"frame " + std::to_string(packet.Frame) + " after " + std::to_string(mLastRendered));
+			Check(packet.FrameResource == packet.Frame % FrameResources, "resource", "frame " + std::to_string(packet.Frame));
+
+			if (mConfig.Jitter)
+				Jitter(mRenderRng);
+			Spin(mConfig.DrawMs);
+
+			const uint64_t fence = ++mCurrentFence;
+			if (mConfig.Paced)
+			{
+				FakeFrameResource& res = mResources[packet.FrameResource];
+				Check(res.Constants[0] == ConstantFor(packet.Frame, 0), "constants",
+					"frame " + std::to_string(packet.Frame) + " recorded over another frame's constants");
+				res.Fence = fence;
+				// The GPU reads the constants until the fence completes
+				mGpu.Submit(fence, [&res, frame = packet.Frame]()
+				{
+					bool same = true;
+					for (size_t i = 0; i < ConstantWords; ++i)
+						same = same && res.Constants[i] == ConstantFor(frame, i);
+					Check(same, "fence ring", "constants of frame " + std::to_string(frame) + " overwritten while the GPU read them");
+				});
+			}
+			else
+			{
+				mGpu.Submit(fence, []() {});
+			}
+
+			mLastRendered = packet.Frame;
+			++mRendered;
+			mInRender.store(false);
+		}
+
+		LoopConfig mConfig;
+		FakeGpu mGpu;
+		FakeFrameResource mResources[FrameResources];
+		FramePacket mSerialPacket;
+		std::mt19937 mSimRng;
+
+		// The render side's, or this thread's while it is drained or stopped
+		std::mt19937 mRenderRng;
+		uint64_t mCurrentFence = 0;
+		uint64_t mLastRendered = 0;
+		uint64_t mLastBegun = 0;
+		uint64_t mRendered = 0;
+		std::atomic<bool> mInRender{ false };
+
+		// Last, so it stops before the rest goes
+		FramePipeline<FramePacket> mPipeline;
+	};
+
+	//
+	// Stress
+	//
+
+	// Producer and consumer hammer the buffer directly; every value taken
+	// must be whole and newer than the last, and taken plus replaced must
+	// add up to everything published
+	void StressTripleBuffer(uint32_t seed, uint64_t count)
+	{
+		struct Value
+		{
+			uint64_t Sequence = 0;
+			std::vector<uint64_t> Data;
+		};
+
+		TripleBuffer<Value> buffer;
+		uint64_t replaced = 0;
+		std::thread producer([&]()
+		{
+			std::mt19937 rng(seed);
+			for (uint64_t seq = 1; seq <= count; ++seq)
+			{
+				Value& v = buffer.GetBack();
+				v.Sequence = seq;
+				v.Data.resize(seq % 64);
+				for (size_t i = 0; i < v.Data.size(); ++i)
+					v.Data[i] = seq * 1000 + i;
+				if (buffer.Publish())
+					++replaced;
+				Jitter(rng);
+			}
+		});
+
+		std::mt19937 rng(seed + 1);
+		uint64_t taken = 0;
+		uint64_t last = 0;
+		while (last < count)
+		{
+			if (!buffer.Acquire())
+			{
+				Jitter(rng);
+				continue;
+			}
+			const Value& v = buffer.GetFront();
+			++taken;
+			Check(v.Sequence > last, "triple buffer order", std::to_string(v.Sequence) + " after " + std::to_string(last));
+			bool whole = v.Data.size() == v.Sequence % 64;
+			for (size_t i = 0; whole && i < v.Data.size(); ++i)
+				whole = v.Data[i] == v.Sequence * 1000 + i;
+			Check(whole, "triple buffer contents", "value " + std::to_string(v.Sequence));
+			last = v.Sequence;
+		}
+		producer.join();
+		Check(!buffer.Acquire(), "triple buffer", "a value left after the last one was taken");
+		Check(taken + replaced == count, "triple buffer count",
+			std::to_string(taken) + " taken + " + std::to_string(replaced) + " replaced of " + std::to_string(count));
+	}
+
+	void RunStress(const BenchConfig& config)
+	{
+		for (int round = 0; round < config.Rounds; ++round)
+		{
+			const uint32_t seed = 1000u + (uint32_t)round;
+			StressTripleBuffer(seed, 20000);
+
+			// Paced, as the app runs: every frame drawn, in order
+			LoopConfig paced;
+			paced.Frames = config.Frames;
+			paced.Jitter = true;
+			paced.InlineEvery = round % 2 ? 0 : 37 + round;
+			paced.ToggleEvery = round % 3 ? 0 : 150 + round;
+			paced.Seed = seed;
+			const LoopResult p = FrameLoop(paced).Run();
+			Check(p.Rendered == (uint64_t)paced.Frames, "paced",
+				std::to_string(p.Rendered) + " of " + std::to_string(paced.Frames) + " frames drawn");
+			Check(p.Stats.Dropped == 0, "paced", std::to_string(p.Stats.Dropped) + " packets dropped");
+			Check(p.Stats.Published == p.Stats.Rendered, "paced",
+				std::to_string(p.Stats.Published) + " published, " + std::to_string(p.Stats.Rendered) + " rendered by the thread");
+
+			// Unpaced: the render side skips what it had no time for
+			LoopConfig unpaced = paced;
+			unpaced.Paced = false;
+			unpaced.InlineEvery = 0;
+			unpaced.ToggleEvery = 0;
+			const LoopResult u = FrameLoop(unpaced).Run();
+			Check(u.Stats.Rendered + u.Stats.Dropped == u.Stats.Published, "unpaced",
+				std::to_string(u.Stats.Rendered) + " rendered + " + std::to_string(u.Stats.Dropped) + " dropped of " +
+				std::to_string(u.Stats.Published));
+
+			// A render error reaches the simulation thread within a frame or two
+			LoopConfig failing = paced;
+			failing.InlineEvery = 0;
+			failing.ToggleEvery = 0;
+			failing.ThrowAt = 50 + (uint64_t)round;
+			FrameLoop loop(failing);
+			const LoopResult f = loop.Run();
+			Check(f.ThrownOn == failing.ThrowAt, "error", "render error not rethrown");
+			Check(loop.GetLastRendered() == failing.ThrowAt - 1, "error",
+				"frame " + std::to_string(loop.GetLastRendered()) + " drawn after the failure");
+			Check(f.FrameMs.size() <= failing.ThrowAt + 1, "error",
+				"rethrown only after frame " + std::to_string(f.FrameMs.size()));
+		}
+		fprintf(stderr, "stress: %d rounds of %d frames, %d failures\n", config.Rounds, config.Frames, gFailures.load());
+	}
+
+	//
+	// Bench
+	//
+
+	struct Sample
+	{
+		std::string Mode;
+		LoopResult Result;
+	};
+
+	Sample Measure(const BenchConfig& config, const char* mode, bool threaded, bool paced)
+	{
+		LoopConfig loop;
+		loop.Frames = config.BenchFrames;
+		loop.Threaded = threaded;
+		loop.Paced = paced;
+		loop.UpdateMs = config.UpdateMs;
+		loop.DrawMs = config.DrawMs;
+		loop.GpuMs = config.GpuMs;
+		Sample sample;
+		sample.Mode = mode;
+		sample.Result = FrameLoop(loop).Run();
+		return sample;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<Sample>& samples)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"FrameHandoff\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"update_ms\": " << config.UpdateMs << ", \"draw_ms\": " << config.DrawMs
+			<< ", \"gpu_ms\": " << config.GpuMs << ", \"frames\": " << config.BenchFrames
+			<< ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"stress_rounds\": " << config.Rounds << ", \"stress_frames\": " << config.Frames
+			<< ", \"stress_failures\": " << gFailures.load() << " },\n";
+		out << "  \"results\": [\n";
+		const double serial = samples.empty() ? 0.0 : samples.front().Result.WallMs;
+		for (size_t s = 0; s < samples.size(); ++s)
+		{
+			const LoopResult& r = samples[s].Result;
+			const double frames = (std::max)(1.0, (double)r.FrameMs.size());
+			const double rendered = (std::max)(1.0, (double)r.Stats.Rendered);
+			out << "    { \"mode\": " << JsonString(samples[s].Mode) << ", \"wall_ms\": " << r.WallMs
+				<< ", \"speedup\": " << (r.WallMs > 0.0 ? serial / r.WallMs : 0.0)
+				<< ", \"fps\": " << (r.WallMs > 0.0 ? 1000.0 * frames / r.WallMs : 0.0)
+				<< ", \"p50_frame_ms\": " << Percentile(r.FrameMs, 0.50) << ", \"p95_frame_ms\": " << Percentile(r.FrameMs, 0.95)
+				<< ", \"rendered\": " << r.Rendered << ", \"dropped\": " << r.Stats.Dropped
+				<< ", \"update_wait_ms_per_frame\": " << r.Stats.SimulationWaitMs / frames
+				<< ", \"render_idle_ms_per_frame\": " << r.Stats.RenderIdleMs / rendered
+				<< ", \"handoff_ms_per_frame\": " << r.Stats.HandoffMs / rendered << " }"
+				<< (s + 1 < samples.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--frames" && hasValue) config.Frames = (std::max)(atoi(argv[++i]), 100);
+			else if (arg == "--rounds" && hasValue) config.Rounds = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--update-ms" && hasValue) config.UpdateMs = (std::max)(atof(argv[++i]), 0.0);
+			else if (arg == "--draw-ms" && hasValue) config.DrawMs = (std::max)(atof(argv[++i]), 0.0);
+			else if (arg == "--gpu-ms" && hasValue) config.GpuMs = (std::max)(atof(argv[++i]), 0.0);
+			else if (arg == "--bench-frames" && hasValue) config.BenchFrames = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--no-bench") config.Bench = false;
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	if (config.Rounds > 0)
+		RunStress(config);
+
+	std::vector<Sample> samples;
+	if (config.Bench)
+	{
+		samples.push_back(Measure(config, "serial", false, true));
+		samples.push_back(Measure(config, "pipelined", true, true));
+		samples.push_back(Measure(config, "unpaced", true, false));
+		for (const Sample& sample : samples)
+			fprintf(stderr, "%-10s %8.1f ms, p50 frame %6.2f ms, %llu drawn, Update waited %6.2f ms/frame\n",
+				sample.Mode.c_str(), sample.Result.WallMs, Percentile(sample.Result.FrameMs, 0.50),
+				(unsigned long long)sample.Result.Rendered,
+				sample.Result.Stats.SimulationWaitMs / (std::max)(1.0, (double)sample.Result.FrameMs.size()));
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, samples);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
@@ -0,0 +1,699 @@
+//***************************************************************************************
+// JobBench.cpp
+//
+// Checks and benchmarks the JobSystem. The stress part runs the scheduler the
+// ways the engine does and a few it should survive - parallel-for over odd
+// sizes and grains, with and without a thread limit, parallel-for nested in
+// jobs, jobs held back by counters, jobs that spawn jobs past a deque's
+// capacity, other threads submitting and waiting - and compares every result
+// with a serial run; a limited parallel-for must also stay on as many threads
+// as it allows. Any difference is a failure and the exit code is 3. Built with -fsanitize=thread it is the
+// scheduler's race test.
+//
+// The scaling part times two engine loops on 1, 2, 4, ... threads:
+//   update_object_cbs  UpdateObjectCBs over bobbing objects, the constants
+//                      copied into a 256-byte element buffer as the app's
+//                      ObjectCB, 64 objects per job
+//   quadtree_subtrees  the terrain quadtree walk (QuadTreeNode::
+//                      UpdateVisibility) split into the subtrees at one
+//                      depth, one job each with its own tile list, the
+//                      lists joined in subtree order
+// Each thread count gets a fresh JobSystem; each sample is --calls calls. The
+// report gives ns per item, the speedup over one thread, what each thread ran
+// and how much was stolen, and a checksum that must match across counts.
+//
+// Needs no GPU or window. Windows: JobBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common JobBench.cpp
+//       -L<dir> -lTerrainCore -o JobBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: JobBench [options]
+//   --threads <a,b,..>  thread counts to time (1, 2, 4, ... up to the hardware)
+//   --objects <n>       objects in update_object_cbs (8192)
+//   --lod <n>           quadtree depth in quadtree_subtrees (8)
+//   --split <n>         depth of the subtrees handed out as jobs (3)
+//   --calls <n>         calls per sample (20)
+//   --reps <n>          samples per thread count (30)
+//   --rounds <n>        stress rounds (200); 0 skips the stress part
+//   --no-bench          stress only
+//   --label <text>      stored in the output, e.g. the commit
+//   --out <file.json>   (stdout)
+//***************************************************************************************
+
+#include "Terrain.h"
+#include "SceneObject.h"
+#include "Camera.h"
+#include "JobSystem.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const float Pi = 3.14159265359f;
+
+	// The app's terrain (TexColumnsApp::InitTerrain)
+	const float WorldSize = 1024.0f;
+	const float HeightScale = 500.0f;
+	const XMFLOAT3 TerrainOffset = XMFLOAT3(0.0f, -100.0f, 0.0f);
+	const int FrameResources = 6;          // gNumFrameResources
+	const size_t ObjectStride = 256;       // d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants))
+
+	struct BenchConfig
+	{
+		std::vector<unsigned> Threads;
+		int Objects = 8192;
+		int Lod = 8;
+		int Split = 3;
+		int Calls = 20;
+		int Reps = 30;
+		int Rounds = 200;
+		bool Bench = true;
+		std::string Label;
+		std::string Out;
+	};
+
+	struct Sample
+	{
+		unsigned Threads;
+		uint64_t Items;                    // per call
+		uint64_t Checksum;
+		std::vector<double> NsPerItem;
+		JobStats Stats;
+	};
+
+	struct KernelResult
+	{
+		std::string Kernel;
+		const char* Item;
+		std::vector<Sample> Samples;
+	};
+
+	void Mix(uint64_t& hash, uint64_t value)
+	{
+		hash = (hash ^ value) * 1099511628211ull;
+	}
+
+	const uint64_t HashSeed = 14695981039346656037ull;
+
+	// Kept alive so the compiler cannot drop a body's result
+	volatile uint64_t gSink = 0;
+
+	//
+	// Stress
+	//
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	uint64_t Value(size_t i)
+	{
+		return (uint64_t)i * 2654435761u % 1000003u;
+	}
+
+	// Every index visited exactly once, and the sums agree
+	void StressParallelFor(JobSystem& jobs, int rounds, uint32_t& random)
+	{
+		for (int round = 0; round < rounds; ++round)
+		{
+			random = random * 1664525u + 1013904223u;
+			const size_t count = (random >> 8) % 100000;
+			const size_t grain = 1 + (random >> 4) % 1000;
+
+			std::vector<uint8_t> visits(count, 0);
+			std::atomic<uint64_t> sum{ 0 };
+			jobs.ParallelFor(count, grain, [&](size_t begin, size_t end)
+			{
+				uint64_t local = 0;
+				for (size_t i = begin; i < end; ++i)
+				{
+					++visits[i];
+					local += Value(i);
+				}
+				sum.fetch_add(local);
+			});
+
+			uint64_t expected = 0;
+			for (size_t i = 0; i < count; ++i)
+				expected += Value(i);
+			const size_t wrong = count - (size_t)std::count(visits.begin(), visits.end(), (uint8_t)1);
+			Check(sum.load() == expected && wrong == 0, "parallel_for",
+				"count " + std::to_string(count) + " grain " + std::to_string(grain) + ": " + std::to_string(wrong) + " indices not visited once");
+		}
+	}
+
+	// A parallel-for limited to a few threads: every index once, and no
+	// more threads than allowed ever inside the body
+	void StressLimited(JobSystem& jobs, int rounds, uint32_t& random)
+	{
+		for (int round = 0; round < (std::max)(rounds / 4, 1); ++round)
+		{
+			random = random * 1664525u + 1013904223u;
+			const size_t count = (random >> 8) % 20000;
+			const size_t grain = 1 + (random >> 4) % 200;
+			const unsigned limit = (random >> 24) % 5;   // 0 = no limit
+
+			std::vector<uint8_t> visits(count, 0);
+			std::mutex lock;
+			std::vector<std::thread::id> threads;
+			jobs.ParallelFor(count, grain, limit, [&](size_t begin, size_t end)
+			{
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					if (std::find(threads.begin(), threads.end(), std::this_thread::get_id()) == threads.end())
+						threads.push_back(std::this_thread::get_id());
+				}
+				for (size_t i = begin; i < end; ++i)
+					++visits[i];
+				// Long enough chunks that sleeping workers wake up and join in
+				std::this_thread::sleep_for(std::chrono::microseconds(20));
+			});
+
+			const size_t wrong = count - (size_t)std::count(visits.begin(), visits.end(), (uint8_t)1);
+			const std::string where = "count " + std::to_string(count) + " grain " + std::to_string(grain) + " limit " + std::to_string(limit);
+			Check(wrong == 0, "limited", where + ": " + std::to_string(wrong) + " indices not visited once");
+			Check(threads.size() <= (limit ? limit : jobs.GetThreadCount()), "limited", where + ": ran on " + std::to_string(threads.size()) + " threads");
+		}
+	}
+
+	// Jobs that wait on parallel-fors of their own
+	void StressNested(JobSystem& jobs, int rounds)
+	{
+		for (int round = 0; round < (std::max)(rounds / 10, 1); ++round)
+		{
+			const size_t outer = 64, inner = 5000;
+			std::vector<uint64_t> sums(outer, 0);
+			jobs.ParallelFor(outer, 1, [&](size_t begin, size_t end)
+			{
+				for (size_t o = begin; o < end; ++o)
+				{
+					std::atomic<uint64_t> sum{ 0 };
+					jobs.ParallelFor(inner, 100, [&](size_t b, size_t e)
+					{
+						uint64_t local = 0;
+						for (size_t i = b; i < e; ++i)
+							local += Value(o * inner + i);
+						sum.fetch_add(local);
+					});
+					sums[o] = sum.load();
+				}
+			});
+
+			for (size_t o = 0; o < outer; ++o)
+			{
+				uint64_t expected = 0;
+				for (size_t i = 0; i < inner; ++i)
+					expected += Value(o * inner + i);
+				Check(sums[o] == expected, "nested", "outer item " + std::to_string(o));
+			}
+		}
+	}
+
+	// Stages of jobs, each held back until the one before is done: every job
+	// of a stage must see all of the previous stage finished
+	void StressDependencies(JobSystem& jobs, int rounds)
+	{
+		const int Stages = 4, PerStage = 50;
+		for (int round = 0; round < (std::max)(rounds / 10, 1); ++round)
+		{
+			JobCounter counters[Stages];
+			std::atomic<int> finished[Stages] = {};
+			std::atomic<int> early{ 0 };
+			for (int stage = 0; stage < Stages; ++stage)
+			{
+				for (int j = 0; j < PerStage; ++j)
+				{
+					jobs.Run([&, stage]()
+					{
+						if (stage > 0 && finished[stage - 1].load() != PerStage)
+							early.fetch_add(1);
+						finished[stage].fetch_add(1);
+					}, &counters[stage], stage > 0 ? &counters[stage - 1] : nullptr);
+				}
+			}
+			jobs.Wait(counters[Stages - 1]);
+			for (int stage = 0; stage < Stages; ++stage)
+				jobs.Wait(counters[stage]);
+
+			Check(early.load() == 0, "dependencies", std::to_string(early.load()) + " jobs ran before the stage they depend on");
+			for (int stage = 0; stage < Stages; ++stage)
+				Check(finished[stage].load() == PerStage, "dependencies", "stage " + std::to_string(stage) + " ran " + std::to_string(finished[stage].load()) + " jobs");
+		}
+	}
+
+	// A binary tree of jobs, each spawning its children onto the same counter;
+	// deep enough that one thread's deque overflows into the shared queue
+	void Spawn(JobSystem& jobs, JobCounter& counter, std::atomic<uint64_t>& leaves, int depth)
+	{
+		if (depth == 0)
+		{
+			leaves.fetch_add(1);
+			return;
+		}
+		for (int child = 0; child < 2; ++child)
+			jobs.Run([&jobs, &counter, &leaves, depth]() { Spawn(jobs, counter, leaves, depth - 1); }, &counter);
+	}
+
+	void StressSpawn(JobSystem& jobs, int rounds)
+	{
+		for (int round = 0; round < (std::max)(rounds / 50, 1); ++round)
+		{
+			JobCounter counter;
+			std::atomic<uint64_t> leaves{ 0 };
+			Spawn(jobs, counter, leaves, 14);
+			jobs.Wait(counter);
+			Check(leaves.load() == (1u << 14), "spawn", std::to_string(leaves.load()) + " leaves");
+
+			// All from one job, past the deque's capacity
+			JobCounter flat;
+			std::atomic<uint64_t> ran{ 0 };
+			jobs.Run([&]()
+			{
+				for (int i = 0; i < 10000; ++i)
+					jobs.Run([&]() { ran.fetch_add(1); }, &flat);
+			}, &flat);
+			jobs.Wait(flat);
+			Check(ran.load() == 10000, "spawn", std::to_string(ran.load()) + " of 10000 flat jobs");
+		}
+	}
+
+	// Threads the system does not own submit through the shared queue and
+	// help out while they wait
+	void StressExternal(JobSystem& jobs, int rounds)
+	{
+		const int Threads = 4;
+		std::vector<uint64_t> sums(Threads, 0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < Threads; ++t)
+		{
+			threads.emplace_back([&, t]()
+			{
+				for (int round = 0; round < (std::max)(rounds / 10, 1); ++round)
+				{
+					JobCounter counter;
+					std::atomic<uint64_t> sum{ 0 };
+					for (int j = 0; j < 100; ++j)
+						jobs.Run([&sum, j]() { sum.fetch_add(Value(j)); }, &counter);
+					jobs.Wait(counter);
+
+					std::atomic<uint64_t> range{ 0 };
+					jobs.ParallelFor(10000, 500, [&](size_t begin, size_t end)
+					{
+						uint64_t local = 0;
+						for (size_t i = begin; i < end; ++i)
+							local += Value(i);
+						range.fetch_add(local);
+					});
+					sums[t] += sum.load() + range.load();
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		uint64_t expected = 0;
+		for (int j = 0; j < 100; ++j)
+			expected += Value(j);
+		for (size_t i = 0; i < 10000; ++i)
+			expected += Value(i);
+		expected *= (std::max)(rounds / 10, 1);
+		for (int t = 0; t < Threads; ++t)
+			Check(sums[t] == expected, "external", "thread " + std::to_string(t));
+	}
+
+	void RunStress(const BenchConfig& config)
+	{
+		// The default size, then more threads than cores so jobs get
+		// preempted halfway
+		const unsigned hardware = (std::max)(1u, std::thread::hardware_concurrency());
+		for (unsigned workers : { JobSystem::HardwareWorkers, hardware * 2 })
+		{
+			JobSystem jobs(workers);
+			uint32_t random = 12345;
+			StressParallelFor(jobs, config.Rounds, random);
+			StressLimited(jobs, config.Rounds, random);
+			StressNested(jobs, config.Rounds);
+			StressDependencies(jobs, config.Rounds);
+			StressSpawn(jobs, config.Rounds);
+			StressExternal(jobs, config.Rounds);
+			const JobStats stats = jobs.GetStats();
+			fprintf(stderr, "stress on %u threads: %llu stolen, %llu sleeps\n", jobs.GetThreadCount(),
+				(unsigned long long)stats.Stolen, (unsigned long long)stats.Sleeps);
+		}
+	}
+
+	//
+	// Scaling
+	//
+
+	// One call does Items units of work and returns a checksum of the result
+	struct Body
+	{
+		uint64_t Items = 1;
+		std::function<uint64_t(JobSystem&)> Run;
+	};
+
+	Body UpdateObjectCBs(const BenchConfig& config)
+	{
+		auto objects = std::make_shared<std::vector<SceneObject>>(config.Objects);
+		auto buffer = std::make_shared<std::vector<uint8_t>>((size_t)config.Objects * ObjectStride);
+		for (int i = 0; i < config.Objects; ++i)
+		{
+			SceneObject& object = (*objects)[i];
+			XMStoreFloat4x4(&object.World, XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixRotationY(0.37f * i) *
+				XMMatrixTranslation(10.0f * (i % 64), 5.0f, 10.0f * (i / 64)));
+			object.Bounds.Center = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			object.Bounds.Extents = XMFLOAT3(1.0f, 1.0f, 1.0f);
+			object.Dynamic = object.Bobbing = true;
+			object.NumFramesDirty = FrameResources;
+			object.ObjCBIndex = i;
+		}
+
+		// The same times on every thread count, so the checksums compare
+		auto frame = std::make_shared<int>(0);
+		Body body;
+		body.Items = objects->size();
+		body.Run = [objects, buffer, frame](JobSystem& jobs)
+		{
+			const float time = (*frame)++ / 60.0f;
+			jobs.ParallelFor(objects->size(), 64, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					SceneObject& object = (*objects)[i];
+					ObjectConstants constants;
+					if (object.UpdateConstants(time, FrameResources, constants))
+						memcpy(buffer->data() + object.ObjCBIndex * ObjectStride, &constants, sizeof(constants));
+				}
+			});
+			uint64_t hash = HashSeed;
+			for (size_t i = 0; i < objects->size(); i += 97)
+			{
+				uint32_t bits;
+				memcpy(&bits, buffer->data() + i * ObjectStride + 7 * sizeof(float), sizeof(bits));
+				Mix(hash, bits);
+			}
+			return hash;
+		};
+		return body;
+	}
+
+	void CollectSubtrees(QuadTreeNode* node, int depth, std::vector<QuadTreeNode*>& roots)
+	{
+		if (node->depth == depth || !node->children[0])
+		{
+			roots.push_back(node);
+			return;
+		}
+		for (auto& child : node->children)
+			if (child)
+				CollectSubtrees(child.get(), depth, roots);
+	}
+
+	Body QuadtreeSubtrees(const BenchConfig& config)
+	{
+		struct State
+		{
+			Terrain Land;
+			std::vector<QuadTreeNode*> Roots;
+			std::vector<std::vector<Tile*>> Tiles; // per subtree
+			std::vector<int> Visited;
+			std::vector<BoundingFrustum> Frustums;
+			std::vector<XMFLOAT3> Positions;
+			size_t Next = 0;
+		};
+		auto state = std::make_shared<State>();
+		state->Land.Initialize(WorldSize, config.Lod, TerrainOffset);
+		state->Land.mHeightScale = HeightScale;
+		CollectSubtrees(state->Land.GetRoot(), config.Split, state->Roots);
+		state->Tiles.resize(state->Roots.size());
+		state->Visited.resize(state->Roots.size());
+
+		// Low cameras on a ring, looking across the centre: most of the tree
+		// is in view and splits deep near the camera
+		for (int i = 0; i < 8; ++i)
+		{
+			const float a = 2.0f * Pi * i / 8;
+			const float cx = TerrainOffset.x + 0.5f * WorldSize, cz = TerrainOffset.z + 0.5f * WorldSize;
+			const XMFLOAT3 position(cx + 0.3f * WorldSize * std::cos(a), TerrainOffset.y + 50.0f, cz + 0.3f * WorldSize * std::sin(a));
+			Camera camera;
+			camera.SetLens(0.4f * Pi, 16.0f / 9.0f, 1.0f, 20000.0f);
+			camera.LookAt(position, XMFLOAT3(cx, TerrainOffset.y, cz), XMFLOAT3(0.0f, 1.0f, 0.0f));
+			camera.UpdateViewMatrix();
+			state->Frustums.push_back(camera.GetFrustum());
+			state->Positions.push_back(position);
+		}
+
+		// Items is nodes visited, which depends on the camera; one pass over
+		// all of them to average it
+		uint64_t visited = 0;
+		for (size_t c = 0; c < state->Frustums.size(); ++c)
+		{
+			for (QuadTreeNode* root : state->Roots)
+			{
+				std::vector<Tile*> tiles;
+				TerrainCullContext context;
+				context.Frustum = &state->Frustums[c];
+				context.CameraPos = state->Positions[c];
+				context.HeightScale = HeightScale;
+				context.MapSize = (int)WorldSize;
+				context.VisibleTiles = &tiles;
+				root->UpdateVisibility(context, true, ViewCullState());
+				visited += context.NodesVisited;
+			}
+		}
+
+		Body body;
+		body.Items = (std::max)((uint64_t)1, visited / state->Frustums.size());
+		body.Run = [state](JobSystem& jobs)
+		{
+			const size_t camera = state->Next++ % state->Frustums.size();
+			jobs.ParallelFor(state->Roots.size(), 1, [&](size_t begin, size_t end)
+			{
+				for (size_t r = begin; r < end; ++r)
+				{
+					state->Tiles[r].clear();
+					TerrainCullContext context;
+					context.Frustum = &state->Frustums[camera];
+					context.CameraPos = state->Positions[camera];
+					context.HeightScale = HeightScale;
+					context.MapSize = (int)WorldSize;
+					context.VisibleTiles = &state->Tiles[r];
+					state->Roots[r]->UpdateVisibility(context, true, ViewCullState());
+					state->Visited[r] = context.NodesVisited;
+				}
+			});
+			uint64_t hash = HashSeed;
+			for (size_t r = 0; r < state->Roots.size(); ++r)
+			{
+				Mix(hash, state->Visited[r]);
+				for (const Tile* tile : state->Tiles[r])
+					Mix(hash, (uint64_t)tile->tileIndex);
+			}
+			return hash;
+		};
+		return body;
+	}
+
+	Sample Measure(const BenchConfig& config, const std::function<Body()>& setup, unsigned threads)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		JobSystem jobs(threads - 1);
+		Body body = setup();
+
+		Sample sample;
+		sample.Threads = jobs.GetThreadCount();
+		sample.Items = body.Items;
+		sample.Checksum = body.Run(jobs); // first call after setup, the same on every count
+		for (int i = 0; i < config.Calls; ++i)
+			gSink = gSink + body.Run(jobs);
+
+		jobs.ResetStats();
+		sample.NsPerItem.reserve(config.Reps);
+		for (int rep = 0; rep < config.Reps; ++rep)
+		{
+			uint64_t sink = 0;
+			const auto start = Clock::now();
+			for (int call = 0; call < config.Calls; ++call)
+				sink += body.Run(jobs);
+			const auto end = Clock::now();
+			gSink = gSink + sink;
+			const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+			sample.NsPerItem.push_back(ns / ((double)config.Calls * sample.Items));
+		}
+		sample.Stats = jobs.GetStats();
+		return sample;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<KernelResult>& results)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"JobBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"objects\": " << config.Objects << ", \"lod\": " << config.Lod << ", \"split\": " << config.Split
+			<< ", \"calls\": " << config.Calls << ", \"reps\": " << config.Reps << ", \"stress_rounds\": " << config.Rounds
+			<< ", \"stress_failures\": " << gFailures << " },\n";
+		out << "  \"results\": [\n";
+		for (size_t k = 0; k < results.size(); ++k)
+		{
+			const KernelResult& r = results[k];
+			const double serial = r.Samples.empty() ? 0.0 : Percentile(r.Samples.front().NsPerItem, 0.50);
+			out << "    {\n";
+			out << "      \"kernel\": " << JsonString(r.Kernel) << ",\n";
+			out << "      \"item\": " << JsonString(r.Item) << ",\n";
+			out << "      \"threads\": [\n";
+			for (size_t s = 0; s < r.Samples.size(); ++s)
+			{
+				const Sample& sample = r.Samples[s];
+				const double p50 = Percentile(sample.NsPerItem, 0.50);
+				const double speedup = p50 > 0.0 ? serial / p50 : 0.0;
+				char checksum[17];
+				snprintf(checksum, sizeof(checksum), "%016llx", (unsigned long long)sample.Checksum);
+
+				uint64_t executed = 0;
+				for (uint64_t count : sample.Stats.Executed)
+					executed += count;
+				out << "        { \"threads\": " << sample.Threads << ", \"items_per_call\": " << sample.Items
+					<< ", \"checksum\": \"" << checksum << "\", \"p50_ns_per_item\": " << p50
+					<< ", \"speedup\": " << speedup << ", \"efficiency\": " << speedup / sample.Threads
+					<< ", \"jobs\": " << executed << ", \"stolen\": " << sample.Stats.Stolen << ", \"sleeps\": " << sample.Stats.Sleeps
+					<< ", \"jobs_per_thread\": [";
+				for (size_t t = 0; t < sample.Stats.Executed.size(); ++t)
+					out << (t ? ", " : "") << sample.Stats.Executed[t];
+				out << "] }" << (s + 1 < r.Samples.size() ? ",\n" : "\n");
+			}
+			out << "      ]\n";
+			out << "    }" << (k + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseThreads(const std::string& text, BenchConfig& config)
+	{
+		std::stringstream list(text);
+		std::string item;
+		while (std::getline(list, item, ','))
+		{
+			const int threads = atoi(item.c_str());
+			if (threads < 1)
+				return false;
+			config.Threads.push_back((unsigned)threads);
+		}
+		return !config.Threads.empty();
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--threads" && hasValue && ParseThreads(argv[++i], config)) {}
+			else if (arg == "--objects" && hasValue) config.Objects = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--lod" && hasValue) config.Lod = (std::min)((std::max)(atoi(argv[++i]), 1), 10);
+			else if (arg == "--split" && hasValue) config.Split = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--calls" && hasValue) config.Calls = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--reps" && hasValue) config.Reps = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--rounds" && hasValue) config.Rounds = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--no-bench") config.Bench = false;
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+	if (config.Threads.empty())
+	{
+		const unsigned hardware = (std::max)(1u, std::thread::hardware_concurrency());
+		for (unsigned threads = 1; threads < hardware; threads *= 2)
+			config.Threads.push_back(threads);
+		config.Threads.push_back(hardware);
+	}
+	std::sort(config.Threads.begin(), config.Threads.end());
+	config.Threads.erase(std::unique(config.Threads.begin(), config.Threads.end()), config.Threads.end());
+
+	if (config.Rounds > 0)
+		RunStress(config);
+
+	std::vector<KernelResult> results;
+	if (config.Bench)
+	{
+		const struct { const char* Name; const char* Item; std::function<Body()> Setup; } kernels[] =
+		{
+			{ "update_object_cbs", "object", [&]() { return UpdateObjectCBs(config); } },
+			{ "quadtree_subtrees", "node", [&]() { return QuadtreeSubtrees(config); } },
+		};
+		for (const auto& kernel : kernels)
+		{
+			KernelResult result;
+			result.Kernel = kernel.Name;
+			result.Item = kernel.Item;
+			for (unsigned threads : config.Threads)
+			{
+				result.Samples.push_back(Measure(config, kernel.Setup, threads));
+				const Sample& sample = result.Samples.back();
+				Check(sample.Checksum == result.Samples.front().Checksum, kernel.Name,
+					"checksum on " + std::to_string(threads) + " threads differs from " + std::to_string(result.Samples.front().Threads));
+				fprintf(stderr, "%-20s %3u threads %10.2f ns/%s\n", kernel.Name, sample.Threads,
+					Percentile(sample.NsPerItem, 0.50), kernel.Item);
+			}
+			results.push_back(std::move(result));
+		}
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, results);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
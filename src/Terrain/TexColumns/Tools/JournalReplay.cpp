@@ -0,0 +1,419 @@
+//***************************************************************************************
+// JournalReplay.cpp
+//
+// Headless replay of an input journal (InputJournal.h) against the CPU side of
+// the app: the camera, terrain selection, and the brush canvas and its undo
+// history. Input goes through the same CameraControls the app uses, and
+// settings are restored by name, so a journal recorded in the app while
+// reproducing a hitch can be replayed here as a benchmark. Reports per-frame
+// cost as JSON, with a hash of the resulting state so runs and builds can be
+// checked for doing the same work.
+//
+// Not replayed: rendering, mesh culling and LODs, texture streaming, and the
+// shadow cascades (the terrain walk here is camera only).
+//
+// Needs no GPU or window. Windows: JournalReplay.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common JournalReplay.cpp
+//       -L<dir> -lTerrainCore -o JournalReplay
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: JournalReplay <file.journal> [options]
+//   --heightmap <file.dds>   terrain heights, as the app loads them (flat)
+//   --size <units>           world size (1024)
+//   --maxlod <n>             quadtree depth (5)
+//   --height-scale <units>   (500)
+//   --canvas <texels>        brush canvas size (1024)
+//   --repeat <n>             replays from the same start (3)
+//   --label <text>           stored in the output, e.g. the commit
+//   --out <file.json>        (stdout)
+//***************************************************************************************
+
+#include "InputJournal.h"
+#include "CameraControls.h"
+#include "Terrain.h"
+#include "HeightField.h"
+#include "PaintLayer.h"
+#include "BrushUndo.h"
+#include "BCEncoder.h"
+#include "BenchReport.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct ReplayConfig
+	{
+		std::string Journal;
+		std::string Heightmap;
+		float Size = 1024.0f;
+		int MaxLod = 5;
+		float HeightScale = 500.0f;
+		XMFLOAT3 Offset = XMFLOAT3(0.0f, -100.0f, 0.0f); // TexColumnsApp::terrainPos
+		int Canvas = 1024;
+		int Repeat = 3;
+		std::string Label;
+		std::string Out;
+	};
+
+	// The app members the journal restores, with their defaults
+	struct ReplaySettings
+	{
+		float HorSpeed = 500.0f;
+		float VertSpeed = 500.0f;
+		int ControlMode = 0;
+		float BrushRadius = 30.0f;
+		float BrushFalloff = 40.0f;
+		XMFLOAT4 BrushColor = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+		bool Horizon = true;
+	};
+
+	struct FrameSample
+	{
+		double Ms;
+		double InputMs;
+		double TerrainMs;
+		double PaintMs;
+		int Tiles;
+		int Nodes;
+	};
+
+	struct ReplayCounts
+	{
+		uint64_t KeyEvents = 0;
+		uint64_t MouseEvents = 0;
+		uint64_t SettingEvents = 0;
+		uint64_t Strokes = 0;
+		uint64_t Stamps = 0;
+		uint64_t Undos = 0;
+		uint64_t Redos = 0;
+		double RecordedSeconds = 0.0;
+	};
+
+	uint64_t Fnv(uint64_t hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	double Ms(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+	{
+		return std::chrono::duration<double, std::milli>(to - from).count();
+	}
+
+	bool ParseArgs(int argc, char** argv, ReplayConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--heightmap" && hasValue) config.Heightmap = argv[++i];
+			else if (arg == "--size" && hasValue) config.Size = (float)atof(argv[++i]);
+			else if (arg == "--maxlod" && hasValue) config.MaxLod = atoi(argv[++i]);
+			else if (arg == "--height-scale" && hasValue) config.HeightScale = (float)atof(argv[++i]);
+			else if (arg == "--canvas" && hasValue) config.Canvas = (std::max)(atoi(argv[++i]), 64);
+			else if (arg == "--repeat" && hasValue) config.Repeat = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else if (arg.compare(0, 2, "--") != 0 && config.Journal.empty()) config.Journal = arg;
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		if (config.Journal.empty())
+		{
+			std::cerr << "Usage: JournalReplay <file.journal> [options]\n";
+			return false;
+		}
+		return true;
+	}
+
+	// One pass over the journal, doing per frame what TexColumnsApp::Update
+	// does with the same input: mouse messages, OnKeyboardInput, UpdateTerrain,
+	// UpdatePaintLayer, then the settings the frame's UI changed.
+	bool Replay(const ReplayConfig& config, Terrain& terrain, std::vector<FrameSample>& samples, ReplayCounts& counts, uint64_t& stateHash, std::string& error)
+	{
+		ReplaySettings settings;
+		InputJournal journal;
+		journal.WatchSetting("camera.speed_h", &settings.HorSpeed);
+		journal.WatchSetting("camera.speed_v", &settings.VertSpeed);
+		journal.WatchSetting("control_mode", &settings.ControlMode);
+		journal.WatchSetting("brush.radius", &settings.BrushRadius);
+		journal.WatchSetting("brush.falloff", &settings.BrushFalloff);
+		journal.WatchSetting("brush.r", &settings.BrushColor.x);
+		journal.WatchSetting("brush.g", &settings.BrushColor.y);
+		journal.WatchSetting("brush.b", &settings.BrushColor.z);
+		journal.WatchSetting("brush.a", &settings.BrushColor.w);
+		journal.WatchSetting("terrain.horizon", &settings.Horizon);
+		if (!journal.StartReplay(config.Journal))
+		{
+			error = journal.GetError();
+			return false;
+		}
+
+		const JournalHeader& header = journal.GetHeader();
+		const int width = (int)(std::max)(header.ClientWidth, 1u);
+		const int height = (int)(std::max)(header.ClientHeight, 1u);
+
+		Camera camera;
+		camera.SetLens(header.FovY, (float)width / height, 1.0f, camera.cameraFarZ);
+		const XMFLOAT3 eye(header.Position[0], header.Position[1], header.Position[2]);
+		const XMFLOAT3 target(eye.x + header.Look[0], eye.y + header.Look[1], eye.z + header.Look[2]);
+		const XMFLOAT3 up(header.Up[0], header.Up[1], header.Up[2]);
+		camera.LookAt(eye, target, up);
+		camera.UpdateViewMatrix();
+
+		// UpdateMainPassCB's inverse view-projection, which ScreenToWorld reads
+		// before the camera moves in a frame
+		auto inverseViewProj = [&camera]()
+		{
+			XMMATRIX viewProj = XMMatrixMultiply(camera.GetView(), camera.GetProj());
+			XMVECTOR det = XMMatrixDeterminant(viewProj);
+			return XMMatrixInverse(&det, viewProj);
+		};
+		XMMATRIX invViewProj = inverseViewProj();
+
+		PaintLayer canvas(config.Canvas, config.Canvas);
+		BrushUndo undo;
+		int lastX = header.MouseX, lastY = header.MouseY;
+		bool painting = false;
+		XMFLOAT3 brushPos(0.0f, 0.0f, 0.0f);
+		bool undoHeld = false, redoHeld = false;
+
+		uint64_t hash = 14695981039346656037ull;
+		JournalFrame frame;
+		samples.clear();
+		samples.reserve(journal.GetFrameCount());
+		counts = ReplayCounts();
+		while (journal.ReadFrame(frame))
+		{
+			counts.RecordedSeconds += frame.Dt;
+			const auto start = std::chrono::steady_clock::now();
+
+			// OnMouseDown / OnMouseUp / OnMouseMove
+			for (const auto& e : frame.Events)
+			{
+				switch (e.Type)
+				{
+				case JournalEventType::MouseDown:
+					++counts.MouseEvents;
+					lastX = e.X;
+					lastY = e.Y;
+					if ((e.Buttons & JournalButtonLeft) && settings.ControlMode == 1 && !e.Captured)
+					{
+						undo.BeginStroke(canvas);
+						++counts.Strokes;
+					}
+					break;
+				case JournalEventType::MouseUp:
+					++counts.MouseEvents;
+					if (undo.IsInStroke())
+						undo.EndStroke(canvas);
+					painting = false;
+					break;
+				case JournalEventType::MouseMove:
+					++counts.MouseEvents;
+					if (e.Captured)
+						break;
+					if (e.Buttons & JournalButtonRight)
+						CameraControls::Look(camera, e.X - lastX, e.Y - lastY);
+					else if (settings.ControlMode == 1)
+					{
+						painting = (e.Buttons & JournalButtonLeft) != 0;
+						XMFLOAT3 hit;
+						if (CameraControls::PickGroundPlane(invViewProj, e.X, e.Y, width, height, hit) &&
+							hit.x >= config.Offset.x && hit.x <= config.Offset.x + config.Size &&
+							hit.z >= config.Offset.z && hit.z <= config.Offset.z + config.Size)
+							brushPos = hit;
+					}
+					lastX = e.X;
+					lastY = e.Y;
+					break;
+				case JournalEventType::KeyDown:
+				case JournalEventType::KeyUp:
+					++counts.KeyEvents;
+					break;
+				case JournalEventType::Setting:
+					++counts.SettingEvents;
+					break;
+				default:
+					break;
+				}
+			}
+
+			// OnKeyboardInput
+			const JournalKeys& keys = journal.GetKeys();
+			CameraControls::Fly(camera, keys, frame.Dt, settings.HorSpeed, settings.VertSpeed);
+			const bool ctrlPressed = keys[JournalKeyControl];
+			const bool undoDown = ctrlPressed && keys['Z'];
+			const bool redoDown = ctrlPressed && keys['Y'];
+			PaintRect restored;
+			if (undoDown && !undoHeld && undo.Undo(canvas, restored))
+			{
+				++counts.Undos;
+				painting = false;
+			}
+			if (redoDown && !redoHeld && undo.Redo(canvas, restored))
+			{
+				++counts.Redos;
+				painting = false;
+			}
+			undoHeld = undoDown;
+			redoHeld = redoDown;
+			camera.UpdateViewMatrix();
+			const auto inputEnd = std::chrono::steady_clock::now();
+
+			// UpdateTerrain
+			terrain.mUseHorizonCulling = settings.Horizon;
+			BoundingFrustum frustum = camera.GetFrustum();
+			terrain.Update(camera.GetPosition3f(), frustum);
+			const auto terrainEnd = std::chrono::steady_clock::now();
+
+			// UpdatePaintLayer
+			const auto& visibleTiles = terrain.GetVisibleTiles();
+			if (painting && !visibleTiles.empty())
+			{
+				const Tile* tile = visibleTiles[0];
+				const float mapSize = terrain.mWorldSize;
+				BrushStamp stamp;
+				stamp.U = (brushPos.x - tile->worldPos.x) / mapSize;
+				stamp.V = (brushPos.z - tile->worldPos.z) / mapSize;
+				stamp.RadiusUV = settings.BrushRadius / mapSize;
+				stamp.FalloffUV = settings.BrushFalloff / mapSize;
+				stamp.Color[0] = settings.BrushColor.x;
+				stamp.Color[1] = settings.BrushColor.y;
+				stamp.Color[2] = settings.BrushColor.z;
+				stamp.Color[3] = settings.BrushColor.w;
+				undo.Paint(canvas, stamp);
+				++counts.Stamps;
+			}
+			const auto end = std::chrono::steady_clock::now();
+
+			invViewProj = inverseViewProj();
+			journal.ApplySettings(frame);
+
+			FrameSample sample;
+			sample.Ms = Ms(start, end);
+			sample.InputMs = Ms(start, inputEnd);
+			sample.TerrainMs = Ms(inputEnd, terrainEnd);
+			sample.PaintMs = Ms(terrainEnd, end);
+			sample.Tiles = (int)visibleTiles.size();
+			sample.Nodes = terrain.mNodesVisited;
+			samples.push_back(sample);
+
+			for (const Tile* tile : visibleTiles)
+				hash = Fnv(hash, &tile->tileIndex, sizeof(tile->tileIndex));
+		}
+
+		const XMFLOAT3 position = camera.GetPosition3f();
+		const XMFLOAT3 look = camera.GetLook3f();
+		hash = Fnv(hash, &position, sizeof(position));
+		hash = Fnv(hash, &look, sizeof(look));
+		for (int y = 0; y < canvas.GetHeight(); ++y)
+		{
+			for (int x = 0; x < canvas.GetWidth(); ++x)
+			{
+				const uint32_t texel = canvas.GetTexel(x, y);
+				hash = Fnv(hash, &texel, sizeof(texel));
+			}
+		}
+		stateHash = hash;
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	ReplayConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	HeightField heights;
+	if (!config.Heightmap.empty())
+	{
+		std::vector<uint8_t> rgba;
+		uint32_t width = 0, height = 0;
+		if (!BCEncoder::LoadDDS(std::filesystem::path(config.Heightmap).wstring(), rgba, width, height))
+		{
+			std::cerr << "Cannot load " << config.Heightmap << "\n";
+			return 1;
+		}
+		heights.Init(rgba.data(), width, height, (size_t)width * 4);
+		heights.SetPlacement(config.Offset.x, config.Offset.z, config.Size, config.Offset.y, config.HeightScale);
+	}
+
+	Terrain terrain;
+	terrain.Initialize(config.Size, config.MaxLod, config.Offset);
+	terrain.mHeightScale = config.HeightScale;
+	terrain.SetHeights(&heights);
+
+	std::ostringstream out;
+	out.precision(6);
+	out << "{\n";
+	out << "  \"benchmark\": \"JournalReplay\",\n";
+	out << "  \"label\": " << JsonString(config.Label) << ",\n";
+	out << "  \"journal\": " << JsonString(config.Journal) << ",\n";
+	out << "  \"config\": { \"heightmap\": " << JsonString(config.Heightmap.empty() ? "flat" : config.Heightmap)
+		<< ", \"size\": " << config.Size << ", \"maxlod\": " << config.MaxLod << ", \"height_scale\": " << config.HeightScale
+		<< ", \"canvas\": " << config.Canvas << " },\n";
+	out << "  \"replays\": [\n";
+
+	for (int run = 0; run < config.Repeat; ++run)
+	{
+		std::vector<FrameSample> samples;
+		ReplayCounts counts;
+		uint64_t stateHash = 0;
+		std::string error;
+		if (!Replay(config, terrain, samples, counts, stateHash, error))
+		{
+			std::cerr << error << "\n";
+			return 1;
+		}
+
+		char hashText[17];
+		snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)stateHash);
+		out << "    {\n";
+		out << "      \"frames\": " << samples.size() << ",\n";
+		out << "      \"recorded_s\": " << counts.RecordedSeconds << ",\n";
+		out << "      \"state_hash\": \"" << hashText << "\",\n";
+		out << "      \"events\": { \"keys\": " << counts.KeyEvents << ", \"mouse\": " << counts.MouseEvents
+			<< ", \"settings\": " << counts.SettingEvents << ", \"strokes\": " << counts.Strokes << ", \"stamps\": " << counts.Stamps
+			<< ", \"undos\": " << counts.Undos << ", \"redos\": " << counts.Redos << " },\n";
+		WriteSummary(out, "frame_ms", samples, [](const FrameSample& s) { return s.Ms; });
+		WriteSummary(out, "input_ms", samples, [](const FrameSample& s) { return s.InputMs; });
+		WriteSummary(out, "terrain_ms", samples, [](const FrameSample& s) { return s.TerrainMs; });
+		WriteSummary(out, "paint_ms", samples, [](const FrameSample& s) { return s.PaintMs; });
+		WriteSummary(out, "nodes_visited", samples, [](const FrameSample& s) { return s.Nodes; });
+		WriteSummary(out, "tiles", samples, [](const FrameSample& s) { return s.Tiles; }, true);
+		out << "    }" << (run + 1 < config.Repeat ? ",\n" : "\n");
+	}
+	out << "  ]\n}\n";
+
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,1003 @@
+//***************************************************************************************
+// MeshBench.cpp
+//
+// Checks and times the two ways a custom mesh reaches BuildCustomMeshGeometry:
+// the Assimp import the app used to run on every launch (MeshCooker::Import:
+// parse the OBJ, triangulate, generate normals and tangents, convert) and the
+// cooked .mesh file it loads now (MeshFileView: map, validate, copy the
+// streams and submesh table out the way BuildCustomMeshGeometry does).
+//
+// Every model is copied into a scratch directory with its material libraries
+// and cooked there. The check part compares the cooked file with a fresh
+// import: submesh and material tables, and every submesh's triangles as a
+// set of corner positions, whatever order the optimizer put them in. A
+// second cook must find the file up to date, a touched source must re-cook,
+// and truncated or foreign files must be refused and cooked again. Any
+// violation is a failure and the exit code is 3.
+//
+// The optimizer checks run MeshOptimizer on small fixed inputs: the FIFO
+// cache simulation must count exactly, welding must merge the corners an
+// OBJ import splits, and a welded grid must come out near the ACMR Tipsify
+// reaches on it. On every cooked model the cache stats must not get worse
+// and the vertices must be shared between triangles; Optimize and
+// GenerateLods limited to 2 threads or on all of them must give the mesh they
+// give on the caller alone.
+//
+// The simplifier checks run MeshSimplifier on grids - welded, split into
+// per-corner vertices the way an OBJ import gives them, and with a UV seam
+// that must not move - and on every submesh of a fresh MeshCooker::Import at
+// the cook's LOD ratios. Each level must be valid, report an error within
+// the bound, and no original vertex may lie further than three times that
+// error from it; the import must lose at least a quarter of its triangles at
+// ratio 0.5. The cooked LOD table must be in order, in range and shrink
+// level by level.
+//
+// The bench part runs both loads --reps times per model and reports the
+// cook (import, weld, optimize, LODs, write) once, with the optimizer stats
+// of that cook. Besides the models given, it
+// writes a synthetic OBJ of --triangles triangles (a few textured grids,
+// like a larger scanned prop) so the comparison does not rest on a small
+// file alone.
+//
+// Needs no GPU or window. Windows: MeshBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) and Assimp on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common
+//       MeshBench.cpp ../MeshCooker.cpp -L<dir> -lTerrainCore -lassimp -o MeshBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: MeshBench [options]
+//   --model <file.obj>   model to load, repeatable (../../Models/maxwell.obj)
+//   --triangles <n>      synthetic model size, 0 to skip it (100000)
+//   --reps <n>           loads per model and path (20)
+//   --label <text>       stored in the output, e.g. the commit
+//   --out <file.json>    (stdout)
+//***************************************************************************************
+
+#include "MeshCooker.h"
+#include "MeshSimplifier.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct BenchConfig
+	{
+		std::vector<std::string> Models;
+		int Triangles = 100000;
+		int Reps = 20;
+		std::string Label;
+		std::string Out;
+	};
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// A model copied into the scratch directory, with its .mesh next to it
+	struct Model
+	{
+		std::string Name;
+		std::filesystem::path Source;
+		std::filesystem::path Cooked;
+		uint64_t SourceBytes = 0;
+	};
+
+	// Copies the OBJ and every .mtl beside it; the source hash covers those
+	bool CopyModel(const std::filesystem::path& source, const std::filesystem::path& dir, Model& model)
+	{
+		std::error_code error;
+		if (!std::filesystem::is_regular_file(source, error))
+			return false;
+		model.Name = source.stem().string();
+		model.Source = dir / source.filename();
+		model.Cooked = dir / (model.Name + ".mesh");
+		std::filesystem::copy_file(source, model.Source, std::filesystem::copy_options::overwrite_existing, error);
+		if (error)
+			return false;
+		for (const auto& entry : std::filesystem::directory_iterator(source.parent_path(), error))
+		{
+			if (entry.path().extension() == ".mtl")
+				std::filesystem::copy_file(entry.path(), dir / entry.path().filename(),
+					std::filesystem::copy_options::overwrite_existing, error);
+		}
+		model.SourceBytes = std::filesystem::file_size(model.Source, error);
+		return true;
+	}
+
+	// Grids of about 16k triangles each, so every object stays within the
+	// 16-bit indices once Assimp has split the corners
+	bool WriteSyntheticModel(const std::filesystem::path& dir, int triangles, Model& model)
+	{
+		const int perObject = 16000;
+		const int objects = (std::max)(1, (triangles + perObject - 1) / perObject);
+		const int side = (std::max)(1, (int)std::sqrt(triangles / (2.0 * objects)));
+
+		model.Name = "synthetic";
+		model.Source = dir / "synthetic.obj";
+		model.Cooked = dir / "synthetic.mesh";
+		{
+			std::ofstream mtl(dir / "synthetic.mtl");
+			for (int o = 0; o < objects; ++o)
+				mtl << "newmtl grid" << o << "\nKd 0.8 0.8 0.8\nmap_Kd grid" << o << ".dds\n\n";
+		}
+
+		std::ofstream obj(model.Source);
+		obj << "mtllib synthetic.mtl\n";
+		int base = 1;
+		for (int o = 0; o < objects; ++o)
+		{
+			obj << "o grid" << o << "\nusemtl grid" << o << "\n";
+			for (int y = 0; y <= side; ++y)
+			{
+				for (int x = 0; x <= side; ++x)
+				{
+					const float u = (float)x / side, v = (float)y / side;
+					const float h = 0.1f * std::sin(6.2831853f * (u + o)) * std::cos(6.2831853f * v);
+					obj << "v " << (u + o * 1.1f) << " " << h << " " << v << "\n";
+					obj << "vt " << u << " " << v << "\n";
+					obj << "vn 0 1 0\n";
+				}
+			}
+			for (int y = 0; y < side; ++y)
+			{
+				for (int x = 0; x < side; ++x)
+				{
+					const int a = base + y * (side + 1) + x, b = a + 1, c = a + side + 1, d = c + 1;
+					obj << "f " << a << "/" << a << "/" << a << " " << c << "/" << c << "/" << c << " " << b << "/" << b << "/" << b << "\n";
+					obj << "f " << b << "/" << b << "/" << b << " " << c << "/" << c << "/" << c << " " << d << "/" << d << "/" << d << "\n";
+				}
+			}
+			base += (side + 1) * (side + 1);
+		}
+		obj.close();
+		if (!obj)
+			return false;
+
+		std::error_code error;
+		model.SourceBytes = std::filesystem::file_size(model.Source, error);
+		return true;
+	}
+
+	// What BuildCustomMeshGeometry takes from the view
+	struct LoadedMesh
+	{
+		std::vector<CookedVertex> Vertices;
+		std::vector<uint16_t> Indices;
+		std::vector<MeshFileSubmesh> Submeshes;
+		std::vector<std::array<std::string, 3>> Materials;   // name, diffuse, normal
+	};
+
+	bool LoadCooked(const std::filesystem::path& file, LoadedMesh& loaded)
+	{
+		MeshFileView view;
+		if (!view.Open(file.wstring()))
+			return false;
+
+		loaded.Materials.clear();
+		for (uint32_t k = 0; k < view.GetMaterialCount(); ++k)
+			loaded.Materials.push_back({ view.GetMaterialName(k), view.GetDiffuseMap(k), view.GetNormalMap(k) });
+		loaded.Vertices.resize(view.GetVertexCount());
+		memcpy(loaded.Vertices.data(), view.GetVertices(), view.GetVertexCount() * sizeof(CookedVertex));
+		loaded.Indices.assign(view.GetIndices(), view.GetIndices() + view.GetIndexCount());
+		loaded.Submeshes.clear();
+		for (uint32_t i = 0; i < view.GetSubmeshCount(); ++i)
+			loaded.Submeshes.push_back(view.GetSubmesh(i));
+		return true;
+	}
+
+	//
+	// Checks
+	//
+
+	// A submesh's triangles as corner positions, each rotated to start at its
+	// smallest corner (winding kept), sorted
+	typedef std::array<float, 9> Triangle;
+
+	std::vector<Triangle> TriangleSet(const CookedVertex* vertices, const uint16_t* indices, uint32_t indexCount)
+	{
+		std::vector<Triangle> set;
+		for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			std::array<std::array<float, 3>, 3> corners;
+			for (int c = 0; c < 3; ++c)
+				for (int k = 0; k < 3; ++k)
+					corners[c][k] = vertices[indices[i + c]].Pos[k];
+			const int first = (int)(std::min_element(corners.begin(), corners.end()) - corners.begin());
+			Triangle t;
+			for (int c = 0; c < 3; ++c)
+				for (int k = 0; k < 3; ++k)
+					t[c * 3 + k] = corners[(first + c) % 3][k];
+			set.push_back(t);
+		}
+		std::sort(set.begin(), set.end());
+		return set;
+	}
+
+	void CheckCookedMatchesImport(const Model& model)
+	{
+		CookedMesh imported;
+		std::string error;
+		if (!MeshCooker::Import(model.Source.string(), imported, error))
+		{
+			Check(false, "import", model.Name + ": " + error);
+			return;
+		}
+		LoadedMesh cooked;
+		if (!LoadCooked(model.Cooked, cooked))
+		{
+			Check(false, "load", model.Name + ": cooked file does not open");
+			return;
+		}
+
+		Check(cooked.Submeshes.size() == imported.Submeshes.size(), "submeshes", model.Name + ": " +
+			std::to_string(cooked.Submeshes.size()) + " cooked, " + std::to_string(imported.Submeshes.size()) + " imported");
+		Check(cooked.Materials.size() == imported.Materials.size(), "materials", model.Name + ": count differs");
+		for (size_t k = 0; k < (std::min)(cooked.Materials.size(), imported.Materials.size()); ++k)
+		{
+			const CookedMaterial& m = imported.Materials[k];
+			Check(cooked.Materials[k] == std::array<std::string, 3>{ m.Name, m.DiffuseMap, m.NormalMap }, "materials",
+				model.Name + ": material " + std::to_string(k) + " differs");
+		}
+
+		for (size_t s = 0; s < (std::min)(cooked.Submeshes.size(), imported.Submeshes.size()); ++s)
+		{
+			const MeshFileSubmesh& c = cooked.Submeshes[s];
+			const CookedSubmesh& i = imported.Submeshes[s];
+			const std::string where = model.Name + " submesh " + std::to_string(s);
+			if (c.BaseVertex + c.VertexCount > cooked.Vertices.size() || c.StartIndex + c.IndexCount > cooked.Indices.size())
+			{
+				Check(false, "ranges", where + " lies outside the streams");
+				continue;
+			}
+			Check(c.MaterialIndex == i.MaterialIndex, "submeshes", where + ": material index differs");
+
+			bool inRange = true;
+			for (uint32_t k = 0; k < c.IndexCount; ++k)
+				inRange &= cooked.Indices[c.StartIndex + k] < c.VertexCount;
+			Check(inRange, "ranges", where + ": index past the submesh vertices");
+			if (!inRange)
+				continue;
+
+			const auto cookedSet = TriangleSet(cooked.Vertices.data() + c.BaseVertex, cooked.Indices.data() + c.StartIndex, c.IndexCount);
+			const auto importSet = TriangleSet(imported.Vertices.data() + i.BaseVertex, imported.Indices.data() + i.StartIndex, i.IndexCount);
+			Check(cookedSet == importSet, "triangles", where + ": " + std::to_string(cookedSet.size()) + " cooked, " +
+				std::to_string(importSet.size()) + " imported, or corners differ");
+		}
+	}
+
+	bool Cook(const Model& model, bool& recooked, MeshOptimizeStats* stats = nullptr)
+	{
+		std::string error;
+		const bool ok = MeshCooker::CookIfStale(model.Source.string(), model.Cooked.wstring(), &recooked, error, stats);
+		Check(ok, "cook", model.Name + ": " + error);
+		return ok;
+	}
+
+	void CheckStaleness(const Model& model)
+	{
+		bool recooked = false;
+		if (Cook(model, recooked))
+			Check(!recooked, "stale", model.Name + ": cooked again although nothing changed");
+
+		// Touching the source (a comment line) changes its hash
+		{
+			std::ofstream source(model.Source, std::ios::app);
+			source << "\n# touched by MeshBench\n";
+		}
+		if (Cook(model, recooked))
+			Check(recooked, "stale", model.Name + ": touched source was not cooked again");
+
+		// Broken cooked files must not open, and the next cook replaces them
+		std::vector<char> good;
+		{
+			std::ifstream in(model.Cooked, std::ios::binary);
+			good.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		}
+		auto writeBroken = [&](const char* what, std::vector<char> bytes)
+		{
+			{
+				std::ofstream out(model.Cooked, std::ios::binary | std::ios::trunc);
+				out.write(bytes.data(), (std::streamsize)bytes.size());
+			}
+			MeshFileView view;
+			Check(!view.Open(model.Cooked.wstring()), "broken", model.Name + ": " + what + " file opened");
+			view.Close();
+			bool again = false;
+			if (Cook(model, again))
+				Check(again, "broken", model.Name + ": " + what + " file was not cooked again");
+		};
+		if (good.size() > sizeof(MeshFileHeader))
+		{
+			writeBroken("empty", {});
+			writeBroken("header-only", std::vector<char>(good.begin(), good.begin() + sizeof(MeshFileHeader)));
+			writeBroken("truncated", std::vector<char>(good.begin(), good.begin() + good.size() / 2));
+			std::vector<char> magic = good;
+			magic[0] ^= 0x20;
+			writeBroken("bad magic", magic);
+			std::vector<char> version = good;
+			version[offsetof(MeshFileHeader, Version)] ^= 0x40;
+			writeBroken("other version", version);
+		}
+		else
+		{
+			Check(false, "broken", model.Name + ": cooked file is too small to corrupt");
+		}
+	}
+
+	VertexCacheStats Analyze(const std::vector<uint16_t>& indices, size_t vertexCount, uint32_t cacheSize)
+	{
+		return MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), vertexCount, cacheSize);
+	}
+
+	void CheckVertexCache()
+	{
+		// A cache of N holds the last N misses
+		const VertexCacheStats repeat = Analyze({ 0, 1, 2, 0, 1, 2 }, 3, 3);
+		Check(repeat.Transforms == 3, "fifo", "triangle drawn twice with a cache of 3: " +
+			std::to_string(repeat.Transforms) + " transforms, expected 3");
+		const VertexCacheStats evicted = Analyze({ 0, 1, 2, 3, 0, 1 }, 4, 3);
+		Check(evicted.Transforms == 6, "fifo", "0 1 2 3 0 1 with a cache of 3: " +
+			std::to_string(evicted.Transforms) + " transforms, expected 6");
+		const VertexCacheStats kept = Analyze({ 0, 1, 2, 3, 0, 1 }, 4, 4);
+		Check(kept.Transforms == 4, "fifo", "0 1 2 3 0 1 with a cache of 4: " +
+			std::to_string(kept.Transforms) + " transforms, expected 4");
+		// Hits do not refresh an entry: 0 is the oldest after 1 2 3 4, so it is out
+		const VertexCacheStats fifo = Analyze({ 0, 1, 0, 2, 3, 4, 0, 5, 6 }, 7, 4);
+		Check(fifo.Transforms == 8, "fifo", "0 1 0 2 3 4 0 5 6 with a cache of 4: " +
+			std::to_string(fifo.Transforms) + " transforms, expected 8");
+	}
+
+	// A side x side quad grid, as an OBJ import gives it (every corner its own
+	// vertex) or welded
+	void MakeGrid(int side, bool split, std::vector<CookedVertex>& vertices, std::vector<uint16_t>& indices)
+	{
+		auto gridVertex = [side](int x, int y)
+		{
+			CookedVertex v = {};
+			v.Pos[0] = (float)x;
+			v.Pos[2] = (float)y;
+			v.Normal[1] = 1.0f;
+			v.TexC[0] = (float)x / side;
+			v.TexC[1] = (float)y / side;
+			v.Tangent[0] = 1.0f;
+			return v;
+		};
+
+		vertices.clear();
+		indices.clear();
+		if (!split)
+		{
+			for (int y = 0; y <= side; ++y)
+				for (int x = 0; x <= side; ++x)
+					vertices.push_back(gridVertex(x, y));
+		}
+		auto corner = [&](int x, int y)
+		{
+			if (split)
+			{
+				indices.push_back((uint16_t)vertices.size());
+				vertices.push_back(gridVertex(x, y));
+			}
+			else
+			{
+				indices.push_back((uint16_t)(y * (side + 1) + x));
+			}
+		};
+		for (int y = 0; y < side; ++y)
+		{
+			for (int x = 0; x < side; ++x)
+			{
+				corner(x, y); corner(x, y + 1); corner(x + 1, y);
+				corner(x + 1, y); corner(x, y + 1); corner(x + 1, y + 1);
+			}
+		}
+	}
+
+	void CheckWeldAndOptimize()
+	{
+		const int side = 32;
+		std::vector<CookedVertex> split, welded;
+		std::vector<uint16_t> splitIndices, weldedIndices;
+		MakeGrid(side, true, split, splitIndices);
+		MakeGrid(side, false, welded, weldedIndices);
+
+		const std::vector<CookedVertex> original = split;
+		const size_t count = MeshOptimizer::WeldVertices(split, splitIndices.data(), splitIndices.size());
+		Check(count == welded.size(), "weld", std::to_string(side) + "x" + std::to_string(side) + " grid: " +
+			std::to_string(count) + " vertices after welding, expected " + std::to_string(welded.size()));
+		bool same = true;
+		for (size_t i = 0; i < splitIndices.size(); ++i)
+			same &= memcmp(&split[splitIndices[i]], &original[i], sizeof(CookedVertex)) == 0;
+		Check(same, "weld", "a welded corner differs from the corner it replaced");
+
+		// One differing attribute (a UV seam) keeps its own vertex
+		std::vector<CookedVertex> seam = { original[0], original[0], original[1] };
+		seam[1].TexC[0] += 0.5f;
+		std::vector<uint16_t> seamIndices = { 0, 1, 2, 1, 0, 2 };
+		Check(MeshOptimizer::WeldVertices(seam, seamIndices.data(), seamIndices.size()) == 3, "weld",
+			"vertices with different UVs were merged");
+
+		// Tipsify on a welded grid: about 0.65-0.7 transforms per triangle with
+		// a 16-entry cache, 1 for the row order the grid starts in
+		CookedMesh mesh;
+		mesh.Vertices = original;
+		mesh.Indices.assign(splitIndices.size(), 0);
+		for (size_t i = 0; i < mesh.Indices.size(); ++i)
+			mesh.Indices[i] = (uint16_t)i;
+		CookedSubmesh sm;
+		sm.IndexCount = (uint32_t)mesh.Indices.size();
+		sm.VertexCount = (uint32_t)mesh.Vertices.size();
+		mesh.Submeshes.push_back(sm);
+		MeshOptimizeStats stats;
+		MeshOptimizer::Optimize(mesh, &stats, 1);
+		Check(stats.WeldedVertices == original.size() - welded.size(), "optimize",
+			std::to_string(stats.WeldedVertices) + " vertices welded, expected " + std::to_string(original.size() - welded.size()));
+		Check(mesh.Vertices.size() == welded.size(), "optimize", std::to_string(mesh.Vertices.size()) +
+			" vertices after Optimize, expected " + std::to_string(welded.size()));
+		Check(stats.After.ACMR < 0.75f && stats.After.ACMR <= stats.Before.ACMR, "optimize", "grid ACMR " +
+			std::to_string(stats.Before.ACMR) + " -> " + std::to_string(stats.After.ACMR) + ", expected below 0.75");
+	}
+
+	void CheckCookStats(const std::string& name, const MeshOptimizeStats& stats)
+	{
+		Check(stats.After.Triangles == stats.Before.Triangles, "cook stats", name + ": triangle count changed");
+		Check(stats.After.ACMR <= stats.Before.ACMR + 1e-4f, "cook stats", name + ": ACMR " +
+			std::to_string(stats.Before.ACMR) + " -> " + std::to_string(stats.After.ACMR));
+		Check(stats.After.Vertices < 3 * stats.After.Triangles, "cook stats", name + ": " +
+			std::to_string(stats.After.Vertices) + " vertices for " + std::to_string(stats.After.Triangles) +
+			" triangles, nothing shared");
+	}
+
+	// The LOD ratios and error bound MeshCooker cooks with
+	const float LodRatios[] = { 0.5f, 0.25f, 0.125f };
+	const float LodMaxError = 0.05f;
+
+	double PointTriangleDistance(const float* p, const float* a, const float* b, const float* c)
+	{
+		// Closest point by region (Ericson, Real-Time Collision Detection 5.1.5)
+		auto sub = [](const float* x, const float* y, double* r) { for (int k = 0; k < 3; ++k) r[k] = (double)x[k] - y[k]; };
+		auto dot = [](const double* x, const double* y) { return x[0] * y[0] + x[1] * y[1] + x[2] * y[2]; };
+		double ab[3], ac[3], ap[3], bp[3], cp[3];
+		sub(b, a, ab); sub(c, a, ac); sub(p, a, ap); sub(p, b, bp); sub(p, c, cp);
+		const double d1 = dot(ab, ap), d2 = dot(ac, ap);
+		const double d3 = dot(ab, bp), d4 = dot(ac, bp);
+		const double d5 = dot(ab, cp), d6 = dot(ac, cp);
+		const double va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+
+		double v = 0.0, w = 0.0;
+		if (d1 <= 0.0 && d2 <= 0.0) { v = 0.0; w = 0.0; }
+		else if (d3 >= 0.0 && d4 <= d3) { v = 1.0; w = 0.0; }
+		else if (d6 >= 0.0 && d5 <= d6) { v = 0.0; w = 1.0; }
+		else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) { v = d1 / (d1 - d3); w = 0.0; }
+		else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) { v = 0.0; w = d2 / (d2 - d6); }
+		else if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0) { w = (d4 - d3) / ((d4 - d3) + (d5 - d6)); v = 1.0 - w; }
+		else
+		{
+			const double denom = 1.0 / (va + vb + vc);
+			v = vb * denom;
+			w = vc * denom;
+		}
+		double d[3];
+		for (int k = 0; k < 3; ++k)
+			d[k] = ap[k] - v * ab[k] - w * ac[k];
+		return std::sqrt(dot(d, d));
+	}
+
+	// How far the original surface lies from the LOD, relative to the extent
+	// Simplify scales its error by: the largest distance from a sample of the
+	// original vertices to the nearest LOD triangle
+	double MeasureDeviation(const CookedVertex* vertices, const uint16_t* indices, size_t indexCount,
+		const std::vector<uint16_t>& lod)
+	{
+		float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				lo[k] = (std::min)(lo[k], vertices[indices[i]].Pos[k]);
+				hi[k] = (std::max)(hi[k], vertices[indices[i]].Pos[k]);
+			}
+		}
+		const double extent = std::sqrt((double)(hi[0] - lo[0]) * (hi[0] - lo[0]) +
+			(double)(hi[1] - lo[1]) * (hi[1] - lo[1]) + (double)(hi[2] - lo[2]) * (hi[2] - lo[2]));
+		if (extent <= 0.0 || lod.empty())
+			return 0.0;
+
+		const size_t stride = (std::max<size_t>)(1, indexCount / 2000);
+		double worst = 0.0;
+		for (size_t i = 0; i < indexCount; i += stride)
+		{
+			const float* p = vertices[indices[i]].Pos;
+			double nearest = DBL_MAX;
+			for (size_t t = 0; t + 2 < lod.size() && nearest > 0.0; t += 3)
+				nearest = (std::min)(nearest, PointTriangleDistance(p, vertices[lod[t]].Pos, vertices[lod[t + 1]].Pos, vertices[lod[t + 2]].Pos));
+			worst = (std::max)(worst, nearest);
+		}
+		return worst / extent;
+	}
+
+	// Checks one Simplify result; returns the triangles it kept
+	size_t CheckLod(const std::string& where, const CookedVertex* vertices, size_t vertexCount,
+		const uint16_t* indices, size_t indexCount, const std::vector<uint16_t>& lod, float error, float maxError)
+	{
+		bool valid = lod.size() % 3 == 0;
+		bool degenerate = false;
+		for (size_t t = 0; t + 2 < lod.size(); t += 3)
+		{
+			valid &= lod[t] < vertexCount && lod[t + 1] < vertexCount && lod[t + 2] < vertexCount;
+			degenerate |= lod[t] == lod[t + 1] || lod[t + 1] == lod[t + 2] || lod[t] == lod[t + 2];
+		}
+		Check(valid, "simplify", where + ": index past the vertices");
+		Check(!degenerate, "simplify", where + ": degenerate triangle left in");
+		Check(error <= maxError + 1e-4f, "simplify", where + ": error " + std::to_string(error) +
+			" above the bound " + std::to_string(maxError));
+		if (!valid)
+			return lod.size() / 3;
+
+		// The quadric error is an area-weighted mean square, so single points
+		// lie further out than it says: 2-2.5 times on maxwell
+		const double deviation = MeasureDeviation(vertices, indices, indexCount, lod);
+		Check(deviation <= 3.0 * error + 1e-4, "simplify", where + ": surface moved by " + std::to_string(deviation) +
+			" of the extent, error reported " + std::to_string(error));
+		return lod.size() / 3;
+	}
+
+	void CheckSimplifyGrids()
+	{
+		// A flat grid costs nothing to simplify, welded or as an OBJ import
+		// splits it, so both must reach the target
+		const int side = 32;
+		for (bool split : { false, true })
+		{
+			std::vector<CookedVertex> vertices;
+			std::vector<uint16_t> indices, lod;
+			MakeGrid(side, split, vertices, indices);
+			const size_t target = indices.size() / 4;
+			const std::string where = std::string(split ? "split" : "welded") + " grid";
+			const float error = MeshSimplifier::Simplify(vertices.data(), vertices.size(), indices.data(), indices.size(),
+				target, LodMaxError, lod);
+			CheckLod(where, vertices.data(), vertices.size(), indices.data(), indices.size(), lod, error, LodMaxError);
+			Check(lod.size() <= target, "simplify", where + ": " + std::to_string(lod.size() / 3) +
+				" triangles left, target " + std::to_string(target / 3));
+		}
+
+		// A UV seam down the middle: the right half gets its own copies of the
+		// seam column, which must all stay where they are
+		std::vector<CookedVertex> vertices;
+		std::vector<uint16_t> indices, lod;
+		MakeGrid(side, false, vertices, indices);
+		const int seamX = side / 2;
+		std::vector<uint16_t> seamCopy(vertices.size(), 0);
+		for (int y = 0; y <= side; ++y)
+		{
+			const uint16_t v = (uint16_t)(y * (side + 1) + seamX);
+			CookedVertex copy = vertices[v];
+			copy.TexC[0] += 1.0f;
+			seamCopy[v] = (uint16_t)vertices.size();
+			vertices.push_back(copy);
+		}
+		for (size_t t = 0; t < indices.size(); t += 3)
+		{
+			float centre = 0.0f;
+			for (int c = 0; c < 3; ++c)
+				centre += vertices[indices[t + c]].Pos[0] / 3.0f;
+			if (centre > seamX)
+				for (int c = 0; c < 3; ++c)
+					if ((int)vertices[indices[t + c]].Pos[0] == seamX)
+						indices[t + c] = seamCopy[indices[t + c]];
+		}
+		const float error = MeshSimplifier::Simplify(vertices.data(), vertices.size(), indices.data(), indices.size(),
+			indices.size() / 4, LodMaxError, lod);
+		CheckLod("seam grid", vertices.data(), vertices.size(), indices.data(), indices.size(), lod, error, LodMaxError);
+		std::vector<uint8_t> kept(vertices.size(), 0);
+		for (uint16_t i : lod)
+			kept[i] = 1;
+		int lost = 0;
+		for (int y = 0; y <= side; ++y)
+		{
+			const uint16_t v = (uint16_t)(y * (side + 1) + seamX);
+			lost += !kept[v] + !kept[seamCopy[v]];
+		}
+		Check(lost == 0, "simplify", "seam grid: " + std::to_string(lost) + " seam vertices collapsed");
+		Check(lod.size() < indices.size() / 2, "simplify", "seam grid: only " +
+			std::to_string(indices.size() / 3 - lod.size() / 3) + " triangles removed");
+	}
+
+	// Simplify on every submesh of a fresh import, at the cook's ratios: each
+	// level valid and within the error bound. Returns the triangles per ratio.
+	std::vector<size_t> CheckSimplifyImport(const Model& model)
+	{
+		std::vector<size_t> triangles(std::size(LodRatios), 0);
+		CookedMesh mesh;
+		std::string error;
+		if (!MeshCooker::Import(model.Source.string(), mesh, error))
+		{
+			Check(false, "import", model.Name + ": " + error);
+			return triangles;
+		}
+
+		size_t original = 0;
+		for (size_t s = 0; s < mesh.Submeshes.size(); ++s)
+		{
+			const CookedSubmesh& sm = mesh.Submeshes[s];
+			const CookedVertex* vertices = mesh.Vertices.data() + sm.BaseVertex;
+			const uint16_t* indices = mesh.Indices.data() + sm.StartIndex;
+			original += sm.IndexCount / 3;
+			for (size_t r = 0; r < std::size(LodRatios); ++r)
+			{
+				const size_t target = (std::max<size_t>)(3, (size_t)(sm.IndexCount / 3 * LodRatios[r]) * 3);
+				std::vector<uint16_t> lod;
+				const float lodError = MeshSimplifier::Simplify(vertices, sm.VertexCount, indices, sm.IndexCount,
+					target, LodMaxError, lod);
+				triangles[r] += CheckLod(model.Name + " submesh " + std::to_string(s) + " at " + std::to_string(LodRatios[r]),
+					vertices, sm.VertexCount, indices, sm.IndexCount, lod, lodError, LodMaxError);
+			}
+		}
+
+		// Seams and borders stop some collapses, but half the triangles must go
+		Check(original > 0 && triangles[0] <= original * 3 / 4, "simplify", model.Name + ": " +
+			std::to_string(triangles[0]) + " of " + std::to_string(original) + " triangles left at ratio 0.5");
+		return triangles;
+	}
+
+	bool SameStreams(const CookedMesh& a, const CookedMesh& b)
+	{
+		if (a.Vertices.size() != b.Vertices.size() || a.Indices != b.Indices || a.Submeshes.size() != b.Submeshes.size())
+			return false;
+		if (!a.Vertices.empty() && memcmp(a.Vertices.data(), b.Vertices.data(), a.Vertices.size() * sizeof(CookedVertex)) != 0)
+			return false;
+		for (size_t s = 0; s < a.Submeshes.size(); ++s)
+		{
+			const CookedSubmesh& x = a.Submeshes[s];
+			const CookedSubmesh& y = b.Submeshes[s];
+			if (x.IndexCount != y.IndexCount || x.StartIndex != y.StartIndex || x.BaseVertex != y.BaseVertex ||
+				x.VertexCount != y.VertexCount || x.MaterialIndex != y.MaterialIndex)
+				return false;
+		}
+		if (a.Lods.size() != b.Lods.size())
+			return false;
+		for (size_t l = 0; l < a.Lods.size(); ++l)
+		{
+			const CookedLod& x = a.Lods[l];
+			const CookedLod& y = b.Lods[l];
+			if (x.Submesh != y.Submesh || x.Level != y.Level || x.StartIndex != y.StartIndex || x.IndexCount != y.IndexCount ||
+				x.Error != y.Error)
+				return false;
+		}
+		return true;
+	}
+
+	// The cook steps limited to 2 threads, or on all of the JobSystem's,
+	// must give the same mesh as on the caller alone
+	void CheckThreadCounts(const Model& model)
+	{
+		CookedMesh imported;
+		std::string error;
+		if (!MeshCooker::Import(model.Source.string(), imported, error))
+		{
+			Check(false, "import", model.Name + ": " + error);
+			return;
+		}
+
+		CookedMesh serial = imported;
+		MeshOptimizer::Optimize(serial, nullptr, 1);
+		for (unsigned threads : { 2u, 0u })
+		{
+			CookedMesh mesh = imported;
+			MeshOptimizer::Optimize(mesh, nullptr, threads);
+			Check(SameStreams(mesh, serial), "threads", model.Name + ": Optimize on " + std::to_string(threads) +
+				" threads differs from the caller alone");
+		}
+
+		MeshSimplifier::GenerateLods(serial, std::vector<float>(std::begin(LodRatios), std::end(LodRatios)), LodMaxError, 1);
+		for (unsigned threads : { 2u, 0u })
+		{
+			CookedMesh mesh = imported;
+			MeshOptimizer::Optimize(mesh, nullptr, 1);
+			MeshSimplifier::GenerateLods(mesh, std::vector<float>(std::begin(LodRatios), std::end(LodRatios)), LodMaxError, threads);
+			Check(SameStreams(mesh, serial), "threads", model.Name + ": GenerateLods on " + std::to_string(threads) +
+				" threads differs from the caller alone");
+		}
+	}
+
+	// The LOD table of a cooked file: levels in order per submesh, each
+	// smaller than the one before, in range and within the error bound
+	void CheckCookedLods(const Model& model)
+	{
+		MeshFileView view;
+		if (!view.Open(model.Cooked.wstring()))
+		{
+			Check(false, "lods", model.Name + ": cooked file does not open");
+			return;
+		}
+		Check(view.GetLodCount() > 0, "lods", model.Name + ": no LODs cooked");
+
+		uint32_t submesh = UINT32_MAX, level = 0, previousCount = 0;
+		for (uint32_t l = 0; l < view.GetLodCount(); ++l)
+		{
+			const MeshFileLod& lod = view.GetLod(l);
+			if (lod.Submesh >= view.GetSubmeshCount() || lod.StartIndex + lod.IndexCount > view.GetIndexCount())
+			{
+				Check(false, "lods", model.Name + ": LOD " + std::to_string(l) + " lies outside the streams");
+				continue;
+			}
+			const MeshFileSubmesh& sm = view.GetSubmesh(lod.Submesh);
+			if (lod.Submesh != submesh)
+			{
+				Check(submesh == UINT32_MAX || lod.Submesh > submesh, "lods", model.Name + ": LODs not sorted by submesh");
+				submesh = lod.Submesh;
+				level = 0;
+				previousCount = sm.IndexCount;
+			}
+			const std::string where = model.Name + " submesh " + std::to_string(lod.Submesh) + " level " + std::to_string(lod.Level);
+			Check(lod.Level == level + 1, "lods", where + ": expected level " + std::to_string(level + 1));
+			Check(lod.IndexCount % 3 == 0 && lod.IndexCount < previousCount, "lods", where + ": " +
+				std::to_string(lod.IndexCount) + " indices, the level before has " + std::to_string(previousCount));
+			Check(lod.Error <= LodMaxError + 1e-4f, "lods", where + ": error " + std::to_string(lod.Error));
+			bool inRange = true;
+			for (uint32_t k = 0; k < lod.IndexCount; ++k)
+				inRange &= view.GetIndices()[lod.StartIndex + k] < sm.VertexCount;
+			Check(inRange, "lods", where + ": index past the submesh vertices");
+			level = lod.Level;
+			previousCount = lod.IndexCount;
+		}
+	}
+
+	//
+	// Bench
+	//
+
+	struct Sample
+	{
+		std::string Model;
+		uint64_t SourceBytes = 0;
+		uint64_t CookedBytes = 0;
+		uint32_t Vertices = 0;         // cooked
+		uint32_t Indices = 0;          // cooked, LOD ranges included
+		uint32_t Submeshes = 0;
+		double CookMs = 0.0;
+		MeshOptimizeStats Optimize;    // of the cook above
+		std::vector<uint32_t> LodTriangles;   // cooked, per level over all submeshes
+		std::vector<float> LodErrors;         // cooked, largest per level
+		std::vector<double> AssimpMs;
+		std::vector<double> CookedMs;
+	};
+
+	Sample Measure(const BenchConfig& config, const Model& model)
+	{
+		Sample sample;
+		sample.Model = model.Name;
+		sample.SourceBytes = model.SourceBytes;
+
+		std::error_code error;
+		std::filesystem::remove(model.Cooked, error);
+		auto start = std::chrono::steady_clock::now();
+		bool recooked = false;
+		if (Cook(model, recooked, &sample.Optimize))
+			CheckCookStats(model.Name, sample.Optimize);
+		sample.CookMs = MsSince(start);
+		sample.CookedBytes = std::filesystem::file_size(model.Cooked, error);
+
+		for (int rep = 0; rep < config.Reps; ++rep)
+		{
+			CookedMesh imported;
+			std::string message;
+			start = std::chrono::steady_clock::now();
+			const bool ok = MeshCooker::Import(model.Source.string(), imported, message);
+			sample.AssimpMs.push_back(MsSince(start));
+			if (rep == 0)
+				Check(ok, "bench", model.Name + ": " + message);
+
+			LoadedMesh loaded;
+			start = std::chrono::steady_clock::now();
+			const bool loadedOk = LoadCooked(model.Cooked, loaded);
+			sample.CookedMs.push_back(MsSince(start));
+			if (rep == 0)
+			{
+				Check(loadedOk, "bench", model.Name + ": cooked file does not open");
+				sample.Vertices = (uint32_t)loaded.Vertices.size();
+				sample.Indices = (uint32_t)loaded.Indices.size();
+				sample.Submeshes = (uint32_t)loaded.Submeshes.size();
+			}
+		}
+
+		MeshFileView view;
+		if (view.Open(model.Cooked.wstring()))
+		{
+			for (uint32_t l = 0; l < view.GetLodCount(); ++l)
+			{
+				const MeshFileLod& lod = view.GetLod(l);
+				if (lod.Level == 0)
+					continue;
+				if (sample.LodTriangles.size() < lod.Level)
+				{
+					sample.LodTriangles.resize(lod.Level, 0);
+					sample.LodErrors.resize(lod.Level, 0.0f);
+				}
+				sample.LodTriangles[lod.Level - 1] += lod.IndexCount / 3;
+				sample.LodErrors[lod.Level - 1] = (std::max)(sample.LodErrors[lod.Level - 1], lod.Error);
+			}
+		}
+		return sample;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<Sample>& samples)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"MeshBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"models\": " << samples.size() << ", \"triangles\": " << config.Triangles
+			<< ", \"reps\": " << config.Reps << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"failures\": " << gFailures << " },\n";
+		out << "  \"results\": [\n";
+		for (size_t s = 0; s < samples.size(); ++s)
+		{
+			const Sample& sample = samples[s];
+			const double assimpMs = Percentile(sample.AssimpMs, 0.50);
+			const double cookedMs = Percentile(sample.CookedMs, 0.50);
+			out << "    {\n";
+			out << "      \"model\": " << JsonString(sample.Model) << ", \"source_bytes\": " << sample.SourceBytes
+				<< ", \"cooked_bytes\": " << sample.CookedBytes << ", \"vertices\": " << sample.Vertices
+				<< ", \"indices\": " << sample.Indices << ", \"submeshes\": " << sample.Submeshes
+				<< ", \"cook_ms\": " << sample.CookMs << ", \"speedup\": " << (cookedMs > 0.0 ? assimpMs / cookedMs : 0.0) << ",\n";
+			const MeshOptimizeStats& o = sample.Optimize;
+			out << "      \"optimize\": { \"ms\": " << o.Milliseconds << ", \"welded_vertices\": " << o.WeldedVertices
+				<< ", \"removed_vertices\": " << o.RemovedVertices << ", \"clusters\": " << o.Clusters
+				<< ", \"acmr_before\": " << o.Before.ACMR << ", \"acmr_after\": " << o.After.ACMR
+				<< ", \"atvr_before\": " << o.Before.ATVR << ", \"atvr_after\": " << o.After.ATVR << " },\n";
+			out << "      \"lods\": [";
+			for (size_t l = 0; l < sample.LodTriangles.size(); ++l)
+				out << (l ? ", " : " ") << "{ \"level\": " << l + 1 << ", \"triangles\": " << sample.LodTriangles[l]
+					<< ", \"error\": " << sample.LodErrors[l] << " }";
+			out << (sample.LodTriangles.empty() ? "],\n" : " ],\n");
+			WriteSummary(out, "assimp_ms", sample.AssimpMs, [](double v) { return v; });
+			WriteSummary(out, "cooked_ms", sample.CookedMs, [](double v) { return v; }, true);
+			out << "    }" << (s + 1 < samples.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--model" && hasValue) config.Models.push_back(argv[++i]);
+			else if (arg == "--triangles" && hasValue) config.Triangles = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--reps" && hasValue) config.Reps = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+	if (config.Models.empty())
+		config.Models.push_back("../../Models/maxwell.obj");
+
+	std::error_code error;
+	const std::filesystem::path scratch = std::filesystem::temp_directory_path(error) / "MeshBench";
+	std::vector<Model> models;
+	for (const std::string& file : config.Models)
+	{
+		// One directory per model, so material libraries of the same name do not collide
+		const std::filesystem::path dir = scratch / std::to_string(models.size());
+		std::filesystem::create_directories(dir, error);
+		Model model;
+		if (!CopyModel(file, dir, model))
+		{
+			std::cerr << "Cannot read " << file << "\n";
+			return 2;
+		}
+		models.push_back(model);
+	}
+	if (config.Triangles > 0)
+	{
+		const std::filesystem::path dir = scratch / "synthetic";
+		std::filesystem::create_directories(dir, error);
+		Model model;
+		if (!WriteSyntheticModel(dir, config.Triangles, model))
+		{
+			std::cerr << "Cannot write the synthetic model under " << dir.string() << "\n";
+			return 1;
+		}
+		models.push_back(model);
+	}
+
+	CheckVertexCache();
+	CheckWeldAndOptimize();
+	CheckSimplifyGrids();
+	for (const Model& model : models)
+	{
+		bool recooked = false;
+		if (!Cook(model, recooked))
+			continue;
+		CheckCookedMatchesImport(model);
+		CheckCookedLods(model);
+		CheckThreadCounts(model);
+		const std::vector<size_t> triangles = CheckSimplifyImport(model);
+		fprintf(stderr, "%-10s simplified from the import: %zu / %zu / %zu triangles at %.3g / %.3g / %.3g\n",
+			model.Name.c_str(), triangles[0], triangles[1], triangles[2], LodRatios[0], LodRatios[1], LodRatios[2]);
+		CheckStaleness(model);
+	}
+
+	std::vector<Sample> samples;
+	for (const Model& model : models)
+	{
+		samples.push_back(Measure(config, model));
+		const Sample& s = samples.back();
+		const double assimpMs = Percentile(s.AssimpMs, 0.50);
+		const double cookedMs = Percentile(s.CookedMs, 0.50);
+		fprintf(stderr, "%-10s %7.1f KB obj, %7.1f KB mesh: assimp %8.3f ms, cooked %7.3f ms (%5.1fx), cook %8.2f ms\n",
+			s.Model.c_str(), s.SourceBytes / 1024.0, s.CookedBytes / 1024.0, assimpMs, cookedMs,
+			cookedMs > 0.0 ? assimpMs / cookedMs : 0.0, s.CookMs);
+		fprintf(stderr, "%-10s %u vertices welded, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u clusters\n", "",
+			s.Optimize.WeldedVertices, s.Optimize.Before.ACMR, s.Optimize.After.ACMR,
+			s.Optimize.Before.ATVR, s.Optimize.After.ATVR, s.Optimize.Clusters);
+		for (size_t l = 0; l < s.LodTriangles.size(); ++l)
+			fprintf(stderr, "%-10s LOD %zu: %u triangles, error %.4f\n", "", l + 1, s.LodTriangles[l], s.LodErrors[l]);
+	}
+	std::filesystem::remove_all(scratch, error);
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, samples);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
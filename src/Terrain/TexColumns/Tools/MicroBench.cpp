@@ -0,0 +1,728 @@
+//***************************************************************************************
+// MicroBench.cpp
+//
+// Micro-benchmarks of the terrain and math hot paths, one kernel at a time:
+// the pieces TerrainBench and JournalReplay only see as part of a frame. Each
+// kernel runs at a few sizes; for each size it is warmed up, calibrated so one
+// sample lasts --sample-ms, then timed for --reps samples. The report gives
+// the cost per item (box, node, tile, ...) as mean/min/p50/p95/p99/max and a
+// standard deviation, and a checksum of what the kernel computed so two
+// builds can be checked for doing the same work.
+//
+// Given a report from an earlier run (--baseline), every kernel and size in
+// both is compared by p50; one slower by more than --threshold percent is a
+// regression and the exit code is 3.
+//
+// Needs no GPU or window. Windows: MicroBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common MicroBench.cpp
+//       -L<dir> -lTerrainCore -o MicroBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: MicroBench [options]
+//   --list                   print the kernels and their default sizes
+//   --filter <text>          only kernels whose name contains text; repeatable
+//   --sizes <kernel=a,b,..>  sizes for one kernel; repeatable
+//   --warmup-ms <ms>         untimed run before each size (100)
+//   --sample-ms <ms>         target length of one sample (5)
+//   --reps <n>               samples per size (30)
+//   --heightmap <file.dds>   terrain heights (default: built-in)
+//   --baseline <file.json>   an earlier report to compare with
+//   --threshold <percent>    p50 slowdown that counts as a regression (10)
+//   --label <text>           stored in the output, e.g. the commit
+//   --out <file.json>        (stdout); keep one as the next --baseline
+//***************************************************************************************
+
+#include "Terrain.h"
+#include "TerrainMesh.h"
+#include "SceneObject.h"
+#include "HeightField.h"
+#include "CameraControls.h"
+#include "Camera.h"
+#include "BCEncoder.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const float Pi = 3.14159265359f;
+
+	// The app's terrain (TexColumnsApp::InitTerrain)
+	const float WorldSize = 1024.0f;
+	const int MaxLod = 5;
+	const float HeightScale = 500.0f;
+	const XMFLOAT3 TerrainOffset = XMFLOAT3(0.0f, -100.0f, 0.0f);
+	const int FrameResources = 6; // gNumFrameResources
+
+	struct BenchConfig
+	{
+		std::vector<std::string> Filters;
+		std::map<std::string, std::vector<int>> Sizes;
+		double WarmupMs = 100.0;
+		double SampleMs = 5.0;
+		int Reps = 30;
+		std::string Heightmap;
+		std::string Baseline;
+		double Threshold = 10.0;
+		std::string Label;
+		std::string Out;
+		bool List = false;
+	};
+
+	// Everything the kernels share, built once
+	struct Scene
+	{
+		HeightField Heights;
+		Terrain Land;
+		std::vector<Camera> Cameras; // around the terrain, looking at it
+	};
+
+	// One call of a kernel's body does Items units of work and returns a
+	// checksum of the results, which also keeps the work from being dropped.
+	struct Body
+	{
+		uint64_t Items = 1;
+		std::function<uint64_t()> Run;
+	};
+
+	struct Kernel
+	{
+		const char* Name;
+		const char* Item; // what one unit of work is
+		const char* Size; // what the size parameter means
+		std::vector<int> DefaultSizes;
+		std::function<Body(Scene&, int)> Setup;
+	};
+
+	struct Result
+	{
+		std::string Kernel;
+		int Size;
+		uint64_t Items;
+		uint64_t Calls; // per sample
+		uint64_t Checksum;
+		std::vector<double> NsPerItem;
+		double Stddev;
+	};
+
+	void Mix(uint64_t& hash, uint64_t value)
+	{
+		hash = (hash ^ value) * 1099511628211ull;
+	}
+
+	void MixFloat(uint64_t& hash, float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		Mix(hash, bits);
+	}
+
+	const uint64_t HashSeed = 14695981039346656037ull;
+
+	// Deterministic heights: a few ridges and bumps, no file needed
+	void BuildHeights(HeightField& heights, uint32_t resolution)
+	{
+		std::vector<float> samples((size_t)resolution * resolution);
+		for (uint32_t y = 0; y < resolution; ++y)
+		{
+			for (uint32_t x = 0; x < resolution; ++x)
+			{
+				const float u = (float)x / resolution, v = (float)y / resolution;
+				const float ridge = 1.0f - std::fabs(std::sin(3.0f * Pi * (u + 0.3f * v)));
+				const float bumps = 0.5f + 0.5f * std::sin(11.0f * Pi * u) * std::cos(7.0f * Pi * v);
+				samples[(size_t)y * resolution + x] = 0.7f * ridge * ridge + 0.3f * bumps;
+			}
+		}
+		heights.Init(samples.data(), resolution, resolution);
+	}
+
+	// The squares of one quadtree level, as Terrain::BuildNode lays them out
+	std::vector<XMFLOAT3> LevelCells(int depth)
+	{
+		const int count = 1 << depth;
+		const float cell = WorldSize / count;
+		std::vector<XMFLOAT3> cells;
+		cells.reserve((size_t)count * count);
+		for (int z = 0; z < count; ++z)
+			for (int x = 0; x < count; ++x)
+				cells.push_back(XMFLOAT3(TerrainOffset.x + x * cell, TerrainOffset.y, TerrainOffset.z + z * cell));
+		return cells;
+	}
+
+	std::vector<Kernel> Kernels()
+	{
+		std::vector<Kernel> kernels;
+
+		kernels.push_back({ "calculate_aabb", "box", "quadtree level, 4^n squares", { 3, 5, 7 },
+			[](Scene& scene, int size)
+			{
+				auto cells = std::make_shared<std::vector<XMFLOAT3>>(LevelCells(size));
+				const float cellSize = WorldSize / (1 << size);
+				Body body;
+				body.Items = cells->size();
+				body.Run = [&scene, cells, cellSize]()
+				{
+					uint64_t hash = HashSeed;
+					for (const XMFLOAT3& cell : *cells)
+					{
+						const BoundingBox box = scene.Land.CalculateAABB(cell, cellSize, -5.0f, 400.0f);
+						MixFloat(hash, box.Center.y);
+						MixFloat(hash, box.Extents.y);
+					}
+					return hash;
+				};
+				return body;
+			} });
+
+		kernels.push_back({ "frustum_contains_aabb", "box", "boxes", { 256, 4096, 65536 },
+			[](Scene& scene, int size)
+			{
+				// Tile bounds of every level, repeated up to size, against
+				// each camera's frustum in turn
+				auto boxes = std::make_shared<std::vector<BoundingBox>>();
+				const auto& tiles = scene.Land.GetAllTiles();
+				for (int i = 0; i < size; ++i)
+					boxes->push_back(tiles[i % tiles.size()]->boundingBox);
+				auto frustums = std::make_shared<std::vector<BoundingFrustum>>();
+				for (const Camera& camera : scene.Cameras)
+					frustums->push_back(camera.GetFrustum());
+				auto next = std::make_shared<size_t>(0);
+
+				Body body;
+				body.Items = boxes->size();
+				body.Run = [boxes, frustums, next]()
+				{
+					const BoundingFrustum& frustum = (*frustums)[(*next)++ % frustums->size()];
+					uint64_t counts[3] = {};
+					for (const BoundingBox& box : *boxes)
+						++counts[frustum.Contains(box)];
+					uint64_t hash = HashSeed;
+					for (uint64_t count : counts)
+						Mix(hash, count);
+					return hash;
+				};
+				return body;
+			} });
+
+		kernels.push_back({ "should_split", "node", "quadtree depth", { 4, 6, 8 },
+			[](Scene& scene, int size)
+			{
+				auto nodes = std::make_shared<std::vector<QuadTreeNode>>();
+				for (int depth = 0; depth <= size; ++depth)
+				{
+					const float cellSize = WorldSize / (1 << depth);
+					for (const XMFLOAT3& cell : LevelCells(depth))
+					{
+						nodes->emplace_back();
+						QuadTreeNode& node = nodes->back();
+						node.boundingBox = scene.Land.CalculateAABB(cell, cellSize, -5.0f, 400.0f);
+						node.size = cellSize;
+						node.depth = depth;
+						node.isLeaf = depth == size;
+						node.tile = nullptr;
+					}
+				}
+				auto positions = std::make_shared<std::vector<XMFLOAT3>>();
+				for (const Camera& camera : scene.Cameras)
+					positions->push_back(camera.GetPosition3f());
+				auto next = std::make_shared<size_t>(0);
+
+				Body body;
+				body.Items = nodes->size();
+				body.Run = [nodes, positions, next]()
+				{
+					const XMFLOAT3& position = (*positions)[(*next)++ % positions->size()];
+					uint64_t splits = 0;
+					for (const QuadTreeNode& node : *nodes)
+						splits += node.ShouldSplit(position, HeightScale, (int)WorldSize);
+					return splits;
+				};
+				return body;
+			} });
+
+		kernels.push_back({ "generate_tile", "tile", "tiles per call", { 1, 64 },
+			[](Scene& scene, int size)
+			{
+				auto vertices = std::make_shared<std::vector<TerrainVertex>>();
+				auto indices = std::make_shared<std::vector<uint32_t>>();
+				const auto& tiles = scene.Land.GetAllTiles();
+				auto sources = std::make_shared<std::vector<const Tile*>>();
+				for (int i = 0; i < size; ++i)
+					sources->push_back(tiles[i % tiles.size()].get());
+
+				Body body;
+				body.Items = sources->size();
+				body.Run = [vertices, indices, sources]()
+				{
+					vertices->clear();
+					indices->clear();
+					for (const Tile* tile : *sources)
+						TerrainMesh::GenerateTile(tile->worldPos, tile->tileSize, *vertices, *indices);
+					uint64_t hash = HashSeed;
+					MixFloat(hash, vertices->back().Pos.x);
+					Mix(hash, indices->back());
+					return hash;
+				};
+				return body;
+			} });
+
+		kernels.push_back({ "build_terrain_geometry", "tile", "quadtree depth", { 3, 5, 6 },
+			[](Scene&, int size)
+			{
+				// Fresh buffers every call, as BuildTerrainGeometry has
+				auto land = std::make_shared<Terrain>();
+				land->Initialize(WorldSize, size, TerrainOffset);
+				land->mHeightScale = HeightScale;
+
+				Body body;
+				body.Items = land->GetAllTiles().size();
+				body.Run = [land]()
+				{
+					std::vector<TerrainVertex> vertices;
+					std::vector<uint32_t> indices;
+					std::vector<TerrainTileRange> ranges;
+					TerrainMesh::BuildTiles(land->GetAllTiles(), vertices, indices, ranges);
+					uint64_t hash = HashSeed;
+					Mix(hash, vertices.size());
+					Mix(hash, indices.size());
+					MixFloat(hash, vertices.back().Pos.z);
+					return hash;
+				};
+				return body;
+			} });
+
+		kernels.push_back({ "camera_update_frustum", "camera", "cameras", { 1, 16 },
+			[](Scene& scene, int size)
+			{
+				auto cameras = std::make_shared<std::vector<Camera>>();
+				for (int i = 0; i < size; ++i)
+					cameras->push_back(scene.Cameras[i % scene.Cameras.size()]);
+
+				Body body;
+				body.Items = cameras->size();
+				body.Run = [cameras]()
+				{
+					uint64_t hash = HashSeed;
+					for (Camera& camera : *cameras)
+					{
+						camera.UpdateFrustum();
+						Mix(hash, camera.GetFrustum().Contains(BoundingBox()));
+					}
+					return hash;
+				};
+				return body;
+			} });
+
+		kernels.push_back({ "update_object_cbs", "item", "bobbing objects", { 64, 1024, 8192 },
+			[](Scene&, int size)
+			{
+				// Every object animated, as the app's maxwell: decompose,
+				// recompose, bounds and transposes each frame
+				auto objects = std::make_shared<std::vector<SceneObject>>(size);
+				auto constants = std::make_shared<std::vector<ObjectConstants>>(size);
+				for (int i = 0; i < size; ++i)
+				{
+					SceneObject& object = (*objects)[i];
+					XMStoreFloat4x4(&object.World, XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixRotationY(0.37f * i) *
+						XMMatrixTranslation(10.0f * (i % 64), 5.0f, 10.0f * (i / 64)));
+					object.Bounds.Center = XMFLOAT3(0.0f, 1.0f, 0.0f);
+					object.Bounds.Extents = XMFLOAT3(1.0f, 1.0f, 1.0f);
+					object.Dynamic = object.Bobbing = true;
+					object.NumFramesDirty = FrameResources;
+					object.ObjCBIndex = i;
+				}
+				auto time = std::make_shared<float>(0.0f);
+
+				Body body;
+				body.Items = objects->size();
+				body.Run = [objects, constants, time]()
+				{
+					*time += 1.0f / 60.0f;
+					for (SceneObject& object : *objects)
+						object.UpdateConstants(*time, FrameResources, (*constants)[object.ObjCBIndex]);
+					uint64_t hash = HashSeed;
+					MixFloat(hash, constants->back().World.m[1][3]);
+					MixFloat(hash, objects->back().WorldBounds.Center.y);
+					return hash;
+				};
+				return body;
+			} });
+
+		kernels.push_back({ "halton_jitter", "sample", "sequence length", { 16, 256 },
+			[](Scene&, int size)
+			{
+				auto jitters = std::make_shared<std::vector<XMFLOAT2>>(size);
+				Body body;
+				body.Items = jitters->size();
+				body.Run = [jitters]()
+				{
+					CameraControls::HaltonJitter(1920.0f, 1080.0f, (int)jitters->size(), jitters->data());
+					uint64_t hash = HashSeed;
+					MixFloat(hash, jitters->back().x);
+					MixFloat(hash, jitters->back().y);
+					return hash;
+				};
+				return body;
+			} });
+
+		return kernels;
+	}
+
+	bool Selected(const BenchConfig& config, const char* name)
+	{
+		if (config.Filters.empty())
+			return true;
+		for (const std::string& filter : config.Filters)
+			if (strstr(name, filter.c_str()))
+				return true;
+		return false;
+	}
+
+	// Kept alive so the compiler cannot drop a body's result
+	volatile uint64_t gSink = 0;
+
+	Result Measure(const BenchConfig& config, const Kernel& kernel, int size, Body& body)
+	{
+		using Clock = std::chrono::steady_clock;
+		Result result;
+		result.Kernel = kernel.Name;
+		result.Size = size;
+		result.Items = body.Items;
+		result.Checksum = body.Run(); // first call after setup, before any state moves on
+
+		// Warm up: caches, branch predictors, allocator, CPU clock
+		uint64_t warmupCalls = 1;
+		const auto warmupStart = Clock::now();
+		double warmupMs = 0.0;
+		while (warmupMs < config.WarmupMs || warmupCalls < 2)
+		{
+			gSink = gSink + body.Run();
+			++warmupCalls;
+			warmupMs = std::chrono::duration<double, std::milli>(Clock::now() - warmupStart).count();
+		}
+
+		// Calls per sample from the warm-up rate
+		const double callMs = warmupMs / (warmupCalls - 1);
+		result.Calls = (std::max)((uint64_t)1, (uint64_t)std::ceil(config.SampleMs / (std::max)(callMs, 1e-6)));
+
+		result.NsPerItem.reserve(config.Reps);
+		for (int rep = 0; rep < config.Reps; ++rep)
+		{
+			uint64_t sink = 0;
+			const auto start = Clock::now();
+			for (uint64_t call = 0; call < result.Calls; ++call)
+				sink += body.Run();
+			const auto end = Clock::now();
+			gSink = gSink + sink;
+			const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+			result.NsPerItem.push_back(ns / (result.Calls * result.Items));
+		}
+
+		double sum = 0.0;
+		for (double ns : result.NsPerItem)
+			sum += ns;
+		const double mean = sum / result.NsPerItem.size();
+		double variance = 0.0;
+		for (double ns : result.NsPerItem)
+			variance += (ns - mean) * (ns - mean);
+		result.Stddev = result.NsPerItem.size() > 1 ? std::sqrt(variance / (result.NsPerItem.size() - 1)) : 0.0;
+		return result;
+	}
+
+	struct BaselineEntry
+	{
+		double P50 = 0.0;
+		uint64_t Checksum = 0;
+	};
+
+	// Reads what WriteReport writes: each result object lists kernel, size,
+	// checksum and the ns_per_item summary, in that order.
+	bool LoadBaseline(const std::string& file, std::map<std::pair<std::string, int>, BaselineEntry>& entries, std::string& label)
+	{
+		std::ifstream in(file, std::ios::binary);
+		if (!in)
+			return false;
+		std::stringstream buffer;
+		buffer << in.rdbuf();
+		const std::string text = buffer.str();
+
+		auto valueAfter = [&text](const char* key, size_t from) -> size_t
+		{
+			const size_t at = text.find(key, from);
+			return at == std::string::npos ? at : at + strlen(key);
+		};
+
+		const size_t labelAt = valueAfter("\"label\": \"", 0);
+		if (labelAt != std::string::npos)
+			label = text.substr(labelAt, text.find('"', labelAt) - labelAt);
+
+		size_t at = 0;
+		while ((at = valueAfter("\"kernel\": \"", at)) != std::string::npos)
+		{
+			const std::string kernel = text.substr(at, text.find('"', at) - at);
+			const size_t sizeAt = valueAfter("\"size\": ", at);
+			const size_t checksumAt = valueAfter("\"checksum\": \"", at);
+			const size_t summaryAt = valueAfter("\"ns_per_item\": {", at);
+			const size_t p50At = summaryAt == std::string::npos ? summaryAt : valueAfter("\"p50\": ", summaryAt);
+			if (sizeAt == std::string::npos || checksumAt == std::string::npos || p50At == std::string::npos)
+				return false;
+
+			BaselineEntry entry;
+			entry.P50 = atof(text.c_str() + p50At);
+			entry.Checksum = strtoull(text.c_str() + checksumAt, nullptr, 16);
+			entries[{ kernel, atoi(text.c_str() + sizeAt) }] = entry;
+			at = p50At;
+		}
+		return !entries.empty();
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<Kernel>& kernels, const std::vector<Result>& results)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"MicroBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"heightmap\": " << JsonString(config.Heightmap.empty() ? "built-in" : config.Heightmap)
+			<< ", \"warmup_ms\": " << config.WarmupMs << ", \"sample_ms\": " << config.SampleMs << ", \"reps\": " << config.Reps << " },\n";
+		out << "  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			const char* item = "";
+			for (const Kernel& kernel : kernels)
+				if (r.Kernel == kernel.Name)
+					item = kernel.Item;
+
+			char checksum[17];
+			snprintf(checksum, sizeof(checksum), "%016llx", (unsigned long long)r.Checksum);
+			out << "    {\n";
+			out << "      \"kernel\": " << JsonString(r.Kernel) << ",\n";
+			out << "      \"size\": " << r.Size << ",\n";
+			out << "      \"item\": " << JsonString(item) << ",\n";
+			out << "      \"items_per_call\": " << r.Items << ",\n";
+			out << "      \"calls_per_sample\": " << r.Calls << ",\n";
+			out << "      \"checksum\": \"" << checksum << "\",\n";
+			out << "      \"stddev_ns\": " << r.Stddev << ",\n";
+			WriteSummary(out, "ns_per_item", r.NsPerItem, [](double ns) { return ns; }, true);
+			out << "    }" << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	// Table on stderr, with the baseline when there is one. Returns the
+	// number of regressions.
+	int Compare(const BenchConfig& config, const std::vector<Result>& results,
+		const std::map<std::pair<std::string, int>, BaselineEntry>* baseline, const std::string& baselineLabel)
+	{
+		int regressions = 0;
+		if (baseline)
+			fprintf(stderr, "Baseline: %s%s%s\n", config.Baseline.c_str(), baselineLabel.empty() ? "" : " ", baselineLabel.c_str());
+		fprintf(stderr, "%-24s %8s %12s %8s", "kernel", "size", "p50 ns/item", "+-%");
+		if (baseline)
+			fprintf(stderr, " %12s %8s", "baseline", "change");
+		fprintf(stderr, "\n");
+
+		for (const Result& r : results)
+		{
+			const double p50 = Percentile(r.NsPerItem, 0.50);
+			double mean = 0.0;
+			for (double ns : r.NsPerItem)
+				mean += ns;
+			mean /= r.NsPerItem.size();
+			fprintf(stderr, "%-24s %8d %12.3f %8.1f", r.Kernel.c_str(), r.Size, p50, mean > 0.0 ? 100.0 * r.Stddev / mean : 0.0);
+
+			if (baseline)
+			{
+				auto found = baseline->find({ r.Kernel, r.Size });
+				if (found == baseline->end())
+				{
+					fprintf(stderr, " %12s %8s", "-", "new");
+				}
+				else
+				{
+					const BaselineEntry& base = found->second;
+					const double change = base.P50 > 0.0 ? 100.0 * (p50 / base.P50 - 1.0) : 0.0;
+					const bool regressed = change > config.Threshold;
+					regressions += regressed;
+					fprintf(stderr, " %12.3f %+7.1f%%%s", base.P50, change, regressed ? "  REGRESSION" : "");
+					if (base.Checksum != r.Checksum)
+						fprintf(stderr, "  (checksum differs: different work)");
+				}
+			}
+			fprintf(stderr, "\n");
+		}
+
+		if (baseline)
+			fprintf(stderr, "%d regression(s) over %.1f%%\n", regressions, config.Threshold);
+		return regressions;
+	}
+
+	bool ParseSizes(const std::string& text, BenchConfig& config)
+	{
+		const size_t equals = text.find('=');
+		if (equals == std::string::npos)
+			return false;
+		std::vector<int> sizes;
+		std::istringstream list(text.substr(equals + 1));
+		std::string value;
+		while (std::getline(list, value, ','))
+		{
+			const int size = atoi(value.c_str());
+			if (size <= 0)
+				return false;
+			sizes.push_back(size);
+		}
+		if (sizes.empty())
+			return false;
+		config.Sizes[text.substr(0, equals)] = sizes;
+		return true;
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--list") config.List = true;
+			else if (arg == "--filter" && hasValue) config.Filters.push_back(argv[++i]);
+			else if (arg == "--sizes" && hasValue && ParseSizes(argv[++i], config)) {}
+			else if (arg == "--warmup-ms" && hasValue) config.WarmupMs = (std::max)(atof(argv[++i]), 0.0);
+			else if (arg == "--sample-ms" && hasValue) config.SampleMs = (std::max)(atof(argv[++i]), 0.01);
+			else if (arg == "--reps" && hasValue) config.Reps = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--heightmap" && hasValue) config.Heightmap = argv[++i];
+			else if (arg == "--baseline" && hasValue) config.Baseline = argv[++i];
+			else if (arg == "--threshold" && hasValue) config.Threshold = atof(argv[++i]);
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	const std::vector<Kernel> kernels = Kernels();
+	if (config.List)
+	{
+		for (const Kernel& kernel : kernels)
+		{
+			std::cout << kernel.Name << ": ns per " << kernel.Item << ", size = " << kernel.Size << ", default";
+			for (int size : kernel.DefaultSizes)
+				std::cout << " " << size;
+			std::cout << "\n";
+		}
+		return 0;
+	}
+	for (const auto& sizes : config.Sizes)
+	{
+		if (std::none_of(kernels.begin(), kernels.end(), [&](const Kernel& k) { return sizes.first == k.Name; }))
+		{
+			std::cerr << "Unknown kernel in --sizes: " << sizes.first << "\n";
+			return 2;
+		}
+	}
+
+	std::map<std::pair<std::string, int>, BaselineEntry> baseline;
+	std::string baselineLabel;
+	if (!config.Baseline.empty() && !LoadBaseline(config.Baseline, baseline, baselineLabel))
+	{
+		std::cerr << "Cannot read baseline " << config.Baseline << "\n";
+		return 1;
+	}
+
+	Scene scene;
+	if (!config.Heightmap.empty())
+	{
+		std::vector<uint8_t> rgba;
+		uint32_t width = 0, height = 0;
+		if (!BCEncoder::LoadDDS(std::filesystem::path(config.Heightmap).wstring(), rgba, width, height))
+		{
+			std::cerr << "Cannot load " << config.Heightmap << "\n";
+			return 1;
+		}
+		scene.Heights.Init(rgba.data(), width, height, (size_t)width * 4);
+	}
+	else
+	{
+		BuildHeights(scene.Heights, 512);
+	}
+	scene.Heights.SetPlacement(TerrainOffset.x, TerrainOffset.z, WorldSize, TerrainOffset.y, HeightScale);
+	scene.Land.Initialize(WorldSize, MaxLod, TerrainOffset);
+	scene.Land.mHeightScale = HeightScale;
+	scene.Land.SetHeights(&scene.Heights);
+
+	// A ring of cameras at different heights, each looking across the centre
+	for (int i = 0; i < 16; ++i)
+	{
+		const float a = 2.0f * Pi * i / 16;
+		const float cx = TerrainOffset.x + 0.5f * WorldSize, cz = TerrainOffset.z + 0.5f * WorldSize;
+		const XMFLOAT3 position(cx + 0.4f * WorldSize * std::cos(a), TerrainOffset.y + HeightScale * (0.1f + 0.1f * (i % 4)), cz + 0.4f * WorldSize * std::sin(a));
+		Camera camera;
+		camera.SetLens(0.25f * Pi, 16.0f / 9.0f, 1.0f, 20000.0f);
+		camera.LookAt(position, XMFLOAT3(cx, TerrainOffset.y, cz), XMFLOAT3(0.0f, 1.0f, 0.0f));
+		camera.UpdateViewMatrix();
+		scene.Cameras.push_back(camera);
+	}
+
+	std::vector<Result> results;
+	for (const Kernel& kernel : kernels)
+	{
+		if (!Selected(config, kernel.Name))
+			continue;
+		auto sizes = config.Sizes.find(kernel.Name);
+		for (int size : sizes != config.Sizes.end() ? sizes->second : kernel.DefaultSizes)
+		{
+			Body body = kernel.Setup(scene, size);
+			results.push_back(Measure(config, kernel, size, body));
+		}
+	}
+	if (results.empty())
+	{
+		std::cerr << "No kernel matches the filter\n";
+		return 2;
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, kernels, results);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	const int regressions = Compare(config, results, config.Baseline.empty() ? nullptr : &baseline, baselineLabel);
+	return regressions > 0 ? 3 : 0;
+}
@@ -0,0 +1,465 @@
+//***************************************************************************************
+// NullDraw.cpp
+//
+// TexColumnsApp::Draw without a GPU: flies the camera around the terrain,
+// gathers the visible tiles and a made-up set of opaque items and custom
+// meshes, and records every frame through FrameRecorder into a
+// NullCommandList - the same calls the app makes on its D3D12 command list.
+// Reports the CPU cost of recording and the command counts per frame as
+// JSON, and checks every frame's counts against what the items should
+// cost: a change that adds a bind per item, or loses a barrier, fails here
+// with exit code 3.
+//
+// Ids and descriptor indices are arbitrary and index counts are the real
+// tile ranges but made-up mesh sizes, so only the counts mean anything.
+// The stream hash covers the whole recording: two builds that record the
+// same commands give the same hash. --capture saves the last frame as a
+// command capture (FrameCapture.h) for Tools/CaptureReplay, with made-up
+// constant buffer contents.
+//
+// Needs no GPU or window. Windows: NullDraw.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common NullDraw.cpp
+//       -L<dir> -lTerrainCore -o NullDraw
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: NullDraw [options]
+//   --size <units>           world size (1024)
+//   --maxlod <n>             quadtree depth (5)
+//   --items <n>              opaque items (1, the app's grid)
+//   --meshes <n>             visible custom mesh submeshes (16)
+//   --paint                  record the brush dispatch every frame
+//   --frames <n>             frames of the orbit (1000)
+//   --warmup <n>             untimed frames first (50)
+//   --capture <file>         capture the last frame
+//   --label <text>           stored in the output, e.g. the commit
+//   --out <file.json>        (stdout)
+//***************************************************************************************
+
+#include "Terrain.h"
+#include "TerrainMesh.h"
+#include "FrameRecorder.h"
+#include "FrameCapture.h"
+#include "BenchReport.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Every allocation in the process is counted; once warmed up, recording a
+// frame should not allocate.
+static std::atomic<uint64_t> gAllocations{ 0 };
+
+void* operator new(size_t size)
+{
+	gAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace
+{
+	const float Pi = 3.14159265359f;
+	const uint32_t TriangleList = 4;        // D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST
+	const uint32_t PatchList3 = 35;         // D3D_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST
+
+	struct DrawConfig
+	{
+		float Size = 1024.0f;
+		int MaxLod = 5;
+		float HeightScale = 500.0f;
+		XMFLOAT3 Offset = XMFLOAT3(0.0f, -100.0f, 0.0f); // TexColumnsApp::terrainPos
+		int Items = 1;
+		int Meshes = 16;
+		bool Paint = false;
+		int Frames = 1000;
+		int Warmup = 50;
+		std::string Capture;
+		std::string Label;
+		std::string Out;
+
+		float Aspect = 16.0f / 9.0f;
+		float NearZ = 1.0f;
+		float FarZ = 20000.0f;
+	};
+
+	struct FrameSample
+	{
+		double RecordUs;
+		uint32_t Commands;
+		uint32_t Bytes;
+		uint32_t Binds;
+		uint32_t Draws;
+		uint32_t Barriers;
+		uint32_t Tiles;
+		uint64_t Allocations;
+	};
+
+	// Distinct ids for everything FrameBindings names
+	FrameBindings MakeBindings()
+	{
+		FrameBindings b;
+		RenderId next = 0;
+		for (RenderId* id : { &b.OpaquePipeline, &b.StandardMeshPipeline, &b.TerrainPipeline, &b.TaaPipeline, &b.BrushPipeline })
+			*id = next++;
+		next = 0;
+		for (RenderId* id : { &b.OpaqueRootSignature, &b.StandardMeshRootSignature, &b.TerrainRootSignature, &b.TaaRootSignature, &b.BrushRootSignature })
+			*id = next++;
+		next = 0;
+		for (RenderId* id : { &b.ObjectCB, &b.MaterialCB, &b.PassCB, &b.TerrainCB, &b.BrushCB, &b.TaaCB,
+			&b.ColorBuffer, &b.VelocityBuffer, &b.PrevHistory, &b.CurrentHistory, &b.BackBuffer, &b.BrushTexture })
+			*id = next++;
+		b.ObjectCBStride = 256;
+		b.MaterialCBStride = 256;
+		b.TerrainCBStride = 256;
+
+		// RTV heap: two back buffers, then the TAA targets
+		b.BackBufferRtv = 0;
+		b.ColorRtv = 2;
+		b.PrevHistoryRtv = 3;
+		b.CurrentHistoryRtv = 4;
+		b.VelocityRtv = 5;
+		b.Dsv = 0;
+		b.ColorSrv = 100;
+		b.VelocitySrv = 101;
+		b.PrevHistorySrv = 102;
+		b.CurrentHistorySrv = 103;
+		b.TerrainDiffuseSrv = 10;
+		b.TerrainNormalSrv = 11;
+		b.TerrainDisplacementSrv = 12;
+		b.BrushSrv = 104;
+		b.BrushUav = 105;
+
+		b.Viewport.Width = 1920.0f;
+		b.Viewport.Height = 1080.0f;
+		b.Scissor.Right = 1920;
+		b.Scissor.Bottom = 1080;
+		b.BrushGroupsX = 1024 / 16;
+		b.BrushGroupsY = 1024 / 16;
+		return b;
+	}
+
+	// What FrameRecorder must emit for a frame, from the item counts alone
+	struct ExpectedCounts
+	{
+		uint32_t Draws, Dispatches, Barriers, Copies, TableBinds, CbvBinds, InputBinds;
+		uint64_t Primitives;
+	};
+
+	ExpectedCounts Expect(size_t opaque, size_t meshes, size_t tiles, uint64_t indices, bool firstFrame, bool paint)
+	{
+		ExpectedCounts e;
+		const uint32_t items = (uint32_t)(opaque + meshes + tiles);
+		e.Draws = items + 1;                                          // + TAA triangle
+		e.Dispatches = paint ? 1 : 0;
+		// scene 2, TAA 5, end of frame 5; history seeding 6; brush 2
+		e.Barriers = 12 + (firstFrame ? 6 : 0) + (paint ? 2 : 0);
+		e.Copies = firstFrame ? 2 : 0;
+		e.TableBinds = (uint32_t)(3 * opaque + 2 * meshes + 4 * tiles) + 3 + (paint ? 2 : 0);
+		e.CbvBinds = (uint32_t)(2 * opaque + 2 * meshes + 4 * tiles)
+			+ 2 + (tiles ? 1 : 0)                                     // pass constants per root signature
+			+ 1                                                       // TAA constants
+			+ (paint ? 1 + (tiles ? 1 : 0) : 0);
+		e.InputBinds = 3 * items + 1;
+		e.Primitives = indices + 3;
+		return e;
+	}
+
+	bool Check(const char* what, uint64_t got, uint64_t expected, int frame)
+	{
+		if (got == expected)
+			return true;
+		std::cerr << "Frame " << frame << ": " << what << " " << got << ", expected " << expected << "\n";
+		return false;
+	}
+
+	bool ParseArgs(int argc, char** argv, DrawConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--size" && hasValue) config.Size = (float)atof(argv[++i]);
+			else if (arg == "--maxlod" && hasValue) config.MaxLod = atoi(argv[++i]);
+			else if (arg == "--items" && hasValue) config.Items = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--meshes" && hasValue) config.Meshes = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--paint") config.Paint = true;
+			else if (arg == "--frames" && hasValue) config.Frames = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--warmup" && hasValue) config.Warmup = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--capture" && hasValue) config.Capture = argv[++i];
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	DrawConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	Terrain terrain;
+	terrain.Initialize(config.Size, config.MaxLod, config.Offset);
+	terrain.mHeightScale = config.HeightScale;
+
+	// One draw item per tile, as TexColumnsApp::BuildRenderItems makes them:
+	// object constants after the opaque items', the shared terrain geometry
+	auto& allTiles = terrain.GetAllTiles();
+	std::vector<TerrainVertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<TerrainTileRange> ranges;
+	TerrainMesh::BuildTiles(allTiles, vertices, indices, ranges);
+	std::vector<DrawItem> tileItems(allTiles.size());
+	for (size_t i = 0; i < allTiles.size(); ++i)
+	{
+		DrawItem& item = tileItems[allTiles[i]->tileIndex];
+		item.Geometry = 1;
+		item.Topology = TriangleList;
+		item.IndexCount = ranges[i].IndexCount;
+		item.StartIndex = ranges[i].StartIndex;
+		item.ObjCBIndex = (uint32_t)(config.Items + i);
+		item.MatCBIndex = 1;
+		item.TileIndex = allTiles[i]->tileIndex;
+	}
+
+	std::vector<DrawItem> opaque(config.Items);
+	for (int i = 0; i < config.Items; ++i)
+	{
+		DrawItem& item = opaque[i];
+		item.Topology = PatchList3;
+		item.IndexCount = 6 * 49 * 49;
+		item.ObjCBIndex = i;
+		item.DiffuseSrv = 0;
+		item.NormalSrv = 1;
+		item.DisplacementSrv = 2;
+	}
+
+	std::vector<DrawItem> meshes(config.Meshes);
+	for (int i = 0; i < config.Meshes; ++i)
+	{
+		DrawItem& item = meshes[i];
+		item.Topology = TriangleList;
+		item.IndexCount = 3 * (2000 + 500 * (i % 8));
+		item.StartIndex = 3 * 2000 * i;
+		item.ObjCBIndex = (uint32_t)(config.Items + allTiles.size() + i);
+		item.MatCBIndex = 2 + i % 4;
+		item.DiffuseSrv = 3 + i % 4;
+		item.NormalSrv = 7 + i % 4;
+	}
+
+	FrameBindings bindings = MakeBindings();
+	NullCommandList commands;
+	std::vector<DrawItem> tiles;
+	uint64_t staticIndices = 0;
+	for (const DrawItem& item : opaque)
+		staticIndices += item.IndexCount;
+	for (const DrawItem& item : meshes)
+		staticIndices += item.IndexCount;
+
+	// Orbit high over the centre looking at it, like TerrainBench's "orbit"
+	const float cx = config.Offset.x + 0.5f * config.Size;
+	const float cz = config.Offset.z + 0.5f * config.Size;
+	auto updateTerrain = [&](int frame)
+	{
+		const float a = 2.0f * Pi * frame / config.Frames;
+		const XMFLOAT3 eye(cx + 0.45f * config.Size * std::cos(a), config.Offset.y + config.HeightScale, cz + 0.45f * config.Size * std::sin(a));
+		const XMVECTOR eyePos = XMLoadFloat3(&eye);
+		const XMMATRIX view = XMMatrixLookAtLH(eyePos, XMVectorSet(cx, config.Offset.y, cz, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * Pi, config.Aspect, config.NearZ, config.FarZ);
+		BoundingFrustum frustum;
+		BoundingFrustum::CreateFromMatrix(frustum, proj);
+		XMVECTOR det;
+		frustum.Transform(frustum, XMMatrixInverse(&det, view));
+		terrain.Update(eye, frustum);
+	};
+
+	// TexColumnsApp::Draw minus UploadBrushRegion and ImGui, which record on
+	// the D3D12 list directly
+	auto recordFrame = [&](int frame, RenderCommandList& cmd)
+	{
+		tiles.clear();
+		for (const Tile* tile : terrain.GetVisibleTiles())
+			tiles.push_back(tileItems[tile->tileIndex]);
+
+		bindings.FirstFrame = frame == 0;
+		bindings.FrameIndex = frame % 16;
+		commands.Reset();
+		FrameRecorder::BeginScene(cmd, bindings);
+		FrameRecorder::RecordScene(cmd, bindings, opaque, meshes, tiles);
+		FrameRecorder::RecordTaa(cmd, bindings);
+		if (config.Paint)
+			FrameRecorder::RecordBrush(cmd, bindings, tiles);
+		FrameRecorder::EndFrame(cmd, bindings);
+	};
+
+	for (int i = 0; i < config.Warmup; ++i)
+	{
+		updateTerrain(i);
+		recordFrame(i + 1, commands);
+	}
+
+	bool countsOk = true;
+	uint64_t hash = 14695981039346656037ull;
+	std::vector<FrameSample> samples(config.Frames);
+	for (int i = 0; i < config.Frames; ++i)
+	{
+		updateTerrain(i);
+
+		const uint64_t allocations = gAllocations.load(std::memory_order_relaxed);
+		const auto start = std::chrono::steady_clock::now();
+		recordFrame(i, commands);
+		const auto end = std::chrono::steady_clock::now();
+
+		const RenderStats stats = commands.GetStats();
+		FrameSample& s = samples[i];
+		s.RecordUs = std::chrono::duration<double, std::micro>(end - start).count();
+		s.Allocations = gAllocations.load(std::memory_order_relaxed) - allocations;
+		s.Commands = stats.Commands;
+		s.Bytes = (uint32_t)(commands.GetCommands().size() * sizeof(RenderCommand) + commands.GetPayload().size() * sizeof(uint32_t));
+		s.Binds = stats.Binds();
+		s.Draws = stats.Draws;
+		s.Barriers = stats.Barriers;
+		s.Tiles = (uint32_t)tiles.size();
+
+		uint64_t tileIndices = 0;
+		for (const DrawItem& item : tiles)
+			tileIndices += item.IndexCount;
+		const ExpectedCounts e = Expect(opaque.size(), meshes.size(), tiles.size(), staticIndices + tileIndices, i == 0, config.Paint);
+		countsOk &= Check("draws", stats.Draws, e.Draws, i);
+		countsOk &= Check("dispatches", stats.Dispatches, e.Dispatches, i);
+		countsOk &= Check("barriers", stats.Barriers, e.Barriers, i);
+		countsOk &= Check("copies", stats.Copies, e.Copies, i);
+		countsOk &= Check("table binds", stats.TableBinds, e.TableBinds, i);
+		countsOk &= Check("CBV binds", stats.CbvBinds, e.CbvBinds, i);
+		countsOk &= Check("input binds", stats.InputBinds, e.InputBinds, i);
+		countsOk &= Check("primitives", stats.Primitives, e.Primitives, i);
+
+		// FNV-1a over the commands and payload of every frame
+		auto hashWords = [&](const uint32_t* words, size_t count)
+		{
+			for (size_t w = 0; w < count; ++w)
+				hash = (hash ^ words[w]) * 1099511628211ull;
+		};
+		for (const RenderCommand& c : commands.GetCommands())
+		{
+			const uint32_t words[4] = { (uint32_t)c.Op | (uint32_t)c.Slot << 8 | (uint32_t)c.Count << 16, c.A, c.B, c.C };
+			hashWords(words, 4);
+		}
+		hashWords(commands.GetPayload().data(), commands.GetPayload().size());
+	}
+
+	// The last frame again, through a capture. Each constant element holds
+	// its index in the first word, the pass constants the frame number.
+	if (!config.Capture.empty())
+	{
+		const int last = config.Frames - 1;
+		auto fill = [](std::vector<uint8_t>& buffer, size_t elements, uint32_t first)
+		{
+			buffer.assign(elements * 256, 0);
+			for (size_t e = 0; e < elements; ++e)
+			{
+				const uint32_t word = first + (uint32_t)e;
+				memcpy(&buffer[e * 256], &word, sizeof(word));
+			}
+		};
+		std::vector<uint8_t> objectCB, materialCB, passCB, terrainCB, brushCB, taaCB;
+		fill(objectCB, config.Items + allTiles.size() + config.Meshes, 0);
+		fill(materialCB, 6, 0);
+		fill(passCB, 1, (uint32_t)last);
+		fill(terrainCB, allTiles.size(), 0);
+		fill(brushCB, 1, 0);
+		fill(taaCB, 1, 0);
+
+		CaptureCommandList capture;
+		capture.Begin(commands, (uint32_t)last);
+		capture.SetConstantSource(bindings.ObjectCB, objectCB.data(), objectCB.size(), bindings.ObjectCBStride);
+		capture.SetConstantSource(bindings.MaterialCB, materialCB.data(), materialCB.size(), bindings.MaterialCBStride);
+		capture.SetConstantSource(bindings.PassCB, passCB.data(), passCB.size(), 256);
+		capture.SetConstantSource(bindings.TerrainCB, terrainCB.data(), terrainCB.size(), bindings.TerrainCBStride);
+		capture.SetConstantSource(bindings.BrushCB, brushCB.data(), brushCB.size(), 256);
+		capture.SetConstantSource(bindings.TaaCB, taaCB.data(), taaCB.size(), 256);
+		recordFrame(last, capture);
+
+		FrameCapture frame;
+		capture.End(frame);
+		std::string error;
+		if (!frame.Save(config.Capture, error))
+		{
+			std::cerr << error << "\n";
+			return 1;
+		}
+	}
+
+	char hashText[17];
+	snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)hash);
+
+	std::ostringstream out;
+	out.precision(6);
+	out << "{\n";
+	out << "  \"benchmark\": \"NullDraw\",\n";
+	out << "  \"label\": " << JsonString(config.Label) << ",\n";
+	out << "  \"config\": { \"size\": " << config.Size << ", \"maxlod\": " << config.MaxLod << ", \"items\": " << config.Items
+		<< ", \"meshes\": " << config.Meshes << ", \"paint\": " << (config.Paint ? "true" : "false")
+		<< ", \"frames\": " << config.Frames << ", \"warmup\": " << config.Warmup << " },\n";
+	out << "  \"tiles_total\": " << allTiles.size() << ",\n";
+	out << "  \"paths\": [\n";
+	out << "    {\n";
+	out << "      \"name\": \"orbit\",\n";
+	out << "      \"frames\": " << samples.size() << ",\n";
+	out << "      \"counts_ok\": " << (countsOk ? "true" : "false") << ",\n";
+	out << "      \"stream_hash\": \"" << hashText << "\",\n";
+	WriteSummary(out, "record_us", samples, [](const FrameSample& s) { return s.RecordUs; });
+	WriteSummary(out, "ns_per_command", samples, [](const FrameSample& s) { return s.Commands ? 1000.0 * s.RecordUs / s.Commands : 0.0; });
+	WriteSummary(out, "commands", samples, [](const FrameSample& s) { return s.Commands; });
+	WriteSummary(out, "bytes", samples, [](const FrameSample& s) { return s.Bytes; });
+	WriteSummary(out, "binds", samples, [](const FrameSample& s) { return s.Binds; });
+	WriteSummary(out, "draws", samples, [](const FrameSample& s) { return s.Draws; });
+	WriteSummary(out, "barriers", samples, [](const FrameSample& s) { return s.Barriers; });
+	WriteSummary(out, "tiles", samples, [](const FrameSample& s) { return s.Tiles; });
+	WriteSummary(out, "allocations", samples, [](const FrameSample& s) { return s.Allocations; }, true);
+	out << "    }\n";
+	out << "  ]\n}\n";
+
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+	return countsOk ? 0 : 3;
+}
@@ -0,0 +1,499 @@
+//***************************************************************************************
+// OcclusionBench.cpp
+//
+// Checks and benchmarks the CPU occlusion culling of terrain tiles. Builds a
+// Terrain like TexColumnsApp::InitTerrain does, the 5x5 tile occluders like
+// BuildTerrainOccluders, and for each of --cameras views near the ground
+// runs the walk and then what UpdateOcclusion does: the nearest tiles are
+// drawn into a 256x144 OcclusionBuffer, the Hi-Z pyramid is built and every
+// visible tile box is tested against it.
+//
+// The check part draws the app's 64 occluders twice per camera, with the
+// SSE2 rasterizer and with the scalar one. The two depth buffers must be
+// identical, pixel for pixel, and hide the same tiles. Every tile the Hi-Z test
+// hides is then tested again per pixel on the full-resolution buffer over its
+// whole screen rectangle; a tile hidden by the pyramid but not by the pixels
+// is a failure, and the exit code is 3. How many of the tiles the pixels hide
+// the pyramid finds as well is reported.
+//
+// The bench part times a frame's occlusion work (sort, draw, Finish, tests)
+// over occluder counts from 0 to 256, SIMD and scalar, --reps times per
+// camera, with the share of visible tiles hidden at each count.
+//
+// Needs no GPU or window. Windows: OcclusionBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common OcclusionBench.cpp
+//       -L<dir> -lTerrainCore -o OcclusionBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: OcclusionBench [options]
+//   --heightmap <file.dds>   heights from the red channel (default: built-in rolling hills)
+//   --cameras <n>            views (32)
+//   --reps <n>               timed frames per view and occluder count (5)
+//   --label <text>           stored in the output, e.g. the commit
+//   --out <file.json>        (stdout)
+//***************************************************************************************
+
+#include "Terrain.h"
+#include "HeightField.h"
+#include "OcclusionBuffer.h"
+#include "BCEncoder.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const float Pi = 3.14159265359f;
+
+	// The app's terrain and camera (TexColumnsApp::InitTerrain, OnResize)
+	const float WorldSize = 1024.0f;
+	const int MaxLod = 5;
+	const float HeightScale = 500.0f;
+	const XMFLOAT3 TerrainOffset = XMFLOAT3(0.0f, -100.0f, 0.0f);
+	const float FovY = 0.25f * Pi;
+	const float Aspect = 16.0f / 9.0f;
+	const float NearZ = 1.0f;
+	const float FarZ = 20000.0f;
+
+	// BuildTerrainOccluders and UpdateOcclusion
+	const int OccluderResolution = 5;
+	const int AppOccluders = 64;
+	const int OccluderCounts[] = { 0, 8, 16, 32, 64, 128, 256 };
+
+	struct BenchConfig
+	{
+		std::string Heightmap;
+		int Cameras = 32;
+		int Reps = 5;
+		std::string Label;
+		std::string Out;
+	};
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Kept alive so the compiler cannot drop a loop's result
+	volatile size_t gSink = 0;
+
+	// Built-in heights: a few octaves of smooth bumps, no file needed (as in
+	// TerrainBench)
+	void BuildHills(HeightField& heights, uint32_t resolution)
+	{
+		std::vector<float> samples((size_t)resolution * resolution);
+		for (uint32_t y = 0; y < resolution; ++y)
+		{
+			for (uint32_t x = 0; x < resolution; ++x)
+			{
+				const float u = (float)x / resolution, v = (float)y / resolution;
+				float h = 0.0f, amplitude = 0.5f, frequency = 2.0f;
+				for (int octave = 0; octave < 5; ++octave)
+				{
+					h += amplitude * (0.5f + 0.5f * std::sin(2.0f * Pi * frequency * u + octave) * std::cos(2.0f * Pi * frequency * v + 2.0f * octave));
+					amplitude *= 0.5f;
+					frequency *= 2.0f;
+				}
+				samples[(size_t)y * resolution + x] = (std::min)(h, 1.0f);
+			}
+		}
+		heights.Init(samples.data(), resolution, resolution);
+	}
+
+	Aabb ToAabb(const BoundingBox& box)
+	{
+		Aabb result;
+		result.Min[0] = box.Center.x - box.Extents.x;
+		result.Min[1] = box.Center.y - box.Extents.y;
+		result.Min[2] = box.Center.z - box.Extents.z;
+		result.Max[0] = box.Center.x + box.Extents.x;
+		result.Max[1] = box.Center.y + box.Extents.y;
+		result.Max[2] = box.Center.z + box.Extents.z;
+		return result;
+	}
+
+	// A view a few metres above the ground looking across it, where the
+	// hills hide the most
+	struct View
+	{
+		XMFLOAT3 Eye;
+		BoundingFrustum Frustum;
+		XMFLOAT4X4 ViewProj;
+	};
+
+	std::vector<View> MakeViews(const HeightField& heights, int count)
+	{
+		std::vector<View> views;
+		uint32_t random = 5;
+		auto next = [&random]()
+		{
+			random = random * 1664525u + 1013904223u;
+			return (float)(random >> 8) * (1.0f / 16777216.0f);
+		};
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(FovY, Aspect, NearZ, FarZ);
+		for (int i = 0; i < count; ++i)
+		{
+			View view;
+			const float x = TerrainOffset.x + WorldSize * (0.1f + 0.8f * next());
+			const float z = TerrainOffset.z + WorldSize * (0.1f + 0.8f * next());
+			view.Eye = XMFLOAT3(x, heights.Sample(x, z) + 2.0f + 30.0f * next() * next(), z);
+			const float yaw = 2.0f * Pi * next(), pitch = -0.15f + 0.2f * next();
+			const XMVECTOR eye = XMLoadFloat3(&view.Eye);
+			const XMVECTOR look = XMVectorSet(std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw), 0.0f);
+			const XMMATRIX viewMatrix = XMMatrixLookToLH(eye, look, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			XMStoreFloat4x4(&view.ViewProj, viewMatrix * proj);
+			BoundingFrustum::CreateFromMatrix(view.Frustum, proj);
+			XMVECTOR det;
+			view.Frustum.Transform(view.Frustum, XMMatrixInverse(&det, viewMatrix));
+			views.push_back(view);
+		}
+		return views;
+	}
+
+	struct Scene
+	{
+		Terrain Ground;
+		std::vector<std::vector<float>> Occluders;   // by tileIndex
+		std::vector<uint32_t> Indices;
+	};
+
+	// The visible tiles of a view, nearest first, as UpdateOcclusion orders them
+	std::vector<Tile*> VisibleTiles(Scene& scene, const View& view)
+	{
+		BoundingFrustum frustum = view.Frustum;
+		scene.Ground.Update(view.Eye, frustum, nullptr, 0);
+		std::vector<Tile*> tiles = scene.Ground.GetVisibleTiles();
+		const XMFLOAT3 eye = view.Eye;
+		std::stable_sort(tiles.begin(), tiles.end(), [&eye](const Tile* a, const Tile* b)
+		{
+			auto distance = [&eye](const Tile* tile)
+			{
+				const BoundingBox& box = tile->boundingBox;
+				const float dx = (std::max)(std::fabs(eye.x - box.Center.x) - box.Extents.x, 0.0f);
+				const float dz = (std::max)(std::fabs(eye.z - box.Center.z) - box.Extents.z, 0.0f);
+				return dx * dx + dz * dz;
+			};
+			return distance(a) < distance(b);
+		});
+		return tiles;
+	}
+
+	void DrawOccluders(OcclusionBuffer& buffer, const Scene& scene, const View& view, const std::vector<Tile*>& order, size_t count)
+	{
+		buffer.Begin(view.ViewProj.m);
+		for (size_t i = 0; i < count && i < order.size(); ++i)
+		{
+			const auto& occluder = scene.Occluders[order[i]->tileIndex];
+			buffer.RenderOccluder(occluder.data(), (uint32_t)(occluder.size() / 3), scene.Indices.data(), (uint32_t)scene.Indices.size());
+		}
+		buffer.Finish();
+	}
+
+	//
+	// Checks
+	//
+
+	// The box's screen rectangle tested pixel by pixel on the full-resolution
+	// depth, with the same projection and comparison as IsOccluded
+	bool OccludedPerPixel(const OcclusionBuffer& buffer, const float viewProj[4][4], const Aabb& box)
+	{
+		float minX = 0.0f, maxX = 0.0f, minY = 0.0f, maxY = 0.0f, minZ = 0.0f;
+		for (int i = 0; i < 8; ++i)
+		{
+			const float p[3] = { (i & 1) ? box.Max[0] : box.Min[0], (i & 2) ? box.Max[1] : box.Min[1], (i & 4) ? box.Max[2] : box.Min[2] };
+			float clip[4];
+			for (int c = 0; c < 4; ++c)
+				clip[c] = p[0] * viewProj[0][c] + p[1] * viewProj[1][c] + p[2] * viewProj[2][c] + viewProj[3][c];
+			if (clip[2] < 0.0f || clip[3] <= 0.0f)
+				return false;
+			const float x = (clip[0] / clip[3] * 0.5f + 0.5f) * buffer.GetWidth();
+			const float y = (0.5f - clip[1] / clip[3] * 0.5f) * buffer.GetHeight();
+			const float z = clip[2] / clip[3];
+			minX = i == 0 ? x : (std::min)(minX, x);
+			maxX = i == 0 ? x : (std::max)(maxX, x);
+			minY = i == 0 ? y : (std::min)(minY, y);
+			maxY = i == 0 ? y : (std::max)(maxY, y);
+			minZ = i == 0 ? z : (std::min)(minZ, z);
+		}
+		if (maxX < 0.0f || maxY < 0.0f || minX >= (float)buffer.GetWidth() || minY >= (float)buffer.GetHeight() || minZ > 1.0f)
+			return false;
+
+		const int x0 = (std::max)(0, (int)minX), x1 = (std::min)((int)buffer.GetWidth() - 1, (int)maxX);
+		const int y0 = (std::max)(0, (int)minY), y1 = (std::min)((int)buffer.GetHeight() - 1, (int)maxY);
+		for (int y = y0; y <= y1; ++y)
+			for (int x = x0; x <= x1; ++x)
+				if (buffer.GetDepth(x, y) >= minZ)
+					return false;
+		return true;
+	}
+
+	struct CheckTotals
+	{
+		size_t Tiles = 0;
+		size_t HiddenHiZ = 0;
+		size_t HiddenPixels = 0;
+		float MaxDepthDifference = 0.0f;
+	};
+
+	void RunChecks(Scene& scene, const std::vector<View>& views, CheckTotals& totals)
+	{
+		OcclusionBuffer simd, scalar;
+		scalar.SetUseSimd(false);
+		for (size_t v = 0; v < views.size(); ++v)
+		{
+			const View& view = views[v];
+			const std::string where = "camera " + std::to_string(v);
+			const std::vector<Tile*> tiles = VisibleTiles(scene, view);
+			DrawOccluders(simd, scene, view, tiles, AppOccluders);
+			DrawOccluders(scalar, scene, view, tiles, AppOccluders);
+
+			float maxDifference = 0.0f;
+			size_t differing = 0;
+			for (uint32_t y = 0; y < simd.GetHeight(); ++y)
+			{
+				for (uint32_t x = 0; x < simd.GetWidth(); ++x)
+				{
+					const float d = std::fabs(simd.GetDepth(x, y) - scalar.GetDepth(x, y));
+					maxDifference = (std::max)(maxDifference, d);
+					differing += d != 0.0f;
+				}
+			}
+			totals.MaxDepthDifference = (std::max)(totals.MaxDepthDifference, maxDifference);
+			Check(differing == 0, "simd", where + ": " + std::to_string(differing) + " pixels differ from the scalar rasterizer, up to " +
+				std::to_string(maxDifference));
+			Check(simd.GetStats().TrianglesDrawn == scalar.GetStats().TrianglesDrawn, "simd", where + ": " +
+				std::to_string(simd.GetStats().TrianglesDrawn) + " triangles drawn, scalar " + std::to_string(scalar.GetStats().TrianglesDrawn));
+
+			size_t disagree = 0, notConservative = 0;
+			for (const Tile* tile : tiles)
+			{
+				const Aabb box = ToAabb(tile->boundingBox);
+				const bool hiz = simd.IsOccluded(box);
+				disagree += hiz != scalar.IsOccluded(box);
+				const bool pixels = OccludedPerPixel(simd, view.ViewProj.m, box);
+				notConservative += hiz && !pixels;
+				totals.HiddenHiZ += hiz;
+				totals.HiddenPixels += pixels;
+			}
+			totals.Tiles += tiles.size();
+			Check(disagree == 0, "simd", where + ": " + std::to_string(disagree) + " tiles hidden by one rasterizer only");
+			Check(notConservative == 0, "hiz", where + ": " + std::to_string(notConservative) + " of " + std::to_string(tiles.size()) +
+				" tiles hidden by the pyramid but visible in some pixel");
+		}
+	}
+
+	//
+	// Bench
+	//
+
+	struct Sample
+	{
+		int Occluders = 0;
+		std::vector<double> SimdMs;
+		std::vector<double> ScalarMs;
+		size_t Tiles = 0;
+		size_t Hidden = 0;
+		uint64_t TrianglesDrawn = 0;   // per view
+	};
+
+	// What UpdateOcclusion does in a frame, the walk excluded
+	double OcclusionFrame(OcclusionBuffer& buffer, const Scene& scene, const View& view, std::vector<Tile*> tiles, int count, size_t* hidden)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const XMFLOAT3 eye = view.Eye;
+		auto distance = [&eye](const Tile* tile)
+		{
+			const BoundingBox& box = tile->boundingBox;
+			const float dx = (std::max)(std::fabs(eye.x - box.Center.x) - box.Extents.x, 0.0f);
+			const float dz = (std::max)(std::fabs(eye.z - box.Center.z) - box.Extents.z, 0.0f);
+			return dx * dx + dz * dz;
+		};
+		const size_t n = (std::min)(tiles.size(), (size_t)count);
+		std::partial_sort(tiles.begin(), tiles.begin() + n, tiles.end(),
+			[&distance](const Tile* a, const Tile* b) { return distance(a) < distance(b); });
+		DrawOccluders(buffer, scene, view, tiles, n);
+		size_t occluded = 0;
+		for (const Tile* tile : tiles)
+			occluded += buffer.IsOccluded(ToAabb(tile->boundingBox));
+		const double ms = MsSince(start);
+		gSink = gSink + occluded;
+		if (hidden)
+			*hidden = occluded;
+		return ms;
+	}
+
+	std::vector<Sample> Measure(const BenchConfig& config, Scene& scene, const std::vector<View>& views)
+	{
+		std::vector<std::vector<Tile*>> visible;
+		for (const View& view : views)
+			visible.push_back(VisibleTiles(scene, view));
+
+		OcclusionBuffer simd, scalar;
+		scalar.SetUseSimd(false);
+		std::vector<Sample> samples;
+		for (int count : OccluderCounts)
+		{
+			Sample sample;
+			sample.Occluders = count;
+			for (size_t v = 0; v < views.size(); ++v)
+			{
+				size_t hidden = 0;
+				OcclusionFrame(simd, scene, views[v], visible[v], count, &hidden);
+				sample.Tiles += visible[v].size();
+				sample.Hidden += hidden;
+				sample.TrianglesDrawn += simd.GetStats().TrianglesDrawn;
+				for (int rep = 0; rep < config.Reps; ++rep)
+				{
+					sample.SimdMs.push_back(OcclusionFrame(simd, scene, views[v], visible[v], count, nullptr));
+					sample.ScalarMs.push_back(OcclusionFrame(scalar, scene, views[v], visible[v], count, nullptr));
+				}
+			}
+			sample.TrianglesDrawn /= views.size();
+			samples.push_back(sample);
+		}
+		return samples;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, Scene& scene, const CheckTotals& totals, const std::vector<Sample>& samples)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"OcclusionBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"heightmap\": " << JsonString(config.Heightmap.empty() ? "hills" : config.Heightmap)
+			<< ", \"cameras\": " << config.Cameras << ", \"reps\": " << config.Reps << ", \"buffer\": \"256x144\""
+			<< ", \"tiles_total\": " << scene.Ground.GetAllTiles().size() << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"failures\": " << gFailures << " },\n";
+		out << "  \"checks\": { \"tiles\": " << totals.Tiles << ", \"hidden_hiz\": " << totals.HiddenHiZ << ", \"hidden_pixels\": " << totals.HiddenPixels
+			<< ", \"max_simd_depth_difference\": " << totals.MaxDepthDifference << " },\n";
+		out << "  \"results\": [\n";
+		for (size_t s = 0; s < samples.size(); ++s)
+		{
+			const Sample& sample = samples[s];
+			out << "    {\n";
+			out << "      \"occluders\": " << sample.Occluders << ", \"hidden_fraction\": "
+				<< (sample.Tiles ? (double)sample.Hidden / sample.Tiles : 0.0) << ", \"triangles_drawn\": "
+				<< sample.TrianglesDrawn << ",\n";
+			WriteSummary(out, "simd_ms", sample.SimdMs, [](double v) { return v; });
+			WriteSummary(out, "scalar_ms", sample.ScalarMs, [](double v) { return v; }, true);
+			out << "    }" << (s + 1 < samples.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--heightmap" && hasValue) config.Heightmap = argv[++i];
+			else if (arg == "--cameras" && hasValue) config.Cameras = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--reps" && hasValue) config.Reps = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	HeightField heights;
+	if (!config.Heightmap.empty())
+	{
+		std::vector<uint8_t> rgba;
+		uint32_t width = 0, height = 0;
+		if (!BCEncoder::LoadDDS(std::filesystem::path(config.Heightmap).wstring(), rgba, width, height))
+		{
+			std::cerr << "Cannot load " << config.Heightmap << "\n";
+			return 1;
+		}
+		heights.Init(rgba.data(), width, height, (size_t)width * 4);
+	}
+	else
+	{
+		BuildHills(heights, 512);
+	}
+	heights.SetPlacement(TerrainOffset.x, TerrainOffset.z, WorldSize, TerrainOffset.y, HeightScale);
+
+	Scene scene;
+	scene.Ground.Initialize(WorldSize, MaxLod, TerrainOffset);
+	scene.Ground.mHeightScale = HeightScale;
+	scene.Ground.SetHeights(&heights);
+	HeightField::BuildGridIndices(OccluderResolution, scene.Indices);
+	for (auto& tile : scene.Ground.GetAllTiles())
+	{
+		if (tile->tileIndex >= (int)scene.Occluders.size())
+			scene.Occluders.resize(tile->tileIndex + 1);
+		heights.BuildOccluder(tile->worldPos.x, tile->worldPos.z, tile->tileSize, OccluderResolution,
+			tile->tileSize / 7.0f, scene.Occluders[tile->tileIndex]);
+	}
+
+	const std::vector<View> views = MakeViews(heights, config.Cameras);
+	CheckTotals totals;
+	RunChecks(scene, views, totals);
+	fprintf(stderr, "checks: %zu visible tiles, pyramid hides %zu, pixels hide %zu (%.0f%% found), SIMD depth off by at most %g\n",
+		totals.Tiles, totals.HiddenHiZ, totals.HiddenPixels, totals.HiddenPixels ? 100.0 * totals.HiddenHiZ / totals.HiddenPixels : 100.0,
+		totals.MaxDepthDifference);
+
+	const std::vector<Sample> samples = Measure(config, scene, views);
+	fprintf(stderr, "occluders   simd ms  scalar ms  hidden  triangles\n");
+	for (const Sample& s : samples)
+	{
+		fprintf(stderr, "%9d %9.3f %10.3f %6.1f%% %10llu\n", s.Occluders, Percentile(s.SimdMs, 0.50), Percentile(s.ScalarMs, 0.50),
+			s.Tiles ? 100.0 * s.Hidden / s.Tiles : 0.0, (unsigned long long)s.TrianglesDrawn);
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, scene, totals, samples);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
@@ -0,0 +1,423 @@
+//***************************************************************************************
+// ProfilerBench.cpp
+//
+// Checks and benchmarks the scoped CPU profiler. The bench part times
+// --rounds rounds of --zones empty PROFILE_SCOPE blocks on the main thread,
+// less the same loop without the scope, with recording on and switched off.
+// A recorded zone must cost under 50 ns in the fastest round; other rounds
+// only add what the machine did meanwhile, and their median is reported.
+// Two of Profiler::Now are part of every zone, so its cost is reported too:
+// under a hypervisor that traps the TSC it is most of the budget.
+//
+// The check part then records one frame the way the app does: four worker
+// threads each open --pairs "outer" zones with an "inner" one inside while
+// the main thread holds "Update" with "UpdateTerrain" inside it for 2 ms.
+// After BeginFrame every zone must be there exactly once, inside the frame,
+// on the thread that recorded it and under its thread's name, with every
+// inner zone one level deeper than, and inside, an outer zone of the same
+// thread. Last, every worker records more zones in one frame than its ring
+// holds: each ring must keep exactly its capacity, the rest must be counted
+// as dropped, and the next frame must record normally again. Then rounds
+// of 16 short-lived threads record a few zones each, with a BeginFrame after
+// every round: every zone must arrive under its thread's name, and the
+// threads of later rounds must reuse the rings of earlier ones, so the ring
+// count stays what the first round left. A failure exits with 3.
+//
+// Needs no GPU or window. Windows: ProfilerBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common ProfilerBench.cpp
+//       -L<dir> -lTerrainCore -o ProfilerBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: ProfilerBench [options]
+//   --zones <n>          zones per timed round, at most a ring (10000)
+//   --rounds <n>         timed rounds (30)
+//   --pairs <n>          outer/inner pairs per worker, at most half a ring (4000)
+//   --trace <file.json>  also write the checked frame as a Chrome trace
+//   --label <text>       stored in the output, e.g. the commit
+//   --out <file.json>    (stdout)
+//***************************************************************************************
+
+#include "Profiler.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const double MaxZoneNs = 50.0;
+	const int Workers = 4;
+	const char* const WorkerNames[Workers] = { "Worker 0", "Worker 1", "Worker \"2\"", "Worker 3" };
+
+	struct BenchConfig
+	{
+		int Zones = 10000;
+		int Rounds = 30;
+		int Pairs = 4000;
+		std::string Trace;
+		std::string Label;
+		std::string Out;
+	};
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	// Kept alive so the compiler cannot drop a loop
+	volatile int gSink = 0;
+
+	double NsPer(std::chrono::steady_clock::time_point start, int count)
+	{
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+	}
+
+	//
+	// Bench
+	//
+
+	struct Sample
+	{
+		double ZoneNs = 0.0;          // recorded zone, less the bare loop
+		double DisabledNs = 0.0;      // scope with recording off, less the bare loop
+		double LoopNs = 0.0;
+		double NowNs = 0.0;           // one Profiler::Now, less the bare loop
+	};
+
+	std::vector<Sample> Measure(const BenchConfig& config)
+	{
+		Profiler& profiler = Profiler::Get();
+		std::vector<Sample> samples;
+		for (int round = 0; round < config.Rounds; ++round)
+		{
+			Sample sample;
+			profiler.BeginFrame();
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < config.Zones; ++i)
+				gSink = i;
+			sample.LoopNs = NsPer(start, config.Zones);
+
+			start = std::chrono::steady_clock::now();
+			for (int i = 0; i < config.Zones; ++i)
+			{
+				PROFILE_SCOPE("Empty");
+				gSink = i;
+			}
+			sample.ZoneNs = NsPer(start, config.Zones) - sample.LoopNs;
+
+			profiler.SetEnabled(false);
+			start = std::chrono::steady_clock::now();
+			for (int i = 0; i < config.Zones; ++i)
+			{
+				PROFILE_SCOPE("Disabled");
+				gSink = i;
+			}
+			sample.DisabledNs = NsPer(start, config.Zones) - sample.LoopNs;
+			profiler.SetEnabled(true);
+
+			start = std::chrono::steady_clock::now();
+			for (int i = 0; i < config.Zones; ++i)
+				gSink = (int)Profiler::Now();
+			sample.NowNs = NsPer(start, config.Zones) - sample.LoopNs;
+			samples.push_back(sample);
+		}
+		profiler.BeginFrame();
+		return samples;
+	}
+
+	//
+	// Checks
+	//
+
+	struct CheckTotals
+	{
+		size_t Zones = 0;
+		double FrameMs = 0.0;
+		double UpdateMs = 0.0;
+		uint64_t Kept = 0;            // by the flooded rings
+		uint64_t Dropped = 0;
+		size_t Rings = 0;             // after the short-lived threads
+		size_t RingsBefore = 0;
+	};
+
+	void RunThreads(int zonesPerWorker, bool flood)
+	{
+		std::vector<std::thread> threads;
+		for (int t = 0; t < Workers; ++t)
+		{
+			threads.emplace_back([t, zonesPerWorker, flood]()
+			{
+				Profiler::Get().SetThreadName(WorkerNames[t]);
+				for (int i = 0; i < zonesPerWorker; ++i)
+				{
+					if (flood)
+					{
+						PROFILE_SCOPE("Flood");
+						gSink = i;
+						continue;
+					}
+					PROFILE_SCOPE("outer");
+					{
+						PROFILE_SCOPE("inner");
+						gSink = i;
+					}
+				}
+			});
+		}
+		if (!flood)
+		{
+			PROFILE_SCOPE("Update");
+			{
+				PROFILE_SCOPE("UpdateTerrain");
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			}
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+
+	void CheckFrame(const BenchConfig& config, CheckTotals& totals)
+	{
+		Profiler& profiler = Profiler::Get();
+		profiler.BeginFrame();
+		profiler.ClearHistory();
+		const uint64_t droppedBefore = profiler.GetDroppedZones();
+
+		RunThreads(config.Pairs, false);
+		profiler.BeginFrame();
+		const ProfileFrame& frame = profiler.GetLastFrame();
+		const std::vector<std::string> names = profiler.GetThreadNames();
+		totals.Zones = frame.Zones.size();
+		totals.FrameMs = (frame.End - frame.Start) / 1e6;
+
+		const size_t expected = (size_t)Workers * 2 * config.Pairs + 2;
+		Check(frame.Zones.size() == expected, "zones", std::to_string(frame.Zones.size()) + " zones, " + std::to_string(expected) + " expected");
+		Check(profiler.GetDroppedZones() == droppedBefore, "zones", std::to_string(profiler.GetDroppedZones() - droppedBefore) + " zones dropped");
+
+		// Per thread and name: zone counts, and the open outer zone for nesting
+		std::map<std::string, int> counts;
+		std::vector<const ProfileZone*> open(names.size(), nullptr);
+		size_t outside = 0, unordered = 0, unnested = 0;
+		for (size_t i = 0; i < frame.Zones.size(); ++i)
+		{
+			const ProfileZone& zone = frame.Zones[i];
+			if (zone.Thread >= names.size())
+			{
+				Check(false, "threads", "zone on unknown thread " + std::to_string(zone.Thread));
+				continue;
+			}
+			const std::string key = names[zone.Thread] + "/" + zone.Name;
+			++counts[key];
+			outside += zone.Start < frame.Start || zone.End > frame.End || zone.End < zone.Start;
+			if (i > 0)
+			{
+				const ProfileZone& previous = frame.Zones[i - 1];
+				unordered += previous.Thread > zone.Thread || (previous.Thread == zone.Thread && previous.Start > zone.Start);
+			}
+
+			if (zone.Depth == 0)
+			{
+				open[zone.Thread] = &zone;
+				continue;
+			}
+			const ProfileZone* parent = open[zone.Thread];
+			unnested += !parent || zone.Depth != parent->Depth + 1 || zone.Start < parent->Start || zone.End > parent->End;
+			if (parent && std::string(names[zone.Thread]) == "Main" && std::string(zone.Name) == "UpdateTerrain")
+				totals.UpdateMs = (parent->End - parent->Start) / 1e6;
+		}
+		Check(outside == 0, "zones", std::to_string(outside) + " zones not inside the frame");
+		Check(unordered == 0, "zones", std::to_string(unordered) + " zones out of thread and start order");
+		Check(unnested == 0, "nesting", std::to_string(unnested) + " inner zones not inside an outer zone one level up");
+
+		for (const char* name : WorkerNames)
+		{
+			for (const char* zone : { "outer", "inner" })
+			{
+				const int count = counts[std::string(name) + "/" + zone];
+				Check(count == config.Pairs, "threads", std::string(name) + " has " + std::to_string(count) + " " + zone + " zones, " +
+					std::to_string(config.Pairs) + " expected");
+			}
+		}
+		Check(counts["Main/Update"] == 1 && counts["Main/UpdateTerrain"] == 1, "threads", "Main lost Update or UpdateTerrain");
+		Check(totals.UpdateMs >= 2.0, "nesting", "Update took " + std::to_string(totals.UpdateMs) + " ms around a 2 ms sleep");
+
+		if (!config.Trace.empty())
+			Check(profiler.WriteChromeTrace(config.Trace), "trace", "cannot write " + config.Trace);
+
+		// More than a ring holds in one frame: the excess is dropped and counted
+		const uint32_t capacity = Profiler::ThreadRing::Capacity;
+		const int extra = 1000;
+		RunThreads((int)capacity + extra, true);
+		profiler.BeginFrame();
+		totals.Kept = profiler.GetLastFrame().Zones.size();
+		totals.Dropped = profiler.GetDroppedZones() - droppedBefore;
+		Check(totals.Kept == (uint64_t)Workers * capacity, "drop", std::to_string(totals.Kept) + " zones kept, " +
+			std::to_string((uint64_t)Workers * capacity) + " expected");
+		Check(totals.Dropped == (uint64_t)Workers * extra, "drop", std::to_string(totals.Dropped) + " zones dropped, " +
+			std::to_string(Workers * extra) + " expected");
+
+		RunThreads(10, false);
+		profiler.BeginFrame();
+		Check(profiler.GetLastFrame().Zones.size() == (size_t)Workers * 20 + 2, "drop", std::to_string(profiler.GetLastFrame().Zones.size()) +
+			" zones in the frame after the flood, " + std::to_string(Workers * 20 + 2) + " expected");
+		Check(profiler.GetDroppedZones() - droppedBefore == totals.Dropped, "drop", "zones dropped in the frame after the flood");
+	}
+
+	// Threads that come and go take over the rings of exited ones
+	void CheckThreadChurn(CheckTotals& totals)
+	{
+		const int Rounds = 8;
+		const int ThreadsPerRound = 16;
+		const int ZonesPerThread = 10;
+		const char* const RoundNames[2] = { "Churn even", "Churn odd" };
+
+		Profiler& profiler = Profiler::Get();
+		profiler.BeginFrame();
+		totals.RingsBefore = profiler.GetThreadNames().size();
+		for (int round = 0; round < Rounds; ++round)
+		{
+			const char* name = RoundNames[round % 2];
+			std::vector<std::thread> threads;
+			for (int t = 0; t < ThreadsPerRound; ++t)
+			{
+				threads.emplace_back([name]()
+				{
+					Profiler::Get().SetThreadName(name);
+					for (int i = 0; i < ZonesPerThread; ++i)
+					{
+						PROFILE_SCOPE("Churn");
+						gSink = i;
+					}
+				});
+			}
+			for (std::thread& thread : threads)
+				thread.join();
+
+			profiler.BeginFrame();
+			const std::vector<std::string> names = profiler.GetThreadNames();
+			size_t zones = 0, named = 0;
+			for (const ProfileZone& zone : profiler.GetLastFrame().Zones)
+			{
+				zones += std::string(zone.Name) == "Churn";
+				named += std::string(zone.Name) == "Churn" && zone.Thread < names.size() && names[zone.Thread] == name;
+			}
+			const std::string where = "round " + std::to_string(round) + ": ";
+			Check(zones == (size_t)ThreadsPerRound * ZonesPerThread, "churn", where + std::to_string(zones) + " zones, " +
+				std::to_string(ThreadsPerRound * ZonesPerThread) + " expected");
+			Check(named == zones, "churn", where + std::to_string(zones - named) + " zones not under their thread's name");
+			if (round == 0)
+				totals.Rings = names.size();
+			Check(names.size() == totals.Rings && totals.Rings <= totals.RingsBefore + ThreadsPerRound, "churn", where +
+				std::to_string(names.size()) + " rings, " + std::to_string(totals.Rings) + " after the first round, " +
+				std::to_string(totals.RingsBefore) + " before it");
+		}
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<Sample>& samples, const CheckTotals& totals)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"ProfilerBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"zones\": " << config.Zones << ", \"rounds\": " << config.Rounds << ", \"pairs\": " << config.Pairs << ", \"workers\": " << Workers
+			<< ", \"rdtsc\": " << (PROFILER_USE_RDTSC ? "true" : "false") << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"failures\": " << gFailures << " },\n";
+		out << "  \"checks\": { \"zones\": " << totals.Zones << ", \"frame_ms\": " << totals.FrameMs << ", \"update_ms\": " << totals.UpdateMs
+			<< ", \"flood_kept\": " << totals.Kept << ", \"flood_dropped\": " << totals.Dropped << ", \"rings_before_churn\": " << totals.RingsBefore
+			<< ", \"rings_after_churn\": " << totals.Rings << " },\n";
+		out << "  \"results\": [\n";
+		out << "    {\n";
+		WriteSummary(out, "zone_ns", samples, [](const Sample& s) { return s.ZoneNs; });
+		WriteSummary(out, "disabled_ns", samples, [](const Sample& s) { return s.DisabledNs; });
+		WriteSummary(out, "now_ns", samples, [](const Sample& s) { return s.NowNs; });
+		WriteSummary(out, "loop_ns", samples, [](const Sample& s) { return s.LoopNs; }, true);
+		out << "    }\n";
+		out << "  ]\n}\n";
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			const int ring = (int)Profiler::ThreadRing::Capacity;
+			if (arg == "--zones" && hasValue) config.Zones = (std::min)((std::max)(atoi(argv[++i]), 1), ring);
+			else if (arg == "--rounds" && hasValue) config.Rounds = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--pairs" && hasValue) config.Pairs = (std::min)((std::max)(atoi(argv[++i]), 1), ring / 2 - 1);
+			else if (arg == "--trace" && hasValue) config.Trace = argv[++i];
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	Profiler::Get().SetThreadName("Main");
+	const std::vector<Sample> samples = Measure(config);
+	std::vector<double> zoneNs, disabledNs, nowNs;
+	for (const Sample& s : samples)
+	{
+		zoneNs.push_back(s.ZoneNs);
+		disabledNs.push_back(s.DisabledNs);
+		nowNs.push_back(s.NowNs);
+	}
+	const double zoneBest = *std::min_element(zoneNs.begin(), zoneNs.end());
+	Check(zoneBest < MaxZoneNs, "overhead", "a zone costs " + std::to_string(zoneBest) + " ns, the budget is " + std::to_string(MaxZoneNs));
+	fprintf(stderr, "zone %.1f ns (median %.1f, p95 %.1f), recording off %.1f ns, Profiler::Now %.1f ns\n", zoneBest, Percentile(zoneNs, 0.50),
+		Percentile(zoneNs, 0.95), Percentile(disabledNs, 0.50), Percentile(nowNs, 0.50));
+
+	CheckTotals totals;
+	CheckFrame(config, totals);
+	CheckThreadChurn(totals);
+	fprintf(stderr, "frame: %zu zones over %.2f ms, Update %.2f ms; flood kept %llu, dropped %llu; rings %zu before short-lived threads, %zu after\n",
+		totals.Zones, totals.FrameMs, totals.UpdateMs, (unsigned long long)totals.Kept, (unsigned long long)totals.Dropped, totals.RingsBefore,
+		totals.Rings);
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, samples, totals);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
@@ -0,0 +1,719 @@
+//***************************************************************************************
+// ResidencyBench.cpp
+//
+// Checks the texture residency manager (TextureResidency) and times its
+// Update under budget pressure.
+//
+// The check part runs fixed scenarios: the wanted mip for a set of screen
+// sizes and mip biases, finer requests applying at once and coarser ones
+// only after the evict delay, eviction from the least important textures
+// first when the budget is short, the per-update stream-in cap, and a budget
+// lowered and raised again at runtime. --rounds random rounds then mix
+// requests, budget, cap and mip bias changes over many textures; after every
+// Update the resident mip must lie between the wanted and the coarsest one,
+// the budget must hold unless everything is down to its coarsest mip, the
+// stream-in must stay under the cap, a starved texture must have nothing
+// left to take from less important ones, and the changes must say exactly
+// what moved. The same round run twice must make the same decisions. Any
+// violation is a failure and the exit code is 3.
+//
+// The bench part places --textures textures on meshes around a camera that
+// circles the map for --frames updates, with the app's stream-in cap and
+// evict delay. A run without a budget finds the most the wanted mips ever
+// add up to; budgets of 100% down to 25% of that follow, and each reports
+// the Update time, what it moved and how many textures went without.
+//
+// Needs no GPU or window. Windows: ResidencyBench.vcxproj. Elsewhere:
+//   g++ -std=c++17 -O2 -pthread -I.. -I../../../Common ResidencyBench.cpp
+//       -L<dir> -lTerrainCore -o ResidencyBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: ResidencyBench [options]
+//   --textures <n>      bench: textures (512)
+//   --frames <n>        bench: updates per budget (600)
+//   --rounds <n>        random check rounds (8); 0 skips them
+//   --no-bench          checks only
+//   --label <text>      stored in the output, e.g. the commit
+//   --out <file.json>   (stdout)
+//***************************************************************************************
+
+#include "TextureResidency.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const uint64_t MB = 1024ull * 1024ull;
+	const uint64_t AppStreamInCap = 32 * MB;   // as TexColumnsApp sets them
+	const uint32_t AppEvictDelay = 6;
+
+	struct BenchConfig
+	{
+		int Textures = 512;
+		int Frames = 600;
+		int Rounds = 8;
+		bool Bench = true;
+		std::string Label;
+		std::string Out;
+	};
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	double UsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Mip sizes and coarsest mip the way the app registers a DDS: BC3 or
+	// RGBA8, a tail of at least 64 texels kept resident
+	ResidencyTextureDesc MakeDesc(uint32_t width, uint32_t height, bool blockCompressed)
+	{
+		ResidencyTextureDesc desc;
+		desc.Width = width;
+		desc.Height = height;
+		for (uint32_t mip = 0; (width >> mip) > 0 || (height >> mip) > 0; ++mip)
+		{
+			const uint32_t w = (std::max)(1u, width >> mip);
+			const uint32_t h = (std::max)(1u, height >> mip);
+			desc.MipBytes.push_back(blockCompressed ? (uint64_t)((w + 3) / 4) * ((h + 3) / 4) * 16 : (uint64_t)w * h * 4);
+			if ((std::max)(w, h) >= 64 && (!blockCompressed || (w % 4 == 0 && h % 4 == 0)))
+				desc.CoarsestMip = mip;
+		}
+		return desc;
+	}
+
+	uint64_t BytesFrom(const ResidencyTextureDesc& desc, uint32_t mip)
+	{
+		uint64_t bytes = 0;
+		for (size_t i = mip; i < desc.MipBytes.size(); ++i)
+			bytes += desc.MipBytes[i];
+		return bytes;
+	}
+
+	std::string Texture(int texture)
+	{
+		return "texture " + std::to_string(texture);
+	}
+
+	// Textures with the same desc and wanted mip: the more important one is
+	// never the one with less detail
+	void CheckPriorityOrder(const TextureResidency& residency, const std::string& where)
+	{
+		for (int a = 0; a < residency.GetTextureCount(); ++a)
+		{
+			for (int b = 0; b < residency.GetTextureCount(); ++b)
+			{
+				if (residency.GetPriority(a) <= residency.GetPriority(b) || residency.GetWantedMip(a) != residency.GetWantedMip(b) ||
+					residency.GetDesc(a).MipBytes != residency.GetDesc(b).MipBytes)
+					continue;
+				Check(residency.GetResidentMip(a) <= residency.GetResidentMip(b), "priority", where + ": " + Texture(a) + " at mip " +
+					std::to_string(residency.GetResidentMip(a)) + " is more important than " + Texture(b) + " at mip " +
+					std::to_string(residency.GetResidentMip(b)));
+			}
+		}
+	}
+
+	//
+	// Fixed scenarios
+	//
+
+	void CheckWantedMip()
+	{
+		struct Case
+		{
+			uint32_t Width, Height;
+			float Pixels[2];                   // two users, 0 = none
+			float Bias;
+			uint32_t Mip;                      // wanted after one Update
+		};
+		// 1024 BC3 keeps mips 0..4 (64 texels) streamable
+		const Case cases[] = {
+			{ 1024, 1024, { 1024.0f, 0.0f }, 0.0f, 0 },
+			{ 1024, 1024, { 4096.0f, 0.0f }, 0.0f, 0 },
+			{ 1024, 1024, { 512.0f, 0.0f }, 0.0f, 1 },
+			{ 1024, 1024, { 256.0f, 0.0f }, 0.0f, 2 },
+			{ 1024, 1024, { 128.0f, 0.0f }, 0.0f, 3 },
+			{ 1024, 1024, { 64.0f, 0.0f }, 0.0f, 4 },
+			{ 1024, 1024, { 8.0f, 0.0f }, 0.0f, 4 },      // clamped to the resident tail
+			{ 1024, 1024, { 0.0f, 0.0f }, 0.0f, 4 },      // nobody asked
+			{ 1024, 1024, { 64.0f, 512.0f }, 0.0f, 1 },   // the larger user wins
+			{ 1024, 1024, { 512.0f, 64.0f }, 0.0f, 1 },
+			{ 1024, 1024, { 512.0f, 0.0f }, 1.0f, 2 },
+			{ 1024, 1024, { 512.0f, 0.0f }, -1.0f, 0 },
+			{ 1024, 1024, { 2048.0f, 0.0f }, 1.0f, 0 },
+			{ 1024, 256, { 256.0f, 0.0f }, 0.0f, 2 },     // longest side
+			{ 256, 1024, { 128.0f, 0.0f }, 0.0f, 3 },
+		};
+		for (const Case& c : cases)
+		{
+			TextureResidency residency;
+			residency.SetMipBias(c.Bias);
+			const int id = residency.AddTexture(MakeDesc(c.Width, c.Height, true), 31);
+			residency.BeginFrame();
+			for (float pixels : c.Pixels)
+				if (pixels > 0.0f)
+					residency.RequestScreenSize(id, pixels);
+			residency.Update();
+
+			const std::string where = std::to_string(c.Width) + "x" + std::to_string(c.Height) + " at " + std::to_string((int)c.Pixels[0]) +
+				"/" + std::to_string((int)c.Pixels[1]) + " px, bias " + std::to_string(c.Bias);
+			Check(residency.GetWantedMip(id) == c.Mip, "wanted mip", where + ": mip " + std::to_string(residency.GetWantedMip(id)) + ", " +
+				std::to_string(c.Mip) + " expected");
+			Check(residency.GetResidentMip(id) == c.Mip, "wanted mip", where + ": resident mip " + std::to_string(residency.GetResidentMip(id)) +
+				" with the budget to spare");
+		}
+
+		TextureResidency residency;
+		Check(residency.MipForScreenSize(1024, 16.0f) == 6, "wanted mip", "MipForScreenSize(1024, 16) is not 6");
+		Check(residency.MipForScreenSize(1024, 0.0f) == UINT32_MAX, "wanted mip", "MipForScreenSize(1024, 0) asks for a mip");
+	}
+
+	void CheckEvictDelay()
+	{
+		// Screen size each frame (0 = not requested) and what must be wanted
+		// and resident after it, with an evict delay of 5 frames
+		struct Frame
+		{
+			float Pixels;
+			uint32_t Wanted;
+		};
+		const Frame frames[] = {
+			{ 1024.0f, 0 },                    // 1: finer applies at once
+			{ 64.0f, 0 }, { 64.0f, 0 }, { 64.0f, 0 }, { 64.0f, 0 }, { 64.0f, 0 },
+			{ 64.0f, 4 },                      // 7: six frames after the last mip 0 request
+			{ 1024.0f, 0 },                    // 8
+			{ 0.0f, 0 }, { 0.0f, 0 }, { 0.0f, 0 }, { 0.0f, 0 }, { 0.0f, 0 },
+			{ 0.0f, 4 },                       // 14: nobody asked for six frames
+			{ 256.0f, 2 },                     // 15
+			{ 1024.0f, 0 },                    // 16
+			{ 512.0f, 0 }, { 256.0f, 0 }, { 128.0f, 0 }, { 128.0f, 0 }, { 128.0f, 0 },
+			{ 128.0f, 1 },                     // 22: mip 0 expired, mip 1 was asked for at 17
+			{ 128.0f, 2 },                     // 23: then mip 2 from 18
+			{ 128.0f, 3 },
+			{ 128.0f, 3 },
+		};
+
+		TextureResidency residency;
+		residency.SetEvictDelay(5);
+		const int id = residency.AddTexture(MakeDesc(1024, 1024, true), 31);
+		uint32_t resident = residency.GetResidentMip(id);
+		for (size_t f = 0; f < sizeof(frames) / sizeof(frames[0]); ++f)
+		{
+			const std::string where = "frame " + std::to_string(f + 1);
+			residency.BeginFrame();
+			if (frames[f].Pixels > 0.0f)
+				residency.RequestScreenSize(id, frames[f].Pixels);
+			const std::vector<ResidencyChange> changes = residency.Update();
+
+			Check(residency.GetWantedMip(id) == frames[f].Wanted, "evict delay", where + ": mip " + std::to_string(residency.GetWantedMip(id)) +
+				" wanted, " + std::to_string(frames[f].Wanted) + " expected");
+			const bool moved = frames[f].Wanted != resident;
+			Check(changes.size() == (moved ? 1u : 0u), "evict delay", where + ": " + std::to_string(changes.size()) + " changes");
+			if (moved && changes.size() == 1)
+				Check(changes[0].Texture == id && changes[0].OldMip == resident && changes[0].NewMip == frames[f].Wanted, "evict delay",
+					where + ": change from mip " + std::to_string(changes[0].OldMip) + " to " + std::to_string(changes[0].NewMip));
+			resident = residency.GetResidentMip(id);
+		}
+	}
+
+	// Six identical textures, more important the higher the index
+	void AddRow(TextureResidency& residency, int count, uint32_t residentMip)
+	{
+		for (int i = 0; i < count; ++i)
+			residency.AddTexture(MakeDesc(1024, 1024, true), residentMip);
+	}
+
+	void RequestRow(TextureResidency& residency)
+	{
+		residency.BeginFrame();
+		for (int i = 0; i < residency.GetTextureCount(); ++i)
+			residency.RequestScreenSize(i, 1024.0f + 100.0f * i);
+	}
+
+	void CheckPriorityEviction()
+	{
+		TextureResidency residency;
+		AddRow(residency, 6, 0);
+		const ResidencyTextureDesc& desc = residency.GetDesc(0);
+		const uint64_t full = BytesFrom(desc, 0), tail = BytesFrom(desc, desc.CoarsestMip);
+		// Room for three full textures, the tails of the rest and half of a
+		// mip 1. Texture 2 cannot fit its mip 1 and gives up mip 0 as well;
+		// what is left over goes to the small mips of textures 0 and 1.
+		residency.SetBudget(3 * full + 3 * tail + desc.MipBytes[1] / 2);
+
+		RequestRow(residency);
+		residency.Update();
+		const ResidencyStats& stats = residency.GetStats();
+		Check(stats.ResidentBytes <= residency.GetBudget(), "eviction", std::to_string(stats.ResidentBytes) + " bytes resident over a budget of " +
+			std::to_string(residency.GetBudget()));
+		Check(stats.StreamIns == 0, "eviction", std::to_string(stats.StreamIns) + " stream-ins while over budget");
+		CheckPriorityOrder(residency, "short budget");
+		const uint32_t expected[] = { desc.CoarsestMip - 1, desc.CoarsestMip - 1, 2, 0, 0, 0 };
+		for (int i = 0; i < 6; ++i)
+			Check(residency.GetResidentMip(i) == expected[i], "eviction", Texture(i) + " at mip " + std::to_string(residency.GetResidentMip(i)) +
+				", " + std::to_string(expected[i]) + " expected");
+	}
+
+	void CheckStreamInCap()
+	{
+		for (uint64_t cap : { (uint64_t)1, 600 * (MB / 1024), 3 * MB })
+		{
+			TextureResidency residency;
+			AddRow(residency, 6, 31);
+			residency.SetBudget(UINT64_MAX);
+			residency.SetMaxStreamInBytes(cap);
+			const ResidencyTextureDesc& desc = residency.GetDesc(0);
+			const uint64_t needed = 6 * (BytesFrom(desc, 0) - BytesFrom(desc, desc.CoarsestMip));
+
+			uint64_t streamed = 0;
+			int updates = 0;
+			for (; updates < 200 && residency.GetStats().ResidentBytes < 6 * BytesFrom(desc, 0); ++updates)
+			{
+				const std::string where = "cap " + std::to_string(cap) + ", update " + std::to_string(updates);
+				RequestRow(residency);
+				const std::vector<ResidencyChange> changes = residency.Update();
+				const ResidencyStats& stats = residency.GetStats();
+				streamed += stats.StreamedInBytes;
+				Check(stats.StreamedInBytes > 0, "stream-in cap", where + ": nothing streamed in");
+				// At least one mip always goes, even when it alone is over the cap
+				const bool single = changes.size() == 1 && changes[0].OldMip == changes[0].NewMip + 1;
+				Check(stats.StreamedInBytes <= cap || single, "stream-in cap", where + ": " + std::to_string(stats.StreamedInBytes) + " bytes");
+				CheckPriorityOrder(residency, where);
+			}
+			Check(streamed == needed, "stream-in cap", "cap " + std::to_string(cap) + ": " + std::to_string(streamed) + " bytes streamed, " +
+				std::to_string(needed) + " expected");
+			if (cap == 1)
+				Check(updates == 6 * (int)desc.CoarsestMip, "stream-in cap", std::to_string(updates) + " updates to stream one mip at a time");
+		}
+	}
+
+	void CheckBudgetChange()
+	{
+		TextureResidency residency;
+		AddRow(residency, 6, 0);
+		const ResidencyTextureDesc& desc = residency.GetDesc(0);
+		const uint64_t full = 6 * BytesFrom(desc, 0), tails = 6 * BytesFrom(desc, desc.CoarsestMip);
+		residency.SetBudget(full);
+		RequestRow(residency);
+		Check(residency.Update().empty() && residency.GetStats().ResidentBytes == full, "budget change", "not fully resident in an exact budget");
+
+		// Lowered: the least important give up detail, nothing streams in
+		for (uint64_t budget : { full / 2, full / 5, tails, tails / 2 })
+		{
+			const std::string where = "budget " + std::to_string(budget);
+			residency.SetBudget(budget);
+			RequestRow(residency);
+			residency.Update();
+			const ResidencyStats& stats = residency.GetStats();
+			Check(stats.StreamIns == 0, "budget change", where + ": streamed in while lowering");
+			Check(stats.ResidentBytes <= (std::max)(budget, tails), "budget change", where + ": " + std::to_string(stats.ResidentBytes) + " bytes resident");
+			Check(budget >= tails || stats.ResidentBytes == tails, "budget change", where + ": below the tails but not everything evicted");
+			Check(residency.GetResidentMip(5) <= residency.GetResidentMip(0), "budget change", where + ": most important texture lost more");
+			CheckPriorityOrder(residency, where);
+		}
+
+		// Raised: everything comes back, most important first
+		residency.SetBudget(full / 2);
+		RequestRow(residency);
+		residency.Update();
+		Check(residency.GetResidentMip(5) == 0 && residency.GetResidentMip(4) == 0 && residency.GetResidentMip(3) > 0, "budget change",
+			"half the budget does not go to the most important textures");
+		CheckPriorityOrder(residency, "budget raised to half");
+		residency.SetBudget(full);
+		RequestRow(residency);
+		residency.Update();
+		Check(residency.GetStats().ResidentBytes == full && residency.GetStats().Evictions == 0, "budget change", "not all back after raising the budget");
+	}
+
+	//
+	// Random rounds
+	//
+
+	// Every starved texture: the free budget and whatever less important
+	// textures could still give up must be less than its next mip. Ties in
+	// priority may take from each other's headroom, so they are skipped.
+	void CheckStarved(const TextureResidency& residency, const std::string& where)
+	{
+		const ResidencyStats& stats = residency.GetStats();
+		const uint64_t headroom = residency.GetBudget() > stats.ResidentBytes ? residency.GetBudget() - stats.ResidentBytes : 0;
+		for (int a = 0; a < residency.GetTextureCount(); ++a)
+		{
+			const uint32_t mip = residency.GetResidentMip(a);
+			if (mip <= residency.GetWantedMip(a))
+				continue;
+			uint64_t available = headroom;
+			bool tied = false;
+			for (int b = 0; b < residency.GetTextureCount(); ++b)
+			{
+				if (b == a)
+					continue;
+				if (residency.GetPriority(b) == residency.GetPriority(a))
+					tied = true;
+				else if (residency.GetPriority(b) < residency.GetPriority(a))
+					available += residency.GetResidentBytes(b) - BytesFrom(residency.GetDesc(b), residency.GetDesc(b).CoarsestMip);
+			}
+			const uint64_t step = residency.GetDesc(a).MipBytes[mip - 1];
+			Check(tied || available < step, "starved", where + ": " + Texture(a) + " starved at mip " + std::to_string(mip) + " with " +
+				std::to_string(available) + " bytes to take for a " + std::to_string(step) + " byte mip");
+		}
+	}
+
+	uint64_t RandomRound(uint32_t seed, bool check)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		TextureResidency residency;
+		const int count = 24 + (int)(rng() % 40);
+		uint64_t tails = 0, full = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			const uint32_t w = 64u << (rng() % 7), h = rng() % 4 ? w : 64u << (rng() % 7);
+			const ResidencyTextureDesc desc = MakeDesc(w, h, rng() % 4 != 0);
+			tails += BytesFrom(desc, desc.CoarsestMip);
+			full += BytesFrom(desc, 0);
+			residency.AddTexture(desc, rng() % 12);
+		}
+
+		uint64_t cap = 0;
+		uint32_t delay = 4;
+		residency.SetEvictDelay(delay);
+		residency.SetBudget(full / 2);
+		uint64_t hash = 14695981039346656037ull;
+		std::vector<uint32_t> before((size_t)count), requested((size_t)count);
+		// Finest request of the last delay + 1 frames, newest last
+		std::vector<std::vector<uint32_t>> history((size_t)count);
+
+		for (int frame = 0; frame < 300; ++frame)
+		{
+			const std::string where = "round " + std::to_string(seed) + ", frame " + std::to_string(frame);
+			switch (rng() % 40)
+			{
+			case 0: residency.SetBudget((uint64_t)(unit(rng) * 1.2f * full)); break;
+			case 1: residency.SetBudget(tails / 2); break;
+			case 2: cap = rng() % 2 ? 0 : (uint64_t)(unit(rng) * 4 * MB); residency.SetMaxStreamInBytes(cap); break;
+			case 3: residency.SetMipBias(unit(rng) * 2.0f - 0.5f); break;
+			default: break;
+			}
+
+			residency.BeginFrame();
+			for (int i = 0; i < count; ++i)
+			{
+				before[i] = residency.GetResidentMip(i);
+				requested[i] = UINT32_MAX;
+				if (rng() % 3 == 0)
+					continue;
+				for (int user = 1 + rng() % 3; user > 0; --user)
+				{
+					const float pixels = std::exp2(unit(rng) * 12.0f);
+					residency.RequestScreenSize(i, pixels);
+					const ResidencyTextureDesc& desc = residency.GetDesc(i);
+					requested[i] = (std::min)(requested[i], residency.MipForScreenSize((std::max)(desc.Width, desc.Height), pixels));
+				}
+			}
+			const std::vector<ResidencyChange>& changes = residency.Update();
+			if (!check)
+			{
+				for (const ResidencyChange& c : changes)
+					hash = (hash ^ ((uint64_t)c.Texture << 32 | c.OldMip << 16 | c.NewMip)) * 1099511628211ull;
+				continue;
+			}
+
+			// What the frame asked for and the evict delay hold on to
+			uint64_t resident = 0;
+			bool allTails = true;
+			for (int i = 0; i < count; ++i)
+			{
+				const ResidencyTextureDesc& desc = residency.GetDesc(i);
+				history[i].push_back((std::min)(requested[i], desc.CoarsestMip));
+				if (history[i].size() > delay + 1)
+					history[i].erase(history[i].begin());
+				const uint32_t held = *std::min_element(history[i].begin(), history[i].end());
+				Check(residency.GetWantedMip(i) == held, "evict delay", where + ": " + Texture(i) + " wants mip " +
+					std::to_string(residency.GetWantedMip(i)) + ", the last " + std::to_string(delay + 1) + " frames asked for " + std::to_string(held));
+
+				const uint32_t mip = residency.GetResidentMip(i);
+				Check(mip >= residency.GetWantedMip(i) && mip <= desc.CoarsestMip, "resident mip", where + ": " + Texture(i) + " at mip " +
+					std::to_string(mip) + ", wanted " + std::to_string(residency.GetWantedMip(i)));
+				resident += residency.GetResidentBytes(i);
+				allTails = allTails && mip == desc.CoarsestMip;
+			}
+
+			const ResidencyStats& stats = residency.GetStats();
+			Check(stats.ResidentBytes == resident, "stats", where + ": " + std::to_string(stats.ResidentBytes) + " resident bytes reported, " +
+				std::to_string(resident) + " counted");
+			Check(stats.ResidentBytes <= residency.GetBudget() || allTails, "budget", where + ": " + std::to_string(stats.ResidentBytes) +
+				" bytes over a budget of " + std::to_string(residency.GetBudget()));
+
+			// The changes are exactly the textures that moved
+			std::vector<uint8_t> changed((size_t)count, 0);
+			int streamIns = 0;
+			bool singleStep = false;
+			for (const ResidencyChange& c : changes)
+			{
+				const bool known = c.Texture >= 0 && c.Texture < count && !changed[c.Texture];
+				Check(known, "changes", where + ": unknown or repeated " + Texture(c.Texture));
+				if (!known)
+					continue;
+				changed[c.Texture] = 1;
+				Check(c.OldMip == before[c.Texture] && c.NewMip == residency.GetResidentMip(c.Texture) && c.OldMip != c.NewMip, "changes",
+					where + ": " + Texture(c.Texture) + " from mip " + std::to_string(c.OldMip) + " to " + std::to_string(c.NewMip));
+				if (c.NewMip < c.OldMip)
+				{
+					++streamIns;
+					singleStep = c.NewMip + 1 == c.OldMip;
+				}
+			}
+			for (int i = 0; i < count; ++i)
+				Check(changed[i] || before[i] == residency.GetResidentMip(i), "changes", where + ": " + Texture(i) + " moved without a change");
+			Check(streamIns == stats.StreamIns, "stats", where + ": stream-in count");
+			Check(cap == 0 || stats.StreamedInBytes <= cap || (streamIns == 1 && singleStep), "stream-in cap", where + ": " +
+				std::to_string(stats.StreamedInBytes) + " bytes over a cap of " + std::to_string(cap));
+			if (cap == 0)
+				CheckStarved(residency, where);
+		}
+		return hash;
+	}
+
+	void RunChecks(const BenchConfig& config)
+	{
+		CheckWantedMip();
+		CheckEvictDelay();
+		CheckPriorityEviction();
+		CheckStreamInCap();
+		CheckBudgetChange();
+		for (int round = 0; round < config.Rounds; ++round)
+		{
+			const uint32_t seed = 100u + (uint32_t)round;
+			RandomRound(seed, true);
+			Check(RandomRound(seed, false) == RandomRound(seed, false), "deterministic", "round " + std::to_string(seed) +
+				" made different changes the second time");
+		}
+		fprintf(stderr, "checks: fixed scenarios and %d random rounds, %d failures\n", config.Rounds, gFailures);
+	}
+
+	//
+	// Bench
+	//
+
+	// A mesh using a texture, on the ground plane
+	struct User
+	{
+		int Texture;
+		float X, Z;
+		float Radius;
+	};
+
+	struct Scene
+	{
+		std::vector<ResidencyTextureDesc> Textures;
+		std::vector<User> Users;
+		uint64_t FullBytes = 0;
+		uint64_t PeakWantedBytes = 0;  // most the wanted mips ever add up to, without a budget
+	};
+
+	Scene BuildScene(const BenchConfig& config)
+	{
+		Scene scene;
+		std::mt19937 rng(11);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (int i = 0; i < config.Textures; ++i)
+		{
+			const uint32_t size = 512u << (rng() % 4);
+			scene.Textures.push_back(MakeDesc(size, size, rng() % 4 != 0));
+			scene.FullBytes += BytesFrom(scene.Textures.back(), 0);
+			for (int user = 1 + rng() % 4; user > 0; --user)
+				scene.Users.push_back({ i, (unit(rng) - 0.5f) * 1600.0f, (unit(rng) - 0.5f) * 1600.0f, 5.0f + unit(rng) * 55.0f });
+		}
+		return scene;
+	}
+
+	struct Sample
+	{
+		double UpdateUs = 0.0;
+		int Changes = 0;
+		double StreamedMB = 0.0;
+		double EvictedMB = 0.0;
+		int Starved = 0;
+		double ResidentMB = 0.0;
+		double WantedMB = 0.0;
+	};
+
+	struct Result
+	{
+		double BudgetFraction;
+		uint64_t Budget;
+		std::vector<Sample> Samples;
+	};
+
+	// fraction of the scene's peak wanted bytes, 0 = no budget
+	Result Measure(const BenchConfig& config, const Scene& scene, double fraction)
+	{
+		Result result;
+		result.BudgetFraction = fraction;
+		result.Budget = fraction > 0.0 ? (uint64_t)(fraction * scene.PeakWantedBytes) : UINT64_MAX;
+
+		TextureResidency residency;
+		for (const ResidencyTextureDesc& desc : scene.Textures)
+			residency.AddTexture(desc, 0);
+		residency.SetBudget(result.Budget);
+		residency.SetMaxStreamInBytes(AppStreamInCap);
+		residency.SetEvictDelay(AppEvictDelay);
+
+		// 1080p, 45 degree field of view, as TexColumnsApp::UpdateTextureResidency
+		const float pixelsPerUnit = 1080.0f / (2.0f * std::tan(0.3926991f));
+		const float cosHalfFov = std::cos(0.7853982f);
+		for (int frame = 0; frame < config.Frames; ++frame)
+		{
+			const float angle = 6.2831853f * frame / config.Frames;
+			const float eyeX = 600.0f * std::cos(angle), eyeZ = 600.0f * std::sin(angle);
+			const float dirX = -std::sin(angle), dirZ = std::cos(angle);
+
+			residency.BeginFrame();
+			for (const User& user : scene.Users)
+			{
+				const float dx = user.X - eyeX, dz = user.Z - eyeZ;
+				const float dist = std::sqrt(dx * dx + dz * dz);
+				if (dx * dirX + dz * dirZ < cosHalfFov * dist - user.Radius)
+					continue;
+				residency.RequestScreenSize(user.Texture, 2.0f * user.Radius * pixelsPerUnit / (std::max)(dist, user.Radius));
+			}
+
+			const auto start = std::chrono::steady_clock::now();
+			const std::vector<ResidencyChange>& changes = residency.Update();
+			Sample sample;
+			sample.UpdateUs = UsSince(start);
+			const ResidencyStats& stats = residency.GetStats();
+			sample.Changes = (int)changes.size();
+			sample.StreamedMB = stats.StreamedInBytes / (double)MB;
+			sample.EvictedMB = stats.EvictedBytes / (double)MB;
+			sample.Starved = stats.StarvedTextures;
+			sample.ResidentMB = stats.ResidentBytes / (double)MB;
+			sample.WantedMB = stats.WantedBytes / (double)MB;
+			result.Samples.push_back(sample);
+		}
+		return result;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const Scene& scene, const std::vector<Result>& results)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"ResidencyBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"textures\": " << config.Textures << ", \"users\": " << scene.Users.size() << ", \"frames\": " << config.Frames
+			<< ", \"full_mb\": " << scene.FullBytes / (double)MB << ", \"peak_wanted_mb\": " << scene.PeakWantedBytes / (double)MB << ", \"stream_in_cap_mb\": " << AppStreamInCap / (double)MB
+			<< ", \"evict_delay\": " << AppEvictDelay << ", \"rounds\": " << config.Rounds
+			<< ", \"hardware_threads\": " << std::thread::hardware_concurrency() << ", \"failures\": " << gFailures << " },\n";
+		out << "  \"results\": [\n";
+		for (size_t r = 0; r < results.size(); ++r)
+		{
+			const Result& result = results[r];
+			out << "    {\n";
+			out << "      \"budget_fraction\": " << result.BudgetFraction << ", \"budget_mb\": " << result.Budget / (double)MB << ",\n";
+			WriteSummary(out, "update_us", result.Samples, [](const Sample& s) { return s.UpdateUs; });
+			WriteSummary(out, "changes", result.Samples, [](const Sample& s) { return s.Changes; });
+			WriteSummary(out, "streamed_mb", result.Samples, [](const Sample& s) { return s.StreamedMB; });
+			WriteSummary(out, "evicted_mb", result.Samples, [](const Sample& s) { return s.EvictedMB; });
+			WriteSummary(out, "starved", result.Samples, [](const Sample& s) { return s.Starved; });
+			WriteSummary(out, "resident_mb", result.Samples, [](const Sample& s) { return s.ResidentMB; });
+			WriteSummary(out, "wanted_mb", result.Samples, [](const Sample& s) { return s.WantedMB; }, true);
+			out << "    }" << (r + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--textures" && hasValue) config.Textures = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--frames" && hasValue) config.Frames = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--rounds" && hasValue) config.Rounds = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--no-bench") config.Bench = false;
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	RunChecks(config);
+
+	Scene scene = BuildScene(config);
+	std::vector<Result> results;
+	if (config.Bench)
+	{
+		for (const Sample& sample : Measure(config, scene, 0.0).Samples)
+			scene.PeakWantedBytes = (std::max)(scene.PeakWantedBytes, (uint64_t)(sample.WantedMB * MB));
+		for (double fraction : { 1.0, 0.75, 0.5, 0.25 })
+		{
+			results.push_back(Measure(config, scene, fraction));
+			const std::vector<Sample>& s = results.back().Samples;
+			std::vector<double> us, streamed, starved, resident;
+			for (const Sample& sample : s)
+			{
+				us.push_back(sample.UpdateUs);
+				streamed.push_back(sample.StreamedMB);
+				starved.push_back(sample.Starved);
+				resident.push_back(sample.ResidentMB);
+			}
+			fprintf(stderr, "budget %3.0f%% (%7.1f MB): Update p50 %7.1f us p95 %7.1f, streamed p95 %5.1f MB, starved p50 %4.0f, resident p50 %7.1f MB\n",
+				fraction * 100.0, results.back().Budget / (double)MB, Percentile(us, 0.5), Percentile(us, 0.95), Percentile(streamed, 0.95),
+				Percentile(starved, 0.5), Percentile(resident, 0.5));
+		}
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, scene, results);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
@@ -0,0 +1,740 @@
+//***************************************************************************************
+// ShadowBench.cpp
+//
+// Checks the shadow cascade fit and the multi-view culling, and times one
+// walk for the camera and every cascade against one walk per view. Cameras
+// are --poses random poses over the terrain with the app's lens; the light
+// and the cascade settings are TexColumnsApp::UpdateShadowCascades'.
+//
+// The check part fits --cascades cascades for every pose, with a 256 and a
+// 2048 texel map:
+//   - the splits run from the near plane to the shadow distance, each
+//     cascade starting where the previous one ends;
+//   - the corners of each slice and random points inside it are inside the
+//     cascade's volume, and stay inside when moved the caster distance
+//     towards the light;
+//   - across the light the volume holds the slice's bounding sphere, also
+//     after the centre is snapped to texels;
+//   - turning the camera leaves every radius exactly as it was;
+//   - moving the camera in small steps moves a fixed point on the shadow
+//     map by whole texels only.
+// Then the camera and the cascades are culled against a LooseOctree and a
+// DynamicAabbTree of --items boxes spread like SpatialBench's, and against
+// the terrain quadtree. The multi-view Query must return, per view, what a
+// Query of that view alone and a brute-force test of every box (of every
+// fat box for the tree) return, and one Terrain::Update with all cascades
+// must give each cascade the tiles a walk with that cascade alone gives it,
+// with or without the camera in the walk. A failure exits with 3.
+//
+// The bench part times, over the poses and --reps times, the multi-view
+// Query of the octree and the tree against one Query per view, and one
+// Terrain::Update with the camera and every cascade against an Update for
+// the camera plus a quadtree walk per cascade. The octree's multi-view Query
+// is itself one walk per view, so it should time like the separate Queries.
+//
+// Needs no GPU or window. Windows: ShadowBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common ShadowBench.cpp
+//       -L<dir> -lTerrainCore -o ShadowBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: ShadowBench [options]
+//   --poses <n>          camera poses (64)
+//   --cascades <n>       cascades per pose (4, what the app fits)
+//   --items <n>          boxes in the octree and the tree (20000)
+//   --reps <n>           timed passes over the poses (20)
+//   --label <text>       stored in the output, e.g. the commit
+//   --out <file.json>    (stdout)
+//***************************************************************************************
+
+#include "ShadowCascades.h"
+#include "LooseOctree.h"
+#include "DynamicAabbTree.h"
+#include "Terrain.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// The app's terrain (TexColumnsApp::InitTerrain), camera and light
+	const float WorldSize = 1024.0f;
+	const int MaxLod = 5;
+	const XMFLOAT3 TerrainOffset = XMFLOAT3(0.0f, -100.0f, 0.0f);
+	const float FovY = 0.25f * XM_PI;
+	const float Aspect = 16.0f / 9.0f;
+	const float NearZ = 1.0f;
+	const float FarZ = 20000.0f;
+	const float ShadowDistance = 1000.0f;
+	const XMFLOAT3 LightDirection = XMFLOAT3(0.57735f, -0.57735f, 0.57735f);
+	const uint32_t MapResolutions[] = { 256, 2048 };
+
+	struct BenchConfig
+	{
+		int Poses = 64;
+		uint32_t Cascades = 4;
+		int Items = 20000;
+		int Reps = 20;
+		std::string Label;
+		std::string Out;
+	};
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Kept alive so the compiler cannot drop a loop's result
+	volatile size_t gSink = 0;
+
+	struct Random
+	{
+		uint32_t State;
+
+		explicit Random(uint32_t seed) : State(seed) {}
+
+		uint32_t Next()
+		{
+			State = State * 1664525u + 1013904223u;
+			return State;
+		}
+		// [lo, hi)
+		float Range(float lo, float hi)
+		{
+			return lo + (hi - lo) * (float)(Next() >> 8) * (1.0f / 16777216.0f);
+		}
+	};
+
+	// One camera: the cascade parameters the app would fill in for it, its
+	// planes and its frustum for Terrain::Update
+	struct Pose
+	{
+		CascadeParams Params;
+		FrustumPlanes Camera;
+		BoundingFrustum Frustum;
+	};
+
+	// Camera basis for a look direction, as XMMatrixLookToLH builds it
+	void SetLook(CascadeParams& params, float yaw, float pitch)
+	{
+		const float look[3] = { std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw) };
+		const float length = std::sqrt(look[0] * look[0] + look[2] * look[2]);
+		const float right[3] = { look[2] / length, 0.0f, -look[0] / length };
+		for (int a = 0; a < 3; ++a)
+		{
+			params.Look[a] = look[a];
+			params.Right[a] = right[a];
+		}
+		params.Up[0] = look[1] * right[2] - look[2] * right[1];
+		params.Up[1] = look[2] * right[0] - look[0] * right[2];
+		params.Up[2] = look[0] * right[1] - look[1] * right[0];
+	}
+
+	std::vector<Pose> MakePoses(const BenchConfig& config)
+	{
+		std::vector<Pose> poses;
+		Random random(7);
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(FovY, Aspect, NearZ, FarZ);
+		for (int i = 0; i < config.Poses; ++i)
+		{
+			Pose pose;
+			CascadeParams& params = pose.Params;
+			params.Eye[0] = TerrainOffset.x + random.Range(0.0f, WorldSize);
+			params.Eye[1] = TerrainOffset.y + random.Range(20.0f, 400.0f);
+			params.Eye[2] = TerrainOffset.z + random.Range(0.0f, WorldSize);
+			SetLook(params, random.Range(0.0f, XM_2PI), random.Range(-0.8f, 0.3f));
+			params.LightDir[0] = LightDirection.x;
+			params.LightDir[1] = LightDirection.y;
+			params.LightDir[2] = LightDirection.z;
+			params.FovY = FovY;
+			params.Aspect = Aspect;
+			params.NearZ = NearZ;
+			params.FarZ = ShadowDistance;
+			params.Count = config.Cascades;
+			params.CasterDistance = WorldSize;
+
+			const XMVECTOR eye = XMVectorSet(params.Eye[0], params.Eye[1], params.Eye[2], 1.0f);
+			const XMVECTOR look = XMVectorSet(params.Look[0], params.Look[1], params.Look[2], 0.0f);
+			const XMMATRIX view = XMMatrixLookToLH(eye, look, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			XMFLOAT4X4 viewProj;
+			XMStoreFloat4x4(&viewProj, view * proj);
+			pose.Camera = FrustumPlanes::FromViewProj(viewProj.m);
+			BoundingFrustum::CreateFromMatrix(pose.Frustum, proj);
+			XMVECTOR det;
+			pose.Frustum.Transform(pose.Frustum, XMMatrixInverse(&det, view));
+			poses.push_back(pose);
+		}
+		return poses;
+	}
+
+	// The camera first, then the cascades, as the app culls them
+	std::vector<FrustumPlanes> PoseViews(const Pose& pose, const std::vector<ShadowCascade>& cascades)
+	{
+		std::vector<FrustumPlanes> views = { pose.Camera };
+		for (const ShadowCascade& cascade : cascades)
+			views.push_back(cascade.Planes);
+		return views;
+	}
+
+	// Shadow map NDC of a world point
+	void ToShadow(const ShadowCascade& cascade, const float p[3], float out[3])
+	{
+		const float (&m)[4][4] = cascade.ViewProj;
+		for (int c = 0; c < 3; ++c)
+			out[c] = p[0] * m[0][c] + p[1] * m[1][c] + p[2] * m[2][c] + m[3][c];
+	}
+
+	// Point of the view slice at depth d, s and t in [-1, 1] across it
+	void SlicePoint(const CascadeParams& params, float d, float s, float t, float out[3])
+	{
+		const float tanHalf = std::tan(0.5f * params.FovY);
+		for (int a = 0; a < 3; ++a)
+			out[a] = params.Eye[a] + params.Look[a] * d + params.Right[a] * (s * tanHalf * params.Aspect * d) + params.Up[a] * (t * tanHalf * d);
+	}
+
+	bool InVolume(const float ndc[3])
+	{
+		const float tolerance = 1e-5f;
+		return std::fabs(ndc[0]) <= 1.0f + tolerance && std::fabs(ndc[1]) <= 1.0f + tolerance &&
+			ndc[2] >= -tolerance && ndc[2] <= 1.0f + tolerance;
+	}
+
+	//
+	// Checks
+	//
+
+	void CheckFit(const std::vector<Pose>& poses)
+	{
+		Random random(11);
+		float light[3] = { LightDirection.x, LightDirection.y, LightDirection.z };
+		const float lightLength = std::sqrt(light[0] * light[0] + light[1] * light[1] + light[2] * light[2]);
+		for (float& c : light)
+			c /= lightLength;
+
+		std::vector<ShadowCascade> cascades, turned, moved;
+		for (size_t p = 0; p < poses.size(); ++p)
+		{
+			for (uint32_t resolution : MapResolutions)
+			{
+				CascadeParams params = poses[p].Params;
+				params.Resolution = resolution;
+				const std::string where = "pose " + std::to_string(p) + ", " + std::to_string(resolution) + " texels";
+				ShadowCascades::Fit(params, cascades);
+
+				Check(cascades.size() == params.Count, "splits", where + ": " + std::to_string(cascades.size()) + " cascades");
+				if (cascades.empty())
+					continue;
+				bool ordered = cascades.front().SplitNear == params.NearZ && cascades.back().SplitFar == params.FarZ;
+				for (size_t i = 0; i < cascades.size(); ++i)
+				{
+					ordered = ordered && cascades[i].SplitNear < cascades[i].SplitFar;
+					if (i > 0)
+						ordered = ordered && cascades[i].SplitNear == cascades[i - 1].SplitFar;
+				}
+				Check(ordered, "splits", where + ": splits do not run from the near plane to the shadow distance in order");
+
+				// Slice corners and random points of every slice, and each moved
+				// towards the light by the caster distance
+				int outside = 0, castersOutside = 0;
+				for (const ShadowCascade& cascade : cascades)
+				{
+					for (int k = 0; k < 8 + 64; ++k)
+					{
+						const float d = k < 8 ? ((k & 4) ? cascade.SplitFar : cascade.SplitNear) :
+							random.Range(cascade.SplitNear, cascade.SplitFar);
+						const float s = k < 8 ? ((k & 1) ? 1.0f : -1.0f) : random.Range(-1.0f, 1.0f);
+						const float t = k < 8 ? ((k & 2) ? 1.0f : -1.0f) : random.Range(-1.0f, 1.0f);
+						float point[3], ndc[3];
+						SlicePoint(params, d, s, t, point);
+						ToShadow(cascade, point, ndc);
+						outside += !InVolume(ndc);
+						for (int a = 0; a < 3; ++a)
+							point[a] -= light[a] * params.CasterDistance;
+						ToShadow(cascade, point, ndc);
+						castersOutside += !InVolume(ndc);
+					}
+				}
+				Check(outside == 0, "contain", where + ": " + std::to_string(outside) + " slice points outside their cascade");
+
+				// The sphere Fit describes: on the view axis, equidistant from the
+				// near and far corners or at the far plane, through the farthest
+				// corner. Across the light the volume spans +-1 over 2 Radius.
+				int spheresOutside = 0;
+				const float tanHalf = std::tan(0.5f * params.FovY);
+				const float k = tanHalf * tanHalf * (1.0f + params.Aspect * params.Aspect);
+				for (const ShadowCascade& cascade : cascades)
+				{
+					const float dn = cascade.SplitNear, df = cascade.SplitFar;
+					const float c = (std::min)(0.5f * (dn + df) * (1.0f + k), df);
+					float center[3], corner[3], ndc[3];
+					SlicePoint(params, c, 0.0f, 0.0f, center);
+					float radius = 0.0f;
+					for (int corners = 0; corners < 8; ++corners)
+					{
+						SlicePoint(params, (corners & 4) ? df : dn, (corners & 1) ? 1.0f : -1.0f, (corners & 2) ? 1.0f : -1.0f, corner);
+						const float dx = corner[0] - center[0], dy = corner[1] - center[1], dz = corner[2] - center[2];
+						radius = (std::max)(radius, std::sqrt(dx * dx + dy * dy + dz * dz));
+					}
+					ToShadow(cascade, center, ndc);
+					const float reach = radius / cascade.Radius;
+					spheresOutside += std::fabs(ndc[0]) + reach > 1.0f + 1e-5f || std::fabs(ndc[1]) + reach > 1.0f + 1e-5f;
+				}
+				Check(spheresOutside == 0, "contain", where + ": " + std::to_string(spheresOutside) + " slice spheres not inside their cascade");
+				Check(castersOutside == 0, "contain", where + ": " + std::to_string(castersOutside) + " casters towards the light outside their cascade");
+
+				// Turning the camera keeps every radius
+				CascadeParams turn = params;
+				SetLook(turn, std::atan2(params.Look[0], params.Look[2]) + 1.0f, std::asin(params.Look[1]) * 0.5f);
+				ShadowCascades::Fit(turn, turned);
+				for (size_t i = 0; i < cascades.size() && i < turned.size(); ++i)
+				{
+					Check(turned[i].Radius == cascades[i].Radius, "stable", where + ", cascade " + std::to_string(i) + ": radius " +
+						std::to_string(cascades[i].Radius) + " becomes " + std::to_string(turned[i].Radius) + " when the camera turns");
+				}
+
+				// Small moves shift a fixed point by whole texels only
+				float anchor[3];
+				SlicePoint(params, 0.5f * (cascades[0].SplitNear + cascades[0].SplitFar), 0.0f, 0.0f, anchor);
+				std::vector<float> phase(2 * cascades.size());
+				float drift = 0.0f;
+				for (int step = 0; step < 50; ++step)
+				{
+					CascadeParams move = params;
+					move.Eye[0] += 0.37f * step;
+					move.Eye[1] += 0.05f * step;
+					move.Eye[2] += 0.21f * step;
+					ShadowCascades::Fit(move, moved);
+					for (size_t i = 0; i < moved.size(); ++i)
+					{
+						float ndc[3];
+						ToShadow(moved[i], anchor, ndc);
+						for (int c = 0; c < 2; ++c)
+						{
+							const double texel = (ndc[c] * 0.5 + 0.5) * resolution;
+							const float fraction = (float)(texel - std::floor(texel));
+							if (step == 0)
+								phase[2 * i + c] = fraction;
+							const float d = std::fabs(fraction - phase[2 * i + c]);
+							drift = (std::max)(drift, (std::min)(d, 1.0f - d));
+						}
+					}
+				}
+				Check(drift < 0.01f, "stable", where + ": a fixed point drifts " + std::to_string(drift) + " texels while the camera moves");
+			}
+		}
+	}
+
+	// Mostly mesh-sized boxes near the ground; one in 50 large, one in 50
+	// partly or fully outside the world
+	Aabb RandomBox(Random& random)
+	{
+		const uint32_t kind = random.Next() % 50;
+		const float margin = kind == 0 ? 200.0f : 0.0f;
+		const float center[3] =
+		{
+			TerrainOffset.x + random.Range(-margin, WorldSize + margin),
+			TerrainOffset.y + random.Range(0.0f, 300.0f),
+			TerrainOffset.z + random.Range(-margin, WorldSize + margin),
+		};
+		const float size = kind == 1 ? random.Range(50.0f, 400.0f) : random.Range(0.5f, 20.0f);
+		const float extents[3] = { size, size * random.Range(0.5f, 2.0f), size };
+		return Aabb::FromCenterExtents(center, extents);
+	}
+
+	// The octree and the tree over the same boxes, built as the app builds them
+	struct Scene
+	{
+		std::vector<Aabb> Boxes;
+		LooseOctree Octree;
+		DynamicAabbTree Tree;
+		std::vector<int32_t> Proxies;
+
+		Scene(int items, uint32_t seed)
+			: Octree(WorldBox(), WorldDepth()), Tree(0.5f)
+		{
+			Random random(seed);
+			for (int id = 0; id < items; ++id)
+			{
+				Boxes.push_back(RandomBox(random));
+				Octree.Insert((uint32_t)id, Boxes.back());
+				Proxies.push_back(Tree.Insert(Boxes.back(), (uint32_t)id));
+			}
+			Tree.Rebuild();
+		}
+
+		// The cube BuildOctree uses and the depth it picks for it
+		static Aabb WorldBox()
+		{
+			Aabb world;
+			world.Min[0] = TerrainOffset.x;
+			world.Min[1] = TerrainOffset.y;
+			world.Min[2] = TerrainOffset.z;
+			world.Max[0] = TerrainOffset.x + WorldSize;
+			world.Max[1] = TerrainOffset.y + WorldSize;
+			world.Max[2] = TerrainOffset.z + WorldSize;
+			return world;
+		}
+
+		static uint32_t WorldDepth()
+		{
+			uint32_t depth = 0;
+			while (depth < 8 && WorldSize / float(1u << (depth + 1)) >= 32.0f)
+				++depth;
+			return depth;
+		}
+	};
+
+	void CompareIds(std::vector<uint32_t> found, std::vector<uint32_t> expected, const char* test, const std::string& where)
+	{
+		std::sort(found.begin(), found.end());
+		std::sort(expected.begin(), expected.end());
+		if (found == expected)
+			return;
+		std::vector<uint32_t> difference;
+		std::set_difference(expected.begin(), expected.end(), found.begin(), found.end(), std::back_inserter(difference));
+		const size_t missing = difference.size();
+		difference.clear();
+		std::set_difference(found.begin(), found.end(), expected.begin(), expected.end(), std::back_inserter(difference));
+		const size_t extra = difference.size();
+		Check(false, test, where + ": " + std::to_string(found.size()) + " found, " + std::to_string(expected.size()) +
+			" expected, " + std::to_string(missing) + " missing, " + std::to_string(extra) + " extra or repeated");
+	}
+
+	// The walk Terrain::Update makes, with one shadow view and no camera
+	void WalkShadowView(Terrain& terrain, const XMFLOAT3& eye, BoundingFrustum& frustum, const FrustumPlanes& view, std::vector<Tile*>& tiles)
+	{
+		TerrainCullContext context;
+		context.Frustum = &frustum;
+		context.CameraPos = eye;
+		context.HeightScale = terrain.mHeightScale;
+		context.MapSize = (int)terrain.mWorldSize;
+		context.ShadowViews = &view;
+		context.ShadowViewCount = 1;
+		context.ShadowTiles = &tiles;
+		terrain.GetRoot()->UpdateVisibility(context, false, ViewCullState::All(1));
+	}
+
+	std::vector<uint32_t> TileIndices(const std::vector<Tile*>& tiles)
+	{
+		std::vector<uint32_t> indices;
+		for (const Tile* tile : tiles)
+			indices.push_back((uint32_t)tile->tileIndex);
+		return indices;
+	}
+
+	void CheckCulling(const BenchConfig& config, const std::vector<Pose>& poses)
+	{
+		Scene scene(config.Items, 1);
+		Terrain terrain;
+		terrain.Initialize(WorldSize, MaxLod, TerrainOffset);
+
+		std::vector<ShadowCascade> cascades;
+		std::vector<std::vector<uint32_t>> octreeViews, treeViews;
+		std::vector<uint32_t> single, expected, expectedFat;
+		std::vector<Tile*> tiles;
+		for (size_t p = 0; p < poses.size(); ++p)
+		{
+			ShadowCascades::Fit(poses[p].Params, cascades);
+			const std::vector<FrustumPlanes> views = PoseViews(poses[p], cascades);
+			const uint32_t viewCount = (uint32_t)views.size();
+			octreeViews.assign(viewCount, {});
+			treeViews.assign(viewCount, {});
+			scene.Octree.Query(views.data(), viewCount, octreeViews.data());
+			scene.Tree.Query(views.data(), viewCount, treeViews.data());
+			for (uint32_t v = 0; v < viewCount; ++v)
+			{
+				const std::string where = "pose " + std::to_string(p) + ", view " + std::to_string(v);
+				expected.clear();
+				expectedFat.clear();
+				for (size_t id = 0; id < scene.Boxes.size(); ++id)
+				{
+					if (views[v].Classify(scene.Boxes[id]) != CullResult::Outside)
+						expected.push_back((uint32_t)id);
+					if (views[v].Classify(scene.Tree.GetFatBox(scene.Proxies[id])) != CullResult::Outside)
+						expectedFat.push_back((uint32_t)id);
+				}
+				single.clear();
+				scene.Octree.Query(views[v], single);
+				CompareIds(single, expected, "octree", where + ", alone");
+				CompareIds(octreeViews[v], expected, "octree", where + ", multi-view");
+				single.clear();
+				scene.Tree.Query(views[v], single);
+				CompareIds(single, expectedFat, "tree", where + ", alone");
+				CompareIds(treeViews[v], expectedFat, "tree", where + ", multi-view");
+			}
+
+			// The terrain: every cascade in the camera's walk, then each alone
+			const std::vector<FrustumPlanes> shadowViews(views.begin() + 1, views.end());
+			const float* e = poses[p].Params.Eye;
+			const XMFLOAT3 eye(e[0], e[1], e[2]);
+			BoundingFrustum frustum = poses[p].Frustum;
+			terrain.Update(eye, frustum, shadowViews.data(), (uint32_t)shadowViews.size());
+			const std::vector<uint32_t> visible = TileIndices(terrain.GetVisibleTiles());
+			std::vector<std::vector<uint32_t>> shadowTiles;
+			for (uint32_t i = 0; i < terrain.GetShadowViewCount(); ++i)
+				shadowTiles.push_back(TileIndices(terrain.GetShadowTiles(i)));
+			Check(shadowTiles.size() == shadowViews.size(), "terrain", "pose " + std::to_string(p) + ": " +
+				std::to_string(shadowTiles.size()) + " shadow views culled");
+			for (size_t i = 0; i < shadowTiles.size(); ++i)
+			{
+				const std::string where = "pose " + std::to_string(p) + ", cascade " + std::to_string(i);
+				frustum = poses[p].Frustum;
+				terrain.Update(eye, frustum, &shadowViews[i], 1);
+				CompareIds(TileIndices(terrain.GetShadowTiles(0)), shadowTiles[i], "terrain", where + ", alone");
+				CompareIds(TileIndices(terrain.GetVisibleTiles()), visible, "terrain", where + ", camera tiles");
+				tiles.clear();
+				WalkShadowView(terrain, eye, frustum, shadowViews[i], tiles);
+				CompareIds(TileIndices(tiles), shadowTiles[i], "terrain", where + ", without the camera");
+			}
+		}
+	}
+
+	//
+	// Bench
+	//
+
+	// One pass over the poses, per pose
+	struct Sample
+	{
+		double OctreeMultiUs = 0.0;
+		double OctreeSeparateUs = 0.0;
+		double TreeMultiUs = 0.0;
+		double TreeSeparateUs = 0.0;
+		double TerrainMultiUs = 0.0;
+		double TerrainSeparateUs = 0.0;
+	};
+
+	struct Totals
+	{
+		std::vector<double> Visible;     // per view, averaged over the poses
+	};
+
+	template <typename Field>
+	double Median(const std::vector<Sample>& samples, Field field)
+	{
+		std::vector<double> values;
+		for (const Sample& s : samples)
+			values.push_back(s.*field);
+		return Percentile(values, 0.50);
+	}
+
+	std::vector<Sample> Measure(const BenchConfig& config, const std::vector<Pose>& poses, Totals& totals)
+	{
+		const Scene scene(config.Items, 3);
+		std::vector<std::vector<FrustumPlanes>> poseViews;
+		std::vector<ShadowCascade> cascades;
+		for (const Pose& pose : poses)
+		{
+			ShadowCascades::Fit(pose.Params, cascades);
+			poseViews.push_back(PoseViews(pose, cascades));
+		}
+
+		const uint32_t viewCount = config.Cascades + 1;
+		std::vector<std::vector<uint32_t>> results(viewCount);
+		for (std::vector<uint32_t>& result : results)
+			result.reserve(scene.Boxes.size());
+		totals.Visible.assign(viewCount, 0.0);
+		for (const std::vector<FrustumPlanes>& views : poseViews)
+		{
+			for (std::vector<uint32_t>& result : results)
+				result.clear();
+			scene.Octree.Query(views.data(), viewCount, results.data());
+			for (uint32_t v = 0; v < viewCount; ++v)
+				totals.Visible[v] += (double)results[v].size() / poseViews.size();
+		}
+
+		auto multi = [&](const auto& structure)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			for (const std::vector<FrustumPlanes>& views : poseViews)
+			{
+				for (std::vector<uint32_t>& result : results)
+					result.clear();
+				structure.Query(views.data(), viewCount, results.data());
+				gSink = gSink + results.back().size();
+			}
+			return MsSince(start) * 1000.0 / poseViews.size();
+		};
+		auto separate = [&](const auto& structure)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			for (const std::vector<FrustumPlanes>& views : poseViews)
+			{
+				for (uint32_t v = 0; v < viewCount; ++v)
+				{
+					results[v].clear();
+					structure.Query(views[v], results[v]);
+				}
+				gSink = gSink + results.back().size();
+			}
+			return MsSince(start) * 1000.0 / poseViews.size();
+		};
+
+		Terrain terrain;
+		terrain.Initialize(WorldSize, MaxLod, TerrainOffset);
+		std::vector<Tile*> tiles;
+		tiles.reserve(terrain.GetAllTiles().size());
+		auto terrainMulti = [&]()
+		{
+			const auto start = std::chrono::steady_clock::now();
+			for (size_t p = 0; p < poses.size(); ++p)
+			{
+				const float* e = poses[p].Params.Eye;
+				BoundingFrustum frustum = poses[p].Frustum;
+				terrain.Update(XMFLOAT3(e[0], e[1], e[2]), frustum, poseViews[p].data() + 1, viewCount - 1);
+				gSink = gSink + terrain.GetShadowTiles(viewCount - 2).size();
+			}
+			return MsSince(start) * 1000.0 / poses.size();
+		};
+		auto terrainSeparate = [&]()
+		{
+			const auto start = std::chrono::steady_clock::now();
+			for (size_t p = 0; p < poses.size(); ++p)
+			{
+				const float* e = poses[p].Params.Eye;
+				const XMFLOAT3 eye(e[0], e[1], e[2]);
+				BoundingFrustum frustum = poses[p].Frustum;
+				terrain.Update(eye, frustum);
+				for (uint32_t v = 1; v < viewCount; ++v)
+				{
+					tiles.clear();
+					WalkShadowView(terrain, eye, frustum, poseViews[p][v], tiles);
+				}
+				gSink = gSink + tiles.size();
+			}
+			return MsSince(start) * 1000.0 / poses.size();
+		};
+
+		std::vector<Sample> samples;
+		for (int rep = 0; rep < config.Reps; ++rep)
+		{
+			Sample sample;
+			sample.OctreeMultiUs = multi(scene.Octree);
+			sample.OctreeSeparateUs = separate(scene.Octree);
+			sample.TreeMultiUs = multi(scene.Tree);
+			sample.TreeSeparateUs = separate(scene.Tree);
+			sample.TerrainMultiUs = terrainMulti();
+			sample.TerrainSeparateUs = terrainSeparate();
+			samples.push_back(sample);
+		}
+		return samples;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<Sample>& samples, const Totals& totals)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"ShadowBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"poses\": " << config.Poses << ", \"cascades\": " << config.Cascades << ", \"items\": " << config.Items
+			<< ", \"reps\": " << config.Reps << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"failures\": " << gFailures << " },\n";
+		out << "  \"visible_per_view\": [";
+		for (size_t v = 0; v < totals.Visible.size(); ++v)
+			out << (v ? ", " : " ") << totals.Visible[v];
+		out << " ],\n";
+		out << "  \"results\": [\n";
+		out << "    {\n";
+		out << "      \"structure\": \"octree\",\n";
+		WriteSummary(out, "multi_view_us", samples, [](const Sample& s) { return s.OctreeMultiUs; });
+		WriteSummary(out, "separate_us", samples, [](const Sample& s) { return s.OctreeSeparateUs; }, true);
+		out << "    },\n";
+		out << "    {\n";
+		out << "      \"structure\": \"bvh\",\n";
+		WriteSummary(out, "multi_view_us", samples, [](const Sample& s) { return s.TreeMultiUs; });
+		WriteSummary(out, "separate_us", samples, [](const Sample& s) { return s.TreeSeparateUs; }, true);
+		out << "    },\n";
+		out << "    {\n";
+		out << "      \"structure\": \"terrain\",\n";
+		WriteSummary(out, "multi_view_us", samples, [](const Sample& s) { return s.TerrainMultiUs; });
+		WriteSummary(out, "separate_us", samples, [](const Sample& s) { return s.TerrainSeparateUs; }, true);
+		out << "    }\n";
+		out << "  ]\n}\n";
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--poses" && hasValue) config.Poses = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--cascades" && hasValue) config.Cascades = (uint32_t)(std::min)((std::max)(atoi(argv[++i]), 1), (int)ViewCullState::MaxViews - 1);
+			else if (arg == "--items" && hasValue) config.Items = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--reps" && hasValue) config.Reps = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	const std::vector<Pose> poses = MakePoses(config);
+	CheckFit(poses);
+	CheckCulling(config, poses);
+
+	Totals totals;
+	const std::vector<Sample> samples = Measure(config, poses, totals);
+	const double octreeMulti = Median(samples, &Sample::OctreeMultiUs), octreeSeparate = Median(samples, &Sample::OctreeSeparateUs);
+	const double treeMulti = Median(samples, &Sample::TreeMultiUs), treeSeparate = Median(samples, &Sample::TreeSeparateUs);
+	const double terrainMulti = Median(samples, &Sample::TerrainMultiUs), terrainSeparate = Median(samples, &Sample::TerrainSeparateUs);
+	fprintf(stderr, "octree  %u views: one walk %8.1f us, one per view %8.1f us (%4.2fx)\n", config.Cascades + 1, octreeMulti, octreeSeparate,
+		octreeMulti > 0.0 ? octreeSeparate / octreeMulti : 0.0);
+	fprintf(stderr, "bvh     %u views: one walk %8.1f us, one per view %8.1f us (%4.2fx)\n", config.Cascades + 1, treeMulti, treeSeparate,
+		treeMulti > 0.0 ? treeSeparate / treeMulti : 0.0);
+	fprintf(stderr, "terrain %u views: one walk %8.1f us, one per view %8.1f us (%4.2fx)\n", config.Cascades + 1, terrainMulti, terrainSeparate,
+		terrainMulti > 0.0 ? terrainSeparate / terrainMulti : 0.0);
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, samples, totals);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
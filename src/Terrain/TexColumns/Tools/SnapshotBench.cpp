@@ -0,0 +1,796 @@
+//***************************************************************************************
+// SnapshotBench.cpp
+//
+// Checks the SnapshotPublisher behind TerrainSnapshots, through which threads
+// other than the one running Terrain::Update read the terrain's selection and
+// heights, and measures how fast readers get through while it is published.
+//
+// The stress part runs a writer that flies the camera, runs Terrain::Update
+// with a shadow view and publishes a snapshot every frame, and now and then
+// edits the heights (refitting the quadtree and handing the snapshots a new
+// copy), against reader threads that take versions, hash everything in them
+// and compare with the hash the writer recorded for that version. Readers
+// also hold versions across many publishes and hash them again, check that
+// versions only go forwards and that FindTile over every tile's centre finds
+// that tile. Pinning, slot exhaustion and reclamation get rounds of their
+// own. Any violation is a failure and the exit code is 3. Built with
+// -fsanitize=thread it is the publisher's race test: versions are plain
+// structs, so a version reused while a reader holds it shows up as a race
+// (and as a hash mismatch without the sanitizer).
+//
+// The bench part runs 1, 2, 4 ... hardware-count readers, each doing
+// FindTile and HeightAt at random points, while the writer publishes every
+// --publish-ms, with three ways of sharing the snapshot: "epoch" (the
+// publisher), "mutex" (a std::shared_ptr swapped under a mutex) and
+// "shared_mutex" (one snapshot rewritten under a reader-writer lock). It
+// reports reads per second, sampled read latency and publish cost.
+//
+// Needs no GPU or window. Windows: SnapshotBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common SnapshotBench.cpp
+//       -L<dir> -lTerrainCore -o SnapshotBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: SnapshotBench [options]
+//   --readers <n,n,...>  bench: reader thread counts (1, 2, 4 ... hardware threads)
+//   --seconds <s>        bench: time per mode and reader count (0.5)
+//   --publish-ms <ms>    bench: writer period (16)
+//   --publishes <n>      publishes per stress round (2000)
+//   --rounds <n>         stress rounds (4); 0 skips the stress part
+//   --no-bench           stress only
+//   --label <text>       stored in the output, e.g. the commit
+//   --out <file.json>    (stdout)
+//***************************************************************************************
+
+#include "TerrainSnapshot.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const float Pi = 3.14159265359f;
+	const float WorldSize = 1024.0f;
+	const int MaxLod = 5;
+	const float HeightScale = 500.0f;
+	const XMFLOAT3 Offset = XMFLOAT3(0.0f, -100.0f, 0.0f);
+	const uint32_t Resolution = 256;
+
+	struct BenchConfig
+	{
+		std::vector<unsigned> Readers;
+		double Seconds = 0.5;
+		double PublishMs = 16.0;
+		int Publishes = 2000;
+		int Rounds = 4;
+		bool Bench = true;
+		std::string Label;
+		std::string Out;
+	};
+
+	std::atomic<int> gFailures{ 0 };
+	std::atomic<uint64_t> gSink{ 0 };
+
+	// Called from the writer and the readers
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	void Spin(double ms)
+	{
+		const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(ms);
+		while (std::chrono::steady_clock::now() < end)
+			std::this_thread::yield();
+	}
+
+	//
+	// The world
+	//
+
+	// Rolling hills as TerrainBench builds them, plus the bumps edited in
+	void BuildHills(std::vector<float>& samples)
+	{
+		samples.resize((size_t)Resolution * Resolution);
+		for (uint32_t y = 0; y < Resolution; ++y)
+		{
+			for (uint32_t x = 0; x < Resolution; ++x)
+			{
+				const float u = (float)x / Resolution, v = (float)y / Resolution;
+				float h = 0.0f, amplitude = 0.5f, frequency = 2.0f;
+				for (int octave = 0; octave < 5; ++octave)
+				{
+					h += amplitude * (0.5f + 0.5f * std::sin(2.0f * Pi * frequency * u + octave) * std::cos(2.0f * Pi * frequency * v + 2.0f * octave));
+					amplitude *= 0.5f;
+					frequency *= 2.0f;
+				}
+				samples[(size_t)y * Resolution + x] = (std::min)(h, 1.0f);
+			}
+		}
+	}
+
+	// A height edit, as a sculpting brush would make one
+	void RaiseBump(std::vector<float>& samples, uint32_t edit)
+	{
+		const int cx = (int)((edit * 97u) % Resolution), cy = (int)((edit * 61u + 31u) % Resolution);
+		const int radius = 12;
+		const float amount = edit % 2 ? 0.2f : -0.2f;
+		for (int y = (std::max)(cy - radius, 0); y < (std::min)(cy + radius, (int)Resolution); ++y)
+		{
+			for (int x = (std::max)(cx - radius, 0); x < (std::min)(cx + radius, (int)Resolution); ++x)
+			{
+				const float d = std::sqrt((float)((x - cx) * (x - cx) + (y - cy) * (y - cy))) / radius;
+				float& h = samples[(size_t)y * Resolution + x];
+				h = (std::min)((std::max)(h + amount * (std::max)(1.0f - d, 0.0f), 0.0f), 1.0f);
+			}
+		}
+	}
+
+	// The thread that owns the terrain: Terrain::Update and height edits
+	class World
+	{
+	public:
+		World()
+		{
+			BuildHills(mSamples);
+			LoadHeights();
+			mTerrain.Initialize(WorldSize, MaxLod, Offset);
+			mTerrain.mHeightScale = HeightScale;
+			mTerrain.SetHeights(&mHeights);
+		}
+
+		Terrain& GetTerrain() { return mTerrain; }
+		const HeightField& GetHeights() const { return mHeights; }
+
+		// Orbits the middle of the map, looking in, with a wider view for
+		// the shadow tiles
+		void Update(uint64_t frame)
+		{
+			const float angle = 0.01f * (float)frame;
+			const float radius = 350.0f + 150.0f * std::sin(0.003f * (float)frame);
+			const float cx = Offset.x + WorldSize * 0.5f, cz = Offset.z + WorldSize * 0.5f;
+			mCameraPos = XMFLOAT3(cx + radius * std::cos(angle), 250.0f, cz + radius * std::sin(angle));
+			const XMFLOAT3 look = XMFLOAT3(-std::cos(angle), -0.3f, -std::sin(angle));
+
+			const XMVECTOR eye = XMLoadFloat3(&mCameraPos);
+			const XMMATRIX view = XMMatrixLookToLH(eye, XMLoadFloat3(&look), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			const XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * Pi, 16.0f / 9.0f, 1.0f, 20000.0f);
+			BoundingFrustum frustum;
+			BoundingFrustum::CreateFromMatrix(frustum, proj);
+			XMVECTOR det;
+			frustum.Transform(frustum, XMMatrixInverse(&det, view));
+
+			XMFLOAT4X4 shadowViewProj;
+			XMStoreFloat4x4(&shadowViewProj, view * XMMatrixPerspectiveFovLH(0.4f * Pi, 16.0f / 9.0f, 1.0f, 800.0f));
+			const FrustumPlanes shadow = FrustumPlanes::FromViewProj(shadowViewProj.m);
+
+			mTerrain.Update(mCameraPos, frustum, &shadow, 1);
+		}
+
+		void EditHeights(uint32_t edit)
+		{
+			RaiseBump(mSamples, edit);
+			LoadHeights();
+			mTerrain.SetHeights(&mHeights);
+		}
+
+		const XMFLOAT3& GetCameraPos() const { return mCameraPos; }
+
+	private:
+		void LoadHeights()
+		{
+			mHeights.Init(mSamples.data(), Resolution, Resolution);
+			mHeights.SetPlacement(Offset.x, Offset.z, WorldSize, Offset.y, HeightScale);
+		}
+
+		std::vector<float> mSamples;
+		HeightField mHeights;
+		Terrain mTerrain;
+		XMFLOAT3 mCameraPos = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	};
+
+	//
+	// Stress
+	//
+
+	void Mix(uint64_t& h, uint64_t value)
+	{
+		h ^= value + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+	}
+
+	uint64_t Bits(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	void MixTiles(uint64_t& h, const std::vector<TileSnapshot>& tiles)
+	{
+		Mix(h, tiles.size());
+		for (const TileSnapshot& tile : tiles)
+		{
+			Mix(h, (uint64_t)tile.TileIndex);
+			Mix(h, (uint64_t)tile.Lod);
+			Mix(h, Bits(tile.Size));
+			Mix(h, Bits(tile.WorldPos.x));
+			Mix(h, Bits(tile.WorldPos.z));
+			Mix(h, Bits(tile.Bounds.Center.y));
+			Mix(h, Bits(tile.Bounds.Extents.y));
+		}
+	}
+
+	// Everything in a version, heights by sampling a fixed grid
+	uint64_t HashSnapshot(const TerrainSnapshot& s)
+	{
+		uint64_t h = 0;
+		Mix(h, s.Version);
+		Mix(h, s.Frame);
+		Mix(h, Bits(s.CameraPos.x));
+		Mix(h, Bits(s.CameraPos.z));
+		Mix(h, s.HeightsVersion);
+		MixTiles(h, s.Tiles);
+		Mix(h, s.ShadowTiles.size());
+		for (const std::vector<TileSnapshot>& tiles : s.ShadowTiles)
+			MixTiles(h, tiles);
+		Mix(h, s.GridSize);
+		Mix(h, Bits(s.CellSize));
+		for (int32_t cell : s.Cells)
+			Mix(h, (uint64_t)(uint32_t)cell);
+		for (int z = 0; z < 8; ++z)
+			for (int x = 0; x < 8; ++x)
+				Mix(h, Bits(s.HeightAt(Offset.x + (x + 0.5f) * WorldSize / 8.0f, Offset.z + (z + 0.5f) * WorldSize / 8.0f)));
+		return h;
+	}
+
+	// Empty when the grid finds every tile at its centre
+	std::string VerifyGrid(const TerrainSnapshot& s)
+	{
+		for (size_t i = 0; i < s.Tiles.size(); ++i)
+		{
+			const TileSnapshot& tile = s.Tiles[i];
+			if (s.FindTile(tile.Bounds.Center.x, tile.Bounds.Center.z) != &tile)
+				return "tile " + std::to_string(tile.TileIndex) + " not found at its centre";
+		}
+		if (!s.Tiles.empty() && s.GridSize == 0)
+			return "no grid";
+		return std::string();
+	}
+
+	// A version held for the whole test: nothing published after it may
+	// touch it, and it is reclaimed once let go
+	void StressPinning()
+	{
+		typedef SnapshotPublisher<std::vector<uint64_t>> Publisher;
+		Publisher publisher;
+		Publisher::Reader reader(publisher);
+		Check(reader.Begin() == nullptr, "pinning", "a version before the first Publish");
+		reader.End();
+
+		auto publish = [&](uint64_t value)
+		{
+			std::vector<uint64_t>& v = publisher.BeginWrite();
+			v.assign(16 + value % 5, value);
+			publisher.Publish();
+		};
+
+		publish(1);
+		const std::vector<uint64_t>* pinned = reader.Begin();
+		for (uint64_t value = 2; value <= 10; ++value)
+			publish(value);
+		Check(pinned && pinned->size() == 17 && pinned->front() == 1 && pinned->back() == 1, "pinning", "version 1 changed while held");
+		Check(publisher.GetStats().Retired == 9, "pinning",
+			std::to_string(publisher.GetStats().Retired) + " retired versions kept while one is held, 9 expected");
+		{
+			Publisher::Reader other(publisher);
+			Publisher::ReadScope scope(other);
+			Check(scope && scope->front() == 10, "pinning", "a new reader did not get the current version");
+		}
+		reader.End();
+		publisher.Reclaim();
+		const SnapshotStats stats = publisher.GetStats();
+		Check(stats.Retired == 0 && stats.Reclaimed == 9, "pinning",
+			std::to_string(stats.Retired) + " retired, " + std::to_string(stats.Reclaimed) + " reclaimed after End");
+		Check(stats.Spare == Publisher::MaxSpare, "pinning", std::to_string(stats.Spare) + " spare versions");
+
+		// Spares are reused, not allocated
+		const uint64_t allocated = stats.Allocated;
+		publish(11);
+		publish(12);
+		Check(publisher.GetStats().Allocated == allocated, "pinning", "BeginWrite allocated with spares left");
+	}
+
+	// Every slot taken: one more reader throws, and a slot let go is free again
+	void StressSlots()
+	{
+		typedef SnapshotPublisher<int> Publisher;
+		Publisher publisher;
+		std::vector<std::unique_ptr<Publisher::Reader>> readers;
+		for (uint32_t i = 0; i < Publisher::MaxReaders; ++i)
+			readers.push_back(std::make_unique<Publisher::Reader>(publisher));
+		bool threw = false;
+		try
+		{
+			Publisher::Reader extra(publisher);
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+		Check(threw, "slots", "a reader beyond MaxReaders was claimed");
+		Check(publisher.GetStats().Readers == Publisher::MaxReaders, "slots", "claimed slot count");
+		readers.pop_back();
+		threw = false;
+		try
+		{
+			Publisher::Reader again(publisher);
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+		Check(!threw, "slots", "a released slot could not be claimed again");
+	}
+
+	struct StressResult
+	{
+		uint64_t Reads = 0;
+		uint64_t Holds = 0;
+		SnapshotStats Stats;
+	};
+
+	StressResult StressTerrain(uint32_t seed, int publishes, unsigned readerCount)
+	{
+		World world;
+		TerrainSnapshots snapshots;
+		snapshots.SetHeights(world.GetHeights());
+
+		// The hash of each version, written before it can be read
+		std::vector<std::atomic<uint64_t>> expected(publishes + 1);
+		for (auto& hash : expected)
+			hash.store(0);
+
+		std::atomic<bool> done{ false };
+		std::atomic<uint64_t> reads{ 0 };
+		std::atomic<uint64_t> holds{ 0 };
+		std::vector<std::thread> readers;
+		for (unsigned r = 0; r < readerCount; ++r)
+		{
+			readers.emplace_back([&, r]()
+			{
+				std::mt19937 rng(seed * 31u + r);
+				TerrainSnapshots::Reader reader(snapshots.GetPublisher());
+				uint64_t lastVersion = 0, lastHeights = 0;
+				uint64_t count = 0, held = 0;
+				while (!done.load(std::memory_order_relaxed))
+				{
+					const TerrainSnapshot* s = reader.Begin();
+					if (!s)
+					{
+						reader.End();
+						std::this_thread::yield();
+						continue;
+					}
+					const uint64_t version = s->Version;
+					Check(version >= lastVersion && s->HeightsVersion >= lastHeights, "order",
+						"version " + std::to_string(version) + " after " + std::to_string(lastVersion));
+					lastVersion = version;
+					lastHeights = s->HeightsVersion;
+
+					uint64_t want = 0;
+					while ((want = expected[version].load(std::memory_order_acquire)) == 0)
+						std::this_thread::yield();
+					const uint64_t hash = HashSnapshot(*s);
+					Check(hash == want, "contents", "version " + std::to_string(version) + " differs from what was published");
+					const std::string grid = VerifyGrid(*s);
+					Check(grid.empty(), "grid", "version " + std::to_string(version) + ": " + grid);
+
+					// Held across publishes, the version must not change
+					if (rng() % 16 == 0)
+					{
+						Spin(0.2);
+						Check(HashSnapshot(*s) == want, "held", "version " + std::to_string(version) + " changed while held");
+						++held;
+					}
+					reader.End();
+					++count;
+					if (rng() % 8 == 0)
+						std::this_thread::yield();
+				}
+				reads.fetch_add(count);
+				holds.fetch_add(held);
+			});
+		}
+
+		std::mt19937 rng(seed);
+		uint32_t edits = 0;
+		for (uint64_t frame = 1; frame <= (uint64_t)publishes; ++frame)
+		{
+			world.Update(frame);
+			if (frame % 97 == 0)
+			{
+				world.EditHeights(++edits);
+				snapshots.SetHeights(world.GetHeights());
+			}
+			snapshots.Publish(world.GetTerrain(), frame, world.GetCameraPos());
+			const TerrainSnapshot* current = snapshots.GetPublisher().GetCurrent();
+			Check(current && current->Version == frame, "publish", "current version " +
+				std::to_string(current ? current->Version : 0) + " after publish " + std::to_string(frame));
+			expected[frame].store(HashSnapshot(*current), std::memory_order_release);
+			if (rng() % 4 == 0)
+				std::this_thread::yield();
+		}
+		// Let every reader see the last version before stopping
+		Spin(5.0);
+		done.store(true);
+		for (std::thread& reader : readers)
+			reader.join();
+
+		snapshots.GetPublisher().Reclaim();
+		StressResult result;
+		result.Reads = reads.load();
+		result.Holds = holds.load();
+		result.Stats = snapshots.GetStats();
+		Check(result.Stats.Retired == 0, "reclaim", std::to_string(result.Stats.Retired) + " versions left retired without readers");
+		Check(result.Stats.Reclaimed == (uint64_t)publishes - 1, "reclaim",
+			std::to_string(result.Stats.Reclaimed) + " reclaimed of " + std::to_string(publishes - 1) + " replaced");
+		Check(result.Stats.Readers == 0, "reclaim", std::to_string(result.Stats.Readers) + " reader slots still claimed");
+		return result;
+	}
+
+	void RunStress(const BenchConfig& config)
+	{
+		const unsigned readers = (std::max)(4u, std::thread::hardware_concurrency());
+		StressPinning();
+		StressSlots();
+		for (int round = 0; round < config.Rounds; ++round)
+		{
+			const StressResult r = StressTerrain(1000u + (uint32_t)round, config.Publishes, readers);
+			fprintf(stderr, "stress round %d: %llu reads (%llu held), %llu versions allocated for %llu publishes\n", round,
+				(unsigned long long)r.Reads, (unsigned long long)r.Holds, (unsigned long long)r.Stats.Allocated,
+				(unsigned long long)r.Stats.Published);
+		}
+		fprintf(stderr, "stress: %d rounds of %d publishes, %u readers, %d failures\n", config.Rounds, config.Publishes, readers, gFailures.load());
+	}
+
+	//
+	// Bench
+	//
+
+	struct Sample
+	{
+		std::string Mode;
+		unsigned Readers = 0;
+		uint64_t Reads = 0;
+		double Seconds = 0.0;
+		std::vector<double> ReadNs;         // every 64th read
+		std::vector<double> PublishMs;
+		uint64_t Allocated = 0;
+	};
+
+	// What a reader does with a snapshot: the tile and ground under a point
+	float Query(const TerrainSnapshot& s, float x, float z)
+	{
+		const TileSnapshot* tile = s.FindTile(x, z);
+		return s.HeightAt(x, z) + (tile ? (float)tile->Lod : -1.0f);
+	}
+
+	// One way of sharing the snapshot between the writer and the readers
+	class Sharing
+	{
+	public:
+		virtual ~Sharing() = default;
+		virtual void Publish(World& world, uint64_t frame) = 0;
+		// Query on the current snapshot; reader threads call BeginReader
+		// first and EndReader last
+		virtual float Read(float x, float z) = 0;
+		virtual void BeginReader() {}
+		virtual void EndReader() {}
+		virtual uint64_t GetAllocated() const { return 0; }
+	};
+
+	class EpochSharing : public Sharing
+	{
+	public:
+		explicit EpochSharing(World& world) { mSnapshots.SetHeights(world.GetHeights()); }
+
+		void Publish(World& world, uint64_t frame) override { mSnapshots.Publish(world.GetTerrain(), frame, world.GetCameraPos()); }
+
+		void BeginReader() override { tReader.reset(new TerrainSnapshots::Reader(mSnapshots.GetPublisher())); }
+		void EndReader() override { tReader.reset(); }
+
+		float Read(float x, float z) override
+		{
+			TerrainSnapshots::ReadScope s(*tReader);
+			return s ? Query(*s.Get(), x, z) : 0.0f;
+		}
+
+		uint64_t GetAllocated() const override { return mSnapshots.GetStats().Allocated; }
+
+	private:
+		TerrainSnapshots mSnapshots;
+		static thread_local std::unique_ptr<TerrainSnapshots::Reader> tReader;
+	};
+
+	thread_local std::unique_ptr<TerrainSnapshots::Reader> EpochSharing::tReader;
+
+	// A new snapshot per publish; readers copy the pointer under the lock and
+	// the last one out frees it
+	class MutexSharing : public Sharing
+	{
+	public:
+		explicit MutexSharing(World& world) : mHeights(std::make_shared<const HeightField>(world.GetHeights())) {}
+
+		void Publish(World& world, uint64_t frame) override
+		{
+			std::shared_ptr<TerrainSnapshot> next = std::make_shared<TerrainSnapshot>();
+			next->Version = frame;
+			next->Frame = frame;
+			next->CameraPos = world.GetCameraPos();
+			next->Heights = mHeights;
+			next->Capture(world.GetTerrain());
+			++mAllocated;
+			std::lock_guard<std::mutex> lock(mLock);
+			mCurrent = std::move(next);
+		}
+
+		float Read(float x, float z) override
+		{
+			std::shared_ptr<const TerrainSnapshot> s;
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+				s = mCurrent;
+			}
+			return s ? Query(*s, x, z) : 0.0f;
+		}
+
+		uint64_t GetAllocated() const override { return mAllocated; }
+
+	private:
+		std::shared_ptr<const HeightField> mHeights;
+		std::mutex mLock;
+		std::shared_ptr<const TerrainSnapshot> mCurrent;
+		uint64_t mAllocated = 0;
+	};
+
+	// One snapshot, rewritten in place while readers are locked out
+	class SharedMutexSharing : public Sharing
+	{
+	public:
+		explicit SharedMutexSharing(World& world) { mSnapshot.Heights = std::make_shared<const HeightField>(world.GetHeights()); }
+
+		void Publish(World& world, uint64_t frame) override
+		{
+			std::unique_lock<std::shared_mutex> lock(mLock);
+			mSnapshot.Version = frame;
+			mSnapshot.Frame = frame;
+			mSnapshot.CameraPos = world.GetCameraPos();
+			mSnapshot.Capture(world.GetTerrain());
+		}
+
+		float Read(float x, float z) override
+		{
+			std::shared_lock<std::shared_mutex> lock(mLock);
+			return mSnapshot.Version ? Query(mSnapshot, x, z) : 0.0f;
+		}
+
+	private:
+		std::shared_mutex mLock;
+		TerrainSnapshot mSnapshot;
+	};
+
+	Sample Measure(const BenchConfig& config, World& world, const char* mode, unsigned readerCount)
+	{
+		std::unique_ptr<Sharing> sharing;
+		if (strcmp(mode, "epoch") == 0)
+			sharing.reset(new EpochSharing(world));
+		else if (strcmp(mode, "mutex") == 0)
+			sharing.reset(new MutexSharing(world));
+		else
+			sharing.reset(new SharedMutexSharing(world));
+
+		Sample sample;
+		sample.Mode = mode;
+		sample.Readers = readerCount;
+
+		std::atomic<bool> stop{ false };
+		std::atomic<uint64_t> reads{ 0 };
+		std::mutex latencyLock;
+
+		uint64_t frame = 1;
+		world.Update(frame);
+		sharing->Publish(world, frame);
+
+		std::thread writer([&]()
+		{
+			auto next = std::chrono::steady_clock::now();
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(config.PublishMs));
+				std::this_thread::sleep_until(next);
+				world.Update(++frame);
+				const auto start = std::chrono::steady_clock::now();
+				sharing->Publish(world, frame);
+				sample.PublishMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			}
+		});
+
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> readers;
+		for (unsigned r = 0; r < readerCount; ++r)
+		{
+			readers.emplace_back([&, r]()
+			{
+				sharing->BeginReader();
+				std::mt19937 rng(17u + r);
+				std::uniform_real_distribution<float> coord(0.0f, WorldSize);
+				std::vector<double> latency;
+				uint64_t count = 0;
+				float sum = 0.0f;
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					for (int i = 0; i < 63; ++i)
+						sum += sharing->Read(Offset.x + coord(rng), Offset.z + coord(rng));
+					const float x = Offset.x + coord(rng), z = Offset.z + coord(rng);
+					const auto readStart = std::chrono::steady_clock::now();
+					sum += sharing->Read(x, z);
+					latency.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - readStart).count());
+					count += 64;
+				}
+				sharing->EndReader();
+				reads.fetch_add(count);
+				gSink.fetch_add((uint64_t)std::fabs(sum), std::memory_order_relaxed);
+				std::lock_guard<std::mutex> lock(latencyLock);
+				sample.ReadNs.insert(sample.ReadNs.end(), latency.begin(), latency.end());
+			});
+		}
+
+		std::this_thread::sleep_for(std::chrono::duration<double>(config.Seconds));
+		stop.store(true);
+		for (std::thread& reader : readers)
+			reader.join();
+		sample.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		writer.join();
+		sample.Reads = reads.load();
+		sample.Allocated = sharing->GetAllocated();
+		return sample;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<Sample>& samples)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"SnapshotBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"seconds\": " << config.Seconds << ", \"publish_ms\": " << config.PublishMs
+			<< ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"stress_rounds\": " << config.Rounds << ", \"stress_publishes\": " << config.Publishes
+			<< ", \"stress_failures\": " << gFailures.load() << " },\n";
+		out << "  \"results\": [\n";
+		for (size_t s = 0; s < samples.size(); ++s)
+		{
+			const Sample& sample = samples[s];
+			const double perSecond = sample.Seconds > 0.0 ? sample.Reads / sample.Seconds : 0.0;
+			out << "    { \"mode\": " << JsonString(sample.Mode) << ", \"readers\": " << sample.Readers
+				<< ", \"reads_per_sec\": " << perSecond << ", \"reads_per_sec_per_reader\": " << perSecond / (std::max)(1u, sample.Readers)
+				<< ", \"p50_read_ns\": " << Percentile(sample.ReadNs, 0.50) << ", \"p99_read_ns\": " << Percentile(sample.ReadNs, 0.99)
+				<< ", \"publishes\": " << sample.PublishMs.size() << ", \"p50_publish_ms\": " << Percentile(sample.PublishMs, 0.50)
+				<< ", \"p99_publish_ms\": " << Percentile(sample.PublishMs, 0.99) << ", \"snapshots_allocated\": " << sample.Allocated << " }"
+				<< (s + 1 < samples.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseReaders(const std::string& text, BenchConfig& config)
+	{
+		std::stringstream list(text);
+		std::string item;
+		while (std::getline(list, item, ','))
+		{
+			const int readers = atoi(item.c_str());
+			if (readers < 1 || readers >= (int)TerrainSnapshots::Publisher::MaxReaders)
+				return false;
+			config.Readers.push_back((unsigned)readers);
+		}
+		return !config.Readers.empty();
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--readers" && hasValue && ParseReaders(argv[++i], config)) {}
+			else if (arg == "--seconds" && hasValue) config.Seconds = (std::max)(atof(argv[++i]), 0.01);
+			else if (arg == "--publish-ms" && hasValue) config.PublishMs = (std::max)(atof(argv[++i]), 0.0);
+			else if (arg == "--publishes" && hasValue) config.Publishes = (std::max)(atoi(argv[++i]), 100);
+			else if (arg == "--rounds" && hasValue) config.Rounds = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--no-bench") config.Bench = false;
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+	if (config.Readers.empty())
+	{
+		const unsigned hardware = (std::min)((std::max)(1u, std::thread::hardware_concurrency()), TerrainSnapshots::Publisher::MaxReaders - 1);
+		for (unsigned readers = 1; readers < hardware; readers *= 2)
+			config.Readers.push_back(readers);
+		config.Readers.push_back(hardware);
+	}
+	std::sort(config.Readers.begin(), config.Readers.end());
+	config.Readers.erase(std::unique(config.Readers.begin(), config.Readers.end()), config.Readers.end());
+
+	if (config.Rounds > 0)
+		RunStress(config);
+
+	std::vector<Sample> samples;
+	if (config.Bench)
+	{
+		World world;
+		for (const char* mode : { "epoch", "mutex", "shared_mutex" })
+		{
+			for (unsigned readers : config.Readers)
+			{
+				samples.push_back(Measure(config, world, mode, readers));
+				const Sample& sample = samples.back();
+				fprintf(stderr, "%-12s %2u readers %12.0f reads/s, p50 read %7.0f ns, p99 %7.0f ns, publish p50 %6.3f ms\n",
+					sample.Mode.c_str(), sample.Readers, sample.Reads / (std::max)(sample.Seconds, 1e-9),
+					Percentile(sample.ReadNs, 0.50), Percentile(sample.ReadNs, 0.99), Percentile(sample.PublishMs, 0.50));
+			}
+		}
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, samples);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
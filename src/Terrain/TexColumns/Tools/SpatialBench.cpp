@@ -0,0 +1,769 @@
+//***************************************************************************************
+// SpatialBench.cpp
+//
+// Checks and benchmarks the culling structures of the custom meshes. The
+// check part fills a LooseOctree the way BuildOctree does (a cube over the
+// terrain, leaf cells of about 32 units) with --items boxes - most of them
+// mesh-sized and spread over the terrain, some large or outside the world so
+// they end up in the root - and then runs --rounds rounds of edits: small
+// moves that mostly stay in their node, jumps across the world, removals and
+// reinsertions. After the fill and after every round each camera frustum
+// and a few boxes are queried and compared with a brute-force test of every
+// live box; a missing or extra id, a wrong count or a node left behind
+// after everything is removed is a failure and the exit code is 3.
+//
+// The bench part times the frustum query over the same cameras against the
+// brute-force loop the app ran before the octree, and Move over a round of
+// small moves, each --reps times.
+//
+// The animated meshes go into a DynamicAabbTree instead: --objects boxes,
+// half bobbing in place like maxwell, half wandering over the terrain. The
+// check part moves them for --frames frames and every 50 frames runs
+// Validate() and compares the frustum, box and ray queries with a brute-force
+// test of every leaf; the leaves must hold their objects, removals and
+// reinsertions must keep it all consistent, and after all that moving the
+// tree may cost at most twice what a fresh build of the same boxes does.
+// The bench part times every frame both ways the app could keep the tree:
+// Move on every object then the camera query, against clearing, inserting
+// and rebuilding it then the same query. Keeping the tree must be cheaper.
+//
+// Needs no GPU or window. Windows: SpatialBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common SpatialBench.cpp
+//       -L<dir> -lTerrainCore -o SpatialBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: SpatialBench [options]
+//   --items <n>          boxes (50000)
+//   --rounds <n>         edit rounds in the check part (10)
+//   --cameras <n>        camera frustums queried (16)
+//   --reps <n>           samples per octree timing (30)
+//   --objects <n>        moving boxes in the BVH (5000)
+//   --frames <n>         frames they move for, in each part (300)
+//   --label <text>       stored in the output, e.g. the commit
+//   --out <file.json>    (stdout)
+//***************************************************************************************
+
+#include "LooseOctree.h"
+#include "DynamicAabbTree.h"
+#include "BenchReport.h"
+
+#include <DirectXMath.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// The app's terrain (TexColumnsApp::InitTerrain)
+	const float WorldSize = 1024.0f;
+	const XMFLOAT3 TerrainOffset = XMFLOAT3(0.0f, -100.0f, 0.0f);
+
+	struct BenchConfig
+	{
+		int Items = 50000;
+		int Rounds = 10;
+		int Cameras = 16;
+		int Reps = 30;
+		int Objects = 5000;
+		int Frames = 300;
+		std::string Label;
+		std::string Out;
+	};
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Kept alive so the compiler cannot drop a loop's result
+	volatile size_t gSink = 0;
+
+	struct Random
+	{
+		uint32_t State;
+
+		explicit Random(uint32_t seed) : State(seed) {}
+
+		uint32_t Next()
+		{
+			State = State * 1664525u + 1013904223u;
+			return State;
+		}
+		// [lo, hi)
+		float Range(float lo, float hi)
+		{
+			return lo + (hi - lo) * (float)(Next() >> 8) * (1.0f / 16777216.0f);
+		}
+	};
+
+	// The cube BuildOctree uses and the depth it picks for it
+	Aabb WorldBox()
+	{
+		Aabb world;
+		world.Min[0] = TerrainOffset.x;
+		world.Min[1] = TerrainOffset.y;
+		world.Min[2] = TerrainOffset.z;
+		world.Max[0] = TerrainOffset.x + WorldSize;
+		world.Max[1] = TerrainOffset.y + WorldSize;
+		world.Max[2] = TerrainOffset.z + WorldSize;
+		return world;
+	}
+
+	uint32_t WorldDepth()
+	{
+		uint32_t depth = 0;
+		while (depth < 8 && WorldSize / float(1u << (depth + 1)) >= 32.0f)
+			++depth;
+		return depth;
+	}
+
+	// Mostly mesh-sized boxes near the ground; one in 50 large, one in 50
+	// partly or fully outside the world
+	Aabb RandomBox(Random& random)
+	{
+		const uint32_t kind = random.Next() % 50;
+		const float margin = kind == 0 ? 200.0f : 0.0f;
+		const float center[3] =
+		{
+			TerrainOffset.x + random.Range(-margin, WorldSize + margin),
+			TerrainOffset.y + random.Range(0.0f, 300.0f),
+			TerrainOffset.z + random.Range(-margin, WorldSize + margin),
+		};
+		const float size = kind == 1 ? random.Range(50.0f, 400.0f) : random.Range(0.5f, 20.0f);
+		const float extents[3] = { size, size * random.Range(0.5f, 2.0f), size };
+		return Aabb::FromCenterExtents(center, extents);
+	}
+
+	Aabb Offset(const Aabb& box, float dx, float dy, float dz)
+	{
+		Aabb moved = box;
+		const float d[3] = { dx, dy, dz };
+		for (int c = 0; c < 3; ++c)
+		{
+			moved.Min[c] += d[c];
+			moved.Max[c] += d[c];
+		}
+		return moved;
+	}
+
+	// Cameras above the terrain looking out at the app's field of view
+	std::vector<FrustumPlanes> MakeCameras(int count)
+	{
+		std::vector<FrustumPlanes> cameras;
+		Random random(7);
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+		for (int i = 0; i < count; ++i)
+		{
+			const XMVECTOR eye = XMVectorSet(TerrainOffset.x + random.Range(0.0f, WorldSize), TerrainOffset.y + random.Range(50.0f, 300.0f),
+				TerrainOffset.z + random.Range(0.0f, WorldSize), 1.0f);
+			const float yaw = random.Range(0.0f, XM_2PI), pitch = random.Range(-0.6f, 0.1f);
+			const XMVECTOR forward = XMVectorSet(std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw), 0.0f);
+			XMFLOAT4X4 viewProj;
+			XMStoreFloat4x4(&viewProj, XMMatrixLookToLH(eye, forward, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj);
+			cameras.push_back(FrustumPlanes::FromViewProj(viewProj.m));
+		}
+		return cameras;
+	}
+
+	// The boxes the octree should hold; Live[id] is false after a Remove
+	struct Scene
+	{
+		std::vector<Aabb> Boxes;
+		std::vector<char> Live;
+	};
+
+	void BruteForce(const Scene& scene, const FrustumPlanes& frustum, std::vector<uint32_t>& result)
+	{
+		for (size_t id = 0; id < scene.Boxes.size(); ++id)
+			if (scene.Live[id] && frustum.Classify(scene.Boxes[id]) != CullResult::Outside)
+				result.push_back((uint32_t)id);
+	}
+
+	//
+	// Checks
+	//
+
+	void CompareIds(std::vector<uint32_t> found, std::vector<uint32_t> expected, const std::string& where)
+	{
+		std::sort(found.begin(), found.end());
+		std::sort(expected.begin(), expected.end());
+		if (found == expected)
+			return;
+		std::vector<uint32_t> difference;
+		std::set_difference(expected.begin(), expected.end(), found.begin(), found.end(), std::back_inserter(difference));
+		const size_t missing = difference.size();
+		difference.clear();
+		std::set_difference(found.begin(), found.end(), expected.begin(), expected.end(), std::back_inserter(difference));
+		const size_t extra = difference.size();
+		Check(false, "query", where + ": " + std::to_string(found.size()) + " found, " + std::to_string(expected.size()) +
+			" expected, " + std::to_string(missing) + " missing, " + std::to_string(extra) + " extra or repeated");
+	}
+
+	void CheckQueries(const LooseOctree& octree, const Scene& scene, const std::vector<FrustumPlanes>& cameras, const std::string& when)
+	{
+		size_t live = 0;
+		for (char l : scene.Live)
+			live += l != 0;
+		Check(octree.GetCount() == live, "count", when + ": " + std::to_string(octree.GetCount()) + " items, " +
+			std::to_string(live) + " expected");
+		for (size_t id = 0; id < scene.Boxes.size(); ++id)
+		{
+			if (octree.Contains((uint32_t)id) != (scene.Live[id] != 0))
+			{
+				Check(false, "count", when + ": Contains(" + std::to_string(id) + ") is wrong");
+				break;
+			}
+		}
+
+		for (size_t c = 0; c < cameras.size(); ++c)
+		{
+			std::vector<uint32_t> found, expected;
+			OctreeQueryStats stats;
+			octree.Query(cameras[c], found, &stats);
+			BruteForce(scene, cameras[c], expected);
+			CompareIds(found, expected, when + ", camera " + std::to_string(c));
+			Check(stats.ItemsTested + stats.ItemsAccepted >= found.size(), "query", when + ", camera " + std::to_string(c) +
+				": stats count fewer items than were returned");
+		}
+
+		// Box queries: a cell-sized box, a large one, one straddling the edge
+		const float boxes[3][6] =
+		{
+			{ 100.0f, -50.0f, 100.0f, 140.0f, 100.0f, 140.0f },
+			{ 200.0f, -100.0f, 300.0f, 700.0f, 200.0f, 600.0f },
+			{ -150.0f, -100.0f, 900.0f, 50.0f, 300.0f, 1100.0f },
+		};
+		const float origin[3] = { TerrainOffset.x, TerrainOffset.y, TerrainOffset.z };
+		for (int b = 0; b < 3; ++b)
+		{
+			Aabb query;
+			for (int c = 0; c < 3; ++c)
+			{
+				query.Min[c] = origin[c] + boxes[b][c];
+				query.Max[c] = origin[c] + boxes[b][c + 3];
+			}
+			std::vector<uint32_t> found, expected;
+			octree.Query(query, found);
+			for (size_t id = 0; id < scene.Boxes.size(); ++id)
+				if (scene.Live[id] && scene.Boxes[id].Overlaps(query))
+					expected.push_back((uint32_t)id);
+			CompareIds(found, expected, when + ", box " + std::to_string(b));
+		}
+	}
+
+	void CheckOctree(const BenchConfig& config, const std::vector<FrustumPlanes>& cameras)
+	{
+		Random random(1);
+		LooseOctree octree(WorldBox(), WorldDepth());
+		Scene scene;
+		for (int id = 0; id < config.Items; ++id)
+		{
+			scene.Boxes.push_back(RandomBox(random));
+			scene.Live.push_back(1);
+			octree.Insert((uint32_t)id, scene.Boxes.back());
+		}
+		CheckQueries(octree, scene, cameras, "after insert");
+
+		for (int round = 0; round < config.Rounds; ++round)
+		{
+			for (size_t id = 0; id < scene.Boxes.size(); ++id)
+			{
+				const uint32_t action = random.Next() % 100;
+				if (!scene.Live[id])
+				{
+					// Removed last round: back in, somewhere else
+					if (action < 50)
+					{
+						scene.Boxes[id] = RandomBox(random);
+						scene.Live[id] = 1;
+						octree.Insert((uint32_t)id, scene.Boxes[id]);
+					}
+				}
+				else if (action < 30)
+				{
+					// Drift, as the animated meshes do
+					scene.Boxes[id] = Offset(scene.Boxes[id], random.Range(-2.0f, 2.0f), random.Range(-0.5f, 0.5f), random.Range(-2.0f, 2.0f));
+					octree.Move((uint32_t)id, scene.Boxes[id]);
+				}
+				else if (action < 33)
+				{
+					scene.Boxes[id] = RandomBox(random);
+					octree.Move((uint32_t)id, scene.Boxes[id]);
+				}
+				else if (action < 35)
+				{
+					scene.Live[id] = 0;
+					octree.Remove((uint32_t)id);
+				}
+			}
+			CheckQueries(octree, scene, cameras, "round " + std::to_string(round));
+		}
+
+		for (size_t id = 0; id < scene.Boxes.size(); ++id)
+			if (scene.Live[id])
+				octree.Remove((uint32_t)id);
+		Check(octree.GetCount() == 0, "clear", std::to_string(octree.GetCount()) + " items left after removing all");
+		Check(octree.GetNodeCount() == 1, "clear", std::to_string(octree.GetNodeCount()) + " nodes left after removing all, expected the root");
+	}
+
+	// Animated meshes: half bob in place like maxwell, half wander over the
+	// terrain and turn back at its edges
+	struct MovingObjects
+	{
+		std::vector<Aabb> Base;
+		std::vector<Aabb> Boxes;
+		std::vector<std::array<float, 3>> Velocity;
+		std::vector<float> Phase;
+
+		MovingObjects(int count, uint32_t seed)
+		{
+			Random random(seed);
+			for (int i = 0; i < count; ++i)
+			{
+				const float center[3] = { TerrainOffset.x + random.Range(0.0f, WorldSize), TerrainOffset.y + random.Range(0.0f, 200.0f),
+					TerrainOffset.z + random.Range(0.0f, WorldSize) };
+				const float extents[3] = { random.Range(0.5f, 5.0f), random.Range(0.5f, 5.0f), random.Range(0.5f, 5.0f) };
+				Base.push_back(Aabb::FromCenterExtents(center, extents));
+				Velocity.push_back({ random.Range(-1.0f, 1.0f), random.Range(-0.2f, 0.2f), random.Range(-1.0f, 1.0f) });
+				Phase.push_back(random.Range(0.0f, 6.2831853f));
+			}
+			Boxes = Base;
+		}
+
+		void Step(int frame)
+		{
+			for (size_t i = 0; i < Boxes.size(); ++i)
+			{
+				if (i & 1)
+				{
+					Boxes[i] = Offset(Base[i], 0.0f, 20.0f * std::sin(frame * 0.05f + Phase[i]), 0.0f);
+					continue;
+				}
+				const float lo[3] = { TerrainOffset.x, TerrainOffset.y, TerrainOffset.z };
+				for (int c = 0; c < 3; ++c)
+				{
+					const float center = Boxes[i].Center(c) + Velocity[i][c];
+					if (center < lo[c] || center > lo[c] + (c == 1 ? 200.0f : WorldSize))
+						Velocity[i][c] = -Velocity[i][c];
+				}
+				Boxes[i] = Offset(Boxes[i], Velocity[i][0], Velocity[i][1], Velocity[i][2]);
+			}
+		}
+	};
+
+	void CheckBvhQueries(const DynamicAabbTree& tree, const MovingObjects& objects, const std::vector<int32_t>& proxies,
+		const std::vector<FrustumPlanes>& cameras, const std::string& when)
+	{
+		Check(tree.Validate(), "validate", when + ": Validate failed");
+		size_t live = 0;
+		for (int32_t proxy : proxies)
+			live += proxy >= 0;
+		Check(tree.GetLeafCount() == live, "count", when + ": " + std::to_string(tree.GetLeafCount()) + " leaves, " +
+			std::to_string(live) + " expected");
+
+		// Queries test the fat boxes, which must hold the object boxes
+		for (size_t i = 0; i < proxies.size(); ++i)
+		{
+			if (proxies[i] >= 0 && !tree.GetFatBox(proxies[i]).Contains(objects.Boxes[i]))
+			{
+				Check(false, "fat box", when + ": object " + std::to_string(i) + " is outside its leaf");
+				break;
+			}
+		}
+
+		for (size_t c = 0; c < cameras.size(); ++c)
+		{
+			std::vector<uint32_t> found, expected;
+			tree.Query(cameras[c], found);
+			for (size_t i = 0; i < proxies.size(); ++i)
+				if (proxies[i] >= 0 && cameras[c].Classify(tree.GetFatBox(proxies[i])) != CullResult::Outside)
+					expected.push_back((uint32_t)i);
+			CompareIds(found, expected, when + ", camera " + std::to_string(c));
+		}
+
+		Aabb box;
+		box.Min[0] = TerrainOffset.x + 300.0f; box.Min[1] = TerrainOffset.y; box.Min[2] = TerrainOffset.z + 200.0f;
+		box.Max[0] = TerrainOffset.x + 500.0f; box.Max[1] = TerrainOffset.y + 100.0f; box.Max[2] = TerrainOffset.z + 600.0f;
+		std::vector<uint32_t> found, expected;
+		tree.Query(box, found);
+		for (size_t i = 0; i < proxies.size(); ++i)
+			if (proxies[i] >= 0 && tree.GetFatBox(proxies[i]).Overlaps(box))
+				expected.push_back((uint32_t)i);
+		CompareIds(found, expected, when + ", box");
+
+		// A ray across the terrain against a slab test of every leaf
+		const float origin[3] = { TerrainOffset.x - 10.0f, TerrainOffset.y + 50.0f, TerrainOffset.z + 3.0f };
+		const float direction[3] = { 1.0f, 0.01f, 0.9f };
+		const float maxDistance = 2000.0f;
+		std::vector<RayHit> hits;
+		tree.RayCast(origin, direction, maxDistance, hits);
+		found.clear();
+		expected.clear();
+		bool sorted = true;
+		for (size_t h = 0; h < hits.size(); ++h)
+		{
+			found.push_back(hits[h].UserData);
+			sorted &= h == 0 || hits[h - 1].Distance <= hits[h].Distance;
+		}
+		for (size_t i = 0; i < proxies.size(); ++i)
+		{
+			if (proxies[i] < 0)
+				continue;
+			const Aabb& leaf = tree.GetFatBox(proxies[i]);
+			float enter = 0.0f, leave = maxDistance;
+			for (int c = 0; c < 3; ++c)
+			{
+				float t0 = (leaf.Min[c] - origin[c]) / direction[c], t1 = (leaf.Max[c] - origin[c]) / direction[c];
+				if (t0 > t1)
+					std::swap(t0, t1);
+				enter = (std::max)(enter, t0);
+				leave = (std::min)(leave, t1);
+			}
+			if (enter <= leave)
+				expected.push_back((uint32_t)i);
+		}
+		CompareIds(found, expected, when + ", ray");
+		Check(sorted, "ray", when + ": hits not sorted by distance");
+	}
+
+	void CheckBvh(const BenchConfig& config, const std::vector<FrustumPlanes>& cameras)
+	{
+		MovingObjects objects(config.Objects, 11);
+		DynamicAabbTree tree(0.5f);   // BuildOctree's margin
+		std::vector<int32_t> proxies;
+		for (size_t i = 0; i < objects.Boxes.size(); ++i)
+			proxies.push_back(tree.Insert(objects.Boxes[i], (uint32_t)i));
+		CheckBvhQueries(tree, objects, proxies, cameras, "after insert");
+		tree.Rebuild();
+		CheckBvhQueries(tree, objects, proxies, cameras, "after Rebuild");
+		const float rebuiltCost = tree.ComputeCost();
+
+		for (int frame = 1; frame <= config.Frames; ++frame)
+		{
+			objects.Step(frame);
+			for (size_t i = 0; i < proxies.size(); ++i)
+				tree.Move(proxies[i], objects.Boxes[i]);
+			if (frame % 50 == 0 || frame == config.Frames)
+				CheckBvhQueries(tree, objects, proxies, cameras, "frame " + std::to_string(frame));
+		}
+
+		// Refits and rotations must keep the tree near what a build gives
+		const float refitCost = tree.ComputeCost();
+		DynamicAabbTree rebuilt(0.5f);
+		for (size_t i = 0; i < objects.Boxes.size(); ++i)
+			rebuilt.Insert(objects.Boxes[i], (uint32_t)i);
+		rebuilt.Rebuild();
+		Check(refitCost <= 2.0f * rebuilt.ComputeCost(), "decay", "cost " + std::to_string(refitCost) + " after " +
+			std::to_string(config.Frames) + " frames, " + std::to_string(rebuilt.ComputeCost()) + " rebuilt (" +
+			std::to_string(rebuiltCost) + " at the start)");
+
+		for (size_t i = 0; i < proxies.size(); i += 3)
+		{
+			tree.Remove(proxies[i]);
+			proxies[i] = -1;
+		}
+		CheckBvhQueries(tree, objects, proxies, cameras, "after removing a third");
+		for (size_t i = 0; i < proxies.size(); i += 3)
+			proxies[i] = tree.Insert(objects.Boxes[i], (uint32_t)i);
+		CheckBvhQueries(tree, objects, proxies, cameras, "after inserting them again");
+	}
+
+	//
+	// Bench
+	//
+
+	struct OctreeSample
+	{
+		double OctreeUs = 0.0;        // per camera query
+		double BruteUs = 0.0;
+		double MoveNs = 0.0;          // per Move
+	};
+
+	struct OctreeTotals
+	{
+		size_t Visible = 0;           // per camera, averaged
+		OctreeQueryStats Stats;       // per camera, averaged
+		size_t Nodes = 0;
+	};
+
+	template <typename Sample>
+	double Median(const std::vector<Sample>& samples, double Sample::* field)
+	{
+		std::vector<double> values;
+		for (const Sample& s : samples)
+			values.push_back(s.*field);
+		return Percentile(values, 0.50);
+	}
+
+	std::vector<OctreeSample> MeasureOctree(const BenchConfig& config, const std::vector<FrustumPlanes>& cameras, OctreeTotals& totals)
+	{
+		Random random(3);
+		LooseOctree octree(WorldBox(), WorldDepth());
+		Scene scene;
+		for (int id = 0; id < config.Items; ++id)
+		{
+			scene.Boxes.push_back(RandomBox(random));
+			scene.Live.push_back(1);
+			octree.Insert((uint32_t)id, scene.Boxes.back());
+		}
+		totals.Nodes = octree.GetNodeCount();
+
+		std::vector<uint32_t> result;
+		result.reserve(scene.Boxes.size());
+		for (const FrustumPlanes& camera : cameras)
+		{
+			result.clear();
+			OctreeQueryStats stats;
+			octree.Query(camera, result, &stats);
+			totals.Visible += result.size();
+			totals.Stats.NodesVisited += stats.NodesVisited;
+			totals.Stats.ItemsTested += stats.ItemsTested;
+			totals.Stats.ItemsAccepted += stats.ItemsAccepted;
+		}
+		const size_t count = (std::max)((size_t)1, cameras.size());
+		totals.Visible /= count;
+		totals.Stats.NodesVisited /= (uint32_t)count;
+		totals.Stats.ItemsTested /= (uint32_t)count;
+		totals.Stats.ItemsAccepted /= (uint32_t)count;
+
+		std::vector<Aabb> drift(scene.Boxes.size());
+		std::vector<OctreeSample> samples;
+		for (int rep = 0; rep < config.Reps; ++rep)
+		{
+			OctreeSample sample;
+			auto start = std::chrono::steady_clock::now();
+			for (const FrustumPlanes& camera : cameras)
+			{
+				result.clear();
+				octree.Query(camera, result);
+				gSink = gSink + result.size();
+			}
+			sample.OctreeUs = MsSince(start) * 1000.0 / count;
+
+			start = std::chrono::steady_clock::now();
+			for (const FrustumPlanes& camera : cameras)
+			{
+				result.clear();
+				BruteForce(scene, camera, result);
+				gSink = gSink + result.size();
+			}
+			sample.BruteUs = MsSince(start) * 1000.0 / count;
+
+			// Every box drifts a little, outside the timing
+			for (size_t id = 0; id < scene.Boxes.size(); ++id)
+				drift[id] = Offset(scene.Boxes[id], random.Range(-2.0f, 2.0f), random.Range(-0.5f, 0.5f), random.Range(-2.0f, 2.0f));
+			start = std::chrono::steady_clock::now();
+			for (size_t id = 0; id < scene.Boxes.size(); ++id)
+				octree.Move((uint32_t)id, drift[id]);
+			sample.MoveNs = MsSince(start) * 1e6 / scene.Boxes.size();
+			scene.Boxes.swap(drift);
+			samples.push_back(sample);
+		}
+		return samples;
+	}
+
+	// One frame of the animated meshes: keeping the tree (Move every object,
+	// then the camera query) against building it again from the new boxes
+	struct BvhSample
+	{
+		double RefitMs = 0.0;
+		double RefitQueryMs = 0.0;
+		double RebuildMs = 0.0;
+		double RebuildQueryMs = 0.0;
+		double Moved = 0.0;           // Move calls that changed the tree
+	};
+
+	struct BvhTotals
+	{
+		float RefitCost = 0.0f;
+		float RebuildCost = 0.0f;
+		int32_t RefitHeight = 0;
+		int32_t RebuildHeight = 0;
+	};
+
+	std::vector<BvhSample> MeasureBvh(const BenchConfig& config, const std::vector<FrustumPlanes>& cameras, BvhTotals& totals)
+	{
+		MovingObjects objects(config.Objects, 13);
+		DynamicAabbTree tree(0.5f);
+		std::vector<int32_t> proxies;
+		for (size_t i = 0; i < objects.Boxes.size(); ++i)
+			proxies.push_back(tree.Insert(objects.Boxes[i], (uint32_t)i));
+		tree.Rebuild();
+
+		std::vector<uint32_t> result;
+		result.reserve(objects.Boxes.size());
+		auto query = [&](const DynamicAabbTree& t)
+		{
+			for (const FrustumPlanes& camera : cameras)
+			{
+				result.clear();
+				t.Query(camera, result);
+				gSink = gSink + result.size();
+			}
+		};
+
+		DynamicAabbTree rebuilt(0.5f);
+		std::vector<BvhSample> samples;
+		for (int frame = 1; frame <= config.Frames; ++frame)
+		{
+			objects.Step(frame);
+			BvhSample sample;
+			auto start = std::chrono::steady_clock::now();
+			uint32_t moved = 0;
+			for (size_t i = 0; i < proxies.size(); ++i)
+				moved += tree.Move(proxies[i], objects.Boxes[i]);
+			sample.RefitMs = MsSince(start);
+			sample.Moved = moved;
+			start = std::chrono::steady_clock::now();
+			query(tree);
+			sample.RefitQueryMs = MsSince(start);
+
+			start = std::chrono::steady_clock::now();
+			rebuilt.Clear();
+			for (size_t i = 0; i < objects.Boxes.size(); ++i)
+				rebuilt.Insert(objects.Boxes[i], (uint32_t)i);
+			rebuilt.Rebuild();
+			sample.RebuildMs = MsSince(start);
+			start = std::chrono::steady_clock::now();
+			query(rebuilt);
+			sample.RebuildQueryMs = MsSince(start);
+			samples.push_back(sample);
+		}
+		totals.RefitCost = tree.ComputeCost();
+		totals.RebuildCost = rebuilt.ComputeCost();
+		totals.RefitHeight = tree.GetHeight();
+		totals.RebuildHeight = rebuilt.GetHeight();
+		Check(tree.Validate() && rebuilt.Validate(), "validate", "after the bench frames");
+		return samples;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<OctreeSample>& samples, const OctreeTotals& totals,
+		const std::vector<BvhSample>& bvhSamples, const BvhTotals& bvhTotals)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"SpatialBench\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"items\": " << config.Items << ", \"rounds\": " << config.Rounds << ", \"cameras\": " << config.Cameras
+			<< ", \"reps\": " << config.Reps << ", \"objects\": " << config.Objects << ", \"frames\": " << config.Frames << ", \"depth\": " << WorldDepth() << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ", \"failures\": " << gFailures << " },\n";
+		out << "  \"results\": [\n";
+		out << "    {\n";
+		out << "      \"structure\": \"octree\", \"nodes\": " << totals.Nodes << ", \"visible\": " << totals.Visible
+			<< ", \"nodes_visited\": " << totals.Stats.NodesVisited << ", \"items_tested\": " << totals.Stats.ItemsTested
+			<< ", \"items_accepted\": " << totals.Stats.ItemsAccepted << ",\n";
+		WriteSummary(out, "query_us", samples, [](const OctreeSample& s) { return s.OctreeUs; });
+		WriteSummary(out, "brute_force_us", samples, [](const OctreeSample& s) { return s.BruteUs; });
+		WriteSummary(out, "move_ns", samples, [](const OctreeSample& s) { return s.MoveNs; }, true);
+		out << "    },\n";
+		out << "    {\n";
+		out << "      \"structure\": \"bvh\", \"cost_refit\": " << bvhTotals.RefitCost << ", \"cost_rebuild\": " << bvhTotals.RebuildCost
+			<< ", \"height_refit\": " << bvhTotals.RefitHeight << ", \"height_rebuild\": " << bvhTotals.RebuildHeight << ",\n";
+		WriteSummary(out, "moved", bvhSamples, [](const BvhSample& s) { return s.Moved; });
+		WriteSummary(out, "refit_ms", bvhSamples, [](const BvhSample& s) { return s.RefitMs; });
+		WriteSummary(out, "refit_query_ms", bvhSamples, [](const BvhSample& s) { return s.RefitQueryMs; });
+		WriteSummary(out, "rebuild_ms", bvhSamples, [](const BvhSample& s) { return s.RebuildMs; });
+		WriteSummary(out, "rebuild_query_ms", bvhSamples, [](const BvhSample& s) { return s.RebuildQueryMs; }, true);
+		out << "    }\n";
+		out << "  ]\n}\n";
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--items" && hasValue) config.Items = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--rounds" && hasValue) config.Rounds = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--cameras" && hasValue) config.Cameras = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--reps" && hasValue) config.Reps = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--objects" && hasValue) config.Objects = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--frames" && hasValue) config.Frames = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	const std::vector<FrustumPlanes> cameras = MakeCameras(config.Cameras);
+	CheckOctree(config, cameras);
+	CheckBvh(config, cameras);
+
+	OctreeTotals totals;
+	const std::vector<OctreeSample> samples = MeasureOctree(config, cameras, totals);
+	const double octreeUs = Median(samples, &OctreeSample::OctreeUs);
+	const double bruteUs = Median(samples, &OctreeSample::BruteUs);
+	const double moveNs = Median(samples, &OctreeSample::MoveNs);
+	fprintf(stderr, "octree     %d items, %zu nodes: query %8.1f us (brute force %8.1f us, %4.1fx), %zu visible, %u nodes visited, %u tested, %u accepted\n",
+		config.Items, totals.Nodes, octreeUs, bruteUs, octreeUs > 0.0 ? bruteUs / octreeUs : 0.0, totals.Visible,
+		totals.Stats.NodesVisited, totals.Stats.ItemsTested, totals.Stats.ItemsAccepted);
+	fprintf(stderr, "octree     move %6.1f ns per item\n", moveNs);
+
+	BvhTotals bvhTotals;
+	const std::vector<BvhSample> bvhSamples = MeasureBvh(config, cameras, bvhTotals);
+	const double refitMs = Median(bvhSamples, &BvhSample::RefitMs) + Median(bvhSamples, &BvhSample::RefitQueryMs);
+	const double rebuildMs = Median(bvhSamples, &BvhSample::RebuildMs) + Median(bvhSamples, &BvhSample::RebuildQueryMs);
+	Check(refitMs < rebuildMs, "bvh", "keeping the tree costs " + std::to_string(refitMs) + " ms a frame, rebuilding it " +
+		std::to_string(rebuildMs) + " ms");
+	fprintf(stderr, "bvh        %d objects: refit + query %7.3f ms/frame (%.0f moved), rebuild + query %7.3f ms/frame (%4.1fx), cost %.1f vs %.1f rebuilt\n",
+		config.Objects, refitMs, Median(bvhSamples, &BvhSample::Moved), rebuildMs, refitMs > 0.0 ? rebuildMs / refitMs : 0.0,
+		bvhTotals.RefitCost, bvhTotals.RebuildCost);
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, samples, totals, bvhSamples, bvhTotals);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
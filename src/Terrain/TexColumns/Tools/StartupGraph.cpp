@@ -0,0 +1,717 @@
+//***************************************************************************************
+// StartupGraph.cpp
+//
+// Checks the TaskGraph that TexColumnsApp::Initialize runs on, and times the
+// CPU side of that startup on 1, 2, 4, ... threads.
+//
+// The stress part builds random graphs of worker and main tasks and checks
+// what Initialize relies on: every task runs exactly once, never before all
+// of its dependencies have ended, main tasks only on the thread that called
+// Run, and a task that throws skips everything after it while the rest still
+// runs and Run rethrows. Any violation is a failure and the exit code is 3.
+// Built with -fsanitize=thread it is the graph's race test.
+//
+// The startup part is the app's graph with the same tasks, queues and
+// dependencies. Tasks with CPU work do it with the engine's code:
+//   LoadTextures        BC-encodes --textures images, one job each, waited
+//                       for in order as LoadQueuedTextures does
+//   InitTerrain         Terrain::Initialize on built-in hills
+//   CookMesh <name>     MeshOptimizer and MeshSimplifier LODs on a geosphere
+//                       standing in for the model
+//   BuildShapeGeometry  the shape meshes and the cooked meshes into one stream
+//   BuildTerrainGeometry TerrainMesh::BuildTiles
+//   BuildRenderItems, BuildOctree, BuildFrameResources over those items
+// Tasks that only talk to D3D (root signatures, shaders, PSOs, descriptor
+// heaps, uploads) spin for --stand-in ms instead; the app's own startup
+// report has their real cost. The loops inside tasks run on one thread here,
+// so the times show what the graph alone buys. Each thread count gets a
+// fresh JobSystem; the checksum over everything built must match across
+// counts. The report gives the wall time, work, critical path and speedup
+// per count, and each task's start, length and thread from the last run.
+//
+// Needs no GPU or window. Windows: StartupGraph.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common StartupGraph.cpp
+//       -L<dir> -lTerrainCore -o StartupGraph
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: StartupGraph [options]
+//   --threads <a,b,..>  thread counts to time (1, 2, 4, ... up to the hardware)
+//   --textures <n>      images LoadTextures encodes (9, as the app queues)
+//   --texture-size <n>  their width and height (512)
+//   --stand-in <ms>     time each D3D-only task takes (2)
+//   --reps <n>          startups per thread count (5)
+//   --rounds <n>        stress rounds (300); 0 skips the stress part
+//   --no-bench          stress only
+//   --label <text>      stored in the output, e.g. the commit
+//   --out <file.json>   (stdout)
+//***************************************************************************************
+
+#include "Terrain.h"
+#include "TerrainMesh.h"
+#include "HeightField.h"
+#include "LooseOctree.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "GeometryGenerator.h"
+#include "BCEncoder.h"
+#include "TaskGraph.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const float Pi = 3.14159265359f;
+
+	// The app's terrain and frame ring (TexColumnsApp)
+	const float WorldSize = 1024.0f;
+	const int MaxLod = 5;
+	const XMFLOAT3 TerrainOffset = XMFLOAT3(0.0f, -100.0f, 0.0f);
+	const int FrameResources = 6;          // gNumFrameResources
+	const size_t ObjectStride = 256;       // d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants))
+
+	struct BenchConfig
+	{
+		std::vector<unsigned> Threads;
+		int Textures = 9;
+		int TextureSize = 512;
+		double StandInMs = 2.0;
+		int Reps = 5;
+		int Rounds = 300;
+		bool Bench = true;
+		std::string Label;
+		std::string Out;
+	};
+
+	struct Sample
+	{
+		unsigned Threads;
+		uint64_t Checksum;
+		std::vector<double> WallMs;
+		double BusyMs = 0.0;
+		double CriticalMs = 0.0;
+		std::vector<std::string> CriticalPath;
+		std::vector<TaskGraph::TaskTiming> Tasks;  // of the last run
+	};
+
+	void Mix(uint64_t& hash, uint64_t value)
+	{
+		hash = (hash ^ value) * 1099511628211ull;
+	}
+
+	void MixBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i)
+			Mix(hash, bytes[i]);
+	}
+
+	const uint64_t HashSeed = 14695981039346656037ull;
+
+	// Kept alive so the compiler cannot drop a stand-in's loop; tasks on
+	// any thread add to it
+	std::atomic<uint64_t> gSink{ 0 };
+
+	void Spin(double ms)
+	{
+		const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(ms);
+		uint64_t x = 1;
+		while (std::chrono::steady_clock::now() < end)
+			for (int i = 0; i < 64; ++i)
+				x = x * 6364136223846793005ull + 1442695040888963407ull;
+		gSink.fetch_add(x, std::memory_order_relaxed);
+	}
+
+	//
+	// Stress
+	//
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	// Start and end tickets from one counter order the tasks without clocks
+	struct StressTask
+	{
+		std::vector<TaskGraph::TaskId> Dependencies;
+		bool Main = false;
+		uint32_t Work = 0;
+		std::atomic<int> Runs{ 0 };
+		std::atomic<uint64_t> Start{ 0 };
+		std::atomic<uint64_t> End{ 0 };
+		std::atomic<bool> OffMain{ false };
+	};
+
+	void StressRandomGraphs(JobSystem& jobs, int rounds, uint32_t& random)
+	{
+		const char* Names[] = { "a", "b", "c", "d", "e", "f", "g", "h" };
+		for (int round = 0; round < rounds; ++round)
+		{
+			random = random * 1664525u + 1013904223u;
+			const size_t count = 1 + (random >> 8) % 120;
+
+			std::vector<std::unique_ptr<StressTask>> tasks;
+			std::atomic<uint64_t> ticket{ 1 };
+			const std::thread::id caller = std::this_thread::get_id();
+			TaskGraph graph;
+			for (size_t i = 0; i < count; ++i)
+			{
+				tasks.push_back(std::make_unique<StressTask>());
+				StressTask& task = *tasks.back();
+				random = random * 1664525u + 1013904223u;
+				task.Main = (random >> 12) % 4 == 0;
+				task.Work = (random >> 16) % 2000;
+				const uint32_t dependencyCount = i ? (random >> 24) % 5 : 0;
+				for (uint32_t d = 0; d < dependencyCount; ++d)
+				{
+					random = random * 1664525u + 1013904223u;
+					task.Dependencies.push_back((TaskGraph::TaskId)((random >> 8) % i));
+				}
+
+				StressTask* state = &task;
+				auto body = [state, &ticket, caller]()
+				{
+					state->Start.store(ticket.fetch_add(1));
+					state->Runs.fetch_add(1);
+					if (state->Main && std::this_thread::get_id() != caller)
+						state->OffMain.store(true);
+					uint64_t x = state->Work;
+					for (uint32_t k = 0; k < state->Work; ++k)
+						x = x * 6364136223846793005ull + 1442695040888963407ull;
+					gSink.fetch_add(x, std::memory_order_relaxed);
+					state->End.store(ticket.fetch_add(1));
+				};
+				// Add takes an initializer list, so spell out each length
+				const auto& deps = task.Dependencies;
+				const TaskGraph::Queue queue = task.Main ? TaskGraph::Queue::Main : TaskGraph::Queue::Worker;
+				const char* name = Names[i % 8];
+				switch (deps.size())
+				{
+				case 0: graph.Add(name, body, {}, queue); break;
+				case 1: graph.Add(name, body, { deps[0] }, queue); break;
+				case 2: graph.Add(name, body, { deps[0], deps[1] }, queue); break;
+				case 3: graph.Add(name, body, { deps[0], deps[1], deps[2] }, queue); break;
+				default: graph.Add(name, body, { deps[0], deps[1], deps[2], deps[3] }, queue); break;
+				}
+			}
+
+			// Every other round runs the graph twice, as a reused graph would be
+			const int runs = round % 2 ? 2 : 1;
+			for (int run = 1; run <= runs; ++run)
+			{
+				graph.Run(jobs);
+				for (size_t i = 0; i < count; ++i)
+				{
+					const StressTask& task = *tasks[i];
+					const TaskGraph::TaskTiming& timing = graph.GetTiming((TaskGraph::TaskId)i);
+					const std::string where = "round " + std::to_string(round) + " task " + std::to_string(i);
+					Check(task.Runs.load() == run, "once", where + " ran " + std::to_string(task.Runs.load()) + " times");
+					Check(timing.Ran, "ran", where + " is marked skipped");
+					Check(!task.OffMain.load(), "main", where + " ran off the main thread");
+					Check(!task.Main || timing.Thread == 0, "main", where + " timed on thread " + std::to_string(timing.Thread));
+					for (TaskGraph::TaskId dependency : task.Dependencies)
+					{
+						Check(tasks[dependency]->End.load() < task.Start.load(), "order",
+							where + " started before task " + std::to_string(dependency) + " ended");
+						Check(graph.GetTiming(dependency).EndMs <= timing.StartMs, "order",
+							where + " timed before task " + std::to_string(dependency) + " ended");
+					}
+				}
+				Check(graph.GetWallMs() >= graph.GetCriticalPath() - 1e-6, "critical path",
+					"round " + std::to_string(round) + " critical path is longer than the run");
+			}
+		}
+	}
+
+	// a throws: its dependents are skipped, the rest runs, Run rethrows
+	void StressExceptions(JobSystem& jobs)
+	{
+		for (TaskGraph::Queue queue : { TaskGraph::Queue::Worker, TaskGraph::Queue::Main })
+		{
+			std::atomic<int> ran[6] = {};
+			TaskGraph graph;
+			auto root = graph.Add("root", [&]() { ran[0]++; });
+			auto fails = graph.Add("fails", [&]() { ran[1]++; throw std::runtime_error("cook failed"); }, { root }, queue);
+			auto after = graph.Add("after", [&]() { ran[2]++; }, { fails });
+			auto side = graph.Add("side", [&]() { ran[3]++; }, { root });
+			graph.Add("join", [&]() { ran[4]++; }, { after, side }, TaskGraph::Queue::Main);
+			graph.Add("free", [&]() { ran[5]++; });
+
+			std::string message;
+			try
+			{
+				graph.Run(jobs);
+			}
+			catch (const std::runtime_error& e)
+			{
+				message = e.what();
+			}
+			const char* test = queue == TaskGraph::Queue::Main ? "exception (main)" : "exception (worker)";
+			Check(message == "cook failed", test, "Run rethrew \"" + message + "\"");
+			Check(ran[0] == 1 && ran[1] == 1 && ran[3] == 1 && ran[5] == 1, test, "a task off the failed path did not run");
+			Check(ran[2] == 0 && ran[4] == 0, test, "a task after the failed one ran");
+			Check(!graph.GetTiming(2).Ran && !graph.GetTiming(4).Ran && graph.GetTiming(3).Ran, test, "skipped tasks are marked wrong");
+		}
+	}
+
+	void RunStress(const BenchConfig& config)
+	{
+		uint32_t random = 12345;
+		for (unsigned threads : config.Threads)
+		{
+			JobSystem jobs(threads - 1);
+			StressRandomGraphs(jobs, config.Rounds, random);
+			StressExceptions(jobs);
+			fprintf(stderr, "stress %3u threads: %d failure(s) so far\n", jobs.GetThreadCount(), gFailures);
+		}
+	}
+
+	//
+	// Startup
+	//
+
+	struct Item
+	{
+		Aabb Bounds;
+		int NumFramesDirty = 0;
+	};
+
+	// What TexColumnsApp keeps from startup, as far as the CPU builds it
+	struct StartupState
+	{
+		std::vector<std::vector<uint8_t>> Images;
+		std::vector<std::vector<uint8_t>> Textures;     // BC1 blocks
+		std::unique_ptr<Terrain> TerrainTree;
+		HeightField Heights;
+		CookedMesh Meshes[2];
+		MeshOptimizeStats MeshStats[2];
+		std::vector<CookedVertex> ShapeVertices;
+		std::vector<uint16_t> ShapeIndices;
+		std::vector<TerrainVertex> TerrainVertices;
+		std::vector<uint32_t> TerrainIndices;
+		std::vector<TerrainTileRange> TerrainRanges;
+		std::vector<uint8_t> Uploaded;                  // stands in for the default-heap buffers
+		std::vector<Item> Items;
+		LooseOctree Octree;
+		std::vector<std::vector<uint8_t>> FrameResources;
+
+		uint64_t Checksum() const
+		{
+			uint64_t hash = HashSeed;
+			for (const auto& texture : Textures)
+				MixBytes(hash, texture.data(), texture.size());
+			for (const CookedMesh& mesh : Meshes)
+			{
+				Mix(hash, mesh.Indices.size());
+				Mix(hash, mesh.Lods.size());
+			}
+			MixBytes(hash, ShapeVertices.data(), ShapeVertices.size() * sizeof(CookedVertex));
+			MixBytes(hash, ShapeIndices.data(), ShapeIndices.size() * sizeof(uint16_t));
+			MixBytes(hash, TerrainVertices.data(), TerrainVertices.size() * sizeof(TerrainVertex));
+			MixBytes(hash, TerrainIndices.data(), TerrainIndices.size() * sizeof(uint32_t));
+			Mix(hash, Uploaded.size());
+			Mix(hash, Items.size());
+			Mix(hash, Octree.GetCount());
+			Mix(hash, Octree.GetNodeCount());
+			Mix(hash, FrameResources.size());
+			return hash;
+		}
+	};
+
+	void BuildImages(const BenchConfig& config, StartupState& state)
+	{
+		const uint32_t size = (uint32_t)config.TextureSize;
+		state.Images.assign(config.Textures, std::vector<uint8_t>((size_t)size * size * 4));
+		for (size_t t = 0; t < state.Images.size(); ++t)
+		{
+			uint8_t* pixels = state.Images[t].data();
+			for (uint32_t y = 0; y < size; ++y)
+				for (uint32_t x = 0; x < size; ++x)
+				{
+					uint8_t* p = pixels + ((size_t)y * size + x) * 4;
+					p[0] = (uint8_t)(x * (t + 1));
+					p[1] = (uint8_t)(y * (t + 3));
+					p[2] = (uint8_t)((x ^ y) + t * 40);
+					p[3] = 255;
+				}
+		}
+	}
+
+	// Built-in heights: a few octaves of smooth bumps, as TerrainBench
+	void BuildHills(HeightField& heights, uint32_t resolution)
+	{
+		std::vector<float> samples((size_t)resolution * resolution);
+		for (uint32_t y = 0; y < resolution; ++y)
+		{
+			for (uint32_t x = 0; x < resolution; ++x)
+			{
+				const float u = (float)x / resolution, v = (float)y / resolution;
+				float h = 0.0f, amplitude = 0.5f, frequency = 2.0f;
+				for (int octave = 0; octave < 5; ++octave)
+				{
+					h += amplitude * (0.5f + 0.5f * std::sin(2.0f * Pi * frequency * u + octave) * std::cos(2.0f * Pi * frequency * v + 2.0f * octave));
+					amplitude *= 0.5f;
+					frequency *= 2.0f;
+				}
+				samples[(size_t)y * resolution + x] = (std::min)(h, 1.0f);
+			}
+		}
+		heights.Init(samples.data(), resolution, resolution);
+	}
+
+	void AppendMesh(const GeometryGenerator::MeshData& data, std::vector<CookedVertex>& vertices, std::vector<uint16_t>& indices)
+	{
+		const size_t base = vertices.size();
+		for (const auto& v : data.Vertices)
+		{
+			CookedVertex cooked;
+			cooked.Pos[0] = v.Position.x; cooked.Pos[1] = v.Position.y; cooked.Pos[2] = v.Position.z;
+			cooked.Normal[0] = v.Normal.x; cooked.Normal[1] = v.Normal.y; cooked.Normal[2] = v.Normal.z;
+			cooked.TexC[0] = v.TexC.x; cooked.TexC[1] = v.TexC.y;
+			cooked.Tangent[0] = v.TangentU.x; cooked.Tangent[1] = v.TangentU.y; cooked.Tangent[2] = v.TangentU.z;
+			vertices.push_back(cooked);
+		}
+		for (uint32_t index : data.Indices32)
+			indices.push_back((uint16_t)(base + index));
+	}
+
+	// A geosphere per submesh stands in for the model the app cooks from OBJ
+	void CookMesh(CookedMesh& mesh, MeshOptimizeStats& stats, uint32_t submeshes, uint32_t subdivisions)
+	{
+		GeometryGenerator geoGen;
+		mesh = CookedMesh();
+		for (uint32_t s = 0; s < submeshes; ++s)
+		{
+			GeometryGenerator::MeshData sphere = geoGen.CreateGeosphere(1.0f + s, subdivisions);
+			CookedSubmesh sm;
+			sm.StartIndex = (uint32_t)mesh.Indices.size();
+			sm.BaseVertex = (uint32_t)mesh.Vertices.size();
+			sm.VertexCount = (uint32_t)sphere.Vertices.size();
+			std::vector<CookedVertex> vertices;
+			std::vector<uint16_t> indices;
+			AppendMesh(sphere, vertices, indices);
+			mesh.Vertices.insert(mesh.Vertices.end(), vertices.begin(), vertices.end());
+			mesh.Indices.insert(mesh.Indices.end(), indices.begin(), indices.end());
+			sm.IndexCount = (uint32_t)mesh.Indices.size() - sm.StartIndex;
+			mesh.Submeshes.push_back(sm);
+		}
+		mesh.ComputeBounds();
+		MeshOptimizer::Optimize(mesh, &stats, 1);
+		MeshSimplifier::GenerateLods(mesh, { 0.5f, 0.25f, 0.125f }, 0.05f, 1);
+	}
+
+	// The graph TexColumnsApp::Initialize builds, task for task
+	void BuildStartup(TaskGraph& startup, StartupState& state, JobSystem& jobs, const BenchConfig& config)
+	{
+		using Queue = TaskGraph::Queue;
+		const double standIn = config.StandInMs;
+		auto d3d = [standIn]() { Spin(standIn); };
+
+		auto textures = startup.Add("LoadTextures", [&state, &jobs]()
+		{
+			state.Textures.assign(state.Images.size(), {});
+			std::vector<JobCounter> ready(state.Images.size());
+			for (size_t i = 0; i < state.Images.size(); ++i)
+			{
+				jobs.Run([&state, i]()
+				{
+					const uint32_t size = (uint32_t)std::sqrt((double)(state.Images[i].size() / 4));
+					state.Textures[i].resize(BCEncoder::CompressedSize(BCEncoder::Format::BC1, size, size));
+					BCEncoder::Encode(BCEncoder::Format::BC1, state.Images[i].data(), size, size, (size_t)size * 4,
+						state.Textures[i].data(), 1);
+				}, &ready[i]);
+			}
+			// Uploads are recorded in queue order
+			for (size_t i = 0; i < ready.size(); ++i)
+			{
+				jobs.Wait(ready[i]);
+				state.Uploaded.insert(state.Uploaded.end(), state.Textures[i].begin(), state.Textures[i].end());
+			}
+		}, {}, Queue::Main);
+		auto imgui = startup.Add("InitImGui", d3d, {}, Queue::Main);
+		auto rootSignature = startup.Add("BuildRootSignature", d3d);
+		auto standMeshRootSignature = startup.Add("BuildStandMeshRootSignature", d3d);
+		auto terrainRootSignature = startup.Add("BuildTerrainRootSignature", d3d);
+		auto csRootSignature = startup.Add("BuildCsRootSignature", d3d);
+		auto shaders = startup.Add("BuildShadersAndInputLayout", d3d);
+		auto terrain = startup.Add("InitTerrain", [&state]()
+		{
+			state.TerrainTree = std::make_unique<Terrain>();
+			state.TerrainTree->Initialize(WorldSize, MaxLod, TerrainOffset);
+			BuildHills(state.Heights, 512);
+			state.Heights.SetPlacement(TerrainOffset.x, TerrainOffset.z, WorldSize, TerrainOffset.y, state.TerrainTree->mHeightScale);
+			state.TerrainTree->SetHeights(&state.Heights);
+		});
+		auto cookGuard = startup.Add("CookMesh Guard", [&state]() { CookMesh(state.Meshes[0], state.MeshStats[0], 4, 5); });
+		auto cookMaxwell = startup.Add("CookMesh maxwell", [&state]() { CookMesh(state.Meshes[1], state.MeshStats[1], 1, 6); });
+
+		auto heaps = startup.Add("BuildDescriptorHeaps", d3d, { textures }, Queue::Main);
+		auto materials = startup.Add("BuildMaterials", d3d, { heaps });
+		auto residency = startup.Add("RegisterResidentTextures", d3d, { materials });
+		auto taa = startup.Add("InitTAAResources", d3d, { heaps }, Queue::Main);
+
+		auto shapes = startup.Add("BuildShapeGeometry", [&state]()
+		{
+			GeometryGenerator geoGen;
+			state.ShapeVertices.clear();
+			state.ShapeIndices.clear();
+			AppendMesh(geoGen.CreateBox(1.0f, 1.0f, 1.0f, 3), state.ShapeVertices, state.ShapeIndices);
+			AppendMesh(geoGen.CreateGrid(10.0f, 10.0f, 2, 2), state.ShapeVertices, state.ShapeIndices);
+			AppendMesh(geoGen.CreateSphere(0.5f, 20, 20), state.ShapeVertices, state.ShapeIndices);
+			AppendMesh(geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20), state.ShapeVertices, state.ShapeIndices);
+			for (const CookedMesh& mesh : state.Meshes)
+			{
+				state.ShapeVertices.insert(state.ShapeVertices.end(), mesh.Vertices.begin(), mesh.Vertices.end());
+				state.ShapeIndices.insert(state.ShapeIndices.end(), mesh.Indices.begin(), mesh.Indices.end());
+			}
+		}, { cookGuard, cookMaxwell, residency });
+		auto terrainGeometry = startup.Add("BuildTerrainGeometry", [&state]()
+		{
+			state.TerrainVertices.clear();
+			state.TerrainIndices.clear();
+			TerrainMesh::BuildTiles(state.TerrainTree->GetAllTiles(), state.TerrainVertices, state.TerrainIndices, state.TerrainRanges);
+		}, { terrain });
+		auto uploadShapes = startup.Add("UploadShapeGeometry", [&state, d3d]()
+		{
+			const uint8_t* vertices = reinterpret_cast<const uint8_t*>(state.ShapeVertices.data());
+			state.Uploaded.insert(state.Uploaded.end(), vertices, vertices + state.ShapeVertices.size() * sizeof(CookedVertex));
+			d3d();
+		}, { shapes }, Queue::Main);
+		auto uploadTerrain = startup.Add("UploadTerrainGeometry", [&state, d3d]()
+		{
+			const uint8_t* vertices = reinterpret_cast<const uint8_t*>(state.TerrainVertices.data());
+			state.Uploaded.insert(state.Uploaded.end(), vertices, vertices + state.TerrainVertices.size() * sizeof(TerrainVertex));
+			d3d();
+		}, { terrainGeometry }, Queue::Main);
+
+		auto renderItems = startup.Add("BuildRenderItems", [&state]()
+		{
+			state.Items.clear();
+			for (const auto& tile : state.TerrainTree->GetAllTiles())
+			{
+				const BoundingBox& box = tile->boundingBox;
+				const float center[3] = { box.Center.x, box.Center.y, box.Center.z };
+				const float extents[3] = { box.Extents.x, box.Extents.y, box.Extents.z };
+				state.Items.push_back({ Aabb::FromCenterExtents(center, extents) });
+			}
+			for (size_t m = 0; m < 2; ++m)
+				for (const CookedSubmesh& sm : state.Meshes[m].Submeshes)
+				{
+					const float center[3] = { sm.BoundsCenter[0] + 100.0f - 80.0f * m, sm.BoundsCenter[1] + 50.0f, sm.BoundsCenter[2] + 100.0f };
+					state.Items.push_back({ Aabb::FromCenterExtents(center, sm.BoundsExtents) });
+				}
+		}, { uploadShapes, uploadTerrain, materials });
+		auto frameResources = startup.Add("BuildFrameResources", [&state]()
+		{
+			state.FrameResources.assign(FrameResources, std::vector<uint8_t>(state.Items.size() * ObjectStride));
+			for (Item& item : state.Items)
+				item.NumFramesDirty = FrameResources;
+		}, { renderItems });
+		auto psos = startup.Add("BuildPSOs", d3d,
+			{ shaders, rootSignature, standMeshRootSignature, terrainRootSignature, csRootSignature, taa });
+		startup.Add("BuildOctree", [&state]()
+		{
+			Aabb world;
+			world.Min[0] = TerrainOffset.x;
+			world.Min[1] = TerrainOffset.y;
+			world.Min[2] = TerrainOffset.z;
+			world.Max[0] = TerrainOffset.x + WorldSize;
+			world.Max[1] = TerrainOffset.y + WorldSize;
+			world.Max[2] = TerrainOffset.z + WorldSize;
+			state.Octree.Reset(world, 5);
+			for (size_t i = 0; i < state.Items.size(); ++i)
+				state.Octree.Insert((uint32_t)i, state.Items[i].Bounds);
+		}, { renderItems });
+		startup.Add("BuildRenderIds", d3d, { psos, uploadShapes, uploadTerrain, frameResources, taa, imgui }, Queue::Main);
+	}
+
+	Sample Measure(const BenchConfig& config, unsigned threads)
+	{
+		JobSystem jobs(threads - 1);
+
+		Sample sample;
+		sample.Threads = jobs.GetThreadCount();
+		sample.Checksum = 0;
+		for (int rep = 0; rep < config.Reps; ++rep)
+		{
+			StartupState state;
+			BuildImages(config, state);
+			TaskGraph startup;
+			BuildStartup(startup, state, jobs, config);
+			startup.Run(jobs);
+
+			sample.WallMs.push_back(startup.GetWallMs());
+			const uint64_t checksum = state.Checksum();
+			Check(rep == 0 || checksum == sample.Checksum, "startup",
+				"checksum changed between runs on " + std::to_string(threads) + " threads");
+			sample.Checksum = checksum;
+
+			if (rep + 1 == config.Reps)
+			{
+				std::vector<TaskGraph::TaskId> path;
+				sample.CriticalMs = startup.GetCriticalPath(&path);
+				sample.BusyMs = startup.GetBusyMs();
+				for (TaskGraph::TaskId id : path)
+					sample.CriticalPath.push_back(startup.GetTiming(id).Name);
+				for (TaskGraph::TaskId id = 0; id < (TaskGraph::TaskId)startup.GetTaskCount(); ++id)
+					sample.Tasks.push_back(startup.GetTiming(id));
+			}
+		}
+		return sample;
+	}
+
+	void WriteReport(std::ostream& out, const BenchConfig& config, const std::vector<Sample>& samples)
+	{
+		out << "{\n";
+		out << "  \"benchmark\": \"StartupGraph\",\n";
+		out << "  \"label\": " << JsonString(config.Label) << ",\n";
+		out << "  \"config\": { \"textures\": " << config.Textures << ", \"texture_size\": " << config.TextureSize
+			<< ", \"stand_in_ms\": " << config.StandInMs << ", \"reps\": " << config.Reps
+			<< ", \"stress_rounds\": " << config.Rounds << ", \"stress_failures\": " << gFailures << " },\n";
+		out << "  \"results\": [\n";
+		const double serial = samples.empty() ? 0.0 : Percentile(samples.front().WallMs, 0.50);
+		for (size_t s = 0; s < samples.size(); ++s)
+		{
+			const Sample& sample = samples[s];
+			const double p50 = Percentile(sample.WallMs, 0.50);
+			const double speedup = p50 > 0.0 ? serial / p50 : 0.0;
+			char checksum[17];
+			snprintf(checksum, sizeof(checksum), "%016llx", (unsigned long long)sample.Checksum);
+
+			out << "    {\n";
+			out << "      \"threads\": " << sample.Threads << ", \"checksum\": \"" << checksum << "\",\n";
+			out << "      \"p50_wall_ms\": " << p50 << ", \"min_wall_ms\": " << *std::min_element(sample.WallMs.begin(), sample.WallMs.end())
+				<< ", \"speedup\": " << speedup << ", \"work_ms\": " << sample.BusyMs << ", \"critical_path_ms\": " << sample.CriticalMs << ",\n";
+			out << "      \"critical_path\": [";
+			for (size_t i = 0; i < sample.CriticalPath.size(); ++i)
+				out << (i ? ", " : "") << JsonString(sample.CriticalPath[i]);
+			out << "],\n";
+			out << "      \"tasks\": [\n";
+			for (size_t t = 0; t < sample.Tasks.size(); ++t)
+			{
+				const TaskGraph::TaskTiming& task = sample.Tasks[t];
+				out << "        { \"name\": " << JsonString(task.Name) << ", \"queue\": \""
+					<< (task.Where == TaskGraph::Queue::Main ? "main" : "worker") << "\", \"start_ms\": " << task.StartMs
+					<< ", \"ms\": " << task.EndMs - task.StartMs << ", \"thread\": " << task.Thread << " }"
+					<< (t + 1 < sample.Tasks.size() ? ",\n" : "\n");
+			}
+			out << "      ]\n";
+			out << "    }" << (s + 1 < samples.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	bool ParseThreads(const std::string& text, BenchConfig& config)
+	{
+		std::stringstream list(text);
+		std::string item;
+		while (std::getline(list, item, ','))
+		{
+			const int threads = atoi(item.c_str());
+			if (threads < 1)
+				return false;
+			config.Threads.push_back((unsigned)threads);
+		}
+		return !config.Threads.empty();
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--threads" && hasValue && ParseThreads(argv[++i], config)) {}
+			else if (arg == "--textures" && hasValue) config.Textures = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--texture-size" && hasValue) config.TextureSize = (std::max)(atoi(argv[++i]) / 4 * 4, 4);
+			else if (arg == "--stand-in" && hasValue) config.StandInMs = (std::max)(atof(argv[++i]), 0.0);
+			else if (arg == "--reps" && hasValue) config.Reps = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--rounds" && hasValue) config.Rounds = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--no-bench") config.Bench = false;
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+	if (config.Threads.empty())
+	{
+		const unsigned hardware = (std::max)(1u, std::thread::hardware_concurrency());
+		for (unsigned threads = 1; threads < hardware; threads *= 2)
+			config.Threads.push_back(threads);
+		config.Threads.push_back(hardware);
+	}
+	std::sort(config.Threads.begin(), config.Threads.end());
+	config.Threads.erase(std::unique(config.Threads.begin(), config.Threads.end()), config.Threads.end());
+
+	if (config.Rounds > 0)
+		RunStress(config);
+
+	std::vector<Sample> samples;
+	if (config.Bench)
+	{
+		for (unsigned threads : config.Threads)
+		{
+			samples.push_back(Measure(config, threads));
+			const Sample& sample = samples.back();
+			Check(sample.Checksum == samples.front().Checksum, "startup",
+				"checksum on " + std::to_string(threads) + " threads differs from " + std::to_string(samples.front().Threads));
+			fprintf(stderr, "startup %3u threads %8.1f ms wall, %8.1f ms work, critical path %8.1f ms\n", sample.Threads,
+				Percentile(sample.WallMs, 0.50), sample.BusyMs, sample.CriticalMs);
+		}
+	}
+
+	std::ostringstream out;
+	out.precision(6);
+	WriteReport(out, config, samples);
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+
+	if (gFailures > 0)
+		std::cerr << gFailures << " check(s) failed\n";
+	return gFailures > 0 ? 3 : 0;
+}
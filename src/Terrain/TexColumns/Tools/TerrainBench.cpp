@@ -0,0 +1,657 @@
+//***************************************************************************************
+// TerrainBench.cpp
+//
+// Headless flythrough benchmark of terrain selection and culling. Builds a
+// Terrain like TexColumnsApp::InitTerrain does, flies camera paths through
+// Terrain::Update and reports per-frame cost as JSON. Everything is a function
+// of the arguments (scripted paths are closed-form, recorded paths are read
+// from a file), so two builds given the same arguments do the same work; the
+// selection hash in the output says whether they also selected the same tiles.
+//
+// Before the paths it checks horizon culling against ray casts. For --views
+// low cameras in the bottoms of valleys, every tile the walk drops with
+// horizon culling (and keeps without it) is probed on a 9x9 grid of surface
+// points; a probe the straight line from the eye reaches over the
+// heightfield makes it a failure, and the exit code is 3. The share of tiles
+// culled per view is reported next to the share the ray casts find hidden.
+// With cascades every frame is also culled with one walk per view (the
+// camera's Update, then each cascade alone), timed as separate_update_ms;
+// those walks must find as many shadow tiles as the shared one.
+//
+// Needs no GPU or window. Windows: TerrainBench.vcxproj. Elsewhere, with
+// DirectXMath (and its sal.h) on the include path:
+//   g++ -std=c++17 -O2 -pthread -I<DirectXMath>/Inc -I.. -I../../../Common TerrainBench.cpp
+//       -L<dir> -lTerrainCore -o TerrainBench
+// with libTerrainCore.a built as TerrainCore.vcxproj describes.
+//
+// Usage: TerrainBench [options]
+//   --heightmap <file.dds>   heights from the red channel (default: built-in rolling hills)
+//   --size <units>           world size (1024)
+//   --maxlod <n>             quadtree depth (5)
+//   --height-scale <units>   (500, what Terrain::Initialize sets)
+//   --path <name|file>       orbit, flyover, ground or a recorded path; repeatable (all three)
+//   --frames <n>             frames per scripted path (2000)
+//   --warmup <n>             untimed frames before each path (50)
+//   --cascades <n>           also cull n shadow cascades in the same walk, and time
+//                            that against a walk per view (0)
+//   --no-horizon             disable horizon culling on the paths
+//   --views <n>              valley cameras for the horizon check (40)
+//   --label <text>           stored in the output, e.g. the commit
+//   --out <file.json>        (stdout)
+//
+// A recorded path has one frame per line, '#' starts a comment:
+//   posX posY posZ lookX lookY lookZ fovYDegrees
+// The app writes this format with "Record camera path".
+//***************************************************************************************
+
+#include "Terrain.h"
+#include "HeightField.h"
+#include "ShadowCascades.h"
+#include "BCEncoder.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Every allocation in the process is counted, so a frame's count is what
+// Terrain::Update allocated.
+static std::atomic<uint64_t> gAllocations{ 0 };
+
+void* operator new(size_t size)
+{
+	gAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace
+{
+	const float Pi = 3.14159265359f;
+
+	// Camera state of one frame; up is world y, the app's camera never rolls
+	struct CameraFrame
+	{
+		XMFLOAT3 Position;
+		XMFLOAT3 Look;
+		float FovY;
+	};
+
+	struct BenchConfig
+	{
+		std::string Heightmap;
+		float Size = 1024.0f;
+		int MaxLod = 5;
+		float HeightScale = 500.0f;
+		XMFLOAT3 Offset = XMFLOAT3(0.0f, -100.0f, 0.0f); // TexColumnsApp::terrainPos
+		std::vector<std::string> Paths;
+		int Frames = 2000;
+		int Warmup = 50;
+		uint32_t Cascades = 0;
+		bool Horizon = true;
+		int Views = 40;
+		std::string Label;
+		std::string Out;
+
+		// The app's camera
+		float Aspect = 16.0f / 9.0f;
+		float NearZ = 1.0f;
+		float FarZ = 20000.0f;
+		float ShadowDistance = 1000.0f;
+		XMFLOAT3 LightDirection = XMFLOAT3(0.57735f, -0.57735f, 0.57735f);
+	};
+
+	// Tiles are an 8x8 vertex grid plus skirts (TerrainMesh::GenerateTile); the
+	// count is before tessellation.
+	const int TileResolution = 8;
+	const uint64_t TileTriangles = 2 * (TileResolution - 1) * (TileResolution - 1) + 8 * (TileResolution - 1);
+
+	struct FrameSample
+	{
+		double Ms;
+		int Nodes;
+		int Tiles;
+		int HorizonCulled;
+		uint64_t Triangles;
+		uint64_t Allocations;
+		uint64_t ShadowTiles;
+		double SeparateMs;
+	};
+
+	XMFLOAT3 Normalized(float x, float y, float z)
+	{
+		const float length = std::sqrt(x * x + y * y + z * z);
+		return XMFLOAT3(x / length, y / length, z / length);
+	}
+
+	float GroundHeight(const HeightField& heights, const BenchConfig& config, float x, float z)
+	{
+		return heights.IsEmpty() ? config.Offset.y : heights.Sample(x, z);
+	}
+
+	// Closed-form paths over the terrain square, t in [0, 1)
+	bool ScriptedPath(const std::string& name, const BenchConfig& config, const HeightField& heights, std::vector<CameraFrame>& frames)
+	{
+		const float size = config.Size;
+		const float cx = config.Offset.x + 0.5f * size;
+		const float cz = config.Offset.z + 0.5f * size;
+		const float fov = 0.25f * Pi;
+		frames.resize(config.Frames);
+
+		for (int i = 0; i < config.Frames; ++i)
+		{
+			const float t = (float)i / config.Frames;
+			CameraFrame& f = frames[i];
+			f.FovY = fov;
+			if (name == "orbit")
+			{
+				// High circle looking at the centre: most of the map, coarse LODs
+				const float a = 2.0f * Pi * t;
+				f.Position = XMFLOAT3(cx + 0.45f * size * std::cos(a), config.Offset.y + config.HeightScale, cz + 0.45f * size * std::sin(a));
+				f.Look = Normalized(cx - f.Position.x, config.Offset.y - f.Position.y, cz - f.Position.z);
+			}
+			else if (name == "flyover")
+			{
+				// Corner to corner at medium height, slightly downwards
+				const float x = config.Offset.x + size * (0.05f + 0.9f * t);
+				const float z = config.Offset.z + size * (0.05f + 0.9f * t);
+				f.Position = XMFLOAT3(x, config.Offset.y + 0.5f * config.HeightScale, z);
+				f.Look = Normalized(1.0f, -0.3f, 1.0f);
+			}
+			else if (name == "ground")
+			{
+				// Low over the ground along a wavy line, looking at the horizon:
+				// fine LODs, and where the horizon culler earns its keep
+				const float x = config.Offset.x + size * (0.1f + 0.8f * t);
+				const float z = cz + 0.3f * size * std::sin(4.0f * Pi * t);
+				f.Position = XMFLOAT3(x, GroundHeight(heights, config, x, z) + 10.0f, z);
+				f.Look = Normalized(0.8f, -0.05f, 0.3f * 4.0f * Pi * std::cos(4.0f * Pi * t));
+			}
+			else
+			{
+				frames.clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool LoadPath(const std::string& file, std::vector<CameraFrame>& frames)
+	{
+		std::ifstream in(file);
+		if (!in)
+			return false;
+		frames.clear();
+		std::string line;
+		while (std::getline(in, line))
+		{
+			const size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.resize(comment);
+			std::istringstream fields(line);
+			CameraFrame f;
+			float fovDegrees;
+			if (fields >> f.Position.x >> f.Position.y >> f.Position.z >> f.Look.x >> f.Look.y >> f.Look.z >> fovDegrees)
+			{
+				f.Look = Normalized(f.Look.x, f.Look.y, f.Look.z);
+				f.FovY = fovDegrees * Pi / 180.0f;
+				frames.push_back(f);
+			}
+		}
+		return !frames.empty();
+	}
+
+	// Same frustum as Camera::UpdateFrustum
+	BoundingFrustum MakeFrustum(const CameraFrame& f, const BenchConfig& config)
+	{
+		const XMVECTOR eye = XMLoadFloat3(&f.Position);
+		const XMVECTOR look = XMLoadFloat3(&f.Look);
+		const XMMATRIX view = XMMatrixLookToLH(eye, look, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(f.FovY, config.Aspect, config.NearZ, config.FarZ);
+
+		BoundingFrustum frustum;
+		BoundingFrustum::CreateFromMatrix(frustum, proj);
+		XMVECTOR det;
+		frustum.Transform(frustum, XMMatrixInverse(&det, view));
+		return frustum;
+	}
+
+	void FitCascades(const CameraFrame& f, const BenchConfig& config, std::vector<ShadowCascade>& cascades, std::vector<FrustumPlanes>& planes)
+	{
+		CascadeParams params;
+		const XMFLOAT3 right = Normalized(f.Look.z, 0.0f, -f.Look.x);
+		const XMFLOAT3 up = XMFLOAT3(
+			f.Look.y * right.z - f.Look.z * right.y,
+			f.Look.z * right.x - f.Look.x * right.z,
+			f.Look.x * right.y - f.Look.y * right.x);
+		memcpy(params.Eye, &f.Position, sizeof(params.Eye));
+		memcpy(params.Right, &right, sizeof(params.Right));
+		memcpy(params.Up, &up, sizeof(params.Up));
+		memcpy(params.Look, &f.Look, sizeof(params.Look));
+		memcpy(params.LightDir, &config.LightDirection, sizeof(params.LightDir));
+		params.FovY = f.FovY;
+		params.Aspect = config.Aspect;
+		params.NearZ = config.NearZ;
+		params.FarZ = (std::min)(config.ShadowDistance, config.FarZ);
+		params.Count = config.Cascades;
+		params.CasterDistance = config.Size;
+		ShadowCascades::Fit(params, cascades);
+
+		planes.clear();
+		for (const auto& cascade : cascades)
+			planes.push_back(cascade.Planes);
+	}
+
+	// The walk Terrain::Update makes, with one shadow view and no camera
+	void WalkShadowView(Terrain& terrain, const XMFLOAT3& eye, BoundingFrustum& frustum, const FrustumPlanes& view, std::vector<Tile*>& tiles)
+	{
+		TerrainCullContext context;
+		context.Frustum = &frustum;
+		context.CameraPos = eye;
+		context.HeightScale = terrain.mHeightScale;
+		context.MapSize = (int)terrain.mWorldSize;
+		context.ShadowViews = &view;
+		context.ShadowViewCount = 1;
+		context.ShadowTiles = &tiles;
+		terrain.GetRoot()->UpdateVisibility(context, false, ViewCullState::All(1));
+	}
+
+	// Built-in heights: a few octaves of smooth bumps, no file needed
+	void BuildHills(HeightField& heights, uint32_t resolution)
+	{
+		std::vector<float> samples((size_t)resolution * resolution);
+		for (uint32_t y = 0; y < resolution; ++y)
+		{
+			for (uint32_t x = 0; x < resolution; ++x)
+			{
+				const float u = (float)x / resolution, v = (float)y / resolution;
+				float h = 0.0f, amplitude = 0.5f, frequency = 2.0f;
+				for (int octave = 0; octave < 5; ++octave)
+				{
+					h += amplitude * (0.5f + 0.5f * std::sin(2.0f * Pi * frequency * u + octave) * std::cos(2.0f * Pi * frequency * v + 2.0f * octave));
+					amplitude *= 0.5f;
+					frequency *= 2.0f;
+				}
+				samples[(size_t)y * resolution + x] = (std::min)(h, 1.0f);
+			}
+		}
+		heights.Init(samples.data(), resolution, resolution);
+	}
+
+	int gFailures = 0;
+
+	void Check(bool ok, const char* test, const std::string& detail)
+	{
+		if (ok)
+			return;
+		++gFailures;
+		std::cerr << "FAIL " << test << ": " << detail << "\n";
+	}
+
+	// Low cameras, each over the lowest of 16 random points, looking roughly
+	// level: where the horizon culler has the most to hide. The seed is
+	// fixed, so every run checks the same views.
+	std::vector<CameraFrame> ValleyViews(const BenchConfig& config, const HeightField& heights)
+	{
+		uint32_t random = 5;
+		auto next = [&random]()
+		{
+			random = random * 1664525u + 1013904223u;
+			return (float)(random >> 8) * (1.0f / 16777216.0f);
+		};
+		std::vector<CameraFrame> views(config.Views);
+		for (CameraFrame& f : views)
+		{
+			float x = 0.0f, z = 0.0f, ground = INFINITY;
+			for (int candidate = 0; candidate < 16; ++candidate)
+			{
+				const float cx = config.Offset.x + config.Size * (0.1f + 0.8f * next());
+				const float cz = config.Offset.z + config.Size * (0.1f + 0.8f * next());
+				const float cy = GroundHeight(heights, config, cx, cz);
+				if (cy < ground)
+				{
+					x = cx;
+					z = cz;
+					ground = cy;
+				}
+			}
+			f.Position = XMFLOAT3(x, ground + 2.0f + 20.0f * next(), z);
+			const float yaw = 2.0f * Pi * next(), pitch = -0.1f + 0.15f * next();
+			f.Look = XMFLOAT3(std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw));
+			f.FovY = 0.25f * Pi;
+		}
+		return views;
+	}
+
+	// Ground truth: the straight line from the eye to the point stays above
+	// the heightfield, sampled every half unit
+	bool PointVisible(const HeightField& heights, const XMFLOAT3& eye, float x, float y, float z)
+	{
+		const float dx = x - eye.x, dy = y - eye.y, dz = z - eye.z;
+		const int steps = (std::max)(8, (int)(std::sqrt(dx * dx + dz * dz) / 0.5f));
+		for (int k = 1; k < steps; ++k)
+		{
+			const float t = (float)k / steps;
+			if (eye.y + dy * t < heights.Sample(eye.x + dx * t, eye.z + dz * t) - 1e-3f)
+				return false;
+		}
+		return true;
+	}
+
+	// Whether any of a grid of surface points over the tile, edges included,
+	// can be seen from the eye
+	const int TileProbes = 9;
+
+	bool TileVisible(const HeightField& heights, const XMFLOAT3& eye, const Tile& tile)
+	{
+		const XMFLOAT3& c = tile.boundingBox.Center;
+		const XMFLOAT3& e = tile.boundingBox.Extents;
+		for (int j = 0; j < TileProbes; ++j)
+		{
+			for (int i = 0; i < TileProbes; ++i)
+			{
+				const float x = c.x - e.x + 2.0f * e.x * i / (TileProbes - 1);
+				const float z = c.z - e.z + 2.0f * e.z * j / (TileProbes - 1);
+				if (PointVisible(heights, eye, x, heights.Sample(x, z), z))
+					return true;
+			}
+		}
+		return false;
+	}
+
+	struct HorizonView
+	{
+		size_t Tiles;        // selected without horizon culling
+		size_t Culled;       // of those, dropped with it
+		size_t Hidden;       // of those, no probe visible
+		double CulledPercent;
+		double HiddenPercent;
+	};
+
+	// Walks every view with and without horizon culling. Culling may only drop
+	// tiles, and only tiles no probe sees.
+	std::vector<HorizonView> CheckHorizon(const BenchConfig& config, Terrain& terrain, const HeightField& heights)
+	{
+		const bool horizon = terrain.mUseHorizonCulling;
+		const std::vector<CameraFrame> views = ValleyViews(config, heights);
+		std::vector<HorizonView> results;
+		std::vector<uint8_t> kept(terrain.GetAllTiles().size());
+		for (size_t v = 0; v < views.size(); ++v)
+		{
+			const CameraFrame& f = views[v];
+			const std::string where = "view " + std::to_string(v);
+
+			BoundingFrustum frustum = MakeFrustum(f, config);
+			terrain.mUseHorizonCulling = false;
+			terrain.Update(f.Position, frustum);
+			const std::vector<Tile*> all = terrain.GetVisibleTiles();
+
+			frustum = MakeFrustum(f, config);
+			terrain.mUseHorizonCulling = true;
+			terrain.Update(f.Position, frustum);
+			std::fill(kept.begin(), kept.end(), 0);
+			for (const Tile* tile : terrain.GetVisibleTiles())
+				kept[tile->tileIndex] = 1;
+
+			HorizonView result = {};
+			result.Tiles = all.size();
+			size_t found = 0, visibleCulled = 0;
+			for (const Tile* tile : all)
+			{
+				const bool visible = TileVisible(heights, f.Position, *tile);
+				result.Hidden += !visible;
+				found += kept[tile->tileIndex];
+				if (!kept[tile->tileIndex])
+				{
+					++result.Culled;
+					visibleCulled += visible;
+				}
+			}
+			Check(found == terrain.GetVisibleTiles().size(), "horizon", where + ": " +
+				std::to_string(terrain.GetVisibleTiles().size() - found) + " tiles selected only with horizon culling");
+			Check(visibleCulled == 0, "horizon", where + ": " + std::to_string(visibleCulled) + " culled tiles are visible along a ray");
+
+			result.CulledPercent = result.Tiles ? 100.0 * result.Culled / result.Tiles : 0.0;
+			result.HiddenPercent = result.Tiles ? 100.0 * result.Hidden / result.Tiles : 0.0;
+			results.push_back(result);
+		}
+		terrain.mUseHorizonCulling = horizon;
+		return results;
+	}
+
+	bool ParseArgs(int argc, char** argv, BenchConfig& config)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--heightmap" && hasValue) config.Heightmap = argv[++i];
+			else if (arg == "--size" && hasValue) config.Size = (float)atof(argv[++i]);
+			else if (arg == "--maxlod" && hasValue) config.MaxLod = atoi(argv[++i]);
+			else if (arg == "--height-scale" && hasValue) config.HeightScale = (float)atof(argv[++i]);
+			else if (arg == "--path" && hasValue) config.Paths.push_back(argv[++i]);
+			else if (arg == "--frames" && hasValue) config.Frames = (std::max)(atoi(argv[++i]), 1);
+			else if (arg == "--warmup" && hasValue) config.Warmup = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--cascades" && hasValue) config.Cascades = (uint32_t)(std::min)((std::max)(atoi(argv[++i]), 0), (int)ViewCullState::MaxViews);
+			else if (arg == "--no-horizon") config.Horizon = false;
+			else if (arg == "--views" && hasValue) config.Views = (std::max)(atoi(argv[++i]), 0);
+			else if (arg == "--label" && hasValue) config.Label = argv[++i];
+			else if (arg == "--out" && hasValue) config.Out = argv[++i];
+			else
+			{
+				std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+				return false;
+			}
+		}
+		if (config.Paths.empty())
+			config.Paths = { "orbit", "flyover", "ground" };
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+		return 2;
+
+	HeightField heights;
+	if (!config.Heightmap.empty())
+	{
+		std::vector<uint8_t> rgba;
+		uint32_t width = 0, height = 0;
+		if (!BCEncoder::LoadDDS(std::filesystem::path(config.Heightmap).wstring(), rgba, width, height))
+		{
+			std::cerr << "Cannot load " << config.Heightmap << "\n";
+			return 1;
+		}
+		heights.Init(rgba.data(), width, height, (size_t)width * 4);
+	}
+	else
+	{
+		BuildHills(heights, 512);
+	}
+	heights.SetPlacement(config.Offset.x, config.Offset.z, config.Size, config.Offset.y, config.HeightScale);
+
+	const auto buildStart = std::chrono::steady_clock::now();
+	Terrain terrain;
+	terrain.Initialize(config.Size, config.MaxLod, config.Offset);
+	terrain.mHeightScale = config.HeightScale;
+	terrain.SetHeights(&heights);
+	terrain.mUseHorizonCulling = config.Horizon;
+	const double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+	const std::vector<HorizonView> valleys = CheckHorizon(config, terrain, heights);
+	size_t valleyTiles = 0, valleyCulled = 0, valleyHidden = 0;
+	for (const HorizonView& v : valleys)
+	{
+		valleyTiles += v.Tiles;
+		valleyCulled += v.Culled;
+		valleyHidden += v.Hidden;
+	}
+	fprintf(stderr, "horizon: %d valley views, %zu tiles, culled %.1f%%, hidden along every ray %.1f%%\n", config.Views, valleyTiles,
+		valleyTiles ? 100.0 * valleyCulled / valleyTiles : 0.0, valleyTiles ? 100.0 * valleyHidden / valleyTiles : 0.0);
+
+	std::ostringstream out;
+	out.precision(6);
+	out << "{\n";
+	out << "  \"benchmark\": \"TerrainBench\",\n";
+	out << "  \"label\": " << JsonString(config.Label) << ",\n";
+	out << "  \"config\": { \"heightmap\": " << JsonString(config.Heightmap.empty() ? "hills" : config.Heightmap)
+		<< ", \"size\": " << config.Size << ", \"maxlod\": " << config.MaxLod << ", \"height_scale\": " << config.HeightScale
+		<< ", \"frames\": " << config.Frames << ", \"warmup\": " << config.Warmup << ", \"cascades\": " << config.Cascades
+		<< ", \"horizon\": " << (config.Horizon ? "true" : "false") << ", \"views\": " << config.Views << ", \"failures\": " << gFailures << " },\n";
+	out << "  \"tiles_total\": " << terrain.GetAllTiles().size() << ",\n";
+	out << "  \"build_ms\": " << buildMs << ",\n";
+	out << "  \"horizon_check\": {\n";
+	out << "      \"tiles\": " << valleyTiles << ", \"culled\": " << valleyCulled << ", \"hidden\": " << valleyHidden << ",\n";
+	WriteSummary(out, "culled_percent", valleys, [](const HorizonView& v) { return v.CulledPercent; });
+	WriteSummary(out, "hidden_percent", valleys, [](const HorizonView& v) { return v.HiddenPercent; }, true);
+	out << "  },\n";
+	out << "  \"paths\": [\n";
+
+	std::vector<ShadowCascade> cascades;
+	std::vector<FrustumPlanes> shadowPlanes;
+	std::vector<Tile*> separateTiles[ViewCullState::MaxViews];
+	for (size_t p = 0; p < config.Paths.size(); ++p)
+	{
+		const std::string& name = config.Paths[p];
+		std::vector<CameraFrame> frames;
+		if (!ScriptedPath(name, config, heights, frames) && !LoadPath(name, frames))
+		{
+			std::cerr << "Unknown path or unreadable file: " << name << "\n";
+			return 1;
+		}
+
+		auto runFrame = [&](const CameraFrame& f, FrameSample* sample)
+		{
+			BoundingFrustum frustum = MakeFrustum(f, config);
+			if (config.Cascades > 0)
+				FitCascades(f, config, cascades, shadowPlanes);
+
+			const uint64_t allocations = gAllocations.load(std::memory_order_relaxed);
+			const auto start = std::chrono::steady_clock::now();
+			terrain.Update(f.Position, frustum, shadowPlanes.data(), (uint32_t)shadowPlanes.size());
+			const auto end = std::chrono::steady_clock::now();
+			if (!sample)
+				return;
+
+			sample->Ms = std::chrono::duration<double, std::milli>(end - start).count();
+			sample->Allocations = gAllocations.load(std::memory_order_relaxed) - allocations;
+			sample->Nodes = terrain.mNodesVisited;
+			sample->Tiles = (int)terrain.GetVisibleTiles().size();
+			sample->HorizonCulled = terrain.mHorizonCulledNodes;
+			sample->Triangles = sample->Tiles * TileTriangles;
+			sample->ShadowTiles = 0;
+			for (uint32_t i = 0; i < terrain.GetShadowViewCount(); ++i)
+				sample->ShadowTiles += terrain.GetShadowTiles(i).size();
+
+			sample->SeparateMs = 0.0;
+			if (shadowPlanes.empty())
+				return;
+			frustum = MakeFrustum(f, config);
+			const auto separateStart = std::chrono::steady_clock::now();
+			terrain.Update(f.Position, frustum);
+			for (size_t i = 0; i < shadowPlanes.size(); ++i)
+			{
+				separateTiles[i].clear();
+				WalkShadowView(terrain, f.Position, frustum, shadowPlanes[i], separateTiles[i]);
+			}
+			sample->SeparateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - separateStart).count();
+			uint64_t separate = 0;
+			for (size_t i = 0; i < shadowPlanes.size(); ++i)
+				separate += separateTiles[i].size();
+			if (separate != sample->ShadowTiles)
+				Check(false, "shadow walks", name + ": " + std::to_string(separate) + " shadow tiles with a walk per view, " +
+					std::to_string(sample->ShadowTiles) + " with one walk");
+		};
+
+		for (int i = 0; i < config.Warmup; ++i)
+			runFrame(frames[i % frames.size()], nullptr);
+
+		// FNV-1a over the selected tile indices of every frame
+		uint64_t hash = 14695981039346656037ull;
+		std::vector<FrameSample> samples(frames.size());
+		for (size_t i = 0; i < frames.size(); ++i)
+		{
+			runFrame(frames[i], &samples[i]);
+			for (const Tile* tile : terrain.GetVisibleTiles())
+				hash = (hash ^ (uint64_t)tile->tileIndex) * 1099511628211ull;
+			hash = (hash ^ 0xFFFFFFFFull) * 1099511628211ull;
+		}
+
+		if (config.Cascades > 0)
+		{
+			std::vector<double> shared, separate;
+			for (const FrameSample& s : samples)
+			{
+				shared.push_back(s.Ms);
+				separate.push_back(s.SeparateMs);
+			}
+			const double sharedMs = Percentile(shared, 0.50), separateMs = Percentile(separate, 0.50);
+			fprintf(stderr, "%s: %u views, one walk %.4f ms, one per view %.4f ms (%4.2fx)\n", name.c_str(), config.Cascades + 1, sharedMs,
+				separateMs, sharedMs > 0.0 ? separateMs / sharedMs : 0.0);
+		}
+
+		char hashText[17];
+		snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)hash);
+		out << "    {\n";
+		out << "      \"name\": " << JsonString(name) << ",\n";
+		out << "      \"frames\": " << frames.size() << ",\n";
+		out << "      \"selection_hash\": \"" << hashText << "\",\n";
+		WriteSummary(out, "update_ms", samples, [](const FrameSample& s) { return s.Ms; });
+		if (config.Cascades > 0)
+			WriteSummary(out, "separate_update_ms", samples, [](const FrameSample& s) { return s.SeparateMs; });
+		WriteSummary(out, "nodes_visited", samples, [](const FrameSample& s) { return s.Nodes; });
+		WriteSummary(out, "tiles", samples, [](const FrameSample& s) { return s.Tiles; });
+		WriteSummary(out, "horizon_culled", samples, [](const FrameSample& s) { return s.HorizonCulled; });
+		WriteSummary(out, "triangles", samples, [](const FrameSample& s) { return s.Triangles; });
+		WriteSummary(out, "shadow_tiles", samples, [](const FrameSample& s) { return s.ShadowTiles; });
+		WriteSummary(out, "allocations", samples, [](const FrameSample& s) { return s.Allocations; }, true);
+		out << "    }" << (p + 1 < config.Paths.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n}\n";
+
+	if (config.Out.empty())
+	{
+		std::cout << out.str();
+	}
+	else
+	{
+		std::ofstream file(config.Out, std::ios::binary | std::ios::trunc);
+		file << out.str();
+		if (!file)
+		{
+			std::cerr << "Cannot write " << config.Out << "\n";
+			return 1;
+		}
+	}
+	if (gFailures)
+	{
+		std::cerr << gFailures << " check(s) failed\n";
+		return 3;
+	}
+	return 0;
+}